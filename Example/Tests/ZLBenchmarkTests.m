@@ -0,0 +1,830 @@
+//
+//  ZLBenchmarkTests.m
+//  ZLNetworking_Tests
+//
+//  Created by lylaut on 2022/3/31.
+//  Copyright (c) 2022 richiezhl. All rights reserved.
+//
+
+@import XCTest;
+@import ImageIO;
+@import MobileCoreServices;
+
+#import <ZLNetworking/ZLURLSessionManager.h>
+#import <ZLNetworking/ZLWebSocket.h>
+#import <ZLNetworking/ZLXMLDictionary.h>
+#import <ZLNetworking/ZLBinarySerialization.h>
+#import <ZLNetworking/ZLNetImage.h>
+#import <ZLNetworking/ZLImageMemoryCache.h>
+#import <ZLNetworking/ZLDecodedImageCache.h>
+#import "ZLBenchmarkResults.h"
+#import "ZLLoopbackServer.h"
+
+/// 库层面的基准测试，和 ZLNetworking/Benchmarks 共用本地服务器和 JSON 结果格式。
+/// 耗时较长，只在环境变量 ZL_BENCHMARK=1 时运行；结果写到 ZL_BENCHMARK_OUTPUT，默认在临时目录下
+static BOOL ZLBenchmarkEnabled(void) {
+    return [[NSProcessInfo processInfo].environment[@"ZL_BENCHMARK"] boolValue];
+}
+
+static ZLLoopbackServer *ZLBenchmarkServer;
+static ZLBenchmarkResults *ZLBenchmarkTestResults;
+
+@interface ZLBenchmarkSocketDelegate : NSObject <ZLWebSocketDelegate>
+
+@property (nonatomic, copy) void (^openBlock)(void);
+@property (nonatomic, copy) void (^messageBlock)(NSData *data);
+@property (nonatomic, copy) void (^failBlock)(NSError *error);
+
+@end
+
+@implementation ZLBenchmarkSocketDelegate
+
+- (NSURL *)webSocketReConnectURL {
+    return nil;
+}
+
+- (NSURLRequest *)webSocketReConnectRequest {
+    return nil;
+}
+
+- (void)webSocketDidOpen:(ZLWebSocket *)webSocket {
+    if (self.openBlock) {
+        self.openBlock();
+    }
+}
+
+- (void)webSocket:(ZLWebSocket *)webSocket didReceiveMessageWithData:(NSData *)data {
+    if (self.messageBlock) {
+        self.messageBlock(data);
+    }
+}
+
+- (void)webSocket:(ZLWebSocket *)webSocket didFailWithError:(NSError *)error {
+    if (self.failBlock) {
+        self.failBlock(error);
+    }
+}
+
+@end
+
+@protocol ZLBenchmarkImageCache <NSObject>
+
+- (UIImage *)imageForKey:(NSString *)key;
+
+- (void)setImage:(UIImage *)image forKey:(NSString *)key;
+
+- (void)removeAllImages;
+
+@end
+
+@interface ZLImageMemoryCache (ZLBenchmark) <ZLBenchmarkImageCache>
+
+@end
+
+@interface ZLBenchmarkLinkedListNode : NSObject
+
+@property (nonatomic, strong) UIImage *image;
+@property (nonatomic, copy) NSString *identifier;
+@property (nonatomic, assign) NSTimeInterval timestamp;
+@property (nonatomic, strong) ZLBenchmarkLinkedListNode *prev;
+@property (nonatomic, strong) ZLBenchmarkLinkedListNode *next;
+
+@end
+
+@implementation ZLBenchmarkLinkedListNode
+
+@end
+
+/// 分片之前 ZLImageCacheManager 的内存缓存，作为对照：串行队列保护一条链表，
+/// 查找时从两头向中间逐个比较 identifier，命中后再同步一次把节点移到头部
+@interface ZLBenchmarkLinkedListImageCache : NSObject <ZLBenchmarkImageCache>
+
+@property (nonatomic, strong) dispatch_queue_t serialQueue;
+@property (nonatomic, strong) ZLBenchmarkLinkedListNode *header;
+@property (nonatomic, strong) ZLBenchmarkLinkedListNode *footer;
+@property (nonatomic, strong) NSMutableSet<NSString *> *cacheIdentifiers;
+
+@end
+
+@implementation ZLBenchmarkLinkedListImageCache
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _serialQueue = dispatch_queue_create("com.richie.zlnetimage.sync", DISPATCH_QUEUE_SERIAL);
+        _cacheIdentifiers = [NSMutableSet set];
+    }
+    return self;
+}
+
+- (void)setImage:(UIImage *)image forKey:(NSString *)key {
+    dispatch_sync(self.serialQueue, ^{
+        if ([self.cacheIdentifiers containsObject:key]) {
+            return;
+        }
+        [self.cacheIdentifiers addObject:key];
+        ZLBenchmarkLinkedListNode *node = [ZLBenchmarkLinkedListNode new];
+        node.image = image;
+        node.identifier = key;
+        node.timestamp = [NSDate date].timeIntervalSince1970;
+        if (self.header == nil) {
+            self.header = node;
+        } else {
+            self.footer.next = node;
+            node.prev = self.footer;
+        }
+        self.footer = node;
+    });
+}
+
+- (ZLBenchmarkLinkedListNode *)findNodeForKey:(NSString *)key {
+    __block ZLBenchmarkLinkedListNode *resultNode = nil;
+    dispatch_sync(self.serialQueue, ^{
+        ZLBenchmarkLinkedListNode *headerNode = self.header;
+        ZLBenchmarkLinkedListNode *footerNode = self.footer;
+        while (headerNode != footerNode) {
+            if ([headerNode.identifier isEqualToString:key]) {
+                resultNode = headerNode;
+            }
+            if ([footerNode.identifier isEqualToString:key]) {
+                resultNode = footerNode;
+            }
+            headerNode = headerNode.next;
+            footerNode = footerNode.prev;
+        }
+        if (resultNode == nil && headerNode && [headerNode.identifier isEqualToString:key]) {
+            resultNode = headerNode;
+        }
+    });
+    return resultNode;
+}
+
+- (void)updateNode:(ZLBenchmarkLinkedListNode *)node {
+    dispatch_sync(self.serialQueue, ^{
+        node.timestamp = [NSDate date].timeIntervalSince1970;
+        if (node == self.header) {
+            return;
+        } else if (node == self.footer) {
+            node.prev.next = nil;
+            self.footer = node.prev;
+        } else {
+            node.prev.next = node.next;
+            node.next.prev = node.prev;
+        }
+        self.header.prev = node;
+        node.next = self.header;
+        node.prev = nil;
+        self.header = node;
+    });
+}
+
+- (UIImage *)imageForKey:(NSString *)key {
+    ZLBenchmarkLinkedListNode *node = [self findNodeForKey:key];
+    if (node == nil) {
+        return nil;
+    }
+    [self updateNode:node];
+    return node.image;
+}
+
+/// 逐个断开强引用，避免释放长链表时递归过深
+- (void)removeAllImages {
+    dispatch_sync(self.serialQueue, ^{
+        ZLBenchmarkLinkedListNode *headerNode = self.header;
+        while (headerNode) {
+            ZLBenchmarkLinkedListNode *next = headerNode.next;
+            headerNode.next = nil;
+            next.prev = nil;
+            headerNode = next;
+        }
+        self.header = nil;
+        self.footer = nil;
+        [self.cacheIdentifiers removeAllObjects];
+    });
+}
+
+@end
+
+@interface ZLBenchmarkTests : XCTestCase
+
+@end
+
+@implementation ZLBenchmarkTests
+
++ (void)setUp {
+    [super setUp];
+    if (!ZLBenchmarkEnabled()) {
+        return;
+    }
+    ZLBenchmarkServer = ZLLoopbackServerStart(0);
+    ZLBenchmarkTestResults = ZLBenchmarkResultsCreate("zlnetworking-ios");
+}
+
++ (void)tearDown {
+    if (ZLBenchmarkTestResults) {
+        NSString *path = [NSProcessInfo processInfo].environment[@"ZL_BENCHMARK_OUTPUT"];
+        if (path.length == 0) {
+            path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"zlnetworking-benchmark.json"];
+        }
+        FILE *file = fopen(path.fileSystemRepresentation, "w");
+        if (file) {
+            ZLBenchmarkResultsWrite(ZLBenchmarkTestResults, file);
+            fclose(file);
+            NSLog(@"benchmark results: %@", path);
+        }
+        ZLBenchmarkResultsDestroy(ZLBenchmarkTestResults);
+        ZLBenchmarkTestResults = NULL;
+    }
+    ZLLoopbackServerStop(ZLBenchmarkServer);
+    ZLBenchmarkServer = NULL;
+    [super tearDown];
+}
+
+- (void)setUp {
+    [super setUp];
+    self.continueAfterFailure = NO;
+}
+
+- (NSString *)URLStringWithPath:(NSString *)path {
+    return [NSString stringWithFormat:@"http://127.0.0.1:%u%@", ZLLoopbackServerPort(ZLBenchmarkServer), path];
+}
+
+- (NSURL *)temporaryFileURL {
+    NSString *name = [NSString stringWithFormat:@"zlbenchmark-%@", [NSUUID UUID].UUIDString];
+    return [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:name]];
+}
+
+#pragma mark - http
+
+- (void)testSmallGETThroughput {
+    if (!ZLBenchmarkEnabled()) {
+        return;
+    }
+    const NSUInteger requestCount = 5000;
+    const NSUInteger concurrency = 8;
+    NSString *URLString = [self URLStringWithPath:@"/bytes/128"];
+    double *samples = calloc(requestCount, sizeof(double));
+    __block NSUInteger failures = 0;
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"small GETs"];
+    dispatch_semaphore_t window = dispatch_semaphore_create(concurrency);
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_queue_t lock = dispatch_queue_create("com.richie.benchmark.lock", DISPATCH_QUEUE_SERIAL);
+    double start = ZLBenchmarkNow();
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        for (NSUInteger i = 0; i < requestCount; i++) {
+            dispatch_semaphore_wait(window, DISPATCH_TIME_FOREVER);
+            dispatch_group_enter(group);
+            double sent = ZLBenchmarkNow();
+            [[ZLURLSessionManager shared] GET:URLString parameters:nil headers:nil responseBodyType:ZLResponseBodyTypeDefault success:^(NSHTTPURLResponse *urlResponse, id responseObject) {
+                samples[i] = (ZLBenchmarkNow() - sent) * 1e6;
+                dispatch_semaphore_signal(window);
+                dispatch_group_leave(group);
+            } failure:^(NSError *error) {
+                dispatch_sync(lock, ^{
+                    failures++;
+                });
+                dispatch_semaphore_signal(window);
+                dispatch_group_leave(group);
+            }];
+        }
+        dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+            [expectation fulfill];
+        });
+    });
+    [self waitForExpectationsWithTimeout:120 handler:nil];
+    double elapsed = ZLBenchmarkNow() - start;
+
+    XCTAssertEqual(failures, 0);
+    ZLBenchmarkResultsAdd(ZLBenchmarkTestResults, "session_small_get", "requests/s", requestCount / elapsed, true);
+    ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "concurrency", concurrency);
+    ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "body_bytes", 128);
+    ZLBenchmarkResultsSetSamples(ZLBenchmarkTestResults, "us", samples, requestCount);
+    free(samples);
+}
+
+- (void)testLargeDownloadThroughput {
+    if (!ZLBenchmarkEnabled()) {
+        return;
+    }
+    const unsigned long long size = 256ull * 1024 * 1024;
+    NSURL *url = [NSURL URLWithString:[self URLStringWithPath:[NSString stringWithFormat:@"/bytes/%llu", size]]];
+
+    for (NSUInteger segmentCount = 1; segmentCount <= 4; segmentCount *= 4) {
+        NSURL *destination = [self temporaryFileURL];
+        XCTestExpectation *expectation = [self expectationWithDescription:@"download"];
+        __block NSError *downloadError = nil;
+        double start = ZLBenchmarkNow();
+        [[ZLURLSessionManager shared] downloadWithRequest:[NSURLRequest requestWithURL:url] headers:nil destination:destination segmentCount:segmentCount progress:nil completionHandler:^(NSURLResponse *response, NSURL *filePath, NSError *error) {
+            downloadError = error;
+            [expectation fulfill];
+        }];
+        [self waitForExpectationsWithTimeout:300 handler:nil];
+        double elapsed = ZLBenchmarkNow() - start;
+
+        XCTAssertNil(downloadError);
+        NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:destination.path error:nil];
+        XCTAssertEqual(attributes.fileSize, size);
+        ZLBenchmarkResultsAdd(ZLBenchmarkTestResults, "session_download", "MiB/s", size / 1048576.0 / elapsed, true);
+        ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "bytes", size);
+        ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "segments", segmentCount);
+        [[NSFileManager defaultManager] removeItemAtURL:destination error:nil];
+    }
+}
+
+- (void)testMultipartUploadMemory {
+    if (!ZLBenchmarkEnabled()) {
+        return;
+    }
+    const NSUInteger size = 128 * 1024 * 1024;
+    NSURL *fileURL = [self temporaryFileURL];
+    [[NSFileManager defaultManager] createFileAtPath:fileURL.path contents:nil attributes:nil];
+    NSFileHandle *handle = [NSFileHandle fileHandleForWritingToURL:fileURL error:nil];
+    NSMutableData *chunk = [NSMutableData dataWithLength:1024 * 1024];
+    for (NSUInteger offset = 0; offset < size; offset += chunk.length) {
+        uint8_t *bytes = chunk.mutableBytes;
+        for (NSUInteger i = 0; i < chunk.length; i++) {
+            bytes[i] = ZLLoopbackServerByteAt(offset + i);
+        }
+        [handle writeData:chunk];
+    }
+    [handle closeFile];
+    chunk = nil;
+
+    // 流式上传时常驻内存不应随文件大小增长
+    size_t baseline = ZLBenchmarkResidentSize();
+    __block size_t peak = baseline;
+    __block id received = nil;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"upload"];
+    double start = ZLBenchmarkNow();
+    [[ZLURLSessionManager shared] POST:[self URLStringWithPath:@"/upload"] parameters:nil constructingBodyWithBlock:^(ZLMultipartFormData *formData) {
+        [formData appendPartWithFileURL:fileURL name:@"file" fileName:@"upload.bin" mimeType:@"application/octet-stream"];
+    } headers:nil responseBodyType:ZLResponseBodyTypeJson progress:^(float uploadProgress) {
+        size_t resident = ZLBenchmarkResidentSize();
+        if (resident > peak) {
+            peak = resident;
+        }
+    } success:^(NSHTTPURLResponse *urlResponse, id responseObject) {
+        received = responseObject[@"received"];
+        [expectation fulfill];
+    } failure:^(NSError *error) {
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:300 handler:nil];
+    double elapsed = ZLBenchmarkNow() - start;
+    [[NSFileManager defaultManager] removeItemAtURL:fileURL error:nil];
+
+    XCTAssertGreaterThan([received unsignedLongLongValue], (unsigned long long)size);
+    ZLBenchmarkResultsAdd(ZLBenchmarkTestResults, "session_multipart_upload", "MiB/s", size / 1048576.0 / elapsed, true);
+    ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "bytes", size);
+    ZLBenchmarkResultsAdd(ZLBenchmarkTestResults, "session_multipart_upload_rss_growth", "MiB", (peak - baseline) / 1048576.0, false);
+    ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "bytes", size);
+}
+
+#pragma mark - websocket
+
+- (ZLWebSocket *)openWebSocketWithPath:(NSString *)path delegate:(ZLBenchmarkSocketDelegate *)delegate {
+    NSString *URLString = [NSString stringWithFormat:@"ws://127.0.0.1:%u%@", ZLLoopbackServerPort(ZLBenchmarkServer), path];
+    ZLWebSocket *webSocket = [[ZLWebSocket alloc] initWithURL:[NSURL URLWithString:URLString]];
+    webSocket.delegateDispatchQueue = dispatch_queue_create("com.richie.benchmark.websocket", DISPATCH_QUEUE_SERIAL);
+    webSocket.delegate = delegate;
+    XCTestExpectation *opened = [self expectationWithDescription:@"open"];
+    delegate.openBlock = ^{
+        [opened fulfill];
+    };
+    [webSocket open];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    delegate.openBlock = nil;
+    return webSocket;
+}
+
+- (void)testWebSocketEchoLatency {
+    if (!ZLBenchmarkEnabled()) {
+        return;
+    }
+    const NSUInteger sizes[] = { 16, 1024, 64 * 1024, 1024 * 1024 };
+    const NSUInteger counts[] = { 5000, 5000, 1000, 100 };
+
+    for (NSUInteger s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        NSUInteger size = sizes[s], count = counts[s];
+        NSMutableData *message = [NSMutableData dataWithLength:size];
+        uint8_t *bytes = message.mutableBytes;
+        for (NSUInteger i = 0; i < size; i++) {
+            bytes[i] = ZLLoopbackServerByteAt(i);
+        }
+
+        ZLBenchmarkSocketDelegate *delegate = [ZLBenchmarkSocketDelegate new];
+        ZLWebSocket *webSocket = [self openWebSocketWithPath:@"/ws/echo" delegate:delegate];
+
+        // 一问一答，收到回显后再发下一条，样本就是往返时间
+        double *samples = calloc(count, sizeof(double));
+        __block NSUInteger received = 0;
+        __block NSUInteger mismatched = 0;
+        __block double sent = ZLBenchmarkNow();
+        XCTestExpectation *expectation = [self expectationWithDescription:@"echo"];
+        __weak ZLWebSocket *weakSocket = webSocket;
+        delegate.messageBlock = ^(NSData *data) {
+            samples[received] = (ZLBenchmarkNow() - sent) * 1e6;
+            if (![data isEqualToData:message]) {
+                mismatched++;
+            }
+            if (++received == count) {
+                [expectation fulfill];
+                return;
+            }
+            sent = ZLBenchmarkNow();
+            [weakSocket sendData:message error:nil];
+        };
+        delegate.failBlock = ^(NSError *error) {
+            [expectation fulfill];
+        };
+        double start = ZLBenchmarkNow();
+        dispatch_async(webSocket.delegateDispatchQueue, ^{
+            sent = ZLBenchmarkNow();
+            [webSocket sendData:message error:nil];
+        });
+        [self waitForExpectationsWithTimeout:120 handler:nil];
+        double elapsed = ZLBenchmarkNow() - start;
+        [webSocket close];
+
+        XCTAssertEqual(received, count);
+        XCTAssertEqual(mismatched, 0);
+        ZLBenchmarkResultsAdd(ZLBenchmarkTestResults, "websocket_client_echo", "messages/s", count / elapsed, true);
+        ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "payload_bytes", size);
+        ZLBenchmarkResultsSetSamples(ZLBenchmarkTestResults, "us", samples, count);
+        free(samples);
+    }
+}
+
+- (void)testWebSocketFloodThroughput {
+    if (!ZLBenchmarkEnabled()) {
+        return;
+    }
+    const NSUInteger sizes[] = { 16, 1024, 64 * 1024 };
+    const NSUInteger counts[] = { 200000, 100000, 2000 };
+
+    for (NSUInteger s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        NSUInteger size = sizes[s], count = counts[s];
+        __block NSUInteger received = 0;
+        __block double start = 0;
+        XCTestExpectation *expectation = [self expectationWithDescription:@"flood"];
+        ZLBenchmarkSocketDelegate *delegate = [ZLBenchmarkSocketDelegate new];
+        delegate.messageBlock = ^(NSData *data) {
+            if (++received == count) {
+                [expectation fulfill];
+            }
+        };
+        delegate.failBlock = ^(NSError *error) {
+            [expectation fulfill];
+        };
+        NSString *path = [NSString stringWithFormat:@"/ws/flood?size=%lu&count=%lu", (unsigned long)size, (unsigned long)count];
+        NSString *URLString = [NSString stringWithFormat:@"ws://127.0.0.1:%u%@", ZLLoopbackServerPort(ZLBenchmarkServer), path];
+        ZLWebSocket *webSocket = [[ZLWebSocket alloc] initWithURL:[NSURL URLWithString:URLString]];
+        webSocket.delegateDispatchQueue = dispatch_queue_create("com.richie.benchmark.websocket", DISPATCH_QUEUE_SERIAL);
+        webSocket.delegate = delegate;
+        start = ZLBenchmarkNow();
+        [webSocket open];
+        [self waitForExpectationsWithTimeout:120 handler:nil];
+        double elapsed = ZLBenchmarkNow() - start;
+        [webSocket close];
+
+        XCTAssertEqual(received, count);
+        ZLBenchmarkResultsAdd(ZLBenchmarkTestResults, "websocket_client_flood", "messages/s", count / elapsed, true);
+        ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "payload_bytes", size);
+        ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "messages", count);
+    }
+}
+
+#pragma mark - body serialization
+
+/// 接口里常见的结构：一条记录里有整数、浮点、布尔、字符串、数组和嵌套字典
+- (NSDictionary *)serializationRecordAtIndex:(NSUInteger)index {
+    return @{
+        @"id": @(100000 + index),
+        @"name": [NSString stringWithFormat:@"user %lu 用户", (unsigned long)index],
+        @"score": @(index * 0.75),
+        @"active": @(index % 3 != 0),
+        @"tags": @[@"alpha", @"beta", [NSString stringWithFormat:@"tag%lu", (unsigned long)(index % 17)]],
+        @"profile": @{ @"city": @"Shanghai", @"level": @(index % 10), @"avatar": [NSString stringWithFormat:@"https://example.com/avatar/%lu.png", (unsigned long)index] },
+    };
+}
+
+/// JSON、XML、MessagePack、CBOR 四种请求/响应体的编码、解码耗时和体积：单条记录对应高频小请求，200 条对应列表接口
+- (void)testBodySerialization {
+    if (!ZLBenchmarkEnabled()) {
+        return;
+    }
+    NSMutableArray *records = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 200; i++) {
+        [records addObject:[self serializationRecordAtIndex:i]];
+    }
+    // XML 只能编码字典，所以都包一层
+    NSDictionary *payloads[] = { @{ @"data": [self serializationRecordAtIndex:0] }, @{ @"data": records } };
+    const char *payloadNames[] = { "record", "list" };
+    const NSUInteger iterations[] = { 5000, 100 };
+
+    NSArray<NSString *> *formats = @[@"json", @"xml", @"msgpack", @"cbor"];
+    NSData *(^encoders[])(NSDictionary *) = {
+        ^NSData *(NSDictionary *object) { return [NSJSONSerialization dataWithJSONObject:object options:0 error:NULL]; },
+        ^NSData *(NSDictionary *object) { return [[object XMLString] dataUsingEncoding:NSUTF8StringEncoding]; },
+        ^NSData *(NSDictionary *object) { return [ZLMessagePackSerialization dataWithObject:object error:NULL]; },
+        ^NSData *(NSDictionary *object) { return [ZLCBORSerialization dataWithObject:object error:NULL]; },
+    };
+    id (^decoders[])(NSData *) = {
+        ^id (NSData *data) { return [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL]; },
+        ^id (NSData *data) { return [NSDictionary dictionaryWithXMLData:data]; },
+        ^id (NSData *data) { return [ZLMessagePackSerialization objectWithData:data error:NULL]; },
+        ^id (NSData *data) { return [ZLCBORSerialization objectWithData:data error:NULL]; },
+    };
+
+    for (NSUInteger p = 0; p < 2; p++) {
+        NSUInteger count = iterations[p];
+        for (NSUInteger f = 0; f < formats.count; f++) {
+            NSData *encoded = encoders[f](payloads[p]);
+            XCTAssertNotNil(encoded);
+            XCTAssertNotNil(decoders[f](encoded));
+
+            double *encodeSamples = calloc(count, sizeof(double));
+            double *decodeSamples = calloc(count, sizeof(double));
+            for (NSUInteger i = 0; i < count; i++) {
+                @autoreleasepool {
+                    double start = ZLBenchmarkNow();
+                    NSData *data = encoders[f](payloads[p]);
+                    double middle = ZLBenchmarkNow();
+                    id object = decoders[f](data);
+                    encodeSamples[i] = (middle - start) * 1e6;
+                    decodeSamples[i] = (ZLBenchmarkNow() - middle) * 1e6;
+                    XCTAssertNotNil(object);
+                }
+            }
+
+            NSString *prefix = [NSString stringWithFormat:@"body_%s_%@", payloadNames[p], formats[f]];
+            ZLBenchmarkResultsAdd(ZLBenchmarkTestResults, [prefix stringByAppendingString:@"_encode"].UTF8String, "us/op", ZLBenchmarkPercentile(encodeSamples, count, 50), false);
+            ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "iterations", count);
+            ZLBenchmarkResultsSetSamples(ZLBenchmarkTestResults, "us", encodeSamples, count);
+            ZLBenchmarkResultsAdd(ZLBenchmarkTestResults, [prefix stringByAppendingString:@"_decode"].UTF8String, "us/op", ZLBenchmarkPercentile(decodeSamples, count, 50), false);
+            ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "iterations", count);
+            ZLBenchmarkResultsSetSamples(ZLBenchmarkTestResults, "us", decodeSamples, count);
+            ZLBenchmarkResultsAdd(ZLBenchmarkTestResults, [prefix stringByAppendingString:@"_size"].UTF8String, "bytes", encoded.length, false);
+            free(encodeSamples);
+            free(decodeSamples);
+        }
+    }
+}
+
+#pragma mark - parsing and decoding
+
+- (void)testXMLDictionaryParseThroughput {
+    if (!ZLBenchmarkEnabled()) {
+        return;
+    }
+    size_t length = 0;
+    char *document = ZLLoopbackCreateXMLDocument(20000, &length);
+    NSData *data = [NSData dataWithBytesNoCopy:document length:length freeWhenDone:YES];
+
+    double samples[5];
+    for (NSUInteger run = 0; run < 5; run++) {
+        @autoreleasepool {
+            double start = ZLBenchmarkNow();
+            NSDictionary *dictionary = [[ZLXMLDictionaryParser sharedInstance] dictionaryWithData:data];
+            samples[run] = length / 1048576.0 / (ZLBenchmarkNow() - start);
+            XCTAssertNotNil(dictionary);
+        }
+    }
+    ZLBenchmarkResultsAdd(ZLBenchmarkTestResults, "xml_dictionary_parse", "MiB/s", ZLBenchmarkPercentile(samples, 5, 100), true);
+    ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "bytes", length);
+    ZLBenchmarkResultsSetSamples(ZLBenchmarkTestResults, "MiB/s", samples, 5);
+}
+
+- (NSData *)encodedImageWithType:(CFStringRef)type frameCount:(NSUInteger)frameCount {
+    const size_t width = 1024, height = 768;
+    NSMutableData *data = [NSMutableData data];
+    CGImageDestinationRef destination = CGImageDestinationCreateWithData((__bridge CFMutableDataRef)data, type, frameCount, NULL);
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    for (NSUInteger frame = 0; frame < frameCount; frame++) {
+        CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, colorSpace, kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Little);
+        uint32_t *pixels = CGBitmapContextGetData(context);
+        size_t stride = CGBitmapContextGetBytesPerRow(context) / 4;
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                pixels[y * stride + x] = 0xFF000000u | (uint32_t)((x + frame * 8) & 0xFF) << 16 | (uint32_t)(y & 0xFF) << 8 | ZLLoopbackServerByteAt(x * y);
+            }
+        }
+        CGImageRef image = CGBitmapContextCreateImage(context);
+        NSDictionary *properties = @{ (__bridge NSString *)kCGImagePropertyGIFDictionary: @{ (__bridge NSString *)kCGImagePropertyGIFDelayTime: @0.04 } };
+        CGImageDestinationAddImage(destination, image, (__bridge CFDictionaryRef)properties);
+        CGImageRelease(image);
+        CGContextRelease(context);
+    }
+    CGImageDestinationFinalize(destination);
+    CFRelease(destination);
+    CGColorSpaceRelease(colorSpace);
+    return data;
+}
+
+- (void)testImageDecodeLatency {
+    if (!ZLBenchmarkEnabled()) {
+        return;
+    }
+    NSDictionary<NSString *, NSData *> *images = @{
+        @"jpeg": [self encodedImageWithType:kUTTypeJPEG frameCount:1],
+        @"png": [self encodedImageWithType:kUTTypePNG frameCount:1],
+    };
+    for (NSString *name in images) {
+        NSData *data = images[name];
+        double samples[20];
+        for (NSUInteger i = 0; i < 20; i++) {
+            @autoreleasepool {
+                double start = ZLBenchmarkNow();
+                UIImage *image = [UIImage zl_imageWithData:data targetSize:CGSizeMake(256, 192) radius:0 contentMode:ZLNetImageViewContentModeScaleAspectFill];
+                samples[i] = (ZLBenchmarkNow() - start) * 1e3;
+                XCTAssertNotNil(image);
+            }
+        }
+        NSString *resultName = [@"image_decode_" stringByAppendingString:name];
+        ZLBenchmarkResultsAdd(ZLBenchmarkTestResults, resultName.UTF8String, "ms/image", ZLBenchmarkPercentile(samples, 20, 50), false);
+        ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "file_bytes", data.length);
+        ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "target_width", 256);
+        ZLBenchmarkResultsSetSamples(ZLBenchmarkTestResults, "ms", samples, 20);
+    }
+
+    enum { frameCount = 30 };
+    NSData *gif = [self encodedImageWithType:kUTTypeGIF frameCount:frameCount];
+    ZLAnimatedImage *animatedImage = [UIImage zl_animatedImageWithData:gif scale:1];
+    XCTAssertEqual(animatedImage.animatedImageFrameCount, (NSUInteger)frameCount);
+    double samples[frameCount];
+    for (NSUInteger i = 0; i < frameCount; i++) {
+        @autoreleasepool {
+            double start = ZLBenchmarkNow();
+            UIImage *frame = [animatedImage animatedImageFrameAtIndex:i];
+            samples[i] = (ZLBenchmarkNow() - start) * 1e3;
+            XCTAssertNotNil(frame);
+        }
+    }
+    ZLBenchmarkResultsAdd(ZLBenchmarkTestResults, "image_decode_gif_frame", "ms/frame", ZLBenchmarkPercentile(samples, frameCount, 50), false);
+    ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "file_bytes", gif.length);
+    ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "frames", frameCount);
+    ZLBenchmarkResultsSetSamples(ZLBenchmarkTestResults, "ms", samples, frameCount);
+}
+
+#pragma mark - image cache
+
+/// 在 duration 秒内用 threadCount 个线程随机查找已缓存的 key，返回每秒查找次数
+- (double)lookupsPerSecondInCache:(id<ZLBenchmarkImageCache>)cache keys:(NSArray<NSString *> *)keys threadCount:(NSUInteger)threadCount duration:(double)duration {
+    NSUInteger keyCount = keys.count;
+    unsigned long *lookups = calloc(threadCount, sizeof(unsigned long));
+    unsigned long *misses = calloc(threadCount, sizeof(unsigned long));
+    double start = ZLBenchmarkNow();
+    double deadline = start + duration;
+    dispatch_apply(threadCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t thread) {
+        uint64_t state = 0x9E3779B97F4A7C15ull * (thread + 1);
+        // 循环里只写局部变量，避免相邻计数器的伪共享干扰并发结果
+        unsigned long threadLookups = 0, threadMisses = 0;
+        do {
+            @autoreleasepool {
+                for (NSUInteger i = 0; i < 16; i++) {
+                    state ^= state << 13;
+                    state ^= state >> 7;
+                    state ^= state << 17;
+                    if ([cache imageForKey:keys[state % keyCount]] == nil) {
+                        threadMisses++;
+                    }
+                }
+            }
+            threadLookups += 16;
+        } while (ZLBenchmarkNow() < deadline);
+        lookups[thread] = threadLookups;
+        misses[thread] = threadMisses;
+    });
+    double elapsed = ZLBenchmarkNow() - start;
+    unsigned long totalLookups = 0, totalMisses = 0;
+    for (NSUInteger thread = 0; thread < threadCount; thread++) {
+        totalLookups += lookups[thread];
+        totalMisses += misses[thread];
+    }
+    free(lookups);
+    free(misses);
+    XCTAssertEqual(totalMisses, 0ul);
+    return totalLookups / elapsed;
+}
+
+/// 内存缓存命中路径的吞吐：1k/10k/100k 条目，单线程和 8 线程并发，对照分片前的链表实现。
+/// maxCost 足够大，测量期间不淘汰；key 的形状和 ZLImageCacheManager 的 memoryIdentifier 一样，是 64 个十六进制字符加尺寸后缀
+- (void)testImageMemoryCacheLookups {
+    if (!ZLBenchmarkEnabled()) {
+        return;
+    }
+    UIGraphicsBeginImageContextWithOptions(CGSizeMake(1, 1), YES, 1);
+    UIImage *image = UIGraphicsGetImageFromCurrentImageContext();
+    UIGraphicsEndImageContext();
+
+    const NSUInteger entryCounts[] = { 1000, 10000, 100000 };
+    const char *entryNames[] = { "1k", "10k", "100k" };
+    const NSUInteger threadCounts[] = { 1, 8 };
+    const char *threadNames[] = { "single", "contended" };
+    enum { runs = 3 };
+
+    for (NSUInteger e = 0; e < 3; e++) {
+        NSMutableArray<NSString *> *keys = [NSMutableArray arrayWithCapacity:entryCounts[e]];
+        for (NSUInteger i = 0; i < entryCounts[e]; i++) {
+            uint64_t a = 0x9E3779B97F4A7C15ull * (i + 1), b = a ^ (a >> 29) ^ 0xBF58476D1CE4E5B9ull;
+            [keys addObject:[NSString stringWithFormat:@"%016llx%016llx%016llx%016llx_100.00_100.00_0.00", a, b, a * 31, b * 31]];
+        }
+        for (NSUInteger c = 0; c < 2; c++) {
+            id<ZLBenchmarkImageCache> cache = nil;
+            if (c == 0) {
+                cache = [[ZLImageMemoryCache alloc] initWithMaxCost:NSUIntegerMax / 2];
+            } else {
+                cache = [ZLBenchmarkLinkedListImageCache new];
+            }
+            for (NSString *key in keys) {
+                [cache setImage:image forKey:key];
+            }
+            for (NSUInteger t = 0; t < 2; t++) {
+                double samples[runs];
+                for (NSUInteger run = 0; run < runs; run++) {
+                    samples[run] = [self lookupsPerSecondInCache:cache keys:keys threadCount:threadCounts[t] duration:0.5];
+                }
+                NSString *name = [NSString stringWithFormat:@"image_memory_cache_%@_%s_%s", c == 0 ? @"sharded" : @"linked_list", entryNames[e], threadNames[t]];
+                ZLBenchmarkResultsAdd(ZLBenchmarkTestResults, name.UTF8String, "lookups/s", ZLBenchmarkPercentile(samples, runs, 50), true);
+                ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "entries", entryCounts[e]);
+                ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "threads", threadCounts[t]);
+                ZLBenchmarkResultsSetSamples(ZLBenchmarkTestResults, "lookups/s", samples, runs);
+            }
+            [cache removeAllImages];
+        }
+    }
+}
+
+/// 把图片画到同样像素大小的位图里，映射的 slab 页和延迟解码都在这一步发生，相当于提交给渲染服务之前的最后一步
+- (void)renderImage:(UIImage *)image {
+    CGImageRef imageRef = image.CGImage;
+    size_t width = CGImageGetWidth(imageRef), height = CGImageGetHeight(imageRef);
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, colorSpace, kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst);
+    CGContextDrawImage(context, CGRectMake(0, 0, width, height), imageRef);
+    CGContextRelease(context);
+    CGColorSpaceRelease(colorSpace);
+}
+
+/// 冷启动后首屏 24 张缩略图从磁盘到可显示位图的总耗时：开启持久化位图缓存前要读原图再解码缩放，
+/// 开启后只需重新加载 slab 并映射槽位。两边都包括绘制一遍，文件都已在页缓存中
+- (void)testFirstScreenRenderTime {
+    if (!ZLBenchmarkEnabled()) {
+        return;
+    }
+    enum { imageCount = 24, runs = 10 };
+    const CGSize targetSize = CGSizeMake(180, 135);
+    NSData *data = [self encodedImageWithType:kUTTypeJPEG frameCount:1];
+    NSString *directory = [self temporaryFileURL].path;
+    NSString *bitmapsPath = [directory stringByAppendingPathComponent:@"bitmaps"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+
+    NSMutableArray<NSString *> *sourcePaths = [NSMutableArray array];
+    @autoreleasepool {
+        ZLDecodedImageCache *decodedCache = [[ZLDecodedImageCache alloc] initWithPath:bitmapsPath byteLimit:64 * 1024 * 1024];
+        for (NSUInteger i = 0; i < imageCount; i++) {
+            NSString *sourcePath = [directory stringByAppendingPathComponent:[NSString stringWithFormat:@"source-%lu", (unsigned long)i]];
+            XCTAssertTrue([data writeToFile:sourcePath atomically:NO]);
+            [sourcePaths addObject:sourcePath];
+            UIImage *image = [UIImage zl_imageWithData:data targetSize:targetSize radius:0 contentMode:ZLNetImageViewContentModeScaleAspectFill];
+            [decodedCache storeImage:image forKey:sourcePath.lastPathComponent sourceKey:sourcePath.lastPathComponent];
+        }
+    }
+
+    double decodeSamples[runs], cachedSamples[runs];
+    for (NSUInteger run = 0; run < runs; run++) {
+        @autoreleasepool {
+            double start = ZLBenchmarkNow();
+            for (NSString *sourcePath in sourcePaths) {
+                NSData *sourceData = [NSData dataWithContentsOfFile:sourcePath options:NSDataReadingMappedIfSafe error:NULL];
+                UIImage *image = [UIImage zl_imageWithData:sourceData targetSize:targetSize radius:0 contentMode:ZLNetImageViewContentModeScaleAspectFill];
+                XCTAssertNotNil(image);
+                [self renderImage:image];
+            }
+            decodeSamples[run] = (ZLBenchmarkNow() - start) * 1e3;
+        }
+        @autoreleasepool {
+            double start = ZLBenchmarkNow();
+            ZLDecodedImageCache *decodedCache = [[ZLDecodedImageCache alloc] initWithPath:bitmapsPath byteLimit:64 * 1024 * 1024];
+            for (NSString *sourcePath in sourcePaths) {
+                UIImage *image = [decodedCache imageForKey:sourcePath.lastPathComponent];
+                XCTAssertNotNil(image);
+                [self renderImage:image];
+            }
+            cachedSamples[run] = (ZLBenchmarkNow() - start) * 1e3;
+        }
+    }
+    [[NSFileManager defaultManager] removeItemAtPath:directory error:NULL];
+
+    const char *names[] = { "first_screen_decode", "first_screen_decoded_cache" };
+    double *samples[] = { decodeSamples, cachedSamples };
+    for (NSUInteger i = 0; i < 2; i++) {
+        ZLBenchmarkResultsAdd(ZLBenchmarkTestResults, names[i], "ms/screen", ZLBenchmarkPercentile(samples[i], runs, 50), false);
+        ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "images", imageCount);
+        ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "file_bytes", data.length);
+        ZLBenchmarkResultsAddParameter(ZLBenchmarkTestResults, "target_width", targetSize.width);
+        ZLBenchmarkResultsSetSamples(ZLBenchmarkTestResults, "ms", samples[i], runs);
+    }
+}
+
+@end
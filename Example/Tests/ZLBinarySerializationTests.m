@@ -0,0 +1,175 @@
+//
+//  ZLBinarySerializationTests.m
+//  ZLNetworking_Tests
+//
+//  Created by lylaut on 2022/4/2.
+//  Copyright (c) 2022 richiezhl. All rights reserved.
+//
+
+@import XCTest;
+
+#import <ZLNetworking/ZLBinarySerialization.h>
+
+static NSData *ZLBinaryTestData(NSString *hex) {
+    NSMutableData *data = [NSMutableData data];
+    for (NSUInteger i = 0; i + 1 < hex.length; i += 2) {
+        uint8_t byte = (uint8_t)strtoul([hex substringWithRange:NSMakeRange(i, 2)].UTF8String, NULL, 16);
+        [data appendBytes:&byte length:1];
+    }
+    return data;
+}
+
+@interface ZLBinarySerializationTests : XCTestCase
+
+@end
+
+@implementation ZLBinarySerializationTests
+
+- (id)messagePackRoundTrip:(id)object {
+    NSError *error = nil;
+    NSData *data = [ZLMessagePackSerialization dataWithObject:object error:&error];
+    XCTAssertNotNil(data, @"%@", error);
+    return data ? [ZLMessagePackSerialization objectWithData:data error:NULL] : nil;
+}
+
+- (id)CBORRoundTrip:(id)object {
+    NSError *error = nil;
+    NSData *data = [ZLCBORSerialization dataWithObject:object error:&error];
+    XCTAssertNotNil(data, @"%@", error);
+    return data ? [ZLCBORSerialization objectWithData:data error:NULL] : nil;
+}
+
+- (void)assertInvalidCBOR:(NSString *)hex {
+    NSError *error = nil;
+    XCTAssertNil([ZLCBORSerialization objectWithData:ZLBinaryTestData(hex) error:&error], @"%@", hex);
+    XCTAssertNotNil(error, @"%@", hex);
+}
+
+- (void)testNestedRoundTrip {
+    NSDictionary *object = @{
+        @"ascii": @"hello",
+        @"unicode": @"用户 ✓ 🚀",
+        @"long": [@"" stringByPaddingToLength:70000 withString:@"abc" startingAtIndex:0],
+        @"integers": @[@0, @23, @24, @127, @128, @255, @256, @65535, @65536, @(UINT32_MAX), @(1ull << 32), @-1, @-32, @-33, @-128, @-129, @(INT32_MIN), @(INT64_MIN), @(INT64_MAX)],
+        @"data": ZLBinaryTestData(@"00ff10"),
+        @"null": [NSNull null],
+        @"nested": @{ @"empty": @{}, @"list": @[@[], @[[NSNull null]]] },
+    };
+    XCTAssertEqualObjects([self messagePackRoundTrip:object], object);
+    XCTAssertEqualObjects([self CBORRoundTrip:object], object);
+}
+
+- (void)testBool {
+    XCTAssertEqualObjects([ZLMessagePackSerialization dataWithObject:@[@YES, @NO] error:NULL], ZLBinaryTestData(@"92c3c2"));
+    XCTAssertEqualObjects([ZLCBORSerialization dataWithObject:@[@YES, @NO] error:NULL], ZLBinaryTestData(@"82f5f4"));
+    // Integers 0 and 1 must not be mistaken for booleans.
+    XCTAssertEqualObjects([ZLMessagePackSerialization dataWithObject:@[@1, @0] error:NULL], ZLBinaryTestData(@"920100"));
+    XCTAssertEqualObjects([ZLCBORSerialization dataWithObject:@[@1, @0] error:NULL], ZLBinaryTestData(@"820100"));
+
+    NSArray *messagePack = [ZLMessagePackSerialization objectWithData:ZLBinaryTestData(@"92c3c2") error:NULL];
+    NSArray *CBOR = [ZLCBORSerialization objectWithData:ZLBinaryTestData(@"82f5f4") error:NULL];
+    for (NSArray *array in @[messagePack, CBOR]) {
+        XCTAssertEqual(array.count, 2u);
+        XCTAssertEqual((__bridge CFBooleanRef)array.firstObject, kCFBooleanTrue);
+        XCTAssertEqual((__bridge CFBooleanRef)array.lastObject, kCFBooleanFalse);
+    }
+}
+
+- (void)testFloat {
+    // Floats are written in single precision, doubles in double precision.
+    XCTAssertEqualObjects([ZLMessagePackSerialization dataWithObject:@(1.5f) error:NULL], ZLBinaryTestData(@"ca3fc00000"));
+    XCTAssertEqualObjects([ZLCBORSerialization dataWithObject:@(1.5f) error:NULL], ZLBinaryTestData(@"fa3fc00000"));
+    XCTAssertEqualObjects([ZLMessagePackSerialization dataWithObject:@(1.1) error:NULL], ZLBinaryTestData(@"cb3ff199999999999a"));
+    XCTAssertEqualObjects([ZLCBORSerialization dataWithObject:@(1.1) error:NULL], ZLBinaryTestData(@"fb3ff199999999999a"));
+    XCTAssertEqualObjects([self messagePackRoundTrip:@(-0.1)], @(-0.1));
+    XCTAssertEqualObjects([self CBORRoundTrip:@(DBL_MAX)], @(DBL_MAX));
+    XCTAssertEqualObjects([self CBORRoundTrip:@(1.5f)], @(1.5f));
+
+    // CBOR half precision: 1.0, -2.0, the smallest subnormal, infinity and NaN.
+    XCTAssertEqualObjects([ZLCBORSerialization objectWithData:ZLBinaryTestData(@"f93c00") error:NULL], @1.0);
+    XCTAssertEqualObjects([ZLCBORSerialization objectWithData:ZLBinaryTestData(@"f9c000") error:NULL], @-2.0);
+    XCTAssertEqualObjects([ZLCBORSerialization objectWithData:ZLBinaryTestData(@"f90001") error:NULL], @(ldexp(1, -24)));
+    XCTAssertEqualObjects([ZLCBORSerialization objectWithData:ZLBinaryTestData(@"f97c00") error:NULL], @(INFINITY));
+    XCTAssertTrue(isnan([[ZLCBORSerialization objectWithData:ZLBinaryTestData(@"f97e00") error:NULL] doubleValue]));
+}
+
+- (void)testLargeUnsigned {
+    // Unsigned values above INT64_MAX must not come back negative.
+    XCTAssertEqualObjects([ZLMessagePackSerialization dataWithObject:@(UINT64_MAX) error:NULL], ZLBinaryTestData(@"cfffffffffffffffff"));
+    XCTAssertEqualObjects([ZLCBORSerialization dataWithObject:@(UINT64_MAX) error:NULL], ZLBinaryTestData(@"1bffffffffffffffff"));
+    XCTAssertEqual([[self messagePackRoundTrip:@(UINT64_MAX)] unsignedLongLongValue], UINT64_MAX);
+    XCTAssertEqual([[self CBORRoundTrip:@(UINT64_MAX)] unsignedLongLongValue], UINT64_MAX);
+    XCTAssertEqual([[self CBORRoundTrip:@(1ull << 63)] unsignedLongLongValue], 1ull << 63);
+    XCTAssertEqual([[self messagePackRoundTrip:@(INT64_MIN)] longLongValue], INT64_MIN);
+    XCTAssertEqualObjects([ZLCBORSerialization dataWithObject:@(INT64_MIN) error:NULL], ZLBinaryTestData(@"3b7fffffffffffffff"));
+
+    // CBOR negative integers reach -2^64; anything below INT64_MIN cannot be represented.
+    [self assertInvalidCBOR:@"3b8000000000000000"];
+    XCTAssertEqual([[ZLCBORSerialization objectWithData:ZLBinaryTestData(@"3b7fffffffffffffff") error:NULL] longLongValue], INT64_MIN);
+}
+
+- (void)testIndefiniteLengthCBOR {
+    XCTAssertEqualObjects([ZLCBORSerialization objectWithData:ZLBinaryTestData(@"9f0102ff") error:NULL], (@[@1, @2]));
+    XCTAssertEqualObjects([ZLCBORSerialization objectWithData:ZLBinaryTestData(@"9fff") error:NULL], @[]);
+    XCTAssertEqualObjects([ZLCBORSerialization objectWithData:ZLBinaryTestData(@"bf616101616282f5f6ff") error:NULL], (@{ @"a": @1, @"b": @[@YES, [NSNull null]] }));
+    XCTAssertEqualObjects([ZLCBORSerialization objectWithData:ZLBinaryTestData(@"7f626162616360ff") error:NULL], @"abc");
+    XCTAssertEqualObjects([ZLCBORSerialization objectWithData:ZLBinaryTestData(@"5f420102410340ff") error:NULL], ZLBinaryTestData(@"010203"));
+    // Definite and indefinite containers nested in each other.
+    XCTAssertEqualObjects([ZLCBORSerialization objectWithData:ZLBinaryTestData(@"829f01ff9f9f02ffff") error:NULL], (@[@[@1], @[@[@2]]]));
+    // Tags are dropped.
+    XCTAssertEqualObjects([ZLCBORSerialization objectWithData:ZLBinaryTestData(@"c16a31323334353637383930") error:NULL], @"1234567890");
+
+    [self assertInvalidCBOR:@"9f0102"];           // missing break
+    [self assertInvalidCBOR:@"bf6161ff"];         // key without a value
+    [self assertInvalidCBOR:@"7f6261624103ff"];   // byte string chunk inside a text string
+    [self assertInvalidCBOR:@"5f5f4101ffff"];     // nested indefinite chunk
+    [self assertInvalidCBOR:@"ff"];               // stray break
+    [self assertInvalidCBOR:@"1f"];               // indefinite integer
+}
+
+- (void)testTruncatedInput {
+    NSDictionary *object = @{ @"list": @[@1, @-300, @(UINT64_MAX), @(1.5f), @(2.25), @YES, [NSNull null]], @"text": @"用户", @"data": ZLBinaryTestData(@"0102030405") };
+    NSData *messagePack = [ZLMessagePackSerialization dataWithObject:object error:NULL];
+    NSData *CBOR = [ZLCBORSerialization dataWithObject:object error:NULL];
+    XCTAssertNotNil(messagePack);
+    XCTAssertNotNil(CBOR);
+
+    // The top level is a definite-length map, so no prefix is complete.
+    for (NSUInteger length = 0; length < messagePack.length; length++) {
+        NSError *error = nil;
+        XCTAssertNil([ZLMessagePackSerialization objectWithData:[messagePack subdataWithRange:NSMakeRange(0, length)] error:&error], @"%lu", (unsigned long)length);
+        XCTAssertNotNil(error);
+    }
+    for (NSUInteger length = 0; length < CBOR.length; length++) {
+        NSError *error = nil;
+        XCTAssertNil([ZLCBORSerialization objectWithData:[CBOR subdataWithRange:NSMakeRange(0, length)] error:&error], @"%lu", (unsigned long)length);
+        XCTAssertNotNil(error);
+    }
+
+    // Trailing bytes.
+    NSMutableData *trailing = [messagePack mutableCopy];
+    [trailing appendBytes:"\0" length:1];
+    XCTAssertNil([ZLMessagePackSerialization objectWithData:trailing error:NULL]);
+    trailing = [CBOR mutableCopy];
+    [trailing appendBytes:"\0" length:1];
+    XCTAssertNil([ZLCBORSerialization objectWithData:trailing error:NULL]);
+
+    // Declared lengths far beyond the remaining input.
+    XCTAssertNil([ZLMessagePackSerialization objectWithData:ZLBinaryTestData(@"dbffffffff61") error:NULL]);
+    XCTAssertNil([ZLMessagePackSerialization objectWithData:ZLBinaryTestData(@"ddffffffff01") error:NULL]);
+    [self assertInvalidCBOR:@"7bffffffffffffffff61"];
+    [self assertInvalidCBOR:@"9bffffffffffffffff01"];
+}
+
+- (void)testUnsupportedInput {
+    NSError *error = nil;
+    XCTAssertNil([ZLMessagePackSerialization dataWithObject:@[[NSDate date]] error:&error]);
+    XCTAssertNotNil(error);
+    error = nil;
+    XCTAssertNil([ZLCBORSerialization dataWithObject:@{ @"set": [NSSet set] } error:&error]);
+    XCTAssertNotNil(error);
+    // MessagePack ext types are not supported.
+    XCTAssertNil([ZLMessagePackSerialization objectWithData:ZLBinaryTestData(@"d40102") error:NULL]);
+}
+
+@end
@@ -0,0 +1,277 @@
+//
+//  ZLDecodedImageCacheTests.m
+//  ZLNetworking_Tests
+//
+//  Created by lylaut on 2022/4/2.
+//  Copyright (c) 2022 richiezhl. All rights reserved.
+//
+
+@import XCTest;
+
+#import <ZLNetworking/ZLDecodedImageCache.h>
+
+/// Large enough for one 4 MiB slot plus its header page, too small for two.
+static unsigned long long const ZLDecodedTestSlabBudget = 4 * 1024 * 1024 + 64 * 1024;
+
+@interface ZLDecodedImageCacheTests : XCTestCase
+
+@end
+
+@implementation ZLDecodedImageCacheTests {
+    NSString *_path;
+}
+
+- (void)setUp {
+    [super setUp];
+    _path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"zldecoded-%@", [NSUUID UUID].UUIDString]];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath:_path error:NULL];
+    [super tearDown];
+}
+
+/// A deterministic sRGB bitmap; alpha images carry valid premultiplied pixels.
+- (UIImage *)imageWithWidth:(size_t)width height:(size_t)height alpha:(BOOL)alpha seed:(uint32_t)seed {
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Host | (alpha ? kCGImageAlphaPremultipliedFirst : kCGImageAlphaNoneSkipFirst);
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, colorSpace, bitmapInfo);
+    uint32_t *pixels = CGBitmapContextGetData(context);
+    size_t stride = CGBitmapContextGetBytesPerRow(context) / 4;
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            uint32_t a = alpha ? (uint32_t)(x * 7 + y * 3 + seed) & 0xFF : 0xFF;
+            uint32_t r = MIN((uint32_t)(x + seed) & 0xFF, a);
+            uint32_t g = MIN((uint32_t)(y * 5 + seed) & 0xFF, a);
+            uint32_t b = MIN((uint32_t)(x ^ y ^ seed) & 0xFF, a);
+            pixels[y * stride + x] = a << 24 | r << 16 | g << 8 | b;
+        }
+    }
+    CGImageRef imageRef = CGBitmapContextCreateImage(context);
+    UIImage *image = [[UIImage alloc] initWithCGImage:imageRef scale:2 orientation:UIImageOrientationUp];
+    CGImageRelease(imageRef);
+    CGContextRelease(context);
+    CGColorSpaceRelease(colorSpace);
+    return image;
+}
+
+- (NSData *)pixelsOfImage:(UIImage *)image {
+    CGImageRef imageRef = image.CGImage;
+    size_t width = CGImageGetWidth(imageRef), height = CGImageGetHeight(imageRef);
+    NSMutableData *pixels = [NSMutableData dataWithLength:width * height * 4];
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    CGContextRef context = CGBitmapContextCreate(pixels.mutableBytes, width, height, 8, width * 4, colorSpace, kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst);
+    CGContextSetBlendMode(context, kCGBlendModeCopy);
+    CGContextDrawImage(context, CGRectMake(0, 0, width, height), imageRef);
+    CGContextRelease(context);
+    CGColorSpaceRelease(colorSpace);
+    return pixels;
+}
+
+- (void)assertImage:(UIImage *)image matches:(UIImage *)expected {
+    XCTAssertNotNil(image);
+    XCTAssertEqual(CGImageGetWidth(image.CGImage), CGImageGetWidth(expected.CGImage));
+    XCTAssertEqual(CGImageGetHeight(image.CGImage), CGImageGetHeight(expected.CGImage));
+    XCTAssertEqual(image.scale, expected.scale);
+    XCTAssertEqualObjects([self pixelsOfImage:image], [self pixelsOfImage:expected]);
+}
+
+- (BOOL)cache:(ZLDecodedImageCache *)cache containsKey:(NSString *)key {
+    @autoreleasepool {
+        return [cache imageForKey:key] != nil;
+    }
+}
+
+- (NSArray<NSString *> *)slabPaths {
+    NSMutableArray *paths = [NSMutableArray array];
+    for (NSString *fileName in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:_path error:NULL]) {
+        if ([fileName.pathExtension isEqualToString:@"slab"]) {
+            [paths addObject:[_path stringByAppendingPathComponent:fileName]];
+        }
+    }
+    return paths;
+}
+
+- (void)testStoreAndReload {
+    UIImage *opaque = [self imageWithWidth:40 height:30 alpha:NO seed:1];
+    UIImage *translucent = [self imageWithWidth:33 height:17 alpha:YES seed:2];
+    @autoreleasepool {
+        ZLDecodedImageCache *cache = [[ZLDecodedImageCache alloc] initWithPath:_path byteLimit:64 * 1024 * 1024];
+        [cache storeImage:opaque forKey:@"photo_40x30" sourceKey:@"photo"];
+        [cache storeImage:translucent forKey:@"icon_33x17" sourceKey:@"icon"];
+        [self assertImage:[cache imageForKey:@"photo_40x30"] matches:opaque];
+        [self assertImage:[cache imageForKey:@"icon_33x17"] matches:translucent];
+        XCTAssertNil([cache imageForKey:@"photo_80x60"]);
+    }
+
+    // One slab per pixel format, each starting with the "ZLSB" magic and format version 2.
+    NSArray<NSString *> *slabPaths = [self slabPaths];
+    XCTAssertEqual(slabPaths.count, 2u);
+    for (NSString *slabPath in slabPaths) {
+        NSData *data = [NSData dataWithContentsOfFile:slabPath];
+        XCTAssertGreaterThanOrEqual(data.length, 8u);
+        uint32_t header[2];
+        [data getBytes:header length:sizeof(header)];
+        XCTAssertEqual(header[0], 0x42534c5au);
+        XCTAssertEqual(header[1], 2u);
+    }
+
+    @autoreleasepool {
+        ZLDecodedImageCache *cache = [[ZLDecodedImageCache alloc] initWithPath:_path byteLimit:64 * 1024 * 1024];
+        [self assertImage:[cache imageForKey:@"photo_40x30"] matches:opaque];
+        [self assertImage:[cache imageForKey:@"icon_33x17"] matches:translucent];
+
+        // Source keys live in the version 2 slot records, so they survive the reload.
+        [cache removeImagesForSourceKey:@"photo"];
+        XCTAssertFalse([self cache:cache containsKey:@"photo_40x30"]);
+        XCTAssertTrue([self cache:cache containsKey:@"icon_33x17"]);
+    }
+
+    ZLDecodedImageCache *cache = [[ZLDecodedImageCache alloc] initWithPath:_path byteLimit:64 * 1024 * 1024];
+    XCTAssertFalse([self cache:cache containsKey:@"photo_40x30"]);
+    [self assertImage:[cache imageForKey:@"icon_33x17"] matches:translucent];
+}
+
+- (void)testReloadDiscardsForeignSlabs {
+    @autoreleasepool {
+        ZLDecodedImageCache *cache = [[ZLDecodedImageCache alloc] initWithPath:_path byteLimit:64 * 1024 * 1024];
+        [cache storeImage:[self imageWithWidth:40 height:30 alpha:NO seed:3] forKey:@"photo_40x30" sourceKey:@"photo"];
+    }
+    NSArray<NSString *> *slabPaths = [self slabPaths];
+    XCTAssertEqual(slabPaths.count, 1u);
+
+    // A version 1 slab has no source keys and must not be read as version 2.
+    FILE *file = fopen(slabPaths.firstObject.fileSystemRepresentation, "r+b");
+    XCTAssertTrue(file != NULL);
+    uint32_t version = 1;
+    fseek(file, 4, SEEK_SET);
+    fwrite(&version, sizeof(version), 1, file);
+    fclose(file);
+    NSString *junkPath = [_path stringByAppendingPathComponent:@"junk.slab"];
+    [[NSData dataWithBytes:"ZLSB" length:4] writeToFile:junkPath atomically:NO];
+
+    ZLDecodedImageCache *cache = [[ZLDecodedImageCache alloc] initWithPath:_path byteLimit:64 * 1024 * 1024];
+    XCTAssertFalse([self cache:cache containsKey:@"photo_40x30"]);
+    XCTAssertEqual([self slabPaths].count, 0u);
+}
+
+- (void)testReferencedSlotIsPinned {
+    // 1024x600 needs a 4 MiB slot, so every slab holds a single slot and the budget fits one slab.
+    UIImage *first = [self imageWithWidth:1024 height:600 alpha:NO seed:4];
+    UIImage *second = [self imageWithWidth:1024 height:600 alpha:NO seed:5];
+    ZLDecodedImageCache *cache = [[ZLDecodedImageCache alloc] initWithPath:_path byteLimit:ZLDecodedTestSlabBudget];
+    [cache storeImage:first forKey:@"first" sourceKey:@"first"];
+
+    @autoreleasepool {
+        UIImage *held = [cache imageForKey:@"first"];
+        XCTAssertNotNil(held);
+
+        // The only slot is referenced by a live CGImage: the store is dropped instead of overwriting it.
+        [cache storeImage:second forKey:@"second" sourceKey:@"second"];
+        XCTAssertFalse([self cache:cache containsKey:@"second"]);
+        XCTAssertTrue([self cache:cache containsKey:@"first"]);
+        [self assertImage:held matches:first];
+
+        // Removing everything unlinks the file, but the mapping stays valid until the image goes away.
+        [cache removeAllImages];
+        XCTAssertEqual([self slabPaths].count, 0u);
+        [self assertImage:held matches:first];
+        [cache storeImage:first forKey:@"first" sourceKey:@"first"];
+    }
+
+    @autoreleasepool {
+        UIImage *held = [cache imageForKey:@"first"];
+        [cache storeImage:second forKey:@"second" sourceKey:@"second"];
+        XCTAssertFalse([self cache:cache containsKey:@"second"]);
+        [self assertImage:held matches:first];
+    }
+
+    // Once released, the slab can be reclaimed for the next store.
+    [cache storeImage:second forKey:@"second" sourceKey:@"second"];
+    XCTAssertFalse([self cache:cache containsKey:@"first"]);
+    [self assertImage:[cache imageForKey:@"second"] matches:second];
+    XCTAssertEqual([self slabPaths].count, 1u);
+}
+
+- (void)testLeastRecentlyUsedSlotIsReused {
+    // A 32x32 bitmap fits in one page, so a single 4 MiB slab holds 4 MiB / page size slots.
+    NSUInteger slotCount = 4 * 1024 * 1024 / getpagesize();
+    ZLDecodedImageCache *cache = [[ZLDecodedImageCache alloc] initWithPath:_path byteLimit:ZLDecodedTestSlabBudget];
+    for (NSUInteger i = 0; i < slotCount; i++) {
+        @autoreleasepool {
+            NSString *key = [NSString stringWithFormat:@"thumb-%lu", (unsigned long)i];
+            [cache storeImage:[self imageWithWidth:32 height:32 alpha:NO seed:(uint32_t)i] forKey:key sourceKey:key];
+        }
+    }
+    XCTAssertEqual([self slabPaths].count, 1u);
+
+    // While thumb-0 is referenced the slab cannot be reclaimed, so single slots are reused instead.
+    UIImage *expected = [self imageWithWidth:32 height:32 alpha:NO seed:0];
+    @autoreleasepool {
+        UIImage *held = [cache imageForKey:@"thumb-0"];
+        XCTAssertNotNil(held);
+
+        // thumb-1 is the least recently used slot.
+        [cache storeImage:[self imageWithWidth:32 height:32 alpha:NO seed:1000] forKey:@"extra-0" sourceKey:@"extra-0"];
+        XCTAssertEqual([self slabPaths].count, 1u);
+        XCTAssertFalse([self cache:cache containsKey:@"thumb-1"]);
+        XCTAssertTrue([self cache:cache containsKey:@"extra-0"]);
+
+        // Read everything else, so the referenced thumb-0 becomes the oldest; it is still skipped.
+        for (NSUInteger i = 2; i < slotCount; i++) {
+            XCTAssertTrue([self cache:cache containsKey:[NSString stringWithFormat:@"thumb-%lu", (unsigned long)i]]);
+        }
+        XCTAssertTrue([self cache:cache containsKey:@"extra-0"]);
+        [cache storeImage:[self imageWithWidth:32 height:32 alpha:NO seed:1001] forKey:@"extra-1" sourceKey:@"extra-1"];
+        XCTAssertFalse([self cache:cache containsKey:@"thumb-2"]);
+        XCTAssertTrue([self cache:cache containsKey:@"extra-1"]);
+        [self assertImage:held matches:expected];
+        [self assertImage:[cache imageForKey:@"thumb-0"] matches:expected];
+    }
+
+    // Nothing is referenced any more: the next store reclaims the whole slab rather than one slot.
+    [cache storeImage:[self imageWithWidth:32 height:32 alpha:NO seed:1002] forKey:@"extra-2" sourceKey:@"extra-2"];
+    XCTAssertEqual([self slabPaths].count, 1u);
+    XCTAssertFalse([self cache:cache containsKey:@"thumb-0"]);
+    XCTAssertFalse([self cache:cache containsKey:@"extra-1"]);
+    XCTAssertTrue([self cache:cache containsKey:@"extra-2"]);
+}
+
+- (void)testLeastRecentlyUsedSlabIsReclaimed {
+    ZLDecodedImageCache *cache = [[ZLDecodedImageCache alloc] initWithPath:_path byteLimit:3 * ZLDecodedTestSlabBudget];
+    NSArray<NSString *> *keys = @[@"a", @"b", @"c", @"d"];
+    NSMutableArray<UIImage *> *images = [NSMutableArray array];
+    for (NSUInteger i = 0; i < keys.count; i++) {
+        [images addObject:[self imageWithWidth:1024 height:600 alpha:NO seed:(uint32_t)(10 + i)]];
+    }
+    for (NSUInteger i = 0; i < 3; i++) {
+        [cache storeImage:images[i] forKey:keys[i] sourceKey:keys[i]];
+    }
+    XCTAssertEqual([self slabPaths].count, 3u);
+
+    // "a" is read again, so storing "d" deletes the slab file holding "b".
+    XCTAssertTrue([self cache:cache containsKey:@"a"]);
+    [cache storeImage:images[3] forKey:@"d" sourceKey:@"d"];
+    XCTAssertEqual([self slabPaths].count, 3u);
+    XCTAssertFalse([self cache:cache containsKey:@"b"]);
+    @autoreleasepool {
+        [self assertImage:[cache imageForKey:@"a"] matches:images[0]];
+        [self assertImage:[cache imageForKey:@"c"] matches:images[2]];
+        [self assertImage:[cache imageForKey:@"d"] matches:images[3]];
+    }
+
+    // Lowering the limit reclaims from the oldest slab until it fits; "d" was read last.
+    XCTAssertTrue([self cache:cache containsKey:@"d"]);
+    cache.byteLimit = ZLDecodedTestSlabBudget;
+    XCTAssertEqual([self slabPaths].count, 1u);
+    XCTAssertFalse([self cache:cache containsKey:@"a"]);
+    XCTAssertFalse([self cache:cache containsKey:@"c"]);
+    XCTAssertTrue([self cache:cache containsKey:@"d"]);
+
+    // The reclaimed state survives a reload.
+    cache = [[ZLDecodedImageCache alloc] initWithPath:_path byteLimit:ZLDecodedTestSlabBudget];
+    XCTAssertFalse([self cache:cache containsKey:@"a"]);
+    [self assertImage:[cache imageForKey:@"d"] matches:images[3]];
+}
+
+@end
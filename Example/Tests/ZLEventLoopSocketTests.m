@@ -0,0 +1,199 @@
+//
+//  ZLEventLoopSocketTests.m
+//  ZLNetworking_Tests
+//
+//  Created by lylaut on 2022/4/2.
+//  Copyright (c) 2022 richiezhl. All rights reserved.
+//
+
+@import XCTest;
+
+#import <ZLNetworking/ZLWebSocket.h>
+#import "ZLLoopbackServer.h"
+
+@interface ZLEventLoopSocketDelegate : NSObject <ZLWebSocketDelegate>
+
+@property (nonatomic, copy) void (^openHandler)(ZLWebSocket *webSocket);
+@property (nonatomic, assign) NSUInteger expectedMessageCount;
+@property (nonatomic, strong) NSMutableArray *messages;
+@property (nonatomic, strong) XCTestExpectation *finishedExpectation;
+@property (nonatomic, assign) BOOL opened;
+@property (nonatomic, strong) NSError *error;
+
+@end
+
+@implementation ZLEventLoopSocketDelegate
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _messages = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (NSURL *)webSocketReConnectURL {
+    return nil;
+}
+
+- (NSURLRequest *)webSocketReConnectRequest {
+    return nil;
+}
+
+- (void)webSocketDidOpen:(ZLWebSocket *)webSocket {
+    self.opened = YES;
+    if (self.openHandler) {
+        self.openHandler(webSocket);
+    }
+}
+
+// Closing after the wait calls back again, so the expectation is only fulfilled once.
+- (void)finish {
+    XCTestExpectation *expectation = self.finishedExpectation;
+    self.finishedExpectation = nil;
+    [expectation fulfill];
+}
+
+- (void)receiveMessage:(id)message {
+    [self.messages addObject:message];
+    if (self.messages.count == self.expectedMessageCount) {
+        [self finish];
+    }
+}
+
+- (void)webSocket:(ZLWebSocket *)webSocket didReceiveMessageWithString:(NSString *)string {
+    [self receiveMessage:string];
+}
+
+- (void)webSocket:(ZLWebSocket *)webSocket didReceiveMessageWithData:(NSData *)data {
+    [self receiveMessage:data];
+}
+
+- (void)webSocket:(ZLWebSocket *)webSocket didFailWithError:(NSError *)error {
+    self.error = error;
+    [self finish];
+}
+
+- (void)webSocket:(ZLWebSocket *)webSocket didCloseWithCode:(NSInteger)code reason:(NSString *)reason wasClean:(BOOL)wasClean {
+    [self finish];
+}
+
+@end
+
+static NSData *ZLEventLoopTestPatternData(NSUInteger length) {
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    uint8_t *bytes = data.mutableBytes;
+    for (NSUInteger i = 0; i < length; i++) {
+        bytes[i] = ZLLoopbackServerByteAt(i);
+    }
+    return data;
+}
+
+@interface ZLEventLoopSocketTests : XCTestCase
+
+@end
+
+@implementation ZLEventLoopSocketTests {
+    ZLLoopbackServer *_server;
+}
+
+- (void)setUp {
+    [super setUp];
+    _server = ZLLoopbackServerStart(0);
+    XCTAssertTrue(_server != NULL);
+}
+
+- (void)tearDown {
+    ZLLoopbackServerStop(_server);
+    _server = NULL;
+    [super tearDown];
+}
+
+- (ZLWebSocket *)eventLoopWebSocketWithPort:(uint16_t)port path:(NSString *)path delegate:(ZLEventLoopSocketDelegate *)delegate {
+    NSString *URLString = [NSString stringWithFormat:@"ws://127.0.0.1:%u%@", port, path];
+    ZLWebSocket *webSocket = [[ZLWebSocket alloc] initWithURL:[NSURL URLWithString:URLString]];
+    webSocket.usesEventLoopSockets = YES;
+    webSocket.delegateDispatchQueue = dispatch_queue_create("com.richie.test.websocket.eventloop", DISPATCH_QUEUE_SERIAL);
+    delegate.finishedExpectation = [self expectationWithDescription:@"finished"];
+    webSocket.delegate = delegate;
+    return webSocket;
+}
+
+- (void)testEchoRoundTrip {
+    NSString *text = @"event loop";
+    // Larger than the socket buffers, so writing has to wait for space.
+    NSData *data = ZLEventLoopTestPatternData(4 * 1024 * 1024);
+
+    ZLEventLoopSocketDelegate *delegate = [ZLEventLoopSocketDelegate new];
+    delegate.expectedMessageCount = 2;
+    delegate.openHandler = ^(ZLWebSocket *webSocket) {
+        [webSocket sendString:text error:NULL];
+        [webSocket sendData:data error:NULL];
+    };
+    ZLWebSocket *webSocket = [self eventLoopWebSocketWithPort:ZLLoopbackServerPort(_server) path:@"/ws/echo" delegate:delegate];
+    [webSocket open];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    [webSocket close];
+
+    XCTAssertNil(delegate.error);
+    XCTAssertEqual(delegate.messages.count, 2u);
+    XCTAssertEqualObjects(delegate.messages.firstObject, text);
+    XCTAssertEqualObjects(delegate.messages.lastObject, data);
+}
+
+// The server writes as fast as it can; reads stop while chunk delivery is backed up and resume from the socket.
+- (void)testFloodArrivesInOrder {
+    NSUInteger length = 64 * 1024;
+    NSUInteger count = 256;
+    ZLEventLoopSocketDelegate *delegate = [ZLEventLoopSocketDelegate new];
+    delegate.expectedMessageCount = count;
+    NSString *path = [NSString stringWithFormat:@"/ws/flood?size=%lu&count=%lu", (unsigned long)length, (unsigned long)count];
+    ZLWebSocket *webSocket = [self eventLoopWebSocketWithPort:ZLLoopbackServerPort(_server) path:path delegate:delegate];
+    [webSocket open];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    [webSocket close];
+
+    XCTAssertNil(delegate.error);
+    XCTAssertEqual(delegate.messages.count, count);
+    NSData *expected = ZLEventLoopTestPatternData(length);
+    for (NSData *message in delegate.messages) {
+        XCTAssertEqualObjects(message, expected);
+    }
+}
+
+- (void)testCompressedEchoRoundTrip {
+    NSMutableString *text = [NSMutableString string];
+    while (text.length < 64 * 1024) {
+        [text appendFormat:@"event loop deflate %lu ", (unsigned long)text.length];
+    }
+    ZLEventLoopSocketDelegate *delegate = [ZLEventLoopSocketDelegate new];
+    delegate.expectedMessageCount = 1;
+    delegate.openHandler = ^(ZLWebSocket *webSocket) {
+        [webSocket sendString:text error:NULL];
+    };
+    ZLWebSocket *webSocket = [self eventLoopWebSocketWithPort:ZLLoopbackServerPort(_server) path:@"/ws/echo" delegate:delegate];
+    webSocket.enablesPerMessageDeflate = YES;
+    [webSocket open];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    [webSocket close];
+
+    XCTAssertNil(delegate.error);
+    XCTAssertEqualObjects(delegate.messages.firstObject, text);
+}
+
+- (void)testRefusedConnectionFails {
+    ZLLoopbackServer *closedServer = ZLLoopbackServerStart(0);
+    uint16_t port = ZLLoopbackServerPort(closedServer);
+    ZLLoopbackServerStop(closedServer);
+
+    ZLEventLoopSocketDelegate *delegate = [ZLEventLoopSocketDelegate new];
+    ZLWebSocket *webSocket = [self eventLoopWebSocketWithPort:port path:@"/ws/echo" delegate:delegate];
+    [webSocket open];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertFalse(delegate.opened);
+    XCTAssertEqualObjects(delegate.error.domain, NSPOSIXErrorDomain);
+    XCTAssertEqual(delegate.error.code, ECONNREFUSED);
+}
+
+@end
@@ -0,0 +1,83 @@
+//
+//  ZLMultipartUploadTests.m
+//  ZLNetworking_Tests
+//
+//  Created by lylaut on 2022/4/2.
+//  Copyright (c) 2022 richiezhl. All rights reserved.
+//
+
+@import XCTest;
+
+#import <ZLNetworking/ZLURLSessionManager.h>
+#import "ZLLoopbackServer.h"
+
+static NSUInteger const ZLMultipartTestFileLength = 256 * 1024;
+
+@interface ZLMultipartUploadTests : XCTestCase
+
+@end
+
+@implementation ZLMultipartUploadTests {
+    ZLLoopbackServer *_server;
+    NSURL *_fileURL;
+}
+
+- (void)setUp {
+    [super setUp];
+    _server = ZLLoopbackServerStart(0);
+    XCTAssertTrue(_server != NULL);
+
+    NSMutableData *data = [NSMutableData dataWithLength:ZLMultipartTestFileLength];
+    uint8_t *bytes = data.mutableBytes;
+    for (NSUInteger i = 0; i < data.length; i++) {
+        bytes[i] = ZLLoopbackServerByteAt(i);
+    }
+    NSString *name = [NSString stringWithFormat:@"zlmultipart-%@.bin", [NSUUID UUID].UUIDString];
+    _fileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:name]];
+    XCTAssertTrue([data writeToURL:_fileURL atomically:YES]);
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtURL:_fileURL error:NULL];
+    ZLLoopbackServerStop(_server);
+    _server = NULL;
+    [super tearDown];
+}
+
+/// Posts a form with a text field and the test file; returns the body length the server received, or -1.
+- (long long)postMultipartToPath:(NSString *)path {
+    NSString *URLString = [NSString stringWithFormat:@"http://127.0.0.1:%u%@", ZLLoopbackServerPort(_server), path];
+    XCTestExpectation *expectation = [self expectationWithDescription:path];
+    __block long long received = -1;
+    NSURL *fileURL = _fileURL;
+    [[ZLURLSessionManager shared] POST:URLString parameters:nil constructingBodyWithBlock:^(ZLMultipartFormData *formData) {
+        [formData appendPartWithFileData:[@"zlnetworking" dataUsingEncoding:NSUTF8StringEncoding] name:@"text" fileName:@"text.txt" mimeType:@"text/plain"];
+        [formData appendPartWithFileURL:fileURL name:@"file"];
+    } headers:nil responseBodyType:ZLResponseBodyTypeJson progress:nil success:^(NSHTTPURLResponse *urlResponse, id responseObject) {
+        XCTAssertEqual(urlResponse.statusCode, 200);
+        received = [responseObject[@"received"] longLongValue];
+        [expectation fulfill];
+    } failure:^(NSError *error) {
+        XCTFail(@"%@ failed: %@", path, error);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    return received;
+}
+
+// A 307 makes the session send the body again; the one-shot body stream has to be replaced by a fresh one.
+- (void)testMultipartPostFollowsTemporaryRedirect {
+    long long direct = [self postMultipartToPath:@"/upload"];
+    XCTAssertGreaterThan(direct, (long long)ZLMultipartTestFileLength);
+
+    uint64_t requestCount = ZLLoopbackServerRequestCount(_server);
+    XCTAssertEqual([self postMultipartToPath:@"/redirect/307/upload"], direct);
+    XCTAssertEqual(ZLLoopbackServerRequestCount(_server), requestCount + 2);
+}
+
+- (void)testMultipartPostFollowsPermanentRedirect {
+    long long direct = [self postMultipartToPath:@"/upload"];
+    XCTAssertEqual([self postMultipartToPath:@"/redirect/308/upload"], direct);
+}
+
+@end
@@ -0,0 +1,219 @@
+//
+//  ZLNetworkThreadPoolTests.m
+//  ZLNetworking_Tests
+//
+//  Created by lylaut on 2022/4/2.
+//  Copyright (c) 2022 richiezhl. All rights reserved.
+//
+
+@import XCTest;
+
+#import <ZLNetworking/ZLWebSocket.h>
+#import "ZLLoopbackServer.h"
+
+/// Keeps one message in flight: every echo is checked, timed and answered with the next message.
+@interface ZLFanOutSocketDelegate : NSObject <ZLWebSocketDelegate>
+
+@property (nonatomic, assign) NSUInteger index;
+@property (nonatomic, assign) NSUInteger messageCount;
+@property (nonatomic, assign) NSUInteger receivedCount;
+@property (nonatomic, assign) BOOL contentMismatched;
+@property (nonatomic, strong) NSError *error;
+@property (nonatomic, strong) XCTestExpectation *doneExpectation;
+@property (nonatomic, copy) void (^latencyBlock)(NSTimeInterval latency);
+
+@end
+
+@implementation ZLFanOutSocketDelegate {
+    CFAbsoluteTime _sentTime;
+}
+
+- (NSURL *)webSocketReConnectURL {
+    return nil;
+}
+
+- (NSURLRequest *)webSocketReConnectRequest {
+    return nil;
+}
+
+- (NSString *)messageAtIndex:(NSUInteger)index {
+    return [NSString stringWithFormat:@"socket %lu message %lu", (unsigned long)self.index, (unsigned long)index];
+}
+
+- (void)sendNextMessage:(ZLWebSocket *)webSocket {
+    _sentTime = CFAbsoluteTimeGetCurrent();
+    NSError *error = nil;
+    if (![webSocket sendString:[self messageAtIndex:self.receivedCount] error:&error]) {
+        self.error = error;
+        [self.doneExpectation fulfill];
+    }
+}
+
+- (void)webSocketDidOpen:(ZLWebSocket *)webSocket {
+    [self sendNextMessage:webSocket];
+}
+
+- (void)webSocket:(ZLWebSocket *)webSocket didReceiveMessageWithString:(NSString *)string {
+    self.latencyBlock(CFAbsoluteTimeGetCurrent() - _sentTime);
+    if (![string isEqualToString:[self messageAtIndex:self.receivedCount]]) {
+        self.contentMismatched = YES;
+    }
+    self.receivedCount++;
+    if (self.receivedCount == self.messageCount) {
+        [self.doneExpectation fulfill];
+        return;
+    }
+    [self sendNextMessage:webSocket];
+}
+
+- (void)webSocket:(ZLWebSocket *)webSocket didFailWithError:(NSError *)error {
+    self.error = error;
+    [self.doneExpectation fulfill];
+}
+
+@end
+
+@interface ZLNetworkThreadPoolTests : XCTestCase
+
+@end
+
+@implementation ZLNetworkThreadPoolTests {
+    ZLLoopbackServer *_server;
+}
+
+- (void)setUp {
+    [super setUp];
+    _server = ZLLoopbackServerStart(0);
+    XCTAssertTrue(_server != NULL);
+}
+
+- (void)tearDown {
+    ZLLoopbackServerStop(_server);
+    _server = NULL;
+    [super tearDown];
+}
+
+- (NSURL *)echoURL {
+    return [NSURL URLWithString:[NSString stringWithFormat:@"ws://127.0.0.1:%u/ws/echo", ZLLoopbackServerPort(_server)]];
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)socketCountsByThread {
+    NSMutableDictionary<NSString *, NSNumber *> *counts = [NSMutableDictionary dictionary];
+    for (ZLNetworkThreadMetrics *metrics in [ZLWebSocket networkThreadMetrics]) {
+        counts[metrics.threadName] = @(metrics.socketCount);
+    }
+    return counts;
+}
+
+// Many sockets echoing at once: every socket gets every echo back, the sockets are spread evenly over the pool,
+// and one thread's backlog does not hold up the round trips of the others.
+- (void)testFanOutAcrossNetworkThreads {
+    const NSUInteger socketCount = 128;
+    const NSUInteger messageCount = 20;
+    NSDictionary<NSString *, NSNumber *> *baseline = [self socketCountsByThread];
+
+    NSMutableArray<NSNumber *> *latencies = [NSMutableArray arrayWithCapacity:socketCount * messageCount];
+    void (^latencyBlock)(NSTimeInterval) = ^(NSTimeInterval latency) {
+        @synchronized (latencies) {
+            [latencies addObject:@(latency)];
+        }
+    };
+
+    NSMutableArray<ZLWebSocket *> *webSockets = [NSMutableArray arrayWithCapacity:socketCount];
+    NSMutableArray<ZLFanOutSocketDelegate *> *delegates = [NSMutableArray arrayWithCapacity:socketCount];
+    for (NSUInteger i = 0; i < socketCount; i++) {
+        ZLWebSocket *webSocket = [[ZLWebSocket alloc] initWithURL:[self echoURL]];
+        webSocket.delegateDispatchQueue = dispatch_queue_create("com.richie.test.websocket.fanout", DISPATCH_QUEUE_SERIAL);
+        ZLFanOutSocketDelegate *delegate = [ZLFanOutSocketDelegate new];
+        delegate.index = i;
+        delegate.messageCount = messageCount;
+        delegate.latencyBlock = latencyBlock;
+        delegate.doneExpectation = [self expectationWithDescription:[NSString stringWithFormat:@"socket %lu", (unsigned long)i]];
+        webSocket.delegate = delegate;
+        [webSockets addObject:webSocket];
+        [delegates addObject:delegate];
+    }
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    for (ZLWebSocket *webSocket in webSockets) {
+        [webSocket open];
+    }
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+
+    for (ZLFanOutSocketDelegate *delegate in delegates) {
+        XCTAssertNil(delegate.error, @"socket %lu", (unsigned long)delegate.index);
+        XCTAssertEqual(delegate.receivedCount, messageCount, @"socket %lu", (unsigned long)delegate.index);
+        XCTAssertFalse(delegate.contentMismatched, @"socket %lu", (unsigned long)delegate.index);
+    }
+
+    // Round-robin assignment: no thread takes more than one socket more than another.
+    NSArray<ZLNetworkThreadMetrics *> *metrics = [ZLWebSocket networkThreadMetrics];
+    NSUInteger assigned = 0, fewest = NSUIntegerMax, most = 0;
+    for (ZLNetworkThreadMetrics *thread in metrics) {
+        NSUInteger added = thread.socketCount - baseline[thread.threadName].unsignedIntegerValue;
+        assigned += added;
+        fewest = MIN(fewest, added);
+        most = MAX(most, added);
+        NSLog(@"%@: %lu sockets, %llu wakeups, busy %.3f ms avg / %.3f ms max, %lu timers", thread.threadName, (unsigned long)added,
+              thread.wakeupCount, thread.averageBusyTime * 1e3, thread.maxBusyTime * 1e3, (unsigned long)thread.timerCount);
+    }
+    XCTAssertEqual(metrics.count, ZLWebSocket.networkThreadCount);
+    XCTAssertEqual(assigned, socketCount);
+    XCTAssertLessThanOrEqual(most - fewest, 1);
+
+    NSArray<NSNumber *> *sorted = [latencies sortedArrayUsingSelector:@selector(compare:)];
+    XCTAssertEqual(sorted.count, socketCount * messageCount);
+    NSTimeInterval p50 = sorted[sorted.count / 2].doubleValue;
+    NSTimeInterval p99 = sorted[(sorted.count * 99 + 99) / 100 - 1].doubleValue;
+    NSLog(@"%lu sockets x %lu echoes in %.2f s, round trip p50 %.2f ms / p99 %.2f ms", (unsigned long)socketCount, (unsigned long)messageCount,
+          elapsed, p50 * 1e3, p99 * 1e3);
+    // Loose enough for a loaded CI simulator; a single shared thread stuck behind a busy socket blows well past it.
+    XCTAssertLessThan(p99, 1.0);
+
+    for (ZLWebSocket *webSocket in webSockets) {
+        [webSocket close];
+    }
+}
+
+- (void)testSocketsWithTheSameAffinityShareAThread {
+    const NSUInteger socketCount = 8;
+    NSDictionary<NSString *, NSNumber *> *baseline = [self socketCountsByThread];
+
+    NSMutableArray<ZLWebSocket *> *webSockets = [NSMutableArray arrayWithCapacity:socketCount];
+    NSMutableArray<ZLFanOutSocketDelegate *> *delegates = [NSMutableArray arrayWithCapacity:socketCount];
+    for (NSUInteger i = 0; i < socketCount; i++) {
+        ZLWebSocket *webSocket = [[ZLWebSocket alloc] initWithURL:[self echoURL]];
+        webSocket.networkThreadAffinity = @"com.richie.test.affinity";
+        webSocket.delegateDispatchQueue = dispatch_queue_create("com.richie.test.websocket.affinity", DISPATCH_QUEUE_SERIAL);
+        ZLFanOutSocketDelegate *delegate = [ZLFanOutSocketDelegate new];
+        delegate.index = i;
+        delegate.messageCount = 1;
+        delegate.latencyBlock = ^(NSTimeInterval latency) {};
+        delegate.doneExpectation = [self expectationWithDescription:[NSString stringWithFormat:@"socket %lu", (unsigned long)i]];
+        webSocket.delegate = delegate;
+        [webSockets addObject:webSocket];
+        [delegates addObject:delegate];
+        [webSocket open];
+    }
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+
+    NSUInteger threadsUsed = 0;
+    for (ZLNetworkThreadMetrics *thread in [ZLWebSocket networkThreadMetrics]) {
+        NSUInteger added = thread.socketCount - baseline[thread.threadName].unsignedIntegerValue;
+        if (added > 0) {
+            threadsUsed++;
+            XCTAssertEqual(added, socketCount);
+        }
+    }
+    XCTAssertEqual(threadsUsed, 1);
+    for (ZLFanOutSocketDelegate *delegate in delegates) {
+        XCTAssertNil(delegate.error);
+        XCTAssertEqual(delegate.receivedCount, 1);
+    }
+
+    for (ZLWebSocket *webSocket in webSockets) {
+        [webSocket close];
+    }
+}
+
+@end
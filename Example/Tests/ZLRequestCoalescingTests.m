@@ -0,0 +1,86 @@
+//
+//  ZLRequestCoalescingTests.m
+//  ZLNetworking_Tests
+//
+//  Created by lylaut on 2022/4/2.
+//  Copyright (c) 2022 richiezhl. All rights reserved.
+//
+
+@import XCTest;
+
+#import <ZLNetworking/ZLURLSessionManager.h>
+#import "ZLLoopbackServer.h"
+
+@interface ZLRequestCoalescingTests : XCTestCase
+
+@end
+
+@implementation ZLRequestCoalescingTests {
+    ZLLoopbackServer *_server;
+}
+
+- (void)setUp {
+    [super setUp];
+    _server = ZLLoopbackServerStart(0);
+    XCTAssertTrue(_server != NULL);
+    [ZLURLSessionManager shared].coalescesIdenticalRequests = YES;
+}
+
+- (void)tearDown {
+    [ZLURLSessionManager shared].coalescesIdenticalRequests = NO;
+    ZLLoopbackServerStop(_server);
+    _server = NULL;
+    [super tearDown];
+}
+
+/// Mutable containers answer their mutators; the immutable ones handed to coalesced callers must not.
+- (BOOL)containsMutableContainer:(id)object {
+    if ([object isKindOfClass:[NSDictionary class]]) {
+        if ([object respondsToSelector:@selector(setObject:forKey:)]) {
+            return YES;
+        }
+        for (id value in [object allValues]) {
+            if ([self containsMutableContainer:value]) {
+                return YES;
+            }
+        }
+    } else if ([object isKindOfClass:[NSArray class]]) {
+        if ([object respondsToSelector:@selector(addObject:)]) {
+            return YES;
+        }
+        for (id element in object) {
+            if ([self containsMutableContainer:element]) {
+                return YES;
+            }
+        }
+    }
+    return NO;
+}
+
+// Both callers share one parse of the XML body; it is read concurrently on the response queue, so it has to be immutable.
+- (void)testCoalescedXMLCallersShareImmutableResponse {
+    // The delay keeps the first request in flight while the second one joins it.
+    NSString *URLString = [NSString stringWithFormat:@"http://127.0.0.1:%u/xml/20?delay=300", ZLLoopbackServerPort(_server)];
+    NSMutableArray *responseObjects = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 2; i++) {
+        XCTestExpectation *expectation = [self expectationWithDescription:[NSString stringWithFormat:@"caller %lu", (unsigned long)i]];
+        [[ZLURLSessionManager shared] GET:URLString parameters:nil headers:nil responseBodyType:ZLResponseBodyTypeXml success:^(NSHTTPURLResponse *urlResponse, id responseObject) {
+            @synchronized (responseObjects) {
+                [responseObjects addObject:responseObject];
+            }
+            [expectation fulfill];
+        } failure:^(NSError *error) {
+            XCTFail(@"%@", error);
+            [expectation fulfill];
+        }];
+    }
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertEqual(ZLLoopbackServerRequestCount(_server), 1);
+    XCTAssertEqual(responseObjects.count, 2u);
+    XCTAssertTrue(responseObjects.firstObject == responseObjects.lastObject);
+    XCTAssertTrue([responseObjects.firstObject isKindOfClass:[NSDictionary class]]);
+    XCTAssertFalse([self containsMutableContainer:responseObjects.firstObject]);
+}
+
+@end
@@ -0,0 +1,115 @@
+//
+//  ZLResponseCacheTests.m
+//  ZLNetworking_Tests
+//
+//  Created by lylaut on 2022/4/2.
+//  Copyright (c) 2022 richiezhl. All rights reserved.
+//
+
+@import XCTest;
+
+#import <ZLNetworking/ZLURLSessionManager.h>
+#import "ZLLoopbackServer.h"
+
+@interface ZLResponseCacheTests : XCTestCase
+
+@end
+
+@implementation ZLResponseCacheTests {
+    ZLLoopbackServer *_server;
+}
+
+- (void)setUp {
+    [super setUp];
+    _server = ZLLoopbackServerStart(0);
+    XCTAssertTrue(_server != NULL);
+    [[ZLURLSessionManager shared] clearResponseCache];
+}
+
+- (void)tearDown {
+    ZLLoopbackServerStop(_server);
+    _server = NULL;
+    [super tearDown];
+}
+
+- (NSString *)URLStringWithPath:(NSString *)path {
+    return [NSString stringWithFormat:@"http://127.0.0.1:%u%@", ZLLoopbackServerPort(_server), path];
+}
+
+- (NSData *)GET:(NSString *)URLString headers:(NSDictionary<NSString *, NSString *> *)headers response:(NSHTTPURLResponse **)response error:(NSError **)error {
+    XCTestExpectation *expectation = [self expectationWithDescription:URLString];
+    __block NSData *body = nil;
+    __block NSHTTPURLResponse *receivedResponse = nil;
+    __block NSError *receivedError = nil;
+    [[ZLURLSessionManager shared] GET:URLString parameters:nil headers:headers responseBodyType:ZLResponseBodyTypeDefault cachePolicy:ZLRequestCachePolicyProtocol success:^(NSHTTPURLResponse *urlResponse, id responseObject) {
+        receivedResponse = urlResponse;
+        body = responseObject;
+        [expectation fulfill];
+    } failure:^(NSError *error) {
+        receivedError = error;
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+    if (response) {
+        *response = receivedResponse;
+    }
+    if (error) {
+        *error = receivedError;
+    }
+    return body;
+}
+
+// The caller's own If-None-Match matches, but there is nothing cached to answer the 304 with.
+- (void)testNotModifiedWithoutCachedEntryRetriesUnconditionally {
+    NSHTTPURLResponse *response = nil;
+    NSError *error = nil;
+    NSData *body = [self GET:[self URLStringWithPath:@"/bytes/1024?maxage=0"] headers:@{@"If-None-Match": @"\"zl-1024\""} response:&response error:&error];
+
+    XCTAssertNil(error);
+    XCTAssertEqual(response.statusCode, 200);
+    XCTAssertEqual(body.length, 1024);
+    XCTAssertEqual(ZLLoopbackServerRequestCount(_server), 2);
+}
+
+- (void)testFreshEntryIsServedWithoutRequest {
+    NSString *URLString = [self URLStringWithPath:@"/bytes/2048?maxage=60"];
+    NSData *first = [self GET:URLString headers:nil response:NULL error:NULL];
+    XCTAssertEqual(first.length, 2048);
+    uint64_t requestCount = ZLLoopbackServerRequestCount(_server);
+
+    NSData *second = [self GET:URLString headers:nil response:NULL error:NULL];
+    XCTAssertEqualObjects(first, second);
+    XCTAssertEqual(ZLLoopbackServerRequestCount(_server), requestCount);
+}
+
+- (void)testStaleEntryIsRevalidated {
+    NSString *URLString = [self URLStringWithPath:@"/bytes/512?maxage=0"];
+    NSData *first = [self GET:URLString headers:nil response:NULL error:NULL];
+
+    NSHTTPURLResponse *response = nil;
+    NSData *second = [self GET:URLString headers:nil response:&response error:NULL];
+    XCTAssertEqualObjects(first, second);
+    XCTAssertEqual(response.statusCode, 200);
+    XCTAssertEqual(ZLLoopbackServerRequestCount(_server), 2);
+}
+
+// The lookup runs off the calling thread, so cancelling right away lands either before the request exists or on the request itself.
+- (void)testCancelWhileLookingUpReportsCancellation {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"cancelled"];
+    __block NSError *receivedError = nil;
+    NSURLSessionDataTask *task = [[ZLURLSessionManager shared] GET:[self URLStringWithPath:@"/bytes/64?delay=500"] parameters:nil headers:nil responseBodyType:ZLResponseBodyTypeDefault cachePolicy:ZLRequestCachePolicyProtocol success:^(NSHTTPURLResponse *urlResponse, id responseObject) {
+        [expectation fulfill];
+    } failure:^(NSError *error) {
+        receivedError = error;
+        [expectation fulfill];
+    }];
+    XCTAssertNotNil(task);
+    XCTAssertEqualObjects(task.originalRequest.URL.path, @"/bytes/64");
+    [task cancel];
+    [self waitForExpectationsWithTimeout:10 handler:nil];
+
+    XCTAssertEqualObjects(receivedError.domain, NSURLErrorDomain);
+    XCTAssertEqual(receivedError.code, NSURLErrorCancelled);
+}
+
+@end
@@ -0,0 +1,131 @@
+//
+//  ZLSegmentedDownloadTests.m
+//  ZLNetworking_Tests
+//
+//  Created by lylaut on 2022/4/2.
+//  Copyright (c) 2022 richiezhl. All rights reserved.
+//
+
+@import XCTest;
+
+#import <ZLNetworking/ZLURLSessionManager.h>
+#import "ZLLoopbackServer.h"
+
+/// Large enough that a loopback download is still running when the cancel lands.
+static unsigned long long const ZLSegmentedTestLength = 64 * 1024 * 1024;
+
+@interface ZLSegmentedDownloadTests : XCTestCase
+
+@end
+
+@implementation ZLSegmentedDownloadTests {
+    ZLLoopbackServer *_server;
+    NSMutableArray<NSURL *> *_destinations;
+}
+
+- (void)setUp {
+    [super setUp];
+    _server = ZLLoopbackServerStart(0);
+    XCTAssertTrue(_server != NULL);
+    _destinations = [NSMutableArray array];
+    [[ZLURLSessionManager shared] clearDiskCache];
+}
+
+- (void)tearDown {
+    for (NSURL *destination in _destinations) {
+        [[NSFileManager defaultManager] removeItemAtURL:destination error:NULL];
+    }
+    [[ZLURLSessionManager shared] clearDiskCache];
+    ZLLoopbackServerStop(_server);
+    _server = NULL;
+    [super tearDown];
+}
+
+- (NSURL *)URLWithPath:(NSString *)path {
+    return [NSURL URLWithString:[NSString stringWithFormat:@"http://127.0.0.1:%u%@", ZLLoopbackServerPort(_server), path]];
+}
+
+- (NSURL *)temporaryDestination {
+    NSString *name = [NSString stringWithFormat:@"zlsegmented-%@", [NSUUID UUID].UUIDString];
+    NSURL *destination = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:name]];
+    [_destinations addObject:destination];
+    return destination;
+}
+
+- (void)assertFileAtURL:(NSURL *)fileURL matchesPatternOfLength:(unsigned long long)length {
+    NSData *data = [NSData dataWithContentsOfURL:fileURL options:NSDataReadingMappedIfSafe error:NULL];
+    XCTAssertEqual(data.length, length);
+    const uint8_t *bytes = data.bytes;
+    for (unsigned long long offset = 0; offset < data.length; offset++) {
+        if (bytes[offset] != ZLLoopbackServerByteAt(offset)) {
+            XCTFail(@"byte %llu is %u, expected %u", offset, bytes[offset], ZLLoopbackServerByteAt(offset));
+            return;
+        }
+    }
+}
+
+/// Starts a segmented download and cancels it once progress passes fraction; returns the completion error.
+- (NSError *)interruptSegmentedDownloadOfURL:(NSURL *)url atProgress:(float)fraction {
+    XCTestExpectation *expectation = [self expectationWithDescription:@"interrupted"];
+    __block BOOL cancelled = NO;
+    __block NSError *receivedError = nil;
+    [[ZLURLSessionManager shared] downloadWithRequest:[NSURLRequest requestWithURL:url] headers:nil destination:[self temporaryDestination] segmentCount:4 progress:^(float downloadProgress) {
+        if (!cancelled && downloadProgress >= fraction) {
+            cancelled = YES;
+            [[ZLURLSessionManager shared] cancelDownloadForURL:url];
+        }
+    } completionHandler:^(NSURLResponse *response, NSURL *filePath, NSError *error) {
+        receivedError = error;
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    return receivedError;
+}
+
+- (void)testInterruptedSegmentedDownloadResumesFromManifest {
+    NSURL *url = [self URLWithPath:[NSString stringWithFormat:@"/bytes/%llu", ZLSegmentedTestLength]];
+    NSError *interruptError = [self interruptSegmentedDownloadOfURL:url atProgress:0.3];
+    XCTAssertEqual(interruptError.code, NSURLErrorCancelled, @"download finished before it could be interrupted");
+    uint64_t rangeRequestCount = ZLLoopbackServerRangeRequestCount(_server);
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"resumed"];
+    __block float firstProgress = -1;
+    __block NSError *receivedError = nil;
+    NSURL *destination = [self temporaryDestination];
+    [[ZLURLSessionManager shared] downloadWithRequest:[NSURLRequest requestWithURL:url] headers:nil destination:destination segmentCount:4 progress:^(float downloadProgress) {
+        if (firstProgress < 0) {
+            firstProgress = downloadProgress;
+        }
+    } completionHandler:^(NSURLResponse *response, NSURL *filePath, NSError *error) {
+        receivedError = error;
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+
+    XCTAssertNil(receivedError);
+    // Progress counts the bytes already on disk, so a resumed download starts where the manifest left off.
+    XCTAssertGreaterThanOrEqual(firstProgress, 0.3);
+    XCTAssertGreaterThan(ZLLoopbackServerRangeRequestCount(_server), rangeRequestCount);
+    [self assertFileAtURL:destination matchesPatternOfLength:ZLSegmentedTestLength];
+}
+
+// The segmented temp file is preallocated to the full length; a plain download must not take it for a finished prefix.
+- (void)testPlainDownloadAfterInterruptedSegmentedDownload {
+    NSURL *url = [self URLWithPath:[NSString stringWithFormat:@"/bytes/%llu", ZLSegmentedTestLength]];
+    NSError *interruptError = [self interruptSegmentedDownloadOfURL:url atProgress:0.1];
+    XCTAssertEqual(interruptError.code, NSURLErrorCancelled, @"download finished before it could be interrupted");
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"plain"];
+    __block NSError *receivedError = nil;
+    NSURL *destination = [self temporaryDestination];
+    [[ZLURLSessionManager shared] downloadWithRequest:[NSURLRequest requestWithURL:url] headers:nil destination:destination progress:nil completionHandler:^(NSURLResponse *response, NSURL *filePath, NSError *error) {
+        receivedError = error;
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+
+    XCTAssertNil(receivedError);
+    [self assertFileAtURL:destination matchesPatternOfLength:ZLSegmentedTestLength];
+}
+
+@end
@@ -0,0 +1,185 @@
+//
+//  ZLWebSocketDeflateTests.m
+//  ZLNetworking_Tests
+//
+//  Created by lylaut on 2022/4/2.
+//  Copyright (c) 2022 richiezhl. All rights reserved.
+//
+
+@import XCTest;
+
+#import <ZLNetworking/ZLWebSocket.h>
+#import "ZLLoopbackServer.h"
+
+@interface ZLDeflateSocketDelegate : NSObject <ZLWebSocketDelegate>
+
+@property (nonatomic, copy) void (^openHandler)(ZLWebSocket *webSocket);
+@property (nonatomic, assign) NSUInteger expectedMessageCount;
+@property (nonatomic, strong) NSMutableArray *messages;
+@property (nonatomic, strong) XCTestExpectation *finishedExpectation;
+@property (nonatomic, assign) NSInteger closeCode;
+@property (nonatomic, strong) NSError *error;
+
+@end
+
+@implementation ZLDeflateSocketDelegate
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _messages = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (NSURL *)webSocketReConnectURL {
+    return nil;
+}
+
+- (NSURLRequest *)webSocketReConnectRequest {
+    return nil;
+}
+
+- (void)webSocketDidOpen:(ZLWebSocket *)webSocket {
+    if (self.openHandler) {
+        self.openHandler(webSocket);
+    }
+}
+
+// Closing after the wait calls back again, so the expectation is only fulfilled once.
+- (void)finish {
+    XCTestExpectation *expectation = self.finishedExpectation;
+    self.finishedExpectation = nil;
+    [expectation fulfill];
+}
+
+- (void)receiveMessage:(id)message {
+    [self.messages addObject:message];
+    if (self.messages.count == self.expectedMessageCount) {
+        [self finish];
+    }
+}
+
+- (void)webSocket:(ZLWebSocket *)webSocket didReceiveMessageWithString:(NSString *)string {
+    [self receiveMessage:string];
+}
+
+- (void)webSocket:(ZLWebSocket *)webSocket didReceiveMessageWithData:(NSData *)data {
+    [self receiveMessage:data];
+}
+
+- (void)webSocket:(ZLWebSocket *)webSocket didFailWithError:(NSError *)error {
+    self.error = error;
+    [self finish];
+}
+
+- (void)webSocket:(ZLWebSocket *)webSocket didCloseWithCode:(NSInteger)code reason:(NSString *)reason wasClean:(BOOL)wasClean {
+    self.closeCode = code;
+    [self finish];
+}
+
+@end
+
+static NSData *ZLDeflateTestPatternData(NSUInteger length) {
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    uint8_t *bytes = data.mutableBytes;
+    for (NSUInteger i = 0; i < length; i++) {
+        bytes[i] = ZLLoopbackServerByteAt(i);
+    }
+    return data;
+}
+
+@interface ZLWebSocketDeflateTests : XCTestCase
+
+@end
+
+@implementation ZLWebSocketDeflateTests {
+    ZLLoopbackServer *_server;
+}
+
+- (void)setUp {
+    [super setUp];
+    _server = ZLLoopbackServerStart(0);
+    XCTAssertTrue(_server != NULL);
+}
+
+- (void)tearDown {
+    ZLLoopbackServerStop(_server);
+    _server = NULL;
+    [super tearDown];
+}
+
+- (ZLWebSocket *)deflateWebSocketWithPath:(NSString *)path delegate:(ZLDeflateSocketDelegate *)delegate {
+    NSString *URLString = [NSString stringWithFormat:@"ws://127.0.0.1:%u%@", ZLLoopbackServerPort(_server), path];
+    ZLWebSocket *webSocket = [[ZLWebSocket alloc] initWithURL:[NSURL URLWithString:URLString]];
+    webSocket.enablesPerMessageDeflate = YES;
+    webSocket.delegateDispatchQueue = dispatch_queue_create("com.richie.test.websocket.deflate", DISPATCH_QUEUE_SERIAL);
+    delegate.finishedExpectation = [self expectationWithDescription:@"finished"];
+    webSocket.delegate = delegate;
+    return webSocket;
+}
+
+// The server inflates what we send and echoes it compressed, so both directions go through zlib.
+- (void)testCompressedEchoRoundTrip {
+    NSMutableString *text = [NSMutableString string];
+    while (text.length < 64 * 1024) {
+        [text appendFormat:@"permessage-deflate %lu ", (unsigned long)text.length];
+    }
+    NSData *data = ZLDeflateTestPatternData(256 * 1024);
+    // Below the compression threshold, sent uncompressed but echoed compressed.
+    NSString *shortText = @"hi";
+
+    ZLDeflateSocketDelegate *delegate = [ZLDeflateSocketDelegate new];
+    delegate.expectedMessageCount = 3;
+    delegate.openHandler = ^(ZLWebSocket *webSocket) {
+        [webSocket sendString:text error:NULL];
+        [webSocket sendData:data error:NULL];
+        [webSocket sendString:shortText error:NULL];
+    };
+    ZLWebSocket *webSocket = [self deflateWebSocketWithPath:@"/ws/echo" delegate:delegate];
+    [webSocket open];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    [webSocket close];
+
+    XCTAssertNil(delegate.error);
+    XCTAssertEqual(delegate.messages.count, 3u);
+    XCTAssertEqualObjects(delegate.messages.firstObject, text);
+    if (delegate.messages.count == 3) {
+        XCTAssertEqualObjects(delegate.messages[1], data);
+        XCTAssertEqualObjects(delegate.messages[2], shortText);
+    }
+}
+
+- (void)testCompressedFloodMessagesInflate {
+    NSUInteger length = 1024 * 1024;
+    ZLDeflateSocketDelegate *delegate = [ZLDeflateSocketDelegate new];
+    delegate.expectedMessageCount = 4;
+    NSString *path = [NSString stringWithFormat:@"/ws/flood?size=%lu&count=4", (unsigned long)length];
+    ZLWebSocket *webSocket = [self deflateWebSocketWithPath:path delegate:delegate];
+    [webSocket open];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+    [webSocket close];
+
+    XCTAssertNil(delegate.error);
+    NSData *expected = ZLDeflateTestPatternData(length);
+    XCTAssertEqual(delegate.messages.count, 4u);
+    for (NSData *message in delegate.messages) {
+        XCTAssertEqualObjects(message, expected);
+    }
+}
+
+// The frame is well under the limit on the wire but inflates past it; the socket has to close instead of buffering it all.
+- (void)testInflatedMessageLargerThanLimitClosesWithMessageTooBig {
+    ZLDeflateSocketDelegate *delegate = [ZLDeflateSocketDelegate new];
+    delegate.expectedMessageCount = 1;
+    ZLWebSocket *webSocket = [self deflateWebSocketWithPath:@"/ws/flood?size=4194304&count=1" delegate:delegate];
+    webSocket.maxInflatedMessageLength = 256 * 1024;
+    [webSocket open];
+    [self waitForExpectationsWithTimeout:30 handler:nil];
+
+    XCTAssertNil(delegate.error);
+    XCTAssertEqual(delegate.messages.count, 0u);
+    XCTAssertEqual(delegate.closeCode, ZLStatusCodeMessageTooBig);
+}
+
+@end
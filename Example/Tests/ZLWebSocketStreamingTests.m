@@ -0,0 +1,110 @@
+//
+//  ZLWebSocketStreamingTests.m
+//  ZLNetworking_Tests
+//
+//  Created by lylaut on 2022/3/31.
+//  Copyright (c) 2022 richiezhl. All rights reserved.
+//
+
+@import XCTest;
+
+#import <ZLNetworking/ZLWebSocket.h>
+#import "ZLLoopbackServer.h"
+
+@interface ZLStreamingSocketDelegate : NSObject <ZLWebSocketDelegate>
+
+@property (nonatomic, assign) useconds_t chunkDelay;
+@property (nonatomic, assign) NSUInteger receivedLength;
+@property (nonatomic, assign) NSUInteger chunkCount;
+@property (nonatomic, assign) BOOL contentMismatched;
+@property (nonatomic, strong) XCTestExpectation *finalChunkExpectation;
+@property (nonatomic, strong) NSError *error;
+
+@end
+
+@implementation ZLStreamingSocketDelegate
+
+- (NSURL *)webSocketReConnectURL {
+    return nil;
+}
+
+- (NSURLRequest *)webSocketReConnectRequest {
+    return nil;
+}
+
+- (void)webSocket:(ZLWebSocket *)webSocket didReceiveMessageChunk:(NSData *)chunk isText:(BOOL)isText isFinal:(BOOL)isFinal {
+    const uint8_t *bytes = chunk.bytes;
+    for (NSUInteger i = 0; i < chunk.length; i++) {
+        if (bytes[i] != ZLLoopbackServerByteAt(self.receivedLength + i)) {
+            self.contentMismatched = YES;
+            break;
+        }
+    }
+    self.receivedLength += chunk.length;
+    self.chunkCount++;
+    // A slow consumer keeps the pending chunk bytes above the limit while the rest of the message is already buffered.
+    usleep(self.chunkDelay);
+    if (isFinal) {
+        [self.finalChunkExpectation fulfill];
+    }
+}
+
+- (void)webSocket:(ZLWebSocket *)webSocket didFailWithError:(NSError *)error {
+    self.error = error;
+    [self.finalChunkExpectation fulfill];
+}
+
+@end
+
+@interface ZLWebSocketStreamingTests : XCTestCase
+
+@end
+
+@implementation ZLWebSocketStreamingTests {
+    ZLLoopbackServer *_server;
+}
+
+- (void)setUp {
+    [super setUp];
+    _server = ZLLoopbackServerStart(0);
+    XCTAssertTrue(_server != NULL);
+}
+
+- (void)tearDown {
+    ZLLoopbackServerStop(_server);
+    _server = NULL;
+    [super tearDown];
+}
+
+- (void)receiveFloodMessageOfLength:(NSUInteger)length maxPendingBytes:(NSUInteger)maxPendingBytes chunkDelay:(useconds_t)chunkDelay {
+    NSString *URLString = [NSString stringWithFormat:@"ws://127.0.0.1:%u/ws/flood?size=%lu&count=1", ZLLoopbackServerPort(_server), (unsigned long)length];
+    ZLWebSocket *webSocket = [[ZLWebSocket alloc] initWithURL:[NSURL URLWithString:URLString]];
+    webSocket.maxPendingMessageChunkBytes = maxPendingBytes;
+    webSocket.delegateDispatchQueue = dispatch_queue_create("com.richie.test.websocket.streaming", DISPATCH_QUEUE_SERIAL);
+
+    ZLStreamingSocketDelegate *delegate = [ZLStreamingSocketDelegate new];
+    delegate.chunkDelay = chunkDelay;
+    delegate.finalChunkExpectation = [self expectationWithDescription:@"final chunk"];
+    webSocket.delegate = delegate;
+
+    [webSocket open];
+    [self waitForExpectationsWithTimeout:60 handler:nil];
+    [webSocket close];
+
+    XCTAssertNil(delegate.error);
+    XCTAssertEqual(delegate.receivedLength, length);
+    XCTAssertGreaterThan(delegate.chunkCount, 1);
+    XCTAssertFalse(delegate.contentMismatched);
+}
+
+// The server writes the whole message right after the handshake, so it is buffered before the delegate falls behind
+// and the socket never reports more bytes; delivery has to resume from the buffer once chunks are drained.
+- (void)testMultiMegabyteMessageInOneReadWithSlowDelegateDeliversFinalChunk {
+    [self receiveFloodMessageOfLength:8 * 1024 * 1024 maxPendingBytes:256 * 1024 chunkDelay:2000];
+}
+
+- (void)testMessageLargerThanPendingLimitWithDefaultSettings {
+    [self receiveFloodMessageOfLength:4 * 1024 * 1024 maxPendingBytes:1024 * 1024 chunkDelay:1000];
+}
+
+@end
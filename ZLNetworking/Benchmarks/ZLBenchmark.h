@@ -0,0 +1,55 @@
+//
+//  ZLBenchmark.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/31.
+//
+
+#ifndef ZLBenchmark_h
+#define ZLBenchmark_h
+
+#include "ZLBenchmarkResults.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ZLBenchmarkOptions {
+    bool quick;             // 缩小数据量和时长，用于 make check 冒烟
+    uint16_t port;          // 本地服务器端口
+} ZLBenchmarkOptions;
+
+/// 场景失败（数据校验不通过、连接出错）时返回 false
+typedef bool (*ZLBenchmarkScenario)(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options);
+
+/* ZLBenchmarkNetwork.c */
+bool ZLBenchmarkSmallGet(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options);
+bool ZLBenchmarkLargeDownload(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options);
+bool ZLBenchmarkUpload(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options);
+bool ZLBenchmarkWebSocketEcho(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options);
+bool ZLBenchmarkWebSocketFlood(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options);
+
+/* ZLBenchmarkParsers.c */
+bool ZLBenchmarkXMLParse(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options);
+bool ZLBenchmarkJSONScan(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options);
+bool ZLBenchmarkHTTPHeadParse(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options);
+bool ZLBenchmarkUTF8Validate(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options);
+
+/* ZLBenchmarkImage.c */
+bool ZLBenchmarkGIFDecode(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options);
+bool ZLBenchmarkAPNGDecode(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options);
+
+/* ZLBenchmarkCache.c */
+bool ZLBenchmarkDiskCacheIndex(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options);
+
+/* ZLBenchmarkTimers.c */
+bool ZLBenchmarkTimerWheel(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options);
+
+/* ZLBenchmarkEventLoop.c */
+bool ZLBenchmarkEventLoopWebSocket(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLBenchmark_h */
@@ -0,0 +1,142 @@
+//
+//  ZLBenchmarkCache.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLBenchmark.h"
+#include "ZLDiskCacheIndex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/// 单次查找只有几十纳秒，比时钟本身还短，按批计时再折算到每次
+#define ZLBenchmarkCacheBatch 64
+
+static uint64_t ZLBenchmarkCacheKey(uint32_t number) {
+    char key[48];
+    int length = snprintf(key, sizeof(key), "https://cdn.example.com/images/%u.jpg", number);
+    return ZLDiskCacheKeyHash(key, (size_t)length);
+}
+
+static uint32_t ZLBenchmarkCacheRandom(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/// 与 ZLDiskCache 相同的用法：命中时 Touch，写入后从最久未访问的一端淘汰到 byteLimit 以内
+bool ZLBenchmarkDiskCacheIndex(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options) {
+    const uint32_t entries = options->quick ? 10000 : 100000;
+    const uint32_t lookups = options->quick ? 20000 : 1000000;
+    const uint64_t entrySize = 32 * 1024;
+    uint64_t *keys = malloc((size_t)entries * 2 * sizeof(uint64_t));
+    size_t batches = lookups / ZLBenchmarkCacheBatch;
+    double *samples = malloc(batches * sizeof(double));
+    ZLDiskCacheIndex *index = ZLDiskCacheIndexCreate();
+    bool succeeded = keys && samples && index;
+    if (!succeeded) {
+        free(keys);
+        free(samples);
+        if (index) {
+            ZLDiskCacheIndexDestroy(index);
+        }
+        return false;
+    }
+    for (uint32_t i = 0; i < entries * 2; i++) {
+        keys[i] = ZLBenchmarkCacheKey(i);
+    }
+
+    double now = 1000;
+    double start = ZLBenchmarkNow();
+    for (uint32_t i = 0; succeeded && i < entries; i++) {
+        succeeded = ZLDiskCacheIndexSet(index, keys[i], entrySize, now++, 0, NULL);
+    }
+    double insertElapsed = ZLBenchmarkNow() - start;
+    succeeded = succeeded && ZLDiskCacheIndexCount(index) == entries;
+
+    // 命中：随机挑已有的 key 查找并 Touch
+    uint32_t state = 2463534242u;
+    size_t hits = 0;
+    for (size_t batch = 0; succeeded && batch < batches; batch++) {
+        double batchStart = ZLBenchmarkNow();
+        for (unsigned i = 0; i < ZLBenchmarkCacheBatch; i++) {
+            uint64_t key = keys[ZLBenchmarkCacheRandom(&state) % entries];
+            if (ZLDiskCacheIndexLookup(index, key)) {
+                ZLDiskCacheIndexTouch(index, key, now);
+                hits++;
+            }
+        }
+        samples[batch] = (ZLBenchmarkNow() - batchStart) * 1e9 / ZLBenchmarkCacheBatch;
+        now++;
+    }
+    succeeded = succeeded && hits == batches * ZLBenchmarkCacheBatch;
+
+    // 未命中
+    size_t misses = 0;
+    start = ZLBenchmarkNow();
+    for (size_t i = 0; succeeded && i < lookups; i++) {
+        misses += ZLDiskCacheIndexLookup(index, keys[entries + ZLBenchmarkCacheRandom(&state) % entries]) == NULL;
+    }
+    double missElapsed = ZLBenchmarkNow() - start;
+    succeeded = succeeded && misses == lookups;
+
+    // 满了之后每写一个新条目都要淘汰一个最旧的
+    uint64_t byteLimit = (uint64_t)entries * entrySize;
+    size_t evictions = 0;
+    start = ZLBenchmarkNow();
+    for (uint32_t i = entries; succeeded && i < entries * 2; i++) {
+        succeeded = ZLDiskCacheIndexSet(index, keys[i], entrySize, now++, 0, NULL);
+        while (succeeded && ZLDiskCacheIndexTotalSize(index) > byteLimit) {
+            const ZLDiskCacheEntry *oldest = ZLDiskCacheIndexOldest(index);
+            succeeded = oldest && ZLDiskCacheIndexRemove(index, oldest->key);
+            evictions++;
+        }
+    }
+    double evictElapsed = ZLBenchmarkNow() - start;
+    succeeded = succeeded && evictions == entries && ZLDiskCacheIndexCount(index) == entries &&
+                ZLDiskCacheIndexLookup(index, keys[entries * 2 - 1]) != NULL;
+
+    // 启动时加载、退到后台时保存
+    size_t length = ZLDiskCacheIndexSerializedLength(index);
+    uint8_t *bytes = succeeded ? malloc(length) : NULL;
+    ZLDiskCacheIndex *loaded = ZLDiskCacheIndexCreate();
+    succeeded = succeeded && bytes && loaded;
+    double serializeElapsed = 0, loadElapsed = 0;
+    if (succeeded) {
+        start = ZLBenchmarkNow();
+        ZLDiskCacheIndexSerialize(index, bytes);
+        serializeElapsed = ZLBenchmarkNow() - start;
+        start = ZLBenchmarkNow();
+        succeeded = ZLDiskCacheIndexLoad(loaded, bytes, length) && ZLDiskCacheIndexCount(loaded) == entries &&
+                    ZLDiskCacheIndexOldest(loaded)->key == ZLDiskCacheIndexOldest(index)->key;
+        loadElapsed = ZLBenchmarkNow() - start;
+    }
+
+    if (succeeded) {
+        ZLBenchmarkResultsAdd(results, "disk_cache_index_hit", "ns/lookup", ZLBenchmarkPercentile(samples, batches, 50), false);
+        ZLBenchmarkResultsAddParameter(results, "entries", entries);
+        ZLBenchmarkResultsAddParameter(results, "batch", ZLBenchmarkCacheBatch);
+        ZLBenchmarkResultsSetSamples(results, "ns", samples, batches);
+        ZLBenchmarkResultsAdd(results, "disk_cache_index_miss", "ns/lookup", missElapsed * 1e9 / lookups, false);
+        ZLBenchmarkResultsAddParameter(results, "entries", entries);
+        ZLBenchmarkResultsAdd(results, "disk_cache_index_insert", "ns/op", insertElapsed * 1e9 / entries, false);
+        ZLBenchmarkResultsAddParameter(results, "entries", entries);
+        ZLBenchmarkResultsAdd(results, "disk_cache_index_insert_evict", "ns/op", evictElapsed * 1e9 / entries, false);
+        ZLBenchmarkResultsAddParameter(results, "entries", entries);
+        ZLBenchmarkResultsAdd(results, "disk_cache_index_serialize", "ms", serializeElapsed * 1e3, false);
+        ZLBenchmarkResultsAddParameter(results, "file_bytes", (double)length);
+        ZLBenchmarkResultsAdd(results, "disk_cache_index_load", "ms", loadElapsed * 1e3, false);
+        ZLBenchmarkResultsAddParameter(results, "entries", entries);
+    }
+    if (loaded) {
+        ZLDiskCacheIndexDestroy(loaded);
+    }
+    free(bytes);
+    ZLDiskCacheIndexDestroy(index);
+    free(samples);
+    free(keys);
+    return succeeded;
+}
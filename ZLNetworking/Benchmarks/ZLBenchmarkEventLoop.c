@@ -0,0 +1,344 @@
+//
+//  ZLBenchmarkEventLoop.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLBenchmark.h"
+#include "ZLEventLoop.h"
+#include "ZLHTTPResponseParser.h"
+#include "ZLLoopbackServer.h"
+#include "ZLSocketStream.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/// 大量 ws:// 连接同时做 echo：每个连接发一条、收到回显再发下一条，连接按轮询分到各个事件循环线程上，
+/// 所有读写都在循环线程的回调里完成，和 ZLWebSocket 用 ZLSocketStream 时的线程模型相同。
+/// 比较 1 个循环和多个循环的吞吐、往返延迟和单次唤醒最长的处理时间
+#define ZLBenchmarkEventLoopPayload 128
+#define ZLBenchmarkEventLoopTimeout 60.0
+
+typedef enum ZLBenchmarkLoopClientState {
+    ZLBenchmarkLoopClientHandshake,
+    ZLBenchmarkLoopClientEcho,
+    ZLBenchmarkLoopClientDone,
+} ZLBenchmarkLoopClientState;
+
+typedef struct ZLBenchmarkLoopClient {
+    ZLSocketStream *stream;
+    ZLBenchmarkLoopClientState state;
+    ZLHTTPResponseHead head;
+    const uint8_t *message;
+
+    uint8_t *output;
+    size_t outputLength;
+    size_t outputOffset;
+    uint8_t *input;
+    size_t inputStart;
+    size_t inputEnd;
+    size_t inputCapacity;
+
+    size_t remaining;
+    double sentAt;
+    double *samples;            // 指向共享数组中属于本连接的一段
+    size_t sampleCount;
+    bool failed;
+    atomic_size_t *finished;
+} ZLBenchmarkLoopClient;
+
+static bool ZLBenchmarkLoopClientQueue(ZLBenchmarkLoopClient *client, const uint8_t *bytes, size_t length) {
+    if (client->outputOffset == client->outputLength) {
+        client->outputOffset = 0;
+        client->outputLength = 0;
+    }
+    uint8_t *output = realloc(client->output, client->outputLength + length);
+    if (!output) {
+        return false;
+    }
+    memcpy(output + client->outputLength, bytes, length);
+    client->output = output;
+    client->outputLength += length;
+    return true;
+}
+
+/// 客户端帧必须带掩码
+static bool ZLBenchmarkLoopClientSendMessage(ZLBenchmarkLoopClient *client) {
+    static const uint8_t mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+    uint8_t frame[ZLBenchmarkEventLoopPayload + 8];
+    size_t offset = 0;
+    frame[offset++] = 0x82;
+    frame[offset++] = 0x80 | 126;
+    frame[offset++] = (uint8_t)(ZLBenchmarkEventLoopPayload >> 8);
+    frame[offset++] = (uint8_t)ZLBenchmarkEventLoopPayload;
+    memcpy(frame + offset, mask, 4);
+    offset += 4;
+    for (size_t i = 0; i < ZLBenchmarkEventLoopPayload; i++) {
+        frame[offset + i] = client->message[i] ^ mask[i % 4];
+    }
+    client->sentAt = ZLBenchmarkNow();
+    return ZLBenchmarkLoopClientQueue(client, frame, offset + ZLBenchmarkEventLoopPayload);
+}
+
+static void ZLBenchmarkLoopClientFinish(ZLBenchmarkLoopClient *client, bool failed) {
+    if (client->state == ZLBenchmarkLoopClientDone) {
+        return;
+    }
+    client->state = ZLBenchmarkLoopClientDone;
+    client->failed = failed;
+    ZLSocketStreamClose(client->stream);
+    atomic_fetch_add(client->finished, 1);
+}
+
+/// 处理缓冲区里完整的响应头和帧，返回 false 表示协议或数据出错
+static bool ZLBenchmarkLoopClientProcess(ZLBenchmarkLoopClient *client) {
+    while (client->state != ZLBenchmarkLoopClientDone) {
+        const uint8_t *data = client->input + client->inputStart;
+        size_t available = client->inputEnd - client->inputStart;
+        if (client->state == ZLBenchmarkLoopClientHandshake) {
+            ZLHTTPParseResult result = ZLHTTPResponseHeadParse(&client->head, data, available);
+            if (result == ZLHTTPParseIncomplete) {
+                return true;
+            }
+            if (result == ZLHTTPParseError || client->head.statusCode != 101) {
+                return false;
+            }
+            client->inputStart += client->head.headLength;
+            client->state = ZLBenchmarkLoopClientEcho;
+            if (!ZLBenchmarkLoopClientSendMessage(client)) {
+                return false;
+            }
+            continue;
+        }
+
+        // 服务端的帧不带掩码，这里只会收到 126 长度编码的二进制帧
+        if (available < 4) {
+            return true;
+        }
+        size_t length = ((size_t)data[2] << 8) | data[3];
+        if (data[0] != 0x82 || data[1] != 126 || length != ZLBenchmarkEventLoopPayload) {
+            return false;
+        }
+        if (available < 4 + length) {
+            return true;
+        }
+        if (memcmp(data + 4, client->message, length) != 0) {
+            return false;
+        }
+        client->inputStart += 4 + length;
+        client->samples[client->sampleCount++] = (ZLBenchmarkNow() - client->sentAt) * 1e6;
+        if (--client->remaining == 0) {
+            ZLBenchmarkLoopClientFinish(client, false);
+            return true;
+        }
+        if (!ZLBenchmarkLoopClientSendMessage(client)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// 写到发送缓冲区满、读到没有数据为止；收到回显后排进去的下一条在同一轮里发出去
+static void ZLBenchmarkLoopClientPump(ZLBenchmarkLoopClient *client) {
+    bool progress = true;
+    while (progress && client->state != ZLBenchmarkLoopClientDone) {
+        progress = false;
+        while (client->outputOffset < client->outputLength) {
+            long written = ZLSocketStreamWrite(client->stream, client->output + client->outputOffset, client->outputLength - client->outputOffset);
+            if (written < 0) {
+                ZLBenchmarkLoopClientFinish(client, true);
+                return;
+            }
+            if (written == 0) {
+                break;
+            }
+            client->outputOffset += (size_t)written;
+        }
+
+        if (client->inputStart == client->inputEnd) {
+            client->inputStart = client->inputEnd = 0;
+        } else if (client->inputCapacity - client->inputEnd < 4096) {
+            memmove(client->input, client->input + client->inputStart, client->inputEnd - client->inputStart);
+            client->inputEnd -= client->inputStart;
+            client->inputStart = 0;
+        }
+        long length = ZLSocketStreamRead(client->stream, client->input + client->inputEnd, client->inputCapacity - client->inputEnd);
+        if (length < 0) {
+            ZLBenchmarkLoopClientFinish(client, true);
+            return;
+        }
+        if (length > 0) {
+            client->inputEnd += (size_t)length;
+            if (!ZLBenchmarkLoopClientProcess(client)) {
+                ZLBenchmarkLoopClientFinish(client, true);
+                return;
+            }
+            progress = true;
+        }
+    }
+}
+
+static void ZLBenchmarkLoopClientCallback(ZLSocketStream *stream, ZLSocketStreamEvent event, void *info) {
+    (void)stream;
+    ZLBenchmarkLoopClient *client = info;
+    switch (event) {
+        case ZLSocketStreamEventOpenCompleted: {
+            static const char request[] = "GET /ws/echo HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                                          "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+            if (!ZLBenchmarkLoopClientQueue(client, (const uint8_t *)request, sizeof(request) - 1)) {
+                ZLBenchmarkLoopClientFinish(client, true);
+            }
+            break;
+        }
+        case ZLSocketStreamEventHasBytesAvailable:
+        case ZLSocketStreamEventHasSpaceAvailable:
+            ZLBenchmarkLoopClientPump(client);
+            break;
+        case ZLSocketStreamEventErrorOccurred:
+        case ZLSocketStreamEventEndEncountered:
+            ZLBenchmarkLoopClientFinish(client, true);
+            break;
+    }
+}
+
+static void *ZLBenchmarkEventLoopThread(void *info) {
+    ZLEventLoopRun(info);
+    return NULL;
+}
+
+typedef struct ZLBenchmarkEventLoopRun {
+    double messagesPerSecond;
+    double maxBusyMicroseconds;
+    double averageBusyMicroseconds;
+} ZLBenchmarkEventLoopRun;
+
+static bool ZLBenchmarkEventLoopEcho(size_t loopCount, size_t connectionCount, size_t messageCount, uint16_t port,
+                                     double *samples, ZLBenchmarkEventLoopRun *run) {
+    ZLEventLoop **loops = calloc(loopCount, sizeof(ZLEventLoop *));
+    pthread_t *threads = calloc(loopCount, sizeof(pthread_t));
+    ZLBenchmarkLoopClient *clients = calloc(connectionCount, sizeof(ZLBenchmarkLoopClient));
+    uint8_t message[ZLBenchmarkEventLoopPayload];
+    for (size_t i = 0; i < sizeof(message); i++) {
+        message[i] = ZLLoopbackServerByteAt(i);
+    }
+    atomic_size_t finished;
+    atomic_init(&finished, 0);
+
+    size_t startedLoops = 0;
+    bool succeeded = loops && threads && clients;
+    for (size_t i = 0; succeeded && i < loopCount; i++) {
+        loops[i] = ZLEventLoopCreate();
+        succeeded = loops[i] && pthread_create(&threads[i], NULL, ZLBenchmarkEventLoopThread, loops[i]) == 0;
+        startedLoops += succeeded;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    size_t connected = 0;
+    double start = ZLBenchmarkNow();
+    for (size_t i = 0; succeeded && i < connectionCount; i++) {
+        ZLBenchmarkLoopClient *client = &clients[i];
+        ZLHTTPResponseHeadReset(&client->head);
+        client->message = message;
+        client->remaining = messageCount;
+        client->samples = samples + i * messageCount;
+        client->finished = &finished;
+        client->inputCapacity = 16384;
+        client->input = malloc(client->inputCapacity);
+        client->stream = client->input ? ZLSocketStreamCreate(loops[i % loopCount], ZLBenchmarkLoopClientCallback, client) : NULL;
+        succeeded = client->stream && ZLSocketStreamConnect(client->stream, (struct sockaddr *)&address, sizeof(address));
+        connected += client->stream != NULL;
+    }
+
+    while (succeeded && atomic_load(&finished) < connectionCount) {
+        if (ZLBenchmarkNow() - start > ZLBenchmarkEventLoopTimeout) {
+            fprintf(stderr, "event loop echo: %zu of %zu connections finished\n", atomic_load(&finished), connectionCount);
+            succeeded = false;
+            break;
+        }
+        usleep(1000);
+    }
+    double elapsed = ZLBenchmarkNow() - start;
+
+    for (size_t i = 0; i < startedLoops; i++) {
+        ZLEventLoopStop(loops[i]);
+        pthread_join(threads[i], NULL);
+    }
+    // 循环线程已经退出，剩下的关闭任务在这里执行完再释放
+    for (size_t i = 0; i < connected; i++) {
+        ZLSocketStreamClose(clients[i].stream);
+        succeeded = succeeded && !clients[i].failed && clients[i].sampleCount == messageCount;
+    }
+    uint64_t wakeups = 0;
+    uint64_t busy = 0;
+    uint64_t maxBusy = 0;
+    for (size_t i = 0; i < startedLoops; i++) {
+        ZLEventLoopRunOnce(loops[i], 0);
+        ZLEventLoopMetrics metrics;
+        ZLEventLoopGetMetrics(loops[i], &metrics);
+        wakeups += metrics.wakeupCount;
+        busy += metrics.busyNanoseconds;
+        maxBusy = metrics.maxBusyNanoseconds > maxBusy ? metrics.maxBusyNanoseconds : maxBusy;
+    }
+    for (size_t i = 0; i < connected; i++) {
+        ZLSocketStreamRelease(clients[i].stream);
+        free(clients[i].input);
+        free(clients[i].output);
+    }
+    for (size_t i = 0; loops && i < loopCount; i++) {
+        ZLEventLoopDestroy(loops[i]);
+    }
+    free(loops);
+    free(threads);
+    free(clients);
+
+    run->messagesPerSecond = (double)(connectionCount * messageCount) / elapsed;
+    run->maxBusyMicroseconds = maxBusy / 1e3;
+    run->averageBusyMicroseconds = wakeups ? busy / 1e3 / (double)wakeups : 0;
+    return succeeded;
+}
+
+bool ZLBenchmarkEventLoopWebSocket(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t maxLoops = processors > 1 ? (size_t)(processors < 4 ? processors : 4) : 2;
+    size_t loopCounts[] = { 1, maxLoops };
+    // 本地服务器每个连接一个线程，连接数不能太大
+    size_t connectionCount = options->quick ? 16 : 256;
+    size_t messageCount = options->quick ? 50 : 400;
+
+    double *samples = malloc(connectionCount * messageCount * sizeof(double));
+    if (!samples) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(loopCounts) / sizeof(loopCounts[0]); i++) {
+        ZLBenchmarkEventLoopRun run;
+        if (!ZLBenchmarkEventLoopEcho(loopCounts[i], connectionCount, messageCount, options->port, samples, &run)) {
+            free(samples);
+            return false;
+        }
+        ZLBenchmarkResultsAdd(results, "event_loop_websocket_echo", "messages/s", run.messagesPerSecond, true);
+        ZLBenchmarkResultsAddParameter(results, "loops", (double)loopCounts[i]);
+        ZLBenchmarkResultsAddParameter(results, "connections", (double)connectionCount);
+        ZLBenchmarkResultsAddParameter(results, "payload_bytes", ZLBenchmarkEventLoopPayload);
+        ZLBenchmarkResultsSetSamples(results, "us", samples, connectionCount * messageCount);
+
+        // 一次唤醒处理得越久，同一个循环上其他连接的事件就被耽误得越久
+        ZLBenchmarkResultsAdd(results, "event_loop_max_busy", "us", run.maxBusyMicroseconds, false);
+        ZLBenchmarkResultsAddParameter(results, "loops", (double)loopCounts[i]);
+        ZLBenchmarkResultsAddParameter(results, "connections", (double)connectionCount);
+        ZLBenchmarkResultsAddParameter(results, "average_busy_us", run.averageBusyMicroseconds);
+    }
+    free(samples);
+    return true;
+}
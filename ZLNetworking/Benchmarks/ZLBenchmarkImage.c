@@ -0,0 +1,434 @@
+//
+//  ZLBenchmarkImage.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/31.
+//
+
+#include "ZLBenchmark.h"
+#include "ZLGIFDecoder.h"
+#include "ZLAPNGDecoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define ZLBenchmarkMiB (1024.0 * 1024.0)
+
+/* 生成 GIF */
+
+typedef struct ZLBenchmarkBytes {
+    uint8_t *bytes;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} ZLBenchmarkBytes;
+
+static void ZLBenchmarkAppend(ZLBenchmarkBytes *data, const void *bytes, size_t length) {
+    if (data->failed) {
+        return;
+    }
+    if (data->length + length > data->capacity) {
+        size_t capacity = (data->capacity + length) * 2;
+        uint8_t *grown = realloc(data->bytes, capacity);
+        if (!grown) {
+            data->failed = true;
+            return;
+        }
+        data->bytes = grown;
+        data->capacity = capacity;
+    }
+    memcpy(data->bytes + data->length, bytes, length);
+    data->length += length;
+}
+
+static void ZLBenchmarkAppendByte(ZLBenchmarkBytes *data, uint8_t byte) {
+    ZLBenchmarkAppend(data, &byte, 1);
+}
+
+static void ZLBenchmarkAppendShort(ZLBenchmarkBytes *data, uint16_t value) {
+    ZLBenchmarkAppendByte(data, (uint8_t)value);
+    ZLBenchmarkAppendByte(data, (uint8_t)(value >> 8));
+}
+
+/// LZW 码流写入器，同时模拟解码端的码长变化，保证两边的码长一致
+typedef struct ZLBenchmarkLZWWriter {
+    ZLBenchmarkBytes *data;
+    uint8_t block[255];
+    size_t blockLength;
+    uint32_t bits;
+    unsigned bitCount;
+
+    unsigned minimumCodeSize;
+    unsigned decoderCodeSize;
+    unsigned decoderNext;
+    bool decoderFirst;
+} ZLBenchmarkLZWWriter;
+
+static void ZLBenchmarkLZWFlushByte(ZLBenchmarkLZWWriter *writer, uint8_t byte) {
+    writer->block[writer->blockLength++] = byte;
+    if (writer->blockLength == sizeof(writer->block)) {
+        ZLBenchmarkAppendByte(writer->data, (uint8_t)writer->blockLength);
+        ZLBenchmarkAppend(writer->data, writer->block, writer->blockLength);
+        writer->blockLength = 0;
+    }
+}
+
+static void ZLBenchmarkLZWEmit(ZLBenchmarkLZWWriter *writer, unsigned code) {
+    writer->bits |= (uint32_t)code << writer->bitCount;
+    writer->bitCount += writer->decoderCodeSize;
+    while (writer->bitCount >= 8) {
+        ZLBenchmarkLZWFlushByte(writer, (uint8_t)writer->bits);
+        writer->bits >>= 8;
+        writer->bitCount -= 8;
+    }
+
+    unsigned clear = 1u << writer->minimumCodeSize;
+    if (code == clear) {
+        writer->decoderCodeSize = writer->minimumCodeSize + 1;
+        writer->decoderNext = clear + 2;
+        writer->decoderFirst = true;
+        return;
+    }
+    if (code == clear + 1) {
+        return;
+    }
+    if (!writer->decoderFirst && writer->decoderNext < 4096) {
+        writer->decoderNext++;
+        if (writer->decoderNext == (1u << writer->decoderCodeSize) && writer->decoderCodeSize < 12) {
+            writer->decoderCodeSize++;
+        }
+    }
+    writer->decoderFirst = false;
+}
+
+#define ZLBenchmarkLZWHashSize 8192
+
+/// 标准的 GIF LZW 编码，字典满了就发 clear
+static void ZLBenchmarkLZWEncode(ZLBenchmarkBytes *data, const uint8_t *pixels, size_t count) {
+    static uint32_t keys[ZLBenchmarkLZWHashSize];
+    static uint16_t codes[ZLBenchmarkLZWHashSize];
+    const unsigned minimumCodeSize = 8;
+    const unsigned clear = 1u << minimumCodeSize;
+
+    ZLBenchmarkAppendByte(data, (uint8_t)minimumCodeSize);
+    ZLBenchmarkLZWWriter writer = { .data = data, .minimumCodeSize = minimumCodeSize };
+    writer.decoderCodeSize = minimumCodeSize + 1;
+
+    memset(keys, 0, sizeof(keys));
+    unsigned next = clear + 2;
+    ZLBenchmarkLZWEmit(&writer, clear);
+    unsigned prefix = pixels[0];
+    for (size_t i = 1; i < count; i++) {
+        uint32_t key = ((uint32_t)prefix << 8 | pixels[i]) + 1;
+        size_t slot = (key * 2654435761u) & (ZLBenchmarkLZWHashSize - 1);
+        while (keys[slot] && keys[slot] != key) {
+            slot = (slot + 1) & (ZLBenchmarkLZWHashSize - 1);
+        }
+        if (keys[slot]) {
+            prefix = codes[slot];
+            continue;
+        }
+        ZLBenchmarkLZWEmit(&writer, prefix);
+        keys[slot] = key;
+        codes[slot] = (uint16_t)next++;
+        if (next == 4096) {
+            ZLBenchmarkLZWEmit(&writer, clear);
+            memset(keys, 0, sizeof(keys));
+            next = clear + 2;
+        }
+        prefix = pixels[i];
+    }
+    ZLBenchmarkLZWEmit(&writer, prefix);
+    ZLBenchmarkLZWEmit(&writer, clear + 1);
+    if (writer.bitCount > 0) {
+        ZLBenchmarkLZWFlushByte(&writer, (uint8_t)writer.bits);
+    }
+    if (writer.blockLength > 0) {
+        ZLBenchmarkAppendByte(data, (uint8_t)writer.blockLength);
+        ZLBenchmarkAppend(data, writer.block, writer.blockLength);
+    }
+    ZLBenchmarkAppendByte(data, 0);
+}
+
+static inline uint8_t ZLBenchmarkPixel(uint32_t x, uint32_t y, uint32_t frame) {
+    // 渐变加少量噪点，压缩率接近真实的动图
+    uint32_t noise = (x * 73856093u) ^ (y * 19349663u) ^ (frame * 83492791u);
+    return (uint8_t)(((x / 4 + y / 4 + frame * 2) & 0x7F) | ((noise >> 13) % 11 == 0 ? 0x80 : 0));
+}
+
+static inline uint32_t ZLBenchmarkPaletteColor(uint8_t index) {
+    return 0xFF000000u | ((uint32_t)index << 16) | ((uint32_t)(255 - index) << 8) | (uint8_t)(index * 3);
+}
+
+static uint8_t *ZLBenchmarkCreateGIF(uint32_t width, uint32_t height, uint32_t frames, size_t *length) {
+    ZLBenchmarkBytes data = { NULL, 0, 0, false };
+    ZLBenchmarkAppend(&data, "GIF89a", 6);
+    ZLBenchmarkAppendShort(&data, (uint16_t)width);
+    ZLBenchmarkAppendShort(&data, (uint16_t)height);
+    ZLBenchmarkAppendByte(&data, 0xF7);
+    ZLBenchmarkAppendByte(&data, 0);
+    ZLBenchmarkAppendByte(&data, 0);
+    for (unsigned i = 0; i < 256; i++) {
+        uint32_t color = ZLBenchmarkPaletteColor((uint8_t)i);
+        uint8_t rgb[3] = { (uint8_t)(color >> 16), (uint8_t)(color >> 8), (uint8_t)color };
+        ZLBenchmarkAppend(&data, rgb, 3);
+    }
+    static const uint8_t loop[] = { 0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 0x03, 0x01, 0x00, 0x00, 0x00 };
+    ZLBenchmarkAppend(&data, loop, sizeof(loop));
+
+    uint8_t *pixels = malloc((size_t)width * height);
+    if (!pixels) {
+        free(data.bytes);
+        return NULL;
+    }
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        static const uint8_t control[] = { 0x21, 0xF9, 0x04, 0x04, 0x04, 0x00, 0x00, 0x00 };
+        ZLBenchmarkAppend(&data, control, sizeof(control));
+        ZLBenchmarkAppendByte(&data, 0x2C);
+        ZLBenchmarkAppendShort(&data, 0);
+        ZLBenchmarkAppendShort(&data, 0);
+        ZLBenchmarkAppendShort(&data, (uint16_t)width);
+        ZLBenchmarkAppendShort(&data, (uint16_t)height);
+        ZLBenchmarkAppendByte(&data, 0);
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                pixels[(size_t)y * width + x] = ZLBenchmarkPixel(x, y, frame);
+            }
+        }
+        ZLBenchmarkLZWEncode(&data, pixels, (size_t)width * height);
+    }
+    free(pixels);
+    ZLBenchmarkAppendByte(&data, 0x3B);
+    if (data.failed) {
+        free(data.bytes);
+        return NULL;
+    }
+    *length = data.length;
+    return data.bytes;
+}
+
+/* 生成 APNG */
+
+static void ZLBenchmarkAppendUInt32(ZLBenchmarkBytes *data, uint32_t value) {
+    uint8_t bytes[4] = { (uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value };
+    ZLBenchmarkAppend(data, bytes, 4);
+}
+
+static void ZLBenchmarkAppendPNGChunk(ZLBenchmarkBytes *data, const char *type, const uint8_t *bytes, size_t length) {
+    ZLBenchmarkAppendUInt32(data, (uint32_t)length);
+    ZLBenchmarkAppend(data, type, 4);
+    ZLBenchmarkAppend(data, bytes, length);
+    uint32_t crc = (uint32_t)crc32(0, (const Bytef *)type, 4);
+    if (length > 0) {
+        crc = (uint32_t)crc32(crc, bytes, (uInt)length);
+    }
+    ZLBenchmarkAppendUInt32(data, crc);
+}
+
+/// 与 GIF 相同的画面和调色板，每帧铺满画布、时长 40ms，扫描行用 Sub 过滤，和常见编码器的输出接近
+static uint8_t *ZLBenchmarkCreateAPNG(uint32_t width, uint32_t height, uint32_t frames, size_t *length) {
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    ZLBenchmarkBytes data = { NULL, 0, 0, false };
+    ZLBenchmarkAppend(&data, signature, sizeof(signature));
+    uint8_t header[13] = { (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+                           (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height, 8, 3, 0, 0, 0 };
+    ZLBenchmarkAppendPNGChunk(&data, "IHDR", header, sizeof(header));
+    uint8_t control[8] = { (uint8_t)(frames >> 24), (uint8_t)(frames >> 16), (uint8_t)(frames >> 8), (uint8_t)frames, 0, 0, 0, 0 };
+    ZLBenchmarkAppendPNGChunk(&data, "acTL", control, sizeof(control));
+    uint8_t palette[256 * 3];
+    for (unsigned i = 0; i < 256; i++) {
+        uint32_t color = ZLBenchmarkPaletteColor((uint8_t)i);
+        palette[i * 3] = (uint8_t)(color >> 16);
+        palette[i * 3 + 1] = (uint8_t)(color >> 8);
+        palette[i * 3 + 2] = (uint8_t)color;
+    }
+    ZLBenchmarkAppendPNGChunk(&data, "PLTE", palette, sizeof(palette));
+
+    size_t scanlinesLength = (size_t)height * (width + 1);
+    uLong bound = compressBound((uLong)scanlinesLength);
+    uint8_t *scanlines = malloc(scanlinesLength);
+    uint8_t *chunk = malloc(4 + bound);
+    if (!scanlines || !chunk) {
+        free(scanlines);
+        free(chunk);
+        free(data.bytes);
+        return NULL;
+    }
+    uint32_t sequence = 0;
+    for (uint32_t frame = 0; frame < frames && !data.failed; frame++) {
+        uint8_t frameControl[26] = { 0 };
+        frameControl[0] = (uint8_t)(sequence >> 24);
+        frameControl[1] = (uint8_t)(sequence >> 16);
+        frameControl[2] = (uint8_t)(sequence >> 8);
+        frameControl[3] = (uint8_t)sequence;
+        memcpy(frameControl + 4, header, 8);
+        frameControl[21] = 4;
+        frameControl[23] = 100;
+        sequence++;
+        ZLBenchmarkAppendPNGChunk(&data, "fcTL", frameControl, sizeof(frameControl));
+
+        for (uint32_t y = 0; y < height; y++) {
+            uint8_t *row = scanlines + (size_t)y * (width + 1);
+            row[0] = 1;
+            uint8_t left = 0;
+            for (uint32_t x = 0; x < width; x++) {
+                uint8_t pixel = ZLBenchmarkPixel(x, y, frame);
+                row[1 + x] = (uint8_t)(pixel - left);
+                left = pixel;
+            }
+        }
+        // 第一帧作为默认图像放在 IDAT 里，之后的帧放在带序号的 fdAT 里
+        uint8_t *compressed = frame == 0 ? chunk : chunk + 4;
+        uLongf compressedLength = bound;
+        if (compress2(compressed, &compressedLength, scanlines, (uLong)scanlinesLength, 6) != Z_OK) {
+            data.failed = true;
+            break;
+        }
+        if (frame == 0) {
+            ZLBenchmarkAppendPNGChunk(&data, "IDAT", chunk, compressedLength);
+        } else {
+            chunk[0] = (uint8_t)(sequence >> 24);
+            chunk[1] = (uint8_t)(sequence >> 16);
+            chunk[2] = (uint8_t)(sequence >> 8);
+            chunk[3] = (uint8_t)sequence;
+            sequence++;
+            ZLBenchmarkAppendPNGChunk(&data, "fdAT", chunk, 4 + compressedLength);
+        }
+    }
+    free(scanlines);
+    free(chunk);
+    ZLBenchmarkAppendPNGChunk(&data, "IEND", NULL, 0);
+    if (data.failed) {
+        free(data.bytes);
+        return NULL;
+    }
+    *length = data.length;
+    return data.bytes;
+}
+
+/* 解码 */
+
+static bool ZLBenchmarkCheckFrame(const uint32_t *pixels, uint32_t width, uint32_t height, uint32_t frame) {
+    for (uint32_t y = 0; y < height; y += 7) {
+        for (uint32_t x = 0; x < width; x += 5) {
+            if (pixels[(size_t)y * width + x] != ZLBenchmarkPaletteColor(ZLBenchmarkPixel(x, y, frame))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool ZLBenchmarkGIFDecode(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options) {
+    const uint32_t width = 512, height = 512;
+    const uint32_t frames = options->quick ? 4 : 60;
+    size_t length = 0;
+    uint8_t *gif = ZLBenchmarkCreateGIF(width, height, frames, &length);
+    if (!gif) {
+        return false;
+    }
+
+    // 和边下边播一样按 16KB 追加
+    size_t baseline = ZLBenchmarkResidentSize();
+    double start = ZLBenchmarkNow();
+    ZLGIFDecoder *decoder = ZLGIFDecoderCreate();
+    bool succeeded = decoder != NULL;
+    for (size_t offset = 0; succeeded && offset < length; offset += 16 * 1024) {
+        size_t n = length - offset < 16 * 1024 ? length - offset : 16 * 1024;
+        succeeded = ZLGIFDecoderAppend(decoder, gif + offset, n);
+    }
+    double appendElapsed = ZLBenchmarkNow() - start;
+    succeeded = succeeded && ZLGIFDecoderIsComplete(decoder) && ZLGIFDecoderFrameCount(decoder) == frames &&
+                ZLGIFDecoderWidth(decoder) == width && ZLGIFDecoderHeight(decoder) == height && ZLGIFDecoderFrameDuration(decoder, 0) == 40;
+
+    ZLGIFCanvas *canvas = succeeded ? ZLGIFCanvasCreate(decoder) : NULL;
+    double *samples = malloc(frames * sizeof(double));
+    succeeded = succeeded && canvas && samples;
+    for (uint32_t frame = 0; succeeded && frame < frames; frame++) {
+        ZLGIFRect dirty;
+        double frameStart = ZLBenchmarkNow();
+        succeeded = ZLGIFCanvasRenderNextFrame(canvas, decoder, &dirty);
+        samples[frame] = (ZLBenchmarkNow() - frameStart) * 1e3;
+        succeeded = succeeded && ZLBenchmarkCheckFrame(ZLGIFCanvasPixels(canvas), width, height, frame);
+    }
+    size_t resident = ZLBenchmarkResidentSize();
+
+    if (succeeded) {
+        double total = 0;
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            total += samples[frame];
+        }
+        ZLBenchmarkResultsAdd(results, "gif_decode", "ms/frame", total / frames, false);
+        ZLBenchmarkResultsAddParameter(results, "width", width);
+        ZLBenchmarkResultsAddParameter(results, "height", height);
+        ZLBenchmarkResultsAddParameter(results, "frames", frames);
+        ZLBenchmarkResultsAddParameter(results, "file_bytes", (double)length);
+        ZLBenchmarkResultsSetSamples(results, "ms", samples, frames);
+        ZLBenchmarkResultsAdd(results, "gif_append", "MiB/s", (double)length / ZLBenchmarkMiB / appendElapsed, true);
+        ZLBenchmarkResultsAddParameter(results, "chunk_bytes", 16 * 1024);
+        ZLBenchmarkResultsAdd(results, "gif_decode_rss_growth", "MiB", resident > baseline ? (double)(resident - baseline) / ZLBenchmarkMiB : 0, false);
+        ZLBenchmarkResultsAddParameter(results, "frames", frames);
+    }
+    free(samples);
+    ZLGIFCanvasDestroy(canvas);
+    ZLGIFDecoderDestroy(decoder);
+    free(gif);
+    return succeeded;
+}
+
+bool ZLBenchmarkAPNGDecode(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options) {
+    const uint32_t width = 512, height = 512;
+    const uint32_t frames = options->quick ? 4 : 60;
+    size_t length = 0;
+    uint8_t *apng = ZLBenchmarkCreateAPNG(width, height, frames, &length);
+    if (!apng) {
+        return false;
+    }
+
+    size_t baseline = ZLBenchmarkResidentSize();
+    double start = ZLBenchmarkNow();
+    ZLAPNGDecoder *decoder = ZLAPNGDecoderCreate();
+    bool succeeded = decoder != NULL;
+    for (size_t offset = 0; succeeded && offset < length; offset += 16 * 1024) {
+        size_t n = length - offset < 16 * 1024 ? length - offset : 16 * 1024;
+        succeeded = ZLAPNGDecoderAppend(decoder, apng + offset, n);
+    }
+    double appendElapsed = ZLBenchmarkNow() - start;
+    succeeded = succeeded && ZLAPNGDecoderIsComplete(decoder) && ZLAPNGDecoderFrameCount(decoder) == frames &&
+                ZLAPNGDecoderWidth(decoder) == width && ZLAPNGDecoderHeight(decoder) == height && ZLAPNGDecoderFrameDuration(decoder, 0) == 40;
+
+    ZLAPNGCanvas *canvas = succeeded ? ZLAPNGCanvasCreate(decoder) : NULL;
+    double *samples = malloc(frames * sizeof(double));
+    succeeded = succeeded && canvas && samples;
+    for (uint32_t frame = 0; succeeded && frame < frames; frame++) {
+        ZLAPNGRect dirty;
+        double frameStart = ZLBenchmarkNow();
+        succeeded = ZLAPNGCanvasRenderNextFrame(canvas, decoder, &dirty);
+        samples[frame] = (ZLBenchmarkNow() - frameStart) * 1e3;
+        succeeded = succeeded && ZLBenchmarkCheckFrame(ZLAPNGCanvasPixels(canvas), width, height, frame);
+    }
+    size_t resident = ZLBenchmarkResidentSize();
+
+    if (succeeded) {
+        double total = 0;
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            total += samples[frame];
+        }
+        ZLBenchmarkResultsAdd(results, "apng_decode", "ms/frame", total / frames, false);
+        ZLBenchmarkResultsAddParameter(results, "width", width);
+        ZLBenchmarkResultsAddParameter(results, "height", height);
+        ZLBenchmarkResultsAddParameter(results, "frames", frames);
+        ZLBenchmarkResultsAddParameter(results, "file_bytes", (double)length);
+        ZLBenchmarkResultsSetSamples(results, "ms", samples, frames);
+        ZLBenchmarkResultsAdd(results, "apng_append", "MiB/s", (double)length / ZLBenchmarkMiB / appendElapsed, true);
+        ZLBenchmarkResultsAddParameter(results, "chunk_bytes", 16 * 1024);
+        ZLBenchmarkResultsAdd(results, "apng_decode_rss_growth", "MiB", resident > baseline ? (double)(resident - baseline) / ZLBenchmarkMiB : 0, false);
+        ZLBenchmarkResultsAddParameter(results, "frames", frames);
+    }
+    free(samples);
+    ZLAPNGCanvasDestroy(canvas);
+    ZLAPNGDecoderDestroy(decoder);
+    free(apng);
+    return succeeded;
+}
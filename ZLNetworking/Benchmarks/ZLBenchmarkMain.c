@@ -0,0 +1,115 @@
+//
+//  ZLBenchmarkMain.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/31.
+//
+
+#include "ZLBenchmark.h"
+#include "ZLLoopbackServer.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct ZLBenchmarkEntry {
+    const char *name;
+    ZLBenchmarkScenario run;
+} ZLBenchmarkEntry;
+
+static const ZLBenchmarkEntry ZLBenchmarkEntries[] = {
+    { "http_small_get", ZLBenchmarkSmallGet },
+    { "http_download", ZLBenchmarkLargeDownload },
+    { "http_upload", ZLBenchmarkUpload },
+    { "websocket_echo", ZLBenchmarkWebSocketEcho },
+    { "websocket_flood", ZLBenchmarkWebSocketFlood },
+    { "xml_parse", ZLBenchmarkXMLParse },
+    { "json_scan", ZLBenchmarkJSONScan },
+    { "http_head_parse", ZLBenchmarkHTTPHeadParse },
+    { "utf8_validate", ZLBenchmarkUTF8Validate },
+    { "gif_decode", ZLBenchmarkGIFDecode },
+    { "apng_decode", ZLBenchmarkAPNGDecode },
+    { "disk_cache_index", ZLBenchmarkDiskCacheIndex },
+    { "timer_wheel", ZLBenchmarkTimerWheel },
+    { "event_loop_websocket", ZLBenchmarkEventLoopWebSocket },
+};
+
+static void ZLBenchmarkUsage(const char *program) {
+    fprintf(stderr, "usage: %s [-q] [-o results.json] [-f filter] [-l]\n"
+                    "  -q  quick run with small inputs (smoke test)\n"
+                    "  -o  write JSON results to a file instead of stdout\n"
+                    "  -f  only run scenarios whose name contains filter\n"
+                    "  -l  list scenarios\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    ZLBenchmarkOptions options = { false, 0 };
+    const char *output = NULL;
+    const char *filter = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "qo:f:lh")) != -1) {
+        switch (option) {
+            case 'q':
+                options.quick = true;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            case 'l':
+                for (size_t i = 0; i < sizeof(ZLBenchmarkEntries) / sizeof(ZLBenchmarkEntries[0]); i++) {
+                    printf("%s\n", ZLBenchmarkEntries[i].name);
+                }
+                return 0;
+            default:
+                ZLBenchmarkUsage(argv[0]);
+                return option == 'h' ? 0 : 2;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    ZLLoopbackServer *server = ZLLoopbackServerStart(0);
+    if (!server) {
+        perror("loopback server");
+        return 1;
+    }
+    options.port = ZLLoopbackServerPort(server);
+
+    ZLBenchmarkResults *results = ZLBenchmarkResultsCreate(options.quick ? "zlnetworking-quick" : "zlnetworking");
+    int failures = 0;
+    size_t ran = 0;
+    for (size_t i = 0; i < sizeof(ZLBenchmarkEntries) / sizeof(ZLBenchmarkEntries[0]); i++) {
+        const ZLBenchmarkEntry *entry = &ZLBenchmarkEntries[i];
+        if (filter && !strstr(entry->name, filter)) {
+            continue;
+        }
+        fprintf(stderr, "%s\n", entry->name);
+        ran++;
+        if (!entry->run(results, &options)) {
+            fprintf(stderr, "  FAILED\n");
+            failures++;
+        }
+    }
+    ZLLoopbackServerStop(server);
+
+    FILE *file = output ? fopen(output, "w") : stdout;
+    if (!file) {
+        perror(output);
+        ZLBenchmarkResultsDestroy(results);
+        return 1;
+    }
+    bool written = ZLBenchmarkResultsWrite(results, file);
+    if (output) {
+        written = fclose(file) == 0 && written;
+    }
+    ZLBenchmarkResultsDestroy(results);
+
+    if (ran == 0) {
+        fprintf(stderr, "no scenario matches '%s'\n", filter);
+        return 2;
+    }
+    return failures || !written ? 1 : 0;
+}
@@ -0,0 +1,675 @@
+//
+//  ZLBenchmarkNetwork.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/31.
+//
+
+#include "ZLBenchmark.h"
+#include "ZLLoopbackServer.h"
+#include "ZLHTTPResponseParser.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+#define ZLBenchmarkSendFlags MSG_NOSIGNAL
+#else
+#define ZLBenchmarkSendFlags 0
+#endif
+
+#define ZLBenchmarkMiB (1024.0 * 1024.0)
+
+/* 客户端 */
+
+/// 带接收缓冲区的阻塞式连接，响应头和 WebSocket 帧都直接在缓冲区里解析
+typedef struct ZLBenchmarkClient {
+    int socket;
+    uint8_t *buffer;
+    size_t start;
+    size_t end;
+    size_t capacity;
+} ZLBenchmarkClient;
+
+typedef void (*ZLBenchmarkSink)(const uint8_t *bytes, size_t length, void *info);
+
+static bool ZLBenchmarkClientOpen(ZLBenchmarkClient *client, uint16_t port) {
+    memset(client, 0, sizeof(ZLBenchmarkClient));
+    client->socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (client->socket < 0) {
+        return false;
+    }
+    int yes = 1;
+    setsockopt(client->socket, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+#ifdef SO_NOSIGPIPE
+    setsockopt(client->socket, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+#endif
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    client->capacity = 256 * 1024;
+    client->buffer = malloc(client->capacity);
+    if (!client->buffer || connect(client->socket, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(client->socket);
+        free(client->buffer);
+        client->buffer = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void ZLBenchmarkClientClose(ZLBenchmarkClient *client) {
+    close(client->socket);
+    free(client->buffer);
+    client->buffer = NULL;
+}
+
+static bool ZLBenchmarkClientSend(ZLBenchmarkClient *client, const void *bytes, size_t length) {
+    const uint8_t *p = bytes;
+    while (length > 0) {
+        ssize_t n = send(client->socket, p, length, ZLBenchmarkSendFlags);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+/// 收一次数据，保证缓冲区从 start 起能放下 need 个字节
+static bool ZLBenchmarkClientFill(ZLBenchmarkClient *client, size_t need) {
+    if (client->start == client->end) {
+        client->start = client->end = 0;
+    }
+    if (client->capacity - client->start < need || client->end == client->capacity) {
+        memmove(client->buffer, client->buffer + client->start, client->end - client->start);
+        client->end -= client->start;
+        client->start = 0;
+        if (client->capacity < need || client->end == client->capacity) {
+            size_t capacity = client->capacity * 2 > need ? client->capacity * 2 : need;
+            uint8_t *buffer = realloc(client->buffer, capacity);
+            if (!buffer) {
+                return false;
+            }
+            client->buffer = buffer;
+            client->capacity = capacity;
+        }
+    }
+    for (;;) {
+        ssize_t n = recv(client->socket, client->buffer + client->end, client->capacity - client->end, 0);
+        if (n > 0) {
+            client->end += (size_t)n;
+            return true;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        return false;
+    }
+}
+
+/// 缓冲区里至少有 length 个连续字节
+static bool ZLBenchmarkClientEnsure(ZLBenchmarkClient *client, size_t length) {
+    while (client->end - client->start < length) {
+        if (!ZLBenchmarkClientFill(client, length)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// 读走 length 个字节交给 sink，sink 为 NULL 时丢弃
+static bool ZLBenchmarkClientConsume(ZLBenchmarkClient *client, uint64_t length, ZLBenchmarkSink sink, void *info) {
+    while (length > 0) {
+        if (client->start == client->end && !ZLBenchmarkClientFill(client, 1)) {
+            return false;
+        }
+        size_t n = client->end - client->start;
+        if (n > length) {
+            n = (size_t)length;
+        }
+        if (sink) {
+            sink(client->buffer + client->start, n, info);
+        }
+        client->start += n;
+        length -= n;
+    }
+    return true;
+}
+
+/// 读出响应头（跳过 1xx），返回状态码和 Content-Length（没有时为 UINT64_MAX），头部字节已从缓冲区移除
+static bool ZLBenchmarkReadResponseHead(ZLBenchmarkClient *client, int *status, uint64_t *contentLength, char *contentRange, size_t contentRangeCapacity) {
+    ZLHTTPResponseHead head;
+    for (;;) {
+        ZLHTTPResponseHeadReset(&head);
+        for (;;) {
+            ZLHTTPParseResult result = ZLHTTPResponseHeadParse(&head, client->buffer + client->start, client->end - client->start);
+            if (result == ZLHTTPParseComplete) {
+                break;
+            }
+            if (result == ZLHTTPParseError || !ZLBenchmarkClientFill(client, client->end - client->start + 1)) {
+                return false;
+            }
+        }
+        const uint8_t *data = client->buffer + client->start;
+        if (head.statusCode >= 100 && head.statusCode < 200 && head.statusCode != 101) {
+            client->start += head.headLength;
+            continue;
+        }
+        *status = head.statusCode;
+        *contentLength = UINT64_MAX;
+        const ZLHTTPHeaderField *field = ZLHTTPResponseHeadFindField(&head, data, "Content-Length");
+        if (field) {
+            char value[32];
+            size_t length = field->value.length < sizeof(value) - 1 ? field->value.length : sizeof(value) - 1;
+            memcpy(value, data + field->value.offset, length);
+            value[length] = '\0';
+            *contentLength = strtoull(value, NULL, 10);
+        }
+        if (contentRange) {
+            contentRange[0] = '\0';
+            field = ZLHTTPResponseHeadFindField(&head, data, "Content-Range");
+            if (field && field->value.length < contentRangeCapacity) {
+                memcpy(contentRange, data + field->value.offset, field->value.length);
+                contentRange[field->value.length] = '\0';
+            }
+        }
+        client->start += head.headLength;
+        return true;
+    }
+}
+
+/// 每隔 4KB 抽查一个字节是否符合 /bytes/<n> 的内容
+typedef struct ZLBenchmarkPatternCheck {
+    uint64_t offset;
+    bool mismatched;
+} ZLBenchmarkPatternCheck;
+
+static void ZLBenchmarkCheckPattern(const uint8_t *bytes, size_t length, void *info) {
+    ZLBenchmarkPatternCheck *check = info;
+    for (size_t i = (size_t)((4096 - check->offset % 4096) % 4096); i < length; i += 4096) {
+        if (bytes[i] != ZLLoopbackServerByteAt(check->offset + i)) {
+            check->mismatched = true;
+        }
+    }
+    check->offset += length;
+}
+
+static bool ZLBenchmarkGet(ZLBenchmarkClient *client, const char *path, const char *extraHeaders, uint64_t firstByte, int *status, uint64_t *length, char *contentRange, size_t contentRangeCapacity) {
+    char request[512];
+    int requestLength = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\n%s\r\n", path, extraHeaders ? extraHeaders : "");
+    if (!ZLBenchmarkClientSend(client, request, (size_t)requestLength) ||
+        !ZLBenchmarkReadResponseHead(client, status, length, contentRange, contentRangeCapacity) || *length == UINT64_MAX) {
+        return false;
+    }
+    ZLBenchmarkPatternCheck check = { firstByte, false };
+    return ZLBenchmarkClientConsume(client, *length, ZLBenchmarkCheckPattern, &check) && !check.mismatched;
+}
+
+/* 小请求 QPS */
+
+typedef struct ZLBenchmarkGetWorker {
+    uint16_t port;
+    double deadline;
+    double *samples;
+    size_t count;
+    size_t capacity;
+    bool failed;
+} ZLBenchmarkGetWorker;
+
+static void *ZLBenchmarkSmallGetThread(void *info) {
+    ZLBenchmarkGetWorker *worker = info;
+    ZLBenchmarkClient client;
+    if (!ZLBenchmarkClientOpen(&client, worker->port)) {
+        worker->failed = true;
+        return NULL;
+    }
+    while (ZLBenchmarkNow() < worker->deadline) {
+        double start = ZLBenchmarkNow();
+        int status = 0;
+        uint64_t length = 0;
+        if (!ZLBenchmarkGet(&client, "/bytes/128", NULL, 0, &status, &length, NULL, 0) || status != 200 || length != 128) {
+            worker->failed = true;
+            break;
+        }
+        if (worker->count == worker->capacity) {
+            worker->capacity = worker->capacity ? worker->capacity * 2 : 4096;
+            double *samples = realloc(worker->samples, worker->capacity * sizeof(double));
+            if (!samples) {
+                worker->failed = true;
+                break;
+            }
+            worker->samples = samples;
+        }
+        worker->samples[worker->count++] = (ZLBenchmarkNow() - start) * 1e6;
+    }
+    ZLBenchmarkClientClose(&client);
+    return NULL;
+}
+
+bool ZLBenchmarkSmallGet(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options) {
+    static const size_t concurrencies[] = { 1, 8 };
+    double duration = options->quick ? 0.3 : 3.0;
+    bool succeeded = true;
+    for (size_t c = 0; c < sizeof(concurrencies) / sizeof(concurrencies[0]); c++) {
+        size_t concurrency = concurrencies[c];
+        ZLBenchmarkGetWorker workers[8];
+        pthread_t threads[8];
+        double start = ZLBenchmarkNow();
+        for (size_t i = 0; i < concurrency; i++) {
+            workers[i] = (ZLBenchmarkGetWorker){ options->port, start + duration, NULL, 0, 0, false };
+            pthread_create(&threads[i], NULL, ZLBenchmarkSmallGetThread, &workers[i]);
+        }
+        size_t total = 0;
+        for (size_t i = 0; i < concurrency; i++) {
+            pthread_join(threads[i], NULL);
+            total += workers[i].count;
+            succeeded = succeeded && !workers[i].failed;
+        }
+        double elapsed = ZLBenchmarkNow() - start;
+
+        double *samples = malloc((total ? total : 1) * sizeof(double));
+        size_t offset = 0;
+        for (size_t i = 0; i < concurrency; i++) {
+            if (samples && workers[i].count) {
+                memcpy(samples + offset, workers[i].samples, workers[i].count * sizeof(double));
+            }
+            offset += workers[i].count;
+            free(workers[i].samples);
+        }
+        ZLBenchmarkResultsAdd(results, "http_small_get", "requests/s", (double)total / elapsed, true);
+        ZLBenchmarkResultsAddParameter(results, "concurrency", (double)concurrency);
+        ZLBenchmarkResultsAddParameter(results, "body_bytes", 128);
+        if (samples) {
+            ZLBenchmarkResultsSetSamples(results, "us", samples, total);
+        }
+        free(samples);
+        succeeded = succeeded && total > 0;
+    }
+    return succeeded;
+}
+
+/* 大文件下载 */
+
+typedef struct ZLBenchmarkSegment {
+    uint16_t port;
+    uint64_t total;
+    uint64_t first;
+    uint64_t last;
+    bool failed;
+} ZLBenchmarkSegment;
+
+static void *ZLBenchmarkSegmentThread(void *info) {
+    ZLBenchmarkSegment *segment = info;
+    ZLBenchmarkClient client;
+    if (!ZLBenchmarkClientOpen(&client, segment->port)) {
+        segment->failed = true;
+        return NULL;
+    }
+    char path[64], range[96], contentRange[96], expected[96];
+    snprintf(path, sizeof(path), "/bytes/%llu", (unsigned long long)segment->total);
+    snprintf(range, sizeof(range), "Range: bytes=%llu-%llu\r\n", (unsigned long long)segment->first, (unsigned long long)segment->last);
+    snprintf(expected, sizeof(expected), "bytes %llu-%llu/%llu",
+             (unsigned long long)segment->first, (unsigned long long)segment->last, (unsigned long long)segment->total);
+    int status = 0;
+    uint64_t length = 0;
+    segment->failed = !ZLBenchmarkGet(&client, path, range, segment->first, &status, &length, contentRange, sizeof(contentRange)) ||
+                      status != 206 || strcmp(contentRange, expected) != 0;
+    ZLBenchmarkClientClose(&client);
+    return NULL;
+}
+
+bool ZLBenchmarkLargeDownload(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options) {
+    uint64_t size = options->quick ? 16 * 1024 * 1024 : 256 * 1024 * 1024;
+    size_t runs = options->quick ? 1 : 3;
+    char path[64];
+    snprintf(path, sizeof(path), "/bytes/%llu", (unsigned long long)size);
+
+    double samples[3];
+    for (size_t run = 0; run < runs; run++) {
+        ZLBenchmarkClient client;
+        if (!ZLBenchmarkClientOpen(&client, options->port)) {
+            return false;
+        }
+        double start = ZLBenchmarkNow();
+        int status = 0;
+        uint64_t length = 0;
+        bool succeeded = ZLBenchmarkGet(&client, path, NULL, 0, &status, &length, NULL, 0) && status == 200 && length == size;
+        samples[run] = (double)size / ZLBenchmarkMiB / (ZLBenchmarkNow() - start);
+        ZLBenchmarkClientClose(&client);
+        if (!succeeded) {
+            return false;
+        }
+    }
+    double best = 0;
+    for (size_t run = 0; run < runs; run++) {
+        best = samples[run] > best ? samples[run] : best;
+    }
+    ZLBenchmarkResultsAdd(results, "http_download", "MiB/s", best, true);
+    ZLBenchmarkResultsAddParameter(results, "bytes", (double)size);
+    ZLBenchmarkResultsSetSamples(results, "MiB/s", samples, runs);
+
+    // 和分段下载一样按区间并发拉取，服务器校验 Range，客户端校验 Content-Range 和内容
+    enum { ZLBenchmarkSegmentCount = 4 };
+    ZLBenchmarkSegment segments[ZLBenchmarkSegmentCount];
+    pthread_t threads[ZLBenchmarkSegmentCount];
+    uint64_t segmentLength = size / ZLBenchmarkSegmentCount;
+    double start = ZLBenchmarkNow();
+    for (size_t i = 0; i < ZLBenchmarkSegmentCount; i++) {
+        uint64_t first = i * segmentLength;
+        uint64_t last = i + 1 == ZLBenchmarkSegmentCount ? size - 1 : first + segmentLength - 1;
+        segments[i] = (ZLBenchmarkSegment){ options->port, size, first, last, false };
+        pthread_create(&threads[i], NULL, ZLBenchmarkSegmentThread, &segments[i]);
+    }
+    bool succeeded = true;
+    for (size_t i = 0; i < ZLBenchmarkSegmentCount; i++) {
+        pthread_join(threads[i], NULL);
+        succeeded = succeeded && !segments[i].failed;
+    }
+    ZLBenchmarkResultsAdd(results, "http_segmented_download", "MiB/s", (double)size / ZLBenchmarkMiB / (ZLBenchmarkNow() - start), true);
+    ZLBenchmarkResultsAddParameter(results, "bytes", (double)size);
+    ZLBenchmarkResultsAddParameter(results, "segments", ZLBenchmarkSegmentCount);
+    return succeeded;
+}
+
+/* multipart 上传 */
+
+static bool ZLBenchmarkSendChunk(ZLBenchmarkClient *client, const void *bytes, size_t length) {
+    char size[32];
+    int sizeLength = snprintf(size, sizeof(size), "%zx\r\n", length);
+    return ZLBenchmarkClientSend(client, size, (size_t)sizeLength) &&
+           ZLBenchmarkClientSend(client, bytes, length) &&
+           ZLBenchmarkClientSend(client, "\r\n", 2);
+}
+
+bool ZLBenchmarkUpload(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options) {
+    size_t fileSize = options->quick ? 8 * 1024 * 1024 : 128 * 1024 * 1024;
+    const char *directory = getenv("TMPDIR");
+    char path[512];
+    snprintf(path, sizeof(path), "%s/zlbenchmark-upload-XXXXXX", directory && *directory ? directory : "/tmp");
+    int file = mkstemp(path);
+    if (file < 0) {
+        return false;
+    }
+    unlink(path);
+
+    uint8_t *chunk = malloc(64 * 1024);
+    bool succeeded = chunk != NULL;
+    for (size_t offset = 0; succeeded && offset < fileSize; offset += 64 * 1024) {
+        for (size_t i = 0; i < 64 * 1024; i++) {
+            chunk[i] = ZLLoopbackServerByteAt(offset + i);
+        }
+        succeeded = write(file, chunk, 64 * 1024) == 64 * 1024;
+    }
+
+    ZLBenchmarkClient client;
+    if (!succeeded || !ZLBenchmarkClientOpen(&client, options->port)) {
+        close(file);
+        free(chunk);
+        return false;
+    }
+
+    // 和 multipart 上传一样从文件分块读出、分块发送，常驻内存不应随文件大小增长
+    static const char head[] = "POST /upload HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                               "Content-Type: multipart/form-data; boundary=ZLBenchmarkBoundary\r\n"
+                               "Transfer-Encoding: chunked\r\n\r\n";
+    static const char preamble[] = "--ZLBenchmarkBoundary\r\n"
+                                   "Content-Disposition: form-data; name=\"file\"; filename=\"upload.bin\"\r\n"
+                                   "Content-Type: application/octet-stream\r\n\r\n";
+    static const char epilogue[] = "\r\n--ZLBenchmarkBoundary--\r\n";
+
+    size_t baseline = ZLBenchmarkResidentSize();
+    size_t peak = baseline;
+    double start = ZLBenchmarkNow();
+    succeeded = ZLBenchmarkClientSend(&client, head, sizeof(head) - 1) && ZLBenchmarkSendChunk(&client, preamble, sizeof(preamble) - 1);
+    lseek(file, 0, SEEK_SET);
+    for (size_t sent = 0; succeeded && sent < fileSize;) {
+        ssize_t n = read(file, chunk, 64 * 1024);
+        if (n <= 0) {
+            succeeded = false;
+            break;
+        }
+        succeeded = ZLBenchmarkSendChunk(&client, chunk, (size_t)n);
+        sent += (size_t)n;
+        if ((sent & (4 * 1024 * 1024 - 1)) == 0) {
+            size_t resident = ZLBenchmarkResidentSize();
+            peak = resident > peak ? resident : peak;
+        }
+    }
+    succeeded = succeeded && ZLBenchmarkSendChunk(&client, epilogue, sizeof(epilogue) - 1) && ZLBenchmarkClientSend(&client, "0\r\n\r\n", 5);
+
+    int status = 0;
+    uint64_t length = 0;
+    char body[64] = "";
+    succeeded = succeeded && ZLBenchmarkReadResponseHead(&client, &status, &length, NULL, 0) && status == 200 && length < sizeof(body) &&
+                ZLBenchmarkClientEnsure(&client, (size_t)length);
+    double elapsed = ZLBenchmarkNow() - start;
+    if (succeeded) {
+        memcpy(body, client.buffer + client.start, (size_t)length);
+        char expected[64];
+        snprintf(expected, sizeof(expected), "{\"received\":%zu}", sizeof(preamble) - 1 + fileSize + sizeof(epilogue) - 1);
+        succeeded = strcmp(body, expected) == 0;
+    }
+    ZLBenchmarkClientClose(&client);
+    close(file);
+    free(chunk);
+    if (!succeeded) {
+        return false;
+    }
+
+    ZLBenchmarkResultsAdd(results, "http_multipart_upload", "MiB/s", (double)fileSize / ZLBenchmarkMiB / elapsed, true);
+    ZLBenchmarkResultsAddParameter(results, "bytes", (double)fileSize);
+    ZLBenchmarkResultsAdd(results, "http_multipart_upload_rss_growth", "MiB", (double)(peak - baseline) / ZLBenchmarkMiB, false);
+    ZLBenchmarkResultsAddParameter(results, "bytes", (double)fileSize);
+    return true;
+}
+
+/* WebSocket */
+
+static bool ZLBenchmarkWebSocketOpen(ZLBenchmarkClient *client, uint16_t port, const char *path) {
+    if (!ZLBenchmarkClientOpen(client, port)) {
+        return false;
+    }
+    // RFC 6455 里的示例 key，对应的 accept 是固定值
+    char request[512];
+    int length = snprintf(request, sizeof(request),
+                          "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                          "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n", path);
+    ZLHTTPResponseHead head;
+    ZLHTTPResponseHeadReset(&head);
+    bool succeeded = ZLBenchmarkClientSend(client, request, (size_t)length);
+    while (succeeded) {
+        ZLHTTPParseResult result = ZLHTTPResponseHeadParse(&head, client->buffer + client->start, client->end - client->start);
+        if (result == ZLHTTPParseComplete) {
+            break;
+        }
+        succeeded = result != ZLHTTPParseError && ZLBenchmarkClientFill(client, client->end - client->start + 1);
+    }
+    if (succeeded) {
+        const uint8_t *data = client->buffer + client->start;
+        const ZLHTTPHeaderField *accept = ZLHTTPResponseHeadFindField(&head, data, "Sec-WebSocket-Accept");
+        succeeded = head.statusCode == 101 && accept && ZLHTTPSpanEquals(data, accept->value, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=", 28);
+        client->start += head.headLength;
+    }
+    if (!succeeded) {
+        ZLBenchmarkClientClose(client);
+    }
+    return succeeded;
+}
+
+/// 发送一个带掩码的完整帧，scratch 至少能放下 length + 14 字节
+static bool ZLBenchmarkWebSocketSend(ZLBenchmarkClient *client, uint8_t opcode, const uint8_t *payload, size_t length, uint8_t *scratch) {
+    static const uint8_t mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+    size_t offset = 0;
+    scratch[offset++] = 0x80 | opcode;
+    if (length < 126) {
+        scratch[offset++] = 0x80 | (uint8_t)length;
+    } else if (length <= UINT16_MAX) {
+        scratch[offset++] = 0x80 | 126;
+        scratch[offset++] = (uint8_t)(length >> 8);
+        scratch[offset++] = (uint8_t)length;
+    } else {
+        scratch[offset++] = 0x80 | 127;
+        for (int i = 0; i < 8; i++) {
+            scratch[offset++] = (uint8_t)((uint64_t)length >> (56 - i * 8));
+        }
+    }
+    memcpy(scratch + offset, mask, 4);
+    offset += 4;
+    for (size_t i = 0; i < length; i++) {
+        scratch[offset + i] = payload[i] ^ mask[i % 4];
+    }
+    return ZLBenchmarkClientSend(client, scratch, offset + length);
+}
+
+/// 收一个完整帧，payload 指向接收缓冲区，下一次读之前有效
+static bool ZLBenchmarkWebSocketReceive(ZLBenchmarkClient *client, uint8_t *opcode, const uint8_t **payload, uint64_t *length) {
+    if (!ZLBenchmarkClientEnsure(client, 2)) {
+        return false;
+    }
+    const uint8_t *header = client->buffer + client->start;
+    if (!(header[0] & 0x80) || (header[1] & 0x80)) {
+        return false;
+    }
+    *opcode = header[0] & 0x0F;
+    uint64_t payloadLength = header[1] & 0x7F;
+    size_t headerLength = 2;
+    if (payloadLength == 126) {
+        headerLength = 4;
+    } else if (payloadLength == 127) {
+        headerLength = 10;
+    }
+    if (!ZLBenchmarkClientEnsure(client, headerLength)) {
+        return false;
+    }
+    header = client->buffer + client->start;
+    if (headerLength > 2) {
+        payloadLength = 0;
+        for (size_t i = 2; i < headerLength; i++) {
+            payloadLength = (payloadLength << 8) | header[i];
+        }
+    }
+    if (!ZLBenchmarkClientEnsure(client, headerLength + (size_t)payloadLength)) {
+        return false;
+    }
+    *payload = client->buffer + client->start + headerLength;
+    *length = payloadLength;
+    client->start += headerLength + (size_t)payloadLength;
+    return true;
+}
+
+static void ZLBenchmarkWebSocketClose(ZLBenchmarkClient *client, uint8_t *scratch) {
+    static const uint8_t normalClosure[2] = { 0x03, 0xE8 };
+    uint8_t opcode = 0;
+    const uint8_t *payload = NULL;
+    uint64_t length = 0;
+    if (ZLBenchmarkWebSocketSend(client, 0x8, normalClosure, sizeof(normalClosure), scratch)) {
+        while (ZLBenchmarkWebSocketReceive(client, &opcode, &payload, &length) && opcode != 0x8) {
+        }
+    }
+    ZLBenchmarkClientClose(client);
+}
+
+bool ZLBenchmarkWebSocketEcho(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options) {
+    static const size_t sizes[] = { 16, 1024, 64 * 1024, 1024 * 1024 };
+    static const size_t iterations[] = { 20000, 10000, 2000, 100 };
+    static const size_t quickIterations[] = { 200, 200, 50, 5 };
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t size = sizes[s];
+        size_t count = options->quick ? quickIterations[s] : iterations[s];
+        uint8_t *message = malloc(size);
+        uint8_t *scratch = malloc(size + 14);
+        double *samples = malloc(count * sizeof(double));
+        ZLBenchmarkClient client;
+        if (!message || !scratch || !samples || !ZLBenchmarkWebSocketOpen(&client, options->port, "/ws/echo")) {
+            free(message);
+            free(scratch);
+            free(samples);
+            return false;
+        }
+        for (size_t i = 0; i < size; i++) {
+            message[i] = ZLLoopbackServerByteAt(i);
+        }
+
+        bool succeeded = true;
+        double start = ZLBenchmarkNow();
+        for (size_t i = 0; i < count && succeeded; i++) {
+            double sent = ZLBenchmarkNow();
+            uint8_t opcode = 0;
+            const uint8_t *payload = NULL;
+            uint64_t length = 0;
+            succeeded = ZLBenchmarkWebSocketSend(&client, 0x2, message, size, scratch) &&
+                        ZLBenchmarkWebSocketReceive(&client, &opcode, &payload, &length) &&
+                        opcode == 0x2 && length == size && memcmp(payload, message, size) == 0;
+            samples[i] = (ZLBenchmarkNow() - sent) * 1e6;
+        }
+        double elapsed = ZLBenchmarkNow() - start;
+        ZLBenchmarkWebSocketClose(&client, scratch);
+
+        if (succeeded) {
+            ZLBenchmarkResultsAdd(results, "websocket_echo", "messages/s", (double)count / elapsed, true);
+            ZLBenchmarkResultsAddParameter(results, "payload_bytes", (double)size);
+            ZLBenchmarkResultsSetSamples(results, "us", samples, count);
+        }
+        free(message);
+        free(scratch);
+        free(samples);
+        if (!succeeded) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ZLBenchmarkWebSocketFlood(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options) {
+    static const size_t sizes[] = { 16, 1024, 64 * 1024 };
+    double totalBytes = options->quick ? 4 * ZLBenchmarkMiB : 256 * ZLBenchmarkMiB;
+    size_t maxCount = options->quick ? 20000 : 1000000;
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t size = sizes[s];
+        size_t count = (size_t)(totalBytes / (double)size);
+        count = count > maxCount ? maxCount : count;
+        char path[96];
+        snprintf(path, sizeof(path), "/ws/flood?size=%zu&count=%zu", size, count);
+
+        uint8_t scratch[16];
+        ZLBenchmarkClient client;
+        double start = ZLBenchmarkNow();
+        if (!ZLBenchmarkWebSocketOpen(&client, options->port, path)) {
+            return false;
+        }
+        bool succeeded = true;
+        for (size_t i = 0; i < count && succeeded; i++) {
+            uint8_t opcode = 0;
+            const uint8_t *payload = NULL;
+            uint64_t length = 0;
+            succeeded = ZLBenchmarkWebSocketReceive(&client, &opcode, &payload, &length) && opcode == 0x2 && length == size &&
+                        payload[size - 1] == ZLLoopbackServerByteAt(size - 1);
+        }
+        double elapsed = ZLBenchmarkNow() - start;
+        ZLBenchmarkWebSocketClose(&client, scratch);
+        if (!succeeded) {
+            return false;
+        }
+        ZLBenchmarkResultsAdd(results, "websocket_flood", "messages/s", (double)count / elapsed, true);
+        ZLBenchmarkResultsAddParameter(results, "payload_bytes", (double)size);
+        ZLBenchmarkResultsAddParameter(results, "messages", (double)count);
+        ZLBenchmarkResultsAddParameter(results, "mib_per_s", (double)count * (double)size / ZLBenchmarkMiB / elapsed);
+    }
+    return true;
+}
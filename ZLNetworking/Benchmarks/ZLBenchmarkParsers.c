@@ -0,0 +1,224 @@
+//
+//  ZLBenchmarkParsers.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/31.
+//
+
+#include "ZLBenchmark.h"
+#include "ZLLoopbackServer.h"
+#include "ZLHTTPResponseParser.h"
+#include "ZLJSONStreamScanner.h"
+#include "ZLUTF8Validator.h"
+#include "ZLXMLPullParser.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ZLBenchmarkMiB (1024.0 * 1024.0)
+#define ZLBenchmarkChunkLength (16 * 1024)
+
+/* XML */
+
+/// 返回开始标签数，出错返回 0；chunkLength 为 0 时一次给出全部数据
+static size_t ZLBenchmarkXMLPull(const uint8_t *document, size_t length, size_t chunkLength) {
+    size_t fed = chunkLength ? (chunkLength < length ? chunkLength : length) : length;
+    ZLXMLPullParser *parser = ZLXMLPullParserCreate(document, fed);
+    if (!parser) {
+        return 0;
+    }
+    if (chunkLength) {
+        ZLXMLPullParserFeed(parser, document, fed, fed == length);
+    }
+    size_t elements = 0;
+    for (;;) {
+        ZLXMLEvent event = ZLXMLPullParserNext(parser);
+        if (event == ZLXMLEventEndDocument) {
+            break;
+        }
+        if (event == ZLXMLEventError) {
+            elements = 0;
+            break;
+        }
+        if (event == ZLXMLEventNeedMoreData) {
+            fed = length - fed > chunkLength ? fed + chunkLength : length;
+            ZLXMLPullParserFeed(parser, document, fed, fed == length);
+        } else if (event == ZLXMLEventStartElement) {
+            elements++;
+        }
+    }
+    ZLXMLPullParserDestroy(parser);
+    return elements;
+}
+
+bool ZLBenchmarkXMLParse(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options) {
+    size_t items = options->quick ? 1000 : 50000;
+    size_t runs = options->quick ? 1 : 5;
+    size_t length = 0;
+    char *document = ZLLoopbackCreateXMLDocument(items, &length);
+    if (!document) {
+        return false;
+    }
+    // Envelope、Body、catalog 加上每个条目里的 item、name、price、desc、tags 和两个 tag
+    size_t expected = 3 + items * 7;
+
+    static const size_t chunkLengths[] = { 0, ZLBenchmarkChunkLength };
+    bool succeeded = true;
+    for (size_t c = 0; c < 2 && succeeded; c++) {
+        double samples[5];
+        for (size_t run = 0; run < runs && succeeded; run++) {
+            double start = ZLBenchmarkNow();
+            succeeded = ZLBenchmarkXMLPull((const uint8_t *)document, length, chunkLengths[c]) == expected;
+            samples[run] = (double)length / ZLBenchmarkMiB / (ZLBenchmarkNow() - start);
+        }
+        if (succeeded) {
+            ZLBenchmarkResultsAdd(results, "xml_pull_parse", "MiB/s", ZLBenchmarkPercentile(samples, runs, 100), true);
+            ZLBenchmarkResultsAddParameter(results, "bytes", (double)length);
+            ZLBenchmarkResultsAddParameter(results, "chunk_bytes", (double)chunkLengths[c]);
+            ZLBenchmarkResultsSetSamples(results, "MiB/s", samples, runs);
+        }
+    }
+    free(document);
+    return succeeded;
+}
+
+/* JSON */
+
+/// 返回数组成员数，出错返回 0
+static size_t ZLBenchmarkJSONMembers(const uint8_t *document, size_t length, size_t chunkLength) {
+    ZLJSONStreamScanner scanner;
+    ZLJSONStreamScannerReset(&scanner);
+    size_t separators = 0;
+    size_t offset = 0;
+    while (offset < length) {
+        size_t available = length - offset;
+        if (chunkLength && available > chunkLength) {
+            available = chunkLength;
+        }
+        size_t consumed = 0;
+        ZLJSONScanResult result = ZLJSONStreamScannerScan(&scanner, document + offset, available, &consumed);
+        offset += consumed;
+        if (result == ZLJSONScanSeparator) {
+            separators++;
+        } else if (result == ZLJSONScanEnd) {
+            return separators + 1;
+        } else if (result == ZLJSONScanError || result == ZLJSONScanScalar || (result == ZLJSONScanNeedMoreData && consumed == 0)) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+bool ZLBenchmarkJSONScan(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options) {
+    size_t items = options->quick ? 2000 : 100000;
+    size_t runs = options->quick ? 1 : 5;
+    size_t length = 0;
+    char *document = ZLLoopbackCreateJSONDocument(items, &length);
+    if (!document) {
+        return false;
+    }
+    static const size_t chunkLengths[] = { 0, ZLBenchmarkChunkLength };
+    bool succeeded = true;
+    for (size_t c = 0; c < 2 && succeeded; c++) {
+        double samples[5];
+        for (size_t run = 0; run < runs && succeeded; run++) {
+            double start = ZLBenchmarkNow();
+            succeeded = ZLBenchmarkJSONMembers((const uint8_t *)document, length, chunkLengths[c]) == items;
+            samples[run] = (double)length / ZLBenchmarkMiB / (ZLBenchmarkNow() - start);
+        }
+        if (succeeded) {
+            ZLBenchmarkResultsAdd(results, "json_stream_scan", "MiB/s", ZLBenchmarkPercentile(samples, runs, 100), true);
+            ZLBenchmarkResultsAddParameter(results, "bytes", (double)length);
+            ZLBenchmarkResultsAddParameter(results, "chunk_bytes", (double)chunkLengths[c]);
+            ZLBenchmarkResultsSetSamples(results, "MiB/s", samples, runs);
+        }
+    }
+    free(document);
+    return succeeded;
+}
+
+/* HTTP 响应头 */
+
+bool ZLBenchmarkHTTPHeadParse(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options) {
+    static const char response[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Date: Thu, 31 Mar 2022 08:00:00 GMT\r\n"
+        "Content-Type: application/json; charset=utf-8\r\n"
+        "Content-Length: 1234\r\n"
+        "Connection: keep-alive\r\n"
+        "Cache-Control: public, max-age=600\r\n"
+        "ETag: \"5f3c-1a2b3c4d\"\r\n"
+        "Last-Modified: Wed, 02 Mar 2022 08:00:00 GMT\r\n"
+        "Vary: Accept-Encoding\r\n"
+        "Server: nginx\r\n"
+        "X-Request-Id: 2c9f6f4e-8a1b-4c2d-9e3f-0a1b2c3d4e5f\r\n"
+        "Strict-Transport-Security: max-age=31536000\r\n"
+        "Set-Cookie: session=abcdef0123456789; Path=/; HttpOnly\r\n"
+        "\r\n";
+    const uint8_t *data = (const uint8_t *)response;
+    size_t length = sizeof(response) - 1;
+    size_t iterations = options->quick ? 10000 : 2000000;
+
+    // 一次给全和按 TCP 分段（三段）给出两种情况
+    for (int split = 0; split < 2; split++) {
+        size_t headers = 0;
+        double start = ZLBenchmarkNow();
+        for (size_t i = 0; i < iterations; i++) {
+            ZLHTTPResponseHead head;
+            ZLHTTPResponseHeadReset(&head);
+            if (split) {
+                ZLHTTPResponseHeadParse(&head, data, length / 3);
+                ZLHTTPResponseHeadParse(&head, data, length * 2 / 3);
+            }
+            if (ZLHTTPResponseHeadParse(&head, data, length) != ZLHTTPParseComplete || !ZLHTTPResponseHeadFindField(&head, data, "etag")) {
+                return false;
+            }
+            headers += head.headerCount;
+        }
+        double elapsed = ZLBenchmarkNow() - start;
+        if (headers != iterations * 12) {
+            return false;
+        }
+        ZLBenchmarkResultsAdd(results, "http_head_parse", "ns/head", elapsed * 1e9 / (double)iterations, false);
+        ZLBenchmarkResultsAddParameter(results, "head_bytes", (double)length);
+        ZLBenchmarkResultsAddParameter(results, "segments", split ? 3 : 1);
+    }
+    return true;
+}
+
+/* UTF-8 */
+
+bool ZLBenchmarkUTF8Validate(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options) {
+    size_t length = options->quick ? 1024 * 1024 : 64 * 1024 * 1024;
+    size_t runs = options->quick ? 1 : 5;
+    uint8_t *text = malloc(length);
+    if (!text) {
+        return false;
+    }
+    // 中文聊天消息的典型组合：ASCII、三字节汉字、四字节 emoji
+    static const char pattern[] = "hello, \xe4\xbd\xa0\xe5\xa5\xbd\xe4\xb8\x96\xe7\x95\x8c \xf0\x9f\x98\x80 {\"id\":42} ";
+    for (int ascii = 1; ascii >= 0; ascii--) {
+        for (size_t i = 0; i < length; i++) {
+            text[i] = ascii ? (uint8_t)('a' + i % 26) : (uint8_t)pattern[i % (sizeof(pattern) - 1)];
+        }
+        // 截掉末尾可能不完整的字符
+        size_t validLength = length - length % (sizeof(pattern) - 1);
+        double samples[5];
+        for (size_t run = 0; run < runs; run++) {
+            ZLUTF8ValidatorState state;
+            ZLUTF8ValidatorReset(&state);
+            double start = ZLBenchmarkNow();
+            bool valid = ZLUTF8ValidatorUpdate(&state, text, validLength) && ZLUTF8ValidatorIsComplete(&state);
+            samples[run] = (double)validLength / ZLBenchmarkMiB / (ZLBenchmarkNow() - start);
+            if (!valid) {
+                free(text);
+                return false;
+            }
+        }
+        ZLBenchmarkResultsAdd(results, "utf8_validate", "MiB/s", ZLBenchmarkPercentile(samples, runs, 100), true);
+        ZLBenchmarkResultsAddParameter(results, "bytes", (double)validLength);
+        ZLBenchmarkResultsAddParameter(results, "ascii_only", ascii);
+    }
+    free(text);
+    return true;
+}
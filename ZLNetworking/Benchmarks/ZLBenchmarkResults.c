@@ -0,0 +1,261 @@
+//
+//  ZLBenchmarkResults.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/31.
+//
+
+#include "ZLBenchmarkResults.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
+#define ZLBenchmarkMaxParameters 8
+
+typedef struct ZLBenchmarkParameter {
+    char key[32];
+    double value;
+} ZLBenchmarkParameter;
+
+typedef struct ZLBenchmarkResult {
+    char name[64];
+    char unit[16];
+    double value;
+    bool higherIsBetter;
+    ZLBenchmarkParameter parameters[ZLBenchmarkMaxParameters];
+    size_t parameterCount;
+
+    bool hasSamples;
+    char sampleUnit[16];
+    size_t sampleCount;
+    double min;
+    double p50;
+    double p99;
+    double max;
+} ZLBenchmarkResult;
+
+struct ZLBenchmarkResults {
+    char suite[64];
+    time_t timestamp;
+    pthread_mutex_t lock;
+    ZLBenchmarkResult *items;
+    size_t count;
+    size_t capacity;
+};
+
+static void ZLBenchmarkCopyString(char *destination, size_t capacity, const char *source) {
+    snprintf(destination, capacity, "%s", source ? source : "");
+}
+
+ZLBenchmarkResults *ZLBenchmarkResultsCreate(const char *suite) {
+    ZLBenchmarkResults *results = calloc(1, sizeof(ZLBenchmarkResults));
+    if (!results) {
+        return NULL;
+    }
+    ZLBenchmarkCopyString(results->suite, sizeof(results->suite), suite);
+    results->timestamp = time(NULL);
+    pthread_mutex_init(&results->lock, NULL);
+    return results;
+}
+
+void ZLBenchmarkResultsDestroy(ZLBenchmarkResults *results) {
+    if (!results) {
+        return;
+    }
+    pthread_mutex_destroy(&results->lock);
+    free(results->items);
+    free(results);
+}
+
+void ZLBenchmarkResultsAdd(ZLBenchmarkResults *results, const char *name, const char *unit, double value, bool higherIsBetter) {
+    pthread_mutex_lock(&results->lock);
+    if (results->count == results->capacity) {
+        size_t capacity = results->capacity ? results->capacity * 2 : 32;
+        ZLBenchmarkResult *items = realloc(results->items, capacity * sizeof(ZLBenchmarkResult));
+        if (!items) {
+            pthread_mutex_unlock(&results->lock);
+            return;
+        }
+        results->items = items;
+        results->capacity = capacity;
+    }
+    ZLBenchmarkResult *result = &results->items[results->count++];
+    memset(result, 0, sizeof(ZLBenchmarkResult));
+    ZLBenchmarkCopyString(result->name, sizeof(result->name), name);
+    ZLBenchmarkCopyString(result->unit, sizeof(result->unit), unit);
+    result->value = value;
+    result->higherIsBetter = higherIsBetter;
+    pthread_mutex_unlock(&results->lock);
+
+    fprintf(stderr, "  %-36s %14.2f %s\n", name, value, unit);
+}
+
+void ZLBenchmarkResultsAddParameter(ZLBenchmarkResults *results, const char *key, double value) {
+    pthread_mutex_lock(&results->lock);
+    if (results->count > 0) {
+        ZLBenchmarkResult *result = &results->items[results->count - 1];
+        if (result->parameterCount < ZLBenchmarkMaxParameters) {
+            ZLBenchmarkParameter *parameter = &result->parameters[result->parameterCount++];
+            ZLBenchmarkCopyString(parameter->key, sizeof(parameter->key), key);
+            parameter->value = value;
+        }
+    }
+    pthread_mutex_unlock(&results->lock);
+}
+
+void ZLBenchmarkResultsSetSamples(ZLBenchmarkResults *results, const char *unit, double *samples, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    double p50 = ZLBenchmarkPercentile(samples, count, 50);
+    double p99 = ZLBenchmarkPercentile(samples, count, 99);
+
+    pthread_mutex_lock(&results->lock);
+    if (results->count > 0) {
+        ZLBenchmarkResult *result = &results->items[results->count - 1];
+        result->hasSamples = true;
+        ZLBenchmarkCopyString(result->sampleUnit, sizeof(result->sampleUnit), unit);
+        result->sampleCount = count;
+        result->min = samples[0];
+        result->p50 = p50;
+        result->p99 = p99;
+        result->max = samples[count - 1];
+    }
+    pthread_mutex_unlock(&results->lock);
+
+    fprintf(stderr, "  %-36s p50 %.2f / p99 %.2f %s (n=%zu)\n", "", p50, p99, unit, count);
+}
+
+size_t ZLBenchmarkResultsCount(const ZLBenchmarkResults *results) {
+    return results->count;
+}
+
+static void ZLBenchmarkWriteString(FILE *file, const char *string) {
+    fputc('"', file);
+    for (const unsigned char *p = (const unsigned char *)string; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(file, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(file, "\\u%04x", *p);
+        } else {
+            fputc(*p, file);
+        }
+    }
+    fputc('"', file);
+}
+
+/// JSON 没有 NaN/Infinity，统一写成 null
+static void ZLBenchmarkWriteNumber(FILE *file, double value) {
+    if (isfinite(value)) {
+        fprintf(file, "%.6g", value);
+    } else {
+        fputs("null", file);
+    }
+}
+
+bool ZLBenchmarkResultsWrite(const ZLBenchmarkResults *results, FILE *file) {
+    struct utsname system;
+    if (uname(&system) != 0) {
+        memset(&system, 0, sizeof(system));
+    }
+    char timestamp[32];
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&results->timestamp));
+
+    fputs("{\n  \"schema\": \"zlnetworking-benchmark/1\",\n  \"suite\": ", file);
+    ZLBenchmarkWriteString(file, results->suite);
+    fputs(",\n  \"timestamp\": ", file);
+    ZLBenchmarkWriteString(file, timestamp);
+    fputs(",\n  \"platform\": {\"os\": ", file);
+    ZLBenchmarkWriteString(file, system.sysname);
+    fputs(", \"release\": ", file);
+    ZLBenchmarkWriteString(file, system.release);
+    fputs(", \"machine\": ", file);
+    ZLBenchmarkWriteString(file, system.machine);
+    fprintf(file, ", \"cpus\": %ld},\n  \"results\": [", sysconf(_SC_NPROCESSORS_ONLN));
+
+    for (size_t i = 0; i < results->count; i++) {
+        const ZLBenchmarkResult *result = &results->items[i];
+        fputs(i ? ",\n    {\"name\": " : "\n    {\"name\": ", file);
+        ZLBenchmarkWriteString(file, result->name);
+        fputs(", \"unit\": ", file);
+        ZLBenchmarkWriteString(file, result->unit);
+        fputs(", \"value\": ", file);
+        ZLBenchmarkWriteNumber(file, result->value);
+        fprintf(file, ", \"higher_is_better\": %s, \"parameters\": {", result->higherIsBetter ? "true" : "false");
+        for (size_t j = 0; j < result->parameterCount; j++) {
+            if (j) {
+                fputs(", ", file);
+            }
+            ZLBenchmarkWriteString(file, result->parameters[j].key);
+            fputs(": ", file);
+            ZLBenchmarkWriteNumber(file, result->parameters[j].value);
+        }
+        fputc('}', file);
+        if (result->hasSamples) {
+            fputs(", \"samples\": {\"unit\": ", file);
+            ZLBenchmarkWriteString(file, result->sampleUnit);
+            fprintf(file, ", \"count\": %zu, \"min\": ", result->sampleCount);
+            ZLBenchmarkWriteNumber(file, result->min);
+            fputs(", \"p50\": ", file);
+            ZLBenchmarkWriteNumber(file, result->p50);
+            fputs(", \"p99\": ", file);
+            ZLBenchmarkWriteNumber(file, result->p99);
+            fputs(", \"max\": ", file);
+            ZLBenchmarkWriteNumber(file, result->max);
+            fputc('}', file);
+        }
+        fputc('}', file);
+    }
+    fputs(results->count ? "\n  ]\n}\n" : "]\n}\n", file);
+    return !ferror(file);
+}
+
+double ZLBenchmarkNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+size_t ZLBenchmarkResidentSize(void) {
+#ifdef __APPLE__
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return (size_t)info.resident_size;
+#else
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file) {
+        return 0;
+    }
+    unsigned long pages = 0, resident = 0;
+    int matched = fscanf(file, "%lu %lu", &pages, &resident);
+    fclose(file);
+    return matched == 2 ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+static int ZLBenchmarkCompareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+double ZLBenchmarkPercentile(double *samples, size_t count, double p) {
+    if (count == 0) {
+        return NAN;
+    }
+    qsort(samples, count, sizeof(double), ZLBenchmarkCompareDoubles);
+    // 最近秩法：第 ceil(p% * n) 个样本
+    size_t rank = (size_t)ceil(p / 100.0 * (double)count);
+    return samples[rank ? rank - 1 : 0];
+}
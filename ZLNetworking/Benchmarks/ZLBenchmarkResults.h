@@ -0,0 +1,53 @@
+//
+//  ZLBenchmarkResults.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/31.
+//
+
+#ifndef ZLBenchmarkResults_h
+#define ZLBenchmarkResults_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 收集一次运行的基准结果，按 results.schema.json 写成 JSON，方便不同版本之间对比
+typedef struct ZLBenchmarkResults ZLBenchmarkResults;
+
+ZLBenchmarkResults *ZLBenchmarkResultsCreate(const char *suite);
+
+void ZLBenchmarkResultsDestroy(ZLBenchmarkResults *results);
+
+/// 记录一项结果，同时在 stderr 打印一行摘要
+void ZLBenchmarkResultsAdd(ZLBenchmarkResults *results, const char *name, const char *unit, double value, bool higherIsBetter);
+
+/// 给最近记录的结果加一个参数，比如负载大小、并发数
+void ZLBenchmarkResultsAddParameter(ZLBenchmarkResults *results, const char *key, double value);
+
+/// 给最近记录的结果附上样本分布（count/min/p50/p99/max），samples 会被排序
+void ZLBenchmarkResultsSetSamples(ZLBenchmarkResults *results, const char *unit, double *samples, size_t count);
+
+size_t ZLBenchmarkResultsCount(const ZLBenchmarkResults *results);
+
+bool ZLBenchmarkResultsWrite(const ZLBenchmarkResults *results, FILE *file);
+
+/// 单调时钟，单位秒
+double ZLBenchmarkNow(void);
+
+/// 当前常驻内存，单位字节，取不到时为 0
+size_t ZLBenchmarkResidentSize(void);
+
+/// 对 samples 排序后取百分位，p 取 0~100
+double ZLBenchmarkPercentile(double *samples, size_t count, double p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLBenchmarkResults_h */
@@ -0,0 +1,319 @@
+//
+//  ZLBenchmarkTimers.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLBenchmark.h"
+#include "ZLTimerWheel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/// 与 ZLWebSocket 相同：50ms 一个 tick，每 5s（±10% 抖动）发一次 ping，2s 内收不到 pong 算超时
+#define ZLBenchmarkTimerTickMilliseconds 50
+#define ZLBenchmarkTimerPingMilliseconds 5000
+#define ZLBenchmarkTimerPongMilliseconds 2000
+
+/// 对照组：CFRunLoop 把定时器按触发时间排在数组里，添加和移除时二分查找位置再整体搬移后面的元素，
+/// 每个不同的触发时间唤醒一次。头部用偏移量出队，相当于 CFArray 的双端存储
+typedef struct ZLBenchmarkSortedTimer {
+    uint64_t deadline;          // 毫秒
+    uint64_t timerID;
+    uintptr_t context;
+} ZLBenchmarkSortedTimer;
+
+typedef struct ZLBenchmarkSortedTimers {
+    ZLBenchmarkSortedTimer *entries;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+    uint64_t nextID;
+} ZLBenchmarkSortedTimers;
+
+typedef struct ZLBenchmarkTimerSocket {
+    uint32_t random;
+    uint64_t pingDeadline;      // 毫秒
+    uint64_t pongDeadline;
+    uint64_t pongTimerID;       // 0 表示没有在等 pong
+} ZLBenchmarkTimerSocket;
+
+/// 在模拟时间上跑，不真的等待；pong 在发出 ping 后的下一次唤醒时到达并取消超时定时器
+typedef struct ZLBenchmarkTimerSimulation {
+    ZLBenchmarkTimerSocket *sockets;
+    uint32_t socketCount;
+    uint32_t *pending;          // 本次唤醒发出了 ping 的连接
+    uint32_t pendingCount;
+    ZLTimerWheel *wheel;
+    ZLBenchmarkSortedTimers *sorted;
+    uint64_t now;               // 毫秒
+    uint64_t operations;        // 添加、取消、触发的总次数
+    uint64_t wakeups;
+    uint64_t pings;
+    uint64_t pongTimeouts;
+    uint64_t maxLateness;       // 毫秒
+    bool failed;
+} ZLBenchmarkTimerSimulation;
+
+static uint32_t ZLBenchmarkTimerRandom(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static bool ZLBenchmarkTimerSimulationInit(ZLBenchmarkTimerSimulation *simulation, uint32_t socketCount) {
+    memset(simulation, 0, sizeof(*simulation));
+    simulation->sockets = calloc(socketCount, sizeof(ZLBenchmarkTimerSocket));
+    simulation->pending = malloc(socketCount * sizeof(uint32_t));
+    simulation->socketCount = socketCount;
+    if (!simulation->sockets || !simulation->pending) {
+        free(simulation->sockets);
+        free(simulation->pending);
+        return false;
+    }
+    // 两种实现用同一组种子，ping 的时间序列相同
+    uint32_t state = 2463534242u;
+    for (uint32_t i = 0; i < socketCount; i++) {
+        ZLBenchmarkTimerSocket *socket = &simulation->sockets[i];
+        socket->random = ZLBenchmarkTimerRandom(&state) | 1;
+        socket->pingDeadline = ZLBenchmarkTimerRandom(&socket->random) % ZLBenchmarkTimerPingMilliseconds + 1;
+    }
+    return true;
+}
+
+static void ZLBenchmarkTimerSimulationFree(ZLBenchmarkTimerSimulation *simulation) {
+    free(simulation->sockets);
+    free(simulation->pending);
+}
+
+/// context 为 (连接序号 << 1 | 是否是 pong 超时) + 1。是 ping 时更新下一次 ping 和 pong 超时的时间并返回 true，
+/// 由调用方添加对应的定时器
+static bool ZLBenchmarkTimerFired(ZLBenchmarkTimerSimulation *simulation, uintptr_t context) {
+    uintptr_t value = context - 1;
+    ZLBenchmarkTimerSocket *socket = &simulation->sockets[value >> 1];
+    simulation->operations++;
+    if (value & 1) {
+        socket->pongTimerID = 0;
+        simulation->pongTimeouts++;
+        return false;
+    }
+    if (simulation->now < socket->pingDeadline) {
+        simulation->failed = true;
+        return false;
+    }
+    if (simulation->now - socket->pingDeadline > simulation->maxLateness) {
+        simulation->maxLateness = simulation->now - socket->pingDeadline;
+    }
+    double jitter = 0.9 + 0.2 * (ZLBenchmarkTimerRandom(&socket->random) % 1000) / 1000.0;
+    socket->pingDeadline = simulation->now + (uint64_t)(ZLBenchmarkTimerPingMilliseconds * jitter);
+    socket->pongDeadline = simulation->now + ZLBenchmarkTimerPongMilliseconds;
+    simulation->pending[simulation->pendingCount++] = (uint32_t)(value >> 1);
+    simulation->pings++;
+    simulation->operations += 2;
+    return true;
+}
+
+/* ZLTimerWheel */
+
+static uint64_t ZLBenchmarkTimerTick(uint64_t milliseconds) {
+    return (milliseconds + ZLBenchmarkTimerTickMilliseconds - 1) / ZLBenchmarkTimerTickMilliseconds;
+}
+
+static void ZLBenchmarkTimerWheelFire(void *context, void *info) {
+    ZLBenchmarkTimerSimulation *simulation = info;
+    if (!ZLBenchmarkTimerFired(simulation, (uintptr_t)context)) {
+        return;
+    }
+    ZLBenchmarkTimerSocket *socket = &simulation->sockets[((uintptr_t)context - 1) >> 1];
+    socket->pongTimerID = ZLTimerWheelSchedule(simulation->wheel, ZLBenchmarkTimerTick(socket->pongDeadline),
+                                               (void *)((uintptr_t)context + 1));
+    if (!socket->pongTimerID || !ZLTimerWheelSchedule(simulation->wheel, ZLBenchmarkTimerTick(socket->pingDeadline), context)) {
+        simulation->failed = true;
+    }
+}
+
+static void ZLBenchmarkTimerWheelReceivePongs(ZLBenchmarkTimerSimulation *simulation) {
+    for (uint32_t i = 0; i < simulation->pendingCount; i++) {
+        ZLBenchmarkTimerSocket *socket = &simulation->sockets[simulation->pending[i]];
+        if (socket->pongTimerID) {
+            void *context = NULL;
+            simulation->failed |= !ZLTimerWheelCancel(simulation->wheel, socket->pongTimerID, &context);
+            socket->pongTimerID = 0;
+            simulation->operations++;
+        }
+    }
+    simulation->pendingCount = 0;
+}
+
+/// 与 ZLWebSocket 的线程一样，每次在 ZLTimerWheelNextTick 返回的 tick 醒来
+static void ZLBenchmarkTimerWheelRun(ZLBenchmarkTimerSimulation *simulation, uint64_t duration) {
+    simulation->wheel = ZLTimerWheelCreate(0);
+    if (!simulation->wheel) {
+        simulation->failed = true;
+        return;
+    }
+    for (uint32_t i = 0; i < simulation->socketCount && !simulation->failed; i++) {
+        void *context = (void *)(((uintptr_t)i << 1) + 1);
+        simulation->failed = !ZLTimerWheelSchedule(simulation->wheel, ZLBenchmarkTimerTick(simulation->sockets[i].pingDeadline), context);
+        simulation->operations++;
+    }
+    while (!simulation->failed) {
+        uint64_t tick = ZLTimerWheelNextTick(simulation->wheel);
+        if (tick == UINT64_MAX || tick * ZLBenchmarkTimerTickMilliseconds > duration) {
+            break;
+        }
+        simulation->now = tick * ZLBenchmarkTimerTickMilliseconds;
+        simulation->wakeups++;
+        ZLBenchmarkTimerWheelReceivePongs(simulation);
+        ZLTimerWheelAdvance(simulation->wheel, tick, ZLBenchmarkTimerWheelFire, simulation);
+    }
+    ZLTimerWheelDestroy(simulation->wheel);
+    simulation->wheel = NULL;
+}
+
+/* sorted timers */
+
+/// 第一个触发时间不早于 deadline 的位置
+static size_t ZLBenchmarkSortedTimersSearch(const ZLBenchmarkSortedTimers *timers, uint64_t deadline) {
+    size_t low = timers->head, high = timers->tail;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (timers->entries[middle].deadline < deadline) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static uint64_t ZLBenchmarkSortedTimersAdd(ZLBenchmarkSortedTimers *timers, uint64_t deadline, uintptr_t context) {
+    if (timers->tail == timers->capacity) {
+        size_t count = timers->tail - timers->head;
+        if (count * 2 >= timers->capacity) {
+            size_t capacity = timers->capacity ? timers->capacity * 2 : 1024;
+            ZLBenchmarkSortedTimer *entries = realloc(timers->entries, capacity * sizeof(ZLBenchmarkSortedTimer));
+            if (!entries) {
+                return 0;
+            }
+            timers->entries = entries;
+            timers->capacity = capacity;
+        }
+        if (timers->head) {
+            memmove(timers->entries, timers->entries + timers->head, count * sizeof(ZLBenchmarkSortedTimer));
+            timers->head = 0;
+        }
+        timers->tail = count;
+    }
+    // 同一时间的按添加顺序触发，插到相同 deadline 的最后
+    size_t index = ZLBenchmarkSortedTimersSearch(timers, deadline + 1);
+    memmove(timers->entries + index + 1, timers->entries + index, (timers->tail - index) * sizeof(ZLBenchmarkSortedTimer));
+    timers->tail++;
+    timers->entries[index] = (ZLBenchmarkSortedTimer){ deadline, ++timers->nextID, context };
+    return timers->nextID;
+}
+
+static bool ZLBenchmarkSortedTimersRemove(ZLBenchmarkSortedTimers *timers, uint64_t deadline, uint64_t timerID) {
+    for (size_t index = ZLBenchmarkSortedTimersSearch(timers, deadline);
+         index < timers->tail && timers->entries[index].deadline == deadline; index++) {
+        if (timers->entries[index].timerID == timerID) {
+            memmove(timers->entries + index, timers->entries + index + 1, (timers->tail - index - 1) * sizeof(ZLBenchmarkSortedTimer));
+            timers->tail--;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void ZLBenchmarkSortedTimersFire(ZLBenchmarkTimerSimulation *simulation, uintptr_t context) {
+    if (!ZLBenchmarkTimerFired(simulation, context)) {
+        return;
+    }
+    ZLBenchmarkTimerSocket *socket = &simulation->sockets[(context - 1) >> 1];
+    socket->pongTimerID = ZLBenchmarkSortedTimersAdd(simulation->sorted, socket->pongDeadline, context + 1);
+    if (!socket->pongTimerID || !ZLBenchmarkSortedTimersAdd(simulation->sorted, socket->pingDeadline, context)) {
+        simulation->failed = true;
+    }
+}
+
+static void ZLBenchmarkSortedTimersReceivePongs(ZLBenchmarkTimerSimulation *simulation) {
+    for (uint32_t i = 0; i < simulation->pendingCount; i++) {
+        ZLBenchmarkTimerSocket *socket = &simulation->sockets[simulation->pending[i]];
+        if (socket->pongTimerID) {
+            simulation->failed |= !ZLBenchmarkSortedTimersRemove(simulation->sorted, socket->pongDeadline, socket->pongTimerID);
+            socket->pongTimerID = 0;
+            simulation->operations++;
+        }
+    }
+    simulation->pendingCount = 0;
+}
+
+/// 每个不同的触发时间都唤醒一次，相当于每个连接各用一个 CFRunLoopTimer
+static void ZLBenchmarkSortedTimersRun(ZLBenchmarkTimerSimulation *simulation, uint64_t duration) {
+    ZLBenchmarkSortedTimers timers = { 0 };
+    simulation->sorted = &timers;
+    for (uint32_t i = 0; i < simulation->socketCount && !simulation->failed; i++) {
+        uintptr_t context = ((uintptr_t)i << 1) + 1;
+        simulation->failed = !ZLBenchmarkSortedTimersAdd(&timers, simulation->sockets[i].pingDeadline, context);
+        simulation->operations++;
+    }
+    while (!simulation->failed && timers.head < timers.tail && timers.entries[timers.head].deadline <= duration) {
+        simulation->now = timers.entries[timers.head].deadline;
+        simulation->wakeups++;
+        ZLBenchmarkSortedTimersReceivePongs(simulation);
+        while (!simulation->failed && timers.head < timers.tail && timers.entries[timers.head].deadline <= simulation->now) {
+            uintptr_t context = timers.entries[timers.head++].context;
+            ZLBenchmarkSortedTimersFire(simulation, context);
+        }
+    }
+    free(timers.entries);
+    simulation->sorted = NULL;
+}
+
+bool ZLBenchmarkTimerWheel(ZLBenchmarkResults *results, const ZLBenchmarkOptions *options) {
+    const uint32_t sockets = options->quick ? 1000 : 10000;
+    const uint64_t duration = options->quick ? 20000 : 120000;
+    ZLBenchmarkTimerSimulation wheel, sorted;
+    if (!ZLBenchmarkTimerSimulationInit(&wheel, sockets)) {
+        return false;
+    }
+    if (!ZLBenchmarkTimerSimulationInit(&sorted, sockets)) {
+        ZLBenchmarkTimerSimulationFree(&wheel);
+        return false;
+    }
+
+    double start = ZLBenchmarkNow();
+    ZLBenchmarkTimerWheelRun(&wheel, duration);
+    double wheelElapsed = ZLBenchmarkNow() - start;
+    start = ZLBenchmarkNow();
+    ZLBenchmarkSortedTimersRun(&sorted, duration);
+    double sortedElapsed = ZLBenchmarkNow() - start;
+
+    // 每个连接至少 ping 了 duration / 5.5s - 1 次，pong 都在超时前到达；时间轮最多晚一个 tick，对照组准时
+    uint64_t minimumPings = sockets * (duration / (ZLBenchmarkTimerPingMilliseconds * 11 / 10) - 1);
+    bool succeeded = !wheel.failed && !sorted.failed &&
+                     wheel.pings >= minimumPings && sorted.pings >= minimumPings &&
+                     wheel.pongTimeouts == 0 && sorted.pongTimeouts == 0 &&
+                     wheel.maxLateness < ZLBenchmarkTimerTickMilliseconds && sorted.maxLateness == 0;
+
+    if (succeeded) {
+        double seconds = duration / 1000.0;
+        ZLBenchmarkResultsAdd(results, "timer_wheel", "ns/op", wheelElapsed * 1e9 / wheel.operations, false);
+        ZLBenchmarkResultsAddParameter(results, "sockets", sockets);
+        ZLBenchmarkResultsAddParameter(results, "simulated_seconds", seconds);
+        ZLBenchmarkResultsAddParameter(results, "operations", (double)wheel.operations);
+        ZLBenchmarkResultsAdd(results, "timer_wheel_wakeups", "wakeups/s", wheel.wakeups / seconds, false);
+        ZLBenchmarkResultsAddParameter(results, "tick_ms", ZLBenchmarkTimerTickMilliseconds);
+        ZLBenchmarkResultsAdd(results, "timer_wheel_max_lateness", "ms", (double)wheel.maxLateness, false);
+        ZLBenchmarkResultsAdd(results, "timer_sorted", "ns/op", sortedElapsed * 1e9 / sorted.operations, false);
+        ZLBenchmarkResultsAddParameter(results, "sockets", sockets);
+        ZLBenchmarkResultsAddParameter(results, "simulated_seconds", seconds);
+        ZLBenchmarkResultsAddParameter(results, "operations", (double)sorted.operations);
+        ZLBenchmarkResultsAdd(results, "timer_sorted_wakeups", "wakeups/s", sorted.wakeups / seconds, false);
+    }
+    ZLBenchmarkTimerSimulationFree(&sorted);
+    ZLBenchmarkTimerSimulationFree(&wheel);
+    return succeeded;
+}
@@ -0,0 +1,1261 @@
+//
+//  ZLLoopbackServer.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/31.
+//
+
+#include "ZLLoopbackServer.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#ifdef MSG_NOSIGNAL
+#define ZLLoopbackSendFlags MSG_NOSIGNAL
+#else
+#define ZLLoopbackSendFlags 0
+#endif
+
+#define ZLLoopbackMaxHeaders 32
+#define ZLLoopbackMaxHeadLength (16 * 1024)
+#define ZLLoopbackBufferLength (64 * 1024)
+
+/// flood 的消息总长不超过这个值时拼成一次写出
+#define ZLLoopbackMaxFloodBatch (16 * 1024 * 1024)
+
+/// 协商了 permessage-deflate 时，回显的消息要整条收齐再压缩，超过这个长度就断开
+#define ZLLoopbackMaxDeflateMessage (64 * 1024 * 1024)
+
+static const char *const ZLLoopbackLastModified = "Wed, 02 Mar 2022 08:00:00 GMT";
+
+struct ZLLoopbackServer {
+    int listenSocket;
+    int wakePipe[2];            // 停止时写入，唤醒 accept 线程的 poll
+    uint16_t port;
+    pthread_t acceptThread;
+
+    pthread_mutex_t lock;
+    pthread_cond_t condition;
+    bool stopping;
+    int *connections;           // 活动连接，停止时逐个 shutdown
+    size_t connectionCount;
+    size_t connectionCapacity;
+
+    _Atomic uint64_t requestCount;
+    _Atomic uint64_t rangeRequestCount;
+};
+
+typedef struct ZLLoopbackConnection {
+    ZLLoopbackServer *server;
+    int socket;
+    size_t start;
+    size_t end;
+    uint8_t buffer[ZLLoopbackBufferLength];
+} ZLLoopbackConnection;
+
+typedef struct ZLLoopbackRequest {
+    char head[ZLLoopbackMaxHeadLength + 1];
+    const char *method;
+    const char *path;
+    const char *query;
+    int minorVersion;
+    size_t headerCount;
+    const char *names[ZLLoopbackMaxHeaders];
+    const char *values[ZLLoopbackMaxHeaders];
+} ZLLoopbackRequest;
+
+/* SHA-1 和 Base64，只用于计算 Sec-WebSocket-Accept */
+
+typedef struct ZLLoopbackSHA1 {
+    uint32_t state[5];
+    uint64_t length;
+    uint8_t block[64];
+    size_t blockLength;
+} ZLLoopbackSHA1;
+
+static inline uint32_t ZLLoopbackRotateLeft(uint32_t value, unsigned shift) {
+    return (value << shift) | (value >> (32 - shift));
+}
+
+static void ZLLoopbackSHA1Block(ZLLoopbackSHA1 *sha, const uint8_t *block) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) | ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = ZLLoopbackRotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = sha->state[0], b = sha->state[1], c = sha->state[2], d = sha->state[3], e = sha->state[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t temp = ZLLoopbackRotateLeft(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ZLLoopbackRotateLeft(b, 30);
+        b = a;
+        a = temp;
+    }
+    sha->state[0] += a;
+    sha->state[1] += b;
+    sha->state[2] += c;
+    sha->state[3] += d;
+    sha->state[4] += e;
+}
+
+static void ZLLoopbackSHA1Update(ZLLoopbackSHA1 *sha, const uint8_t *bytes, size_t length) {
+    sha->length += length;
+    while (length > 0) {
+        size_t n = 64 - sha->blockLength;
+        if (n > length) {
+            n = length;
+        }
+        memcpy(sha->block + sha->blockLength, bytes, n);
+        sha->blockLength += n;
+        bytes += n;
+        length -= n;
+        if (sha->blockLength == 64) {
+            ZLLoopbackSHA1Block(sha, sha->block);
+            sha->blockLength = 0;
+        }
+    }
+}
+
+static void ZLLoopbackSHA1Digest(const uint8_t *bytes, size_t length, uint8_t digest[20]) {
+    ZLLoopbackSHA1 sha = { { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 }, 0, { 0 }, 0 };
+    ZLLoopbackSHA1Update(&sha, bytes, length);
+    uint64_t bits = sha.length * 8;
+    uint8_t padding = 0x80;
+    ZLLoopbackSHA1Update(&sha, &padding, 1);
+    padding = 0;
+    while (sha.blockLength != 56) {
+        ZLLoopbackSHA1Update(&sha, &padding, 1);
+    }
+    uint8_t lengthBytes[8];
+    for (int i = 0; i < 8; i++) {
+        lengthBytes[i] = (uint8_t)(bits >> (56 - i * 8));
+    }
+    ZLLoopbackSHA1Update(&sha, lengthBytes, 8);
+    for (int i = 0; i < 5; i++) {
+        digest[i * 4] = (uint8_t)(sha.state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(sha.state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(sha.state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)sha.state[i];
+    }
+}
+
+static void ZLLoopbackBase64(const uint8_t *bytes, size_t length, char *output) {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < length; i += 3) {
+        uint32_t value = (uint32_t)bytes[i] << 16;
+        if (i + 1 < length) {
+            value |= (uint32_t)bytes[i + 1] << 8;
+        }
+        if (i + 2 < length) {
+            value |= bytes[i + 2];
+        }
+        output[o++] = table[(value >> 18) & 63];
+        output[o++] = table[(value >> 12) & 63];
+        output[o++] = i + 1 < length ? table[(value >> 6) & 63] : '=';
+        output[o++] = i + 2 < length ? table[value & 63] : '=';
+    }
+    output[o] = '\0';
+}
+
+/* 读写 */
+
+static bool ZLLoopbackSendAll(int socket, const void *bytes, size_t length) {
+    const uint8_t *p = bytes;
+    while (length > 0) {
+        ssize_t n = send(socket, p, length, ZLLoopbackSendFlags);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+static bool ZLLoopbackSendFormat(int socket, const char *format, ...) {
+    char buffer[4096];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, arguments);
+    va_end(arguments);
+    if (length < 0 || (size_t)length >= sizeof(buffer)) {
+        return false;
+    }
+    return ZLLoopbackSendAll(socket, buffer, (size_t)length);
+}
+
+/// 从 socket 读更多数据到缓冲区，连接关闭或出错时返回 false
+static bool ZLLoopbackFill(ZLLoopbackConnection *connection) {
+    if (connection->start == connection->end) {
+        connection->start = connection->end = 0;
+    } else if (connection->end == ZLLoopbackBufferLength) {
+        memmove(connection->buffer, connection->buffer + connection->start, connection->end - connection->start);
+        connection->end -= connection->start;
+        connection->start = 0;
+        if (connection->end == ZLLoopbackBufferLength) {
+            return false;
+        }
+    }
+    for (;;) {
+        ssize_t n = recv(connection->socket, connection->buffer + connection->end, ZLLoopbackBufferLength - connection->end, 0);
+        if (n > 0) {
+            connection->end += (size_t)n;
+            return true;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        return false;
+    }
+}
+
+/// 读出恰好 length 个字节，bytes 为 NULL 时丢弃
+static bool ZLLoopbackRead(ZLLoopbackConnection *connection, void *bytes, size_t length) {
+    uint8_t *p = bytes;
+    while (length > 0) {
+        if (connection->start == connection->end && !ZLLoopbackFill(connection)) {
+            return false;
+        }
+        size_t n = connection->end - connection->start;
+        if (n > length) {
+            n = length;
+        }
+        if (p) {
+            memcpy(p, connection->buffer + connection->start, n);
+            p += n;
+        }
+        connection->start += n;
+        length -= n;
+    }
+    return true;
+}
+
+/// 读一行（去掉 CRLF），超长或连接关闭时返回 false
+static bool ZLLoopbackReadLine(ZLLoopbackConnection *connection, char *line, size_t capacity) {
+    for (;;) {
+        uint8_t *begin = connection->buffer + connection->start;
+        uint8_t *newline = memchr(begin, '\n', connection->end - connection->start);
+        if (newline) {
+            size_t length = (size_t)(newline - begin);
+            connection->start += length + 1;
+            if (length > 0 && begin[length - 1] == '\r') {
+                length--;
+            }
+            if (length >= capacity) {
+                return false;
+            }
+            memcpy(line, begin, length);
+            line[length] = '\0';
+            return true;
+        }
+        if (connection->end - connection->start >= capacity || !ZLLoopbackFill(connection)) {
+            return false;
+        }
+    }
+}
+
+/* HTTP */
+
+static bool ZLLoopbackReadRequest(ZLLoopbackConnection *connection, ZLLoopbackRequest *request) {
+    size_t headLength = 0;
+    for (;;) {
+        const uint8_t *begin = connection->buffer + connection->start;
+        size_t available = connection->end - connection->start;
+        for (size_t i = 3; i < available; i++) {
+            if (begin[i] == '\n' && begin[i - 1] == '\r' && begin[i - 2] == '\n' && begin[i - 3] == '\r') {
+                headLength = i + 1;
+                break;
+            }
+        }
+        if (headLength > 0) {
+            break;
+        }
+        if (available > ZLLoopbackMaxHeadLength || !ZLLoopbackFill(connection)) {
+            return false;
+        }
+    }
+    if (headLength > ZLLoopbackMaxHeadLength) {
+        return false;
+    }
+    memcpy(request->head, connection->buffer + connection->start, headLength);
+    request->head[headLength] = '\0';
+    connection->start += headLength;
+
+    char *line = request->head;
+    char *end = strstr(line, "\r\n");
+    *end = '\0';
+    char *method = line;
+    char *target = strchr(method, ' ');
+    if (!target) {
+        return false;
+    }
+    *target++ = '\0';
+    char *version = strchr(target, ' ');
+    if (!version || strncmp(version + 1, "HTTP/1.", 7) != 0) {
+        return false;
+    }
+    *version = '\0';
+    request->minorVersion = version[8] - '0';
+    request->method = method;
+    request->path = target;
+    char *query = strchr(target, '?');
+    if (query) {
+        *query++ = '\0';
+    }
+    request->query = query ? query : "";
+
+    request->headerCount = 0;
+    line = end + 2;
+    while (*line != '\r' && *line != '\0') {
+        end = strstr(line, "\r\n");
+        if (!end) {
+            return false;
+        }
+        *end = '\0';
+        char *colon = strchr(line, ':');
+        if (colon && request->headerCount < ZLLoopbackMaxHeaders) {
+            *colon = '\0';
+            char *value = colon + 1;
+            while (*value == ' ' || *value == '\t') {
+                value++;
+            }
+            char *valueEnd = value + strlen(value);
+            while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) {
+                *--valueEnd = '\0';
+            }
+            request->names[request->headerCount] = line;
+            request->values[request->headerCount] = value;
+            request->headerCount++;
+        }
+        line = end + 2;
+    }
+    return true;
+}
+
+static const char *ZLLoopbackHeader(const ZLLoopbackRequest *request, const char *name) {
+    for (size_t i = 0; i < request->headerCount; i++) {
+        if (strcasecmp(request->names[i], name) == 0) {
+            return request->values[i];
+        }
+    }
+    return NULL;
+}
+
+/// 大小写不敏感地判断逗号分隔的头部取值中是否有 token
+static bool ZLLoopbackHeaderContainsToken(const char *value, const char *token) {
+    size_t length = strlen(token);
+    while (value && *value) {
+        while (*value == ' ' || *value == ',') {
+            value++;
+        }
+        const char *end = value;
+        while (*end && *end != ',') {
+            end++;
+        }
+        // 忽略 ; 之后的参数，例如 permessage-deflate; client_max_window_bits
+        const char *trimmed = value;
+        while (trimmed < end && *trimmed != ';') {
+            trimmed++;
+        }
+        while (trimmed > value && trimmed[-1] == ' ') {
+            trimmed--;
+        }
+        if ((size_t)(trimmed - value) == length && strncasecmp(value, token, length) == 0) {
+            return true;
+        }
+        value = end;
+    }
+    return false;
+}
+
+static bool ZLLoopbackQueryValue(const char *query, const char *name, unsigned long long *value) {
+    size_t length = strlen(name);
+    const char *p = query;
+    while (p && *p) {
+        if (strncmp(p, name, length) == 0 && p[length] == '=') {
+            *value = strtoull(p + length + 1, NULL, 10);
+            return true;
+        }
+        p = strchr(p, '&');
+        if (p) {
+            p++;
+        }
+    }
+    return false;
+}
+
+static bool ZLLoopbackParseCount(const char *path, const char *prefix, unsigned long long *count) {
+    size_t length = strlen(prefix);
+    if (strncmp(path, prefix, length) != 0 || path[length] < '0' || path[length] > '9') {
+        return false;
+    }
+    char *end = NULL;
+    *count = strtoull(path + length, &end, 10);
+    return *end == '\0';
+}
+
+/// 解析单个区间，格式不对或有多个区间时返回 0（忽略 Range），无法满足时返回 -1
+static int ZLLoopbackParseRange(const char *range, uint64_t total, uint64_t *first, uint64_t *last) {
+    if (strncasecmp(range, "bytes=", 6) != 0 || strchr(range, ',') != NULL) {
+        return 0;
+    }
+    const char *p = range + 6;
+    char *end = NULL;
+    if (*p == '-') {
+        unsigned long long suffix = strtoull(p + 1, &end, 10);
+        if (end == p + 1 || *end != '\0') {
+            return 0;
+        }
+        if (suffix == 0 || total == 0) {
+            return -1;
+        }
+        *first = suffix < total ? total - suffix : 0;
+        *last = total - 1;
+        return 1;
+    }
+    if (*p < '0' || *p > '9') {
+        return 0;
+    }
+    unsigned long long start = strtoull(p, &end, 10);
+    if (*end != '-') {
+        return 0;
+    }
+    p = end + 1;
+    unsigned long long stop = UINT64_MAX;
+    if (*p != '\0') {
+        stop = strtoull(p, &end, 10);
+        if (end == p || *end != '\0' || stop < start) {
+            return 0;
+        }
+    }
+    if (start >= total) {
+        return -1;
+    }
+    *first = start;
+    *last = stop < total ? stop : total - 1;
+    return 1;
+}
+
+static bool ZLLoopbackSendPattern(int socket, uint64_t first, uint64_t length) {
+    uint8_t chunk[16 * 1024];
+    while (length > 0) {
+        size_t n = length < sizeof(chunk) ? (size_t)length : sizeof(chunk);
+        for (size_t i = 0; i < n; i++) {
+            chunk[i] = ZLLoopbackServerByteAt(first + i);
+        }
+        if (!ZLLoopbackSendAll(socket, chunk, n)) {
+            return false;
+        }
+        first += n;
+        length -= n;
+    }
+    return true;
+}
+
+static bool ZLLoopbackServeBytes(ZLLoopbackConnection *connection, const ZLLoopbackRequest *request, uint64_t total, bool supportsRanges, bool keepAlive) {
+    const char *connectionHeader = keepAlive ? "keep-alive" : "close";
+    bool head = strcmp(request->method, "HEAD") == 0;
+    char etag[48];
+    snprintf(etag, sizeof(etag), "\"zl-%llu\"", (unsigned long long)total);
+    unsigned long long maxAge = 0;
+    ZLLoopbackQueryValue(request->query, "maxage", &maxAge);
+
+    const char *ifNoneMatch = ZLLoopbackHeader(request, "If-None-Match");
+    if (ifNoneMatch && (strcmp(ifNoneMatch, etag) == 0 || strcmp(ifNoneMatch, "*") == 0)) {
+        return ZLLoopbackSendFormat(connection->socket,
+                                    "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nLast-Modified: %s\r\nCache-Control: max-age=%llu\r\nConnection: %s\r\n\r\n",
+                                    etag, ZLLoopbackLastModified, maxAge, connectionHeader);
+    }
+
+    uint64_t first = 0;
+    uint64_t last = total ? total - 1 : 0;
+    bool partial = false;
+    const char *range = ZLLoopbackHeader(request, "Range");
+    const char *ifRange = ZLLoopbackHeader(request, "If-Range");
+    if (supportsRanges && range && (!ifRange || strcmp(ifRange, etag) == 0 || strcmp(ifRange, ZLLoopbackLastModified) == 0)) {
+        int result = ZLLoopbackParseRange(range, total, &first, &last);
+        if (result < 0) {
+            return ZLLoopbackSendFormat(connection->socket,
+                                        "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%llu\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n",
+                                        (unsigned long long)total, connectionHeader);
+        }
+        partial = result > 0;
+    }
+    uint64_t length = total ? last - first + 1 : 0;
+
+    char contentRange[96] = "";
+    if (partial) {
+        atomic_fetch_add(&connection->server->rangeRequestCount, 1);
+        snprintf(contentRange, sizeof(contentRange), "Content-Range: bytes %llu-%llu/%llu\r\n",
+                 (unsigned long long)first, (unsigned long long)last, (unsigned long long)total);
+    }
+    if (!ZLLoopbackSendFormat(connection->socket,
+                              "HTTP/1.1 %s\r\nContent-Type: application/octet-stream\r\nContent-Length: %llu\r\n%sETag: %s\r\nLast-Modified: %s\r\nCache-Control: max-age=%llu\r\nAccept-Ranges: %s\r\nConnection: %s\r\n\r\n",
+                              partial ? "206 Partial Content" : "200 OK", (unsigned long long)length, contentRange,
+                              etag, ZLLoopbackLastModified, maxAge, supportsRanges ? "bytes" : "none", connectionHeader)) {
+        return false;
+    }
+    return head || ZLLoopbackSendPattern(connection->socket, first, length);
+}
+
+static bool ZLLoopbackServeDocument(ZLLoopbackConnection *connection, char *document, size_t length, const char *contentType, bool keepAlive) {
+    if (!document) {
+        return false;
+    }
+    bool sent = ZLLoopbackSendFormat(connection->socket, "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n",
+                                     contentType, length, keepAlive ? "keep-alive" : "close") &&
+                ZLLoopbackSendAll(connection->socket, document, length);
+    free(document);
+    return sent;
+}
+
+/// 读完请求体，返回字节数；格式错误时返回 -1
+static long long ZLLoopbackReadBody(ZLLoopbackConnection *connection, const ZLLoopbackRequest *request) {
+    const char *transferEncoding = ZLLoopbackHeader(request, "Transfer-Encoding");
+    if (transferEncoding && ZLLoopbackHeaderContainsToken(transferEncoding, "chunked")) {
+        long long total = 0;
+        char line[256];
+        for (;;) {
+            if (!ZLLoopbackReadLine(connection, line, sizeof(line))) {
+                return -1;
+            }
+            char *end = NULL;
+            unsigned long long size = strtoull(line, &end, 16);
+            if (end == line) {
+                return -1;
+            }
+            if (size == 0) {
+                // trailer 一直到空行
+                do {
+                    if (!ZLLoopbackReadLine(connection, line, sizeof(line))) {
+                        return -1;
+                    }
+                } while (line[0] != '\0');
+                return total;
+            }
+            if (!ZLLoopbackRead(connection, NULL, size) || !ZLLoopbackReadLine(connection, line, sizeof(line)) || line[0] != '\0') {
+                return -1;
+            }
+            total += (long long)size;
+        }
+    }
+    const char *contentLength = ZLLoopbackHeader(request, "Content-Length");
+    unsigned long long length = contentLength ? strtoull(contentLength, NULL, 10) : 0;
+    return ZLLoopbackRead(connection, NULL, length) ? (long long)length : -1;
+}
+
+/* WebSocket */
+
+static size_t ZLLoopbackFrameHeader(uint8_t *header, bool fin, uint8_t opcode, uint64_t length) {
+    header[0] = (uint8_t)((fin ? 0x80 : 0) | opcode);
+    if (length < 126) {
+        header[1] = (uint8_t)length;
+        return 2;
+    }
+    if (length <= UINT16_MAX) {
+        header[1] = 126;
+        header[2] = (uint8_t)(length >> 8);
+        header[3] = (uint8_t)length;
+        return 4;
+    }
+    header[1] = 127;
+    for (int i = 0; i < 8; i++) {
+        header[2 + i] = (uint8_t)(length >> (56 - i * 8));
+    }
+    return 10;
+}
+
+static void ZLLoopbackFillPayload(uint8_t *payload, size_t length, bool text) {
+    for (size_t i = 0; i < length; i++) {
+        payload[i] = text ? (uint8_t)('a' + i % 26) : ZLLoopbackServerByteAt(i);
+    }
+}
+
+/// permessage-deflate 的一条消息：原始 deflate 流，去掉同步刷新结尾的 00 00 ff ff。
+/// 握手时双方都声明了 no_context_takeover，所以每条消息独立压缩、独立解压
+static uint8_t *ZLLoopbackDeflateMessage(const uint8_t *bytes, size_t length, size_t *deflatedLength) {
+    if (length > UINT_MAX) {
+        return NULL;
+    }
+    z_stream stream = { 0 };
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+    size_t capacity = deflateBound(&stream, length) + 16;
+    uint8_t *output = malloc(capacity);
+    if (!output) {
+        deflateEnd(&stream);
+        return NULL;
+    }
+    stream.next_in = (Bytef *)bytes;
+    stream.avail_in = (uInt)length;
+    stream.next_out = output;
+    stream.avail_out = (uInt)capacity;
+    int result = deflate(&stream, Z_SYNC_FLUSH);
+    size_t used = capacity - stream.avail_out;
+    deflateEnd(&stream);
+    if (result != Z_OK || stream.avail_in != 0 || stream.avail_out == 0 || used < 4) {
+        free(output);
+        return NULL;
+    }
+    *deflatedLength = used - 4;
+    return output;
+}
+
+/// 补回 00 00 ff ff 后解压，结果超过 ZLLoopbackMaxDeflateMessage 时失败
+static uint8_t *ZLLoopbackInflateMessage(const uint8_t *bytes, size_t length, size_t *inflatedLength) {
+    static const uint8_t trailer[4] = { 0x00, 0x00, 0xFF, 0xFF };
+    if (length > UINT_MAX) {
+        return NULL;
+    }
+    z_stream stream = { 0 };
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        return NULL;
+    }
+    size_t capacity = 0;
+    size_t used = 0;
+    uint8_t *output = NULL;
+    bool ok = true;
+    for (int pass = 0; pass < 2 && ok; pass++) {
+        stream.next_in = (Bytef *)(pass == 0 ? bytes : trailer);
+        stream.avail_in = pass == 0 ? (uInt)length : sizeof(trailer);
+        do {
+            if (used == capacity) {
+                size_t grown = capacity ? capacity * 2 : length * 4 + 1024;
+                if (grown > ZLLoopbackMaxDeflateMessage) {
+                    grown = ZLLoopbackMaxDeflateMessage;
+                }
+                uint8_t *resized = grown > capacity ? realloc(output, grown) : NULL;
+                if (!resized) {
+                    ok = false;
+                    break;
+                }
+                output = resized;
+                capacity = grown;
+            }
+            stream.next_out = output + used;
+            stream.avail_out = (uInt)(capacity - used);
+            int result = inflate(&stream, Z_SYNC_FLUSH);
+            used = capacity - stream.avail_out;
+            if (result == Z_STREAM_END) {
+                break;
+            }
+            if (result != Z_OK && !(result == Z_BUF_ERROR && stream.avail_in == 0)) {
+                ok = false;
+            }
+        } while (ok && (stream.avail_in > 0 || stream.avail_out == 0));
+    }
+    inflateEnd(&stream);
+    if (!ok) {
+        free(output);
+        return NULL;
+    }
+    *inflatedLength = used;
+    return output;
+}
+
+static bool ZLLoopbackFlood(ZLLoopbackConnection *connection, uint64_t size, uint64_t count, bool text, bool deflate) {
+    if (size > SIZE_MAX / 2 || (deflate && size > ZLLoopbackMaxDeflateMessage)) {
+        return false;
+    }
+    uint8_t *payload = malloc((size_t)size + 1);
+    if (!payload) {
+        return false;
+    }
+    ZLLoopbackFillPayload(payload, (size_t)size, text);
+    size_t payloadLength = (size_t)size;
+    if (deflate) {
+        uint8_t *deflated = ZLLoopbackDeflateMessage(payload, (size_t)size, &payloadLength);
+        free(payload);
+        payload = deflated;
+        if (!payload) {
+            return false;
+        }
+    }
+
+    // 每条消息内容相同，先拼好一帧
+    uint8_t header[10];
+    size_t headerLength = ZLLoopbackFrameHeader(header, true, text ? 0x1 : 0x2, payloadLength);
+    if (deflate) {
+        header[0] |= 0x40;
+    }
+    uint64_t frameLength = headerLength + payloadLength;
+    uint8_t *frame = malloc((size_t)frameLength);
+    if (!frame) {
+        free(payload);
+        return false;
+    }
+    memcpy(frame, header, headerLength);
+    memcpy(frame + headerLength, payload, payloadLength);
+    free(payload);
+
+    bool sent = true;
+    if (frameLength * count <= ZLLoopbackMaxFloodBatch) {
+        uint8_t *batch = malloc(frameLength * count + 1);
+        if (!batch) {
+            free(frame);
+            return false;
+        }
+        for (uint64_t i = 0; i < count; i++) {
+            memcpy(batch + i * frameLength, frame, (size_t)frameLength);
+        }
+        sent = ZLLoopbackSendAll(connection->socket, batch, frameLength * count);
+        free(batch);
+    } else {
+        for (uint64_t i = 0; i < count && sent; i++) {
+            sent = ZLLoopbackSendAll(connection->socket, frame, frameLength);
+        }
+    }
+    free(frame);
+    return sent;
+}
+
+/// 协商了 permessage-deflate 时正在收的消息
+typedef struct ZLLoopbackMessage {
+    uint8_t opcode;
+    bool compressed;
+    uint8_t *bytes;
+    size_t length;
+    size_t capacity;
+} ZLLoopbackMessage;
+
+/// 收齐的消息解压后重新压缩成一帧回显
+static bool ZLLoopbackEchoMessage(ZLLoopbackConnection *connection, const ZLLoopbackMessage *message) {
+    const uint8_t *payload = message->bytes;
+    size_t length = message->length;
+    uint8_t *inflated = NULL;
+    if (message->compressed) {
+        inflated = ZLLoopbackInflateMessage(message->bytes, message->length, &length);
+        if (!inflated) {
+            return false;
+        }
+        payload = inflated;
+    }
+    size_t deflatedLength = 0;
+    uint8_t *deflated = ZLLoopbackDeflateMessage(payload, length, &deflatedLength);
+    free(inflated);
+    if (!deflated) {
+        return false;
+    }
+    uint8_t header[10];
+    size_t headerLength = ZLLoopbackFrameHeader(header, true, message->opcode, deflatedLength);
+    header[0] |= 0x40;
+    bool sent = ZLLoopbackSendAll(connection->socket, header, headerLength) && ZLLoopbackSendAll(connection->socket, deflated, deflatedLength);
+    free(deflated);
+    return sent;
+}
+
+/// 回显数据帧，直到收到 close 或连接断开。message 为 NULL 时逐帧原样转发，否则整条收齐后压缩回显
+static void ZLLoopbackEchoFrames(ZLLoopbackConnection *connection, ZLLoopbackMessage *message) {
+    uint8_t chunk[16 * 1024];
+    for (;;) {
+        uint8_t bytes[8];
+        if (!ZLLoopbackRead(connection, bytes, 2)) {
+            return;
+        }
+        bool fin = bytes[0] & 0x80;
+        bool compressed = bytes[0] & 0x40;
+        uint8_t opcode = bytes[0] & 0x0F;
+        bool masked = bytes[1] & 0x80;
+        uint64_t length = bytes[1] & 0x7F;
+        if (length == 126) {
+            if (!ZLLoopbackRead(connection, bytes, 2)) {
+                return;
+            }
+            length = ((uint64_t)bytes[0] << 8) | bytes[1];
+        } else if (length == 127) {
+            if (!ZLLoopbackRead(connection, bytes, 8)) {
+                return;
+            }
+            length = 0;
+            for (int i = 0; i < 8; i++) {
+                length = (length << 8) | bytes[i];
+            }
+        }
+        uint8_t mask[4] = { 0 };
+        if (masked && !ZLLoopbackRead(connection, mask, 4)) {
+            return;
+        }
+
+        if (opcode >= 0x8) {
+            uint8_t payload[125];
+            if (length > sizeof(payload) || !ZLLoopbackRead(connection, payload, (size_t)length)) {
+                return;
+            }
+            for (size_t i = 0; i < length; i++) {
+                payload[i] ^= mask[i % 4];
+            }
+            if (opcode == 0xA) {
+                continue;
+            }
+            uint8_t header[10];
+            size_t headerLength = ZLLoopbackFrameHeader(header, true, opcode == 0x9 ? 0xA : opcode, length);
+            if (!ZLLoopbackSendAll(connection->socket, header, headerLength) || !ZLLoopbackSendAll(connection->socket, payload, (size_t)length)) {
+                return;
+            }
+            if (opcode == 0x8) {
+                return;
+            }
+            continue;
+        }
+
+        if (message) {
+            if (opcode != 0x0) {
+                message->opcode = opcode;
+                message->compressed = compressed;
+                message->length = 0;
+            }
+            if (length > ZLLoopbackMaxDeflateMessage - message->length) {
+                return;
+            }
+            if (message->length + length > message->capacity) {
+                size_t capacity = message->length + (size_t)length;
+                uint8_t *resized = realloc(message->bytes, capacity);
+                if (!resized) {
+                    return;
+                }
+                message->bytes = resized;
+                message->capacity = capacity;
+            }
+            uint8_t *payload = message->bytes + message->length;
+            if (!ZLLoopbackRead(connection, payload, (size_t)length)) {
+                return;
+            }
+            for (size_t i = 0; i < length; i++) {
+                payload[i] ^= mask[i % 4];
+            }
+            message->length += (size_t)length;
+            if (fin && !ZLLoopbackEchoMessage(connection, message)) {
+                return;
+            }
+            continue;
+        }
+
+        uint8_t header[10];
+        size_t headerLength = ZLLoopbackFrameHeader(header, fin, opcode, length);
+        if (!ZLLoopbackSendAll(connection->socket, header, headerLength)) {
+            return;
+        }
+        uint64_t offset = 0;
+        while (offset < length) {
+            size_t n = length - offset < sizeof(chunk) ? (size_t)(length - offset) : sizeof(chunk);
+            if (!ZLLoopbackRead(connection, chunk, n)) {
+                return;
+            }
+            for (size_t i = 0; i < n; i++) {
+                chunk[i] ^= mask[(offset + i) % 4];
+            }
+            if (!ZLLoopbackSendAll(connection->socket, chunk, n)) {
+                return;
+            }
+            offset += n;
+        }
+    }
+}
+
+static void ZLLoopbackEcho(ZLLoopbackConnection *connection, bool deflate) {
+    ZLLoopbackMessage message = { 0 };
+    ZLLoopbackEchoFrames(connection, deflate ? &message : NULL);
+    free(message.bytes);
+}
+
+static void ZLLoopbackServeWebSocket(ZLLoopbackConnection *connection, const ZLLoopbackRequest *request) {
+    const char *key = ZLLoopbackHeader(request, "Sec-WebSocket-Key");
+    if (!key || strlen(key) > 64) {
+        ZLLoopbackSendFormat(connection->socket, "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return;
+    }
+    char concatenated[128];
+    int length = snprintf(concatenated, sizeof(concatenated), "%s258EAFA5-E914-47DA-95CA-C5AB0DC85B11", key);
+    uint8_t digest[20];
+    ZLLoopbackSHA1Digest((const uint8_t *)concatenated, (size_t)length, digest);
+    char accept[32];
+    ZLLoopbackBase64(digest, sizeof(digest), accept);
+    // 只接受不带参数协商的形式：两端每条消息都重置上下文，窗口保持 15
+    bool deflate = ZLLoopbackHeaderContainsToken(ZLLoopbackHeader(request, "Sec-WebSocket-Extensions"), "permessage-deflate");
+    if (!ZLLoopbackSendFormat(connection->socket, "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n%s\r\n", accept,
+                              deflate ? "Sec-WebSocket-Extensions: permessage-deflate; server_no_context_takeover; client_no_context_takeover\r\n" : "")) {
+        return;
+    }
+
+    if (strcmp(request->path, "/ws/flood") == 0) {
+        unsigned long long size = 0, count = 0, text = 0;
+        ZLLoopbackQueryValue(request->query, "size", &size);
+        ZLLoopbackQueryValue(request->query, "count", &count);
+        ZLLoopbackQueryValue(request->query, "text", &text);
+        if (!ZLLoopbackFlood(connection, size, count, text != 0, deflate)) {
+            return;
+        }
+    }
+    ZLLoopbackEcho(connection, deflate);
+}
+
+/// /redirect/<状态码>/<路径> 重定向到 /<路径>，保留查询串
+static bool ZLLoopbackServeRedirect(ZLLoopbackConnection *connection, const ZLLoopbackRequest *request, bool keepAlive) {
+    char *end = NULL;
+    unsigned long status = strtoul(request->path + 10, &end, 10);
+    if (end == request->path + 10 || *end != '/' || status < 300 || status > 399) {
+        return ZLLoopbackSendFormat(connection->socket, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n",
+                                    keepAlive ? "keep-alive" : "close");
+    }
+    return ZLLoopbackSendFormat(connection->socket, "HTTP/1.1 %lu Redirect\r\nLocation: %s%s%s\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n",
+                                status, end, request->query[0] ? "?" : "", request->query, keepAlive ? "keep-alive" : "close");
+}
+
+static void ZLLoopbackServeConnection(ZLLoopbackConnection *connection) {
+    ZLLoopbackRequest *request = malloc(sizeof(ZLLoopbackRequest));
+    if (!request) {
+        return;
+    }
+    while (ZLLoopbackReadRequest(connection, request)) {
+        const char *connectionHeader = ZLLoopbackHeader(request, "Connection");
+        bool keepAlive = request->minorVersion >= 1 && !ZLLoopbackHeaderContainsToken(connectionHeader, "close");
+
+        unsigned long long delay = 0;
+        if (ZLLoopbackQueryValue(request->query, "delay", &delay) && delay > 0) {
+            usleep((useconds_t)(delay * 1000));
+        }
+
+        const char *upgrade = ZLLoopbackHeader(request, "Upgrade");
+        if (upgrade && ZLLoopbackHeaderContainsToken(upgrade, "websocket") && strncmp(request->path, "/ws/", 4) == 0) {
+            ZLLoopbackServeWebSocket(connection, request);
+            break;
+        }
+        atomic_fetch_add(&connection->server->requestCount, 1);
+
+        bool upload = strcmp(request->path, "/upload") == 0 && (strcmp(request->method, "POST") == 0 || strcmp(request->method, "PUT") == 0);
+        const char *expect = ZLLoopbackHeader(request, "Expect");
+        if (upload && expect && strcasecmp(expect, "100-continue") == 0 &&
+            !ZLLoopbackSendFormat(connection->socket, "HTTP/1.1 100 Continue\r\n\r\n")) {
+            break;
+        }
+        long long received = ZLLoopbackReadBody(connection, request);
+        if (received < 0) {
+            break;
+        }
+
+        unsigned long long count = 0;
+        bool sent;
+        if (upload) {
+            char body[64];
+            int length = snprintf(body, sizeof(body), "{\"received\":%lld}", received);
+            sent = ZLLoopbackSendFormat(connection->socket, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\nConnection: %s\r\n\r\n%s",
+                                        length, keepAlive ? "keep-alive" : "close", body);
+        } else if (strncmp(request->path, "/redirect/", 10) == 0) {
+            sent = ZLLoopbackServeRedirect(connection, request, keepAlive);
+        } else if (ZLLoopbackParseCount(request->path, "/bytes/", &count)) {
+            sent = ZLLoopbackServeBytes(connection, request, count, true, keepAlive);
+        } else if (ZLLoopbackParseCount(request->path, "/norange/", &count)) {
+            sent = ZLLoopbackServeBytes(connection, request, count, false, keepAlive);
+        } else if (ZLLoopbackParseCount(request->path, "/json/", &count)) {
+            size_t length = 0;
+            char *document = ZLLoopbackCreateJSONDocument((size_t)count, &length);
+            sent = ZLLoopbackServeDocument(connection, document, length, "application/json", keepAlive);
+        } else if (ZLLoopbackParseCount(request->path, "/xml/", &count)) {
+            size_t length = 0;
+            char *document = ZLLoopbackCreateXMLDocument((size_t)count, &length);
+            sent = ZLLoopbackServeDocument(connection, document, length, "application/xml; charset=utf-8", keepAlive);
+        } else {
+            sent = ZLLoopbackSendFormat(connection->socket, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n",
+                                        keepAlive ? "keep-alive" : "close");
+        }
+        if (!sent || !keepAlive) {
+            break;
+        }
+    }
+    free(request);
+}
+
+/* 线程 */
+
+static void *ZLLoopbackConnectionThread(void *info) {
+    ZLLoopbackConnection *connection = info;
+    ZLLoopbackServer *server = connection->server;
+    ZLLoopbackServeConnection(connection);
+
+    pthread_mutex_lock(&server->lock);
+    for (size_t i = 0; i < server->connectionCount; i++) {
+        if (server->connections[i] == connection->socket) {
+            server->connections[i] = server->connections[--server->connectionCount];
+            break;
+        }
+    }
+    close(connection->socket);
+    pthread_cond_broadcast(&server->condition);
+    pthread_mutex_unlock(&server->lock);
+    free(connection);
+    return NULL;
+}
+
+static void ZLLoopbackAccept(ZLLoopbackServer *server, int socket) {
+    int yes = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+#ifdef SO_NOSIGPIPE
+    setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+#endif
+
+    ZLLoopbackConnection *connection = malloc(sizeof(ZLLoopbackConnection));
+    if (!connection) {
+        close(socket);
+        return;
+    }
+    connection->server = server;
+    connection->socket = socket;
+    connection->start = connection->end = 0;
+
+    pthread_mutex_lock(&server->lock);
+    if (server->stopping) {
+        pthread_mutex_unlock(&server->lock);
+        close(socket);
+        free(connection);
+        return;
+    }
+    if (server->connectionCount == server->connectionCapacity) {
+        size_t capacity = server->connectionCapacity ? server->connectionCapacity * 2 : 16;
+        int *connections = realloc(server->connections, capacity * sizeof(int));
+        if (!connections) {
+            pthread_mutex_unlock(&server->lock);
+            close(socket);
+            free(connection);
+            return;
+        }
+        server->connections = connections;
+        server->connectionCapacity = capacity;
+    }
+    server->connections[server->connectionCount++] = socket;
+
+    pthread_t thread;
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attributes, ZLLoopbackConnectionThread, connection) != 0) {
+        server->connectionCount--;
+        close(socket);
+        free(connection);
+    }
+    pthread_attr_destroy(&attributes);
+    pthread_mutex_unlock(&server->lock);
+}
+
+static void *ZLLoopbackAcceptThread(void *info) {
+    ZLLoopbackServer *server = info;
+    struct pollfd descriptors[2] = {
+        { server->listenSocket, POLLIN, 0 },
+        { server->wakePipe[0], POLLIN, 0 },
+    };
+    for (;;) {
+        if (poll(descriptors, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (descriptors[1].revents) {
+            break;
+        }
+        if (descriptors[0].revents & POLLIN) {
+            int socket = accept(server->listenSocket, NULL, NULL);
+            if (socket >= 0) {
+                ZLLoopbackAccept(server, socket);
+            } else if (errno == EMFILE || errno == ENFILE) {
+                // 描述符用完时稍等，避免空转
+                usleep(1000);
+            }
+        }
+    }
+    return NULL;
+}
+
+ZLLoopbackServer *ZLLoopbackServerStart(uint16_t port) {
+    ZLLoopbackServer *server = calloc(1, sizeof(ZLLoopbackServer));
+    if (!server) {
+        return NULL;
+    }
+    server->listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (server->listenSocket < 0) {
+        free(server);
+        return NULL;
+    }
+    int yes = 1;
+    setsockopt(server->listenSocket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+    if (bind(server->listenSocket, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(server->listenSocket, 512) != 0 ||
+        getsockname(server->listenSocket, (struct sockaddr *)&address, &addressLength) != 0 ||
+        pipe(server->wakePipe) != 0) {
+        close(server->listenSocket);
+        free(server);
+        return NULL;
+    }
+    server->port = ntohs(address.sin_port);
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->condition, NULL);
+
+    if (pthread_create(&server->acceptThread, NULL, ZLLoopbackAcceptThread, server) != 0) {
+        close(server->listenSocket);
+        close(server->wakePipe[0]);
+        close(server->wakePipe[1]);
+        pthread_mutex_destroy(&server->lock);
+        pthread_cond_destroy(&server->condition);
+        free(server);
+        return NULL;
+    }
+    return server;
+}
+
+uint16_t ZLLoopbackServerPort(const ZLLoopbackServer *server) {
+    return server->port;
+}
+
+uint64_t ZLLoopbackServerRequestCount(const ZLLoopbackServer *server) {
+    return atomic_load(&((ZLLoopbackServer *)server)->requestCount);
+}
+
+uint64_t ZLLoopbackServerRangeRequestCount(const ZLLoopbackServer *server) {
+    return atomic_load(&((ZLLoopbackServer *)server)->rangeRequestCount);
+}
+
+void ZLLoopbackServerStop(ZLLoopbackServer *server) {
+    if (!server) {
+        return;
+    }
+    pthread_mutex_lock(&server->lock);
+    server->stopping = true;
+    for (size_t i = 0; i < server->connectionCount; i++) {
+        shutdown(server->connections[i], SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    char wake = 0;
+    while (write(server->wakePipe[1], &wake, 1) < 0 && errno == EINTR) {
+    }
+    pthread_join(server->acceptThread, NULL);
+
+    pthread_mutex_lock(&server->lock);
+    while (server->connectionCount > 0) {
+        pthread_cond_wait(&server->condition, &server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    close(server->listenSocket);
+    close(server->wakePipe[0]);
+    close(server->wakePipe[1]);
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->condition);
+    free(server->connections);
+    free(server);
+}
+
+/* 文档 */
+
+typedef struct ZLLoopbackBuffer {
+    char *bytes;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} ZLLoopbackBuffer;
+
+static void ZLLoopbackAppendFormat(ZLLoopbackBuffer *buffer, const char *format, ...) {
+    if (buffer->failed) {
+        return;
+    }
+    for (;;) {
+        va_list arguments;
+        va_start(arguments, format);
+        int n = vsnprintf(buffer->bytes + buffer->length, buffer->capacity - buffer->length, format, arguments);
+        va_end(arguments);
+        if (n < 0) {
+            buffer->failed = true;
+            return;
+        }
+        if ((size_t)n < buffer->capacity - buffer->length) {
+            buffer->length += (size_t)n;
+            return;
+        }
+        size_t capacity = buffer->capacity * 2 + (size_t)n + 1;
+        char *bytes = realloc(buffer->bytes, capacity);
+        if (!bytes) {
+            buffer->failed = true;
+            return;
+        }
+        buffer->bytes = bytes;
+        buffer->capacity = capacity;
+    }
+}
+
+static char *ZLLoopbackBufferFinish(ZLLoopbackBuffer *buffer, size_t *length) {
+    if (buffer->failed) {
+        free(buffer->bytes);
+        return NULL;
+    }
+    *length = buffer->length;
+    return buffer->bytes;
+}
+
+char *ZLLoopbackCreateJSONDocument(size_t count, size_t *length) {
+    ZLLoopbackBuffer buffer = { malloc(4096), 0, 4096, false };
+    buffer.failed = buffer.bytes == NULL;
+    ZLLoopbackAppendFormat(&buffer, "[");
+    for (size_t i = 0; i < count; i++) {
+        ZLLoopbackAppendFormat(&buffer, "%s{\"id\":%zu,\"name\":\"item-%zu\",\"title\":\"\\u7b2c %zu \\u6761 \\\"quoted\\\"\",\"tags\":[\"news\",\"sports\"],\"score\":%zu.5,\"active\":%s,\"extra\":null}",
+                               i ? "," : "", i, i, i, i % 100, i % 2 ? "true" : "false");
+    }
+    ZLLoopbackAppendFormat(&buffer, "]");
+    return ZLLoopbackBufferFinish(&buffer, length);
+}
+
+char *ZLLoopbackCreateXMLDocument(size_t count, size_t *length) {
+    ZLLoopbackBuffer buffer = { malloc(4096), 0, 4096, false };
+    buffer.failed = buffer.bytes == NULL;
+    ZLLoopbackAppendFormat(&buffer, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                                    "<soap:Envelope xmlns:soap=\"http://schemas.xmlsoap.org/soap/envelope/\"><soap:Body><catalog>");
+    for (size_t i = 0; i < count; i++) {
+        ZLLoopbackAppendFormat(&buffer, "<item id=\"%zu\" available=\"%s\"><name>item-%zu</name><price currency=\"CNY\">%zu.50</price>"
+                                        "<desc>Fish &amp; chips, \xe7\xac\xac %zu \xe6\x9d\xa1</desc><!-- note --><tags><tag>a</tag><tag>b</tag></tags></item>\n",
+                               i, i % 2 ? "true" : "false", i, i % 1000, i);
+    }
+    ZLLoopbackAppendFormat(&buffer, "</catalog></soap:Body></soap:Envelope>\n");
+    return ZLLoopbackBufferFinish(&buffer, length);
+}
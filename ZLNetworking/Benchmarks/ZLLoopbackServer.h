@@ -0,0 +1,67 @@
+//
+//  ZLLoopbackServer.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/31.
+//
+
+#ifndef ZLLoopbackServer_h
+#define ZLLoopbackServer_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 基准测试和回归测试用的本地服务器，只监听 127.0.0.1，每个连接一个线程，只依赖 POSIX。
+///
+/// HTTP/1.1，支持 keep-alive，任何路径都可以带 ?delay=<毫秒> 在响应前等待，模拟网络延迟：
+///   GET/HEAD /bytes/<n>        n 字节的确定内容（见 ZLLoopbackServerByteAt），带 ETag / Last-Modified，
+///                              支持单个区间的 Range、If-Range、If-None-Match；?maxage=<秒> 设置 Cache-Control
+///   GET/HEAD /norange/<n>      同上，但忽略 Range，用于测试不支持区间请求时的退回
+///   GET /json/<n>              n 个元素的 JSON 数组，内容见 ZLLoopbackCreateJSONDocument
+///   GET /xml/<n>               n 个条目的 SOAP 风格 XML，内容见 ZLLoopbackCreateXMLDocument
+///   POST/PUT /upload           读完请求体（Content-Length 或 chunked），返回 {"received":<字节数>}
+///   任意方法 /redirect/<状态码>/<路径>
+///                              读完请求体后用该状态码（3xx）重定向到 /<路径>，保留查询串
+///
+/// WebSocket（RFC 6455）。客户端提供 permessage-deflate 时接受，并要求两端都不保留压缩上下文，
+/// 此后发出的数据消息全部压缩，回显时整条收齐、解压后重新压缩：
+///   /ws/echo                   原样回显数据帧，回应 ping 和 close
+///   /ws/flood?size=<n>&count=<m>[&text=1]
+///                              握手后把 m 条 n 字节的消息一次性写出，之后同 /ws/echo
+typedef struct ZLLoopbackServer ZLLoopbackServer;
+
+/// port 为 0 时由系统分配，失败返回 NULL
+ZLLoopbackServer *ZLLoopbackServerStart(uint16_t port);
+
+uint16_t ZLLoopbackServerPort(const ZLLoopbackServer *server);
+
+/// 已处理的 HTTP 请求数（不含 WebSocket 握手）
+uint64_t ZLLoopbackServerRequestCount(const ZLLoopbackServer *server);
+
+/// 其中返回 206 的请求数
+uint64_t ZLLoopbackServerRangeRequestCount(const ZLLoopbackServer *server);
+
+/// 关闭监听和所有连接，等连接线程全部退出后返回
+void ZLLoopbackServerStop(ZLLoopbackServer *server);
+
+/// /bytes/<n> 第 offset 个字节，客户端据此校验区间拼接的结果
+static inline uint8_t ZLLoopbackServerByteAt(uint64_t offset) {
+    return (uint8_t)((offset * 131) ^ (offset >> 13));
+}
+
+/// 与 /json/<n> 相同的文档，调用方 free
+char *ZLLoopbackCreateJSONDocument(size_t count, size_t *length);
+
+/// 与 /xml/<n> 相同的文档，调用方 free
+char *ZLLoopbackCreateXMLDocument(size_t count, size_t *length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLLoopbackServer_h */
@@ -0,0 +1,40 @@
+//
+//  ZLLoopbackServerMain.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/31.
+//
+
+#include "ZLLoopbackServer.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/// 单独运行本地服务器，用来在模拟器或真机上跑 ZLURLSessionManager / ZLWebSocket 的基准测试：
+///   zlloopbackserver [port]
+int main(int argc, char *argv[]) {
+    uint16_t port = argc > 1 ? (uint16_t)strtoul(argv[1], NULL, 10) : 8080;
+    signal(SIGPIPE, SIG_IGN);
+    ZLLoopbackServer *server = ZLLoopbackServerStart(port);
+    if (!server) {
+        perror("loopback server");
+        return 1;
+    }
+    printf("listening on http://127.0.0.1:%u\n", ZLLoopbackServerPort(server));
+    fflush(stdout);
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    int received = 0;
+    sigwait(&signals, &received);
+
+    printf("served %llu requests\n", (unsigned long long)ZLLoopbackServerRequestCount(server));
+    ZLLoopbackServerStop(server);
+    return 0;
+}
@@ -0,0 +1,887 @@
+//
+//  ZLAPNGDecoder.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLAPNGDecoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+/// 画布像素数的上限，超过时当作损坏，避免恶意的文件头申请过大的内存
+#define ZLAPNGMaxPixels (1u << 26)
+
+enum {
+    ZLAPNGDisposeNone = 0,
+    ZLAPNGDisposeBackground = 1,
+    ZLAPNGDisposePrevious = 2,
+};
+
+enum {
+    ZLAPNGBlendSource = 0,
+    ZLAPNGBlendOver = 1,
+};
+
+enum {
+    ZLAPNGColorGray = 0,
+    ZLAPNGColorRGB = 2,
+    ZLAPNGColorPalette = 3,
+    ZLAPNGColorGrayAlpha = 4,
+    ZLAPNGColorRGBA = 6,
+};
+
+enum {
+    ZLAPNGStateSignature = 0,
+    ZLAPNGStateChunks,
+    ZLAPNGStateDone,
+};
+
+static const uint8_t ZLAPNGSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+/// 一段压缩数据在 data 中的位置，一帧的数据可以分在多个 IDAT 或 fdAT 块中
+typedef struct ZLAPNGSegment {
+    size_t offset;
+    size_t length;
+} ZLAPNGSegment;
+
+typedef struct ZLAPNGFrame {
+    ZLAPNGRect rect;
+    uint32_t duration;
+    uint8_t dispose;
+    uint8_t blend;
+    size_t firstSegment;
+    size_t segmentCount;
+} ZLAPNGFrame;
+
+struct ZLAPNGDecoder {
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+    size_t offset;              // 下一个待解析的块
+    int state;
+    bool corrupted;
+
+    uint32_t width;
+    uint32_t height;
+    uint8_t bitDepth;
+    uint8_t colorType;
+    bool interlaced;
+    uint32_t loopCount;
+    bool animated;              // 第一个 IDAT 之前出现了 acTL
+    uint32_t nextSequence;      // fcTL 和 fdAT 共用的序号
+
+    uint8_t paletteColors[256 * 3];
+    uint8_t paletteAlpha[256];
+    uint16_t paletteCount;
+    uint32_t palette[256];      // 收到第一个 IDAT 时由 PLTE 和 tRNS 生成，预乘的 ARGB
+    bool hasTransparentKey;     // 灰度和 RGB 图像的 tRNS，等于这个值的像素透明
+    uint16_t transparentKey[3];
+
+    bool sawImageData;          // 已经收到过 IDAT
+    bool imageDataEnded;        // IDAT 之后出现了其他块
+    bool hasPendingFrame;       // 收到了 fcTL，数据还没收全
+    bool pendingIsDefaultImage; // fcTL 在 IDAT 之前，这一帧的数据就是 IDAT
+    ZLAPNGFrame pendingFrame;
+
+    ZLAPNGSegment *segments;
+    size_t segmentCount;
+    size_t segmentCapacity;
+
+    ZLAPNGFrame *frames;
+    size_t frameCount;
+    size_t frameCapacity;
+};
+
+struct ZLAPNGCanvas {
+    uint32_t width;
+    uint32_t height;
+    uint32_t *pixels;
+    size_t nextFrame;
+
+    // 上一帧的区域和 dispose_op，在合成下一帧之前处理
+    ZLAPNGRect previousRect;
+    uint8_t previousDispose;
+    uint32_t *backup;           // dispose_op 为 PREVIOUS 的帧合成前保存的区域
+    size_t backupCapacity;
+
+    uint8_t *scanlines;         // 解压出的带过滤类型字节的扫描行
+    size_t scanlinesCapacity;
+    uint32_t *row;              // 转换成预乘 ARGB 的一行
+    size_t rowCapacity;
+};
+
+static inline uint32_t ZLAPNGReadUInt32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint16_t ZLAPNGReadUInt16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t ZLAPNGChunkType(const char type[4]) {
+    return ZLAPNGReadUInt32((const uint8_t *)type);
+}
+
+static inline uint32_t ZLAPNGChannelCount(uint8_t colorType) {
+    switch (colorType) {
+        case ZLAPNGColorRGB:
+            return 3;
+        case ZLAPNGColorGrayAlpha:
+            return 2;
+        case ZLAPNGColorRGBA:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+/// c * a / 255，四舍五入
+static inline uint32_t ZLAPNGMultiply(uint32_t c, uint32_t a) {
+    uint32_t t = c * a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static inline uint32_t ZLAPNGPremultiplied(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+    if (a == 255) {
+        return 0xFF000000u | (r << 16) | (g << 8) | b;
+    }
+    if (a == 0) {
+        return 0;
+    }
+    return (a << 24) | (ZLAPNGMultiply(r, a) << 16) | (ZLAPNGMultiply(g, a) << 8) | ZLAPNGMultiply(b, a);
+}
+
+ZLAPNGSniffResult ZLAPNGSniff(const uint8_t *bytes, size_t length) {
+    if (length < sizeof(ZLAPNGSignature)) {
+        return memcmp(bytes, ZLAPNGSignature, length) == 0 ? ZLAPNGSniffNeedMoreData : ZLAPNGSniffNotAnimated;
+    }
+    if (memcmp(bytes, ZLAPNGSignature, sizeof(ZLAPNGSignature)) != 0) {
+        return ZLAPNGSniffNotAnimated;
+    }
+    size_t offset = sizeof(ZLAPNGSignature);
+    while (offset + 8 <= length) {
+        uint32_t chunkLength = ZLAPNGReadUInt32(bytes + offset);
+        uint32_t type = ZLAPNGReadUInt32(bytes + offset + 4);
+        if (type == ZLAPNGChunkType("acTL")) {
+            return ZLAPNGSniffAnimated;
+        }
+        if (type == ZLAPNGChunkType("IDAT") || type == ZLAPNGChunkType("IEND") || chunkLength > 0x7FFFFFFFu) {
+            return ZLAPNGSniffNotAnimated;
+        }
+        offset += 12 + (size_t)chunkLength;
+    }
+    return ZLAPNGSniffNeedMoreData;
+}
+
+/* chunks */
+
+static bool ZLAPNGParseHeader(ZLAPNGDecoder *decoder, const uint8_t *p, uint32_t length) {
+    if (length != 13) {
+        return false;
+    }
+    uint32_t width = ZLAPNGReadUInt32(p);
+    uint32_t height = ZLAPNGReadUInt32(p + 4);
+    uint8_t bitDepth = p[8];
+    uint8_t colorType = p[9];
+    if (width == 0 || height == 0 || (uint64_t)width * height > ZLAPNGMaxPixels ||
+        p[10] != 0 || p[11] != 0 || p[12] > 1) {
+        return false;
+    }
+    bool validDepth;
+    switch (colorType) {
+        case ZLAPNGColorGray:
+            validDepth = bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8 || bitDepth == 16;
+            break;
+        case ZLAPNGColorPalette:
+            validDepth = bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8;
+            break;
+        case ZLAPNGColorRGB:
+        case ZLAPNGColorGrayAlpha:
+        case ZLAPNGColorRGBA:
+            validDepth = bitDepth == 8 || bitDepth == 16;
+            break;
+        default:
+            validDepth = false;
+            break;
+    }
+    if (!validDepth) {
+        return false;
+    }
+    decoder->width = width;
+    decoder->height = height;
+    decoder->bitDepth = bitDepth;
+    decoder->colorType = colorType;
+    decoder->interlaced = p[12] == 1;
+    return true;
+}
+
+/// tRNS 格式不对时忽略，与浏览器一致
+static void ZLAPNGParseTransparency(ZLAPNGDecoder *decoder, const uint8_t *p, uint32_t length) {
+    switch (decoder->colorType) {
+        case ZLAPNGColorPalette:
+            for (uint32_t i = 0; i < length && i < 256; i++) {
+                decoder->paletteAlpha[i] = p[i];
+            }
+            break;
+        case ZLAPNGColorGray:
+            if (length >= 2) {
+                decoder->hasTransparentKey = true;
+                decoder->transparentKey[0] = ZLAPNGReadUInt16(p);
+            }
+            break;
+        case ZLAPNGColorRGB:
+            if (length >= 6) {
+                decoder->hasTransparentKey = true;
+                decoder->transparentKey[0] = ZLAPNGReadUInt16(p);
+                decoder->transparentKey[1] = ZLAPNGReadUInt16(p + 2);
+                decoder->transparentKey[2] = ZLAPNGReadUInt16(p + 4);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void ZLAPNGBuildPalette(ZLAPNGDecoder *decoder) {
+    for (uint32_t i = 0; i < 256; i++) {
+        if (i < decoder->paletteCount) {
+            const uint8_t *rgb = decoder->paletteColors + i * 3;
+            decoder->palette[i] = ZLAPNGPremultiplied(rgb[0], rgb[1], rgb[2], decoder->paletteAlpha[i]);
+        } else {
+            decoder->palette[i] = 0xFF000000u;
+        }
+    }
+}
+
+static bool ZLAPNGAddSegment(ZLAPNGDecoder *decoder, size_t offset, size_t length) {
+    if (decoder->segmentCount == decoder->segmentCapacity) {
+        size_t capacity = decoder->segmentCapacity ? decoder->segmentCapacity * 2 : 32;
+        ZLAPNGSegment *segments = realloc(decoder->segments, capacity * sizeof(ZLAPNGSegment));
+        if (segments == NULL) {
+            return false;
+        }
+        decoder->segments = segments;
+        decoder->segmentCapacity = capacity;
+    }
+    ZLAPNGSegment *segment = &decoder->segments[decoder->segmentCount++];
+    segment->offset = offset;
+    segment->length = length;
+    decoder->pendingFrame.segmentCount++;
+    return true;
+}
+
+/// 下一个 fcTL 或 IEND 到达时，上一帧的数据才算收全
+static bool ZLAPNGFinishPendingFrame(ZLAPNGDecoder *decoder) {
+    if (!decoder->hasPendingFrame) {
+        return true;
+    }
+    decoder->hasPendingFrame = false;
+    if (decoder->pendingFrame.segmentCount == 0) {
+        return false;
+    }
+    if (decoder->frameCount == decoder->frameCapacity) {
+        size_t capacity = decoder->frameCapacity ? decoder->frameCapacity * 2 : 16;
+        ZLAPNGFrame *frames = realloc(decoder->frames, capacity * sizeof(ZLAPNGFrame));
+        if (frames == NULL) {
+            return false;
+        }
+        decoder->frames = frames;
+        decoder->frameCapacity = capacity;
+    }
+    decoder->frames[decoder->frameCount++] = decoder->pendingFrame;
+    return true;
+}
+
+static bool ZLAPNGParseFrameControl(ZLAPNGDecoder *decoder, const uint8_t *p, uint32_t length) {
+    if (length != 26 || ZLAPNGReadUInt32(p) != decoder->nextSequence || !ZLAPNGFinishPendingFrame(decoder)) {
+        return false;
+    }
+    decoder->nextSequence++;
+
+    ZLAPNGFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.rect.width = ZLAPNGReadUInt32(p + 4);
+    frame.rect.height = ZLAPNGReadUInt32(p + 8);
+    frame.rect.x = ZLAPNGReadUInt32(p + 12);
+    frame.rect.y = ZLAPNGReadUInt32(p + 16);
+    uint16_t delayNumerator = ZLAPNGReadUInt16(p + 20);
+    uint16_t delayDenominator = ZLAPNGReadUInt16(p + 22);
+    frame.dispose = p[24];
+    frame.blend = p[25];
+    if (frame.rect.width == 0 || frame.rect.height == 0 ||
+        (uint64_t)frame.rect.x + frame.rect.width > decoder->width ||
+        (uint64_t)frame.rect.y + frame.rect.height > decoder->height ||
+        frame.dispose > ZLAPNGDisposePrevious || frame.blend > ZLAPNGBlendOver) {
+        return false;
+    }
+    // 默认图像作为第一帧时必须铺满画布
+    bool isDefaultImage = !decoder->sawImageData;
+    if (isDefaultImage && (frame.rect.x != 0 || frame.rect.y != 0 ||
+                           frame.rect.width != decoder->width || frame.rect.height != decoder->height)) {
+        return false;
+    }
+    // 分母为 0 时按 1/100 秒计
+    uint32_t milliseconds = (uint32_t)(((uint64_t)delayNumerator * 1000 + (delayDenominator ? delayDenominator : 100) / 2) /
+                                       (delayDenominator ? delayDenominator : 100));
+    frame.duration = milliseconds <= 10 ? 100 : milliseconds;
+    if (decoder->frameCount == 0 && frame.dispose == ZLAPNGDisposePrevious) {
+        frame.dispose = ZLAPNGDisposeBackground;
+    }
+    frame.firstSegment = decoder->segmentCount;
+
+    decoder->pendingFrame = frame;
+    decoder->hasPendingFrame = true;
+    decoder->pendingIsDefaultImage = isDefaultImage;
+    return true;
+}
+
+static bool ZLAPNGParseChunk(ZLAPNGDecoder *decoder, uint32_t type, size_t dataOffset, uint32_t length) {
+    const uint8_t *p = decoder->data + dataOffset;
+    bool isImageData = type == ZLAPNGChunkType("IDAT");
+    if (decoder->width == 0) {
+        return type == ZLAPNGChunkType("IHDR") && ZLAPNGParseHeader(decoder, p, length);
+    }
+    if (decoder->sawImageData && !isImageData) {
+        decoder->imageDataEnded = true;
+    }
+
+    if (isImageData) {
+        // 没有 acTL 的是普通 PNG，交给系统解码
+        if (!decoder->animated || decoder->imageDataEnded) {
+            return false;
+        }
+        if (!decoder->sawImageData) {
+            decoder->sawImageData = true;
+            ZLAPNGBuildPalette(decoder);
+        }
+        // fcTL 在 IDAT 之后时默认图像不属于动画，跳过
+        if (decoder->hasPendingFrame && decoder->pendingIsDefaultImage) {
+            return ZLAPNGAddSegment(decoder, dataOffset, length);
+        }
+        return true;
+    }
+    if (type == ZLAPNGChunkType("fdAT")) {
+        if (length < 4 || !decoder->hasPendingFrame || decoder->pendingIsDefaultImage ||
+            ZLAPNGReadUInt32(p) != decoder->nextSequence) {
+            return false;
+        }
+        decoder->nextSequence++;
+        return length == 4 || ZLAPNGAddSegment(decoder, dataOffset + 4, length - 4);
+    }
+    if (type == ZLAPNGChunkType("fcTL")) {
+        return decoder->animated && ZLAPNGParseFrameControl(decoder, p, length);
+    }
+    if (type == ZLAPNGChunkType("IEND")) {
+        decoder->state = ZLAPNGStateDone;
+        return ZLAPNGFinishPendingFrame(decoder) && decoder->sawImageData;
+    }
+
+    if (decoder->sawImageData) {
+        // IDAT 之后的辅助块（tEXt 等）不影响图像
+        return (type & 0x20000000u) != 0;
+    }
+    if (type == ZLAPNGChunkType("acTL")) {
+        if (length != 8 || ZLAPNGReadUInt32(p) == 0) {
+            return false;
+        }
+        decoder->animated = true;
+        decoder->loopCount = ZLAPNGReadUInt32(p + 4);
+        return true;
+    }
+    if (type == ZLAPNGChunkType("PLTE")) {
+        if (length % 3 != 0 || length > sizeof(decoder->paletteColors)) {
+            return false;
+        }
+        memcpy(decoder->paletteColors, p, length);
+        decoder->paletteCount = (uint16_t)(length / 3);
+        return true;
+    }
+    if (type == ZLAPNGChunkType("tRNS")) {
+        ZLAPNGParseTransparency(decoder, p, length);
+        return true;
+    }
+    // 不认识的关键块（类型首字母大写）无法正确显示
+    return (type & 0x20000000u) != 0;
+}
+
+static bool ZLAPNGParseChunks(ZLAPNGDecoder *decoder) {
+    while (decoder->state == ZLAPNGStateChunks && decoder->offset + 12 <= decoder->length) {
+        const uint8_t *p = decoder->data + decoder->offset;
+        uint32_t length = ZLAPNGReadUInt32(p);
+        if (length > 0x7FFFFFFFu) {
+            return false;
+        }
+        if (decoder->length - decoder->offset - 12 < length) {
+            return true;
+        }
+        uint32_t crc = (uint32_t)crc32(0, p + 4, length + 4);
+        if (crc != ZLAPNGReadUInt32(p + 8 + length)) {
+            return false;
+        }
+        if (!ZLAPNGParseChunk(decoder, ZLAPNGReadUInt32(p + 4), decoder->offset + 8, length)) {
+            return false;
+        }
+        decoder->offset += 12 + (size_t)length;
+    }
+    return true;
+}
+
+ZLAPNGDecoder *ZLAPNGDecoderCreate(void) {
+    ZLAPNGDecoder *decoder = calloc(1, sizeof(ZLAPNGDecoder));
+    if (decoder) {
+        decoder->loopCount = 1;
+        memset(decoder->paletteAlpha, 0xFF, sizeof(decoder->paletteAlpha));
+    }
+    return decoder;
+}
+
+void ZLAPNGDecoderDestroy(ZLAPNGDecoder *decoder) {
+    if (decoder == NULL) {
+        return;
+    }
+    free(decoder->data);
+    free(decoder->segments);
+    free(decoder->frames);
+    free(decoder);
+}
+
+bool ZLAPNGDecoderAppend(ZLAPNGDecoder *decoder, const uint8_t *bytes, size_t length) {
+    if (decoder->corrupted) {
+        return false;
+    }
+    if (decoder->state == ZLAPNGStateDone || length == 0) {
+        return true;
+    }
+
+    if (decoder->length + length > decoder->capacity) {
+        size_t capacity = decoder->capacity ? decoder->capacity : 4096;
+        while (capacity < decoder->length + length) {
+            capacity *= 2;
+        }
+        uint8_t *data = realloc(decoder->data, capacity);
+        if (data == NULL) {
+            return false;
+        }
+        decoder->data = data;
+        decoder->capacity = capacity;
+    }
+    memcpy(decoder->data + decoder->length, bytes, length);
+    decoder->length += length;
+
+    bool valid = true;
+    if (decoder->state == ZLAPNGStateSignature && decoder->length >= sizeof(ZLAPNGSignature)) {
+        valid = memcmp(decoder->data, ZLAPNGSignature, sizeof(ZLAPNGSignature)) == 0;
+        decoder->offset = sizeof(ZLAPNGSignature);
+        decoder->state = ZLAPNGStateChunks;
+    }
+    if (valid && decoder->state == ZLAPNGStateChunks) {
+        valid = ZLAPNGParseChunks(decoder);
+    }
+    if (!valid) {
+        decoder->corrupted = true;
+        decoder->state = ZLAPNGStateDone;
+    }
+    return valid;
+}
+
+size_t ZLAPNGDecoderDataLength(const ZLAPNGDecoder *decoder) {
+    return decoder->length;
+}
+
+bool ZLAPNGDecoderIsComplete(const ZLAPNGDecoder *decoder) {
+    return decoder->state == ZLAPNGStateDone;
+}
+
+uint32_t ZLAPNGDecoderWidth(const ZLAPNGDecoder *decoder) {
+    return decoder->width;
+}
+
+uint32_t ZLAPNGDecoderHeight(const ZLAPNGDecoder *decoder) {
+    return decoder->height;
+}
+
+uint32_t ZLAPNGDecoderLoopCount(const ZLAPNGDecoder *decoder) {
+    return decoder->loopCount;
+}
+
+size_t ZLAPNGDecoderFrameCount(const ZLAPNGDecoder *decoder) {
+    return decoder->frameCount;
+}
+
+uint32_t ZLAPNGDecoderFrameDuration(const ZLAPNGDecoder *decoder, size_t index) {
+    return index < decoder->frameCount ? decoder->frames[index].duration : 0;
+}
+
+/* canvas */
+
+ZLAPNGCanvas *ZLAPNGCanvasCreate(const ZLAPNGDecoder *decoder) {
+    if (decoder->width == 0 || decoder->height == 0) {
+        return NULL;
+    }
+    ZLAPNGCanvas *canvas = calloc(1, sizeof(ZLAPNGCanvas));
+    if (canvas == NULL) {
+        return NULL;
+    }
+    canvas->width = decoder->width;
+    canvas->height = decoder->height;
+    canvas->pixels = calloc((size_t)canvas->width * canvas->height, sizeof(uint32_t));
+    if (canvas->pixels == NULL) {
+        free(canvas);
+        return NULL;
+    }
+    return canvas;
+}
+
+void ZLAPNGCanvasDestroy(ZLAPNGCanvas *canvas) {
+    if (canvas == NULL) {
+        return;
+    }
+    free(canvas->pixels);
+    free(canvas->backup);
+    free(canvas->scanlines);
+    free(canvas->row);
+    free(canvas);
+}
+
+void ZLAPNGCanvasReset(ZLAPNGCanvas *canvas) {
+    canvas->nextFrame = 0;
+    canvas->previousDispose = ZLAPNGDisposeNone;
+    memset(&canvas->previousRect, 0, sizeof(ZLAPNGRect));
+}
+
+size_t ZLAPNGCanvasNextFrameIndex(const ZLAPNGCanvas *canvas) {
+    return canvas->nextFrame;
+}
+
+const uint32_t *ZLAPNGCanvasPixels(const ZLAPNGCanvas *canvas) {
+    return canvas->pixels;
+}
+
+static ZLAPNGRect ZLAPNGUnionRect(ZLAPNGRect a, ZLAPNGRect b) {
+    if (a.width == 0 || a.height == 0) {
+        return b;
+    }
+    if (b.width == 0 || b.height == 0) {
+        return a;
+    }
+    uint32_t minX = a.x < b.x ? a.x : b.x;
+    uint32_t minY = a.y < b.y ? a.y : b.y;
+    uint32_t maxX = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+    uint32_t maxY = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+    ZLAPNGRect rect = {minX, minY, maxX - minX, maxY - minY};
+    return rect;
+}
+
+static void ZLAPNGCopyRect(uint32_t *dst, size_t dstStride, const uint32_t *src, size_t srcStride, ZLAPNGRect rect) {
+    for (uint32_t row = 0; row < rect.height; row++) {
+        memcpy(dst + row * dstStride, src + row * srcStride, rect.width * sizeof(uint32_t));
+    }
+}
+
+/// Adam7 每一遍的起点和步长，不隔行时只有一遍
+static const uint8_t ZLAPNGPassStartX[7] = {0, 4, 0, 2, 0, 1, 0};
+static const uint8_t ZLAPNGPassStartY[7] = {0, 0, 4, 0, 2, 0, 1};
+static const uint8_t ZLAPNGPassStepX[7] = {8, 8, 4, 4, 2, 2, 1};
+static const uint8_t ZLAPNGPassStepY[7] = {8, 8, 8, 4, 4, 2, 2};
+
+static inline uint32_t ZLAPNGPassSize(uint32_t size, uint32_t start, uint32_t step) {
+    return size > start ? (size - start + step - 1) / step : 0;
+}
+
+static inline size_t ZLAPNGRowBytes(const ZLAPNGDecoder *decoder, uint32_t width) {
+    return ((size_t)width * ZLAPNGChannelCount(decoder->colorType) * decoder->bitDepth + 7) / 8;
+}
+
+static size_t ZLAPNGScanlinesLength(const ZLAPNGDecoder *decoder, ZLAPNGRect rect) {
+    if (!decoder->interlaced) {
+        return (size_t)rect.height * (1 + ZLAPNGRowBytes(decoder, rect.width));
+    }
+    size_t length = 0;
+    for (int pass = 0; pass < 7; pass++) {
+        uint32_t width = ZLAPNGPassSize(rect.width, ZLAPNGPassStartX[pass], ZLAPNGPassStepX[pass]);
+        uint32_t height = ZLAPNGPassSize(rect.height, ZLAPNGPassStartY[pass], ZLAPNGPassStepY[pass]);
+        if (width && height) {
+            length += (size_t)height * (1 + ZLAPNGRowBytes(decoder, width));
+        }
+    }
+    return length;
+}
+
+/// 解压帧的全部数据，返回实际得到的字节数；数据损坏时返回损坏之前的部分
+static size_t ZLAPNGInflateFrame(const ZLAPNGDecoder *decoder, const ZLAPNGFrame *frame, uint8_t *output, size_t length) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        return 0;
+    }
+    stream.next_out = output;
+    stream.avail_out = (uInt)length;
+    for (size_t i = 0; i < frame->segmentCount && stream.avail_out > 0; i++) {
+        const ZLAPNGSegment *segment = &decoder->segments[frame->firstSegment + i];
+        stream.next_in = (Bytef *)(uintptr_t)(decoder->data + segment->offset);
+        stream.avail_in = (uInt)segment->length;
+        int result = inflate(&stream, Z_NO_FLUSH);
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            break;
+        }
+    }
+    size_t produced = length - stream.avail_out;
+    inflateEnd(&stream);
+    return produced;
+}
+
+static inline uint8_t ZLAPNGPaeth(uint8_t a, uint8_t b, uint8_t c) {
+    int p = (int)a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+/// previous 为 NULL 表示这一遍的第一行，上一行按全 0 处理
+static bool ZLAPNGUnfilter(uint8_t filter, uint8_t *line, const uint8_t *previous, size_t length, size_t pixelBytes) {
+    switch (filter) {
+        case 0:
+            return true;
+        case 1:
+            for (size_t i = pixelBytes; i < length; i++) {
+                line[i] = (uint8_t)(line[i] + line[i - pixelBytes]);
+            }
+            return true;
+        case 2:
+            if (previous) {
+                for (size_t i = 0; i < length; i++) {
+                    line[i] = (uint8_t)(line[i] + previous[i]);
+                }
+            }
+            return true;
+        case 3:
+            for (size_t i = 0; i < length; i++) {
+                uint32_t left = i >= pixelBytes ? line[i - pixelBytes] : 0;
+                uint32_t up = previous ? previous[i] : 0;
+                line[i] = (uint8_t)(line[i] + ((left + up) >> 1));
+            }
+            return true;
+        case 4:
+            for (size_t i = 0; i < length; i++) {
+                uint8_t left = i >= pixelBytes ? line[i - pixelBytes] : 0;
+                uint8_t up = previous ? previous[i] : 0;
+                uint8_t upLeft = previous && i >= pixelBytes ? previous[i - pixelBytes] : 0;
+                line[i] = (uint8_t)(line[i] + ZLAPNGPaeth(left, up, upLeft));
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+/// 位深小于 8 时的第 index 个样本
+static inline uint32_t ZLAPNGPackedSample(const uint8_t *line, uint32_t index, uint8_t bitDepth) {
+    size_t bit = (size_t)index * bitDepth;
+    return (line[bit / 8] >> (8 - bitDepth - bit % 8)) & ((1u << bitDepth) - 1);
+}
+
+/// 一行扫描线转换成预乘的 ARGB；16 位样本取高 8 位，透明色按原始位深比较
+static void ZLAPNGConvertRow(const ZLAPNGDecoder *decoder, const uint8_t *line, uint32_t width, uint32_t *row) {
+    uint8_t depth = decoder->bitDepth;
+    const uint16_t *key = decoder->transparentKey;
+    bool hasKey = decoder->hasTransparentKey;
+    switch (decoder->colorType) {
+        case ZLAPNGColorGray:
+            for (uint32_t x = 0; x < width; x++) {
+                uint32_t sample, value;
+                if (depth == 16) {
+                    sample = ZLAPNGReadUInt16(line + x * 2);
+                    value = sample >> 8;
+                } else if (depth == 8) {
+                    sample = value = line[x];
+                } else {
+                    sample = ZLAPNGPackedSample(line, x, depth);
+                    value = sample * 255 / ((1u << depth) - 1);
+                }
+                row[x] = hasKey && sample == key[0] ? 0 : 0xFF000000u | (value << 16) | (value << 8) | value;
+            }
+            break;
+        case ZLAPNGColorRGB:
+            for (uint32_t x = 0; x < width; x++) {
+                uint32_t r, g, b;
+                bool transparent;
+                if (depth == 16) {
+                    const uint8_t *p = line + x * 6;
+                    transparent = hasKey && ZLAPNGReadUInt16(p) == key[0] && ZLAPNGReadUInt16(p + 2) == key[1] && ZLAPNGReadUInt16(p + 4) == key[2];
+                    r = p[0];
+                    g = p[2];
+                    b = p[4];
+                } else {
+                    const uint8_t *p = line + x * 3;
+                    r = p[0];
+                    g = p[1];
+                    b = p[2];
+                    transparent = hasKey && r == key[0] && g == key[1] && b == key[2];
+                }
+                row[x] = transparent ? 0 : 0xFF000000u | (r << 16) | (g << 8) | b;
+            }
+            break;
+        case ZLAPNGColorPalette:
+            for (uint32_t x = 0; x < width; x++) {
+                uint32_t index = depth == 8 ? line[x] : ZLAPNGPackedSample(line, x, depth);
+                row[x] = decoder->palette[index];
+            }
+            break;
+        case ZLAPNGColorGrayAlpha:
+            for (uint32_t x = 0; x < width; x++) {
+                const uint8_t *p = depth == 16 ? line + x * 4 : line + x * 2;
+                uint32_t value = p[0];
+                uint32_t alpha = depth == 16 ? p[2] : p[1];
+                row[x] = ZLAPNGPremultiplied(value, value, value, alpha);
+            }
+            break;
+        default:
+            for (uint32_t x = 0; x < width; x++) {
+                const uint8_t *p = depth == 16 ? line + x * 8 : line + x * 4;
+                uint32_t step = depth == 16 ? 2 : 1;
+                row[x] = ZLAPNGPremultiplied(p[0], p[step], p[step * 2], p[step * 3]);
+            }
+            break;
+    }
+}
+
+/// 预乘颜色的 source-over：dst = src + dst * (1 - srcAlpha)
+static inline uint32_t ZLAPNGCompositeOver(uint32_t src, uint32_t dst) {
+    uint32_t alpha = src >> 24;
+    if (alpha == 255 || dst == 0) {
+        return src;
+    }
+    if (alpha == 0) {
+        return dst;
+    }
+    uint32_t inverse = 255 - alpha;
+    uint32_t a = (src >> 24) + ZLAPNGMultiply(dst >> 24, inverse);
+    uint32_t r = ((src >> 16) & 0xFF) + ZLAPNGMultiply((dst >> 16) & 0xFF, inverse);
+    uint32_t g = ((src >> 8) & 0xFF) + ZLAPNGMultiply((dst >> 8) & 0xFF, inverse);
+    uint32_t b = (src & 0xFF) + ZLAPNGMultiply(dst & 0xFF, inverse);
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+static void ZLAPNGDecodeFrame(ZLAPNGCanvas *canvas, const ZLAPNGDecoder *decoder, const ZLAPNGFrame *frame) {
+    size_t length = ZLAPNGScanlinesLength(decoder, frame->rect);
+    if (length > UINT32_MAX) {
+        return;
+    }
+    if (length > canvas->scanlinesCapacity) {
+        uint8_t *scanlines = realloc(canvas->scanlines, length);
+        if (scanlines == NULL) {
+            return;
+        }
+        canvas->scanlines = scanlines;
+        canvas->scanlinesCapacity = length;
+    }
+    if (frame->rect.width > canvas->rowCapacity) {
+        uint32_t *row = realloc(canvas->row, frame->rect.width * sizeof(uint32_t));
+        if (row == NULL) {
+            return;
+        }
+        canvas->row = row;
+        canvas->rowCapacity = frame->rect.width;
+    }
+    size_t produced = ZLAPNGInflateFrame(decoder, frame, canvas->scanlines, length);
+
+    size_t pixelBytes = (ZLAPNGChannelCount(decoder->colorType) * decoder->bitDepth + 7) / 8;
+    size_t offset = 0;
+    int passCount = decoder->interlaced ? 7 : 1;
+    for (int pass = 0; pass < passCount; pass++) {
+        uint32_t startX = decoder->interlaced ? ZLAPNGPassStartX[pass] : 0;
+        uint32_t startY = decoder->interlaced ? ZLAPNGPassStartY[pass] : 0;
+        uint32_t stepX = decoder->interlaced ? ZLAPNGPassStepX[pass] : 1;
+        uint32_t stepY = decoder->interlaced ? ZLAPNGPassStepY[pass] : 1;
+        uint32_t width = ZLAPNGPassSize(frame->rect.width, startX, stepX);
+        uint32_t height = ZLAPNGPassSize(frame->rect.height, startY, stepY);
+        if (width == 0 || height == 0) {
+            continue;
+        }
+        size_t rowBytes = ZLAPNGRowBytes(decoder, width);
+        const uint8_t *previous = NULL;
+        for (uint32_t y = 0; y < height; y++) {
+            if (produced - offset < 1 + rowBytes) {
+                return;
+            }
+            uint8_t *line = canvas->scanlines + offset + 1;
+            if (!ZLAPNGUnfilter(canvas->scanlines[offset], line, previous, rowBytes, pixelBytes)) {
+                return;
+            }
+            ZLAPNGConvertRow(decoder, line, width, canvas->row);
+
+            uint32_t *target = canvas->pixels + (size_t)(frame->rect.y + startY + y * stepY) * canvas->width + frame->rect.x + startX;
+            if (frame->blend == ZLAPNGBlendSource) {
+                for (uint32_t x = 0; x < width; x++) {
+                    target[(size_t)x * stepX] = canvas->row[x];
+                }
+            } else {
+                for (uint32_t x = 0; x < width; x++) {
+                    target[(size_t)x * stepX] = ZLAPNGCompositeOver(canvas->row[x], target[(size_t)x * stepX]);
+                }
+            }
+            previous = line;
+            offset += 1 + rowBytes;
+        }
+    }
+}
+
+bool ZLAPNGCanvasRenderNextFrame(ZLAPNGCanvas *canvas, const ZLAPNGDecoder *decoder, ZLAPNGRect *dirtyRect) {
+    size_t index = canvas->nextFrame;
+    if (index >= decoder->frameCount) {
+        return false;
+    }
+
+    ZLAPNGRect dirty = {0, 0, 0, 0};
+    if (index == 0) {
+        memset(canvas->pixels, 0, (size_t)canvas->width * canvas->height * sizeof(uint32_t));
+        dirty.width = canvas->width;
+        dirty.height = canvas->height;
+    } else if (canvas->previousDispose == ZLAPNGDisposeBackground) {
+        ZLAPNGRect rect = canvas->previousRect;
+        for (uint32_t row = 0; row < rect.height; row++) {
+            memset(canvas->pixels + (size_t)(rect.y + row) * canvas->width + rect.x, 0, rect.width * sizeof(uint32_t));
+        }
+        dirty = rect;
+    } else if (canvas->previousDispose == ZLAPNGDisposePrevious) {
+        ZLAPNGRect rect = canvas->previousRect;
+        ZLAPNGCopyRect(canvas->pixels + (size_t)rect.y * canvas->width + rect.x, canvas->width, canvas->backup, rect.width, rect);
+        dirty = rect;
+    }
+
+    const ZLAPNGFrame *frame = &decoder->frames[index];
+    ZLAPNGRect rect = frame->rect;
+    uint8_t dispose = frame->dispose;
+    if (dispose == ZLAPNGDisposePrevious) {
+        size_t backupLength = (size_t)rect.width * rect.height;
+        if (backupLength > canvas->backupCapacity) {
+            uint32_t *backup = realloc(canvas->backup, backupLength * sizeof(uint32_t));
+            if (backup == NULL) {
+                dispose = ZLAPNGDisposeNone;
+            } else {
+                canvas->backup = backup;
+                canvas->backupCapacity = backupLength;
+            }
+        }
+        if (dispose == ZLAPNGDisposePrevious) {
+            ZLAPNGCopyRect(canvas->backup, rect.width, canvas->pixels + (size_t)rect.y * canvas->width + rect.x, canvas->width, rect);
+        }
+    }
+
+    ZLAPNGDecodeFrame(canvas, decoder, frame);
+
+    canvas->previousRect = rect;
+    canvas->previousDispose = dispose;
+    canvas->nextFrame = index + 1;
+    if (dirtyRect) {
+        *dirtyRect = ZLAPNGUnionRect(dirty, rect);
+    }
+    return true;
+}
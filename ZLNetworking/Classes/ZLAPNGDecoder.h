@@ -0,0 +1,91 @@
+//
+//  ZLAPNGDecoder.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#ifndef ZLAPNGDecoder_h
+#define ZLAPNGDecoder_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 流式 APNG 解码，用法与 ZLGIFDecoder 相同：数据可以分多次追加，每收全一帧就能解码这一帧。
+/// ZLAPNGDecoder 只解析块结构、记录每帧的压缩数据在哪些块中；ZLAPNGCanvas 是一块可复用的画布，按顺序把每帧合成上去，
+/// 只改动帧所在的矩形并按 dispose_op、blend_op 处理。同一个 decoder 可以有多块画布，都不加锁，由调用方串行访问
+typedef struct ZLAPNGDecoder ZLAPNGDecoder;
+
+typedef struct ZLAPNGCanvas ZLAPNGCanvas;
+
+typedef struct ZLAPNGRect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+} ZLAPNGRect;
+
+typedef enum ZLAPNGSniffResult {
+    ZLAPNGSniffNeedMoreData = 0,
+    ZLAPNGSniffAnimated,
+    ZLAPNGSniffNotAnimated,     // 普通 PNG 或者不是 PNG
+} ZLAPNGSniffResult;
+
+/// 只看第一个 IDAT 之前的块，判断是不是 APNG，不校验 CRC
+ZLAPNGSniffResult ZLAPNGSniff(const uint8_t *bytes, size_t length);
+
+ZLAPNGDecoder *ZLAPNGDecoderCreate(void);
+
+void ZLAPNGDecoderDestroy(ZLAPNGDecoder *decoder);
+
+/// 追加新收到的数据并解析其中完整的块；数据不是 APNG 或结构损坏时返回 false，已解析的帧仍可使用
+bool ZLAPNGDecoderAppend(ZLAPNGDecoder *decoder, const uint8_t *bytes, size_t length);
+
+/// 已追加的数据长度
+size_t ZLAPNGDecoderDataLength(const ZLAPNGDecoder *decoder);
+
+/// 读到了 IEND 或数据损坏，之后不会再有新的帧
+bool ZLAPNGDecoderIsComplete(const ZLAPNGDecoder *decoder);
+
+/// 画布尺寸，IHDR 还没收全时为 0
+uint32_t ZLAPNGDecoderWidth(const ZLAPNGDecoder *decoder);
+
+uint32_t ZLAPNGDecoderHeight(const ZLAPNGDecoder *decoder);
+
+/// 播放次数，0 表示无限循环
+uint32_t ZLAPNGDecoderLoopCount(const ZLAPNGDecoder *decoder);
+
+/// 已收全的帧数，不包括不属于动画的默认图像
+size_t ZLAPNGDecoderFrameCount(const ZLAPNGDecoder *decoder);
+
+/// 帧的显示时长，单位毫秒；与 GIF 一致，把不超过 10ms 的时长当作 100ms
+uint32_t ZLAPNGDecoderFrameDuration(const ZLAPNGDecoder *decoder, size_t index);
+
+/// 解码器的画布尺寸还未知时返回 NULL
+ZLAPNGCanvas *ZLAPNGCanvasCreate(const ZLAPNGDecoder *decoder);
+
+void ZLAPNGCanvasDestroy(ZLAPNGCanvas *canvas);
+
+/// 回到第 0 帧之前的状态
+void ZLAPNGCanvasReset(ZLAPNGCanvas *canvas);
+
+/// 下一次 ZLAPNGCanvasRenderNextFrame 合成的帧
+size_t ZLAPNGCanvasNextFrameIndex(const ZLAPNGCanvas *canvas);
+
+/// 合成下一帧，dirtyRect 返回这次改动的区域；下一帧还没收全时返回 false。
+/// 帧内压缩数据损坏时保留已解出的行
+bool ZLAPNGCanvasRenderNextFrame(ZLAPNGCanvas *canvas, const ZLAPNGDecoder *decoder, ZLAPNGRect *dirtyRect);
+
+/// 画布像素，每行 width 个，主机字节序的 32 位 ARGB（预乘，透明像素为 0），与 ZLGIFCanvasPixels 相同
+const uint32_t *ZLAPNGCanvasPixels(const ZLAPNGCanvas *canvas);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLAPNGDecoder_h */
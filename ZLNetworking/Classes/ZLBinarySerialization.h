@@ -0,0 +1,31 @@
+//
+//  ZLBinarySerialization.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/16.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// 与 NSJSONSerialization 用法一致的 MessagePack 编解码，支持 NSDictionary/NSArray/NSNumber/NSString/NSData/NSNull；
+/// 解码得到的容器为可变类型
+@interface ZLMessagePackSerialization : NSObject
+
++ (nullable NSData *)dataWithObject:(id)object error:(NSError **)error;
+
++ (nullable id)objectWithData:(NSData *)data error:(NSError **)error;
+
+@end
+
+/// CBOR (RFC 8949) 编解码，支持的类型同上；解码时忽略标签，undefined 解码为 NSNull
+@interface ZLCBORSerialization : NSObject
+
++ (nullable NSData *)dataWithObject:(id)object error:(NSError **)error;
+
++ (nullable id)objectWithData:(NSData *)data error:(NSError **)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
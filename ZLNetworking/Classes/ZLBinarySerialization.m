@@ -0,0 +1,660 @@
+//
+//  ZLBinarySerialization.m
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/16.
+//
+
+#import "ZLBinarySerialization.h"
+
+/// 容器嵌套的最大深度，避免恶意数据导致栈溢出
+static NSUInteger const ZLBinaryMaxDepth = 512;
+
+static NSString * const ZLBinarySerializationErrorDomain = @"ZLBinarySerializationErrorDomain";
+
+static NSError *ZLBinaryError(NSString *description) {
+    return [NSError errorWithDomain:ZLBinarySerializationErrorDomain code:-1 userInfo:@{NSLocalizedDescriptionKey: description}];
+}
+
+#pragma mark - buffer
+
+typedef struct ZLBinaryWriter {
+    uint8_t *bytes;
+    size_t length;
+    size_t capacity;
+    BOOL failed;
+} ZLBinaryWriter;
+
+static BOOL ZLBinaryWriterReserve(ZLBinaryWriter *writer, size_t length) {
+    if (writer->failed) {
+        return NO;
+    }
+    if (writer->capacity - writer->length >= length) {
+        return YES;
+    }
+    size_t capacity = writer->capacity ? writer->capacity : 256;
+    while (capacity - writer->length < length) {
+        if (capacity > SIZE_MAX / 2) {
+            writer->failed = YES;
+            return NO;
+        }
+        capacity *= 2;
+    }
+    uint8_t *bytes = realloc(writer->bytes, capacity);
+    if (bytes == NULL) {
+        writer->failed = YES;
+        return NO;
+    }
+    writer->bytes = bytes;
+    writer->capacity = capacity;
+    return YES;
+}
+
+static inline void ZLBinaryWriteBytes(ZLBinaryWriter *writer, const void *bytes, size_t length) {
+    if (ZLBinaryWriterReserve(writer, length)) {
+        memcpy(writer->bytes + writer->length, bytes, length);
+        writer->length += length;
+    }
+}
+
+static inline void ZLBinaryWriteByte(ZLBinaryWriter *writer, uint8_t byte) {
+    ZLBinaryWriteBytes(writer, &byte, 1);
+}
+
+/// 大端写入 size 字节的整数
+static inline void ZLBinaryWriteBigEndian(ZLBinaryWriter *writer, uint8_t prefix, uint64_t value, size_t size) {
+    uint8_t bytes[9];
+    bytes[0] = prefix;
+    for (size_t i = 0; i < size; i++) {
+        bytes[size - i] = (uint8_t)(value >> (8 * i));
+    }
+    ZLBinaryWriteBytes(writer, bytes, size + 1);
+}
+
+/// 字符串直接以 UTF-8 写进缓冲区，不生成中间对象
+static void ZLBinaryWriteStringBytes(ZLBinaryWriter *writer, NSString *string, NSUInteger length) {
+    if (length == 0 || !ZLBinaryWriterReserve(writer, length)) {
+        return;
+    }
+    const char *cString = CFStringGetCStringPtr((__bridge CFStringRef)string, kCFStringEncodingUTF8);
+    if (cString != NULL) {
+        memcpy(writer->bytes + writer->length, cString, length);
+    } else {
+        NSUInteger usedLength = 0;
+        [string getBytes:writer->bytes + writer->length maxLength:length usedLength:&usedLength encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, string.length) remainingRange:NULL];
+        if (usedLength != length) {
+            writer->failed = YES;
+            return;
+        }
+    }
+    writer->length += length;
+}
+
+static NSData *ZLBinaryWriterFinish(ZLBinaryWriter *writer, NSString *failure, NSError **error) {
+    if (writer->failed) {
+        free(writer->bytes);
+        if (error) {
+            *error = ZLBinaryError(failure);
+        }
+        return nil;
+    }
+    return [NSData dataWithBytesNoCopy:writer->bytes length:writer->length freeWhenDone:YES];
+}
+
+static inline BOOL ZLBinaryNumberIsBool(NSNumber *number) {
+    return CFGetTypeID((__bridge CFTypeRef)number) == CFBooleanGetTypeID();
+}
+
+static inline BOOL ZLBinaryNumberIsFloat(NSNumber *number) {
+    return CFNumberIsFloatType((__bridge CFNumberRef)number);
+}
+
+/// 只有 unsigned long long 超出 long long 范围时才需要按无符号处理
+static inline BOOL ZLBinaryNumberIsLargeUnsigned(NSNumber *number) {
+    const char *type = number.objCType;
+    return (type[0] == 'Q' || type[0] == 'L') && number.unsignedLongLongValue > INT64_MAX;
+}
+
+#pragma mark - reader
+
+typedef struct ZLBinaryReader {
+    const uint8_t *cur;
+    const uint8_t *end;
+    NSUInteger depth;
+} ZLBinaryReader;
+
+static inline BOOL ZLBinaryReadBigEndian(ZLBinaryReader *reader, size_t size, uint64_t *value) {
+    if ((size_t)(reader->end - reader->cur) < size) {
+        return NO;
+    }
+    uint64_t result = 0;
+    for (size_t i = 0; i < size; i++) {
+        result = (result << 8) | reader->cur[i];
+    }
+    reader->cur += size;
+    *value = result;
+    return YES;
+}
+
+static inline NSString *ZLBinaryReadString(ZLBinaryReader *reader, uint64_t length) {
+    if ((uint64_t)(reader->end - reader->cur) < length) {
+        return nil;
+    }
+    NSString *string = [[NSString alloc] initWithBytes:reader->cur length:(NSUInteger)length encoding:NSUTF8StringEncoding];
+    reader->cur += length;
+    return string;
+}
+
+static inline NSData *ZLBinaryReadData(ZLBinaryReader *reader, uint64_t length) {
+    if ((uint64_t)(reader->end - reader->cur) < length) {
+        return nil;
+    }
+    NSData *data = [NSData dataWithBytes:reader->cur length:(NSUInteger)length];
+    reader->cur += length;
+    return data;
+}
+
+static inline double ZLBinaryDoubleFromBits(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline float ZLBinaryFloatFromBits(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+#pragma mark - MessagePack
+
+static void ZLMessagePackWriteLength(ZLBinaryWriter *writer, NSUInteger length, uint8_t fixPrefix, NSUInteger fixLimit, uint8_t prefix8, uint8_t prefix16, uint8_t prefix32) {
+    if (fixLimit > 0 && length < fixLimit) {
+        ZLBinaryWriteByte(writer, fixPrefix | (uint8_t)length);
+    } else if (prefix8 != 0 && length <= UINT8_MAX) {
+        ZLBinaryWriteBigEndian(writer, prefix8, length, 1);
+    } else if (length <= UINT16_MAX) {
+        ZLBinaryWriteBigEndian(writer, prefix16, length, 2);
+    } else if (length <= UINT32_MAX) {
+        ZLBinaryWriteBigEndian(writer, prefix32, length, 4);
+    } else {
+        writer->failed = YES;
+    }
+}
+
+static void ZLMessagePackWriteObject(ZLBinaryWriter *writer, id object, NSUInteger depth) {
+    if (writer->failed) {
+        return;
+    }
+    if (depth > ZLBinaryMaxDepth) {
+        writer->failed = YES;
+        return;
+    }
+
+    if ([object isKindOfClass:[NSString class]]) {
+        NSString *string = object;
+        NSUInteger length = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+        ZLMessagePackWriteLength(writer, length, 0xa0, 32, 0xd9, 0xda, 0xdb);
+        ZLBinaryWriteStringBytes(writer, string, length);
+    } else if ([object isKindOfClass:[NSNumber class]]) {
+        NSNumber *number = object;
+        if (ZLBinaryNumberIsBool(number)) {
+            ZLBinaryWriteByte(writer, number.boolValue ? 0xc3 : 0xc2);
+        } else if (ZLBinaryNumberIsFloat(number)) {
+            if (number.objCType[0] == 'f') {
+                float value = number.floatValue;
+                uint32_t bits;
+                memcpy(&bits, &value, sizeof(bits));
+                ZLBinaryWriteBigEndian(writer, 0xca, bits, 4);
+            } else {
+                double value = number.doubleValue;
+                uint64_t bits;
+                memcpy(&bits, &value, sizeof(bits));
+                ZLBinaryWriteBigEndian(writer, 0xcb, bits, 8);
+            }
+        } else if (ZLBinaryNumberIsLargeUnsigned(number)) {
+            ZLBinaryWriteBigEndian(writer, 0xcf, number.unsignedLongLongValue, 8);
+        } else {
+            int64_t value = number.longLongValue;
+            if (value >= 0) {
+                if (value < 128) {
+                    ZLBinaryWriteByte(writer, (uint8_t)value);
+                } else if (value <= UINT8_MAX) {
+                    ZLBinaryWriteBigEndian(writer, 0xcc, (uint64_t)value, 1);
+                } else if (value <= UINT16_MAX) {
+                    ZLBinaryWriteBigEndian(writer, 0xcd, (uint64_t)value, 2);
+                } else if (value <= UINT32_MAX) {
+                    ZLBinaryWriteBigEndian(writer, 0xce, (uint64_t)value, 4);
+                } else {
+                    ZLBinaryWriteBigEndian(writer, 0xcf, (uint64_t)value, 8);
+                }
+            } else if (value >= -32) {
+                ZLBinaryWriteByte(writer, (uint8_t)(int8_t)value);
+            } else if (value >= INT8_MIN) {
+                ZLBinaryWriteBigEndian(writer, 0xd0, (uint8_t)(int8_t)value, 1);
+            } else if (value >= INT16_MIN) {
+                ZLBinaryWriteBigEndian(writer, 0xd1, (uint16_t)(int16_t)value, 2);
+            } else if (value >= INT32_MIN) {
+                ZLBinaryWriteBigEndian(writer, 0xd2, (uint32_t)(int32_t)value, 4);
+            } else {
+                ZLBinaryWriteBigEndian(writer, 0xd3, (uint64_t)value, 8);
+            }
+        }
+    } else if ([object isKindOfClass:[NSDictionary class]]) {
+        NSDictionary *dictionary = object;
+        ZLMessagePackWriteLength(writer, dictionary.count, 0x80, 16, 0, 0xde, 0xdf);
+        [dictionary enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+            ZLMessagePackWriteObject(writer, key, depth + 1);
+            ZLMessagePackWriteObject(writer, obj, depth + 1);
+            *stop = writer->failed;
+        }];
+    } else if ([object isKindOfClass:[NSArray class]]) {
+        NSArray *array = object;
+        ZLMessagePackWriteLength(writer, array.count, 0x90, 16, 0, 0xdc, 0xdd);
+        for (id obj in array) {
+            ZLMessagePackWriteObject(writer, obj, depth + 1);
+            if (writer->failed) {
+                break;
+            }
+        }
+    } else if ([object isKindOfClass:[NSData class]]) {
+        NSData *data = object;
+        ZLMessagePackWriteLength(writer, data.length, 0, 0, 0xc4, 0xc5, 0xc6);
+        ZLBinaryWriteBytes(writer, data.bytes, data.length);
+    } else if (object == nil || object == [NSNull null]) {
+        ZLBinaryWriteByte(writer, 0xc0);
+    } else {
+        writer->failed = YES;
+    }
+}
+
+static id ZLMessagePackReadObject(ZLBinaryReader *reader);
+
+static id ZLMessagePackReadArray(ZLBinaryReader *reader, uint64_t count) {
+    // 每个元素至少占一个字节，先用剩余长度排除伪造的超大数量
+    if (count > (uint64_t)(reader->end - reader->cur) || ++reader->depth > ZLBinaryMaxDepth) {
+        return nil;
+    }
+    NSMutableArray *array = [NSMutableArray arrayWithCapacity:(NSUInteger)count];
+    for (uint64_t i = 0; i < count; i++) {
+        id obj = ZLMessagePackReadObject(reader);
+        if (obj == nil) {
+            return nil;
+        }
+        [array addObject:obj];
+    }
+    reader->depth--;
+    return array;
+}
+
+static id ZLMessagePackReadMap(ZLBinaryReader *reader, uint64_t count) {
+    if (count > (uint64_t)(reader->end - reader->cur) / 2 || ++reader->depth > ZLBinaryMaxDepth) {
+        return nil;
+    }
+    NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity:(NSUInteger)count];
+    for (uint64_t i = 0; i < count; i++) {
+        id key = ZLMessagePackReadObject(reader);
+        id obj = key ? ZLMessagePackReadObject(reader) : nil;
+        if (obj == nil || ![key conformsToProtocol:@protocol(NSCopying)]) {
+            return nil;
+        }
+        dictionary[key] = obj;
+    }
+    reader->depth--;
+    return dictionary;
+}
+
+static id ZLMessagePackReadObject(ZLBinaryReader *reader) {
+    if (reader->cur >= reader->end) {
+        return nil;
+    }
+    uint8_t type = *reader->cur++;
+    uint64_t value = 0;
+
+    if (type <= 0x7f) {
+        return @(type);
+    } else if (type >= 0xe0) {
+        return @((int8_t)type);
+    } else if ((type & 0xe0) == 0xa0) {
+        return ZLBinaryReadString(reader, type & 0x1f);
+    } else if ((type & 0xf0) == 0x90) {
+        return ZLMessagePackReadArray(reader, type & 0x0f);
+    } else if ((type & 0xf0) == 0x80) {
+        return ZLMessagePackReadMap(reader, type & 0x0f);
+    }
+
+    switch (type) {
+        case 0xc0:
+            return [NSNull null];
+        case 0xc2:
+            return @NO;
+        case 0xc3:
+            return @YES;
+        case 0xc4:
+        case 0xc5:
+        case 0xc6:
+            return ZLBinaryReadBigEndian(reader, 1 << (type - 0xc4), &value) ? ZLBinaryReadData(reader, value) : nil;
+        case 0xca:
+            return ZLBinaryReadBigEndian(reader, 4, &value) ? @(ZLBinaryFloatFromBits((uint32_t)value)) : nil;
+        case 0xcb:
+            return ZLBinaryReadBigEndian(reader, 8, &value) ? @(ZLBinaryDoubleFromBits(value)) : nil;
+        case 0xcc:
+        case 0xcd:
+        case 0xce:
+        case 0xcf:
+            return ZLBinaryReadBigEndian(reader, 1 << (type - 0xcc), &value) ? @(value) : nil;
+        case 0xd0:
+            return ZLBinaryReadBigEndian(reader, 1, &value) ? @((int8_t)value) : nil;
+        case 0xd1:
+            return ZLBinaryReadBigEndian(reader, 2, &value) ? @((int16_t)value) : nil;
+        case 0xd2:
+            return ZLBinaryReadBigEndian(reader, 4, &value) ? @((int32_t)value) : nil;
+        case 0xd3:
+            return ZLBinaryReadBigEndian(reader, 8, &value) ? @((int64_t)value) : nil;
+        case 0xd9:
+        case 0xda:
+        case 0xdb:
+            return ZLBinaryReadBigEndian(reader, 1 << (type - 0xd9), &value) ? ZLBinaryReadString(reader, value) : nil;
+        case 0xdc:
+        case 0xdd:
+            return ZLBinaryReadBigEndian(reader, type == 0xdc ? 2 : 4, &value) ? ZLMessagePackReadArray(reader, value) : nil;
+        case 0xde:
+        case 0xdf:
+            return ZLBinaryReadBigEndian(reader, type == 0xde ? 2 : 4, &value) ? ZLMessagePackReadMap(reader, value) : nil;
+        default:
+            // ext 类型不支持
+            return nil;
+    }
+}
+
+@implementation ZLMessagePackSerialization
+
++ (NSData *)dataWithObject:(id)object error:(NSError **)error {
+    ZLBinaryWriter writer = {0};
+    ZLMessagePackWriteObject(&writer, object, 0);
+    return ZLBinaryWriterFinish(&writer, @"Object cannot be encoded as MessagePack", error);
+}
+
++ (id)objectWithData:(NSData *)data error:(NSError **)error {
+    ZLBinaryReader reader = { data.bytes, (const uint8_t *)data.bytes + data.length, 0 };
+    id object = ZLMessagePackReadObject(&reader);
+    if (object == nil || reader.cur != reader.end) {
+        if (error) {
+            *error = ZLBinaryError(@"Invalid MessagePack data");
+        }
+        return nil;
+    }
+    return object;
+}
+
+@end
+
+#pragma mark - CBOR
+
+static void ZLCBORWriteHead(ZLBinaryWriter *writer, uint8_t majorType, uint64_t value) {
+    uint8_t major = (uint8_t)(majorType << 5);
+    if (value < 24) {
+        ZLBinaryWriteByte(writer, major | (uint8_t)value);
+    } else if (value <= UINT8_MAX) {
+        ZLBinaryWriteBigEndian(writer, major | 24, value, 1);
+    } else if (value <= UINT16_MAX) {
+        ZLBinaryWriteBigEndian(writer, major | 25, value, 2);
+    } else if (value <= UINT32_MAX) {
+        ZLBinaryWriteBigEndian(writer, major | 26, value, 4);
+    } else {
+        ZLBinaryWriteBigEndian(writer, major | 27, value, 8);
+    }
+}
+
+static void ZLCBORWriteObject(ZLBinaryWriter *writer, id object, NSUInteger depth) {
+    if (writer->failed) {
+        return;
+    }
+    if (depth > ZLBinaryMaxDepth) {
+        writer->failed = YES;
+        return;
+    }
+
+    if ([object isKindOfClass:[NSString class]]) {
+        NSString *string = object;
+        NSUInteger length = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+        ZLCBORWriteHead(writer, 3, length);
+        ZLBinaryWriteStringBytes(writer, string, length);
+    } else if ([object isKindOfClass:[NSNumber class]]) {
+        NSNumber *number = object;
+        if (ZLBinaryNumberIsBool(number)) {
+            ZLBinaryWriteByte(writer, number.boolValue ? 0xf5 : 0xf4);
+        } else if (ZLBinaryNumberIsFloat(number)) {
+            if (number.objCType[0] == 'f') {
+                float value = number.floatValue;
+                uint32_t bits;
+                memcpy(&bits, &value, sizeof(bits));
+                ZLBinaryWriteBigEndian(writer, 0xfa, bits, 4);
+            } else {
+                double value = number.doubleValue;
+                uint64_t bits;
+                memcpy(&bits, &value, sizeof(bits));
+                ZLBinaryWriteBigEndian(writer, 0xfb, bits, 8);
+            }
+        } else if (ZLBinaryNumberIsLargeUnsigned(number)) {
+            ZLCBORWriteHead(writer, 0, number.unsignedLongLongValue);
+        } else {
+            int64_t value = number.longLongValue;
+            if (value >= 0) {
+                ZLCBORWriteHead(writer, 0, (uint64_t)value);
+            } else {
+                ZLCBORWriteHead(writer, 1, (uint64_t)(-1 - value));
+            }
+        }
+    } else if ([object isKindOfClass:[NSDictionary class]]) {
+        NSDictionary *dictionary = object;
+        ZLCBORWriteHead(writer, 5, dictionary.count);
+        [dictionary enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+            ZLCBORWriteObject(writer, key, depth + 1);
+            ZLCBORWriteObject(writer, obj, depth + 1);
+            *stop = writer->failed;
+        }];
+    } else if ([object isKindOfClass:[NSArray class]]) {
+        NSArray *array = object;
+        ZLCBORWriteHead(writer, 4, array.count);
+        for (id obj in array) {
+            ZLCBORWriteObject(writer, obj, depth + 1);
+            if (writer->failed) {
+                break;
+            }
+        }
+    } else if ([object isKindOfClass:[NSData class]]) {
+        NSData *data = object;
+        ZLCBORWriteHead(writer, 2, data.length);
+        ZLBinaryWriteBytes(writer, data.bytes, data.length);
+    } else if (object == nil || object == [NSNull null]) {
+        ZLBinaryWriteByte(writer, 0xf6);
+    } else {
+        writer->failed = YES;
+    }
+}
+
+/// IEEE 754 半精度
+static double ZLCBORDecodeHalf(uint16_t half) {
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    double value;
+    if (exponent == 0) {
+        value = ldexp(mantissa, -24);
+    } else if (exponent != 31) {
+        value = ldexp(mantissa + 1024, exponent - 25);
+    } else {
+        value = mantissa == 0 ? INFINITY : NAN;
+    }
+    return (half & 0x8000) ? -value : value;
+}
+
+/// 读取头部的参数，indefinite 返回是否为不定长（additional info 31）
+static BOOL ZLCBORReadArgument(ZLBinaryReader *reader, uint8_t additional, uint64_t *value, BOOL *indefinite) {
+    *indefinite = NO;
+    if (additional < 24) {
+        *value = additional;
+        return YES;
+    } else if (additional <= 27) {
+        return ZLBinaryReadBigEndian(reader, (size_t)1 << (additional - 24), value);
+    } else if (additional == 31) {
+        *indefinite = YES;
+        return YES;
+    }
+    return NO;
+}
+
+static inline BOOL ZLCBORReadBreak(ZLBinaryReader *reader) {
+    if (reader->cur < reader->end && *reader->cur == 0xff) {
+        reader->cur++;
+        return YES;
+    }
+    return NO;
+}
+
+static id ZLCBORReadObject(ZLBinaryReader *reader);
+
+/// 不定长字符串由若干同类型的定长片段组成
+static id ZLCBORReadChunks(ZLBinaryReader *reader, uint8_t majorType) {
+    NSMutableData *data = [NSMutableData data];
+    while (!ZLCBORReadBreak(reader)) {
+        if (reader->cur >= reader->end || (*reader->cur >> 5) != majorType) {
+            return nil;
+        }
+        uint8_t additional = *reader->cur++ & 0x1f;
+        uint64_t length = 0;
+        BOOL indefinite = NO;
+        if (!ZLCBORReadArgument(reader, additional, &length, &indefinite) || indefinite || (uint64_t)(reader->end - reader->cur) < length) {
+            return nil;
+        }
+        [data appendBytes:reader->cur length:(NSUInteger)length];
+        reader->cur += length;
+    }
+    if (majorType == 2) {
+        return data;
+    }
+    return [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+}
+
+static id ZLCBORReadObject(ZLBinaryReader *reader) {
+    if (reader->cur >= reader->end) {
+        return nil;
+    }
+    uint8_t initial = *reader->cur++;
+    uint8_t majorType = initial >> 5;
+    uint8_t additional = initial & 0x1f;
+    uint64_t value = 0;
+    BOOL indefinite = NO;
+
+    if (majorType == 7) {
+        switch (additional) {
+            case 20:
+                return @NO;
+            case 21:
+                return @YES;
+            case 22:
+            case 23:
+                return [NSNull null];
+            case 25:
+                return ZLBinaryReadBigEndian(reader, 2, &value) ? @(ZLCBORDecodeHalf((uint16_t)value)) : nil;
+            case 26:
+                return ZLBinaryReadBigEndian(reader, 4, &value) ? @(ZLBinaryFloatFromBits((uint32_t)value)) : nil;
+            case 27:
+                return ZLBinaryReadBigEndian(reader, 8, &value) ? @(ZLBinaryDoubleFromBits(value)) : nil;
+            default:
+                return nil;
+        }
+    }
+
+    if (!ZLCBORReadArgument(reader, additional, &value, &indefinite)) {
+        return nil;
+    }
+
+    switch (majorType) {
+        case 0:
+            return indefinite ? nil : @(value);
+        case 1:
+            // -1 - value 超出 int64 范围时无法用 NSNumber 精确表示
+            return indefinite || value > INT64_MAX ? nil : @(-1 - (int64_t)value);
+        case 2:
+            if (indefinite) {
+                return ZLCBORReadChunks(reader, majorType);
+            }
+            return ZLBinaryReadData(reader, value);
+        case 3:
+            if (indefinite) {
+                return ZLCBORReadChunks(reader, majorType);
+            }
+            return ZLBinaryReadString(reader, value);
+        case 4: {
+            if ((!indefinite && value > (uint64_t)(reader->end - reader->cur)) || ++reader->depth > ZLBinaryMaxDepth) {
+                return nil;
+            }
+            NSMutableArray *array = [NSMutableArray arrayWithCapacity:indefinite ? 0 : (NSUInteger)value];
+            for (uint64_t i = 0; indefinite || i < value; i++) {
+                if (indefinite && ZLCBORReadBreak(reader)) {
+                    break;
+                }
+                id obj = ZLCBORReadObject(reader);
+                if (obj == nil) {
+                    return nil;
+                }
+                [array addObject:obj];
+            }
+            reader->depth--;
+            return array;
+        }
+        case 5: {
+            if ((!indefinite && value > (uint64_t)(reader->end - reader->cur) / 2) || ++reader->depth > ZLBinaryMaxDepth) {
+                return nil;
+            }
+            NSMutableDictionary *dictionary = [NSMutableDictionary dictionaryWithCapacity:indefinite ? 0 : (NSUInteger)value];
+            for (uint64_t i = 0; indefinite || i < value; i++) {
+                if (indefinite && ZLCBORReadBreak(reader)) {
+                    break;
+                }
+                id key = ZLCBORReadObject(reader);
+                id obj = key ? ZLCBORReadObject(reader) : nil;
+                if (obj == nil || ![key conformsToProtocol:@protocol(NSCopying)]) {
+                    return nil;
+                }
+                dictionary[key] = obj;
+            }
+            reader->depth--;
+            return dictionary;
+        }
+        case 6:
+            // 标签只是语义标注，直接返回被标注的值
+            if (indefinite || ++reader->depth > ZLBinaryMaxDepth) {
+                return nil;
+            } else {
+                id obj = ZLCBORReadObject(reader);
+                reader->depth--;
+                return obj;
+            }
+        default:
+            return nil;
+    }
+}
+
+@implementation ZLCBORSerialization
+
++ (NSData *)dataWithObject:(id)object error:(NSError **)error {
+    ZLBinaryWriter writer = {0};
+    ZLCBORWriteObject(&writer, object, 0);
+    return ZLBinaryWriterFinish(&writer, @"Object cannot be encoded as CBOR", error);
+}
+
++ (id)objectWithData:(NSData *)data error:(NSError **)error {
+    ZLBinaryReader reader = { data.bytes, (const uint8_t *)data.bytes + data.length, 0 };
+    id object = ZLCBORReadObject(&reader);
+    if (object == nil || reader.cur != reader.end) {
+        if (error) {
+            *error = ZLBinaryError(@"Invalid CBOR data");
+        }
+        return nil;
+    }
+    return object;
+}
+
+@end
@@ -0,0 +1,38 @@
+//
+//  ZLDecodedImageCache.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/25.
+//
+
+#import <UIKit/UIKit.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// 持久化的位图缓存：解码、缩放、圆角处理后的最终位图按像素格式和大小分级存放在内存映射的 slab 文件中，
+/// 命中时直接用映射的内存创建 CGImage，不需要再解码，也不拷贝像素
+@interface ZLDecodedImageCache : NSObject
+
+@property (nonatomic, copy, readonly) NSString *path;
+
+/// 所有 slab 文件的总大小上限
+@property (nonatomic, assign) unsigned long long byteLimit;
+
+- (instancetype)initWithPath:(NSString *)path byteLimit:(unsigned long long)byteLimit;
+
+- (nullable UIImage *)imageForKey:(NSString *)key;
+
+/// 动图、非 Up 方向以及过大的图片不缓存；会同步绘制到映射的内存中，不要在主线程调用。
+/// sourceKey 是原图的 key，同一张原图的各种尺寸可以用 removeImagesForSourceKey: 一起删掉
+- (void)storeImage:(UIImage *)image forKey:(NSString *)key sourceKey:(NSString *)sourceKey;
+
+- (void)removeImageForKey:(NSString *)key;
+
+/// 原图重新下载或被删除后调用，遍历所有槽位，不要在主线程调用
+- (void)removeImagesForSourceKey:(NSString *)sourceKey;
+
+- (void)removeAllImages;
+
+@end
+
+NS_ASSUME_NONNULL_END
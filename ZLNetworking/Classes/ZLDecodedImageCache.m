@@ -0,0 +1,534 @@
+//
+//  ZLDecodedImageCache.m
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/25.
+//
+
+#import "ZLDecodedImageCache.h"
+#import "ZLDiskCacheIndex.h"
+#import "ZLNetImage.h"
+#import <stdatomic.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+/// 每个 slab 文件中槽位部分的大小，槽位比它大时一个文件只放一个槽位
+static size_t const ZLBitmapSlabFileLength = 4 * 1024 * 1024;
+
+/// 超过这个大小的位图不缓存
+static size_t const ZLBitmapSlabMaxSlotLength = 4 * 1024 * 1024;
+
+static uint32_t const ZLBitmapSlabMagic = 0x42534c5a; // "ZLSB"
+static uint32_t const ZLBitmapSlabVersion = 2;
+
+/// 与 CGImageCreateDecoded 一致的两种像素格式，都是 32Host 字节序
+typedef NS_ENUM(uint32_t, ZLBitmapSlabFormat) {
+    ZLBitmapSlabFormatOpaque = 0,   // kCGImageAlphaNoneSkipFirst
+    ZLBitmapSlabFormatAlpha  = 1,   // kCGImageAlphaPremultipliedFirst
+};
+
+typedef struct ZLBitmapSlabHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;
+    uint32_t slotLength;
+    uint32_t slotCount;
+    uint32_t reserved[3];
+} ZLBitmapSlabHeader;
+
+/// 每个槽位的描述，紧跟在文件头后面；key 为 0 表示空闲
+typedef struct ZLBitmapSlabRecord {
+    uint64_t key;
+    uint64_t sourceKey;     // 原图的 key 哈希，原图更新或删除时一起删掉
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerRow;
+    float scale;
+    double accessTime;
+} ZLBitmapSlabRecord;
+
+static inline size_t ZLRoundUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static inline uint32_t ZLBitmapSlabSlotCount(uint32_t slotLength) {
+    return (uint32_t)MAX((size_t)1, ZLBitmapSlabFileLength / slotLength);
+}
+
+/// 文件头和槽位描述占整数页，槽位从页边界开始
+static inline size_t ZLBitmapSlabHeaderLength(uint32_t slotCount) {
+    return ZLRoundUp(sizeof(ZLBitmapSlabHeader) + slotCount * sizeof(ZLBitmapSlabRecord), (size_t)getpagesize());
+}
+
+static inline size_t ZLBitmapSlabLength(uint32_t slotLength) {
+    uint32_t slotCount = ZLBitmapSlabSlotCount(slotLength);
+    return ZLBitmapSlabHeaderLength(slotCount) + (size_t)slotCount * slotLength;
+}
+
+static inline CGColorSpaceRef ZLBitmapSlabColorSpace(void) {
+    static CGColorSpaceRef colorSpace;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+    });
+    return colorSpace;
+}
+
+static inline CGBitmapInfo ZLBitmapInfoForFormat(ZLBitmapSlabFormat format) {
+    return kCGBitmapByteOrder32Host | (format == ZLBitmapSlabFormatAlpha ? kCGImageAlphaPremultipliedFirst : kCGImageAlphaNoneSkipFirst);
+}
+
+/// 一个映射到内存的 slab 文件，包含同一格式、同一大小级别的若干槽位
+@interface ZLBitmapSlab : NSObject {
+@public
+    ZLBitmapSlabRecord *_records;
+    uint8_t *_slots;
+    /// 正在被 CGImage 引用或正在写入的槽位不能复用
+    atomic_uint *_refCounts;
+}
+
+@property (nonatomic, copy, readonly) NSString *path;
+@property (nonatomic, assign, readonly) ZLBitmapSlabFormat format;
+@property (nonatomic, assign, readonly) uint32_t slotLength;
+@property (nonatomic, assign, readonly) uint32_t slotCount;
+@property (nonatomic, assign, readonly) size_t length;
+
+- (nullable instancetype)initWithPath:(NSString *)path format:(ZLBitmapSlabFormat)format slotLength:(uint32_t)slotLength create:(BOOL)create;
+
+/// 所有槽位中最近一次访问的时间
+- (double)lastAccessTime;
+
+- (BOOL)hasReferencedSlots;
+
+@end
+
+@implementation ZLBitmapSlab {
+    uint8_t *_bytes;
+}
+
+- (instancetype)initWithPath:(NSString *)path format:(ZLBitmapSlabFormat)format slotLength:(uint32_t)slotLength create:(BOOL)create {
+    if (self = [super init]) {
+        _path = [path copy];
+        _format = format;
+        _slotLength = slotLength;
+        _slotCount = ZLBitmapSlabSlotCount(slotLength);
+        _length = ZLBitmapSlabLength(slotLength);
+
+        int fd = open(path.fileSystemRepresentation, create ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR, 0644);
+        if (fd < 0) {
+            return nil;
+        }
+        struct stat st;
+        if ((create && ftruncate(fd, (off_t)_length) != 0) || fstat(fd, &st) != 0 || (size_t)st.st_size != _length) {
+            close(fd);
+            return nil;
+        }
+        void *bytes = mmap(NULL, _length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (bytes == MAP_FAILED) {
+            return nil;
+        }
+        _bytes = bytes;
+
+        ZLBitmapSlabHeader *header = (ZLBitmapSlabHeader *)_bytes;
+        if (create) {
+            header->magic = ZLBitmapSlabMagic;
+            header->version = ZLBitmapSlabVersion;
+            header->format = format;
+            header->slotLength = slotLength;
+            header->slotCount = _slotCount;
+        } else if (header->magic != ZLBitmapSlabMagic || header->version != ZLBitmapSlabVersion ||
+                   header->format != format || header->slotLength != slotLength || header->slotCount != _slotCount) {
+            return nil;
+        }
+        _records = (ZLBitmapSlabRecord *)(_bytes + sizeof(ZLBitmapSlabHeader));
+        _slots = _bytes + ZLBitmapSlabHeaderLength(_slotCount);
+        _refCounts = calloc(_slotCount, sizeof(atomic_uint));
+        if (_refCounts == NULL) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_bytes != NULL) {
+        munmap(_bytes, _length);
+    }
+    free(_refCounts);
+}
+
+- (double)lastAccessTime {
+    double accessTime = 0;
+    for (uint32_t slot = 0; slot < _slotCount; slot++) {
+        if (_records[slot].key != 0) {
+            accessTime = MAX(accessTime, _records[slot].accessTime);
+        }
+    }
+    return accessTime;
+}
+
+- (BOOL)hasReferencedSlots {
+    for (uint32_t slot = 0; slot < _slotCount; slot++) {
+        if (atomic_load(&_refCounts[slot]) != 0) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+@end
+
+@interface ZLBitmapSlabEntry : NSObject
+
+@property (nonatomic, strong, readonly) ZLBitmapSlab *slab;
+@property (nonatomic, assign, readonly) uint32_t slot;
+
+@end
+
+@implementation ZLBitmapSlabEntry
+
+- (instancetype)initWithSlab:(ZLBitmapSlab *)slab slot:(uint32_t)slot {
+    if (self = [super init]) {
+        _slab = slab;
+        _slot = slot;
+    }
+    return self;
+}
+
+@end
+
+/// CGImage 释放像素数据时调用，info 是创建时持有的 ZLBitmapSlabEntry，slab 在此之前不会被 unmap
+static void ZLBitmapSlabReleaseData(void *info, const void *data, size_t size) {
+    ZLBitmapSlabEntry *entry = (__bridge_transfer ZLBitmapSlabEntry *)info;
+    atomic_fetch_sub(&entry.slab->_refCounts[entry.slot], 1);
+}
+
+@implementation ZLDecodedImageCache {
+    dispatch_semaphore_t _lock;
+    NSMutableArray<ZLBitmapSlab *> *_slabs;
+    /// key 哈希 -> 所在的槽位
+    NSMutableDictionary<NSNumber *, ZLBitmapSlabEntry *> *_entries;
+    unsigned long long _totalLength;
+    uint32_t _nextSerial;
+}
+
+- (instancetype)initWithPath:(NSString *)path byteLimit:(unsigned long long)byteLimit {
+    if (self = [super init]) {
+        _path = [path copy];
+        _byteLimit = byteLimit;
+        _lock = dispatch_semaphore_create(1);
+        _slabs = [NSMutableArray array];
+        _entries = [NSMutableDictionary dictionary];
+
+        BOOL isDir = NO;
+        if (![[NSFileManager defaultManager] fileExistsAtPath:_path isDirectory:&isDir] || !isDir) {
+            if (![[NSFileManager defaultManager] createDirectoryAtPath:_path withIntermediateDirectories:YES attributes:nil error:nil]) {
+                NSLog(@"file system error");
+            }
+        }
+        [self loadSlabs];
+        [self trimToByteLimit];
+    }
+    return self;
+}
+
+/// slab 文件名为 <format>_<slotLength>_<serial>.slab，槽位描述就在文件里，不需要单独的索引
+- (void)loadSlabs {
+    NSArray<NSString *> *contents = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:_path error:NULL];
+    for (NSString *fileName in contents) {
+        NSString *filePath = [_path stringByAppendingPathComponent:fileName];
+        unsigned int format = 0, slotLength = 0, serial = 0;
+        if (![fileName.pathExtension isEqualToString:@"slab"] ||
+            sscanf(fileName.UTF8String, "%u_%u_%u.slab", &format, &slotLength, &serial) != 3 ||
+            format > ZLBitmapSlabFormatAlpha || slotLength == 0 || slotLength > ZLBitmapSlabMaxSlotLength) {
+            [[NSFileManager defaultManager] removeItemAtPath:filePath error:NULL];
+            continue;
+        }
+        ZLBitmapSlab *slab = [[ZLBitmapSlab alloc] initWithPath:filePath format:format slotLength:slotLength create:NO];
+        if (slab == nil) {
+            [[NSFileManager defaultManager] removeItemAtPath:filePath error:NULL];
+            continue;
+        }
+        [_slabs addObject:slab];
+        _totalLength += slab.length;
+        _nextSerial = MAX(_nextSerial, serial + 1);
+
+        for (uint32_t slot = 0; slot < slab.slotCount; slot++) {
+            ZLBitmapSlabRecord *record = &slab->_records[slot];
+            if (record->key == 0) {
+                continue;
+            }
+            if (record->width == 0 || record->height == 0 || record->bytesPerRow < (uint64_t)record->width * 4 ||
+                (uint64_t)record->bytesPerRow * record->height > slab.slotLength || !(record->scale > 0)) {
+                record->key = 0;
+                continue;
+            }
+            // 写入中途崩溃可能留下同一个 key 的两份，保留较新的
+            ZLBitmapSlabEntry *existing = _entries[@(record->key)];
+            if (existing != nil) {
+                ZLBitmapSlabRecord *existingRecord = &existing.slab->_records[existing.slot];
+                if (existingRecord->accessTime >= record->accessTime) {
+                    record->key = 0;
+                    continue;
+                }
+                existingRecord->key = 0;
+            }
+            _entries[@(record->key)] = [[ZLBitmapSlabEntry alloc] initWithSlab:slab slot:slot];
+        }
+    }
+}
+
+- (void)setByteLimit:(unsigned long long)byteLimit {
+    _byteLimit = byteLimit;
+    [self trimToByteLimit];
+}
+
+- (void)trimToByteLimit {
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    while (_totalLength > _byteLimit && [self reclaimOldestSlab]) {
+    }
+    dispatch_semaphore_signal(_lock);
+}
+
+#pragma mark - slots (加锁后调用)
+
+- (void)removeEntryForHash:(uint64_t)hash {
+    ZLBitmapSlabEntry *entry = _entries[@(hash)];
+    if (entry == nil) {
+        return;
+    }
+    entry.slab->_records[entry.slot].key = 0;
+    [_entries removeObjectForKey:@(hash)];
+}
+
+/// 删除最久未访问且没有被引用的整个 slab 文件；已经映射的内存在最后一个 CGImage 释放后才 unmap
+- (BOOL)reclaimOldestSlab {
+    ZLBitmapSlab *oldest = nil;
+    double oldestAccessTime = DBL_MAX;
+    for (ZLBitmapSlab *slab in _slabs) {
+        if ([slab hasReferencedSlots]) {
+            continue;
+        }
+        double accessTime = [slab lastAccessTime];
+        if (accessTime < oldestAccessTime) {
+            oldest = slab;
+            oldestAccessTime = accessTime;
+        }
+    }
+    if (oldest == nil) {
+        return NO;
+    }
+    for (uint32_t slot = 0; slot < oldest.slotCount; slot++) {
+        uint64_t key = oldest->_records[slot].key;
+        if (key != 0 && _entries[@(key)].slab == oldest) {
+            [_entries removeObjectForKey:@(key)];
+        }
+    }
+    unlink(oldest.path.fileSystemRepresentation);
+    _totalLength -= oldest.length;
+    [_slabs removeObject:oldest];
+    return YES;
+}
+
+/// 依次尝试：同级别的空闲槽位、新建 slab、腾出整个旧 slab 后新建、淘汰同级别中最久未访问的槽位。
+/// 返回的槽位引用计数已加一，写完后需要减掉
+- (ZLBitmapSlabEntry *)reserveSlotWithFormat:(ZLBitmapSlabFormat)format slotLength:(uint32_t)slotLength {
+    ZLBitmapSlab *lruSlab = nil;
+    uint32_t lruSlot = 0;
+    double lruAccessTime = DBL_MAX;
+    for (ZLBitmapSlab *slab in _slabs) {
+        if (slab.format != format || slab.slotLength != slotLength) {
+            continue;
+        }
+        for (uint32_t slot = 0; slot < slab.slotCount; slot++) {
+            if (atomic_load(&slab->_refCounts[slot]) != 0) {
+                continue;
+            }
+            ZLBitmapSlabRecord *record = &slab->_records[slot];
+            if (record->key == 0) {
+                atomic_fetch_add(&slab->_refCounts[slot], 1);
+                return [[ZLBitmapSlabEntry alloc] initWithSlab:slab slot:slot];
+            }
+            if (record->accessTime < lruAccessTime) {
+                lruSlab = slab;
+                lruSlot = slot;
+                lruAccessTime = record->accessTime;
+            }
+        }
+    }
+
+    size_t slabLength = ZLBitmapSlabLength(slotLength);
+    while (_totalLength + slabLength > _byteLimit && [self reclaimOldestSlab]) {
+    }
+    // 腾出的可能正是 lruSlab
+    if (lruSlab != nil && ![_slabs containsObject:lruSlab]) {
+        lruSlab = nil;
+    }
+    if (_totalLength + slabLength <= _byteLimit) {
+        NSString *fileName = [NSString stringWithFormat:@"%u_%u_%u.slab", (unsigned int)format, slotLength, _nextSerial++];
+        ZLBitmapSlab *slab = [[ZLBitmapSlab alloc] initWithPath:[_path stringByAppendingPathComponent:fileName] format:format slotLength:slotLength create:YES];
+        if (slab != nil) {
+            [_slabs addObject:slab];
+            _totalLength += slab.length;
+            atomic_fetch_add(&slab->_refCounts[0], 1);
+            return [[ZLBitmapSlabEntry alloc] initWithSlab:slab slot:0];
+        }
+    }
+
+    if (lruSlab == nil) {
+        return nil;
+    }
+    [self removeEntryForHash:lruSlab->_records[lruSlot].key];
+    atomic_fetch_add(&lruSlab->_refCounts[lruSlot], 1);
+    return [[ZLBitmapSlabEntry alloc] initWithSlab:lruSlab slot:lruSlot];
+}
+
+#pragma mark - public
+
+static inline uint64_t ZLDecodedImageCacheHashForKey(NSString *key) {
+    const char *bytes = key.UTF8String;
+    return ZLDiskCacheKeyHash(bytes, bytes ? strlen(bytes) : 0);
+}
+
+- (UIImage *)imageForKey:(NSString *)key {
+    if (key == nil) {
+        return nil;
+    }
+    uint64_t hash = ZLDecodedImageCacheHashForKey(key);
+
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    ZLBitmapSlabEntry *entry = _entries[@(hash)];
+    if (entry == nil) {
+        dispatch_semaphore_signal(_lock);
+        return nil;
+    }
+    ZLBitmapSlab *slab = entry.slab;
+    ZLBitmapSlabRecord record = slab->_records[entry.slot];
+    slab->_records[entry.slot].accessTime = CFAbsoluteTimeGetCurrent();
+    atomic_fetch_add(&slab->_refCounts[entry.slot], 1);
+    dispatch_semaphore_signal(_lock);
+
+    uint8_t *pixels = slab->_slots + (size_t)entry.slot * slab.slotLength;
+    size_t length = (size_t)record.bytesPerRow * record.height;
+    CGDataProviderRef provider = CGDataProviderCreateWithData((__bridge_retained void *)entry, pixels, length, ZLBitmapSlabReleaseData);
+    if (provider == NULL) {
+        CFBridgingRelease((__bridge void *)entry);
+        atomic_fetch_sub(&slab->_refCounts[entry.slot], 1);
+        return nil;
+    }
+    CGImageRef imageRef = CGImageCreate(record.width, record.height, 8, 32, record.bytesPerRow, ZLBitmapSlabColorSpace(), ZLBitmapInfoForFormat(slab.format), provider, NULL, false, kCGRenderingIntentDefault);
+    CGDataProviderRelease(provider);
+    if (imageRef == NULL) {
+        return nil;
+    }
+    UIImage *image = [[UIImage alloc] initWithCGImage:imageRef scale:record.scale orientation:UIImageOrientationUp];
+    CGImageRelease(imageRef);
+    return image;
+}
+
+- (void)storeImage:(UIImage *)image forKey:(NSString *)key sourceKey:(NSString *)sourceKey {
+    if (image == nil || key == nil || sourceKey == nil || image.images != nil || [image conformsToProtocol:@protocol(ZLAnimatedImage)] ||
+        image.imageOrientation != UIImageOrientationUp) {
+        return;
+    }
+    CGImageRef cgImage = image.CGImage;
+    if (cgImage == NULL) {
+        return;
+    }
+    size_t width = CGImageGetWidth(cgImage);
+    size_t height = CGImageGetHeight(cgImage);
+    // 行字节数按 64 对齐，Core Animation 可以直接使用而不用再拷贝一份
+    size_t bytesPerRow = ZLRoundUp(width * 4, 64);
+    size_t dataLength = bytesPerRow * height;
+    if (width == 0 || height == 0 || dataLength > ZLBitmapSlabMaxSlotLength) {
+        return;
+    }
+    // 大小级别：不小于一页的 2 的幂
+    size_t slotLength = (size_t)getpagesize();
+    while (slotLength < dataLength) {
+        slotLength <<= 1;
+    }
+    ZLBitmapSlabFormat format = ZLImageHasAlpha(cgImage) ? ZLBitmapSlabFormatAlpha : ZLBitmapSlabFormatOpaque;
+    uint64_t hash = ZLDecodedImageCacheHashForKey(key);
+    uint64_t sourceHash = ZLDecodedImageCacheHashForKey(sourceKey);
+
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    [self removeEntryForHash:hash];
+    ZLBitmapSlabEntry *entry = [self reserveSlotWithFormat:format slotLength:(uint32_t)slotLength];
+    dispatch_semaphore_signal(_lock);
+    if (entry == nil) {
+        return;
+    }
+
+    // 绘制不加锁，槽位已被引用计数占住
+    ZLBitmapSlab *slab = entry.slab;
+    uint8_t *pixels = slab->_slots + (size_t)entry.slot * slab.slotLength;
+    CGContextRef context = CGBitmapContextCreate(pixels, width, height, 8, bytesPerRow, ZLBitmapSlabColorSpace(), ZLBitmapInfoForFormat(format));
+    if (context == NULL) {
+        atomic_fetch_sub(&slab->_refCounts[entry.slot], 1);
+        return;
+    }
+    CGContextClearRect(context, CGRectMake(0, 0, width, height));
+    CGContextDrawImage(context, CGRectMake(0, 0, width, height), cgImage);
+    CGContextRelease(context);
+
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    // slab 在绘制期间被 removeAllImages 删掉时放弃
+    if ([_slabs containsObject:slab]) {
+        [self removeEntryForHash:hash];
+        ZLBitmapSlabRecord *record = &slab->_records[entry.slot];
+        record->width = (uint32_t)width;
+        record->height = (uint32_t)height;
+        record->bytesPerRow = (uint32_t)bytesPerRow;
+        record->scale = (float)image.scale;
+        record->accessTime = CFAbsoluteTimeGetCurrent();
+        record->sourceKey = sourceHash;
+        // key 最后写，进程在写像素时崩溃不会留下有效的描述
+        record->key = hash;
+        _entries[@(hash)] = entry;
+    }
+    atomic_fetch_sub(&slab->_refCounts[entry.slot], 1);
+    dispatch_semaphore_signal(_lock);
+}
+
+- (void)removeImageForKey:(NSString *)key {
+    if (key == nil) {
+        return;
+    }
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    [self removeEntryForHash:ZLDecodedImageCacheHashForKey(key)];
+    dispatch_semaphore_signal(_lock);
+}
+
+- (void)removeImagesForSourceKey:(NSString *)sourceKey {
+    if (sourceKey == nil) {
+        return;
+    }
+    uint64_t sourceHash = ZLDecodedImageCacheHashForKey(sourceKey);
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    for (ZLBitmapSlab *slab in _slabs) {
+        for (uint32_t slot = 0; slot < slab.slotCount; slot++) {
+            ZLBitmapSlabRecord *record = &slab->_records[slot];
+            if (record->key != 0 && record->sourceKey == sourceHash) {
+                [self removeEntryForHash:record->key];
+            }
+        }
+    }
+    dispatch_semaphore_signal(_lock);
+}
+
+- (void)removeAllImages {
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    for (ZLBitmapSlab *slab in _slabs) {
+        unlink(slab.path.fileSystemRepresentation);
+    }
+    [_slabs removeAllObjects];
+    [_entries removeAllObjects];
+    _totalLength = 0;
+    dispatch_semaphore_signal(_lock);
+}
+
+@end
@@ -0,0 +1,51 @@
+//
+//  ZLDiskCache.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/24.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// 有总大小和时间上限的磁盘缓存。文件按 key 的 64 位哈希放在两级分片目录中，
+/// 大小、最近访问时间、过期时间记在内存索引里并定期写回 path/index，判断是否存在不需要访问文件系统。
+/// 索引条目和文件的扩展属性都记着完整 key 的 SHA-256，哈希碰撞的两个 key 互相覆盖文件，但不会读到对方的数据
+@interface ZLDiskCache : NSObject
+
+@property (nonatomic, copy, readonly) NSString *path;
+
+/// 总大小上限，超过时从最久未访问的开始删除
+@property (nonatomic, assign) unsigned long long byteLimit;
+
+/// 超过这么久没有访问的文件会被删除，0 表示不限
+@property (nonatomic, assign) NSTimeInterval ageLimit;
+
+- (instancetype)initWithPath:(NSString *)path
+                   byteLimit:(unsigned long long)byteLimit
+                    ageLimit:(NSTimeInterval)ageLimit;
+
+/// 只查内存索引
+- (BOOL)containsDataForKey:(NSString *)key;
+
+/// 通过 mmap 读取，文件被删除或替换后返回的数据依然有效
+- (nullable NSData *)dataForKey:(NSString *)key;
+
+- (void)setData:(NSData *)data forKey:(NSString *)key;
+
+/// expirationDate 之后视为不存在
+- (void)setData:(NSData *)data forKey:(NSString *)key expirationDate:(nullable NSDate *)expirationDate;
+
+/// key 对应的文件路径，所在的分片目录已创建；在外部写入（只能整体替换，不能原地修改）后调用 fileDidChangeForKey:
+- (NSString *)filePathForKey:(NSString *)key;
+
+- (void)fileDidChangeForKey:(NSString *)key;
+
+- (void)removeDataForKey:(NSString *)key;
+
+- (void)removeAllData;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,407 @@
+//
+//  ZLDiskCache.m
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/24.
+//
+
+#import "ZLDiskCache.h"
+#import "ZLDiskCacheIndex.h"
+#import <CommonCrypto/CommonDigest.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <sys/xattr.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+/// 索引有改动后延迟写回，合并短时间内的多次修改
+static int64_t const ZLDiskCacheIndexSaveDelay = 2 * NSEC_PER_SEC;
+
+static NSString * const ZLDiskCacheIndexFileName = @"index";
+
+/// 每个缓存文件的扩展属性里存一份 key 的摘要：读取时核对打开的文件，索引丢失后重建时恢复条目的 keyDigest
+static const char * const ZLDiskCacheKeyDigestAttribute = "com.richie.zlnetworking.keydigest";
+
+static inline uint64_t ZLDiskCacheHashForKey(NSString *key) {
+    const char *bytes = key.UTF8String;
+    return ZLDiskCacheKeyHash(bytes, bytes ? strlen(bytes) : 0);
+}
+
+/// 放在结构体里才能被 block 捕获
+typedef struct ZLDiskCacheKeyDigest {
+    uint8_t bytes[ZLDiskCacheKeyDigestLength];
+} ZLDiskCacheKeyDigest;
+
+/// 文件名和索引只用 64 位哈希，不同的 key 可能碰撞，需要用完整 key 的 SHA-256 区分
+static inline ZLDiskCacheKeyDigest ZLDiskCacheDigestForKey(NSString *key) {
+    ZLDiskCacheKeyDigest digest;
+    const char *bytes = key.UTF8String;
+    CC_SHA256(bytes, (CC_LONG)(bytes ? strlen(bytes) : 0), digest.bytes);
+    return digest;
+}
+
+static inline BOOL ZLDiskCacheSetFileDigest(NSString *filePath, const ZLDiskCacheKeyDigest *digest) {
+    return setxattr(filePath.fileSystemRepresentation, ZLDiskCacheKeyDigestAttribute, digest->bytes, ZLDiskCacheKeyDigestLength, 0, 0) == 0;
+}
+
+@implementation ZLDiskCache {
+    dispatch_semaphore_t _lock;
+    ZLDiskCacheIndex *_index;
+
+    /// 文件的写入和删除都在这个串行队列上，保证同一个 key 的操作按顺序执行
+    dispatch_queue_t _ioQueue;
+    BOOL _indexSaveScheduled;
+}
+
+- (instancetype)initWithPath:(NSString *)path
+                   byteLimit:(unsigned long long)byteLimit
+                    ageLimit:(NSTimeInterval)ageLimit {
+    if (self = [super init]) {
+        _path = [path copy];
+        _byteLimit = byteLimit;
+        _ageLimit = ageLimit;
+        _lock = dispatch_semaphore_create(1);
+        _index = ZLDiskCacheIndexCreate();
+        _ioQueue = dispatch_queue_create("com.richie.zlnetworking.diskcache", DISPATCH_QUEUE_SERIAL);
+
+        BOOL isDir = NO;
+        if (![[NSFileManager defaultManager] fileExistsAtPath:_path isDirectory:&isDir] || !isDir) {
+            if (![[NSFileManager defaultManager] createDirectoryAtPath:_path withIntermediateDirectories:YES attributes:nil error:nil]) {
+                NSLog(@"file system error");
+            }
+        }
+
+        NSData *indexData = [NSData dataWithContentsOfFile:[_path stringByAppendingPathComponent:ZLDiskCacheIndexFileName]];
+        if (indexData == nil || !ZLDiskCacheIndexLoad(_index, indexData.bytes, indexData.length)) {
+            dispatch_async(_ioQueue, ^{
+                [self rebuildIndex];
+            });
+        } else {
+            [self trim];
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    ZLDiskCacheIndexDestroy(_index);
+}
+
+#pragma mark - paths
+
+static inline NSString * ZLDiskCacheFileName(uint64_t hash) {
+    return [NSString stringWithFormat:@"%016llx", hash];
+}
+
+/// path/ab/cd/abcd...
+- (NSString *)filePathForHash:(uint64_t)hash {
+    NSString *fileName = ZLDiskCacheFileName(hash);
+    return [[[_path stringByAppendingPathComponent:[fileName substringToIndex:2]]
+             stringByAppendingPathComponent:[fileName substringWithRange:NSMakeRange(2, 2)]]
+            stringByAppendingPathComponent:fileName];
+}
+
+- (NSString *)filePathForKey:(NSString *)key {
+    NSString *filePath = [self filePathForHash:ZLDiskCacheHashForKey(key)];
+    // 排在之前的 removeAllData 之后创建，避免目录刚建好就被删掉
+    dispatch_sync(_ioQueue, ^{
+        [[NSFileManager defaultManager] createDirectoryAtPath:filePath.stringByDeletingLastPathComponent withIntermediateDirectories:YES attributes:nil error:nil];
+    });
+    return filePath;
+}
+
+#pragma mark - index
+
+/// 索引文件丢失或损坏时扫描分片目录重建，顺便删掉旧版本直接放在根目录下的缓存文件。
+/// 没有 key 摘要属性的文件（旧版本写入的）无法确认属于哪个 key，也一并删掉
+- (void)rebuildIndex {
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSArray *resourceKeys = @[NSURLIsDirectoryKey, NSURLFileSizeKey, NSURLContentModificationDateKey];
+    NSURL *rootURL = [NSURL fileURLWithPath:_path isDirectory:YES];
+    NSArray<NSURL *> *rootContents = [fileManager contentsOfDirectoryAtURL:rootURL includingPropertiesForKeys:resourceKeys options:0 error:NULL];
+    for (NSURL *fileURL in rootContents) {
+        NSNumber *isDirectory = nil;
+        [fileURL getResourceValue:&isDirectory forKey:NSURLIsDirectoryKey error:NULL];
+        if (!isDirectory.boolValue && ![fileURL.lastPathComponent isEqualToString:ZLDiskCacheIndexFileName]) {
+            [fileManager removeItemAtURL:fileURL error:NULL];
+        }
+    }
+
+    NSDirectoryEnumerator<NSURL *> *enumerator = [fileManager enumeratorAtURL:rootURL includingPropertiesForKeys:resourceKeys options:NSDirectoryEnumerationSkipsHiddenFiles errorHandler:nil];
+    NSMutableArray<NSDictionary *> *entries = [NSMutableArray array];
+    for (NSURL *fileURL in enumerator) {
+        NSDictionary *values = [fileURL resourceValuesForKeys:resourceKeys error:NULL];
+        NSString *fileName = fileURL.lastPathComponent;
+        if ([values[NSURLIsDirectoryKey] boolValue] || enumerator.level != 3 || fileName.length != 16) {
+            continue;
+        }
+        unsigned long long hash = strtoull(fileName.UTF8String, NULL, 16);
+        if (hash == 0) {
+            continue;
+        }
+        ZLDiskCacheKeyDigest digest;
+        if (getxattr(fileURL.fileSystemRepresentation, ZLDiskCacheKeyDigestAttribute, digest.bytes, ZLDiskCacheKeyDigestLength, 0, 0) != ZLDiskCacheKeyDigestLength) {
+            [fileManager removeItemAtURL:fileURL error:NULL];
+            continue;
+        }
+        [entries addObject:@{@"hash": @(hash), @"digest": [NSData dataWithBytes:digest.bytes length:ZLDiskCacheKeyDigestLength],
+                             @"size": values[NSURLFileSizeKey] ?: @0, @"date": values[NSURLContentModificationDateKey] ?: [NSDate distantPast]}];
+    }
+    // 按修改时间从旧到新插入，得到近似的 LRU 顺序
+    [entries sortUsingComparator:^NSComparisonResult(NSDictionary *obj1, NSDictionary *obj2) {
+        return [obj1[@"date"] compare:obj2[@"date"]];
+    }];
+
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    for (NSDictionary *entry in entries) {
+        if (ZLDiskCacheIndexLookup(_index, [entry[@"hash"] unsignedLongLongValue]) == NULL) {
+            ZLDiskCacheIndexSet(_index, [entry[@"hash"] unsignedLongLongValue], [entry[@"size"] unsignedLongLongValue], [entry[@"date"] timeIntervalSinceReferenceDate], 0, [entry[@"digest"] bytes]);
+        }
+    }
+    dispatch_semaphore_signal(_lock);
+
+    [self trim];
+    [self scheduleIndexSave];
+}
+
+- (void)scheduleIndexSave {
+    dispatch_async(_ioQueue, ^{
+        if (self->_indexSaveScheduled) {
+            return;
+        }
+        self->_indexSaveScheduled = YES;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, ZLDiskCacheIndexSaveDelay), self->_ioQueue, ^{
+            self->_indexSaveScheduled = NO;
+            [self saveIndex];
+        });
+    });
+}
+
+/// 在 _ioQueue 上调用
+- (void)saveIndex {
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    size_t length = ZLDiskCacheIndexSerializedLength(_index);
+    uint8_t *buffer = malloc(length);
+    if (buffer != NULL) {
+        ZLDiskCacheIndexSerialize(_index, buffer);
+    }
+    dispatch_semaphore_signal(_lock);
+    if (buffer == NULL) {
+        return;
+    }
+    NSData *data = [NSData dataWithBytesNoCopy:buffer length:length freeWhenDone:YES];
+    [data writeToFile:[_path stringByAppendingPathComponent:ZLDiskCacheIndexFileName] atomically:YES];
+}
+
+/// 在 _ioQueue 上删除已从索引中移除的文件。移除之后同一个 key 可能又被写入，
+/// 写文件和更新索引在 _ioQueue 的同一个任务里完成，所以这里看到索引中有条目时文件一定是新的，不能删
+- (void)unlinkFilesForHashes:(NSArray<NSNumber *> *)hashes {
+    dispatch_async(_ioQueue, ^{
+        for (NSNumber *hash in hashes) {
+            dispatch_semaphore_wait(self->_lock, DISPATCH_TIME_FOREVER);
+            BOOL reinserted = ZLDiskCacheIndexLookup(self->_index, hash.unsignedLongLongValue) != NULL;
+            dispatch_semaphore_signal(self->_lock);
+            if (!reinserted) {
+                unlink([self filePathForHash:hash.unsignedLongLongValue].fileSystemRepresentation);
+            }
+        }
+    });
+}
+
+/// 先删过期太久未访问的，再按 LRU 删到 byteLimit 以内；索引立即更新，文件在 _ioQueue 上删除
+- (void)trim {
+    NSMutableArray<NSNumber *> *removedHashes = [NSMutableArray array];
+    double expiredTime = self.ageLimit > 0 ? [NSDate timeIntervalSinceReferenceDate] - self.ageLimit : -DBL_MAX;
+    unsigned long long byteLimit = self.byteLimit;
+
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    const ZLDiskCacheEntry *oldest = NULL;
+    while ((oldest = ZLDiskCacheIndexOldest(_index)) != NULL &&
+           (oldest->accessTime < expiredTime || ZLDiskCacheIndexTotalSize(_index) > byteLimit)) {
+        uint64_t hash = oldest->key;
+        [removedHashes addObject:@(hash)];
+        ZLDiskCacheIndexRemove(_index, hash);
+    }
+    dispatch_semaphore_signal(_lock);
+
+    if (removedHashes.count > 0) {
+        [self unlinkFilesForHashes:removedHashes];
+        [self scheduleIndexSave];
+    }
+}
+
+- (void)setByteLimit:(unsigned long long)byteLimit {
+    _byteLimit = byteLimit;
+    [self trim];
+}
+
+- (void)setAgeLimit:(NSTimeInterval)ageLimit {
+    _ageLimit = ageLimit;
+    [self trim];
+}
+
+#pragma mark - public
+
+/// 条目存在、属于这个 key 且没有过期
+- (BOOL)containsDataForHash:(uint64_t)hash digest:(const ZLDiskCacheKeyDigest *)digest {
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    const ZLDiskCacheEntry *entry = ZLDiskCacheIndexLookup(_index, hash);
+    BOOL contains = entry != NULL && memcmp(entry->keyDigest, digest->bytes, ZLDiskCacheKeyDigestLength) == 0 &&
+                    (entry->expiry == 0 || entry->expiry > [NSDate timeIntervalSinceReferenceDate]);
+    dispatch_semaphore_signal(_lock);
+    return contains;
+}
+
+- (BOOL)containsDataForKey:(NSString *)key {
+    if (key == nil) {
+        return NO;
+    }
+    ZLDiskCacheKeyDigest digest = ZLDiskCacheDigestForKey(key);
+    return [self containsDataForHash:ZLDiskCacheHashForKey(key) digest:&digest];
+}
+
+- (NSData *)dataForKey:(NSString *)key {
+    if (key == nil) {
+        return nil;
+    }
+    uint64_t hash = ZLDiskCacheHashForKey(key);
+    ZLDiskCacheKeyDigest digest = ZLDiskCacheDigestForKey(key);
+    if (![self containsDataForHash:hash digest:&digest]) {
+        return nil;
+    }
+    NSString *filePath = [self filePathForHash:hash];
+
+    NSData *data = nil;
+    BOOL foreign = NO;
+    int fd = open(filePath.fileSystemRepresentation, O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0) {
+        // 查过索引之后，哈希碰撞的另一个 key 可能已经替换了文件，再核对打开的这个文件
+        ZLDiskCacheKeyDigest fileDigest;
+        foreign = fgetxattr(fd, ZLDiskCacheKeyDigestAttribute, fileDigest.bytes, ZLDiskCacheKeyDigestLength, 0, 0) != ZLDiskCacheKeyDigestLength ||
+                  memcmp(fileDigest.bytes, digest.bytes, ZLDiskCacheKeyDigestLength) != 0;
+        if (foreign) {
+            // 不属于这个 key，也不能删
+        } else if (st.st_size == 0) {
+            data = [NSData data];
+        } else {
+            // 缓存文件只会被整体替换或删除，不会被截断，映射期间访问是安全的
+            void *bytes = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (bytes != MAP_FAILED) {
+                data = [[NSData alloc] initWithBytesNoCopy:bytes length:(NSUInteger)st.st_size deallocator:^(void *mappedBytes, NSUInteger length) {
+                    munmap(mappedBytes, length);
+                }];
+            }
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (foreign) {
+        return nil;
+    }
+
+    if (data == nil) {
+        // 文件已被系统清理，索引随之失效
+        [self removeDataForKey:key];
+        return nil;
+    }
+
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    ZLDiskCacheIndexTouch(_index, hash, [NSDate timeIntervalSinceReferenceDate]);
+    dispatch_semaphore_signal(_lock);
+    [self scheduleIndexSave];
+    return data;
+}
+
+- (void)setData:(NSData *)data forKey:(NSString *)key {
+    [self setData:data forKey:key expirationDate:nil];
+}
+
+- (void)setData:(NSData *)data forKey:(NSString *)key expirationDate:(NSDate *)expirationDate {
+    if (data == nil || key == nil) {
+        return;
+    }
+    uint64_t hash = ZLDiskCacheHashForKey(key);
+    ZLDiskCacheKeyDigest digest = ZLDiskCacheDigestForKey(key);
+    NSString *filePath = [self filePathForKey:key];
+    double expiry = expirationDate ? expirationDate.timeIntervalSinceReferenceDate : 0;
+    __block BOOL written = NO;
+    // 写文件和更新索引放在同一个任务里，见 unlinkFilesForHashes:
+    dispatch_sync(_ioQueue, ^{
+        written = [data writeToFile:filePath atomically:YES];
+        if (written && !ZLDiskCacheSetFileDigest(filePath, &digest)) {
+            unlink(filePath.fileSystemRepresentation);
+            written = NO;
+        }
+        if (written) {
+            dispatch_semaphore_wait(self->_lock, DISPATCH_TIME_FOREVER);
+            ZLDiskCacheIndexSet(self->_index, hash, data.length, [NSDate timeIntervalSinceReferenceDate], expiry, digest.bytes);
+            dispatch_semaphore_signal(self->_lock);
+        }
+    });
+    if (!written) {
+        return;
+    }
+    [self trim];
+    [self scheduleIndexSave];
+}
+
+- (void)fileDidChangeForKey:(NSString *)key {
+    if (key == nil) {
+        return;
+    }
+    uint64_t hash = ZLDiskCacheHashForKey(key);
+    ZLDiskCacheKeyDigest digest = ZLDiskCacheDigestForKey(key);
+    NSString *filePath = [self filePathForHash:hash];
+    __block BOOL exists = NO;
+    dispatch_sync(_ioQueue, ^{
+        struct stat st;
+        exists = stat(filePath.fileSystemRepresentation, &st) == 0 && ZLDiskCacheSetFileDigest(filePath, &digest);
+        if (exists) {
+            dispatch_semaphore_wait(self->_lock, DISPATCH_TIME_FOREVER);
+            ZLDiskCacheIndexSet(self->_index, hash, (uint64_t)st.st_size, [NSDate timeIntervalSinceReferenceDate], 0, digest.bytes);
+            dispatch_semaphore_signal(self->_lock);
+        }
+    });
+    if (!exists) {
+        [self removeDataForKey:key];
+        return;
+    }
+    [self trim];
+    [self scheduleIndexSave];
+}
+
+- (void)removeDataForKey:(NSString *)key {
+    if (key == nil) {
+        return;
+    }
+    uint64_t hash = ZLDiskCacheHashForKey(key);
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    ZLDiskCacheIndexRemove(_index, hash);
+    dispatch_semaphore_signal(_lock);
+
+    [self unlinkFilesForHashes:@[@(hash)]];
+    [self scheduleIndexSave];
+}
+
+- (void)removeAllData {
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    ZLDiskCacheIndexRemoveAll(_index);
+    dispatch_semaphore_signal(_lock);
+
+    dispatch_async(_ioQueue, ^{
+        // 清空索引之后、这里执行之前写入的条目，文件也会被下面删掉
+        dispatch_semaphore_wait(self->_lock, DISPATCH_TIME_FOREVER);
+        ZLDiskCacheIndexRemoveAll(self->_index);
+        dispatch_semaphore_signal(self->_lock);
+
+        NSArray *contents = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:self->_path error:NULL];
+        for (NSString *fileName in contents) {
+            [[NSFileManager defaultManager] removeItemAtPath:[self->_path stringByAppendingPathComponent:fileName] error:NULL];
+        }
+        [self saveIndex];
+    });
+}
+
+@end
@@ -0,0 +1,317 @@
+//
+//  ZLDiskCacheIndex.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/24.
+//
+
+#include "ZLDiskCacheIndex.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ZLDiskCacheIndexNil UINT32_MAX
+
+/// 序列化格式：魔数、版本、条目数，之后是按本机字节序排列的 ZLDiskCacheEntry
+static const uint32_t ZLDiskCacheIndexMagic = 0x43444c5a; // "ZLDC"
+static const uint32_t ZLDiskCacheIndexVersion = 2;    // 2：条目加上 keyDigest
+static const size_t ZLDiskCacheIndexHeaderLength = 12;
+
+typedef struct ZLDiskCacheNode {
+    ZLDiskCacheEntry entry;
+    uint32_t prev;
+    uint32_t next;
+} ZLDiskCacheNode;
+
+struct ZLDiskCacheIndex {
+    ZLDiskCacheNode *nodes;
+    uint32_t nodeCapacity;
+    uint32_t nodeCount;         // nodes 中用过的数量，包括空闲链表中的
+    uint32_t freeList;          // 以 next 串起来的空闲节点
+
+    uint32_t *slots;            // 节点下标 + 1，0 表示空
+    uint32_t slotMask;
+
+    uint32_t head;              // 最近访问
+    uint32_t tail;              // 最久未访问
+    size_t count;
+    uint64_t totalSize;
+};
+
+uint64_t ZLDiskCacheKeyHash(const void *bytes, size_t length) {
+    const uint8_t *p = bytes;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash ? hash : 1;
+}
+
+/// FNV 的低位分布不够均匀，取槽位前再混合一次
+static inline uint32_t ZLDiskCacheSlotHash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (uint32_t)key;
+}
+
+ZLDiskCacheIndex *ZLDiskCacheIndexCreate(void) {
+    ZLDiskCacheIndex *index = calloc(1, sizeof(ZLDiskCacheIndex));
+    if (index == NULL) {
+        return NULL;
+    }
+    index->slots = calloc(64, sizeof(uint32_t));
+    if (index->slots == NULL) {
+        free(index);
+        return NULL;
+    }
+    index->slotMask = 63;
+    index->freeList = ZLDiskCacheIndexNil;
+    index->head = ZLDiskCacheIndexNil;
+    index->tail = ZLDiskCacheIndexNil;
+    return index;
+}
+
+void ZLDiskCacheIndexDestroy(ZLDiskCacheIndex *index) {
+    if (index == NULL) {
+        return;
+    }
+    free(index->nodes);
+    free(index->slots);
+    free(index);
+}
+
+/// 返回 key 所在的槽位，不存在时返回应插入的空槽位
+static inline uint32_t ZLDiskCacheFindSlot(const ZLDiskCacheIndex *index, uint64_t key) {
+    uint32_t slot = ZLDiskCacheSlotHash(key) & index->slotMask;
+    while (index->slots[slot] != 0 && index->nodes[index->slots[slot] - 1].entry.key != key) {
+        slot = (slot + 1) & index->slotMask;
+    }
+    return slot;
+}
+
+static bool ZLDiskCacheGrowSlots(ZLDiskCacheIndex *index) {
+    uint32_t capacity = (index->slotMask + 1) * 2;
+    if (capacity == 0) {
+        return false;
+    }
+    uint32_t *slots = calloc(capacity, sizeof(uint32_t));
+    if (slots == NULL) {
+        return false;
+    }
+    uint32_t *oldSlots = index->slots;
+    uint32_t oldCapacity = index->slotMask + 1;
+    index->slots = slots;
+    index->slotMask = capacity - 1;
+    for (uint32_t i = 0; i < oldCapacity; i++) {
+        if (oldSlots[i] != 0) {
+            uint32_t slot = ZLDiskCacheFindSlot(index, index->nodes[oldSlots[i] - 1].entry.key);
+            slots[slot] = oldSlots[i];
+        }
+    }
+    free(oldSlots);
+    return true;
+}
+
+static uint32_t ZLDiskCacheAllocNode(ZLDiskCacheIndex *index) {
+    if (index->freeList != ZLDiskCacheIndexNil) {
+        uint32_t node = index->freeList;
+        index->freeList = index->nodes[node].next;
+        return node;
+    }
+    if (index->nodeCount == index->nodeCapacity) {
+        uint32_t capacity = index->nodeCapacity ? index->nodeCapacity * 2 : 64;
+        if (capacity <= index->nodeCapacity || capacity >= ZLDiskCacheIndexNil) {
+            return ZLDiskCacheIndexNil;
+        }
+        ZLDiskCacheNode *nodes = realloc(index->nodes, (size_t)capacity * sizeof(ZLDiskCacheNode));
+        if (nodes == NULL) {
+            return ZLDiskCacheIndexNil;
+        }
+        index->nodes = nodes;
+        index->nodeCapacity = capacity;
+    }
+    return index->nodeCount++;
+}
+
+static inline void ZLDiskCacheUnlink(ZLDiskCacheIndex *index, uint32_t node) {
+    ZLDiskCacheNode *n = &index->nodes[node];
+    if (n->prev != ZLDiskCacheIndexNil) {
+        index->nodes[n->prev].next = n->next;
+    } else {
+        index->head = n->next;
+    }
+    if (n->next != ZLDiskCacheIndexNil) {
+        index->nodes[n->next].prev = n->prev;
+    } else {
+        index->tail = n->prev;
+    }
+}
+
+static inline void ZLDiskCacheLinkHead(ZLDiskCacheIndex *index, uint32_t node) {
+    ZLDiskCacheNode *n = &index->nodes[node];
+    n->prev = ZLDiskCacheIndexNil;
+    n->next = index->head;
+    if (index->head != ZLDiskCacheIndexNil) {
+        index->nodes[index->head].prev = node;
+    }
+    index->head = node;
+    if (index->tail == ZLDiskCacheIndexNil) {
+        index->tail = node;
+    }
+}
+
+const ZLDiskCacheEntry *ZLDiskCacheIndexLookup(const ZLDiskCacheIndex *index, uint64_t key) {
+    uint32_t slot = ZLDiskCacheFindSlot(index, key);
+    return index->slots[slot] ? &index->nodes[index->slots[slot] - 1].entry : NULL;
+}
+
+bool ZLDiskCacheIndexTouch(ZLDiskCacheIndex *index, uint64_t key, double accessTime) {
+    uint32_t slot = ZLDiskCacheFindSlot(index, key);
+    if (index->slots[slot] == 0) {
+        return false;
+    }
+    uint32_t node = index->slots[slot] - 1;
+    index->nodes[node].entry.accessTime = accessTime;
+    if (index->head != node) {
+        ZLDiskCacheUnlink(index, node);
+        ZLDiskCacheLinkHead(index, node);
+    }
+    return true;
+}
+
+bool ZLDiskCacheIndexSet(ZLDiskCacheIndex *index, uint64_t key, uint64_t size, double accessTime, double expiry, const uint8_t *keyDigest) {
+    uint32_t slot = ZLDiskCacheFindSlot(index, key);
+    uint32_t node;
+    if (index->slots[slot] != 0) {
+        node = index->slots[slot] - 1;
+        index->totalSize -= index->nodes[node].entry.size;
+        ZLDiskCacheUnlink(index, node);
+    } else {
+        // 负载因子不超过 1/2
+        if ((index->count + 1) * 2 > (size_t)index->slotMask + 1) {
+            if (!ZLDiskCacheGrowSlots(index)) {
+                return false;
+            }
+            slot = ZLDiskCacheFindSlot(index, key);
+        }
+        node = ZLDiskCacheAllocNode(index);
+        if (node == ZLDiskCacheIndexNil) {
+            return false;
+        }
+        index->slots[slot] = node + 1;
+        index->count++;
+    }
+
+    ZLDiskCacheEntry *entry = &index->nodes[node].entry;
+    entry->key = key;
+    entry->size = size;
+    entry->accessTime = accessTime;
+    entry->expiry = expiry;
+    if (keyDigest != NULL) {
+        memcpy(entry->keyDigest, keyDigest, ZLDiskCacheKeyDigestLength);
+    } else {
+        memset(entry->keyDigest, 0, ZLDiskCacheKeyDigestLength);
+    }
+    index->totalSize += size;
+    ZLDiskCacheLinkHead(index, node);
+    return true;
+}
+
+bool ZLDiskCacheIndexRemove(ZLDiskCacheIndex *index, uint64_t key) {
+    uint32_t slot = ZLDiskCacheFindSlot(index, key);
+    if (index->slots[slot] == 0) {
+        return false;
+    }
+    uint32_t node = index->slots[slot] - 1;
+    index->totalSize -= index->nodes[node].entry.size;
+    index->count--;
+    ZLDiskCacheUnlink(index, node);
+    index->nodes[node].next = index->freeList;
+    index->freeList = node;
+
+    // 线性探测的删除：把后面探测链上的元素前移，不留墓碑
+    uint32_t hole = slot;
+    uint32_t next = slot;
+    for (;;) {
+        next = (next + 1) & index->slotMask;
+        if (index->slots[next] == 0) {
+            break;
+        }
+        uint32_t home = ZLDiskCacheSlotHash(index->nodes[index->slots[next] - 1].entry.key) & index->slotMask;
+        bool movable = hole <= next ? (home <= hole || home > next) : (home <= hole && home > next);
+        if (movable) {
+            index->slots[hole] = index->slots[next];
+            hole = next;
+        }
+    }
+    index->slots[hole] = 0;
+    return true;
+}
+
+void ZLDiskCacheIndexRemoveAll(ZLDiskCacheIndex *index) {
+    memset(index->slots, 0, ((size_t)index->slotMask + 1) * sizeof(uint32_t));
+    index->nodeCount = 0;
+    index->freeList = ZLDiskCacheIndexNil;
+    index->head = ZLDiskCacheIndexNil;
+    index->tail = ZLDiskCacheIndexNil;
+    index->count = 0;
+    index->totalSize = 0;
+}
+
+const ZLDiskCacheEntry *ZLDiskCacheIndexOldest(const ZLDiskCacheIndex *index) {
+    return index->tail != ZLDiskCacheIndexNil ? &index->nodes[index->tail].entry : NULL;
+}
+
+size_t ZLDiskCacheIndexCount(const ZLDiskCacheIndex *index) {
+    return index->count;
+}
+
+uint64_t ZLDiskCacheIndexTotalSize(const ZLDiskCacheIndex *index) {
+    return index->totalSize;
+}
+
+size_t ZLDiskCacheIndexSerializedLength(const ZLDiskCacheIndex *index) {
+    return ZLDiskCacheIndexHeaderLength + index->count * sizeof(ZLDiskCacheEntry);
+}
+
+void ZLDiskCacheIndexSerialize(const ZLDiskCacheIndex *index, uint8_t *buffer) {
+    uint32_t count = (uint32_t)index->count;
+    memcpy(buffer, &ZLDiskCacheIndexMagic, 4);
+    memcpy(buffer + 4, &ZLDiskCacheIndexVersion, 4);
+    memcpy(buffer + 8, &count, 4);
+    uint8_t *p = buffer + ZLDiskCacheIndexHeaderLength;
+    for (uint32_t node = index->tail; node != ZLDiskCacheIndexNil; node = index->nodes[node].prev) {
+        memcpy(p, &index->nodes[node].entry, sizeof(ZLDiskCacheEntry));
+        p += sizeof(ZLDiskCacheEntry);
+    }
+}
+
+bool ZLDiskCacheIndexLoad(ZLDiskCacheIndex *index, const uint8_t *bytes, size_t length) {
+    ZLDiskCacheIndexRemoveAll(index);
+    if (length < ZLDiskCacheIndexHeaderLength) {
+        return false;
+    }
+    uint32_t magic, version, count;
+    memcpy(&magic, bytes, 4);
+    memcpy(&version, bytes + 4, 4);
+    memcpy(&count, bytes + 8, 4);
+    if (magic != ZLDiskCacheIndexMagic || version != ZLDiskCacheIndexVersion ||
+        (length - ZLDiskCacheIndexHeaderLength) / sizeof(ZLDiskCacheEntry) != count ||
+        (length - ZLDiskCacheIndexHeaderLength) % sizeof(ZLDiskCacheEntry) != 0) {
+        return false;
+    }
+
+    const uint8_t *p = bytes + ZLDiskCacheIndexHeaderLength;
+    for (uint32_t i = 0; i < count; i++) {
+        ZLDiskCacheEntry entry;
+        memcpy(&entry, p, sizeof(ZLDiskCacheEntry));
+        p += sizeof(ZLDiskCacheEntry);
+        if (entry.key == 0 || !ZLDiskCacheIndexSet(index, entry.key, entry.size, entry.accessTime, entry.expiry, entry.keyDigest)) {
+            ZLDiskCacheIndexRemoveAll(index);
+            return false;
+        }
+    }
+    return true;
+}
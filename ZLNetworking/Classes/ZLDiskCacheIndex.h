@@ -0,0 +1,73 @@
+//
+//  ZLDiskCacheIndex.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/24.
+//
+
+#ifndef ZLDiskCacheIndex_h
+#define ZLDiskCacheIndex_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ZLDiskCacheKeyDigestLength 32
+
+/// 磁盘缓存的内存索引：64 位 key 哈希 -> 大小、最近访问时间、过期时间、完整 key 的摘要。
+/// 开放寻址哈希表 + 按访问时间排列的双向链表，查找、更新、删除、取最久未访问的条目都是 O(1)；不加锁，由调用方串行访问。
+/// 64 位哈希只用来定位条目，不同的 key 可能碰撞，调用方读取前用 keyDigest 确认条目属于这个 key
+typedef struct ZLDiskCacheEntry {
+    uint64_t key;
+    uint64_t size;
+    double accessTime;
+    double expiry;      // 0 表示不过期
+    uint8_t keyDigest[ZLDiskCacheKeyDigestLength];  // 完整 key 的 SHA-256，由调用方计算
+} ZLDiskCacheEntry;
+
+typedef struct ZLDiskCacheIndex ZLDiskCacheIndex;
+
+ZLDiskCacheIndex *ZLDiskCacheIndexCreate(void);
+
+void ZLDiskCacheIndexDestroy(ZLDiskCacheIndex *index);
+
+/// 缓存 key 的 64 位 FNV-1a 哈希，不会返回 0
+uint64_t ZLDiskCacheKeyHash(const void *bytes, size_t length);
+
+/// 返回的指针在下一次修改索引前有效
+const ZLDiskCacheEntry *ZLDiskCacheIndexLookup(const ZLDiskCacheIndex *index, uint64_t key);
+
+/// 更新访问时间并移到最近访问的一端，key 不存在时返回 false
+bool ZLDiskCacheIndexTouch(ZLDiskCacheIndex *index, uint64_t key, double accessTime);
+
+/// 插入或覆盖，并移到最近访问的一端；keyDigest 为 NULL 时记为全 0。内存不足时返回 false
+bool ZLDiskCacheIndexSet(ZLDiskCacheIndex *index, uint64_t key, uint64_t size, double accessTime, double expiry, const uint8_t *keyDigest);
+
+bool ZLDiskCacheIndexRemove(ZLDiskCacheIndex *index, uint64_t key);
+
+void ZLDiskCacheIndexRemoveAll(ZLDiskCacheIndex *index);
+
+/// 最久未访问的条目，索引为空时返回 NULL
+const ZLDiskCacheEntry *ZLDiskCacheIndexOldest(const ZLDiskCacheIndex *index);
+
+size_t ZLDiskCacheIndexCount(const ZLDiskCacheIndex *index);
+
+uint64_t ZLDiskCacheIndexTotalSize(const ZLDiskCacheIndex *index);
+
+/// 序列化为紧凑的二进制格式，条目按访问时间从旧到新排列，加载后保持原来的 LRU 顺序
+size_t ZLDiskCacheIndexSerializedLength(const ZLDiskCacheIndex *index);
+
+void ZLDiskCacheIndexSerialize(const ZLDiskCacheIndex *index, uint8_t *buffer);
+
+/// 清空后从 bytes 加载，格式不对时返回 false 且索引为空
+bool ZLDiskCacheIndexLoad(ZLDiskCacheIndex *index, const uint8_t *bytes, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLDiskCacheIndex_h */
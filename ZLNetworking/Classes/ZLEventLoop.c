@@ -0,0 +1,515 @@
+//
+//  ZLEventLoop.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLEventLoop.h"
+#include "ZLTimerWheel.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+#include <sys/event.h>
+#else
+#error "ZLEventLoop needs epoll or kqueue"
+#endif
+
+#define ZLEventLoopTickNanoseconds ((uint64_t)ZLEventLoopTickMilliseconds * 1000000)
+#define ZLEventLoopMaxEvents 64
+
+// 低 32 位是 fd，高 32 位是监听时的代数：fd 被移除后再复用，旧事件对不上代数就丢弃
+#define ZLEventLoopWakeToken UINT64_MAX
+#define ZLEventLoopTimerToken (UINT64_MAX - 1)
+
+typedef struct ZLEventLoopWatcher {
+    ZLEventLoopCallback callback;
+    void *info;
+    uint32_t generation;
+} ZLEventLoopWatcher;
+
+typedef struct ZLEventLoopItem {
+    ZLEventLoopTask task;
+    void *info;
+} ZLEventLoopItem;
+
+// 未触发的定时器串成双向链表，销毁时逐个释放
+typedef struct ZLEventLoopTimer {
+    ZLEventLoopTask task;
+    void *info;
+    struct ZLEventLoopTimer *prev;
+    struct ZLEventLoopTimer *next;
+} ZLEventLoopTimer;
+
+struct ZLEventLoop {
+    int backend;
+#if defined(__linux__)
+    int wakeFD;
+    int timerFD;
+#endif
+
+    ZLEventLoopWatcher *watchers;   // 以 fd 为下标
+    size_t watcherCapacity;
+
+    // 跨线程投递的任务，执行时整体换到 running 里
+    pthread_mutex_t lock;
+    ZLEventLoopItem *pending;
+    size_t pendingCount;
+    size_t pendingCapacity;
+    ZLEventLoopItem *running;
+    size_t runningCapacity;
+    bool wakePending;
+
+    ZLTimerWheel *timers;
+    ZLEventLoopTimer *timerList;
+    uint64_t armedTick;
+
+    atomic_bool stopped;
+    _Atomic uint64_t wakeupCount;
+    _Atomic uint64_t busyNanoseconds;
+    _Atomic uint64_t maxBusyNanoseconds;
+    atomic_size_t watchCount;
+};
+
+static uint64_t ZLEventLoopNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static void ZLEventLoopWake(ZLEventLoop *loop) {
+#if defined(__linux__)
+    uint64_t value = 1;
+    ssize_t written;
+    do {
+        written = write(loop->wakeFD, &value, sizeof(value));
+    } while (written < 0 && errno == EINTR);
+#else
+    struct kevent change;
+    EV_SET(&change, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, (void *)(uintptr_t)ZLEventLoopWakeToken);
+    kevent(loop->backend, &change, 1, NULL, 0, NULL);
+#endif
+}
+
+/* create */
+
+ZLEventLoop *ZLEventLoopCreate(void) {
+    ZLEventLoop *loop = calloc(1, sizeof(ZLEventLoop));
+    if (!loop) {
+        return NULL;
+    }
+    loop->backend = -1;
+#if defined(__linux__)
+    loop->wakeFD = -1;
+    loop->timerFD = -1;
+#endif
+    loop->armedTick = UINT64_MAX;
+    atomic_init(&loop->stopped, false);
+    atomic_init(&loop->wakeupCount, 0);
+    atomic_init(&loop->busyNanoseconds, 0);
+    atomic_init(&loop->maxBusyNanoseconds, 0);
+    atomic_init(&loop->watchCount, 0);
+    if (pthread_mutex_init(&loop->lock, NULL) != 0) {
+        free(loop);
+        return NULL;
+    }
+
+    loop->timers = ZLTimerWheelCreate(ZLEventLoopNow() / ZLEventLoopTickNanoseconds);
+    if (!loop->timers) {
+        ZLEventLoopDestroy(loop);
+        return NULL;
+    }
+
+#if defined(__linux__)
+    loop->backend = epoll_create1(EPOLL_CLOEXEC);
+    loop->wakeFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    loop->timerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (loop->backend < 0 || loop->wakeFD < 0 || loop->timerFD < 0) {
+        ZLEventLoopDestroy(loop);
+        return NULL;
+    }
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = ZLEventLoopWakeToken };
+    struct epoll_event timerEvent = { .events = EPOLLIN, .data.u64 = ZLEventLoopTimerToken };
+    if (epoll_ctl(loop->backend, EPOLL_CTL_ADD, loop->wakeFD, &event) != 0 ||
+        epoll_ctl(loop->backend, EPOLL_CTL_ADD, loop->timerFD, &timerEvent) != 0) {
+        ZLEventLoopDestroy(loop);
+        return NULL;
+    }
+#else
+    loop->backend = kqueue();
+    if (loop->backend < 0) {
+        ZLEventLoopDestroy(loop);
+        return NULL;
+    }
+    struct kevent change;
+    EV_SET(&change, 0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, (void *)(uintptr_t)ZLEventLoopWakeToken);
+    if (kevent(loop->backend, &change, 1, NULL, 0, NULL) != 0) {
+        ZLEventLoopDestroy(loop);
+        return NULL;
+    }
+#endif
+    return loop;
+}
+
+void ZLEventLoopDestroy(ZLEventLoop *loop) {
+    if (!loop) {
+        return;
+    }
+    if (loop->backend >= 0) {
+        close(loop->backend);
+    }
+#if defined(__linux__)
+    if (loop->wakeFD >= 0) {
+        close(loop->wakeFD);
+    }
+    if (loop->timerFD >= 0) {
+        close(loop->timerFD);
+    }
+#endif
+    ZLEventLoopTimer *timer = loop->timerList;
+    while (timer) {
+        ZLEventLoopTimer *next = timer->next;
+        free(timer);
+        timer = next;
+    }
+    ZLTimerWheelDestroy(loop->timers);
+    pthread_mutex_destroy(&loop->lock);
+    free(loop->watchers);
+    free(loop->pending);
+    free(loop->running);
+    free(loop);
+}
+
+int ZLEventLoopFileDescriptor(const ZLEventLoop *loop) {
+    return loop->backend;
+}
+
+/* watch */
+
+bool ZLEventLoopWatch(ZLEventLoop *loop, int fd, ZLEventLoopCallback callback, void *info) {
+    if (fd < 0 || !callback) {
+        return false;
+    }
+    if ((size_t)fd >= loop->watcherCapacity) {
+        size_t capacity = loop->watcherCapacity ? loop->watcherCapacity : 64;
+        while (capacity <= (size_t)fd) {
+            capacity *= 2;
+        }
+        ZLEventLoopWatcher *watchers = realloc(loop->watchers, capacity * sizeof(ZLEventLoopWatcher));
+        if (!watchers) {
+            return false;
+        }
+        memset(watchers + loop->watcherCapacity, 0, (capacity - loop->watcherCapacity) * sizeof(ZLEventLoopWatcher));
+        loop->watchers = watchers;
+        loop->watcherCapacity = capacity;
+    }
+
+    ZLEventLoopWatcher *watcher = &loop->watchers[fd];
+    bool replacing = watcher->callback != NULL;
+    if (!replacing) {
+        uint64_t token = ((uint64_t)watcher->generation << 32) | (uint32_t)fd;
+#if defined(__linux__)
+        struct epoll_event event = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.u64 = token };
+        if (epoll_ctl(loop->backend, EPOLL_CTL_ADD, fd, &event) != 0) {
+            return false;
+        }
+#else
+        struct kevent changes[2];
+        EV_SET(&changes[0], fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, (void *)(uintptr_t)token);
+        EV_SET(&changes[1], fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, (void *)(uintptr_t)token);
+        if (kevent(loop->backend, changes, 2, NULL, 0, NULL) != 0) {
+            return false;
+        }
+#endif
+        atomic_fetch_add(&loop->watchCount, 1);
+    }
+    watcher->callback = callback;
+    watcher->info = info;
+    return true;
+}
+
+void ZLEventLoopUnwatch(ZLEventLoop *loop, int fd) {
+    if (fd < 0 || (size_t)fd >= loop->watcherCapacity || !loop->watchers[fd].callback) {
+        return;
+    }
+    ZLEventLoopWatcher *watcher = &loop->watchers[fd];
+#if defined(__linux__)
+    epoll_ctl(loop->backend, EPOLL_CTL_DEL, fd, NULL);
+#else
+    struct kevent changes[2];
+    EV_SET(&changes[0], fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    EV_SET(&changes[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+    kevent(loop->backend, changes, 2, NULL, 0, NULL);
+#endif
+    watcher->callback = NULL;
+    watcher->info = NULL;
+    watcher->generation++;
+    atomic_fetch_sub(&loop->watchCount, 1);
+}
+
+static void ZLEventLoopDispatch(ZLEventLoop *loop, uint64_t token, int events) {
+    uint32_t fd = (uint32_t)token;
+    if (fd >= loop->watcherCapacity) {
+        return;
+    }
+    ZLEventLoopWatcher *watcher = &loop->watchers[fd];
+    if (!watcher->callback || watcher->generation != (uint32_t)(token >> 32)) {
+        return;
+    }
+    watcher->callback(loop, (int)fd, events, watcher->info);
+}
+
+/* post */
+
+bool ZLEventLoopPost(ZLEventLoop *loop, ZLEventLoopTask task, void *info) {
+    pthread_mutex_lock(&loop->lock);
+    if (loop->pendingCount == loop->pendingCapacity) {
+        size_t capacity = loop->pendingCapacity ? loop->pendingCapacity * 2 : 16;
+        ZLEventLoopItem *pending = realloc(loop->pending, capacity * sizeof(ZLEventLoopItem));
+        if (!pending) {
+            pthread_mutex_unlock(&loop->lock);
+            return false;
+        }
+        loop->pending = pending;
+        loop->pendingCapacity = capacity;
+    }
+    loop->pending[loop->pendingCount++] = (ZLEventLoopItem){ task, info };
+    bool wake = !loop->wakePending;
+    loop->wakePending = true;
+    pthread_mutex_unlock(&loop->lock);
+
+    // 一轮只唤醒一次，循环线程取走任务前的投递共用这次唤醒
+    if (wake) {
+        ZLEventLoopWake(loop);
+    }
+    return true;
+}
+
+static size_t ZLEventLoopRunPosted(ZLEventLoop *loop) {
+    pthread_mutex_lock(&loop->lock);
+    size_t count = loop->pendingCount;
+    ZLEventLoopItem *items = loop->pending;
+    size_t capacity = loop->pendingCapacity;
+    loop->pending = loop->running;
+    loop->pendingCapacity = loop->runningCapacity;
+    loop->pendingCount = 0;
+    loop->running = items;
+    loop->runningCapacity = capacity;
+    loop->wakePending = false;
+    pthread_mutex_unlock(&loop->lock);
+
+    // 执行期间新投递的任务留到下一轮，唤醒信号让下一轮不会阻塞
+    for (size_t i = 0; i < count; i++) {
+        items[i].task(items[i].info);
+    }
+    return count;
+}
+
+/* timers */
+
+// 在下一个有定时器的 tick 让 backend 变为可读，外部的循环只监听 backend 也能按时处理定时器
+static void ZLEventLoopArmTimer(ZLEventLoop *loop) {
+    uint64_t next = ZLTimerWheelNextTick(loop->timers);
+    if (next == loop->armedTick) {
+        return;
+    }
+    loop->armedTick = next;
+#if defined(__linux__)
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (next != UINT64_MAX) {
+        uint64_t deadline = next * ZLEventLoopTickNanoseconds;
+        spec.it_value.tv_sec = (time_t)(deadline / 1000000000ULL);
+        spec.it_value.tv_nsec = (long)(deadline % 1000000000ULL);
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+            spec.it_value.tv_nsec = 1;
+        }
+    }
+    timerfd_settime(loop->timerFD, TFD_TIMER_ABSTIME, &spec, NULL);
+#else
+    struct kevent change;
+    if (next == UINT64_MAX) {
+        EV_SET(&change, 0, EVFILT_TIMER, EV_DELETE, 0, 0, NULL);
+    } else {
+        uint64_t deadline = next * ZLEventLoopTickNanoseconds;
+        uint64_t now = ZLEventLoopNow();
+        int64_t delay = deadline > now ? (int64_t)(deadline - now) : 0;
+        EV_SET(&change, 0, EVFILT_TIMER, EV_ADD | EV_ONESHOT, NOTE_NSECONDS, delay, (void *)(uintptr_t)ZLEventLoopTimerToken);
+    }
+    kevent(loop->backend, &change, 1, NULL, 0, NULL);
+#endif
+}
+
+static void ZLEventLoopFireTimer(void *context, void *info) {
+    ZLEventLoop *loop = info;
+    ZLEventLoopTimer *timer = context;
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        loop->timerList = timer->next;
+    }
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+    ZLEventLoopTask task = timer->task;
+    void *taskInfo = timer->info;
+    free(timer);
+    task(taskInfo);
+}
+
+uint64_t ZLEventLoopScheduleTimer(ZLEventLoop *loop, uint64_t delayMilliseconds, ZLEventLoopTask task, void *info) {
+    ZLEventLoopTimer *timer = calloc(1, sizeof(ZLEventLoopTimer));
+    if (!timer) {
+        return 0;
+    }
+    timer->task = task;
+    timer->info = info;
+
+    uint64_t nanoseconds = ZLEventLoopNow();
+    if (ZLTimerWheelCount(loop->timers) == 0) {
+        // 空闲的时间轮先追上当前时间，否则新定时器会落到很高的层
+        ZLTimerWheelAdvance(loop->timers, nanoseconds / ZLEventLoopTickNanoseconds, ZLEventLoopFireTimer, loop);
+    }
+    // 向上取整，定时器不会提前触发
+    uint64_t delay = delayMilliseconds > UINT64_MAX / 2000000 ? UINT64_MAX / 2 : delayMilliseconds * 1000000;
+    uint64_t deadline = (nanoseconds + delay + ZLEventLoopTickNanoseconds - 1) / ZLEventLoopTickNanoseconds;
+    uint64_t timerID = ZLTimerWheelSchedule(loop->timers, deadline, timer);
+    if (timerID == 0) {
+        free(timer);
+        return 0;
+    }
+    timer->next = loop->timerList;
+    if (timer->next) {
+        timer->next->prev = timer;
+    }
+    loop->timerList = timer;
+    ZLEventLoopArmTimer(loop);
+    return timerID;
+}
+
+bool ZLEventLoopCancelTimer(ZLEventLoop *loop, uint64_t timerID) {
+    void *context = NULL;
+    if (timerID == 0 || !ZLTimerWheelCancel(loop->timers, timerID, &context)) {
+        return false;
+    }
+    ZLEventLoopTimer *timer = context;
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        loop->timerList = timer->next;
+    }
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+    free(timer);
+    return true;
+}
+
+/* run */
+
+int ZLEventLoopRunOnce(ZLEventLoop *loop, int timeoutMilliseconds) {
+#if defined(__linux__)
+    struct epoll_event events[ZLEventLoopMaxEvents];
+    int count = epoll_wait(loop->backend, events, ZLEventLoopMaxEvents, timeoutMilliseconds);
+#else
+    struct kevent events[ZLEventLoopMaxEvents];
+    struct timespec timeout = { timeoutMilliseconds / 1000, (long)(timeoutMilliseconds % 1000) * 1000000 };
+    int count = kevent(loop->backend, NULL, 0, events, ZLEventLoopMaxEvents, timeoutMilliseconds < 0 ? NULL : &timeout);
+#endif
+    if (count < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+        count = 0;
+    }
+    uint64_t start = ZLEventLoopNow();
+    int handled = 0;
+
+    for (int i = 0; i < count; i++) {
+#if defined(__linux__)
+        uint64_t token = events[i].data.u64;
+        if (token == ZLEventLoopWakeToken) {
+            uint64_t value;
+            while (read(loop->wakeFD, &value, sizeof(value)) < 0 && errno == EINTR) {
+            }
+            continue;
+        }
+        if (token == ZLEventLoopTimerToken) {
+            uint64_t expirations;
+            while (read(loop->timerFD, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {
+            }
+            loop->armedTick = UINT64_MAX;
+            continue;
+        }
+        int ready = 0;
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            ready |= ZLEventLoopReadable;
+        }
+        if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+            ready |= ZLEventLoopWritable;
+        }
+#else
+        uint64_t token = (uint64_t)(uintptr_t)events[i].udata;
+        if (events[i].filter == EVFILT_USER) {
+            continue;
+        }
+        if (events[i].filter == EVFILT_TIMER) {
+            loop->armedTick = UINT64_MAX;
+            continue;
+        }
+        int ready = events[i].filter == EVFILT_READ ? ZLEventLoopReadable : ZLEventLoopWritable;
+        if (events[i].flags & EV_ERROR) {
+            ready = ZLEventLoopReadable | ZLEventLoopWritable;
+        }
+#endif
+        ZLEventLoopDispatch(loop, token, ready);
+        handled++;
+    }
+
+    handled += (int)ZLEventLoopRunPosted(loop);
+    if (ZLTimerWheelCount(loop->timers) > 0) {
+        handled += (int)ZLTimerWheelAdvance(loop->timers, ZLEventLoopNow() / ZLEventLoopTickNanoseconds, ZLEventLoopFireTimer, loop);
+    }
+    ZLEventLoopArmTimer(loop);
+
+    if (count > 0 || handled > 0) {
+        uint64_t busy = ZLEventLoopNow() - start;
+        atomic_fetch_add(&loop->wakeupCount, 1);
+        atomic_fetch_add(&loop->busyNanoseconds, busy);
+        uint64_t maxBusy = atomic_load(&loop->maxBusyNanoseconds);
+        while (busy > maxBusy && !atomic_compare_exchange_weak(&loop->maxBusyNanoseconds, &maxBusy, busy)) {
+        }
+    }
+    return handled;
+}
+
+void ZLEventLoopRun(ZLEventLoop *loop) {
+    do {
+        if (ZLEventLoopRunOnce(loop, -1) < 0) {
+            break;
+        }
+    } while (!atomic_exchange(&loop->stopped, false));
+}
+
+void ZLEventLoopStop(ZLEventLoop *loop) {
+    atomic_store(&loop->stopped, true);
+    ZLEventLoopWake(loop);
+}
+
+void ZLEventLoopGetMetrics(ZLEventLoop *loop, ZLEventLoopMetrics *metrics) {
+    metrics->wakeupCount = atomic_load(&loop->wakeupCount);
+    metrics->busyNanoseconds = atomic_load(&loop->busyNanoseconds);
+    metrics->maxBusyNanoseconds = atomic_load(&loop->maxBusyNanoseconds);
+    metrics->watchCount = atomic_load(&loop->watchCount);
+}
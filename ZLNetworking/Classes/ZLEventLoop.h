@@ -0,0 +1,87 @@
+//
+//  ZLEventLoop.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#ifndef ZLEventLoop_h
+#define ZLEventLoop_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 非阻塞 I/O 的事件循环：Linux 上用 epoll，Darwin 上用 kqueue，fd 一律边沿触发，
+/// 定时器用 ZLTimerWheel，tick 为 ZLEventLoopTickMilliseconds。
+///
+/// 可以用 ZLEventLoopRun 独占一个线程，也可以把 ZLEventLoopFileDescriptor 交给别的循环（例如 CFRunLoop）监听，
+/// 可读时调用 ZLEventLoopRunOnce(loop, 0)。除了注明可以跨线程调用的函数，其余只能在运行循环的线程上调用
+typedef struct ZLEventLoop ZLEventLoop;
+
+#define ZLEventLoopTickMilliseconds 10
+
+typedef enum ZLEventLoopEvents {
+    ZLEventLoopReadable = 1 << 0,
+    ZLEventLoopWritable = 1 << 1,
+} ZLEventLoopEvents;
+
+/// fd 就绪时在循环线程上回调。出错和对端关闭按可读、可写上报，由之后 read/write 的结果区分
+typedef void (*ZLEventLoopCallback)(ZLEventLoop *loop, int fd, int events, void *info);
+
+/// ZLEventLoopPost 和定时器的回调
+typedef void (*ZLEventLoopTask)(void *info);
+
+/// 从创建起累计；一次唤醒从等待返回算起，到下一次进入等待为止，最长的一次就是其他 fd 最多被耽误的时间
+typedef struct ZLEventLoopMetrics {
+    uint64_t wakeupCount;
+    uint64_t busyNanoseconds;
+    uint64_t maxBusyNanoseconds;
+    size_t watchCount;
+} ZLEventLoopMetrics;
+
+/// 失败返回 NULL
+ZLEventLoop *ZLEventLoopCreate(void);
+
+/// 不关闭仍在监听的 fd，未执行的任务和定时器直接丢弃
+void ZLEventLoopDestroy(ZLEventLoop *loop);
+
+/// epoll/kqueue 本身的 fd，有事件、投递的任务或需要处理的定时器时可读
+int ZLEventLoopFileDescriptor(const ZLEventLoop *loop);
+
+/// 同时监听可读和可写，fd 需要已经设为非阻塞；同一个 fd 重复添加时替换回调
+bool ZLEventLoopWatch(ZLEventLoop *loop, int fd, ZLEventLoopCallback callback, void *info);
+
+/// 移除后本轮已经取到的事件也不再回调，之后才能 close(fd)
+void ZLEventLoopUnwatch(ZLEventLoop *loop, int fd);
+
+/// 可以跨线程调用：在循环线程上按投递顺序执行 task
+bool ZLEventLoopPost(ZLEventLoop *loop, ZLEventLoopTask task, void *info);
+
+/// delay 毫秒后执行 task，向上取整到 tick；返回用于取消的标识，失败返回 0
+uint64_t ZLEventLoopScheduleTimer(ZLEventLoop *loop, uint64_t delayMilliseconds, ZLEventLoopTask task, void *info);
+
+/// 已触发或已取消的返回 false
+bool ZLEventLoopCancelTimer(ZLEventLoop *loop, uint64_t timerID);
+
+/// 最多等待 timeout 毫秒（负数一直等，0 不等），处理就绪的 fd、投递的任务和到期的定时器；返回处理的数量，出错返回 -1
+int ZLEventLoopRunOnce(ZLEventLoop *loop, int timeoutMilliseconds);
+
+/// 一直运行到 ZLEventLoopStop
+void ZLEventLoopRun(ZLEventLoop *loop);
+
+/// 可以跨线程调用：ZLEventLoopRun 处理完当前一轮后返回
+void ZLEventLoopStop(ZLEventLoop *loop);
+
+/// 可以跨线程调用
+void ZLEventLoopGetMetrics(ZLEventLoop *loop, ZLEventLoopMetrics *metrics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLEventLoop_h */
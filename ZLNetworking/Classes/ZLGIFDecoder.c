@@ -0,0 +1,574 @@
+//
+//  ZLGIFDecoder.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/27.
+//
+
+#include "ZLGIFDecoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ZLGIFMaxCodeCount 4096
+
+/// 画布像素数的上限，与 ZLAPNGDecoder 相同；超过时当作损坏，交给 ImageIO，避免文件头里的 65535x65535 申请 16GB 画布
+#define ZLGIFMaxPixels (1u << 26)
+
+enum {
+    ZLGIFDisposalNone = 0,
+    ZLGIFDisposalKeep = 1,
+    ZLGIFDisposalBackground = 2,
+    ZLGIFDisposalPrevious = 3,
+};
+
+enum {
+    ZLGIFStateHeader = 0,
+    ZLGIFStateBlocks,
+    ZLGIFStateDone,
+};
+
+typedef struct ZLGIFFrame {
+    ZLGIFRect rect;
+    uint32_t duration;
+    uint8_t disposal;
+    bool interlaced;
+    int16_t transparentIndex;   // -1 表示没有透明色
+    uint16_t colorCount;
+    size_t colorTableOffset;    // colorCount 为 0 时使用全局色表
+    size_t dataOffset;          // LZW 最小码长所在的位置
+} ZLGIFFrame;
+
+struct ZLGIFDecoder {
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+    size_t offset;              // 下一个待解析的块
+    int state;
+    bool corrupted;
+
+    uint32_t width;
+    uint32_t height;
+    uint16_t globalColorCount;
+    size_t globalColorTableOffset;
+    uint32_t loopCount;
+
+    // 最近一个图形控制扩展，作用于其后的第一帧
+    bool hasControl;
+    uint16_t delay;
+    uint8_t disposal;
+    int16_t transparentIndex;
+
+    ZLGIFFrame *frames;
+    size_t frameCount;
+    size_t frameCapacity;
+};
+
+struct ZLGIFCanvas {
+    uint32_t width;
+    uint32_t height;
+    uint32_t *pixels;
+    size_t nextFrame;
+
+    // 上一帧的区域和 disposal，在合成下一帧之前处理
+    ZLGIFRect previousRect;
+    uint8_t previousDisposal;
+    uint32_t *backup;           // disposal 为 3 的帧合成前保存的区域
+    size_t backupCapacity;
+
+    uint16_t prefix[ZLGIFMaxCodeCount];
+    uint8_t suffix[ZLGIFMaxCodeCount];
+    uint8_t stack[ZLGIFMaxCodeCount + 1];
+};
+
+static inline uint16_t ZLGIFReadUInt16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/// 跳过以 0 结尾的子块序列，数据不全时返回 false
+static bool ZLGIFSkipSubBlocks(const uint8_t *data, size_t length, size_t offset, size_t *end) {
+    while (offset < length) {
+        uint8_t size = data[offset];
+        if (size == 0) {
+            *end = offset + 1;
+            return true;
+        }
+        offset += 1 + size;
+    }
+    return false;
+}
+
+static bool ZLGIFParseHeader(ZLGIFDecoder *decoder) {
+    if (decoder->length < 13) {
+        return true;
+    }
+    const uint8_t *p = decoder->data;
+    if (memcmp(p, "GIF87a", 6) != 0 && memcmp(p, "GIF89a", 6) != 0) {
+        return false;
+    }
+    uint8_t flags = p[10];
+    size_t tableLength = (flags & 0x80) ? 3 * (2 << (flags & 0x07)) : 0;
+    if (decoder->length < 13 + tableLength) {
+        return true;
+    }
+
+    uint32_t width = ZLGIFReadUInt16(p + 6);
+    uint32_t height = ZLGIFReadUInt16(p + 8);
+    if (width == 0 || height == 0 || (uint64_t)width * height > ZLGIFMaxPixels) {
+        return false;
+    }
+    decoder->width = width;
+    decoder->height = height;
+    decoder->globalColorCount = (uint16_t)(tableLength / 3);
+    decoder->globalColorTableOffset = 13;
+    decoder->offset = 13 + tableLength;
+    decoder->state = ZLGIFStateBlocks;
+    return true;
+}
+
+static bool ZLGIFParseExtension(ZLGIFDecoder *decoder, size_t *end) {
+    const uint8_t *p = decoder->data;
+    size_t offset = decoder->offset;
+    if (offset + 2 > decoder->length || !ZLGIFSkipSubBlocks(p, decoder->length, offset + 2, end)) {
+        return false;
+    }
+
+    uint8_t label = p[offset + 1];
+    const uint8_t *block = p + offset + 2;
+    if (label == 0xF9 && block[0] >= 4) {
+        decoder->hasControl = true;
+        decoder->disposal = (block[1] >> 2) & 0x07;
+        decoder->delay = ZLGIFReadUInt16(block + 2);
+        decoder->transparentIndex = (block[1] & 0x01) ? block[4] : -1;
+    } else if (label == 0xFF && block[0] == 11 &&
+               (memcmp(block + 1, "NETSCAPE2.0", 11) == 0 || memcmp(block + 1, "ANIMEXTS1.0", 11) == 0)) {
+        const uint8_t *sub = block + 12;
+        if (sub[0] >= 3 && sub[1] == 0x01) {
+            // 记录的是重复次数，0 表示无限循环
+            uint16_t repeat = ZLGIFReadUInt16(sub + 2);
+            decoder->loopCount = repeat == 0 ? 0 : repeat + 1u;
+        }
+    }
+    return true;
+}
+
+static bool ZLGIFParseImage(ZLGIFDecoder *decoder, size_t *end) {
+    const uint8_t *p = decoder->data;
+    size_t offset = decoder->offset;
+    if (offset + 10 > decoder->length) {
+        return false;
+    }
+    uint8_t flags = p[offset + 9];
+    size_t tableLength = (flags & 0x80) ? 3 * (2 << (flags & 0x07)) : 0;
+    size_t dataOffset = offset + 10 + tableLength;
+    if (dataOffset + 1 > decoder->length || !ZLGIFSkipSubBlocks(p, decoder->length, dataOffset + 1, end)) {
+        return false;
+    }
+
+    if (decoder->frameCount == decoder->frameCapacity) {
+        size_t capacity = decoder->frameCapacity ? decoder->frameCapacity * 2 : 16;
+        ZLGIFFrame *frames = realloc(decoder->frames, capacity * sizeof(ZLGIFFrame));
+        if (frames == NULL) {
+            return false;
+        }
+        decoder->frames = frames;
+        decoder->frameCapacity = capacity;
+    }
+
+    ZLGIFFrame *frame = &decoder->frames[decoder->frameCount++];
+    frame->rect.x = ZLGIFReadUInt16(p + offset + 1);
+    frame->rect.y = ZLGIFReadUInt16(p + offset + 3);
+    frame->rect.width = ZLGIFReadUInt16(p + offset + 5);
+    frame->rect.height = ZLGIFReadUInt16(p + offset + 7);
+    frame->interlaced = (flags & 0x40) != 0;
+    frame->colorCount = (uint16_t)(tableLength / 3);
+    frame->colorTableOffset = offset + 10;
+    frame->dataOffset = dataOffset;
+    if (decoder->hasControl) {
+        frame->duration = decoder->delay <= 1 ? 100 : decoder->delay * 10u;
+        frame->disposal = decoder->disposal;
+        frame->transparentIndex = decoder->transparentIndex;
+    } else {
+        frame->duration = 100;
+        frame->disposal = ZLGIFDisposalNone;
+        frame->transparentIndex = -1;
+    }
+    decoder->hasControl = false;
+    return true;
+}
+
+static bool ZLGIFParseBlocks(ZLGIFDecoder *decoder) {
+    while (decoder->offset < decoder->length) {
+        size_t end = 0;
+        switch (decoder->data[decoder->offset]) {
+            case 0x21:
+                if (!ZLGIFParseExtension(decoder, &end)) {
+                    return true;
+                }
+                break;
+            case 0x2C:
+                if (!ZLGIFParseImage(decoder, &end)) {
+                    return true;
+                }
+                break;
+            case 0x3B:
+                decoder->state = ZLGIFStateDone;
+                return true;
+            default:
+                return false;
+        }
+        decoder->offset = end;
+    }
+    return true;
+}
+
+ZLGIFDecoder *ZLGIFDecoderCreate(void) {
+    ZLGIFDecoder *decoder = calloc(1, sizeof(ZLGIFDecoder));
+    if (decoder) {
+        decoder->loopCount = 1;
+        decoder->transparentIndex = -1;
+    }
+    return decoder;
+}
+
+void ZLGIFDecoderDestroy(ZLGIFDecoder *decoder) {
+    if (decoder == NULL) {
+        return;
+    }
+    free(decoder->data);
+    free(decoder->frames);
+    free(decoder);
+}
+
+bool ZLGIFDecoderAppend(ZLGIFDecoder *decoder, const uint8_t *bytes, size_t length) {
+    if (decoder->corrupted) {
+        return false;
+    }
+    if (decoder->state == ZLGIFStateDone || length == 0) {
+        return true;
+    }
+
+    if (decoder->length + length > decoder->capacity) {
+        size_t capacity = decoder->capacity ? decoder->capacity : 4096;
+        while (capacity < decoder->length + length) {
+            capacity *= 2;
+        }
+        uint8_t *data = realloc(decoder->data, capacity);
+        if (data == NULL) {
+            return false;
+        }
+        decoder->data = data;
+        decoder->capacity = capacity;
+    }
+    memcpy(decoder->data + decoder->length, bytes, length);
+    decoder->length += length;
+
+    bool valid = true;
+    if (decoder->state == ZLGIFStateHeader) {
+        valid = ZLGIFParseHeader(decoder);
+    }
+    if (valid && decoder->state == ZLGIFStateBlocks) {
+        valid = ZLGIFParseBlocks(decoder);
+    }
+    if (!valid) {
+        decoder->corrupted = true;
+        decoder->state = ZLGIFStateDone;
+    }
+    return valid;
+}
+
+size_t ZLGIFDecoderDataLength(const ZLGIFDecoder *decoder) {
+    return decoder->length;
+}
+
+bool ZLGIFDecoderIsComplete(const ZLGIFDecoder *decoder) {
+    return decoder->state == ZLGIFStateDone;
+}
+
+uint32_t ZLGIFDecoderWidth(const ZLGIFDecoder *decoder) {
+    return decoder->width;
+}
+
+uint32_t ZLGIFDecoderHeight(const ZLGIFDecoder *decoder) {
+    return decoder->height;
+}
+
+uint32_t ZLGIFDecoderLoopCount(const ZLGIFDecoder *decoder) {
+    return decoder->loopCount;
+}
+
+size_t ZLGIFDecoderFrameCount(const ZLGIFDecoder *decoder) {
+    return decoder->frameCount;
+}
+
+uint32_t ZLGIFDecoderFrameDuration(const ZLGIFDecoder *decoder, size_t index) {
+    return index < decoder->frameCount ? decoder->frames[index].duration : 0;
+}
+
+/* canvas */
+
+ZLGIFCanvas *ZLGIFCanvasCreate(const ZLGIFDecoder *decoder) {
+    if (decoder->width == 0 || decoder->height == 0 || (uint64_t)decoder->width * decoder->height > ZLGIFMaxPixels) {
+        return NULL;
+    }
+    ZLGIFCanvas *canvas = calloc(1, sizeof(ZLGIFCanvas));
+    if (canvas == NULL) {
+        return NULL;
+    }
+    canvas->width = decoder->width;
+    canvas->height = decoder->height;
+    canvas->pixels = calloc((size_t)canvas->width * canvas->height, sizeof(uint32_t));
+    if (canvas->pixels == NULL) {
+        free(canvas);
+        return NULL;
+    }
+    return canvas;
+}
+
+void ZLGIFCanvasDestroy(ZLGIFCanvas *canvas) {
+    if (canvas == NULL) {
+        return;
+    }
+    free(canvas->pixels);
+    free(canvas->backup);
+    free(canvas);
+}
+
+void ZLGIFCanvasReset(ZLGIFCanvas *canvas) {
+    canvas->nextFrame = 0;
+    canvas->previousDisposal = ZLGIFDisposalNone;
+    memset(&canvas->previousRect, 0, sizeof(ZLGIFRect));
+}
+
+size_t ZLGIFCanvasNextFrameIndex(const ZLGIFCanvas *canvas) {
+    return canvas->nextFrame;
+}
+
+const uint32_t *ZLGIFCanvasPixels(const ZLGIFCanvas *canvas) {
+    return canvas->pixels;
+}
+
+/// 帧的位置可以超出画布，只处理重叠的部分
+static ZLGIFRect ZLGIFClipRect(const ZLGIFCanvas *canvas, ZLGIFRect rect) {
+    ZLGIFRect clipped = {0, 0, 0, 0};
+    if (rect.x >= canvas->width || rect.y >= canvas->height) {
+        return clipped;
+    }
+    clipped.x = rect.x;
+    clipped.y = rect.y;
+    clipped.width = rect.width < canvas->width - rect.x ? rect.width : canvas->width - rect.x;
+    clipped.height = rect.height < canvas->height - rect.y ? rect.height : canvas->height - rect.y;
+    return clipped;
+}
+
+static ZLGIFRect ZLGIFUnionRect(ZLGIFRect a, ZLGIFRect b) {
+    if (a.width == 0 || a.height == 0) {
+        return b;
+    }
+    if (b.width == 0 || b.height == 0) {
+        return a;
+    }
+    uint32_t minX = a.x < b.x ? a.x : b.x;
+    uint32_t minY = a.y < b.y ? a.y : b.y;
+    uint32_t maxX = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+    uint32_t maxY = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+    ZLGIFRect rect = {minX, minY, maxX - minX, maxY - minY};
+    return rect;
+}
+
+static void ZLGIFCopyRect(uint32_t *dst, size_t dstStride, const uint32_t *src, size_t srcStride, ZLGIFRect rect) {
+    for (uint32_t row = 0; row < rect.height; row++) {
+        memcpy(dst + row * dstStride, src + row * srcStride, rect.width * sizeof(uint32_t));
+    }
+}
+
+static void ZLGIFDecodeFrame(ZLGIFCanvas *canvas, const ZLGIFDecoder *decoder, const ZLGIFFrame *frame) {
+    const uint8_t *data = decoder->data;
+    size_t length = decoder->length;
+
+    uint32_t palette[256];
+    const uint8_t *table = data + (frame->colorCount ? frame->colorTableOffset : decoder->globalColorTableOffset);
+    uint16_t colorCount = frame->colorCount ? frame->colorCount : decoder->globalColorCount;
+    for (uint32_t i = 0; i < 256; i++) {
+        if (i < colorCount) {
+            palette[i] = 0xFF000000u | ((uint32_t)table[i * 3] << 16) | ((uint32_t)table[i * 3 + 1] << 8) | table[i * 3 + 2];
+        } else {
+            palette[i] = 0xFF000000u;
+        }
+    }
+
+    uint8_t minCodeSize = data[frame->dataOffset];
+    if (minCodeSize < 1 || minCodeSize > 11) {
+        return;
+    }
+    const uint32_t clearCode = 1u << minCodeSize;
+    const uint32_t endCode = clearCode + 1;
+    for (uint32_t i = 0; i < clearCode; i++) {
+        canvas->prefix[i] = 0;
+        canvas->suffix[i] = (uint8_t)i;
+    }
+
+    const uint32_t frameWidth = frame->rect.width;
+    const uint32_t frameHeight = frame->rect.height;
+    const uint64_t pixelCount = (uint64_t)frameWidth * frameHeight;
+    if (pixelCount == 0) {
+        return;
+    }
+
+    // 输出位置：列、帧内的行以及隔行扫描的当前遍
+    static const uint8_t interlaceStart[4] = {0, 4, 2, 1};
+    static const uint8_t interlaceStep[4] = {8, 8, 4, 2};
+    uint32_t column = 0;
+    uint32_t row = 0;
+    uint32_t pass = 0;
+    uint64_t written = 0;
+
+    uint32_t codeSize = minCodeSize + 1;
+    uint32_t nextCode = clearCode + 2;
+    int32_t oldCode = -1;
+    uint8_t firstByte = 0;
+
+    uint32_t bits = 0;
+    uint32_t bitCount = 0;
+    size_t offset = frame->dataOffset + 1;
+    size_t blockEnd = offset;
+
+    while (written < pixelCount) {
+        // 按子块读取，直到攒够一个码
+        while (bitCount < codeSize) {
+            if (offset == blockEnd) {
+                if (offset >= length || data[offset] == 0) {
+                    return;
+                }
+                blockEnd = offset + 1 + data[offset];
+                offset++;
+            }
+            bits |= (uint32_t)data[offset++] << bitCount;
+            bitCount += 8;
+        }
+        uint32_t code = bits & ((1u << codeSize) - 1);
+        bits >>= codeSize;
+        bitCount -= codeSize;
+
+        if (code == clearCode) {
+            codeSize = minCodeSize + 1;
+            nextCode = clearCode + 2;
+            oldCode = -1;
+            continue;
+        }
+        if (code == endCode) {
+            return;
+        }
+
+        size_t depth = 0;
+        if (oldCode < 0) {
+            if (code >= clearCode) {
+                return;
+            }
+            firstByte = (uint8_t)code;
+            canvas->stack[depth++] = firstByte;
+        } else {
+            uint32_t current = code;
+            if (current > nextCode) {
+                return;
+            }
+            if (current == nextCode) {
+                canvas->stack[depth++] = firstByte;
+                current = (uint32_t)oldCode;
+            }
+            while (current >= clearCode) {
+                canvas->stack[depth++] = canvas->suffix[current];
+                current = canvas->prefix[current];
+            }
+            firstByte = (uint8_t)current;
+            canvas->stack[depth++] = firstByte;
+
+            if (nextCode < ZLGIFMaxCodeCount) {
+                canvas->prefix[nextCode] = (uint16_t)oldCode;
+                canvas->suffix[nextCode] = firstByte;
+                nextCode++;
+                if (nextCode == (1u << codeSize) && codeSize < 12) {
+                    codeSize++;
+                }
+            }
+        }
+        oldCode = (int32_t)code;
+
+        // 栈里是倒序的像素
+        while (depth > 0 && written < pixelCount) {
+            uint8_t index = canvas->stack[--depth];
+            uint32_t x = frame->rect.x + column;
+            uint32_t y = frame->rect.y + row;
+            if (index != frame->transparentIndex && x < canvas->width && y < canvas->height) {
+                canvas->pixels[(size_t)y * canvas->width + x] = palette[index];
+            }
+
+            written++;
+            if (++column == frameWidth) {
+                column = 0;
+                if (frame->interlaced) {
+                    row += interlaceStep[pass];
+                    while (row >= frameHeight && pass < 3) {
+                        pass++;
+                        row = interlaceStart[pass];
+                    }
+                } else {
+                    row++;
+                }
+            }
+        }
+    }
+}
+
+bool ZLGIFCanvasRenderNextFrame(ZLGIFCanvas *canvas, const ZLGIFDecoder *decoder, ZLGIFRect *dirtyRect) {
+    size_t index = canvas->nextFrame;
+    if (index >= decoder->frameCount) {
+        return false;
+    }
+
+    ZLGIFRect dirty = {0, 0, 0, 0};
+    if (index == 0) {
+        memset(canvas->pixels, 0, (size_t)canvas->width * canvas->height * sizeof(uint32_t));
+        dirty.width = canvas->width;
+        dirty.height = canvas->height;
+    } else if (canvas->previousDisposal == ZLGIFDisposalBackground) {
+        ZLGIFRect rect = canvas->previousRect;
+        for (uint32_t row = 0; row < rect.height; row++) {
+            memset(canvas->pixels + (size_t)(rect.y + row) * canvas->width + rect.x, 0, rect.width * sizeof(uint32_t));
+        }
+        dirty = rect;
+    } else if (canvas->previousDisposal == ZLGIFDisposalPrevious) {
+        ZLGIFRect rect = canvas->previousRect;
+        ZLGIFCopyRect(canvas->pixels + (size_t)rect.y * canvas->width + rect.x, canvas->width, canvas->backup, rect.width, rect);
+        dirty = rect;
+    }
+
+    const ZLGIFFrame *frame = &decoder->frames[index];
+    ZLGIFRect rect = ZLGIFClipRect(canvas, frame->rect);
+    uint8_t disposal = frame->disposal;
+    if (disposal == ZLGIFDisposalPrevious) {
+        size_t backupLength = (size_t)rect.width * rect.height;
+        if (backupLength > canvas->backupCapacity) {
+            uint32_t *backup = realloc(canvas->backup, backupLength * sizeof(uint32_t));
+            if (backup == NULL) {
+                disposal = ZLGIFDisposalNone;
+            } else {
+                canvas->backup = backup;
+                canvas->backupCapacity = backupLength;
+            }
+        }
+        if (disposal == ZLGIFDisposalPrevious) {
+            ZLGIFCopyRect(canvas->backup, rect.width, canvas->pixels + (size_t)rect.y * canvas->width + rect.x, canvas->width, rect);
+        }
+    }
+
+    ZLGIFDecodeFrame(canvas, decoder, frame);
+
+    canvas->previousRect = rect;
+    canvas->previousDisposal = disposal;
+    canvas->nextFrame = index + 1;
+    if (dirtyRect) {
+        *dirtyRect = ZLGIFUnionRect(dirty, rect);
+    }
+    return true;
+}
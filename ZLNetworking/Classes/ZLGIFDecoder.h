@@ -0,0 +1,82 @@
+//
+//  ZLGIFDecoder.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/27.
+//
+
+#ifndef ZLGIFDecoder_h
+#define ZLGIFDecoder_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 流式 GIF 解码：数据可以分多次追加，每收全一帧就能解码这一帧。
+/// ZLGIFDecoder 只解析结构、记录每帧在数据中的位置；ZLGIFCanvas 是一块可复用的画布，按顺序把每帧合成上去，
+/// 只改动帧所在的矩形并按 disposal 方式恢复。同一个 decoder 可以有多块画布，都不加锁，由调用方串行访问
+typedef struct ZLGIFDecoder ZLGIFDecoder;
+
+typedef struct ZLGIFCanvas ZLGIFCanvas;
+
+typedef struct ZLGIFRect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+} ZLGIFRect;
+
+ZLGIFDecoder *ZLGIFDecoderCreate(void);
+
+void ZLGIFDecoderDestroy(ZLGIFDecoder *decoder);
+
+/// 追加新收到的数据并解析其中完整的帧；数据不是 GIF、结构损坏或画布超过 2^26 像素时返回 false，已解析的帧仍可使用
+bool ZLGIFDecoderAppend(ZLGIFDecoder *decoder, const uint8_t *bytes, size_t length);
+
+/// 已追加的数据长度
+size_t ZLGIFDecoderDataLength(const ZLGIFDecoder *decoder);
+
+/// 读到了结束标记或数据损坏，之后不会再有新的帧
+bool ZLGIFDecoderIsComplete(const ZLGIFDecoder *decoder);
+
+/// 画布尺寸，文件头还没收全时为 0
+uint32_t ZLGIFDecoderWidth(const ZLGIFDecoder *decoder);
+
+uint32_t ZLGIFDecoderHeight(const ZLGIFDecoder *decoder);
+
+/// 播放次数，0 表示无限循环
+uint32_t ZLGIFDecoderLoopCount(const ZLGIFDecoder *decoder);
+
+/// 已收全的帧数
+size_t ZLGIFDecoderFrameCount(const ZLGIFDecoder *decoder);
+
+/// 帧的显示时长，单位毫秒；和浏览器一样把不超过 10ms 的时长当作 100ms
+uint32_t ZLGIFDecoderFrameDuration(const ZLGIFDecoder *decoder, size_t index);
+
+/// 解码器的画布尺寸还未知或超过像素上限时返回 NULL
+ZLGIFCanvas *ZLGIFCanvasCreate(const ZLGIFDecoder *decoder);
+
+void ZLGIFCanvasDestroy(ZLGIFCanvas *canvas);
+
+/// 回到第 0 帧之前的状态
+void ZLGIFCanvasReset(ZLGIFCanvas *canvas);
+
+/// 下一次 ZLGIFCanvasRenderNextFrame 合成的帧
+size_t ZLGIFCanvasNextFrameIndex(const ZLGIFCanvas *canvas);
+
+/// 合成下一帧，dirtyRect 返回这次改动的区域；下一帧还没收全时返回 false。
+/// 帧内 LZW 数据损坏时保留已解出的像素，与浏览器行为一致
+bool ZLGIFCanvasRenderNextFrame(ZLGIFCanvas *canvas, const ZLGIFDecoder *decoder, ZLGIFRect *dirtyRect);
+
+/// 画布像素，每行 width 个，主机字节序的 32 位 ARGB（预乘，透明像素为 0）
+const uint32_t *ZLGIFCanvasPixels(const ZLGIFCanvas *canvas);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLGIFDecoder_h */
@@ -0,0 +1,72 @@
+//
+//  ZLHTTPResponseCache.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/20.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// 一条缓存的响应，新鲜度按 Cache-Control max-age / Expires / Last-Modified 启发式计算
+@interface ZLHTTPCachedResponse : NSObject
+
+@property (nonatomic, strong, readonly) NSHTTPURLResponse *response;
+
+@property (nonatomic, strong, readonly) NSData *data;
+
+/// 本地收到响应（或被 304 刷新）的时间
+@property (nonatomic, strong, readonly) NSDate *responseDate;
+
+/// 响应 Vary 中列出的请求头及存储时请求里的取值
+@property (nonatomic, copy, readonly) NSDictionary<NSString *, NSString *> *varyHeaders;
+
+@property (nonatomic, assign, readonly, getter=isFresh) BOOL fresh;
+
+/// no-cache / must-revalidate：过期后必须先验证才能使用
+@property (nonatomic, assign, readonly) BOOL requiresRevalidation;
+
+@end
+
+/// 内存 + 磁盘两级的 HTTP 响应缓存，两级都按 LRU 淘汰。
+/// 以 method + URL 为键，每个键只保留一个变体，请求的 Vary 头取值不一致时视为未命中
+@interface ZLHTTPResponseCache : NSObject
+
+@property (nonatomic, assign) NSUInteger memoryCapacity;
+
+@property (nonatomic, assign) NSUInteger diskCapacity;
+
+- (instancetype)initWithDirectory:(NSString *)directory
+                   memoryCapacity:(NSUInteger)memoryCapacity
+                     diskCapacity:(NSUInteger)diskCapacity;
+
+/// 内存未命中时同步读磁盘，不要在主线程调用
+- (nullable ZLHTTPCachedResponse *)cachedResponseForRequest:(NSURLRequest *)request;
+
+/// 内存命中时在当前线程直接回调；否则在后台读磁盘，读完后在全局队列上回调
+- (void)cachedResponseForRequest:(NSURLRequest *)request
+               completionHandler:(void (^)(ZLHTTPCachedResponse * _Nullable cachedResponse))completionHandler;
+
+/// 响应不可缓存时返回 nil；no-store 或 Vary: * 的响应会同时删掉已有的缓存
+- (nullable ZLHTTPCachedResponse *)storeResponse:(NSHTTPURLResponse *)response
+                                            data:(NSData *)data
+                                      forRequest:(NSURLRequest *)request;
+
+/// 用 304 响应的头更新缓存并重新计算新鲜度，返回更新后的缓存
+- (ZLHTTPCachedResponse *)cachedResponse:(ZLHTTPCachedResponse *)cachedResponse
+        refreshedWithNotModifiedResponse:(NSHTTPURLResponse *)response
+                              forRequest:(NSURLRequest *)request;
+
+- (void)removeAllCachedResponses;
+
+/// 按缓存的 ETag / Last-Modified 添加 If-None-Match / If-Modified-Since
++ (void)addConditionalHeadersFromCachedResponse:(ZLHTTPCachedResponse *)cachedResponse
+                                      toRequest:(NSMutableURLRequest *)request;
+
+/// 去掉请求里所有的条件头（If-None-Match / If-Modified-Since / If-Match / If-Unmodified-Since / If-Range）
++ (void)removeConditionalHeadersFromRequest:(NSMutableURLRequest *)request;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,585 @@
+//
+//  ZLHTTPResponseCache.m
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/20.
+//
+
+#import "ZLHTTPResponseCache.h"
+#import "ZLURLSessionManager.h"
+
+/// 没有明确过期时间时，按 Last-Modified 启发式计算的新鲜期上限
+static NSTimeInterval const ZLHTTPHeuristicFreshnessLimit = 24 * 60 * 60;
+
+/// allHeaderFields 在 iOS 13 以前不保证大小写不敏感
+static NSString * ZLHTTPHeaderValue(NSDictionary *headers, NSString *field) {
+    NSString *value = headers[field];
+    if (value != nil) {
+        return value;
+    }
+    for (NSString *key in headers) {
+        if ([key caseInsensitiveCompare:field] == NSOrderedSame) {
+            return headers[key];
+        }
+    }
+    return nil;
+}
+
+/// 指令名转小写，没有值的指令对应空串
+static NSDictionary<NSString *, NSString *> * ZLHTTPParseCacheControl(NSString *cacheControl) {
+    if (cacheControl.length == 0) {
+        return @{};
+    }
+    NSMutableDictionary *directives = [NSMutableDictionary dictionary];
+    NSCharacterSet *whitespace = [NSCharacterSet whitespaceCharacterSet];
+    for (NSString *component in [cacheControl componentsSeparatedByString:@","]) {
+        NSString *directive = [component stringByTrimmingCharactersInSet:whitespace];
+        if (directive.length == 0) {
+            continue;
+        }
+        NSRange equal = [directive rangeOfString:@"="];
+        if (equal.location == NSNotFound) {
+            directives[directive.lowercaseString] = @"";
+        } else {
+            NSString *name = [[directive substringToIndex:equal.location] stringByTrimmingCharactersInSet:whitespace];
+            NSString *value = [[directive substringFromIndex:NSMaxRange(equal)] stringByTrimmingCharactersInSet:whitespace];
+            directives[name.lowercaseString] = [value stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@"\""]];
+        }
+    }
+    return directives;
+}
+
+static NSDate * ZLHTTPParseDate(NSString *string) {
+    if (string.length == 0) {
+        return nil;
+    }
+    static NSDateFormatter *formatter = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        formatter = [[NSDateFormatter alloc] init];
+        formatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+        formatter.timeZone = [NSTimeZone timeZoneForSecondsFromGMT:0];
+        formatter.dateFormat = @"EEE, dd MMM yyyy HH:mm:ss zzz";
+    });
+    return [formatter dateFromString:string];
+}
+
+static NSArray<NSString *> * ZLHTTPVaryFields(NSHTTPURLResponse *response) {
+    NSString *vary = ZLHTTPHeaderValue(response.allHeaderFields, @"Vary");
+    if (vary.length == 0) {
+        return @[];
+    }
+    NSMutableArray *fields = [NSMutableArray array];
+    for (NSString *component in [vary componentsSeparatedByString:@","]) {
+        NSString *field = [component stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        if (field.length > 0) {
+            [fields addObject:field];
+        }
+    }
+    return fields;
+}
+
+static NSString * ZLHTTPCacheKeyForRequest(NSURLRequest *request) {
+    return ZLSha256HashFor([NSString stringWithFormat:@"%@ %@", request.HTTPMethod ?: @"GET", request.URL.absoluteString]);
+}
+
+@implementation ZLHTTPCachedResponse {
+    NSTimeInterval _freshnessLifetime;
+    NSTimeInterval _initialAge;
+}
+
+- (instancetype)initWithResponse:(NSHTTPURLResponse *)response
+                            data:(NSData *)data
+                    responseDate:(NSDate *)responseDate
+                     varyHeaders:(NSDictionary<NSString *, NSString *> *)varyHeaders {
+    if (self = [super init]) {
+        _response = response;
+        _data = data;
+        _responseDate = responseDate;
+        _varyHeaders = [varyHeaders copy];
+
+        NSDictionary *headers = response.allHeaderFields;
+        NSDictionary *cacheControl = ZLHTTPParseCacheControl(ZLHTTPHeaderValue(headers, @"Cache-Control"));
+        NSDate *date = ZLHTTPParseDate(ZLHTTPHeaderValue(headers, @"Date")) ?: responseDate;
+
+        if (cacheControl[@"no-cache"] != nil) {
+            _freshnessLifetime = 0;
+        } else if (cacheControl[@"max-age"] != nil) {
+            _freshnessLifetime = [cacheControl[@"max-age"] doubleValue];
+        } else if (ZLHTTPHeaderValue(headers, @"Expires") != nil) {
+            // 无法解析的 Expires 视为已过期
+            NSDate *expires = ZLHTTPParseDate(ZLHTTPHeaderValue(headers, @"Expires"));
+            _freshnessLifetime = expires ? [expires timeIntervalSinceDate:date] : 0;
+        } else {
+            NSDate *lastModified = ZLHTTPParseDate(ZLHTTPHeaderValue(headers, @"Last-Modified"));
+            if (lastModified != nil) {
+                _freshnessLifetime = MIN([date timeIntervalSinceDate:lastModified] * 0.1, ZLHTTPHeuristicFreshnessLimit);
+            }
+        }
+
+        _initialAge = MAX(0, MAX([ZLHTTPHeaderValue(headers, @"Age") doubleValue], [responseDate timeIntervalSinceDate:date]));
+        _requiresRevalidation = cacheControl[@"no-cache"] != nil || cacheControl[@"must-revalidate"] != nil;
+    }
+    return self;
+}
+
+- (BOOL)isFresh {
+    NSTimeInterval currentAge = _initialAge + [[NSDate date] timeIntervalSinceDate:_responseDate];
+    return currentAge < _freshnessLifetime;
+}
+
+- (BOOL)matchesRequest:(NSURLRequest *)request {
+    for (NSString *field in _varyHeaders) {
+        NSString *value = [request valueForHTTPHeaderField:field] ?: @"";
+        if (![value isEqualToString:_varyHeaders[field]]) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+@end
+
+@interface ZLHTTPResponseCacheNode : NSObject
+
+@property (nonatomic, copy) NSString *key;
+
+@property (nonatomic, strong) ZLHTTPCachedResponse *cachedResponse;
+
+@property (nonatomic, assign) NSUInteger cost;
+
+/// 节点由字典持有，链表指针不持有节点
+@property (nonatomic, unsafe_unretained) ZLHTTPResponseCacheNode *prev;
+
+@property (nonatomic, unsafe_unretained) ZLHTTPResponseCacheNode *next;
+
+@end
+
+@implementation ZLHTTPResponseCacheNode
+
+@end
+
+@interface ZLHTTPResponseDiskEntry : NSObject
+
+@property (nonatomic, assign) unsigned long long size;
+
+@property (nonatomic, assign) NSTimeInterval accessTime;
+
+@end
+
+@implementation ZLHTTPResponseDiskEntry
+
+@end
+
+@implementation ZLHTTPResponseCache {
+    NSString *_directory;
+
+    /// 内存缓存：哈希索引 + 侵入式 LRU 双向链表
+    dispatch_semaphore_t _lock;
+    NSMutableDictionary<NSString *, ZLHTTPResponseCacheNode *> *_nodes;
+    __unsafe_unretained ZLHTTPResponseCacheNode *_header;
+    __unsafe_unretained ZLHTTPResponseCacheNode *_footer;
+    NSUInteger _totalCost;
+    NSUInteger _memoryCapacity;
+
+    /// 磁盘缓存的读写和索引都只在 _ioQueue 上进行，索引第一次用到时扫描目录建立
+    dispatch_queue_t _ioQueue;
+    NSMutableDictionary<NSString *, ZLHTTPResponseDiskEntry *> *_diskIndex;
+    unsigned long long _diskTotalSize;
+    NSUInteger _diskCapacity;
+}
+
+- (instancetype)initWithDirectory:(NSString *)directory
+                   memoryCapacity:(NSUInteger)memoryCapacity
+                     diskCapacity:(NSUInteger)diskCapacity {
+    if (self = [super init]) {
+        _directory = [directory copy];
+        _lock = dispatch_semaphore_create(1);
+        _nodes = [NSMutableDictionary dictionary];
+        _memoryCapacity = memoryCapacity;
+        _ioQueue = dispatch_queue_create("com.richie.zlnetworking.responsecache", DISPATCH_QUEUE_SERIAL);
+        _diskCapacity = diskCapacity;
+
+        BOOL isDir = NO;
+        if (![[NSFileManager defaultManager] fileExistsAtPath:_directory isDirectory:&isDir] || !isDir) {
+            if (![[NSFileManager defaultManager] createDirectoryAtPath:_directory withIntermediateDirectories:YES attributes:nil error:nil]) {
+                NSLog(@"file system error");
+            }
+        }
+    }
+    return self;
+}
+
+#pragma mark - memory
+
+- (void)unlinkNode:(ZLHTTPResponseCacheNode *)node {
+    if (node.prev) {
+        node.prev.next = node.next;
+    } else {
+        _header = node.next;
+    }
+    if (node.next) {
+        node.next.prev = node.prev;
+    } else {
+        _footer = node.prev;
+    }
+    node.prev = nil;
+    node.next = nil;
+}
+
+- (void)insertNodeAtHeader:(ZLHTTPResponseCacheNode *)node {
+    node.next = _header;
+    _header.prev = node;
+    _header = node;
+    if (_footer == nil) {
+        _footer = node;
+    }
+}
+
+- (void)trimMemoryToCost:(NSUInteger)cost {
+    while (_totalCost > cost && _footer != nil) {
+        ZLHTTPResponseCacheNode *node = _footer;
+        _totalCost -= node.cost;
+        [self unlinkNode:node];
+        [_nodes removeObjectForKey:node.key];
+    }
+}
+
+- (ZLHTTPCachedResponse *)memoryCachedResponseForKey:(NSString *)key {
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    ZLHTTPResponseCacheNode *node = _nodes[key];
+    if (node) {
+        [self unlinkNode:node];
+        [self insertNodeAtHeader:node];
+    }
+    ZLHTTPCachedResponse *cachedResponse = node.cachedResponse;
+    dispatch_semaphore_signal(_lock);
+    return cachedResponse;
+}
+
+- (void)setMemoryCachedResponse:(ZLHTTPCachedResponse *)cachedResponse forKey:(NSString *)key {
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    ZLHTTPResponseCacheNode *node = _nodes[key];
+    if (node) {
+        _totalCost -= node.cost;
+        [self unlinkNode:node];
+        [_nodes removeObjectForKey:key];
+    }
+    NSUInteger cost = cachedResponse.data.length;
+    if (cachedResponse != nil && cost <= _memoryCapacity) {
+        [self trimMemoryToCost:_memoryCapacity - cost];
+        node = [ZLHTTPResponseCacheNode new];
+        node.key = key;
+        node.cachedResponse = cachedResponse;
+        node.cost = cost;
+        _nodes[key] = node;
+        [self insertNodeAtHeader:node];
+        _totalCost += cost;
+    }
+    dispatch_semaphore_signal(_lock);
+}
+
+- (NSUInteger)memoryCapacity {
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    NSUInteger memoryCapacity = _memoryCapacity;
+    dispatch_semaphore_signal(_lock);
+    return memoryCapacity;
+}
+
+- (void)setMemoryCapacity:(NSUInteger)memoryCapacity {
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    _memoryCapacity = memoryCapacity;
+    [self trimMemoryToCost:memoryCapacity];
+    dispatch_semaphore_signal(_lock);
+}
+
+#pragma mark - disk
+
+- (NSString *)bodyPathForKey:(NSString *)key {
+    return [_directory stringByAppendingPathComponent:key];
+}
+
+- (NSString *)metadataPathForKey:(NSString *)key {
+    return [[_directory stringByAppendingPathComponent:key] stringByAppendingPathExtension:@"meta"];
+}
+
+- (void)loadDiskIndexIfNeeded {
+    if (_diskIndex != nil) {
+        return;
+    }
+    _diskIndex = [NSMutableDictionary dictionary];
+    NSArray *resourceKeys = @[NSURLFileSizeKey, NSURLContentModificationDateKey];
+    NSArray<NSURL *> *fileURLs = [[NSFileManager defaultManager] contentsOfDirectoryAtURL:[NSURL fileURLWithPath:_directory] includingPropertiesForKeys:resourceKeys options:NSDirectoryEnumerationSkipsHiddenFiles error:NULL];
+    for (NSURL *fileURL in fileURLs) {
+        NSDictionary *values = [fileURL resourceValuesForKeys:resourceKeys error:NULL];
+        NSString *key = fileURL.lastPathComponent.stringByDeletingPathExtension;
+        ZLHTTPResponseDiskEntry *entry = _diskIndex[key];
+        if (entry == nil) {
+            entry = [ZLHTTPResponseDiskEntry new];
+            _diskIndex[key] = entry;
+        }
+        unsigned long long size = [values[NSURLFileSizeKey] unsignedLongLongValue];
+        entry.size += size;
+        entry.accessTime = MAX(entry.accessTime, [values[NSURLContentModificationDateKey] timeIntervalSinceReferenceDate]);
+        _diskTotalSize += size;
+    }
+}
+
+- (void)removeDiskEntryForKey:(NSString *)key {
+    ZLHTTPResponseDiskEntry *entry = _diskIndex[key];
+    if (entry != nil) {
+        _diskTotalSize -= entry.size;
+        [_diskIndex removeObjectForKey:key];
+    }
+    [[NSFileManager defaultManager] removeItemAtPath:[self bodyPathForKey:key] error:NULL];
+    [[NSFileManager defaultManager] removeItemAtPath:[self metadataPathForKey:key] error:NULL];
+}
+
+/// 按最近访问时间从旧到新删除，直到总大小不超过 diskCapacity
+- (void)trimDisk {
+    if (_diskTotalSize <= _diskCapacity) {
+        return;
+    }
+    NSArray<NSString *> *keys = [_diskIndex keysSortedByValueUsingComparator:^NSComparisonResult(ZLHTTPResponseDiskEntry *obj1, ZLHTTPResponseDiskEntry *obj2) {
+        return obj1.accessTime < obj2.accessTime ? NSOrderedAscending : (obj1.accessTime > obj2.accessTime ? NSOrderedDescending : NSOrderedSame);
+    }];
+    for (NSString *key in keys) {
+        if (_diskTotalSize <= _diskCapacity) {
+            break;
+        }
+        [self removeDiskEntryForKey:key];
+    }
+}
+
+- (void)writeCachedResponse:(ZLHTTPCachedResponse *)cachedResponse forKey:(NSString *)key includingData:(BOOL)includingData {
+    NSHTTPURLResponse *response = cachedResponse.response;
+    NSDictionary *metadata = @{
+        @"url": response.URL.absoluteString ?: @"",
+        @"status": @(response.statusCode),
+        @"headers": response.allHeaderFields ?: @{},
+        @"date": cachedResponse.responseDate,
+        @"vary": cachedResponse.varyHeaders ?: @{}
+    };
+    NSData *metadataData = [NSPropertyListSerialization dataWithPropertyList:metadata format:NSPropertyListBinaryFormat_v1_0 options:0 error:NULL];
+    if (metadataData == nil) {
+        return;
+    }
+
+    dispatch_async(_ioQueue, ^{
+        [self loadDiskIndexIfNeeded];
+        ZLHTTPResponseDiskEntry *entry = self->_diskIndex[key];
+        if (includingData || entry == nil) {
+            [self removeDiskEntryForKey:key];
+            if (![cachedResponse.data writeToFile:[self bodyPathForKey:key] atomically:YES]) {
+                return;
+            }
+        } else {
+            // 只替换元数据，正文文件保持不变
+            NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:[self metadataPathForKey:key] error:NULL];
+            entry.size -= attributes.fileSize;
+            self->_diskTotalSize -= attributes.fileSize;
+        }
+        if (![metadataData writeToFile:[self metadataPathForKey:key] atomically:YES]) {
+            [self removeDiskEntryForKey:key];
+            return;
+        }
+
+        entry = self->_diskIndex[key];
+        if (entry == nil) {
+            entry = [ZLHTTPResponseDiskEntry new];
+            entry.size = cachedResponse.data.length;
+            self->_diskIndex[key] = entry;
+            self->_diskTotalSize += entry.size;
+        }
+        entry.size += metadataData.length;
+        entry.accessTime = [NSDate timeIntervalSinceReferenceDate];
+        self->_diskTotalSize += metadataData.length;
+        [self trimDisk];
+    });
+}
+
+/// 在 _ioQueue 上调用
+- (ZLHTTPCachedResponse *)readCachedResponseForKey:(NSString *)key {
+    [self loadDiskIndexIfNeeded];
+    ZLHTTPResponseDiskEntry *entry = _diskIndex[key];
+    if (entry == nil) {
+        return nil;
+    }
+
+    NSData *metadataData = [NSData dataWithContentsOfFile:[self metadataPathForKey:key]];
+    NSDictionary *metadata = metadataData ? [NSPropertyListSerialization propertyListWithData:metadataData options:NSPropertyListImmutable format:NULL error:NULL] : nil;
+    NSData *data = [NSData dataWithContentsOfFile:[self bodyPathForKey:key] options:NSDataReadingMappedIfSafe error:NULL];
+    NSURL *url = [metadata isKindOfClass:[NSDictionary class]] && [metadata[@"url"] isKindOfClass:[NSString class]] ? [NSURL URLWithString:metadata[@"url"]] : nil;
+    if (url == nil || data == nil ||
+        ![metadata[@"status"] isKindOfClass:[NSNumber class]] ||
+        ![metadata[@"headers"] isKindOfClass:[NSDictionary class]] ||
+        ![metadata[@"date"] isKindOfClass:[NSDate class]] ||
+        ![metadata[@"vary"] isKindOfClass:[NSDictionary class]]) {
+        [self removeDiskEntryForKey:key];
+        return nil;
+    }
+
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:url statusCode:[metadata[@"status"] integerValue] HTTPVersion:@"HTTP/1.1" headerFields:metadata[@"headers"]];
+    entry.accessTime = [NSDate timeIntervalSinceReferenceDate];
+    [[NSFileManager defaultManager] setAttributes:@{NSFileModificationDate: [NSDate date]} ofItemAtPath:[self metadataPathForKey:key] error:NULL];
+    return [[ZLHTTPCachedResponse alloc] initWithResponse:response data:data responseDate:metadata[@"date"] varyHeaders:metadata[@"vary"]];
+}
+
+- (NSUInteger)diskCapacity {
+    __block NSUInteger diskCapacity = 0;
+    dispatch_sync(_ioQueue, ^{
+        diskCapacity = self->_diskCapacity;
+    });
+    return diskCapacity;
+}
+
+- (void)setDiskCapacity:(NSUInteger)diskCapacity {
+    dispatch_async(_ioQueue, ^{
+        self->_diskCapacity = diskCapacity;
+        [self loadDiskIndexIfNeeded];
+        [self trimDisk];
+    });
+}
+
+#pragma mark - public
+
+/// 读到的磁盘缓存放回内存缓存，Vary 不匹配时返回 nil
+- (ZLHTTPCachedResponse *)cachedResponse:(ZLHTTPCachedResponse *)cachedResponse
+                          readFromDisk:(BOOL)readFromDisk
+                                forKey:(NSString *)key
+                               request:(NSURLRequest *)request {
+    if (cachedResponse == nil) {
+        return nil;
+    }
+    if (readFromDisk) {
+        [self setMemoryCachedResponse:cachedResponse forKey:key];
+    }
+    return [cachedResponse matchesRequest:request] ? cachedResponse : nil;
+}
+
+- (ZLHTTPCachedResponse *)cachedResponseForRequest:(NSURLRequest *)request {
+    NSString *key = ZLHTTPCacheKeyForRequest(request);
+    ZLHTTPCachedResponse *cachedResponse = [self memoryCachedResponseForKey:key];
+    if (cachedResponse != nil) {
+        return [self cachedResponse:cachedResponse readFromDisk:NO forKey:key request:request];
+    }
+    __block ZLHTTPCachedResponse *diskCachedResponse = nil;
+    dispatch_sync(_ioQueue, ^{
+        diskCachedResponse = [self readCachedResponseForKey:key];
+    });
+    return [self cachedResponse:diskCachedResponse readFromDisk:YES forKey:key request:request];
+}
+
+- (void)cachedResponseForRequest:(NSURLRequest *)request
+               completionHandler:(void (^)(ZLHTTPCachedResponse *cachedResponse))completionHandler {
+    NSString *key = ZLHTTPCacheKeyForRequest(request);
+    ZLHTTPCachedResponse *cachedResponse = [self memoryCachedResponseForKey:key];
+    if (cachedResponse != nil) {
+        completionHandler([self cachedResponse:cachedResponse readFromDisk:NO forKey:key request:request]);
+        return;
+    }
+    NSURLRequest *keyRequest = [request copy];
+    dispatch_async(_ioQueue, ^{
+        ZLHTTPCachedResponse *diskCachedResponse = [self readCachedResponseForKey:key];
+        // 回调里可能再访问缓存，不在 _ioQueue 上回调
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            completionHandler([self cachedResponse:diskCachedResponse readFromDisk:YES forKey:key request:keyRequest]);
+        });
+    });
+}
+
+- (ZLHTTPCachedResponse *)storeResponse:(NSHTTPURLResponse *)response
+                                   data:(NSData *)data
+                             forRequest:(NSURLRequest *)request {
+    if (![response isKindOfClass:[NSHTTPURLResponse class]] || data == nil ||
+        (response.statusCode != 200 && response.statusCode != 203)) {
+        return nil;
+    }
+
+    NSString *key = ZLHTTPCacheKeyForRequest(request);
+    NSDictionary *requestCacheControl = ZLHTTPParseCacheControl([request valueForHTTPHeaderField:@"Cache-Control"]);
+    NSDictionary *responseCacheControl = ZLHTTPParseCacheControl(ZLHTTPHeaderValue(response.allHeaderFields, @"Cache-Control"));
+    NSArray<NSString *> *varyFields = ZLHTTPVaryFields(response);
+    if (requestCacheControl[@"no-store"] != nil || responseCacheControl[@"no-store"] != nil || [varyFields containsObject:@"*"]) {
+        [self setMemoryCachedResponse:nil forKey:key];
+        dispatch_async(_ioQueue, ^{
+            [self loadDiskIndexIfNeeded];
+            [self removeDiskEntryForKey:key];
+        });
+        return nil;
+    }
+
+    NSMutableDictionary *varyHeaders = [NSMutableDictionary dictionaryWithCapacity:varyFields.count];
+    for (NSString *field in varyFields) {
+        varyHeaders[field] = [request valueForHTTPHeaderField:field] ?: @"";
+    }
+    ZLHTTPCachedResponse *cachedResponse = [[ZLHTTPCachedResponse alloc] initWithResponse:response data:[data copy] responseDate:[NSDate date] varyHeaders:varyHeaders];
+    [self setMemoryCachedResponse:cachedResponse forKey:key];
+    [self writeCachedResponse:cachedResponse forKey:key includingData:YES];
+    return cachedResponse;
+}
+
+- (ZLHTTPCachedResponse *)cachedResponse:(ZLHTTPCachedResponse *)cachedResponse
+        refreshedWithNotModifiedResponse:(NSHTTPURLResponse *)response
+                              forRequest:(NSURLRequest *)request {
+    // 304 中的头覆盖缓存的头，描述正文的头保持原样
+    NSMutableDictionary *headers = [cachedResponse.response.allHeaderFields mutableCopy] ?: [NSMutableDictionary dictionary];
+    NSSet *preservedFields = [NSSet setWithObjects:@"content-length", @"content-encoding", @"content-type", @"transfer-encoding", nil];
+    [response.allHeaderFields enumerateKeysAndObjectsUsingBlock:^(NSString *field, NSString *value, BOOL *stop) {
+        if ([preservedFields containsObject:field.lowercaseString]) {
+            return;
+        }
+        for (NSString *existingField in headers.allKeys) {
+            if ([existingField caseInsensitiveCompare:field] == NSOrderedSame) {
+                [headers removeObjectForKey:existingField];
+            }
+        }
+        headers[field] = value;
+    }];
+
+    NSHTTPURLResponse *mergedResponse = [[NSHTTPURLResponse alloc] initWithURL:cachedResponse.response.URL statusCode:cachedResponse.response.statusCode HTTPVersion:@"HTTP/1.1" headerFields:headers];
+    ZLHTTPCachedResponse *refreshedResponse = [[ZLHTTPCachedResponse alloc] initWithResponse:mergedResponse data:cachedResponse.data responseDate:[NSDate date] varyHeaders:cachedResponse.varyHeaders];
+    NSString *key = ZLHTTPCacheKeyForRequest(request);
+    [self setMemoryCachedResponse:refreshedResponse forKey:key];
+    [self writeCachedResponse:refreshedResponse forKey:key includingData:NO];
+    return refreshedResponse;
+}
+
+- (void)removeAllCachedResponses {
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    _header = nil;
+    _footer = nil;
+    _totalCost = 0;
+    NSMutableDictionary *nodes = _nodes;
+    _nodes = [NSMutableDictionary dictionary];
+    dispatch_semaphore_signal(_lock);
+    [nodes removeAllObjects];
+
+    dispatch_async(_ioQueue, ^{
+        [ZLURLSessionManager deleteDirPath:self->_directory];
+        [[NSFileManager defaultManager] createDirectoryAtPath:self->_directory withIntermediateDirectories:YES attributes:nil error:nil];
+        self->_diskIndex = [NSMutableDictionary dictionary];
+        self->_diskTotalSize = 0;
+    });
+}
+
++ (void)addConditionalHeadersFromCachedResponse:(ZLHTTPCachedResponse *)cachedResponse
+                                      toRequest:(NSMutableURLRequest *)request {
+    NSDictionary *headers = cachedResponse.response.allHeaderFields;
+    NSString *eTag = ZLHTTPHeaderValue(headers, @"ETag");
+    NSString *lastModified = ZLHTTPHeaderValue(headers, @"Last-Modified");
+    if (eTag.length > 0) {
+        [request setValue:eTag forHTTPHeaderField:@"If-None-Match"];
+    }
+    if (lastModified.length > 0) {
+        [request setValue:lastModified forHTTPHeaderField:@"If-Modified-Since"];
+    }
+}
+
++ (void)removeConditionalHeadersFromRequest:(NSMutableURLRequest *)request {
+    for (NSString *field in @[@"If-None-Match", @"If-Modified-Since", @"If-Match", @"If-Unmodified-Since", @"If-Range"]) {
+        [request setValue:nil forHTTPHeaderField:field];
+    }
+}
+
+@end
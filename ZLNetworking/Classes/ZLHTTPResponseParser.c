@@ -0,0 +1,172 @@
+//
+//  ZLHTTPResponseParser.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/29.
+//
+
+#include "ZLHTTPResponseParser.h"
+
+#include <string.h>
+
+/// RFC 7230 token 字符
+static bool ZLHTTPIsTokenChar(uint8_t c) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+        return true;
+    }
+    return c != 0 && strchr("!#$%&'*+-.^_`|~", c) != NULL;
+}
+
+static inline bool ZLHTTPIsWhitespace(uint8_t c) {
+    return c == ' ' || c == '\t';
+}
+
+static inline uint8_t ZLHTTPLowercase(uint8_t c) {
+    return (c >= 'A' && c <= 'Z') ? (uint8_t)(c + ('a' - 'A')) : c;
+}
+
+/// HTTP/1.x SP 3DIGIT [SP reason]
+static bool ZLHTTPParseStatusLine(ZLHTTPResponseHead *head, const uint8_t *line, size_t length, size_t offset) {
+    if (length < 12 || memcmp(line, "HTTP/1.", 7) != 0 || line[7] < '0' || line[7] > '9' || line[8] != ' ') {
+        return false;
+    }
+    int status = 0;
+    for (size_t i = 9; i < 12; i++) {
+        if (line[i] < '0' || line[i] > '9') {
+            return false;
+        }
+        status = status * 10 + (line[i] - '0');
+    }
+    head->minorVersion = line[7] - '0';
+    head->statusCode = status;
+    if (length == 12) {
+        head->reason.offset = offset + 12;
+        head->reason.length = 0;
+    } else if (line[12] == ' ') {
+        head->reason.offset = offset + 13;
+        head->reason.length = length - 13;
+    } else {
+        return false;
+    }
+    head->statusParsed = true;
+    return true;
+}
+
+/// name ":" OWS value OWS，不支持已废弃的折行
+static bool ZLHTTPParseHeaderLine(ZLHTTPResponseHead *head, const uint8_t *line, size_t length, size_t offset) {
+    if (head->headerCount == ZLHTTPResponseMaxHeaderCount) {
+        return false;
+    }
+    size_t colon = 0;
+    while (colon < length && ZLHTTPIsTokenChar(line[colon])) {
+        colon++;
+    }
+    if (colon == 0 || colon == length || line[colon] != ':') {
+        return false;
+    }
+    size_t start = colon + 1;
+    size_t end = length;
+    while (start < end && ZLHTTPIsWhitespace(line[start])) {
+        start++;
+    }
+    while (end > start && ZLHTTPIsWhitespace(line[end - 1])) {
+        end--;
+    }
+
+    ZLHTTPHeaderField *field = &head->headers[head->headerCount++];
+    field->name.offset = offset;
+    field->name.length = colon;
+    field->value.offset = offset + start;
+    field->value.length = end - start;
+    return true;
+}
+
+void ZLHTTPResponseHeadReset(ZLHTTPResponseHead *head) {
+    head->lineStart = 0;
+    head->searched = 0;
+    head->headLength = 0;
+    head->state = ZLHTTPParseIncomplete;
+    head->minorVersion = 0;
+    head->statusCode = 0;
+    head->reason.offset = 0;
+    head->reason.length = 0;
+    head->statusParsed = false;
+    head->headerCount = 0;
+}
+
+ZLHTTPParseResult ZLHTTPResponseHeadParse(ZLHTTPResponseHead *head, const uint8_t *data, size_t length) {
+    if (head->state != ZLHTTPParseIncomplete) {
+        return head->state;
+    }
+
+    while (head->searched < length) {
+        const uint8_t *newline = memchr(data + head->searched, '\n', length - head->searched);
+        if (newline == NULL) {
+            head->searched = length;
+            break;
+        }
+        size_t lineEnd = (size_t)(newline - data);
+        if (lineEnd >= ZLHTTPResponseMaxHeadLength) {
+            // 一次收到的数据里就有越过上限的行时，与分多次收到时一样出错
+            head->state = ZLHTTPParseError;
+            return head->state;
+        }
+        size_t lineStart = head->lineStart;
+        head->lineStart = lineEnd + 1;
+        head->searched = lineEnd + 1;
+
+        // 兼容只用 LF 换行的实现
+        size_t lineLength = lineEnd - lineStart;
+        if (lineLength > 0 && data[lineEnd - 1] == '\r') {
+            lineLength--;
+        }
+
+        const uint8_t *line = data + lineStart;
+        bool valid;
+        if (!head->statusParsed && lineLength == 0 && lineStart == 0) {
+            // RFC 7230 建议忽略状态行之前的空行
+            valid = true;
+        } else if (!head->statusParsed) {
+            valid = ZLHTTPParseStatusLine(head, line, lineLength, lineStart);
+        } else if (lineLength == 0) {
+            head->headLength = lineEnd + 1;
+            head->state = ZLHTTPParseComplete;
+            return head->state;
+        } else {
+            valid = ZLHTTPParseHeaderLine(head, line, lineLength, lineStart);
+        }
+        if (!valid) {
+            head->state = ZLHTTPParseError;
+            return head->state;
+        }
+    }
+
+    if (head->searched > ZLHTTPResponseMaxHeadLength) {
+        head->state = ZLHTTPParseError;
+    }
+    return head->state;
+}
+
+const ZLHTTPHeaderField *ZLHTTPResponseHeadFindField(const ZLHTTPResponseHead *head, const uint8_t *data, const char *name) {
+    for (size_t i = 0; i < head->headerCount; i++) {
+        if (ZLHTTPSpanEqualsIgnoringCase(data, head->headers[i].name, name)) {
+            return &head->headers[i];
+        }
+    }
+    return NULL;
+}
+
+bool ZLHTTPSpanEquals(const uint8_t *data, ZLHTTPSpan span, const void *bytes, size_t length) {
+    return span.length == length && memcmp(data + span.offset, bytes, length) == 0;
+}
+
+bool ZLHTTPSpanEqualsIgnoringCase(const uint8_t *data, ZLHTTPSpan span, const char *string) {
+    const uint8_t *p = data + span.offset;
+    size_t i = 0;
+    for (; i < span.length; i++) {
+        if (string[i] == '\0' || ZLHTTPLowercase(p[i]) != ZLHTTPLowercase((uint8_t)string[i])) {
+            return false;
+        }
+    }
+    return string[i] == '\0';
+}
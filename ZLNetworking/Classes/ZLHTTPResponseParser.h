@@ -0,0 +1,79 @@
+//
+//  ZLHTTPResponseParser.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/29.
+//
+
+#ifndef ZLHTTPResponseParser_h
+#define ZLHTTPResponseParser_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 最多记录的头部字段数，超过视为错误
+#define ZLHTTPResponseMaxHeaderCount 64
+
+/// 响应头（包括状态行和空行）的长度上限，超过视为错误
+#define ZLHTTPResponseMaxHeadLength (64 * 1024)
+
+typedef enum ZLHTTPParseResult {
+    ZLHTTPParseError = -1,
+    ZLHTTPParseIncomplete = 0,
+    ZLHTTPParseComplete = 1,
+} ZLHTTPParseResult;
+
+/// 数据中的一段，不拷贝字节
+typedef struct ZLHTTPSpan {
+    size_t offset;
+    size_t length;
+} ZLHTTPSpan;
+
+typedef struct ZLHTTPHeaderField {
+    ZLHTTPSpan name;
+    ZLHTTPSpan value;           // 已去掉首尾空白
+} ZLHTTPHeaderField;
+
+/// 可续接的 HTTP/1.x 响应头解析状态。每次传入从响应开头起收到的全部数据，
+/// 只解析上次之后的新行；字段以 span 记录在数据中的位置，不分配内存
+typedef struct ZLHTTPResponseHead {
+    size_t lineStart;           // 下一行的起点
+    size_t searched;            // 已经找过换行符的位置
+    size_t headLength;          // 完成后为包括空行在内的长度
+    ZLHTTPParseResult state;
+
+    int minorVersion;
+    int statusCode;
+    ZLHTTPSpan reason;
+    bool statusParsed;
+
+    ZLHTTPHeaderField headers[ZLHTTPResponseMaxHeaderCount];
+    size_t headerCount;
+} ZLHTTPResponseHead;
+
+/// 重置为初始状态
+void ZLHTTPResponseHeadReset(ZLHTTPResponseHead *head);
+
+/// data 为从响应开头起目前收到的全部数据，必须以上次传入的数据为前缀。
+/// 完成后 headLength 之后的字节属于响应体或后续协议，出错后状态不再变化
+ZLHTTPParseResult ZLHTTPResponseHeadParse(ZLHTTPResponseHead *head, const uint8_t *data, size_t length);
+
+/// 大小写不敏感地查找第一个名为 name 的字段，找不到返回 NULL
+const ZLHTTPHeaderField *ZLHTTPResponseHeadFindField(const ZLHTTPResponseHead *head, const uint8_t *data, const char *name);
+
+/// span 的内容是否与 bytes 完全相同
+bool ZLHTTPSpanEquals(const uint8_t *data, ZLHTTPSpan span, const void *bytes, size_t length);
+
+/// span 的内容是否与 ASCII 字符串 string 大小写不敏感地相同
+bool ZLHTTPSpanEqualsIgnoringCase(const uint8_t *data, ZLHTTPSpan span, const char *string);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLHTTPResponseParser_h */
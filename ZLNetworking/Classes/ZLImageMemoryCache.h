@@ -0,0 +1,31 @@
+//
+//  ZLImageMemoryCache.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2021/10/12.
+//
+
+#import <UIKit/UIKit.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// 按 identifier 哈希分片加锁的内存缓存，总字节数不超过 maxCost。
+/// 每个分片是字典索引 + 侵入式 LRU 双向链表，查找和插入都是 O(1)，不同分片的访问互不阻塞
+@interface ZLImageMemoryCache : NSObject
+
+/// 调小时立即淘汰到新的上限以内
+@property (nonatomic, assign) NSUInteger maxCost;
+
+- (instancetype)initWithMaxCost:(NSUInteger)maxCost;
+
+/// 命中时把节点移到所在分片的链表头部
+- (nullable UIImage *)imageForKey:(NSString *)key;
+
+/// 已存在同 key 的图片时不覆盖；单张超过 maxCost 的图片不缓存
+- (void)setImage:(UIImage *)image forKey:(NSString *)key;
+
+- (void)removeAllImages;
+
+@end
+
+NS_ASSUME_NONNULL_END
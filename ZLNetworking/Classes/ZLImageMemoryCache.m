@@ -0,0 +1,290 @@
+//
+//  ZLImageMemoryCache.m
+//  ZLNetworking
+//
+//  Created by lylaut on 2021/10/12.
+//
+
+#import "ZLImageMemoryCache.h"
+#import <QuartzCore/QuartzCore.h>
+#import <stdatomic.h>
+
+@interface ZLImageMemoryCacheNode : NSObject
+
+@property (nonatomic, strong) UIImage *image;
+
+@property (nonatomic, copy) NSString *identifier;
+
+@property (nonatomic, assign) NSUInteger memoryCost;
+
+@property (nonatomic, assign) CFTimeInterval timestamp;
+
+/// 节点由所在分片的字典持有，链表指针不持有节点
+@property (nonatomic, unsafe_unretained) ZLImageMemoryCacheNode *prev;
+
+@property (nonatomic, unsafe_unretained) ZLImageMemoryCacheNode *next;
+
+@end
+
+@implementation ZLImageMemoryCacheNode
+
+- (instancetype)initWithImage:(UIImage *)image identifier:(NSString *)identifier {
+    if (self = [super init]) {
+        self.image = image;
+        self.identifier = identifier;
+        self.timestamp = CACurrentMediaTime();
+        self.memoryCost = [[self class] memoryCacheCostForImage:image];
+    }
+    return self;
+}
+
++ (NSUInteger)memoryCacheCostForImage:(UIImage *)image {
+    CGImageRef imageRef = image.CGImage;
+    if (!imageRef) {
+        return 0;
+    }
+    NSUInteger bytesPerFrame = CGImageGetBytesPerRow(imageRef) * CGImageGetHeight(imageRef);
+    NSUInteger frameCount = image.images.count > 0 ? image.images.count : 1;
+
+    NSUInteger cost = bytesPerFrame * frameCount;
+    return cost;
+}
+
+@end
+
+/// 一个分片：哈希索引 + 侵入式 LRU 双向链表，所有操作 O(1)
+@interface ZLImageMemoryCacheShard : NSObject {
+    dispatch_semaphore_t _lock;
+    NSMutableDictionary<NSString *, ZLImageMemoryCacheNode *> *_nodes;
+    __unsafe_unretained ZLImageMemoryCacheNode *_header;
+    __unsafe_unretained ZLImageMemoryCacheNode *_footer;
+}
+
+- (UIImage *)imageForKey:(NSString *)key;
+
+/// 已存在同 key 节点时只更新访问时间并返回 NO
+- (BOOL)insertNode:(ZLImageMemoryCacheNode *)node;
+
+/// 最久未访问节点的时间戳，分片为空时返回 DBL_MAX
+- (CFTimeInterval)footerTimestamp;
+
+/// 淘汰最久未访问的节点，返回释放的字节数，分片为空时返回 0
+- (NSUInteger)evictFooter;
+
+/// 清空分片，返回释放的字节数
+- (NSUInteger)removeAllNodes;
+
+@end
+
+@implementation ZLImageMemoryCacheShard
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _lock = dispatch_semaphore_create(1);
+        _nodes = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (void)bringNodeToHeader:(ZLImageMemoryCacheNode *)node {
+    node.timestamp = CACurrentMediaTime();
+    if (node == _header) {
+        return;
+    }
+    if (node == _footer) {
+        _footer = node.prev;
+        _footer.next = nil;
+    } else {
+        node.prev.next = node.next;
+        node.next.prev = node.prev;
+    }
+    node.prev = nil;
+    node.next = _header;
+    _header.prev = node;
+    _header = node;
+}
+
+- (void)unlinkNode:(ZLImageMemoryCacheNode *)node {
+    if (node.prev) {
+        node.prev.next = node.next;
+    } else {
+        _header = node.next;
+    }
+    if (node.next) {
+        node.next.prev = node.prev;
+    } else {
+        _footer = node.prev;
+    }
+    node.prev = nil;
+    node.next = nil;
+}
+
+- (UIImage *)imageForKey:(NSString *)key {
+    UIImage *image = nil;
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    ZLImageMemoryCacheNode *node = _nodes[key];
+    if (node) {
+        [self bringNodeToHeader:node];
+        image = node.image;
+    }
+    dispatch_semaphore_signal(_lock);
+    return image;
+}
+
+- (BOOL)insertNode:(ZLImageMemoryCacheNode *)node {
+    BOOL inserted = NO;
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    ZLImageMemoryCacheNode *existing = _nodes[node.identifier];
+    if (existing) {
+        [self bringNodeToHeader:existing];
+    } else {
+        _nodes[node.identifier] = node;
+        node.next = _header;
+        _header.prev = node;
+        _header = node;
+        if (_footer == nil) {
+            _footer = node;
+        }
+        inserted = YES;
+    }
+    dispatch_semaphore_signal(_lock);
+    return inserted;
+}
+
+- (CFTimeInterval)footerTimestamp {
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    CFTimeInterval timestamp = _footer ? _footer.timestamp : DBL_MAX;
+    dispatch_semaphore_signal(_lock);
+    return timestamp;
+}
+
+- (NSUInteger)evictFooter {
+    NSUInteger cost = 0;
+    ZLImageMemoryCacheNode *node = nil;
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    node = _footer;
+    if (node) {
+        cost = node.memoryCost;
+        [self unlinkNode:node];
+        [_nodes removeObjectForKey:node.identifier];
+    }
+    dispatch_semaphore_signal(_lock);
+    return cost;
+}
+
+- (NSUInteger)removeAllNodes {
+    NSUInteger cost = 0;
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    for (ZLImageMemoryCacheNode *node = _header; node; node = node.next) {
+        cost += node.memoryCost;
+    }
+    _header = nil;
+    _footer = nil;
+    NSMutableDictionary *nodes = _nodes;
+    _nodes = [NSMutableDictionary dictionary];
+    dispatch_semaphore_signal(_lock);
+    // 在锁外释放图片
+    [nodes removeAllObjects];
+    return cost;
+}
+
+@end
+
+static const NSUInteger ZLImageMemoryCacheShardCount = 16;
+
+@implementation ZLImageMemoryCache {
+    NSArray<ZLImageMemoryCacheShard *> *_shards;
+    _Atomic(NSUInteger) _totalCost;
+    _Atomic(NSUInteger) _maxCost;
+}
+
+- (instancetype)initWithMaxCost:(NSUInteger)maxCost {
+    if (self = [super init]) {
+        NSMutableArray *shards = [NSMutableArray arrayWithCapacity:ZLImageMemoryCacheShardCount];
+        for (NSUInteger i = 0; i < ZLImageMemoryCacheShardCount; i++) {
+            [shards addObject:[ZLImageMemoryCacheShard new]];
+        }
+        _shards = [shards copy];
+        atomic_init(&_totalCost, 0);
+        atomic_init(&_maxCost, maxCost);
+    }
+    return self;
+}
+
+- (ZLImageMemoryCacheShard *)shardForKey:(NSString *)key {
+    return _shards[key.hash % ZLImageMemoryCacheShardCount];
+}
+
+- (UIImage *)imageForKey:(NSString *)key {
+    if (key == nil) {
+        return nil;
+    }
+    return [[self shardForKey:key] imageForKey:key];
+}
+
+/// 从各分片尾部中挑最久未访问的一个淘汰，近似全局 LRU
+- (BOOL)evictOldest {
+    ZLImageMemoryCacheShard *oldestShard = nil;
+    CFTimeInterval oldestTimestamp = DBL_MAX;
+    for (ZLImageMemoryCacheShard *shard in _shards) {
+        CFTimeInterval timestamp = [shard footerTimestamp];
+        if (timestamp < oldestTimestamp) {
+            oldestTimestamp = timestamp;
+            oldestShard = shard;
+        }
+    }
+    if (oldestShard == nil) {
+        return NO;
+    }
+    NSUInteger cost = [oldestShard evictFooter];
+    atomic_fetch_sub(&_totalCost, cost);
+    return YES;
+}
+
+- (void)trimToCost:(NSUInteger)cost {
+    while (atomic_load(&_totalCost) > cost) {
+        if (![self evictOldest]) {
+            break;
+        }
+    }
+}
+
+- (NSUInteger)maxCost {
+    return atomic_load(&_maxCost);
+}
+
+- (void)setMaxCost:(NSUInteger)maxCost {
+    atomic_store(&_maxCost, maxCost);
+    [self trimToCost:maxCost];
+}
+
+- (void)setImage:(UIImage *)image forKey:(NSString *)key {
+    if (image == nil || key == nil) {
+        return;
+    }
+    ZLImageMemoryCacheShard *shard = [self shardForKey:key];
+    if ([shard imageForKey:key] != nil) {
+        return;
+    }
+
+    ZLImageMemoryCacheNode *node = [[ZLImageMemoryCacheNode alloc] initWithImage:image identifier:key];
+    NSUInteger maxCost = self.maxCost;
+    if (node.memoryCost >= maxCost) {
+        return;
+    }
+
+    // 先预占字节数再淘汰，保证已缓存的总量始终不超过 maxCost
+    atomic_fetch_add(&_totalCost, node.memoryCost);
+    [self trimToCost:maxCost];
+    if (atomic_load(&_totalCost) > maxCost || ![shard insertNode:node]) {
+        atomic_fetch_sub(&_totalCost, node.memoryCost);
+    }
+}
+
+- (void)removeAllImages {
+    for (ZLImageMemoryCacheShard *shard in _shards) {
+        atomic_fetch_sub(&_totalCost, [shard removeAllNodes]);
+    }
+}
+
+@end
@@ -0,0 +1,91 @@
+//
+//  ZLJSONStreamScanner.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/9.
+//
+
+#include "ZLJSONStreamScanner.h"
+
+void ZLJSONStreamScannerReset(ZLJSONStreamScanner *scanner) {
+    scanner->depth = 0;
+    scanner->container = 0;
+    scanner->inString = false;
+    scanner->escaped = false;
+    scanner->closed = false;
+}
+
+static inline bool ZLJSONIsSpace(uint8_t c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+ZLJSONScanResult ZLJSONStreamScannerScan(ZLJSONStreamScanner *scanner, const uint8_t *bytes, size_t length, size_t *consumed) {
+    size_t i = 0;
+    for (; i < length; i++) {
+        uint8_t c = bytes[i];
+        if (scanner->inString) {
+            if (scanner->escaped) {
+                scanner->escaped = false;
+            } else if (c == '\\') {
+                scanner->escaped = true;
+            } else if (c == '"') {
+                scanner->inString = false;
+            }
+            continue;
+        }
+
+        if (ZLJSONIsSpace(c)) {
+            continue;
+        }
+        if (scanner->closed) {
+            *consumed = i;
+            return ZLJSONScanError;
+        }
+        if (scanner->container == 0) {
+            if (c != '[' && c != '{') {
+                *consumed = i;
+                return ZLJSONScanScalar;
+            }
+            scanner->container = c;
+            scanner->depth = 1;
+            *consumed = i + 1;
+            return ZLJSONScanBegin;
+        }
+
+        switch (c) {
+            case '"':
+                scanner->inString = true;
+                break;
+            case '[':
+            case '{':
+                if (scanner->depth == UINT32_MAX) {
+                    *consumed = i;
+                    return ZLJSONScanError;
+                }
+                scanner->depth++;
+                break;
+            case ']':
+            case '}':
+                scanner->depth--;
+                if (scanner->depth == 0) {
+                    *consumed = i + 1;
+                    if ((scanner->container == '[') != (c == ']')) {
+                        return ZLJSONScanError;
+                    }
+                    scanner->closed = true;
+                    return ZLJSONScanEnd;
+                }
+                break;
+            case ',':
+                if (scanner->depth == 1) {
+                    *consumed = i + 1;
+                    return ZLJSONScanSeparator;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    *consumed = i;
+    return ZLJSONScanNeedMoreData;
+}
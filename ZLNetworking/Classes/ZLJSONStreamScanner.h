@@ -0,0 +1,47 @@
+//
+//  ZLJSONStreamScanner.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/9.
+//
+
+#ifndef ZLJSONStreamScanner_h
+#define ZLJSONStreamScanner_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 流式扫描 JSON 文档的顶层结构，找出最外层数组/对象中每个成员的边界，成员本身交给完整的 JSON 解析器。
+/// 只跟踪字符串、转义和括号深度，不做完整的语法校验
+typedef enum ZLJSONScanResult {
+    ZLJSONScanNeedMoreData = 0,
+    ZLJSONScanBegin,        // 读到了最外层的 [ 或 {
+    ZLJSONScanSeparator,    // 读到了最外层的 ,，之前的字节是一个完整成员
+    ZLJSONScanEnd,          // 读到了最外层的 ] 或 }，之前的字节是最后一个成员（可能为空）
+    ZLJSONScanScalar,       // 顶层不是数组或对象，需要整体解析
+    ZLJSONScanError,
+} ZLJSONScanResult;
+
+typedef struct ZLJSONStreamScanner {
+    uint32_t depth;
+    uint8_t container;  // 最外层的 [ 或 {，0 表示还未开始
+    bool inString;
+    bool escaped;
+    bool closed;
+} ZLJSONStreamScanner;
+
+void ZLJSONStreamScannerReset(ZLJSONStreamScanner *scanner);
+
+/// 从 bytes 开始扫描，*consumed 返回本次消耗的字节数，Begin/Separator/End 时包含对应的括号或逗号
+ZLJSONScanResult ZLJSONStreamScannerScan(ZLJSONStreamScanner *scanner, const uint8_t *bytes, size_t length, size_t *consumed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLJSONStreamScanner_h */
@@ -48,6 +48,18 @@ extern BOOL ZLImageHasAlpha(CGImageRef _Nullable image);
 /// 缓存的最大值 默认 设备物理内存的1/4
 @property (nonatomic, assign) NSUInteger maxMemoryCacheBytes;
 
+/// 磁盘缓存的最大值 默认 200MB，超过时从最久未访问的图片开始删除
+@property (nonatomic, assign) unsigned long long maxDiskCacheBytes;
+
+/// 磁盘缓存中超过这么久没有访问的图片会被删除 默认 7天，0 表示不限
+@property (nonatomic, assign) NSTimeInterval maxDiskCacheAge;
+
+/// 是否把解码、缩放、圆角处理后的位图也持久化，冷启动时直接映射使用而不用重新解码 默认 NO
+@property (nonatomic, assign) BOOL decodedDiskCacheEnabled;
+
+/// 持久化位图缓存的最大值 默认 100MB
+@property (nonatomic, assign) unsigned long long maxDecodedDiskCacheBytes;
+
 + (instancetype _Nonnull)shared;
 
 - (void)clearDiskCache;
@@ -69,6 +81,21 @@ extern BOOL ZLImageHasAlpha(CGImageRef _Nullable image);
 
 @interface ZLAnimatedImageView : UIImageView
 
+/// 所有动图视图共享的解码帧内存上限，由正在播放的动图平分 默认 min(物理内存的20%, 可用内存的60%)
+@property (class, nonatomic, assign) NSUInteger maxFrameBufferBytes;
+
+/// 累计掉帧数：到了切换时间而下一帧还没有解码好的刷新次数
+@property (class, nonatomic, assign, readonly) NSUInteger droppedFrameCount;
+
+/// 累计解码的帧数
+@property (class, nonatomic, assign, readonly) NSUInteger decodedFrameCount;
+
+/// 从提交解码到解码完成的平均耗时
+@property (class, nonatomic, assign, readonly) NSTimeInterval averageFrameDecodeLatency;
+
+/// 从提交解码到解码完成的最长耗时
+@property (class, nonatomic, assign, readonly) NSTimeInterval maxFrameDecodeLatency;
+
 @end
 
 typedef NS_ENUM(NSInteger, ZLNetImageViewContentMode) {
@@ -140,6 +167,20 @@ typedef NS_ENUM(NSInteger, ZLNetImageViewContentMode) {
                   progress:(nullable void (^)(float progress))progressBlock
                  completed:(nullable void (^)(UIImage * _Nullable image, NSError * _Nullable error))completedBlock;
 
+/**
+ * Same as `zl_setImageWithURL:placeholderImage:progress:completed:`, and additionally renders
+ * progressive JPEG / interlaced PNG images while they are still downloading.
+ *
+ * @param partialImageBlock A block called on the main queue each time a partial image has been decoded from the
+ *                          bytes received so far. The partial image is set on the image view before the block is called.
+ *                          Pass nil to disable incremental decoding.
+ */
+- (void)zl_setImageWithURL:(nullable NSURL *)url
+          placeholderImage:(nullable UIImage *)placeholder
+                  progress:(nullable void (^)(float progress))progressBlock
+              partialImage:(nullable void (^)(UIImage *partialImage))partialImageBlock
+                 completed:(nullable void (^)(UIImage * _Nullable image, NSError * _Nullable error))completedBlock;
+
 - (void)zl_setImageWithURL:(nullable NSURL *)url
           placeholderImage:(nullable UIImage *)placeholder;
 
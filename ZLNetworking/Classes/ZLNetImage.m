@@ -9,7 +9,14 @@
 #import "ZLNetImage.h"
 #import <objc/runtime.h>
 #import <mach/mach.h>
+#import <stdatomic.h>
 #import "ZLURLSessionManager.h"
+#import "ZLDiskCache.h"
+#import "ZLImageMemoryCache.h"
+#import "ZLDecodedImageCache.h"
+#import "ZLGIFDecoder.h"
+#import "ZLAPNGDecoder.h"
+#import "ZLWebPDecoder.h"
 
 #define ZL_CSTR(str) #str
 #define ZL_NSSTRING(str) @(ZL_CSTR(str))
@@ -288,6 +295,163 @@ static inline CGImageRef CGImageCreateDecoded(CGImageRef cgImage, CGImagePropert
     return newImageRef;
 }
 
+/// 画布像素本身就是 BGRA8888（预乘）格式，拷贝一份即可显示，不需要再解码
+static CGImageRef ZLCreateImageFromCanvasPixels(const uint32_t *pixels, size_t width, size_t height) {
+    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst;
+    CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, ZLColorSpaceGetDeviceRGB(), bitmapInfo);
+    if (!context) {
+        return NULL;
+    }
+    uint8_t *bytes = CGBitmapContextGetData(context);
+    size_t bytesPerRow = CGBitmapContextGetBytesPerRow(context);
+    for (size_t row = 0; row < height; row++) {
+        memcpy(bytes + row * bytesPerRow, pixels + row * width, width * sizeof(uint32_t));
+    }
+    CGImageRef imageRef = CGBitmapContextCreateImage(context);
+    CGContextRelease(context);
+    return imageRef;
+}
+
+/// ZLGIFDecoder、ZLAPNGDecoder 和 ZLWebPDecoder 的接口一一对应，ZLAnimatedImage 通过这张表使用它们，合成和画布复用的逻辑只写一份
+typedef struct ZLFrameCodec {
+    void *(*decoderCreate)(void);
+    void (*decoderDestroy)(void *decoder);
+    bool (*decoderAppend)(void *decoder, const uint8_t *bytes, size_t length);
+    size_t (*decoderDataLength)(const void *decoder);
+    bool (*decoderIsComplete)(const void *decoder);
+    uint32_t (*decoderWidth)(const void *decoder);
+    uint32_t (*decoderHeight)(const void *decoder);
+    uint32_t (*decoderLoopCount)(const void *decoder);
+    size_t (*decoderFrameCount)(const void *decoder);
+    uint32_t (*decoderFrameDuration)(const void *decoder, size_t index);
+    void *(*canvasCreate)(const void *decoder);
+    void (*canvasDestroy)(void *canvas);
+    void (*canvasReset)(void *canvas);
+    size_t (*canvasNextFrameIndex)(const void *canvas);
+    bool (*canvasRenderNextFrame)(void *canvas, const void *decoder);
+    const uint32_t *(*canvasPixels)(const void *canvas);
+} ZLFrameCodec;
+
+static void *ZLGIFCodecDecoderCreate(void) { return ZLGIFDecoderCreate(); }
+static void ZLGIFCodecDecoderDestroy(void *decoder) { ZLGIFDecoderDestroy(decoder); }
+static bool ZLGIFCodecDecoderAppend(void *decoder, const uint8_t *bytes, size_t length) { return ZLGIFDecoderAppend(decoder, bytes, length); }
+static size_t ZLGIFCodecDecoderDataLength(const void *decoder) { return ZLGIFDecoderDataLength(decoder); }
+static bool ZLGIFCodecDecoderIsComplete(const void *decoder) { return ZLGIFDecoderIsComplete(decoder); }
+static uint32_t ZLGIFCodecDecoderWidth(const void *decoder) { return ZLGIFDecoderWidth(decoder); }
+static uint32_t ZLGIFCodecDecoderHeight(const void *decoder) { return ZLGIFDecoderHeight(decoder); }
+static uint32_t ZLGIFCodecDecoderLoopCount(const void *decoder) { return ZLGIFDecoderLoopCount(decoder); }
+static size_t ZLGIFCodecDecoderFrameCount(const void *decoder) { return ZLGIFDecoderFrameCount(decoder); }
+static uint32_t ZLGIFCodecDecoderFrameDuration(const void *decoder, size_t index) { return ZLGIFDecoderFrameDuration(decoder, index); }
+static void *ZLGIFCodecCanvasCreate(const void *decoder) { return ZLGIFCanvasCreate(decoder); }
+static void ZLGIFCodecCanvasDestroy(void *canvas) { ZLGIFCanvasDestroy(canvas); }
+static void ZLGIFCodecCanvasReset(void *canvas) { ZLGIFCanvasReset(canvas); }
+static size_t ZLGIFCodecCanvasNextFrameIndex(const void *canvas) { return ZLGIFCanvasNextFrameIndex(canvas); }
+static bool ZLGIFCodecCanvasRenderNextFrame(void *canvas, const void *decoder) { return ZLGIFCanvasRenderNextFrame(canvas, decoder, NULL); }
+static const uint32_t *ZLGIFCodecCanvasPixels(const void *canvas) { return ZLGIFCanvasPixels(canvas); }
+
+static const ZLFrameCodec ZLGIFCodec = {
+    ZLGIFCodecDecoderCreate, ZLGIFCodecDecoderDestroy, ZLGIFCodecDecoderAppend, ZLGIFCodecDecoderDataLength,
+    ZLGIFCodecDecoderIsComplete, ZLGIFCodecDecoderWidth, ZLGIFCodecDecoderHeight, ZLGIFCodecDecoderLoopCount,
+    ZLGIFCodecDecoderFrameCount, ZLGIFCodecDecoderFrameDuration, ZLGIFCodecCanvasCreate, ZLGIFCodecCanvasDestroy,
+    ZLGIFCodecCanvasReset, ZLGIFCodecCanvasNextFrameIndex, ZLGIFCodecCanvasRenderNextFrame, ZLGIFCodecCanvasPixels,
+};
+
+static void *ZLAPNGCodecDecoderCreate(void) { return ZLAPNGDecoderCreate(); }
+static void ZLAPNGCodecDecoderDestroy(void *decoder) { ZLAPNGDecoderDestroy(decoder); }
+static bool ZLAPNGCodecDecoderAppend(void *decoder, const uint8_t *bytes, size_t length) { return ZLAPNGDecoderAppend(decoder, bytes, length); }
+static size_t ZLAPNGCodecDecoderDataLength(const void *decoder) { return ZLAPNGDecoderDataLength(decoder); }
+static bool ZLAPNGCodecDecoderIsComplete(const void *decoder) { return ZLAPNGDecoderIsComplete(decoder); }
+static uint32_t ZLAPNGCodecDecoderWidth(const void *decoder) { return ZLAPNGDecoderWidth(decoder); }
+static uint32_t ZLAPNGCodecDecoderHeight(const void *decoder) { return ZLAPNGDecoderHeight(decoder); }
+static uint32_t ZLAPNGCodecDecoderLoopCount(const void *decoder) { return ZLAPNGDecoderLoopCount(decoder); }
+static size_t ZLAPNGCodecDecoderFrameCount(const void *decoder) { return ZLAPNGDecoderFrameCount(decoder); }
+static uint32_t ZLAPNGCodecDecoderFrameDuration(const void *decoder, size_t index) { return ZLAPNGDecoderFrameDuration(decoder, index); }
+static void *ZLAPNGCodecCanvasCreate(const void *decoder) { return ZLAPNGCanvasCreate(decoder); }
+static void ZLAPNGCodecCanvasDestroy(void *canvas) { ZLAPNGCanvasDestroy(canvas); }
+static void ZLAPNGCodecCanvasReset(void *canvas) { ZLAPNGCanvasReset(canvas); }
+static size_t ZLAPNGCodecCanvasNextFrameIndex(const void *canvas) { return ZLAPNGCanvasNextFrameIndex(canvas); }
+static bool ZLAPNGCodecCanvasRenderNextFrame(void *canvas, const void *decoder) { return ZLAPNGCanvasRenderNextFrame(canvas, decoder, NULL); }
+static const uint32_t *ZLAPNGCodecCanvasPixels(const void *canvas) { return ZLAPNGCanvasPixels(canvas); }
+
+static const ZLFrameCodec ZLAPNGCodec = {
+    ZLAPNGCodecDecoderCreate, ZLAPNGCodecDecoderDestroy, ZLAPNGCodecDecoderAppend, ZLAPNGCodecDecoderDataLength,
+    ZLAPNGCodecDecoderIsComplete, ZLAPNGCodecDecoderWidth, ZLAPNGCodecDecoderHeight, ZLAPNGCodecDecoderLoopCount,
+    ZLAPNGCodecDecoderFrameCount, ZLAPNGCodecDecoderFrameDuration, ZLAPNGCodecCanvasCreate, ZLAPNGCodecCanvasDestroy,
+    ZLAPNGCodecCanvasReset, ZLAPNGCodecCanvasNextFrameIndex, ZLAPNGCodecCanvasRenderNextFrame, ZLAPNGCodecCanvasPixels,
+};
+
+/// WebP 的帧码流交给 ImageIO 解码，画进调用方的缓冲区；CGImage 在返回前就释放了，不会再引用 bytes
+static bool ZLWebPDecodeFrameWithImageIO(const uint8_t *bytes, size_t length, uint32_t width, uint32_t height, uint32_t *pixels, void *info) {
+    (void)info;
+    CFDataRef data = CFDataCreateWithBytesNoCopy(NULL, bytes, length, kCFAllocatorNull);
+    if (!data) {
+        return false;
+    }
+    CGImageSourceRef source = CGImageSourceCreateWithData(data, NULL);
+    CFRelease(data);
+    if (!source) {
+        return false;
+    }
+    CGImageRef imageRef = CGImageSourceCreateImageAtIndex(source, 0, NULL);
+    CFRelease(source);
+    if (!imageRef) {
+        return false;
+    }
+    memset(pixels, 0, (size_t)width * height * sizeof(uint32_t));
+    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst;
+    CGContextRef context = CGBitmapContextCreate(pixels, width, height, 8, width * sizeof(uint32_t), ZLColorSpaceGetDeviceRGB(), bitmapInfo);
+    if (!context) {
+        CGImageRelease(imageRef);
+        return false;
+    }
+    CGContextDrawImage(context, CGRectMake(0, 0, width, height), imageRef);
+    CGContextRelease(context);
+    CGImageRelease(imageRef);
+    return true;
+}
+
+static void *ZLWebPCodecDecoderCreate(void) { return ZLWebPDecoderCreate(ZLWebPDecodeFrameWithImageIO, NULL); }
+static void ZLWebPCodecDecoderDestroy(void *decoder) { ZLWebPDecoderDestroy(decoder); }
+static bool ZLWebPCodecDecoderAppend(void *decoder, const uint8_t *bytes, size_t length) { return ZLWebPDecoderAppend(decoder, bytes, length); }
+static size_t ZLWebPCodecDecoderDataLength(const void *decoder) { return ZLWebPDecoderDataLength(decoder); }
+static bool ZLWebPCodecDecoderIsComplete(const void *decoder) { return ZLWebPDecoderIsComplete(decoder); }
+static uint32_t ZLWebPCodecDecoderWidth(const void *decoder) { return ZLWebPDecoderWidth(decoder); }
+static uint32_t ZLWebPCodecDecoderHeight(const void *decoder) { return ZLWebPDecoderHeight(decoder); }
+static uint32_t ZLWebPCodecDecoderLoopCount(const void *decoder) { return ZLWebPDecoderLoopCount(decoder); }
+static size_t ZLWebPCodecDecoderFrameCount(const void *decoder) { return ZLWebPDecoderFrameCount(decoder); }
+static uint32_t ZLWebPCodecDecoderFrameDuration(const void *decoder, size_t index) { return ZLWebPDecoderFrameDuration(decoder, index); }
+static void *ZLWebPCodecCanvasCreate(const void *decoder) { return ZLWebPCanvasCreate(decoder); }
+static void ZLWebPCodecCanvasDestroy(void *canvas) { ZLWebPCanvasDestroy(canvas); }
+static void ZLWebPCodecCanvasReset(void *canvas) { ZLWebPCanvasReset(canvas); }
+static size_t ZLWebPCodecCanvasNextFrameIndex(const void *canvas) { return ZLWebPCanvasNextFrameIndex(canvas); }
+static bool ZLWebPCodecCanvasRenderNextFrame(void *canvas, const void *decoder) { return ZLWebPCanvasRenderNextFrame(canvas, decoder, NULL); }
+static const uint32_t *ZLWebPCodecCanvasPixels(const void *canvas) { return ZLWebPCanvasPixels(canvas); }
+
+static const ZLFrameCodec ZLWebPCodec = {
+    ZLWebPCodecDecoderCreate, ZLWebPCodecDecoderDestroy, ZLWebPCodecDecoderAppend, ZLWebPCodecDecoderDataLength,
+    ZLWebPCodecDecoderIsComplete, ZLWebPCodecDecoderWidth, ZLWebPCodecDecoderHeight, ZLWebPCodecDecoderLoopCount,
+    ZLWebPCodecDecoderFrameCount, ZLWebPCodecDecoderFrameDuration, ZLWebPCodecCanvasCreate, ZLWebPCodecCanvasDestroy,
+    ZLWebPCodecCanvasReset, ZLWebPCodecCanvasNextFrameIndex, ZLWebPCodecCanvasRenderNextFrame, ZLWebPCodecCanvasPixels,
+};
+
+/// 自己解码的动图格式，其他格式返回 NULL，交给 ImageIO
+static const ZLFrameCodec *ZLFrameCodecForImageData(NSData *data) {
+    switch (zl_imageFormatForImageData(data)) {
+        case ZLImageFormatGIF:
+            return &ZLGIFCodec;
+        case ZLImageFormatPNG:
+            return ZLAPNGSniff(data.bytes, data.length) == ZLAPNGSniffAnimated ? &ZLAPNGCodec : NULL;
+        case ZLImageFormatWebP:
+            // 帧码流靠 ImageIO 解码，iOS 14 之前的系统不认识 WebP
+            if (@available(iOS 14.0, *)) {
+                return ZLWebPSniff(data.bytes, data.length) == ZLWebPSniffAnimated ? &ZLWebPCodec : NULL;
+            }
+            return NULL;
+        default:
+            return NULL;
+    }
+}
+
 @interface ZLGIFCoderFrame : NSObject
 
 @property (nonatomic, assign) NSUInteger index;
@@ -299,10 +463,25 @@ static inline CGImageRef CGImageCreateDecoded(CGImageRef cgImage, CGImagePropert
 
 @end
 
+/// 同一张动图最多同时保留的画布数，多个视图播放到不同位置时各用一块，不必从头合成
+#define ZLFrameCanvasCount 2
+
 @interface ZLAnimatedImage ()
 
+/// 帧已经是可以直接显示的位图，不需要再解码
+@property (nonatomic, assign, readonly) BOOL framesDecoded;
+
+/// 数据还没有下载完，帧数还会增加
+@property (nonatomic, assign, readonly, getter=isIncomplete) BOOL incomplete;
+
 + (float)frameDurationAtIndex:(NSUInteger)index source:(CGImageSourceRef)source;
 
+/// data 为目前为止收到的全部数据，第一帧还没收全时返回 nil；只支持 GIF 和 APNG
+- (nullable instancetype)initWithIncrementalData:(NSData *)data scale:(CGFloat)scale;
+
+/// data 为目前为止收到的全部数据
+- (void)updateWithData:(NSData *)data finished:(BOOL)finished;
+
 @end
 
 @implementation ZLAnimatedImage {
@@ -311,22 +490,48 @@ static inline CGImageRef CGImageCreateDecoded(CGImageRef cgImage, CGImagePropert
   NSUInteger _loopCount;
   NSUInteger _frameCount;
   NSArray<ZLGIFCoderFrame *> *_frames;
+  /// 保护帧数、时长等信息，主线程读取时不会被正在合成的帧阻塞
+  dispatch_semaphore_t _frameInfoLock;
+  BOOL _incomplete;
+
+  /// GIF、APNG 和动画 WebP 用自己的解码器边下载边解码，其他格式用 ImageIO
+  const ZLFrameCodec *_codec;
+  void *_decoder;
+  void *_canvases[ZLFrameCanvasCount];
+  dispatch_semaphore_t _decoderLock;
 }
 
 - (instancetype)initWithData:(NSData *)data scale:(CGFloat)scale {
+    return [self initWithData:data scale:scale finished:YES];
+}
+
+- (instancetype)initWithIncrementalData:(NSData *)data scale:(CGFloat)scale {
+    return [self initWithData:data scale:scale finished:NO];
+}
+
+- (instancetype)initWithData:(NSData *)data scale:(CGFloat)scale finished:(BOOL)finished {
     if (self = [super init]) {
-        CGImageSourceRef imageSource = CGImageSourceCreateWithData((__bridge CFDataRef)data, NULL);
-        if (!imageSource) {
+        _scale = MAX(scale, 1);
+        _frameInfoLock = dispatch_semaphore_create(1);
+        const ZLFrameCodec *codec = ZLFrameCodecForImageData(data);
+        if (codec && [self setUpDecoderWithCodec:codec data:data finished:finished]) {
+            _framesDecoded = YES;
+        } else if (!finished) {
             return nil;
-        }
+        } else {
+            CGImageSourceRef imageSource = CGImageSourceCreateWithData((__bridge CFDataRef)data, NULL);
+            if (!imageSource) {
+                return nil;
+            }
 
-        BOOL framesValid = [self scanAndCheckFramesValidWithSource:imageSource];
-        if (!framesValid) {
-            CFRelease(imageSource);
-            return nil;
-        }
+            BOOL framesValid = [self scanAndCheckFramesValidWithSource:imageSource];
+            if (!framesValid) {
+                CFRelease(imageSource);
+                return nil;
+            }
 
-        _imageSource = imageSource;
+            _imageSource = imageSource;
+        }
 
         // grab image at the first index
         UIImage *image = [self animatedImageFrameAtIndex:0];
@@ -363,16 +568,126 @@ static inline CGImageRef CGImageCreateDecoded(CGImageRef cgImage, CGImagePropert
     return YES;
 }
 
+- (BOOL)setUpDecoderWithCodec:(const ZLFrameCodec *)codec data:(NSData *)data finished:(BOOL)finished {
+    void *decoder = codec->decoderCreate();
+    if (decoder == NULL) {
+        return NO;
+    }
+    codec->decoderAppend(decoder, data.bytes, data.length);
+    // 数据损坏到一帧都解析不出来时交给 ImageIO 兜底
+    if (codec->decoderFrameCount(decoder) == 0) {
+        codec->decoderDestroy(decoder);
+        return NO;
+    }
+    _codec = codec;
+    _decoder = decoder;
+    _decoderLock = dispatch_semaphore_create(1);
+    [self updateFrameInfoFinished:finished];
+    return YES;
+}
+
+/// 调用时持有 _decoderLock
+- (void)updateFrameInfoFinished:(BOOL)finished {
+    size_t frameCount = _codec->decoderFrameCount(_decoder);
+    NSMutableArray<ZLGIFCoderFrame *> *frames = _frames ? [_frames mutableCopy] : [NSMutableArray array];
+    for (size_t i = frames.count; i < frameCount; i++) {
+        ZLGIFCoderFrame *frame = [[ZLGIFCoderFrame alloc] init];
+        frame.index = i;
+        frame.duration = _codec->decoderFrameDuration(_decoder, i) / 1000.0;
+        [frames addObject:frame];
+    }
+
+    dispatch_semaphore_wait(_frameInfoLock, DISPATCH_TIME_FOREVER);
+    _frames = [frames copy];
+    _frameCount = frameCount;
+    _loopCount = _codec->decoderLoopCount(_decoder);
+    _incomplete = !finished && !_codec->decoderIsComplete(_decoder);
+    dispatch_semaphore_signal(_frameInfoLock);
+}
+
+- (void)updateWithData:(NSData *)data finished:(BOOL)finished {
+    if (_decoder == NULL) {
+        return;
+    }
+    dispatch_semaphore_wait(_decoderLock, DISPATCH_TIME_FOREVER);
+    // 数据快照可能乱序到达，只追加比已有数据多出来的部分
+    size_t length = _codec->decoderDataLength(_decoder);
+    if (data.length > length) {
+        _codec->decoderAppend(_decoder, (const uint8_t *)data.bytes + length, data.length - length);
+    }
+    [self updateFrameInfoFinished:finished];
+    dispatch_semaphore_signal(_decoderLock);
+}
+
+- (BOOL)isIncomplete {
+    dispatch_semaphore_wait(_frameInfoLock, DISPATCH_TIME_FOREVER);
+    BOOL incomplete = _incomplete;
+    dispatch_semaphore_signal(_frameInfoLock);
+    return incomplete;
+}
+
+/// 合成一帧需要从前面某一帧开始按顺序叠加，挑一块不用回退的画布继续合成
+- (UIImage *)canvasFrameAtIndex:(NSUInteger)index {
+    dispatch_semaphore_wait(_decoderLock, DISPATCH_TIME_FOREVER);
+    NSInteger best = -1;
+    NSInteger empty = -1;
+    NSInteger earliest = -1;
+    for (NSInteger i = 0; i < ZLFrameCanvasCount; i++) {
+        if (_canvases[i] == NULL) {
+            if (empty < 0) {
+                empty = i;
+            }
+            continue;
+        }
+        size_t next = _codec->canvasNextFrameIndex(_canvases[i]);
+        if (next <= index + 1 && (best < 0 || next > _codec->canvasNextFrameIndex(_canvases[best]))) {
+            best = i;
+        }
+        if (earliest < 0 || next < _codec->canvasNextFrameIndex(_canvases[earliest])) {
+            earliest = i;
+        }
+    }
+    if (best < 0 && empty >= 0) {
+        _canvases[empty] = _codec->canvasCreate(_decoder);
+        best = _canvases[empty] ? empty : -1;
+    }
+    if (best < 0 && earliest >= 0) {
+        best = earliest;
+        _codec->canvasReset(_canvases[best]);
+    }
+
+    CGImageRef imageRef = NULL;
+    if (best >= 0) {
+        void *canvas = _canvases[best];
+        while (_codec->canvasNextFrameIndex(canvas) <= index && _codec->canvasRenderNextFrame(canvas, _decoder)) {
+        }
+        if (_codec->canvasNextFrameIndex(canvas) == index + 1) {
+            imageRef = ZLCreateImageFromCanvasPixels(_codec->canvasPixels(canvas), _codec->decoderWidth(_decoder), _codec->decoderHeight(_decoder));
+        }
+    }
+    dispatch_semaphore_signal(_decoderLock);
+
+    if (!imageRef) {
+        return nil;
+    }
+    UIImage *image = [[UIImage alloc] initWithCGImage:imageRef scale:_scale orientation:UIImageOrientationUp];
+    CGImageRelease(imageRef);
+    return image;
+}
+
 - (NSUInteger)imageLoopCountWithSource:(CGImageSourceRef)source {
     NSUInteger loopCount = 1;
     NSDictionary *imageProperties = (__bridge_transfer NSDictionary *)CGImageSourceCopyProperties(source, nil);
     NSDictionary *gifProperties = imageProperties[(__bridge NSString *)kCGImagePropertyGIFDictionary];
-    if (gifProperties) {
-        NSNumber *gifLoopCount = gifProperties[(__bridge NSString *)kCGImagePropertyGIFLoopCount];
+    // 自己的 APNG 解码器放弃的文件由 ImageIO 兜底，属性在 PNG 字典里
+    NSDictionary *pngProperties = imageProperties[(__bridge NSString *)kCGImagePropertyPNGDictionary];
+    if (gifProperties || pngProperties) {
+        NSNumber *gifLoopCount = gifProperties ? gifProperties[(__bridge NSString *)kCGImagePropertyGIFLoopCount] : pngProperties[(__bridge NSString *)kCGImagePropertyAPNGLoopCount];
         if (gifLoopCount != nil) {
             loopCount = gifLoopCount.unsignedIntegerValue;
             // A loop count of 1 means it should repeat twice, 2 means, thrice, etc.
-            if (loopCount != 0) {
+            // APNG's num_plays is already the total number of plays.
+            if (loopCount != 0 && gifProperties) {
                 loopCount++;
             }
         }
@@ -392,12 +707,13 @@ static inline CGImageRef CGImageCreateDecoded(CGImageRef cgImage, CGImagePropert
     }
     NSDictionary *frameProperties = (__bridge NSDictionary *)cfFrameProperties;
     NSDictionary *gifProperties = frameProperties[(NSString *)kCGImagePropertyGIFDictionary];
+    NSDictionary *pngProperties = frameProperties[(NSString *)kCGImagePropertyPNGDictionary];
 
-    NSNumber *delayTimeUnclampedProp = gifProperties[(NSString *)kCGImagePropertyGIFUnclampedDelayTime];
+    NSNumber *delayTimeUnclampedProp = gifProperties ? gifProperties[(NSString *)kCGImagePropertyGIFUnclampedDelayTime] : pngProperties[(NSString *)kCGImagePropertyAPNGUnclampedDelayTime];
     if (delayTimeUnclampedProp != nil && [delayTimeUnclampedProp floatValue] != 0.0f) {
         frameDuration = [delayTimeUnclampedProp floatValue];
     } else {
-        NSNumber *delayTimeProp = gifProperties[(NSString *)kCGImagePropertyGIFDelayTime];
+        NSNumber *delayTimeProp = gifProperties ? gifProperties[(NSString *)kCGImagePropertyGIFDelayTime] : pngProperties[(NSString *)kCGImagePropertyAPNGDelayTime];
         if (delayTimeProp != nil) {
             frameDuration = [delayTimeProp floatValue];
         }
@@ -408,21 +724,30 @@ static inline CGImageRef CGImageCreateDecoded(CGImageRef cgImage, CGImagePropert
 }
 
 - (NSUInteger)animatedImageLoopCount {
-    return _loopCount;
+    dispatch_semaphore_wait(_frameInfoLock, DISPATCH_TIME_FOREVER);
+    NSUInteger loopCount = _loopCount;
+    dispatch_semaphore_signal(_frameInfoLock);
+    return loopCount;
 }
 
 - (NSUInteger)animatedImageFrameCount {
-    return _frameCount;
+    dispatch_semaphore_wait(_frameInfoLock, DISPATCH_TIME_FOREVER);
+    NSUInteger frameCount = _frameCount;
+    dispatch_semaphore_signal(_frameInfoLock);
+    return frameCount;
 }
 
 - (NSTimeInterval)animatedImageDurationAtIndex:(NSUInteger)index {
-    if (index >= _frameCount) {
-        return 0;
-    }
-    return _frames[index].duration;
+    dispatch_semaphore_wait(_frameInfoLock, DISPATCH_TIME_FOREVER);
+    NSTimeInterval duration = index < _frameCount ? _frames[index].duration : 0;
+    dispatch_semaphore_signal(_frameInfoLock);
+    return duration;
 }
 
 - (UIImage *)animatedImageFrameAtIndex:(NSUInteger)index {
+    if (_decoder) {
+        return [self canvasFrameAtIndex:index];
+    }
     CGImageRef imageRef = CGImageSourceCreateImageAtIndex(_imageSource, index, NULL);
     if (!imageRef) {
         return nil;
@@ -438,6 +763,15 @@ static inline CGImageRef CGImageCreateDecoded(CGImageRef cgImage, CGImagePropert
             CGImageSourceRemoveCacheAtIndex(_imageSource, i);
         }
     }
+    if (_decoder) {
+        // 画布用到时再创建，代价是下一帧要从头合成
+        dispatch_semaphore_wait(_decoderLock, DISPATCH_TIME_FOREVER);
+        for (NSInteger i = 0; i < ZLFrameCanvasCount; i++) {
+            _codec->canvasDestroy(_canvases[i]);
+            _canvases[i] = NULL;
+        }
+        dispatch_semaphore_signal(_decoderLock);
+    }
 }
 
 - (void)dealloc {
@@ -445,6 +779,12 @@ static inline CGImageRef CGImageCreateDecoded(CGImageRef cgImage, CGImagePropert
         CFRelease(_imageSource);
         _imageSource = NULL;
     }
+    if (_decoder) {
+        for (NSInteger i = 0; i < ZLFrameCanvasCount; i++) {
+            _codec->canvasDestroy(_canvases[i]);
+        }
+        _codec->decoderDestroy(_decoder);
+    }
     
     [[NSNotificationCenter defaultCenter] removeObserver:self];
 }
@@ -486,35 +826,272 @@ static inline CGImageRef CGImageCreateDecoded(CGImageRef cgImage, CGImagePropert
 
 @end
 
-@interface ZLAnimatedImageView () <CALayerDelegate, ZLDisplayRefreshable>
+/// 所有动图视图累计的统计，主线程和解码线程都会更新
+static atomic_ulong ZLAnimatedDroppedFrameCount;
+static atomic_ulong ZLAnimatedDecodedFrameCount;
+static _Atomic uint64_t ZLAnimatedDecodeNanoseconds;
+static _Atomic uint64_t ZLAnimatedMaxDecodeNanoseconds;
+
+/// 环形缓冲区的一个槽位，image 为 NULL 表示空
+typedef struct ZLAnimatedFrameSlot {
+    uint64_t sequence;
+    NSUInteger frameIndex;
+    CGImageRef image;
+} ZLAnimatedFrameSlot;
+
+@interface ZLAnimatedFrameRequest : NSObject
+
+@property (nonatomic, weak) ZLAnimatedImageView *view;
+@property (nonatomic, strong) UIImage<ZLAnimatedImage> *image;
+@property (nonatomic, assign) NSUInteger frameIndex;
+/// 从开始播放算起的帧序号，跨越循环单调递增
+@property (nonatomic, assign) uint64_t sequence;
+/// 预计显示的时间，越早越优先解码
+@property (nonatomic, assign) CFTimeInterval deadline;
+@property (nonatomic, assign) CFTimeInterval submitTime;
+
+@end
+
+@implementation ZLAnimatedFrameRequest
+
+@end
+
+@interface ZLAnimatedImageView () <CALayerDelegate>
 
-@property (nonatomic, assign) NSUInteger maxBufferSize;
 @property (nonatomic, strong, readwrite) UIImage *currentFrame;
 @property (nonatomic, assign, readwrite) NSUInteger currentFrameIndex;
 @property (nonatomic, assign, readwrite) NSUInteger currentLoopCount;
 @property (nonatomic, assign) NSUInteger totalFrameCount;
 @property (nonatomic, assign) NSUInteger totalLoopCount;
 @property (nonatomic, strong) UIImage<ZLAnimatedImage> *animatedImage;
-@property (nonatomic, strong) NSMutableDictionary<NSNumber *, UIImage *> *frameBuffer;
 @property (nonatomic, assign) NSTimeInterval currentTime;
 @property (nonatomic, assign) BOOL bufferMiss;
-@property (nonatomic, assign) NSUInteger maxBufferCount;
-@property (nonatomic, strong) NSOperationQueue *fetchQueue;
-@property (nonatomic, strong) dispatch_semaphore_t lock;
 @property (nonatomic, assign) CGFloat animatedImageScale;
-@property (nonatomic, strong) CADisplayLink *displayLink;
+
+- (void)animationTickWithDuration:(NSTimeInterval)durationToNextRefresh;
+
+/// 调整环形缓冲区容量，bytes 为分给这个视图的解码帧内存
+- (void)setFrameBufferBytes:(NSUInteger)bytes;
+
+- (void)didDecodeFrame:(CGImageRef)frame request:(ZLAnimatedFrameRequest *)request;
+
+/// 只保留正在显示的帧
+- (void)trimFrameBuffer;
 
 @end
 
-@implementation ZLAnimatedImageView
+/// 所有动图视图共用的动画驱动：一个 CADisplayLink 驱动所有正在播放的动图，
+/// 帧在有限个工作线程上解码，预计显示时间最早的帧优先；解码帧的内存上限由正在播放的动图平分。
+/// 除解码外都在主线程上执行
+@interface ZLAnimationScheduler : NSObject <ZLDisplayRefreshable>
 
-- (instancetype)initWithFrame:(CGRect)frame {
-  if (self = [super initWithFrame:frame]) {
-    self.lock = dispatch_semaphore_create(1);
-    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(didReceiveMemoryWarning:) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+@property (nonatomic, assign) NSUInteger maxFrameBufferBytes;
 
-  }
-  return self;
++ (instancetype)shared;
+
+- (void)addView:(ZLAnimatedImageView *)view;
+
+- (void)removeView:(ZLAnimatedImageView *)view;
+
+/// 可在任意线程调用
+- (void)submitRequest:(ZLAnimatedFrameRequest *)request;
+
+@end
+
+@implementation ZLAnimationScheduler {
+    CADisplayLink *_displayLink;
+    NSHashTable<ZLAnimatedImageView *> *_views;
+    /// 上次分配内存时的视图数，视图释放后弱引用表变小，下一帧重新分配
+    NSUInteger _distributedViewCount;
+
+    dispatch_semaphore_t _lock;
+    /// 每个视图同时最多一个请求，数量很少，线性查找最早的即可
+    NSMutableArray<ZLAnimatedFrameRequest *> *_pendingRequests;
+    NSUInteger _runningWorkerCount;
+    NSUInteger _maxWorkerCount;
+}
+
++ (instancetype)shared {
+    static ZLAnimationScheduler *scheduler = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        scheduler = [ZLAnimationScheduler new];
+    });
+    return scheduler;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _views = [NSHashTable weakObjectsHashTable];
+        _lock = dispatch_semaphore_create(1);
+        _pendingRequests = [NSMutableArray array];
+        _maxWorkerCount = MAX((NSUInteger)1, MIN([NSProcessInfo processInfo].activeProcessorCount / 2, (NSUInteger)4));
+        // Calculate based on current memory, these factors are by experience
+        _maxFrameBufferBytes = MIN(ZLDeviceTotalMemory() * 0.2, ZLDeviceFreeMemory() * 0.6);
+
+        _displayLink = [ZLDisplayWeakRefreshable displayLinkWithWeakRefreshable:self];
+        _displayLink.paused = YES;
+        NSString *runLoopMode = [NSProcessInfo processInfo].activeProcessorCount > 1 ? NSRunLoopCommonModes : NSDefaultRunLoopMode;
+        [_displayLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:runLoopMode];
+
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(didReceiveMemoryWarning:) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+    }
+    return self;
+}
+
+- (void)setMaxFrameBufferBytes:(NSUInteger)maxFrameBufferBytes {
+    _maxFrameBufferBytes = maxFrameBufferBytes;
+    [self distributeFrameBufferBytes];
+}
+
+- (void)distributeFrameBufferBytes {
+    NSArray<ZLAnimatedImageView *> *views = _views.allObjects;
+    _distributedViewCount = views.count;
+    if (views.count == 0) {
+        return;
+    }
+    NSUInteger share = _maxFrameBufferBytes / views.count;
+    for (ZLAnimatedImageView *view in views) {
+        [view setFrameBufferBytes:share];
+    }
+}
+
+- (void)addView:(ZLAnimatedImageView *)view {
+    if ([_views containsObject:view]) {
+        return;
+    }
+    [_views addObject:view];
+    [self distributeFrameBufferBytes];
+    _displayLink.paused = NO;
+}
+
+- (void)removeView:(ZLAnimatedImageView *)view {
+    if (![_views containsObject:view]) {
+        return;
+    }
+    [_views removeObject:view];
+    [self distributeFrameBufferBytes];
+    if (_views.count == 0) {
+        _displayLink.paused = YES;
+    }
+}
+
+- (void)displayDidRefresh:(CADisplayLink *)displayLink {
+#if TARGET_OS_UIKITFORMAC
+    // TODO: `displayLink.frameInterval` is not available on UIKitForMac
+    NSTimeInterval durationToNextRefresh = displayLink.duration;
+#else
+    // displaylink.duration -- time interval between frames, assuming maximumFramesPerSecond
+    // displayLink.preferredFramesPerSecond (>= iOS 10) -- Set to 30 for displayDidRefresh to be called at 30 fps
+    // durationToNextRefresh -- Time interval to the next time displayDidRefresh is called
+
+    NSTimeInterval durationToNextRefresh = displayLink.targetTimestamp - displayLink.timestamp;
+#endif
+    NSArray<ZLAnimatedImageView *> *views = _views.allObjects;
+    if (views.count != _distributedViewCount) {
+        [self distributeFrameBufferBytes];
+    }
+    if (views.count == 0) {
+        _displayLink.paused = YES;
+        return;
+    }
+    for (ZLAnimatedImageView *view in views) {
+        [view animationTickWithDuration:durationToNextRefresh];
+    }
+}
+
+- (void)submitRequest:(ZLAnimatedFrameRequest *)request {
+    request.submitTime = CACurrentMediaTime();
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    [_pendingRequests addObject:request];
+    BOOL startWorker = _runningWorkerCount < _maxWorkerCount;
+    if (startWorker) {
+        _runningWorkerCount++;
+    }
+    dispatch_semaphore_signal(_lock);
+
+    if (startWorker) {
+        dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            [self runWorker];
+        });
+    }
+}
+
+- (ZLAnimatedFrameRequest *)dequeueEarliestRequest {
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    NSUInteger earliestIndex = NSNotFound;
+    CFTimeInterval earliestDeadline = DBL_MAX;
+    for (NSUInteger i = 0; i < _pendingRequests.count; i++) {
+        if (_pendingRequests[i].deadline < earliestDeadline) {
+            earliestIndex = i;
+            earliestDeadline = _pendingRequests[i].deadline;
+        }
+    }
+    ZLAnimatedFrameRequest *request = nil;
+    if (earliestIndex == NSNotFound) {
+        _runningWorkerCount--;
+    } else {
+        request = _pendingRequests[earliestIndex];
+        [_pendingRequests removeObjectAtIndex:earliestIndex];
+    }
+    dispatch_semaphore_signal(_lock);
+    return request;
+}
+
+- (void)runWorker {
+    ZLAnimatedFrameRequest *request = nil;
+    while ((request = [self dequeueEarliestRequest]) != nil) {
+        CGImageRef frame = NULL;
+        @autoreleasepool {
+            UIImage *frameImage = [request.image animatedImageFrameAtIndex:request.frameIndex];
+            // 在工作线程上解码，主线程只需要切换 layer.contents
+            BOOL framesDecoded = [request.image isKindOfClass:[ZLAnimatedImage class]] && ((ZLAnimatedImage *)request.image).framesDecoded;
+            if (!framesDecoded) {
+                frame = CGImageCreateDecoded(frameImage.CGImage, kCGImagePropertyOrientationUp);
+            }
+            if (frame == NULL && frameImage.CGImage != NULL) {
+                frame = CGImageRetain(frameImage.CGImage);
+            }
+        }
+
+        uint64_t latency = (uint64_t)((CACurrentMediaTime() - request.submitTime) * NSEC_PER_SEC);
+        atomic_fetch_add(&ZLAnimatedDecodedFrameCount, 1);
+        atomic_fetch_add(&ZLAnimatedDecodeNanoseconds, latency);
+        uint64_t maxLatency = atomic_load(&ZLAnimatedMaxDecodeNanoseconds);
+        while (latency > maxLatency && !atomic_compare_exchange_weak(&ZLAnimatedMaxDecodeNanoseconds, &maxLatency, latency)) {
+        }
+
+        // 视图只在主线程上取出强引用，避免在工作线程上释放
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [request.view didDecodeFrame:frame request:request];
+            CGImageRelease(frame);
+        });
+    }
+}
+
+- (void)didReceiveMemoryWarning:(NSNotification *)notification {
+    for (ZLAnimatedImageView *view in _views.allObjects) {
+        [view trimFrameBuffer];
+    }
+}
+
+@end
+
+@implementation ZLAnimatedImageView {
+    ZLAnimatedFrameSlot *_ring;
+    NSUInteger _ringCapacity;
+    /// 容量足够放下所有帧时按帧下标存放，播放一轮后不再解码
+    BOOL _ringHoldsAllFrames;
+    NSUInteger _frameBytes;
+    /// 调度器分给这个视图的解码帧内存
+    NSUInteger _frameBufferBytesLimit;
+
+    /// 正在显示的帧序号
+    uint64_t _currentSequence;
+    /// 下一个要解码的帧序号
+    uint64_t _fetchSequence;
+    BOOL _fetchPending;
+    BOOL _animating;
 }
 
 - (void)resetAnimatedImage {
@@ -526,18 +1103,18 @@ static inline CGImageRef CGImageCreateDecoded(CGImageRef cgImage, CGImagePropert
       self.currentLoopCount = 0;
       self.currentTime = 0;
       self.bufferMiss = NO;
-      self.maxBufferCount = 0;
       self.animatedImageScale = 1;
-      [_fetchQueue cancelAllOperations];
-      _fetchQueue = nil;
-      dispatch_semaphore_wait(self.lock, DISPATCH_TIME_FOREVER);
-      [_frameBuffer removeAllObjects];
-      _frameBuffer = nil;
-      dispatch_semaphore_signal(self.lock);
+      [self releaseFrameBuffer];
+      _frameBytes = 0;
+      _frameBufferBytesLimit = 0;
+      _currentSequence = 0;
+      _fetchSequence = 0;
+      _fetchPending = NO;
 }
 
 - (void)setImage:(UIImage *)image {
-    if (self.image == image) {
+    // 边下载边播放的动图在下载完成后会再设置一次，不重新开始播放
+    if (self.image == image || (image != nil && self.animatedImage == image)) {
         return;
     }
 
@@ -562,16 +1139,10 @@ static inline CGImageRef CGImageCreateDecoded(CGImageRef cgImage, CGImagePropert
 
         self.currentFrame = image;
 
-        dispatch_semaphore_wait(self.lock, DISPATCH_TIME_FOREVER);
-        self.frameBuffer[@(self.currentFrameIndex)] = self.currentFrame;
-        dispatch_semaphore_signal(self.lock);
+        _frameBytes = CGImageGetBytesPerRow(image.CGImage) * CGImageGetHeight(image.CGImage);
+        if (_frameBytes == 0) _frameBytes = 1024;
 
-        // Calculate max buffer size
-        [self calculateMaxBufferCount];
-
-        if ([self paused]) {
-            [self start];
-        }
+        [self start];
 
         [self.layer setNeedsDisplay];
     } else {
@@ -579,72 +1150,75 @@ static inline CGImageRef CGImageCreateDecoded(CGImageRef cgImage, CGImagePropert
     }
 }
 
-#pragma mark - Private
-
-- (NSOperationQueue *)fetchQueue {
-    if (!_fetchQueue) {
-        _fetchQueue = [[NSOperationQueue alloc] init];
-        _fetchQueue.maxConcurrentOperationCount = 1;
+- (void)didMoveToWindow {
+    [super didMoveToWindow];
+    // 不在屏幕上的动图不占用解码线程和帧内存
+    if (self.window) {
+        [self start];
+    } else {
+        [self stop];
     }
-    return _fetchQueue;
 }
 
-- (NSMutableDictionary<NSNumber *,UIImage *> *)frameBuffer {
-    if (!_frameBuffer) {
-        _frameBuffer = [NSMutableDictionary dictionary];
-    }
-    return _frameBuffer;
-}
+#pragma mark - Animation
 
-- (CADisplayLink *)displayLink {
-    if (!_animatedImage) {
-        return nil;
+- (void)start {
+    if (!self.animatedImage || !self.window || _animating) {
+        return;
     }
-
-    if (!_displayLink) {
-        _displayLink = [ZLDisplayWeakRefreshable displayLinkWithWeakRefreshable:self];
-        NSString *runLoopMode = [NSProcessInfo processInfo].activeProcessorCount > 1 ? NSRunLoopCommonModes : NSDefaultRunLoopMode;
-        [_displayLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:runLoopMode];
+    // if reached the max loop count, stay on the last frame
+    if (self.totalLoopCount != 0 && self.currentLoopCount >= self.totalLoopCount) {
+        return;
     }
-    return _displayLink;
+    _animating = YES;
+    [[ZLAnimationScheduler shared] addView:self];
 }
 
-#pragma mark - Animation
-
-- (void)start {
-    self.displayLink.paused = NO;
+- (void)stop {
+    if (!_animating) {
+        return;
+    }
+    _animating = NO;
+    [[ZLAnimationScheduler shared] removeView:self];
+    [self trimFrameBuffer];
 }
 
-- (void)stop {
-    self.displayLink.paused = YES;
+- (BOOL)isAnimatedImageIncomplete {
+    return [self.animatedImage isKindOfClass:[ZLAnimatedImage class]] && ((ZLAnimatedImage *)self.animatedImage).isIncomplete;
 }
 
-- (BOOL)paused {
-    return self.displayLink.isPaused;
+/// 边下载边播放时帧数会增加，缓冲区按新的帧数重新分配
+- (void)animatedImageFrameCountDidChange:(NSUInteger)frameCount {
+    self.totalFrameCount = frameCount;
+    self.totalLoopCount = self.animatedImage.animatedImageLoopCount;
+    if (_ring != NULL) {
+        [self setFrameBufferBytes:_frameBufferBytesLimit];
+    }
 }
 
-- (void)displayDidRefresh:(CADisplayLink *)displayLink {
-#if TARGET_OS_UIKITFORMAC
-    // TODO: `displayLink.frameInterval` is not available on UIKitForMac
-    NSTimeInterval durationToNextRefresh = displayLink.duration;
-#else
-    // displaylink.duration -- time interval between frames, assuming maximumFramesPerSecond
-    // displayLink.preferredFramesPerSecond (>= iOS 10) -- Set to 30 for displayDidRefresh to be called at 30 fps
-    // durationToNextRefresh -- Time interval to the next time displayDidRefresh is called
-    
-    NSTimeInterval durationToNextRefresh = displayLink.targetTimestamp - displayLink.timestamp;
-#endif
+- (void)animationTickWithDuration:(NSTimeInterval)durationToNextRefresh {
+    NSUInteger frameCount = self.animatedImage.animatedImageFrameCount;
+    if (frameCount != self.totalFrameCount) {
+        [self animatedImageFrameCountDidChange:frameCount];
+    }
     NSUInteger totalFrameCount = self.totalFrameCount;
-    NSUInteger currentFrameIndex = self.currentFrameIndex;
-    NSUInteger nextFrameIndex = (currentFrameIndex + 1) % totalFrameCount;
+    if (totalFrameCount == 0 || _ring == NULL) {
+        return;
+    }
+    NSUInteger nextFrameIndex = (self.currentFrameIndex + 1) % totalFrameCount;
+    if (nextFrameIndex == 0 && [self isAnimatedImageIncomplete]) {
+        // 后面的帧还没下载到，停在当前帧等待而不是从头播放
+        return;
+    }
 
     // Check if we have the frame buffer firstly to improve performance
     if (!self.bufferMiss) {
         // Then check if timestamp is reached
         self.currentTime += durationToNextRefresh;
-        NSTimeInterval currentDuration = [self.animatedImage animatedImageDurationAtIndex:currentFrameIndex];
+        NSTimeInterval currentDuration = [self.animatedImage animatedImageDurationAtIndex:self.currentFrameIndex];
         if (self.currentTime < currentDuration) {
-          // Current frame timestamp not reached, return
+            // Current frame timestamp not reached, keep decoding ahead
+            [self prefetchFrames];
             return;
         }
         self.currentTime -= currentDuration;
@@ -656,128 +1230,228 @@ static inline CGImageRef CGImageCreateDecoded(CGImageRef cgImage, CGImagePropert
         }
     }
 
-    // Update the current frame
-    UIImage *currentFrame;
-    UIImage *fetchFrame;
-    dispatch_semaphore_wait(self.lock, DISPATCH_TIME_FOREVER);
-    currentFrame = self.frameBuffer[@(currentFrameIndex)];
-    fetchFrame = currentFrame ? self.frameBuffer[@(nextFrameIndex)] : nil;
-    dispatch_semaphore_signal(self.lock);
-    BOOL bufferFull = NO;
-    if (currentFrame) {
-        dispatch_semaphore_wait(self.lock, DISPATCH_TIME_FOREVER);
-        // Remove the frame buffer if need
-        if (self.frameBuffer.count > self.maxBufferCount) {
-            self.frameBuffer[@(currentFrameIndex)] = nil;
-        }
-        // Check whether we can stop fetch
-        if (self.frameBuffer.count == totalFrameCount) {
-            bufferFull = YES;
-        }
-        dispatch_semaphore_signal(self.lock);
-        self.currentFrame = currentFrame;
-        self.currentFrameIndex = nextFrameIndex;
-        self.bufferMiss = NO;
-        [self.layer setNeedsDisplay];
-    } else {
-        self.bufferMiss = YES;
-    }
-
     // Update the loop count when last frame rendered
-    if (nextFrameIndex == 0 && !self.bufferMiss) {
-        // Update the loop count
-        self.currentLoopCount++;
+    if (nextFrameIndex == 0) {
         // if reached the max loop count, stop animating, 0 means loop indefinitely
         NSUInteger maxLoopCount = self.totalLoopCount;
-        if (maxLoopCount != 0 && (self.currentLoopCount >= maxLoopCount)) {
+        if (maxLoopCount != 0 && self.currentLoopCount + 1 >= maxLoopCount) {
+            self.currentLoopCount++;
             [self stop];
             return;
         }
     }
 
-    // Check if we should prefetch next frame or current frame
-    NSUInteger fetchFrameIndex;
-    if (self.bufferMiss) {
-        // When buffer miss, means the decode speed is slower than render speed, we fetch current miss frame
-        fetchFrameIndex = currentFrameIndex;
-    } else {
-        // Or, most cases, the decode speed is faster than render speed, we fetch next frame
-        fetchFrameIndex = nextFrameIndex;
+    uint64_t nextSequence = _currentSequence + 1;
+    CGImageRef frame = [self bufferedFrameForSequence:nextSequence];
+    if (frame == NULL) {
+        // The decode speed is slower than render speed, the frame is shown as soon as it arrives
+        self.bufferMiss = YES;
+        atomic_fetch_add(&ZLAnimatedDroppedFrameCount, 1);
+        [self prefetchFrames];
+        return;
     }
 
-    if (!fetchFrame && !bufferFull && self.fetchQueue.operationCount == 0) {
-        // Prefetch next frame in background queue
-        UIImage<ZLAnimatedImage> *animatedImage = self.animatedImage;
-        NSOperation *operation = [NSBlockOperation blockOperationWithBlock:^{
-            UIImage *frame = [animatedImage animatedImageFrameAtIndex:fetchFrameIndex];
-            dispatch_semaphore_wait(self.lock, DISPATCH_TIME_FOREVER);
-            self.frameBuffer[@(fetchFrameIndex)] = frame;
-            dispatch_semaphore_signal(self.lock);
-        }];
-        [self.fetchQueue addOperation:operation];
+    self.bufferMiss = NO;
+    if (nextFrameIndex == 0) {
+        self.currentLoopCount++;
+    }
+    self.currentFrame = [[UIImage alloc] initWithCGImage:frame scale:self.animatedImageScale orientation:UIImageOrientationUp];
+    if (!_ringHoldsAllFrames) {
+        // currentFrame 已经持有，腾出槽位给后面的帧
+        ZLAnimatedFrameSlot *slot = [self slotForSequence:nextSequence];
+        CGImageRelease(slot->image);
+        slot->image = NULL;
     }
+    _currentSequence = nextSequence;
+    self.currentFrameIndex = nextFrameIndex;
+    [self.layer setNeedsDisplay];
+
+    [self prefetchFrames];
 }
 
-#pragma mark - CALayerDelegate
+#pragma mark - Frame Buffer
 
-- (void)displayLayer:(CALayer *)layer {
-    if (_currentFrame) {
-        layer.contentsScale = self.animatedImageScale;
-        layer.contents = (__bridge id)_currentFrame.CGImage;
-    } else {
-        [super displayLayer:layer];
+- (ZLAnimatedFrameSlot *)slotForSequence:(uint64_t)sequence {
+    return &_ring[_ringHoldsAllFrames ? sequence % self.totalFrameCount : sequence % _ringCapacity];
+}
+
+/// 缓冲区覆盖正在显示的帧之后的 _ringCapacity 帧
+- (BOOL)isSequenceInWindow:(uint64_t)sequence {
+    return sequence > _currentSequence && sequence <= _currentSequence + _ringCapacity;
+}
+
+- (CGImageRef)bufferedFrameForSequence:(uint64_t)sequence {
+    if (_ring == NULL) {
+        return NULL;
+    }
+    ZLAnimatedFrameSlot *slot = [self slotForSequence:sequence];
+    if (slot->image == NULL) {
+        return NULL;
     }
+    BOOL matched = _ringHoldsAllFrames ? slot->frameIndex == sequence % self.totalFrameCount : slot->sequence == sequence;
+    return matched ? slot->image : NULL;
 }
 
-#pragma mark - Util
+- (void)prefetchFrames {
+    if (_fetchPending || _ring == NULL) {
+        return;
+    }
+    if (_fetchSequence <= _currentSequence) {
+        _fetchSequence = _currentSequence + 1;
+    }
+    while ([self isSequenceInWindow:_fetchSequence] && [self bufferedFrameForSequence:_fetchSequence] != NULL) {
+        _fetchSequence++;
+    }
+    if (![self isSequenceInWindow:_fetchSequence]) {
+        return;
+    }
 
-- (void)calculateMaxBufferCount {
-    NSUInteger bytes = CGImageGetBytesPerRow(self.currentFrame.CGImage) * CGImageGetHeight(self.currentFrame.CGImage);
-    if (bytes == 0) bytes = 1024;
+    NSUInteger totalFrameCount = self.totalFrameCount;
+    // 没下载完时不会回到第一帧，帧序号就是帧下标
+    if (_fetchSequence >= totalFrameCount && [self isAnimatedImageIncomplete]) {
+        return;
+    }
+    CFTimeInterval deadline = CACurrentMediaTime() + MAX([self.animatedImage animatedImageDurationAtIndex:self.currentFrameIndex] - self.currentTime, 0);
+    for (uint64_t sequence = _currentSequence + 1; sequence < _fetchSequence; sequence++) {
+        deadline += [self.animatedImage animatedImageDurationAtIndex:sequence % totalFrameCount];
+    }
+
+    ZLAnimatedFrameRequest *request = [[ZLAnimatedFrameRequest alloc] init];
+    request.view = self;
+    request.image = self.animatedImage;
+    request.frameIndex = _fetchSequence % totalFrameCount;
+    request.sequence = _fetchSequence;
+    request.deadline = deadline;
+    _fetchPending = YES;
+    [[ZLAnimationScheduler shared] submitRequest:request];
+}
 
-    NSUInteger max = 0;
-    if (self.maxBufferSize > 0) {
-        max = self.maxBufferSize;
+- (void)didDecodeFrame:(CGImageRef)frame request:(ZLAnimatedFrameRequest *)request {
+    if (request.image != self.animatedImage) {
+        return;
+    }
+    _fetchPending = NO;
+    if (!_animating) {
+        return;
+    }
+    if (frame != NULL && _ring != NULL && [self isSequenceInWindow:request.sequence]) {
+        ZLAnimatedFrameSlot *slot = [self slotForSequence:request.sequence];
+        CGImageRelease(slot->image);
+        slot->sequence = request.sequence;
+        slot->frameIndex = request.frameIndex;
+        slot->image = CGImageRetain(frame);
+    }
+    if (self.bufferMiss && request.sequence == _currentSequence + 1) {
+        // 补上缺的帧后立即显示
+        [self animationTickWithDuration:0];
     } else {
-        // Calculate based on current memory, these factors are by experience
-        NSUInteger total = ZLDeviceTotalMemory();
-        NSUInteger free = ZLDeviceFreeMemory();
-        max = MIN(total * 0.2, free * 0.6);
+        [self prefetchFrames];
+    }
+}
+
+- (void)setFrameBufferBytes:(NSUInteger)bytes {
+    _frameBufferBytesLimit = bytes;
+    NSUInteger totalFrameCount = self.totalFrameCount;
+    if (totalFrameCount == 0 || _frameBytes == 0) {
+        return;
     }
+    NSUInteger capacity = MAX((NSUInteger)1, bytes / _frameBytes);
+    BOOL holdsAllFrames = capacity >= totalFrameCount;
+    if (holdsAllFrames) {
+        capacity = totalFrameCount;
+    }
+    if (_ring != NULL && capacity == _ringCapacity && holdsAllFrames == _ringHoldsAllFrames) {
+        return;
+    }
+    ZLAnimatedFrameSlot *ring = calloc(capacity, sizeof(ZLAnimatedFrameSlot));
+    if (ring == NULL) {
+        return;
+    }
+
+    ZLAnimatedFrameSlot *oldRing = _ring;
+    NSUInteger oldCapacity = _ringCapacity;
+    _ring = ring;
+    _ringCapacity = capacity;
+    _ringHoldsAllFrames = holdsAllFrames;
 
-    NSUInteger maxBufferCount = (double)max / (double)bytes;
-    if (!maxBufferCount) {
-        // At least 1 frame
-        maxBufferCount = 1;
+    // 已解码的帧尽量搬到新的缓冲区里
+    for (NSUInteger i = 0; i < oldCapacity; i++) {
+        ZLAnimatedFrameSlot old = oldRing[i];
+        if (old.image == NULL) {
+            continue;
+        }
+        uint64_t sequence = _currentSequence + 1 + (old.frameIndex + totalFrameCount - (_currentSequence + 1) % totalFrameCount) % totalFrameCount;
+        if ([self isSequenceInWindow:sequence]) {
+            ZLAnimatedFrameSlot *slot = [self slotForSequence:sequence];
+            if (slot->image == NULL) {
+                slot->sequence = sequence;
+                slot->frameIndex = old.frameIndex;
+                slot->image = old.image;
+                continue;
+            }
+        }
+        CGImageRelease(old.image);
     }
+    free(oldRing);
+    _fetchSequence = _currentSequence + 1;
+}
 
-    self.maxBufferCount = maxBufferCount;
+- (void)trimFrameBuffer {
+    for (NSUInteger i = 0; i < _ringCapacity; i++) {
+        CGImageRelease(_ring[i].image);
+        _ring[i].image = NULL;
+    }
 }
 
-#pragma mark - Lifecycle
+- (void)releaseFrameBuffer {
+    [self trimFrameBuffer];
+    free(_ring);
+    _ring = NULL;
+    _ringCapacity = 0;
+    _ringHoldsAllFrames = NO;
+}
 
-- (void)dealloc {
-    // Removes the display link from all run loop modes.
-    [_displayLink invalidate];
-    _displayLink = nil;
-    
-    [[NSNotificationCenter defaultCenter] removeObserver:self];
++ (NSUInteger)droppedFrameCount {
+    return atomic_load(&ZLAnimatedDroppedFrameCount);
 }
 
-- (void)didReceiveMemoryWarning:(NSNotification *)notification {
-    [_fetchQueue cancelAllOperations];
-    [_fetchQueue addOperationWithBlock:^{
-    NSNumber *currentFrameIndex = @(self.currentFrameIndex);
-    dispatch_semaphore_wait(self.lock, DISPATCH_TIME_FOREVER);
-    NSArray *keys = self.frameBuffer.allKeys;
-    // only keep the next frame for later rendering
-    for (NSNumber * key in keys) {
-        if (![key isEqualToNumber:currentFrameIndex]) {
-            [self.frameBuffer removeObjectForKey:key];
-        }
++ (NSUInteger)decodedFrameCount {
+    return atomic_load(&ZLAnimatedDecodedFrameCount);
+}
+
++ (NSTimeInterval)averageFrameDecodeLatency {
+    NSUInteger count = atomic_load(&ZLAnimatedDecodedFrameCount);
+    return count ? atomic_load(&ZLAnimatedDecodeNanoseconds) / (double)count / NSEC_PER_SEC : 0;
+}
+
++ (NSTimeInterval)maxFrameDecodeLatency {
+    return atomic_load(&ZLAnimatedMaxDecodeNanoseconds) / (double)NSEC_PER_SEC;
+}
+
++ (NSUInteger)maxFrameBufferBytes {
+    return [ZLAnimationScheduler shared].maxFrameBufferBytes;
+}
+
++ (void)setMaxFrameBufferBytes:(NSUInteger)maxFrameBufferBytes {
+    [ZLAnimationScheduler shared].maxFrameBufferBytes = maxFrameBufferBytes;
+}
+
+#pragma mark - CALayerDelegate
+
+- (void)displayLayer:(CALayer *)layer {
+    if (_currentFrame) {
+        layer.contentsScale = self.animatedImageScale;
+        layer.contents = (__bridge id)_currentFrame.CGImage;
+    } else {
+        [super displayLayer:layer];
     }
-    dispatch_semaphore_signal(self.lock);
-    }];
+}
+
+#pragma mark - Lifecycle
+
+- (void)dealloc {
+    // 调度器只弱引用视图，下一帧会重新分配内存
+    [self releaseFrameBuffer];
 }
 
 @end
@@ -962,6 +1636,57 @@ static NSUInteger gcdArray(size_t const count, NSUInteger const * const values)
 
 @end
 
+/// 按目标尺寸和填充模式计算解码需要的最大像素边长，无需缩小或尺寸未知时返回 0
+static NSUInteger ZLDownsampleMaxPixelSize(CGImageSourceRef source, CGSize targetSize, ZLNetImageViewContentMode contentMode) {
+    if (CGSizeEqualToSize(targetSize, CGSizeZero) || contentMode == ZLNetImageViewContentModeCenter) {
+        return 0;
+    }
+    NSDictionary *properties = (__bridge_transfer NSDictionary *)CGImageSourceCopyPropertiesAtIndex(source, 0, NULL);
+    CGFloat pixelWidth = [properties[(__bridge NSString *)kCGImagePropertyPixelWidth] doubleValue];
+    CGFloat pixelHeight = [properties[(__bridge NSString *)kCGImagePropertyPixelHeight] doubleValue];
+    CGImagePropertyOrientation orientation = (CGImagePropertyOrientation)[properties[(__bridge NSString *)kCGImagePropertyOrientation] unsignedIntegerValue];
+    switch (orientation) {
+        case kCGImagePropertyOrientationLeft:
+        case kCGImagePropertyOrientationLeftMirrored:
+        case kCGImagePropertyOrientationRight:
+        case kCGImagePropertyOrientationRightMirrored: {
+            CGFloat tmp = pixelWidth;
+            pixelWidth = pixelHeight;
+            pixelHeight = tmp;
+        }
+            break;
+        default:
+            break;
+    }
+    if (pixelWidth <= 0 || pixelHeight <= 0) {
+        return 0;
+    }
+    
+    CGFloat screenScale = [UIScreen mainScreen].scale;
+    CGFloat targetPixelWidth = targetSize.width * screenScale;
+    CGFloat targetPixelHeight = targetSize.height * screenScale;
+    double factor;
+    if (contentMode == ZLNetImageViewContentModeScaleAspectFill) {
+        factor = fmax(targetPixelWidth / pixelWidth, targetPixelHeight / pixelHeight);
+    } else {
+        factor = fmin(targetPixelWidth / pixelWidth, targetPixelHeight / pixelHeight);
+    }
+    if (factor >= 1) {
+        return 0;
+    }
+    return MAX((NSUInteger)ceil(fmax(pixelWidth, pixelHeight) * factor), 1);
+}
+
+static CGImageRef ZLCreateThumbnailImage(CGImageSourceRef source, NSUInteger maxPixelSize) {
+    NSDictionary *thumbnailOptions = @{
+        (__bridge NSString *)kCGImageSourceCreateThumbnailFromImageAlways : @(YES),
+        (__bridge NSString *)kCGImageSourceCreateThumbnailWithTransform : @(YES),
+        (__bridge NSString *)kCGImageSourceShouldCacheImmediately : @(YES),
+        (__bridge NSString *)kCGImageSourceThumbnailMaxPixelSize : @(maxPixelSize)
+    };
+    return CGImageSourceCreateThumbnailAtIndex(source, 0, (__bridge CFDictionaryRef)thumbnailOptions);
+}
+
 static void *ZLNetworkingImageISDecodedAssociatedKey = &ZLNetworkingImageISDecodedAssociatedKey;
 
 @implementation UIImage (ZLNet)
@@ -1007,7 +1732,7 @@ static void *ZLNetworkingImageISDecodedAssociatedKey = &ZLNetworkingImageISDecod
         return nil;
     }
     ZLImageFormat imgFormat = zl_imageFormatForImageData(data);
-    if (imgFormat == ZLImageFormatGIF) {
+    if (ZLFrameCodecForImageData(data)) {
         return [[ZLAnimatedImage alloc] initWithData:data scale:[UIScreen mainScreen].scale];;
     } else if (imgFormat == ZLImageFormatPDF || imgFormat == ZLImageFormatSVG) {
         return image;
@@ -1031,6 +1756,19 @@ static void *ZLNetworkingImageISDecodedAssociatedKey = &ZLNetworkingImageISDecod
     if (data == nil) {
         return nil;
     }
+    ZLImageFormat imgFormat = zl_imageFormatForImageData(data);
+    if (ZLFrameCodecForImageData(data)) {
+        return [[ZLAnimatedImage alloc] initWithData:data scale:[UIScreen mainScreen].scale];
+    }
+    
+    if (imgFormat != ZLImageFormatPDF && imgFormat != ZLImageFormatSVG) {
+        // 直接从压缩数据解码出目标像素尺寸，圆角只在小图上处理
+        UIImage *downsampledImage = [UIImage zl_downsampledImageWithData:data targetSize:targetSize contentMode:contentMode];
+        if (downsampledImage != nil) {
+            return [downsampledImage imageScaleForSize:targetSize withCornerRadius:radius contentMode:contentMode];
+        }
+    }
+    
     UIImage *image = [UIImage imageWithData:data];
     if (image == nil) {
         return nil;
@@ -1039,10 +1777,7 @@ static void *ZLNetworkingImageISDecodedAssociatedKey = &ZLNetworkingImageISDecod
     if (image == nil) {
         return nil;
     }
-    ZLImageFormat imgFormat = zl_imageFormatForImageData(data);
-    if (imgFormat == ZLImageFormatGIF) {
-        return [[ZLAnimatedImage alloc] initWithData:data scale:[UIScreen mainScreen].scale];;
-    } else if (imgFormat == ZLImageFormatPDF || imgFormat == ZLImageFormatSVG) {
+    if (imgFormat == ZLImageFormatPDF || imgFormat == ZLImageFormatSVG) {
         return image;
     }
     
@@ -1057,6 +1792,33 @@ static void *ZLNetworkingImageISDecodedAssociatedKey = &ZLNetworkingImageISDecod
     return decodedImage;
 }
 
+/// 用 ImageIO 缩略图接口直接解码出目标像素尺寸（JPEG 会走 DCT 降采样），
+/// 不需要缩小时返回 nil 由调用方走原路径
++ (UIImage *_Nullable)zl_downsampledImageWithData:(NSData *)data
+                                       targetSize:(CGSize)targetSize
+                                      contentMode:(ZLNetImageViewContentMode)contentMode {
+    if (CGSizeEqualToSize(targetSize, CGSizeZero) || contentMode == ZLNetImageViewContentModeCenter) {
+        return nil;
+    }
+    
+    NSDictionary *sourceOptions = @{(__bridge NSString *)kCGImageSourceShouldCache : @(NO)};
+    CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)data, (__bridge CFDictionaryRef)sourceOptions);
+    if (!source) {
+        return nil;
+    }
+    
+    NSUInteger maxPixelSize = ZLDownsampleMaxPixelSize(source, targetSize, contentMode);
+    CGImageRef imageRef = maxPixelSize > 0 ? ZLCreateThumbnailImage(source, maxPixelSize) : NULL;
+    CFRelease(source);
+    if (!imageRef) {
+        return nil;
+    }
+    
+    UIImage *image = [[UIImage alloc] initWithCGImage:imageRef scale:1 orientation:UIImageOrientationUp];
+    CGImageRelease(imageRef);
+    return image;
+}
+
 + (UIImage *)zl_imageWithContentsOfFile:(NSString *)path {
     NSData *data = [NSData dataWithContentsOfFile:path];
     if (data == nil) {
@@ -1070,7 +1832,11 @@ static void *ZLNetworkingImageISDecodedAssociatedKey = &ZLNetworkingImageISDecod
                                       targetSize:(CGSize)targetSize
                                           radius:(CGFloat)radius
                                      contentMode:(ZLNetImageViewContentMode)contentMode {
-    NSData *data = [NSData dataWithContentsOfFile:path];
+    if (path == nil) {
+        return nil;
+    }
+    // 映射文件即可，降采样解码只会读取需要的部分
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:nil];
     if (data == nil) {
         return nil;
     }
@@ -1189,51 +1955,103 @@ static void *ZLNetworkingImageISDecodedAssociatedKey = &ZLNetworkingImageISDecod
 
 @end
 
-@interface ZLImageMemoryCacheNode : NSObject
-
-@property (nonatomic, strong) UIImage *image;
+/// 下载过程中基于已收到的数据生成渐进式 JPEG / 交错 PNG 的部分图像；GIF 和 APNG 收全第一帧后就返回可以播放的动图，之后继续往里追加帧
+@interface ZLIncrementalImageDecoder : NSObject
 
-@property (nonatomic, copy) NSString *identifier;
+/// 正在解码时丢弃新的数据快照，避免解码堆积拖慢下载
+@property (atomic, assign, getter=isDecoding) BOOL decoding;
 
-@property (nonatomic, assign) NSInteger memoryCost;
+/// 最终图像已生成，之后不再回调部分图像
+@property (atomic, assign, getter=isFinished) BOOL finished;
 
-@property (nonatomic, assign) NSTimeInterval timestamp;
+/// 已经返回过的 GIF 或 APNG 动图，下载完成后用全部数据补齐，作为最终图像
+@property (atomic, strong, nullable) ZLAnimatedImage *animatedImage;
 
-@property (nonatomic, strong) ZLImageMemoryCacheNode *prev;
+- (instancetype)initWithTargetSize:(CGSize)targetSize
+                            radius:(CGFloat)radius
+                       contentMode:(ZLNetImageViewContentMode)contentMode;
 
-@property (nonatomic, strong) ZLImageMemoryCacheNode *next;
+/// data 为目前为止收到的全部数据
+- (UIImage *)partialImageWithData:(NSData *)data;
 
 @end
 
-@implementation ZLImageMemoryCacheNode
+@implementation ZLIncrementalImageDecoder {
+    CGImageSourceRef _imageSource;
+    CGSize _targetSize;
+    CGFloat _radius;
+    ZLNetImageViewContentMode _contentMode;
+    BOOL _unsupported;
+}
 
-- (instancetype)initWithImage:(UIImage *)image identifier:(NSString *)identifier {
+- (instancetype)initWithTargetSize:(CGSize)targetSize
+                            radius:(CGFloat)radius
+                       contentMode:(ZLNetImageViewContentMode)contentMode {
     if (self = [super init]) {
-        self.image = image;
-        self.identifier = identifier;
-        self.timestamp = [NSDate date].timeIntervalSince1970;
-        _memoryCost = -1;
+        _targetSize = targetSize;
+        _radius = radius;
+        _contentMode = contentMode;
     }
     return self;
 }
 
-- (NSInteger)memoryCost {
-    if (_memoryCost == -1) {
-        _memoryCost = [[self class] memoryCacheCostForImage:self.image];
+- (UIImage *)partialImageWithData:(NSData *)data {
+    if (_unsupported || data.length == 0) {
+        return nil;
+    }
+    if (self.animatedImage) {
+        // 动图已经交给视图播放，新的帧直接追加进去
+        [self.animatedImage updateWithData:data finished:NO];
+        return nil;
+    }
+    if (!_imageSource) {
+        ZLImageFormat imgFormat = zl_imageFormatForImageData(data);
+        // acTL 在第一个 IDAT 之前，没看到 IDAT 之前还不知道是不是 APNG
+        if (imgFormat == ZLImageFormatPNG && ZLAPNGSniff(data.bytes, data.length) == ZLAPNGSniffNeedMoreData) {
+            return nil;
+        }
+        if (imgFormat == ZLImageFormatWebP && ZLWebPSniff(data.bytes, data.length) == ZLWebPSniffNeedMoreData) {
+            return nil;
+        }
+        if (ZLFrameCodecForImageData(data)) {
+            self.animatedImage = [[ZLAnimatedImage alloc] initWithIncrementalData:data scale:[UIScreen mainScreen].scale];
+            return self.animatedImage;
+        }
+        if (imgFormat != ZLImageFormatJPEG && imgFormat != ZLImageFormatPNG) {
+            _unsupported = YES;
+            return nil;
+        }
+        _imageSource = CGImageSourceCreateIncremental(NULL);
+    }
+    CGImageSourceUpdateData(_imageSource, (__bridge CFDataRef)data, false);
+    
+    // 图像头还没收全时拿不到宽高，无法解码
+    CGImageSourceStatus status = CGImageSourceGetStatusAtIndex(_imageSource, 0);
+    if (status != kCGImageStatusIncomplete && status != kCGImageStatusComplete) {
+        return nil;
+    }
+    
+    NSUInteger maxPixelSize = ZLDownsampleMaxPixelSize(_imageSource, _targetSize, _contentMode);
+    CGImageRef imageRef;
+    if (maxPixelSize > 0) {
+        imageRef = ZLCreateThumbnailImage(_imageSource, maxPixelSize);
+    } else {
+        imageRef = CGImageSourceCreateImageAtIndex(_imageSource, 0, NULL);
     }
-    return _memoryCost;
-}
-
-+ (NSUInteger)memoryCacheCostForImage:(UIImage *)image {
-    CGImageRef imageRef = image.CGImage;
     if (!imageRef) {
-        return 0;
+        return nil;
     }
-    NSUInteger bytesPerFrame = CGImageGetBytesPerRow(imageRef) * CGImageGetHeight(imageRef);
-    NSUInteger frameCount = image.images.count > 0 ? image.images.count : 1;
+    UIImage *image = [[UIImage alloc] initWithCGImage:imageRef scale:1 orientation:UIImageOrientationUp];
+    CGImageRelease(imageRef);
+    
+    return [image imageScaleForSize:_targetSize withCornerRadius:_radius contentMode:_contentMode];
+}
 
-    NSUInteger cost = bytesPerFrame * frameCount;
-    return cost;
+- (void)dealloc {
+    if (_imageSource) {
+        CFRelease(_imageSource);
+        _imageSource = NULL;
+    }
 }
 
 @end
@@ -1243,19 +2061,20 @@ static void *ZLNetworkingImageISDecodedAssociatedKey = &ZLNetworkingImageISDecod
 @property (nonatomic, copy, readwrite) NSString *workspacePath;
 
 @property (nonatomic, strong) dispatch_queue_t workQueue;
-@property (nonatomic, strong) dispatch_queue_t serialQueue;
 
-@property (nonatomic, strong) ZLImageMemoryCacheNode *header;
-@property (nonatomic, strong) ZLImageMemoryCacheNode *footer;
-@property (nonatomic, assign) NSInteger memoryCachedBytes;
+@property (nonatomic, strong) ZLImageMemoryCache *memoryCache;
+
+@property (nonatomic, strong) ZLDiskCache *diskCache;
 
-@property (nonatomic, strong) NSMutableSet<NSString *> *cacheIdentifiers;
+/// 未开启时为 nil
+@property (atomic, strong) ZLDecodedImageCache *decodedCache;
 
 - (void)getCacheWithURL:(NSURL *)url
              targetSize:(CGSize)targetSize
                  radius:(CGFloat)radius
             contentMode:(ZLNetImageViewContentMode)contentMode
                progress:(void (^)(float progress))progressBlock
+           partialImage:(void (^)(UIImage *partialImage))partialImageBlock
               completed:(void (^)(UIImage * _Nullable image, NSError * _Nullable error))completedBlock;
 
 @end
@@ -1263,115 +2082,66 @@ static void *ZLNetworkingImageISDecodedAssociatedKey = &ZLNetworkingImageISDecod
 @implementation ZLImageCacheManager
 
 - (void)addCacheImage:(UIImage *)image identifier:(NSString *)identifier {
-    dispatch_sync(self.serialQueue, ^{
-        if ([self.cacheIdentifiers containsObject:identifier]) {
-            return;
-        }
-        [self.cacheIdentifiers addObject:identifier];
-        
-        ZLImageMemoryCacheNode *node = [[ZLImageMemoryCacheNode alloc] initWithImage:image identifier:identifier];
-        
-        if (self.header == nil) {
-            if (node.memoryCost >= self.maxMemoryCacheBytes) {
-                return;
-            }
-            
-            self.header = node;
-            self.footer = node;
-            self.memoryCachedBytes = node.memoryCost;
-        } else {
-            if (node.memoryCost >= self.maxMemoryCacheBytes) {
-                return;
-            }
-            
-            NSInteger preMemoryCachedBytes = self.memoryCachedBytes + node.memoryCost;
-            if (preMemoryCachedBytes >= self.maxMemoryCacheBytes) {
-                ZLImageMemoryCacheNode *lastNode = self.footer;
-                preMemoryCachedBytes -= lastNode.memoryCost;
-                while (preMemoryCachedBytes >= self.maxMemoryCacheBytes) {
-                    [self.cacheIdentifiers removeObject:lastNode.identifier];
-                    lastNode = lastNode.prev;
-                    lastNode.next.prev = nil;
-                    lastNode.next = nil;
-                    preMemoryCachedBytes -= lastNode.memoryCost;
-                }
-                self.footer = lastNode;
-            }
-            
-            self.footer.next = node;
-            node.prev = self.footer;
-            self.footer = node;
-            
-            self.memoryCachedBytes = preMemoryCachedBytes;
-        }
-    });
+    [self.memoryCache setImage:image forKey:identifier];
 }
 
-- (void)updateCacheNode:(ZLImageMemoryCacheNode *)node {
-    dispatch_sync(self.serialQueue, ^{
-        node.timestamp = [NSDate date].timeIntervalSince1970;
-        if (node == self.header) {
-            return;
-        } else if (node == self.footer) {
-            node.prev.next = nil;
-            self.footer = node.prev;
-            
-            self.header.prev = node;
-            node.next = self.header;
-            node.prev = nil;
-            self.header = node;
-            return;
-        }
+- (void)setMaxMemoryCacheBytes:(NSUInteger)maxMemoryCacheBytes {
+    self.memoryCache.maxCost = maxMemoryCacheBytes;
+}
 
-        node.prev.next = node.next;
-        node.next.prev = node.prev;
+- (NSUInteger)maxMemoryCacheBytes {
+    return self.memoryCache.maxCost;
+}
 
-        self.header.prev = node;
-        node.next = self.header;
-        node.prev = nil;
-        self.header = node;
-    });
+- (void)setMaxDiskCacheBytes:(unsigned long long)maxDiskCacheBytes {
+    self.diskCache.byteLimit = maxDiskCacheBytes;
 }
 
-- (ZLImageMemoryCacheNode *)findMemoryCacheByIdentifier:(NSString *)identifier {
-    __block ZLImageMemoryCacheNode *resultNode = nil;
-    dispatch_sync(self.serialQueue, ^{
-        ZLImageMemoryCacheNode *headerNode = self.header;
-        ZLImageMemoryCacheNode *footerNode = self.footer;
-        
-        while (headerNode != footerNode) {
-            if ([headerNode.identifier isEqualToString:identifier]) {
-                resultNode = headerNode;
-            }
-            
-            if ([footerNode.identifier isEqualToString:identifier]) {
-                resultNode = footerNode;
-            }
-            
-            headerNode = headerNode.next;
-            footerNode = footerNode.prev;
-        }
-        
-        if (resultNode == nil && headerNode && [headerNode.identifier isEqualToString:identifier]) {
-            resultNode = headerNode;
+- (unsigned long long)maxDiskCacheBytes {
+    return self.diskCache.byteLimit;
+}
+
+- (void)setMaxDiskCacheAge:(NSTimeInterval)maxDiskCacheAge {
+    self.diskCache.ageLimit = maxDiskCacheAge;
+}
+
+- (NSTimeInterval)maxDiskCacheAge {
+    return self.diskCache.ageLimit;
+}
+
+- (void)setDecodedDiskCacheEnabled:(BOOL)decodedDiskCacheEnabled {
+    @synchronized (self) {
+        if (!decodedDiskCacheEnabled) {
+            self.decodedCache = nil;
+        } else if (self.decodedCache == nil) {
+            self.decodedCache = [[ZLDecodedImageCache alloc] initWithPath:[[ZLURLSessionManager shared].workspaceDirURLString stringByAppendingPathComponent:@"bitmaps"] byteLimit:_maxDecodedDiskCacheBytes];
         }
+    }
+}
+
+- (BOOL)decodedDiskCacheEnabled {
+    return self.decodedCache != nil;
+}
+
+- (void)setMaxDecodedDiskCacheBytes:(unsigned long long)maxDecodedDiskCacheBytes {
+    @synchronized (self) {
+        _maxDecodedDiskCacheBytes = maxDecodedDiskCacheBytes;
+        self.decodedCache.byteLimit = maxDecodedDiskCacheBytes;
+    }
+}
+
+- (void)storeDecodedImage:(UIImage *)image identifier:(NSString *)identifier sourceIdentifier:(NSString *)sourceIdentifier {
+    ZLDecodedImageCache *decodedCache = self.decodedCache;
+    if (image == nil || decodedCache == nil) {
+        return;
+    }
+    dispatch_async(self.workQueue, ^{
+        [decodedCache storeImage:image forKey:identifier sourceKey:sourceIdentifier];
     });
-    return resultNode;
 }
 
 - (void)didReceiveMemoryWarning:(NSNotification *)notification {
-    dispatch_sync(self.serialQueue, ^{
-        ZLImageMemoryCacheNode *headerNode = self.header;
-        while (headerNode) {
-            ZLImageMemoryCacheNode *next = headerNode.next;
-            headerNode.next = nil;
-            next.prev = nil;
-            headerNode = next;
-        }
-        self.header = nil;
-        self.footer = nil;
-        [self.cacheIdentifiers removeAllObjects];
-    });
+    [self.memoryCache removeAllImages];
 }
 
 + (instancetype)shared {
@@ -1388,87 +2158,137 @@ static void *ZLNetworkingImageISDecodedAssociatedKey = &ZLNetworkingImageISDecod
     if (self) {
         _workspacePath = [[ZLURLSessionManager shared].workspaceDirURLString stringByAppendingPathComponent:@"caches"];
         
-        BOOL isDir = NO;
-        if (![[NSFileManager defaultManager] fileExistsAtPath:_workspacePath isDirectory:&isDir] || !isDir) {
-            if (![[NSFileManager defaultManager] createDirectoryAtPath:_workspacePath withIntermediateDirectories:YES attributes:nil error:nil]) {
-                NSLog(@"file system error");
-            }
-        }
+        _diskCache = [[ZLDiskCache alloc] initWithPath:_workspacePath byteLimit:200 * 1024 * 1024 ageLimit:7 * 24 * 60 * 60];
         
-        _workQueue = dispatch_queue_create("com.richie.zlnetimage", DISPATCH_QUEUE_CONCURRENT);
-        _serialQueue = dispatch_queue_create("com.richie.zlnetimage.sync", DISPATCH_QUEUE_SERIAL);
+        _maxDecodedDiskCacheBytes = 100 * 1024 * 1024;
         
-        _maxMemoryCacheBytes = ZLDeviceTotalMemory() / 4;
+        _workQueue = dispatch_queue_create("com.richie.zlnetimage", DISPATCH_QUEUE_CONCURRENT);
         
-        self.cacheIdentifiers = [NSMutableSet set];
+        _memoryCache = [[ZLImageMemoryCache alloc] initWithMaxCost:ZLDeviceTotalMemory() / 4];
         
         [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(didReceiveMemoryWarning:) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
     }
     return self;
 }
 
-- (BOOL)cacheFileExists:(NSString *)destPath {
-    BOOL isDir = NO;
-    if ([[NSFileManager defaultManager] fileExistsAtPath:destPath isDirectory:&isDir] && !isDir) {
-        return YES;
-    }
-    return NO;
-}
-
-- (NSString *)identifierWithURL:(NSURL *)url {
-    return ZLSha256HashFor(url.absoluteString);
-}
-
 - (void)getCacheWithURL:(NSURL *)url
              targetSize:(CGSize)targetSize
                  radius:(CGFloat)radius
             contentMode:(ZLNetImageViewContentMode)contentMode
                progress:(void (^)(float progress))progressBlock
+           partialImage:(void (^)(UIImage *partialImage))partialImageBlock
               completed:(void (^)(UIImage * _Nullable image, NSError * _Nullable error))completedBlock {
     
-    NSString *identifier = [self identifierWithURL:url];
+    NSString *identifier = url.absoluteString;
     NSString *memoryIdentifier = [identifier stringByAppendingFormat:@"_%.2f_%.2f_%.2f", targetSize.width, targetSize.height, radius];
-    NSString *destPath = [_workspacePath stringByAppendingPathComponent:identifier];
+    // 持久化的位图跨越启动，内容模式和屏幕倍率也要区分
+    NSString *decodedIdentifier = [memoryIdentifier stringByAppendingFormat:@"_%ld_%.1f", (long)contentMode, [UIScreen mainScreen].scale];
     
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
-        ZLImageMemoryCacheNode *node = [self findMemoryCacheByIdentifier:memoryIdentifier];
-        if (node != nil) {
-            [self updateCacheNode:node];
+        UIImage *cachedImage = [self.memoryCache imageForKey:memoryIdentifier];
+        if (cachedImage != nil) {
             dispatch_async(dispatch_get_main_queue(), ^{
-                completedBlock(node.image, nil);
+                completedBlock(cachedImage, nil);
             });
             return;
         }
         
-        NSURL *desURL = [NSURL fileURLWithPath:destPath];
+        // 命中时只是映射文件并包装成 CGImage，像素在首次绘制时才换页进来。
+        // 原图已过期或被淘汰时位图也不再使用，之后重新下载的内容可能已经变了
+        ZLDecodedImageCache *decodedCache = self.decodedCache;
+        UIImage *decodedImage = nil;
+        if (decodedCache != nil) {
+            if ([self.diskCache containsDataForKey:identifier]) {
+                decodedImage = [decodedCache imageForKey:decodedIdentifier];
+            } else {
+                [decodedCache removeImageForKey:decodedIdentifier];
+            }
+        }
+        if (decodedImage != nil) {
+            [self addCacheImage:decodedImage identifier:memoryIdentifier];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completedBlock(decodedImage, nil);
+            });
+            return;
+        }
         
         void (^downloadBlock)(void) = ^{
-            [[ZLURLSessionManager shared] downloadWithRequest:[NSURLRequest requestWithURL:url] headers:nil destination:desURL progress:progressBlock completionHandler:^(NSURLResponse *response, NSURL *filePath, NSError *error) {
+            NSString *destPath = [self.diskCache filePathForKey:identifier];
+            NSURL *desURL = [NSURL fileURLWithPath:destPath];
+            // 已过期或被淘汰但还没删掉的旧文件会让下载完成后的移动失败
+            [[NSFileManager defaultManager] removeItemAtURL:desURL error:nil];
+            // 原图要重新下载，由旧内容生成的各种尺寸的位图都作废
+            [self.decodedCache removeImagesForSourceKey:identifier];
+            ZLIncrementalImageDecoder *decoder = nil;
+            if (partialImageBlock) {
+                decoder = [[ZLIncrementalImageDecoder alloc] initWithTargetSize:targetSize radius:radius contentMode:contentMode];
+            }
+            __block NSData *downloadedData = nil;
+            void (^receivedDataBlock)(NSData *, BOOL) = ^(NSData *receivedData, BOOL finished) {
+                if (finished) {
+                    downloadedData = receivedData;
+                    return;
+                }
+                if (decoder == nil || decoder.isDecoding || decoder.isFinished) {
+                    return;
+                }
+                decoder.decoding = YES;
+                NSData *snapshot = [receivedData copy];
+                dispatch_async(self.workQueue, ^{
+                    UIImage *partialImage = [decoder partialImageWithData:snapshot];
+                    decoder.decoding = NO;
+                    if (partialImage == nil) {
+                        return;
+                    }
+                    dispatch_async(dispatch_get_main_queue(), ^{
+                        if (!decoder.isFinished) {
+                            partialImageBlock(partialImage);
+                        }
+                    });
+                });
+            };
+            [[ZLURLSessionManager shared] downloadWithRequest:[NSURLRequest requestWithURL:url] headers:nil destination:desURL priority:ZLRequestPriorityVisible progress:progressBlock receivedData:receivedDataBlock completionHandler:^(NSURLResponse *response, NSURL *filePath, NSError *error) {
+                decoder.finished = YES;
                 if (error) {
                     dispatch_async(dispatch_get_main_queue(), ^{
                         completedBlock(nil, error);
                     });
                     return;
                 }
+                [self.diskCache fileDidChangeForKey:identifier];
                 
-                __block UIImage *image = [UIImage zl_imageWithContentsOfFile:destPath targetSize:targetSize radius:radius contentMode:contentMode];
+                // 下载时已在内存中的数据直接解码，不再从磁盘读回
+                __block UIImage *image = nil;
+                ZLAnimatedImage *animatedImage = decoder.animatedImage;
+                if (animatedImage) {
+                    // 正在播放的动图补齐剩下的帧，视图不用重新开始
+                    [animatedImage updateWithData:downloadedData ?: [NSData dataWithContentsOfFile:destPath options:NSDataReadingMappedIfSafe error:nil] finished:YES];
+                    image = animatedImage;
+                } else if (downloadedData) {
+                    image = [UIImage zl_imageWithData:downloadedData targetSize:targetSize radius:radius contentMode:contentMode];
+                } else {
+                    image = [UIImage zl_imageWithContentsOfFile:destPath targetSize:targetSize radius:radius contentMode:contentMode];
+                }
                 [self addCacheImage:image identifier:memoryIdentifier];
+                [self storeDecodedImage:image identifier:decodedIdentifier sourceIdentifier:identifier];
                 dispatch_async(dispatch_get_main_queue(), ^{
                     completedBlock(image, nil);
                 });
             }];
         };
         
-        if ([self cacheFileExists:destPath]) {
+        // 只查内存中的磁盘索引，不访问文件系统
+        if ([self.diskCache containsDataForKey:identifier]) {
             dispatch_async(self.workQueue, ^{
-                __block UIImage *image = [UIImage zl_imageWithContentsOfFile:destPath  targetSize:targetSize radius:radius contentMode:contentMode];
+                __block UIImage *image = [UIImage zl_imageWithData:[self.diskCache dataForKey:identifier] targetSize:targetSize radius:radius contentMode:contentMode];
                 if (image == nil) {
-                    [[NSFileManager defaultManager] removeItemAtURL:desURL error:nil];
+                    [self.diskCache removeDataForKey:identifier];
                     
                     downloadBlock();
                     return;
                 }
                 [self addCacheImage:image identifier:memoryIdentifier];
+                [self storeDecodedImage:image identifier:decodedIdentifier sourceIdentifier:identifier];
                 dispatch_async(dispatch_get_main_queue(), ^{
                     completedBlock(image, nil);
                 });
@@ -1481,8 +2301,8 @@ static void *ZLNetworkingImageISDecodedAssociatedKey = &ZLNetworkingImageISDecod
 }
 
 - (void)clearDiskCache {
-    [ZLURLSessionManager deleteDirPath:_workspacePath];
-    [[NSFileManager defaultManager] createDirectoryAtPath:_workspacePath withIntermediateDirectories:YES attributes:nil error:nil];
+    [self.diskCache removeAllData];
+    [self.decodedCache removeAllImages];
 }
 
 @end
@@ -1497,6 +2317,9 @@ static void *ZLNetImageViewConfigAKey = &ZLNetImageViewConfigAKey;
 
 @property (nonatomic, assign) ZLNetImageViewContentMode renderContentMode;
 
+/// 最近一次设置的 URL，复用时据此降级旧的下载并丢弃旧的结果
+@property (nonatomic, strong) NSURL *currentURL;
+
 @end
 
 @implementation ZLNetImageViewConfig
@@ -1559,6 +2382,14 @@ static void *ZLNetImageViewConfigAKey = &ZLNetImageViewConfigAKey;
           placeholderImage:(nullable UIImage *)placeholder
                   progress:(nullable void (^)(float progress))progressBlock
 completed:(nullable void (^)(UIImage * _Nullable image, NSError * _Nullable error))completedBlock {
+    [self zl_setImageWithURL:url placeholderImage:placeholder progress:progressBlock partialImage:nil completed:completedBlock];
+}
+
+- (void)zl_setImageWithURL:(nullable NSURL *)url
+          placeholderImage:(nullable UIImage *)placeholder
+                  progress:(nullable void (^)(float progress))progressBlock
+              partialImage:(nullable void (^)(UIImage *partialImage))partialImageBlock
+                 completed:(nullable void (^)(UIImage * _Nullable image, NSError * _Nullable error))completedBlock {
     if ([NSThread isMainThread]) {
         self.image = placeholder ?: [UIImage new];
     } else {
@@ -1566,6 +2397,14 @@ completed:(nullable void (^)(UIImage * _Nullable image, NSError * _Nullable erro
             self.image = placeholder ?: [UIImage new];
         });
     }
+    
+    ZLNetImageViewConfig *config = [self getZLRenderConfig];
+    NSURL *previousURL = config.currentURL;
+    config.currentURL = url;
+    if (previousURL != nil && ![previousURL isEqual:url]) {
+        [[ZLURLSessionManager shared] deprioritizeDownloadForURL:previousURL];
+    }
+    
     if (url == nil) {
         if (completedBlock) {
             completedBlock(nil, [NSError errorWithDomain:@"ZLNetImageError" code:-999 userInfo:@{NSLocalizedDescriptionKey: @"url must not be nil"}]);
@@ -1578,8 +2417,16 @@ completed:(nullable void (^)(UIImage * _Nullable image, NSError * _Nullable erro
                                            radius:self.renderCornerRadius
                                       contentMode:self.renderContentMode
                                          progress:progressBlock
+                                     partialImage:partialImageBlock ? ^(UIImage *partialImage) {
+        if (![config.currentURL isEqual:url]) {
+            return;
+        }
+        [self setImage:partialImage];
+        partialImageBlock(partialImage);
+    } : nil
                                         completed:^(UIImage * _Nullable image, NSError * _Nullable error) {
-        if (image != nil) {
+        // 已经换成别的 URL 时不再覆盖图片
+        if (image != nil && [config.currentURL isEqual:url]) {
             [self setImage:image];
         }
         if (completedBlock) {
@@ -0,0 +1,35 @@
+//
+//  ZLProxyResolver.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/30.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// 解析结果回调，proxy 为 CFNetworkCopyProxiesForURL 格式的单个代理设置（已执行过 PAC），直连时为 nil
+typedef void(^ZLProxyResolverCompletion)(NSDictionary *_Nullable proxy);
+
+/// 进程内共享的代理解析：缓存系统代理设置、PAC 脚本（带 ETag/Last-Modified 重新验证）和每个 host 的解析结果，
+/// 网络变化时整体失效并在后台重新解析最近用过的 host，建连时命中缓存就不再走代理发现
+@interface ZLProxyResolver : NSObject
+
++ (instancetype)sharedResolver;
+
+/// 每个 host 解析结果的有效期，默认 300 秒
+@property (nonatomic, assign) NSTimeInterval decisionLifetime;
+
+/// 有缓存时在当前线程同步回调，否则在内部串行队列上解析后回调；url 只用 scheme 和 host
+- (void)resolveProxyForURL:(NSURL *)url completion:(ZLProxyResolverCompletion)completion;
+
+/// 在后台提前解析，之后的 resolveProxyForURL:completion: 可以直接命中
+- (void)prefetchProxyForURL:(NSURL *)url;
+
+/// 丢弃所有缓存，网络变化时会自动调用
+- (void)invalidate;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,414 @@
+//
+//  ZLProxyResolver.m
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/30.
+//
+
+#import "ZLProxyResolver.h"
+#import "ZLHTTPResponseCache.h"
+#import "ZHLReachability.h"
+
+static NSTimeInterval const ZLProxyResolverDefaultDecisionLifetime = 300;
+
+/// 网络变化后在后台重新解析的 host 数上限，按最近使用排序
+static NSUInteger const ZLProxyResolverMaxWarmHosts = 16;
+
+/// 缓存的 host 解析结果数上限，写入时超过就先清掉过期的，仍然超过再淘汰最久未使用的
+static NSUInteger const ZLProxyResolverMaxDecisions = 256;
+
+static NSTimeInterval const ZLProxyResolverScriptTimeout = 10;
+
+/// 一个 host 的解析结果
+@interface ZLProxyDecision : NSObject
+
+@property (nonatomic, strong) NSURL *url;
+
+/// 直连时为 nil
+@property (nonatomic, copy, nullable) NSDictionary *proxy;
+
+@property (nonatomic, assign) CFAbsoluteTime expiration;
+
+@property (nonatomic, assign) CFAbsoluteTime lastUsed;
+
+@end
+
+@implementation ZLProxyDecision
+
+@end
+
+@implementation ZLProxyResolver {
+    dispatch_queue_t _queue;
+
+    /// 只保护 _decisions，命中缓存时不经过 _queue，避免被正在执行的 PAC 脚本阻塞
+    dispatch_semaphore_t _lock;
+    NSMutableDictionary<NSString *, ZLProxyDecision *> *_decisions;
+
+    // 以下只在 _queue 上访问
+    NSUInteger _generation;             // invalidate 时加一，之前发起的解析结果不再缓存
+    NSDictionary *_systemSettings;
+    CFAbsoluteTime _systemSettingsExpiration;
+    NSMutableDictionary<NSString *, NSMutableArray<ZLProxyResolverCompletion> *> *_pendingDecisions;   // 键带上 generation
+    NSMutableDictionary<NSURL *, NSMutableArray<void (^)(NSString *)> *> *_pendingScripts;
+    NSMutableSet<NSURL *> *_loadedScripts;
+    NSMutableSet<NSURL *> *_scriptsNeedingValidation;
+    ZLHTTPResponseCache *_scriptCache;
+    NSURLSession *_session;
+
+    ZHLReachability *_reachability;
+}
+
++ (instancetype)sharedResolver {
+    static ZLProxyResolver *resolver = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        resolver = [[ZLProxyResolver alloc] init];
+    });
+    return resolver;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _decisionLifetime = ZLProxyResolverDefaultDecisionLifetime;
+        _queue = dispatch_queue_create("com.richie.ZLProxyResolver", DISPATCH_QUEUE_SERIAL);
+        _lock = dispatch_semaphore_create(1);
+        _decisions = [NSMutableDictionary dictionary];
+        _pendingDecisions = [NSMutableDictionary dictionary];
+        _pendingScripts = [NSMutableDictionary dictionary];
+        _loadedScripts = [NSMutableSet set];
+        _scriptsNeedingValidation = [NSMutableSet set];
+
+        NSString *directory = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES).firstObject stringByAppendingPathComponent:@"com.richie.ZLProxyResolver"];
+        _scriptCache = [[ZLHTTPResponseCache alloc] initWithDirectory:directory memoryCapacity:256 * 1024 diskCapacity:1024 * 1024];
+
+        NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+        configuration.requestCachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+        configuration.timeoutIntervalForRequest = ZLProxyResolverScriptTimeout;
+        // PAC 文件本身直连获取
+        configuration.connectionProxyDictionary = @{};
+        NSOperationQueue *delegateQueue = [[NSOperationQueue alloc] init];
+        delegateQueue.underlyingQueue = _queue;
+        delegateQueue.maxConcurrentOperationCount = 1;
+        _session = [NSURLSession sessionWithConfiguration:configuration delegate:nil delegateQueue:delegateQueue];
+
+        // SCNetworkReachability 的回调需要在有 runloop 的线程上注册
+        __weak typeof(self) wself = self;
+        dispatch_async(dispatch_get_main_queue(), ^{
+            __strong typeof(wself) sself = wself;
+            if (sself == nil) {
+                return;
+            }
+            sself->_reachability = [ZHLReachability reachabilityForInternetConnection];
+            sself->_reachability.statusChangeBlock = ^(NetworkStatus status) {
+                [wself invalidate];
+            };
+            [sself->_reachability startNotifier];
+        });
+    }
+    return self;
+}
+
+/// CFNetwork 不认识 ws:// 和 wss://，只按 http(s)://host 解析
+static NSString *ZLProxyResolverKeyForURL(NSURL *url, NSURL **httpURL) {
+    NSString *scheme = url.scheme.lowercaseString;
+    BOOL secure = [scheme isEqualToString:@"wss"] || [scheme isEqualToString:@"https"];
+    NSString *host = url.host.lowercaseString ?: @"";
+    NSString *key = [NSString stringWithFormat:@"%@://%@", secure ? @"https" : @"http", host];
+    if (httpURL) {
+        *httpURL = [NSURL URLWithString:key];
+    }
+    return key;
+}
+
+/// invalidate 之后同一个 host 要重新解析，不能并到上一代还没完成的解析里
+static NSString *ZLProxyResolverPendingKey(NSString *key, NSUInteger generation) {
+    return [NSString stringWithFormat:@"%lu %@", (unsigned long)generation, key];
+}
+
+- (void)resolveProxyForURL:(NSURL *)url completion:(ZLProxyResolverCompletion)completion {
+    NSURL *httpURL = nil;
+    NSString *key = ZLProxyResolverKeyForURL(url, &httpURL);
+
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    ZLProxyDecision *decision = _decisions[key];
+    BOOL hit = decision != nil && decision.expiration > now;
+    NSDictionary *proxy = decision.proxy;
+    if (hit) {
+        decision.lastUsed = now;
+    }
+    dispatch_semaphore_signal(_lock);
+
+    if (hit || httpURL == nil) {
+        completion(proxy);
+        return;
+    }
+
+    dispatch_async(_queue, ^{
+        [self _resolveKey:key URL:httpURL completion:completion];
+    });
+}
+
+- (void)prefetchProxyForURL:(NSURL *)url {
+    NSURL *httpURL = nil;
+    NSString *key = ZLProxyResolverKeyForURL(url, &httpURL);
+    if (httpURL == nil) {
+        return;
+    }
+
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    ZLProxyDecision *decision = _decisions[key];
+    BOOL hit = decision != nil && decision.expiration > CFAbsoluteTimeGetCurrent();
+    dispatch_semaphore_signal(_lock);
+
+    if (!hit) {
+        dispatch_async(_queue, ^{
+            [self _resolveKey:key URL:httpURL completion:nil];
+        });
+    }
+}
+
+- (void)invalidate {
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    NSArray<ZLProxyDecision *> *recent = [_decisions.allValues sortedArrayUsingComparator:^NSComparisonResult(ZLProxyDecision *a, ZLProxyDecision *b) {
+        return a.lastUsed > b.lastUsed ? NSOrderedAscending : (a.lastUsed < b.lastUsed ? NSOrderedDescending : NSOrderedSame);
+    }];
+    [_decisions removeAllObjects];
+    dispatch_semaphore_signal(_lock);
+
+    if (recent.count > ZLProxyResolverMaxWarmHosts) {
+        recent = [recent subarrayWithRange:NSMakeRange(0, ZLProxyResolverMaxWarmHosts)];
+    }
+
+    dispatch_async(_queue, ^{
+        self->_generation++;
+        self->_systemSettings = nil;
+        // 换了网络后同一个 PAC 地址可能返回不同的脚本，带上验证头重新请求
+        [self->_scriptsNeedingValidation unionSet:self->_loadedScripts];
+
+        for (ZLProxyDecision *decision in recent) {
+            NSURL *httpURL = decision.url;
+            [self _resolveKey:ZLProxyResolverKeyForURL(httpURL, NULL) URL:httpURL completion:nil];
+        }
+    });
+}
+
+///--------------------------------------
+#pragma mark - Resolve (on _queue)
+///--------------------------------------
+
+- (NSDictionary *)_currentSystemSettings {
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    if (_systemSettings == nil || _systemSettingsExpiration <= now) {
+        _systemSettings = CFBridgingRelease(CFNetworkCopySystemProxySettings()) ?: @{};
+        _systemSettingsExpiration = now + self.decisionLifetime;
+    }
+    return _systemSettings;
+}
+
+- (void)_resolveKey:(NSString *)key URL:(NSURL *)httpURL completion:(nullable ZLProxyResolverCompletion)completion {
+    NSUInteger generation = _generation;
+    NSString *pendingKey = ZLProxyResolverPendingKey(key, generation);
+    NSMutableArray<ZLProxyResolverCompletion> *pending = _pendingDecisions[pendingKey];
+    if (pending != nil) {
+        if (completion) {
+            [pending addObject:completion];
+        }
+        return;
+    }
+
+    // 排队期间可能已经被别的请求解析过
+    dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+    ZLProxyDecision *decision = _decisions[key];
+    BOOL hit = decision != nil && decision.expiration > CFAbsoluteTimeGetCurrent();
+    dispatch_semaphore_signal(_lock);
+    if (hit) {
+        if (completion) {
+            completion(decision.proxy);
+        }
+        return;
+    }
+
+    pending = [NSMutableArray array];
+    if (completion) {
+        [pending addObject:completion];
+    }
+    _pendingDecisions[pendingKey] = pending;
+
+    NSDictionary *proxySettings = [self _currentSystemSettings];
+    // 这次调用同时满足了 CFNetworkCopyProxiesForAutoConfigurationScript 需要先调用一次
+    // CFNetworkCopyProxiesForURL 的要求 <rdar://problem/5530166>
+    NSArray *proxies = CFBridgingRelease(CFNetworkCopyProxiesForURL((__bridge CFURLRef)httpURL, (__bridge CFDictionaryRef)proxySettings));
+    NSDictionary *settings = proxies.firstObject;
+    NSString *proxyType = settings[(__bridge NSString *)kCFProxyTypeKey];
+
+    if ([proxyType isEqualToString:(__bridge NSString *)kCFProxyTypeAutoConfigurationURL]) {
+        NSURL *pacURL = settings[(__bridge NSString *)kCFProxyAutoConfigurationURLKey];
+        if (pacURL) {
+            [self _loadScriptWithURL:pacURL completion:^(NSString *script) {
+                [self _finishKey:key URL:httpURL withScript:script generation:generation];
+            }];
+            return;
+        }
+    }
+    if ([proxyType isEqualToString:(__bridge NSString *)kCFProxyTypeAutoConfigurationJavaScript]) {
+        NSString *script = settings[(__bridge NSString *)kCFProxyAutoConfigurationJavaScriptKey];
+        if (script) {
+            [self _finishKey:key URL:httpURL withScript:script generation:generation];
+            return;
+        }
+    }
+    [self _finishKey:key URL:httpURL proxy:settings cacheable:YES generation:generation];
+}
+
+- (void)_finishKey:(NSString *)key URL:(NSURL *)httpURL withScript:(nullable NSString *)script generation:(NSUInteger)generation {
+    if (script == nil) {
+        // 拿不到脚本时按直连处理，但不缓存，下次建连再试
+        [self _finishKey:key URL:httpURL proxy:nil cacheable:NO generation:generation];
+        return;
+    }
+
+    CFErrorRef err = NULL;
+    NSArray *proxies = CFBridgingRelease(CFNetworkCopyProxiesForAutoConfigurationScript((__bridge CFStringRef)script, (__bridge CFURLRef)httpURL, &err));
+    if (err) {
+        CFRelease(err);
+        [self _finishKey:key URL:httpURL proxy:nil cacheable:NO generation:generation];
+        return;
+    }
+    [self _finishKey:key URL:httpURL proxy:proxies.firstObject cacheable:YES generation:generation];
+}
+
+- (void)_finishKey:(NSString *)key URL:(NSURL *)httpURL proxy:(nullable NSDictionary *)proxy cacheable:(BOOL)cacheable generation:(NSUInteger)generation {
+    NSString *proxyType = proxy[(__bridge NSString *)kCFProxyTypeKey];
+    if (proxyType == nil || [proxyType isEqualToString:(__bridge NSString *)kCFProxyTypeNone]) {
+        proxy = nil;
+    }
+
+    if (cacheable && generation == _generation) {
+        CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+        ZLProxyDecision *decision = [[ZLProxyDecision alloc] init];
+        decision.url = httpURL;
+        decision.proxy = proxy;
+        decision.expiration = now + self.decisionLifetime;
+        decision.lastUsed = now;
+
+        dispatch_semaphore_wait(_lock, DISPATCH_TIME_FOREVER);
+        if (_decisions[key] == nil && _decisions.count >= ZLProxyResolverMaxDecisions) {
+            [self _pruneDecisionsAtTime:now];
+        }
+        _decisions[key] = decision;
+        dispatch_semaphore_signal(_lock);
+    }
+
+    NSString *pendingKey = ZLProxyResolverPendingKey(key, generation);
+    NSArray<ZLProxyResolverCompletion> *completions = _pendingDecisions[pendingKey];
+    [_pendingDecisions removeObjectForKey:pendingKey];
+    for (ZLProxyResolverCompletion completion in completions) {
+        completion(proxy);
+    }
+}
+
+/// 调用方持有 _lock。过期的只会在查找时被覆盖，访问过很多 host 的进程里会一直留着，这里一并清掉
+- (void)_pruneDecisionsAtTime:(CFAbsoluteTime)now {
+    __block NSString *leastRecentKey = nil;
+    __block CFAbsoluteTime leastRecentUse = 0;
+    NSMutableArray<NSString *> *expiredKeys = [NSMutableArray array];
+    [_decisions enumerateKeysAndObjectsUsingBlock:^(NSString *key, ZLProxyDecision *decision, BOOL *stop) {
+        if (decision.expiration <= now) {
+            [expiredKeys addObject:key];
+        } else if (leastRecentKey == nil || decision.lastUsed < leastRecentUse) {
+            leastRecentKey = key;
+            leastRecentUse = decision.lastUsed;
+        }
+    }];
+    if (expiredKeys.count > 0) {
+        [_decisions removeObjectsForKeys:expiredKeys];
+    } else if (leastRecentKey != nil) {
+        [_decisions removeObjectForKey:leastRecentKey];
+    }
+}
+
+///--------------------------------------
+#pragma mark - PAC (on _queue)
+///--------------------------------------
+
+- (void)_loadScriptWithURL:(NSURL *)pacURL completion:(void (^)(NSString *_Nullable script))completion {
+    NSMutableArray *pending = _pendingScripts[pacURL];
+    if (pending != nil) {
+        [pending addObject:completion];
+        return;
+    }
+
+    if ([pacURL isFileURL]) {
+        completion([NSString stringWithContentsOfURL:pacURL usedEncoding:NULL error:NULL]);
+        return;
+    }
+
+    NSString *scheme = [pacURL.scheme lowercaseString];
+    if (![scheme isEqualToString:@"http"] && ![scheme isEqualToString:@"https"]) {
+        // Don't know how to read data from this URL, we'll have to give up
+        // We'll simply assume no proxies, and start the request as normal
+        completion(nil);
+        return;
+    }
+
+    NSURLRequest *cacheKeyRequest = [NSURLRequest requestWithURL:pacURL];
+    ZLHTTPCachedResponse *cachedResponse = [_scriptCache cachedResponseForRequest:cacheKeyRequest];
+    if (cachedResponse != nil && cachedResponse.isFresh && ![_scriptsNeedingValidation containsObject:pacURL]) {
+        [_loadedScripts addObject:pacURL];
+        completion([self _scriptFromData:cachedResponse.data response:cachedResponse.response]);
+        return;
+    }
+
+    _pendingScripts[pacURL] = [NSMutableArray arrayWithObject:completion];
+
+    NSMutableURLRequest *request = [cacheKeyRequest mutableCopy];
+    request.cachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+    if (cachedResponse != nil) {
+        [ZLHTTPResponseCache addConditionalHeadersFromCachedResponse:cachedResponse toRequest:request];
+    }
+
+    [[_session dataTaskWithRequest:request completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+        NSString *script = nil;
+        NSHTTPURLResponse *httpResponse = [response isKindOfClass:[NSHTTPURLResponse class]] ? (NSHTTPURLResponse *)response : nil;
+        if (error == nil && httpResponse.statusCode == 304 && cachedResponse != nil) {
+            ZLHTTPCachedResponse *refreshedResponse = [self->_scriptCache cachedResponse:cachedResponse refreshedWithNotModifiedResponse:httpResponse forRequest:cacheKeyRequest];
+            script = [self _scriptFromData:refreshedResponse.data response:refreshedResponse.response];
+        } else if (error == nil && httpResponse.statusCode >= 200 && httpResponse.statusCode < 300) {
+            [self->_scriptCache storeResponse:httpResponse data:data forRequest:cacheKeyRequest];
+            script = [self _scriptFromData:data response:httpResponse];
+        } else if (cachedResponse != nil) {
+            // 验证失败时继续用旧脚本，比直接按直连处理更接近实际的网络配置
+            script = [self _scriptFromData:cachedResponse.data response:cachedResponse.response];
+        }
+
+        if (error == nil && httpResponse != nil) {
+            [self->_scriptsNeedingValidation removeObject:pacURL];
+        }
+        if (script != nil) {
+            [self->_loadedScripts addObject:pacURL];
+        }
+
+        NSArray *completions = self->_pendingScripts[pacURL];
+        [self->_pendingScripts removeObjectForKey:pacURL];
+        for (void (^completion)(NSString *) in completions) {
+            completion(script);
+        }
+    }] resume];
+}
+
+- (nullable NSString *)_scriptFromData:(NSData *)data response:(NSURLResponse *)response {
+    if (data.length == 0) {
+        return nil;
+    }
+    NSStringEncoding encoding = NSUTF8StringEncoding;
+    if (response.textEncodingName) {
+        CFStringEncoding cfEncoding = CFStringConvertIANACharSetNameToEncoding((__bridge CFStringRef)response.textEncodingName);
+        if (cfEncoding != kCFStringEncodingInvalidId) {
+            encoding = CFStringConvertEncodingToNSStringEncoding(cfEncoding);
+        }
+    }
+    return [[NSString alloc] initWithData:data encoding:encoding] ?: [[NSString alloc] initWithData:data encoding:NSISOLatin1StringEncoding];
+}
+
+@end
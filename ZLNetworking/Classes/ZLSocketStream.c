@@ -0,0 +1,346 @@
+//
+//  ZLSocketStream.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLSocketStream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if defined(MSG_NOSIGNAL)
+#define ZLSocketStreamSendFlags MSG_NOSIGNAL
+#else
+#define ZLSocketStreamSendFlags 0
+#endif
+
+struct ZLSocketStream {
+    ZLEventLoop *loop;
+    atomic_int refCount;
+
+    // 以下字段都由 lock 保护；回调在持有锁时调用，所以用递归锁，回调里可以直接读写和关闭
+    pthread_mutex_t lock;
+    ZLSocketStreamCallback callback;
+    void *info;
+    int fd;
+    ZLSocketStreamStatus status;
+    int error;
+    bool hasBytes;
+    bool hasSpace;
+    bool closed;
+
+    bool watching;              // 只在循环线程上访问；监听期间持有一个引用
+};
+
+ZLSocketStream *ZLSocketStreamCreate(ZLEventLoop *loop, ZLSocketStreamCallback callback, void *info) {
+    ZLSocketStream *stream = calloc(1, sizeof(ZLSocketStream));
+    if (!stream) {
+        return NULL;
+    }
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    int result = pthread_mutex_init(&stream->lock, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+    if (result != 0) {
+        free(stream);
+        return NULL;
+    }
+    stream->loop = loop;
+    atomic_init(&stream->refCount, 1);
+    stream->callback = callback;
+    stream->info = info;
+    stream->fd = -1;
+    stream->status = ZLSocketStreamStatusNotOpen;
+    return stream;
+}
+
+ZLSocketStream *ZLSocketStreamRetain(ZLSocketStream *stream) {
+    atomic_fetch_add(&stream->refCount, 1);
+    return stream;
+}
+
+void ZLSocketStreamRelease(ZLSocketStream *stream) {
+    if (!stream || atomic_fetch_sub(&stream->refCount, 1) != 1) {
+        return;
+    }
+    pthread_mutex_destroy(&stream->lock);
+    free(stream);
+}
+
+/* events */
+
+// 持有锁时调用
+static void ZLSocketStreamEmit(ZLSocketStream *stream, ZLSocketStreamEvent event) {
+    if (!stream->closed && stream->callback) {
+        stream->callback(stream, event, stream->info);
+    }
+}
+
+static void ZLSocketStreamEmitEnd(void *info) {
+    ZLSocketStream *stream = info;
+    pthread_mutex_lock(&stream->lock);
+    ZLSocketStreamEmit(stream, ZLSocketStreamEventEndEncountered);
+    pthread_mutex_unlock(&stream->lock);
+    ZLSocketStreamRelease(stream);
+}
+
+static void ZLSocketStreamEmitError(void *info) {
+    ZLSocketStream *stream = info;
+    pthread_mutex_lock(&stream->lock);
+    ZLSocketStreamEmit(stream, ZLSocketStreamEventErrorOccurred);
+    pthread_mutex_unlock(&stream->lock);
+    ZLSocketStreamRelease(stream);
+}
+
+// 持有锁时调用；读写在调用方线程上失败时事件投递到循环线程
+static void ZLSocketStreamFail(ZLSocketStream *stream, int error, bool onLoop) {
+    if (stream->status == ZLSocketStreamStatusError || stream->closed) {
+        return;
+    }
+    stream->status = ZLSocketStreamStatusError;
+    stream->error = error;
+    stream->hasBytes = false;
+    stream->hasSpace = false;
+    if (onLoop) {
+        ZLSocketStreamEmit(stream, ZLSocketStreamEventErrorOccurred);
+    } else if (!ZLEventLoopPost(stream->loop, ZLSocketStreamEmitError, ZLSocketStreamRetain(stream))) {
+        ZLSocketStreamRelease(stream);
+    }
+}
+
+static void ZLSocketStreamHandleEvents(ZLEventLoop *loop, int fd, int events, void *info) {
+    (void)loop;
+    ZLSocketStream *stream = ZLSocketStreamRetain(info);
+    pthread_mutex_lock(&stream->lock);
+
+    if (stream->status == ZLSocketStreamStatusOpening && (events & ZLEventLoopWritable)) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0) {
+            error = errno;
+        }
+        if (error != 0) {
+            ZLSocketStreamFail(stream, error, true);
+        } else {
+            // 连接完成的可写事件已经被这里取走，直接视为有空间
+            stream->status = ZLSocketStreamStatusOpen;
+            stream->hasSpace = true;
+            ZLSocketStreamEmit(stream, ZLSocketStreamEventOpenCompleted);
+            ZLSocketStreamEmit(stream, ZLSocketStreamEventHasSpaceAvailable);
+            events &= ~ZLEventLoopWritable;
+        }
+    }
+
+    if (stream->status == ZLSocketStreamStatusOpen) {
+        if ((events & ZLEventLoopReadable) && !stream->hasBytes) {
+            stream->hasBytes = true;
+            ZLSocketStreamEmit(stream, ZLSocketStreamEventHasBytesAvailable);
+        }
+        if ((events & ZLEventLoopWritable) && !stream->hasSpace && stream->status == ZLSocketStreamStatusOpen) {
+            stream->hasSpace = true;
+            ZLSocketStreamEmit(stream, ZLSocketStreamEventHasSpaceAvailable);
+        }
+    }
+
+    pthread_mutex_unlock(&stream->lock);
+    ZLSocketStreamRelease(stream);
+}
+
+/* connect */
+
+static void ZLSocketStreamStartWatching(void *info) {
+    ZLSocketStream *stream = info;
+    pthread_mutex_lock(&stream->lock);
+    if (!stream->closed) {
+        if (ZLEventLoopWatch(stream->loop, stream->fd, ZLSocketStreamHandleEvents, stream)) {
+            stream->watching = true;
+            ZLSocketStreamRetain(stream);
+        } else {
+            ZLSocketStreamFail(stream, errno ? errno : ENOMEM, true);
+        }
+    }
+    pthread_mutex_unlock(&stream->lock);
+    ZLSocketStreamRelease(stream);
+}
+
+bool ZLSocketStreamConnect(ZLSocketStream *stream, const struct sockaddr *address, socklen_t length) {
+    pthread_mutex_lock(&stream->lock);
+    if (stream->status != ZLSocketStreamStatusNotOpen || stream->closed) {
+        pthread_mutex_unlock(&stream->lock);
+        return false;
+    }
+
+    int fd = socket(address->sa_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        ZLSocketStreamFail(stream, errno, false);
+        pthread_mutex_unlock(&stream->lock);
+        return false;
+    }
+    int one = 1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#if defined(SO_NOSIGPIPE)
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    // WebSocket 帧小而频繁，不等 Nagle 攒包
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    int result;
+    do {
+        result = connect(fd, address, length);
+    } while (result != 0 && errno == EINTR);
+    if (result != 0 && errno != EINPROGRESS) {
+        // 本机地址可能立即被拒绝
+        int error = errno;
+        close(fd);
+        ZLSocketStreamFail(stream, error, false);
+        pthread_mutex_unlock(&stream->lock);
+        return false;
+    }
+
+    // 立即连上的（本机地址）也等可写事件再回调 OpenCompleted，回调始终在循环线程上
+    stream->fd = fd;
+    stream->status = ZLSocketStreamStatusOpening;
+    bool posted = ZLEventLoopPost(stream->loop, ZLSocketStreamStartWatching, ZLSocketStreamRetain(stream));
+    if (!posted) {
+        ZLSocketStreamRelease(stream);
+        stream->fd = -1;
+        stream->status = ZLSocketStreamStatusError;
+        stream->error = ENOMEM;
+        close(fd);
+    }
+    pthread_mutex_unlock(&stream->lock);
+    return posted;
+}
+
+/* read & write */
+
+long ZLSocketStreamRead(ZLSocketStream *stream, uint8_t *buffer, size_t length) {
+    pthread_mutex_lock(&stream->lock);
+    long result = 0;
+    if (stream->status == ZLSocketStreamStatusOpen) {
+        ssize_t received;
+        do {
+            received = recv(stream->fd, buffer, length, 0);
+        } while (received < 0 && errno == EINTR);
+
+        if (received > 0) {
+            result = received;
+        } else if (received == 0 && length > 0) {
+            stream->status = ZLSocketStreamStatusAtEnd;
+            stream->hasBytes = false;
+            if (!ZLEventLoopPost(stream->loop, ZLSocketStreamEmitEnd, ZLSocketStreamRetain(stream))) {
+                ZLSocketStreamRelease(stream);
+            }
+        } else if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            stream->hasBytes = false;
+        } else if (received < 0) {
+            ZLSocketStreamFail(stream, errno, false);
+            result = -1;
+        }
+    } else if (stream->status != ZLSocketStreamStatusOpening && stream->status != ZLSocketStreamStatusAtEnd) {
+        result = -1;
+    }
+    pthread_mutex_unlock(&stream->lock);
+    return result;
+}
+
+long ZLSocketStreamWrite(ZLSocketStream *stream, const uint8_t *buffer, size_t length) {
+    pthread_mutex_lock(&stream->lock);
+    long result = 0;
+    // 对端只关闭了写方向时仍然可以发送
+    if (stream->status == ZLSocketStreamStatusOpen || stream->status == ZLSocketStreamStatusAtEnd) {
+        ssize_t sent;
+        do {
+            sent = send(stream->fd, buffer, length, ZLSocketStreamSendFlags);
+        } while (sent < 0 && errno == EINTR);
+
+        if (sent >= 0) {
+            result = sent;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            stream->hasSpace = false;
+        } else {
+            ZLSocketStreamFail(stream, errno, false);
+            result = -1;
+        }
+    } else if (stream->status != ZLSocketStreamStatusOpening) {
+        result = -1;
+    }
+    pthread_mutex_unlock(&stream->lock);
+    return result;
+}
+
+bool ZLSocketStreamHasBytesAvailable(ZLSocketStream *stream) {
+    pthread_mutex_lock(&stream->lock);
+    bool hasBytes = stream->hasBytes && stream->status == ZLSocketStreamStatusOpen;
+    pthread_mutex_unlock(&stream->lock);
+    return hasBytes;
+}
+
+bool ZLSocketStreamHasSpaceAvailable(ZLSocketStream *stream) {
+    pthread_mutex_lock(&stream->lock);
+    bool hasSpace = stream->hasSpace && (stream->status == ZLSocketStreamStatusOpen || stream->status == ZLSocketStreamStatusAtEnd);
+    pthread_mutex_unlock(&stream->lock);
+    return hasSpace;
+}
+
+ZLSocketStreamStatus ZLSocketStreamGetStatus(ZLSocketStream *stream) {
+    pthread_mutex_lock(&stream->lock);
+    ZLSocketStreamStatus status = stream->status;
+    pthread_mutex_unlock(&stream->lock);
+    return status;
+}
+
+int ZLSocketStreamGetError(ZLSocketStream *stream) {
+    pthread_mutex_lock(&stream->lock);
+    int error = stream->status == ZLSocketStreamStatusError ? stream->error : 0;
+    pthread_mutex_unlock(&stream->lock);
+    return error;
+}
+
+/* close */
+
+static void ZLSocketStreamCloseOnLoop(void *info) {
+    ZLSocketStream *stream = info;
+    pthread_mutex_lock(&stream->lock);
+    int fd = stream->fd;
+    stream->fd = -1;
+    bool watching = stream->watching;
+    stream->watching = false;
+    pthread_mutex_unlock(&stream->lock);
+
+    if (watching) {
+        ZLEventLoopUnwatch(stream->loop, fd);
+        ZLSocketStreamRelease(stream);
+    }
+    close(fd);
+    ZLSocketStreamRelease(stream);
+}
+
+void ZLSocketStreamClose(ZLSocketStream *stream) {
+    pthread_mutex_lock(&stream->lock);
+    if (stream->closed) {
+        pthread_mutex_unlock(&stream->lock);
+        return;
+    }
+    stream->closed = true;
+    stream->callback = NULL;
+    stream->info = NULL;
+    stream->status = ZLSocketStreamStatusClosed;
+    stream->hasBytes = false;
+    stream->hasSpace = false;
+    // 监听只能在循环线程上移除，fd 也要等移除后才能关闭，否则复用的 fd 会收到旧的事件
+    if (stream->fd >= 0 && !ZLEventLoopPost(stream->loop, ZLSocketStreamCloseOnLoop, ZLSocketStreamRetain(stream))) {
+        ZLSocketStreamRelease(stream);
+    }
+    pthread_mutex_unlock(&stream->lock);
+}
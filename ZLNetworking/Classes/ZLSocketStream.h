@@ -0,0 +1,81 @@
+//
+//  ZLSocketStream.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#ifndef ZLSocketStream_h
+#define ZLSocketStream_h
+
+#include "ZLEventLoop.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// ZLEventLoop 上的非阻塞 TCP 连接，用来替代 CFStream。读写可以在任意线程调用，事件只在循环线程上回调。
+///
+/// 事件和状态的取值与 NSStreamEvent、NSStreamStatus 相同；HasBytesAvailable 和 HasSpaceAvailable 只在
+/// 从无到有时回调一次，之后一直读（写）到返回 0 为止，下一次才会再回调
+typedef struct ZLSocketStream ZLSocketStream;
+
+typedef enum ZLSocketStreamEvent {
+    ZLSocketStreamEventOpenCompleted = 1 << 0,
+    ZLSocketStreamEventHasBytesAvailable = 1 << 1,
+    ZLSocketStreamEventHasSpaceAvailable = 1 << 2,
+    ZLSocketStreamEventErrorOccurred = 1 << 3,
+    ZLSocketStreamEventEndEncountered = 1 << 4,
+} ZLSocketStreamEvent;
+
+typedef enum ZLSocketStreamStatus {
+    ZLSocketStreamStatusNotOpen = 0,
+    ZLSocketStreamStatusOpening = 1,
+    ZLSocketStreamStatusOpen = 2,
+    ZLSocketStreamStatusAtEnd = 5,
+    ZLSocketStreamStatusClosed = 6,
+    ZLSocketStreamStatusError = 7,
+} ZLSocketStreamStatus;
+
+/// 在循环线程上回调，回调期间持有连接的锁：其他线程的读写和关闭会等回调返回
+typedef void (*ZLSocketStreamCallback)(ZLSocketStream *stream, ZLSocketStreamEvent event, void *info);
+
+/// 引用计数为 1；失败返回 NULL
+ZLSocketStream *ZLSocketStreamCreate(ZLEventLoop *loop, ZLSocketStreamCallback callback, void *info);
+
+ZLSocketStream *ZLSocketStreamRetain(ZLSocketStream *stream);
+
+/// 释放最后一个引用前需要先 ZLSocketStreamClose
+void ZLSocketStreamRelease(ZLSocketStream *stream);
+
+/// 开始连接 address，结果通过 OpenCompleted 或 ErrorOccurred 回调，立即失败的也回调 ErrorOccurred 并返回 false；只能调用一次
+bool ZLSocketStreamConnect(ZLSocketStream *stream, const struct sockaddr *address, socklen_t length);
+
+/// 返回读到的字节数；暂时没有数据或已读到末尾返回 0，出错返回 -1。读到末尾后在循环线程上回调 EndEncountered
+long ZLSocketStreamRead(ZLSocketStream *stream, uint8_t *buffer, size_t length);
+
+/// 返回写入的字节数；发送缓冲区满或还未连上返回 0，出错返回 -1
+long ZLSocketStreamWrite(ZLSocketStream *stream, const uint8_t *buffer, size_t length);
+
+bool ZLSocketStreamHasBytesAvailable(ZLSocketStream *stream);
+
+bool ZLSocketStreamHasSpaceAvailable(ZLSocketStream *stream);
+
+ZLSocketStreamStatus ZLSocketStreamGetStatus(ZLSocketStream *stream);
+
+/// 出错时的 errno，没有出错返回 0
+int ZLSocketStreamGetError(ZLSocketStream *stream);
+
+/// 返回后不再回调；fd 在循环线程上移除监听后关闭。可以重复调用
+void ZLSocketStreamClose(ZLSocketStream *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLSocketStream_h */
@@ -0,0 +1,243 @@
+//
+//  ZLTimerWheel.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/28.
+//
+
+#include "ZLTimerWheel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ZLTimerWheelLevels 4
+#define ZLTimerWheelSlotBits 6
+#define ZLTimerWheelSlots (1u << ZLTimerWheelSlotBits)
+#define ZLTimerWheelNil UINT32_MAX
+#define ZLTimerWheelFreeSlot UINT16_MAX
+
+typedef struct ZLTimerWheelNode {
+    uint64_t deadline;
+    void *context;
+    uint32_t prev;
+    uint32_t next;
+    uint32_t generation;        // 节点复用时加一，旧的标识随之失效
+    uint16_t slot;              // 层 * 64 + 槽位，空闲节点为 ZLTimerWheelFreeSlot
+} ZLTimerWheelNode;
+
+struct ZLTimerWheel {
+    uint64_t current;           // 已处理到的 tick
+
+    ZLTimerWheelNode *nodes;
+    uint32_t nodeCapacity;
+    uint32_t nodeCount;         // nodes 中用过的数量，包括空闲链表中的
+    uint32_t freeList;          // 以 next 串起来的空闲节点
+
+    uint32_t heads[ZLTimerWheelLevels * ZLTimerWheelSlots];
+    uint64_t occupied[ZLTimerWheelLevels]; // 每层非空槽位的位图
+    size_t count;
+};
+
+static inline uint64_t ZLTimerWheelRotateRight(uint64_t value, unsigned shift) {
+    shift &= 63;
+    return shift ? (value >> shift) | (value << (64 - shift)) : value;
+}
+
+static void ZLTimerWheelUnlink(ZLTimerWheel *wheel, uint32_t index) {
+    ZLTimerWheelNode *node = &wheel->nodes[index];
+    if (node->prev != ZLTimerWheelNil) {
+        wheel->nodes[node->prev].next = node->next;
+    } else {
+        wheel->heads[node->slot] = node->next;
+        if (node->next == ZLTimerWheelNil) {
+            wheel->occupied[node->slot / ZLTimerWheelSlots] &= ~(1ULL << (node->slot % ZLTimerWheelSlots));
+        }
+    }
+    if (node->next != ZLTimerWheelNil) {
+        wheel->nodes[node->next].prev = node->prev;
+    }
+}
+
+/// 按到期时间距 current 的远近放到对应层，到期时间不早于 minimum
+static void ZLTimerWheelInsert(ZLTimerWheel *wheel, uint32_t index, uint64_t minimum) {
+    ZLTimerWheelNode *node = &wheel->nodes[index];
+    uint64_t deadline = node->deadline < minimum ? minimum : node->deadline;
+    uint64_t delta = deadline - wheel->current;
+
+    unsigned level = 0;
+    while (level < ZLTimerWheelLevels - 1 && delta >= (1ULL << (ZLTimerWheelSlotBits * (level + 1)))) {
+        level++;
+    }
+    // 超出时间轮范围的先放在最上层最远的槽位，下移时重新计算
+    uint64_t range = 1ULL << (ZLTimerWheelSlotBits * ZLTimerWheelLevels);
+    if (delta >= range) {
+        deadline = wheel->current + range - 1;
+    }
+
+    uint16_t slot = (uint16_t)(level * ZLTimerWheelSlots + ((deadline >> (ZLTimerWheelSlotBits * level)) & (ZLTimerWheelSlots - 1)));
+    node->slot = slot;
+    node->prev = ZLTimerWheelNil;
+    node->next = wheel->heads[slot];
+    if (node->next != ZLTimerWheelNil) {
+        wheel->nodes[node->next].prev = index;
+    }
+    wheel->heads[slot] = index;
+    wheel->occupied[level] |= 1ULL << (slot % ZLTimerWheelSlots);
+}
+
+static void ZLTimerWheelFreeNode(ZLTimerWheel *wheel, uint32_t index) {
+    ZLTimerWheelNode *node = &wheel->nodes[index];
+    node->slot = ZLTimerWheelFreeSlot;
+    node->context = NULL;
+    node->generation = node->generation == UINT32_MAX ? 1 : node->generation + 1;
+    node->next = wheel->freeList;
+    wheel->freeList = index;
+    wheel->count--;
+}
+
+/// 把上层一个槽位的定时器按剩余时间重新放到下层
+static void ZLTimerWheelCascade(ZLTimerWheel *wheel, unsigned level) {
+    unsigned position = (unsigned)((wheel->current >> (ZLTimerWheelSlotBits * level)) & (ZLTimerWheelSlots - 1));
+    uint16_t slot = (uint16_t)(level * ZLTimerWheelSlots + position);
+    uint32_t index = wheel->heads[slot];
+    wheel->heads[slot] = ZLTimerWheelNil;
+    wheel->occupied[level] &= ~(1ULL << position);
+    while (index != ZLTimerWheelNil) {
+        uint32_t next = wheel->nodes[index].next;
+        ZLTimerWheelInsert(wheel, index, wheel->current);
+        index = next;
+    }
+}
+
+ZLTimerWheel *ZLTimerWheelCreate(uint64_t now) {
+    ZLTimerWheel *wheel = calloc(1, sizeof(ZLTimerWheel));
+    if (wheel == NULL) {
+        return NULL;
+    }
+    wheel->current = now;
+    wheel->freeList = ZLTimerWheelNil;
+    for (size_t i = 0; i < ZLTimerWheelLevels * ZLTimerWheelSlots; i++) {
+        wheel->heads[i] = ZLTimerWheelNil;
+    }
+    return wheel;
+}
+
+void ZLTimerWheelDestroy(ZLTimerWheel *wheel) {
+    if (wheel == NULL) {
+        return;
+    }
+    free(wheel->nodes);
+    free(wheel);
+}
+
+uint64_t ZLTimerWheelSchedule(ZLTimerWheel *wheel, uint64_t deadline, void *context) {
+    uint32_t index;
+    if (wheel->freeList != ZLTimerWheelNil) {
+        index = wheel->freeList;
+        wheel->freeList = wheel->nodes[index].next;
+    } else {
+        if (wheel->nodeCount == wheel->nodeCapacity) {
+            if (wheel->nodeCapacity >= ZLTimerWheelNil / 2) {
+                return 0;
+            }
+            uint32_t capacity = wheel->nodeCapacity ? wheel->nodeCapacity * 2 : 64;
+            ZLTimerWheelNode *nodes = realloc(wheel->nodes, capacity * sizeof(ZLTimerWheelNode));
+            if (nodes == NULL) {
+                return 0;
+            }
+            wheel->nodes = nodes;
+            wheel->nodeCapacity = capacity;
+        }
+        index = wheel->nodeCount++;
+        wheel->nodes[index].generation = 1;
+    }
+
+    ZLTimerWheelNode *node = &wheel->nodes[index];
+    node->deadline = deadline;
+    node->context = context;
+    wheel->count++;
+    // 当前 tick 的槽位已经处理过
+    ZLTimerWheelInsert(wheel, index, wheel->current + 1);
+    return ((uint64_t)node->generation << 32) | (index + 1);
+}
+
+bool ZLTimerWheelCancel(ZLTimerWheel *wheel, uint64_t timerID, void **context) {
+    uint32_t index = (uint32_t)(timerID & UINT32_MAX) - 1;
+    if (timerID == 0 || index >= wheel->nodeCount) {
+        return false;
+    }
+    ZLTimerWheelNode *node = &wheel->nodes[index];
+    if (node->slot == ZLTimerWheelFreeSlot || node->generation != (uint32_t)(timerID >> 32)) {
+        return false;
+    }
+    if (context) {
+        *context = node->context;
+    }
+    ZLTimerWheelUnlink(wheel, index);
+    ZLTimerWheelFreeNode(wheel, index);
+    return true;
+}
+
+size_t ZLTimerWheelCount(const ZLTimerWheel *wheel) {
+    return wheel->count;
+}
+
+size_t ZLTimerWheelAdvance(ZLTimerWheel *wheel, uint64_t now, ZLTimerWheelCallback callback, void *info) {
+    size_t fired = 0;
+    while (wheel->current < now) {
+        if (wheel->count == 0) {
+            wheel->current = now;
+            break;
+        }
+        if (wheel->occupied[0] == 0) {
+            // 最底层为空，直接跳到下一次下移
+            uint64_t boundary = (wheel->current | (ZLTimerWheelSlots - 1)) + 1;
+            wheel->current = (boundary < now ? boundary : now) - 1;
+        }
+        uint64_t tick = ++wheel->current;
+
+        // 跨过上层的槽位边界时，从高到低把该槽位的定时器下移
+        unsigned levels = 0;
+        while (levels < ZLTimerWheelLevels - 1 && (tick & ((1ULL << (ZLTimerWheelSlotBits * (levels + 1))) - 1)) == 0) {
+            levels++;
+        }
+        for (unsigned level = levels; level > 0; level--) {
+            ZLTimerWheelCascade(wheel, level);
+        }
+
+        // 回调里新添加的定时器最早在下一个 tick，这里一定能取完
+        uint16_t slot = (uint16_t)(tick & (ZLTimerWheelSlots - 1));
+        while (wheel->heads[slot] != ZLTimerWheelNil) {
+            uint32_t index = wheel->heads[slot];
+            void *context = wheel->nodes[index].context;
+            ZLTimerWheelUnlink(wheel, index);
+            ZLTimerWheelFreeNode(wheel, index);
+            fired++;
+            callback(context, info);
+        }
+    }
+    return fired;
+}
+
+uint64_t ZLTimerWheelNextTick(const ZLTimerWheel *wheel) {
+    if (wheel->count == 0) {
+        return UINT64_MAX;
+    }
+    uint64_t next = UINT64_MAX;
+    for (unsigned level = 0; level < ZLTimerWheelLevels; level++) {
+        uint64_t bits = wheel->occupied[level];
+        if (bits == 0) {
+            continue;
+        }
+        unsigned shift = ZLTimerWheelSlotBits * level;
+        uint64_t position = wheel->current >> shift;
+        // 从当前槽位的下一个开始找第一个非空槽位，最多转一整圈回到当前槽位
+        uint64_t rotated = ZLTimerWheelRotateRight(bits, (unsigned)((position + 1) & (ZLTimerWheelSlots - 1)));
+        uint64_t distance = (uint64_t)__builtin_ctzll(rotated) + 1;
+        uint64_t tick = (position + distance) << shift;
+        if (tick < next) {
+            next = tick;
+        }
+    }
+    return next;
+}
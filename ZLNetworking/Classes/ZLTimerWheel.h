@@ -0,0 +1,52 @@
+//
+//  ZLTimerWheel.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/28.
+//
+
+#ifndef ZLTimerWheel_h
+#define ZLTimerWheel_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 分层时间轮：4 层、每层 64 个槽，时间以 tick 为单位，添加和取消都是 O(1)。
+/// 到期时间落在同一个 tick 的定时器一起触发；不加锁，由调用方串行访问
+typedef struct ZLTimerWheel ZLTimerWheel;
+
+/// 到期回调，context 为添加时传入的值；回调中可以添加和取消定时器，新添加的最早在下一个 tick 触发
+typedef void (*ZLTimerWheelCallback)(void *context, void *info);
+
+/// now 为当前 tick
+ZLTimerWheel *ZLTimerWheelCreate(uint64_t now);
+
+/// 未触发的定时器直接丢弃，context 由调用方自行释放
+void ZLTimerWheelDestroy(ZLTimerWheel *wheel);
+
+/// 添加在 deadline（tick）到期的定时器，返回用于取消的标识，失败返回 0；已过期的在下一个 tick 触发
+uint64_t ZLTimerWheelSchedule(ZLTimerWheel *wheel, uint64_t deadline, void *context);
+
+/// 取消未触发的定时器并通过 context 返回添加时的值；已触发或已取消的返回 false
+bool ZLTimerWheelCancel(ZLTimerWheel *wheel, uint64_t timerID, void **context);
+
+/// 未触发的定时器数量
+size_t ZLTimerWheelCount(const ZLTimerWheel *wheel);
+
+/// 推进到 now 并依次触发到期的定时器，返回触发的数量
+size_t ZLTimerWheelAdvance(ZLTimerWheel *wheel, uint64_t now, ZLTimerWheelCallback callback, void *info);
+
+/// 下一次需要调用 ZLTimerWheelAdvance 的 tick，可能早于实际的到期时间（需要把上层的定时器下移时）；
+/// 没有定时器时返回 UINT64_MAX
+uint64_t ZLTimerWheelNextTick(const ZLTimerWheel *wheel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLTimerWheel_h */
@@ -13,13 +13,34 @@ typedef NS_ENUM(NSInteger, ZLRequestBodyType) {
     ZLRequestBodyTypeDefault = 0,
     ZLRequestBodyTypeURLEncoding,
     ZLRequestBodyTypeJson,
-    ZLRequestBodyTypeXml
+    ZLRequestBodyTypeXml,
+    ZLRequestBodyTypeMessagePack,
+    ZLRequestBodyTypeCBOR
 };
 
 typedef NS_ENUM(NSInteger, ZLResponseBodyType) {
     ZLResponseBodyTypeDefault = 0,
     ZLResponseBodyTypeJson,
-    ZLResponseBodyTypeXml
+    ZLResponseBodyTypeXml,
+    ZLResponseBodyTypeMessagePack,
+    ZLResponseBodyTypeCBOR
+};
+
+typedef NS_ENUM(NSInteger, ZLRequestCachePolicy) {
+    /// 不读也不写响应缓存
+    ZLRequestCachePolicyNone = 0,
+    /// 按 Cache-Control / Expires 判断新鲜度，新鲜时直接返回缓存不发请求；过期后带 If-None-Match / If-Modified-Since 请求，304 时返回缓存
+    ZLRequestCachePolicyProtocol,
+    /// 有缓存时立即返回（即使已过期），过期的缓存在后台重新验证并更新，不再回调；
+    /// 响应带 no-cache / must-revalidate 时退化为 ZLRequestCachePolicyProtocol
+    ZLRequestCachePolicyStaleWhileRevalidate
+};
+
+/// 下载的优先级，排队时高优先级的先开始
+typedef NS_ENUM(NSInteger, ZLRequestPriority) {
+    ZLRequestPriorityBackground = 0,
+    ZLRequestPriorityPrefetch,
+    ZLRequestPriorityVisible
 };
 
 extern NSString *ZLSha256HashFor(NSString *input);
@@ -90,11 +111,31 @@ extern NSString *ZLSha256HashFor(NSString *input);
 /// 通用请求头，如鉴权
 @property (nonatomic, copy) NSDictionary *commonHeader;
 
+/// 为 YES 时 Json/Xml 响应边接收边解析，最后一个字节到达后很快就能拿到结果，默认 NO
+@property (nonatomic, assign) BOOL parsesResponseIncrementally;
+
+/// 为 YES 时 method + URL + 请求头 + responseBodyType 都相同的 GET/HEAD 请求在进行中时合并为一个请求，响应只解析一次，
+/// 同一个 responseObject 交给所有调用方，不要修改它。每个调用方拿到各自的 task，cancel 只取消自己，全部取消后才取消请求。
+/// 带 elementBlock 或 cachePolicy 的请求不参与合并，默认 NO
+@property (nonatomic, assign) BOOL coalescesIdenticalRequests;
+
+/// 同一 host 同时进行的下载数上限，默认 4；总数上限为 CPU 核数
+@property (nonatomic, assign) NSUInteger maxConcurrentDownloadsPerHost;
+
+/// 每个下载从排队到开始时调用，queueWaitTime 为排队的秒数，可用于统计图片从请求到显示的耗时
+@property (nonatomic, copy) void (^downloadQueueWaitTimeBlock)(NSURL *url, ZLRequestPriority priority, NSTimeInterval queueWaitTime);
+
 @property (nonatomic, strong) ZHLReachability *reachablity;
 
 /// 缓存目录
 @property (nonatomic, copy, readonly) NSString *workspaceDirURLString;
 
+/// 响应缓存的内存上限，默认 4M
+@property (nonatomic, assign) NSUInteger responseCacheMemoryCapacity;
+
+/// 响应缓存的磁盘上限，默认 50M
+@property (nonatomic, assign) NSUInteger responseCacheDiskCapacity;
+
 + (instancetype)shared;
 
 - (instancetype)init NS_UNAVAILABLE;
@@ -108,6 +149,26 @@ extern NSString *ZLSha256HashFor(NSString *input);
                       success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
                       failure:(void (^)(NSError *error))failure;
 
+/// 总是边接收边解析 Json/Xml 响应。顶层为 JSON 数组时，每个元素一解析完就按顺序在接收数据的队列上回调 elementBlock，
+/// 调用方可以在请求结束前开始展示；success 中仍然是完整的数组
+- (NSURLSessionDataTask *)GET:(NSString *)URLString
+                   parameters:(id)parameters
+                      headers:(NSDictionary <NSString *, NSString *> *)headers
+             responseBodyType:(ZLResponseBodyType)responseBodyType
+                      element:(void (^)(id element))elementBlock
+                      success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
+                      failure:(void (^)(NSError *error))failure;
+
+/// 按 cachePolicy 使用响应缓存，缓存以 method + URL 为键并遵循 Vary；命中新鲜缓存时不发请求。
+/// 缓存在后台查找，不阻塞调用线程，返回的 task 可以随时取消；没有缓存却收到 304 时会去掉条件头重试一次
+- (NSURLSessionDataTask *)GET:(NSString *)URLString
+                   parameters:(id)parameters
+                      headers:(NSDictionary <NSString *, NSString *> *)headers
+             responseBodyType:(ZLResponseBodyType)responseBodyType
+                  cachePolicy:(ZLRequestCachePolicy)cachePolicy
+                      success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
+                      failure:(void (^)(NSError *error))failure;
+
 - (NSURLSessionDataTask *)HEAD:(NSString *)URLString
                      parameters:(id)parameters
                         headers:(NSDictionary <NSString *, NSString *> *)headers
@@ -174,16 +235,72 @@ responseBodyType:(ZLResponseBodyType)responseBodyType
      success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
      failure:(void (^)(NSError *error))failure;
 
+/// 请求体以流的方式上传，文件部分边读边发，不会整体读入内存；uploadProgressBlock 在读取请求体的线程回调
+- (void)POST:(NSString *)URLString
+  parameters:(id)parameters
+constructingBodyWithBlock:(void (^)(ZLMultipartFormData *formData))block
+     headers:(NSDictionary <NSString *, NSString *> *)headers
+responseBodyType:(ZLResponseBodyType)responseBodyType
+    progress:(void (^)(float uploadProgress))uploadProgressBlock
+     success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
+     failure:(void (^)(NSError *error))failure;
+
+- (void)downloadWithRequest:(NSURLRequest *)request
+                    headers:(NSDictionary <NSString *, NSString *> *)headers
+                destination:(NSURL *)destinationURL
+                   progress:(void (^)(float downloadProgress))downloadProgressBlock
+          completionHandler:(void (^)(NSURLResponse *response, NSURL *filePath, NSError *error))completionHandler;
+
+/// receivedDataBlock 在下载代理队列上调用，receivedData 为目前收到的全部数据，只在回调期间有效，需要保留请 copy；
+/// 下载成功时会以 finished = YES 再回调一次，此时的 receivedData 不会再被修改，可直接持有用于后续处理而无需重新读文件。
+/// 同一 URL 已在下载时只会追加 completionHandler，不会回调 receivedDataBlock
 - (void)downloadWithRequest:(NSURLRequest *)request
                     headers:(NSDictionary <NSString *, NSString *> *)headers
                 destination:(NSURL *)destinationURL
                    progress:(void (^)(float downloadProgress))downloadProgressBlock
+               receivedData:(void (^)(NSData *receivedData, BOOL finished))receivedDataBlock
+          completionHandler:(void (^)(NSURLResponse *response, NSURL *filePath, NSError *error))completionHandler;
+
+/// 按优先级排队的下载，同优先级中后提交的先开始（LIFO），适合列表中的图片；
+/// 同一 URL 已在排队时会按两者中较高的优先级处理。不带 priority 的下载方法为 ZLRequestPriorityVisible 且先进先出
+- (void)downloadWithRequest:(NSURLRequest *)request
+                    headers:(NSDictionary <NSString *, NSString *> *)headers
+                destination:(NSURL *)destinationURL
+                   priority:(ZLRequestPriority)priority
+                   progress:(void (^)(float downloadProgress))downloadProgressBlock
+               receivedData:(void (^)(NSData *receivedData, BOOL finished))receivedDataBlock
+          completionHandler:(void (^)(NSURLResponse *response, NSURL *filePath, NSError *error))completionHandler;
+
+/// 分段并行下载，服务器支持 Range 时用 segmentCount 个连接同时下载不同区间，中断后按段续传；
+/// 服务器不支持 Range 时自动退回单连接下载。segmentCount <= 1 时等同于普通下载
+- (void)downloadWithRequest:(NSURLRequest *)request
+                    headers:(NSDictionary <NSString *, NSString *> *)headers
+                destination:(NSURL *)destinationURL
+               segmentCount:(NSUInteger)segmentCount
+                   progress:(void (^)(float downloadProgress))downloadProgressBlock
+          completionHandler:(void (^)(NSURLResponse *response, NSURL *filePath, NSError *error))completionHandler;
+
+/// 按优先级排队的分段下载，排队规则与带 priority 的普通下载相同
+- (void)downloadWithRequest:(NSURLRequest *)request
+                    headers:(NSDictionary <NSString *, NSString *> *)headers
+                destination:(NSURL *)destinationURL
+               segmentCount:(NSUInteger)segmentCount
+                   priority:(ZLRequestPriority)priority
+                   progress:(void (^)(float downloadProgress))downloadProgressBlock
           completionHandler:(void (^)(NSURLResponse *response, NSURL *filePath, NSError *error))completionHandler;
 
 - (void)clearDiskCache;
 
+- (void)clearResponseCache;
+
 - (void)cancelDownloadForURL:(NSURL *)url;
 
+/// 调整还在排队的下载的优先级，已经开始的不受影响
+- (void)setPriority:(ZLRequestPriority)priority forDownloadURL:(NSURL *)url;
+
+/// 不再需要某个 URL 时调用：还在排队且没有其它等待者时取消，否则降为 ZLRequestPriorityBackground
+- (void)deprioritizeDownloadForURL:(NSURL *)url;
+
 + (void)deleteDirPath:(NSString *)dirPath;
 
 @end
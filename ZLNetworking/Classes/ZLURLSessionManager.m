@@ -8,7 +8,13 @@
 
 #import "ZLURLSessionManager.h"
 #import "ZLXMLDictionary.h"
+#import "ZLJSONStreamScanner.h"
+#import "ZLBinarySerialization.h"
+#import "ZLHTTPResponseCache.h"
+#import <objc/runtime.h>
 #import <sys/sysctl.h>
+#import <fcntl.h>
+#import <unistd.h>
 #import <CoreServices/CoreServices.h>
 #import <CommonCrypto/CommonDigest.h>
 
@@ -112,11 +118,382 @@ static id ZLParseResponseBody(ZLResponseBodyType type, NSData *data) {
         }
         
         return nil;
+    } else if (type == ZLResponseBodyTypeMessagePack || type == ZLResponseBodyTypeCBOR) {
+        NSError *error = nil;
+        id result = type == ZLResponseBodyTypeMessagePack ? [ZLMessagePackSerialization objectWithData:data error:&error] : [ZLCBORSerialization objectWithData:data error:&error];
+        if (error) {
+            NSLog(@"%@", error);
+            return nil;
+        }
+        return result;
     }
     
     return data;
 }
 
+/// 逐层换成不可变的容器、字符串和数据
+static id ZLImmutableDeepCopy(id object) {
+    if ([object isKindOfClass:[NSDictionary class]]) {
+        NSDictionary *dictionary = object;
+        NSMutableDictionary *copy = [NSMutableDictionary dictionaryWithCapacity:dictionary.count];
+        [dictionary enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            copy[key] = ZLImmutableDeepCopy(value);
+        }];
+        return [copy copy];
+    }
+    if ([object isKindOfClass:[NSArray class]]) {
+        NSArray *array = object;
+        NSMutableArray *copy = [NSMutableArray arrayWithCapacity:array.count];
+        for (id element in array) {
+            [copy addObject:ZLImmutableDeepCopy(element)];
+        }
+        return [copy copy];
+    }
+    if ([object isKindOfClass:[NSString class]] || [object isKindOfClass:[NSData class]]) {
+        return [object copy];
+    }
+    return object;
+}
+
+/// 合并请求的结果会交给多个调用方，并在 responseQueue 上并发使用，所以不能含可变对象：
+/// JSON 不用可变选项直接解析，XML、MessagePack、CBOR 的解析结果是可变容器，解析后做一次不可变深拷贝
+static id ZLParseSharedResponseBody(ZLResponseBodyType type, NSData *data) {
+    if (type == ZLResponseBodyTypeJson && data != nil) {
+        NSError *error = nil;
+        id result = [NSJSONSerialization JSONObjectWithData:data options:0 error:&error];
+        if (error) {
+            NSLog(@"%@", error);
+            return nil;
+        }
+        return result;
+    }
+    return ZLImmutableDeepCopy(ZLParseResponseBody(type, data));
+}
+
+/// 边接收边解析 JSON：顶层数组/对象的成员一完整就交给 NSJSONSerialization，只缓存当前还不完整的成员
+@interface ZLIncrementalJSONParser : NSObject
+
+- (instancetype)initWithElementBlock:(void (^)(id element))elementBlock;
+
+/// 数据格式错误时返回 NO
+- (BOOL)appendData:(NSData *)data;
+
+- (id)finish;
+
+@end
+
+@implementation ZLIncrementalJSONParser {
+    ZLJSONStreamScanner _scanner;
+    /// 当前成员的数据；整体解析时为全部数据
+    NSMutableData *_pendingData;
+    NSMutableArray *_array;
+    NSMutableDictionary *_dictionary;
+    void (^_elementBlock)(id element);
+    BOOL _checkedEncoding;
+    BOOL _parsesWhole;
+    BOOL _sawElement;
+    BOOL _failed;
+}
+
+- (instancetype)initWithElementBlock:(void (^)(id element))elementBlock {
+    if (self = [super init]) {
+        ZLJSONStreamScannerReset(&_scanner);
+        _pendingData = [NSMutableData data];
+        _elementBlock = [elementBlock copy];
+    }
+    return self;
+}
+
+- (BOOL)appendData:(NSData *)data {
+    if (_failed) {
+        return NO;
+    }
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        if (![self scanBytes:bytes length:byteRange.length]) {
+            *stop = YES;
+        }
+    }];
+    return !_failed;
+}
+
+- (BOOL)scanBytes:(const uint8_t *)bytes length:(size_t)length {
+    if (_parsesWhole) {
+        [_pendingData appendBytes:bytes length:length];
+        return YES;
+    }
+    
+    if (!_checkedEncoding) {
+        // 带 BOM 或 UTF-16/32 编码的数据交给 NSJSONSerialization 整体解析
+        [_pendingData appendBytes:bytes length:length];
+        if (_pendingData.length < 4) {
+            return YES;
+        }
+        _checkedEncoding = YES;
+        const uint8_t *head = _pendingData.bytes;
+        if (head[0] == 0 || head[1] == 0 || head[2] == 0 || head[3] == 0 || head[0] >= 0x80) {
+            _parsesWhole = YES;
+            return YES;
+        }
+        NSData *headData = _pendingData;
+        _pendingData = [NSMutableData data];
+        return [self scanBytes:headData.bytes length:headData.length];
+    }
+    
+    while (length > 0) {
+        size_t consumed = 0;
+        ZLJSONScanResult result = ZLJSONStreamScannerScan(&_scanner, bytes, length, &consumed);
+        switch (result) {
+            case ZLJSONScanNeedMoreData:
+                if (_scanner.container != 0 && !_scanner.closed) {
+                    [_pendingData appendBytes:bytes length:consumed];
+                }
+                return YES;
+            case ZLJSONScanBegin:
+                if (_scanner.container == '[') {
+                    _array = [NSMutableArray array];
+                } else {
+                    _dictionary = [NSMutableDictionary dictionary];
+                }
+                break;
+            case ZLJSONScanSeparator:
+            case ZLJSONScanEnd:
+                [_pendingData appendBytes:bytes length:consumed - 1];
+                if (![self finishElementAtEnd:result == ZLJSONScanEnd]) {
+                    _failed = YES;
+                    return NO;
+                }
+                break;
+            case ZLJSONScanScalar:
+                _parsesWhole = YES;
+                [_pendingData appendBytes:bytes length:length];
+                return YES;
+            case ZLJSONScanError:
+                _failed = YES;
+                return NO;
+        }
+        bytes += consumed;
+        length -= consumed;
+    }
+    return YES;
+}
+
+- (BOOL)finishElementAtEnd:(BOOL)isEnd {
+    const uint8_t *bytes = _pendingData.bytes;
+    NSUInteger length = _pendingData.length;
+    NSUInteger i = 0;
+    while (i < length && (bytes[i] == ' ' || bytes[i] == '\t' || bytes[i] == '\n' || bytes[i] == '\r')) {
+        i++;
+    }
+    if (i == length) {
+        // 只有 [] 或 {} 允许没有成员
+        _pendingData.length = 0;
+        return isEnd && !_sawElement;
+    }
+    _sawElement = YES;
+    
+    NSData *elementData = _pendingData;
+    if (_dictionary) {
+        // 对象成员 "key": value 补上括号后单独解析
+        NSMutableData *wrappedData = [NSMutableData dataWithCapacity:length + 2];
+        [wrappedData appendBytes:"{" length:1];
+        [wrappedData appendData:_pendingData];
+        [wrappedData appendBytes:"}" length:1];
+        elementData = wrappedData;
+    }
+    id element = [NSJSONSerialization JSONObjectWithData:elementData options:NSJSONReadingMutableLeaves | NSJSONReadingFragmentsAllowed error:nil];
+    _pendingData.length = 0;
+    if (element == nil) {
+        return NO;
+    }
+    
+    if (_array) {
+        [_array addObject:element];
+        if (_elementBlock) {
+            _elementBlock(element);
+        }
+    } else if ([element isKindOfClass:[NSDictionary class]]) {
+        [_dictionary addEntriesFromDictionary:element];
+    } else {
+        return NO;
+    }
+    return YES;
+}
+
+- (id)finish {
+    if (_failed) {
+        return nil;
+    }
+    if (_parsesWhole || !_checkedEncoding) {
+        return ZLParseResponseBody(ZLResponseBodyTypeJson, _pendingData);
+    }
+    if (!_scanner.closed) {
+        return nil;
+    }
+    return _array ?: _dictionary;
+}
+
+@end
+
+
+/// 一个边接收边解析的请求
+@interface ZLIncrementalResponseTask : NSObject
+
+@property (nonatomic, strong) NSURLResponse *response;
+
+@property (nonatomic, assign, readonly) BOOL failed;
+
+@property (nonatomic, copy) void (^success)(NSHTTPURLResponse *urlResponse, id responseObject);
+
+@property (nonatomic, copy) void (^failure)(NSError *error);
+
+- (instancetype)initWithResponseBodyType:(ZLResponseBodyType)responseBodyType
+                                 element:(void (^)(id element))elementBlock;
+
+- (void)appendData:(NSData *)data;
+
+- (id)finish;
+
+@end
+
+@implementation ZLIncrementalResponseTask {
+    ZLIncrementalJSONParser *_jsonParser;
+    ZLXMLDictionaryParser *_xmlParser;
+}
+
+- (instancetype)initWithResponseBodyType:(ZLResponseBodyType)responseBodyType
+                                 element:(void (^)(id element))elementBlock {
+    if (self = [super init]) {
+        if (responseBodyType == ZLResponseBodyTypeJson) {
+            _jsonParser = [[ZLIncrementalJSONParser alloc] initWithElementBlock:elementBlock];
+        } else {
+            _xmlParser = [[ZLXMLDictionaryParser sharedInstance] copy];
+        }
+    }
+    return self;
+}
+
+- (void)appendData:(NSData *)data {
+    if (_jsonParser) {
+        _failed = ![_jsonParser appendData:data];
+    } else {
+        [_xmlParser appendIncrementalData:data];
+    }
+}
+
+- (id)finish {
+    if (_failed) {
+        return nil;
+    }
+    if (_jsonParser) {
+        return [_jsonParser finish];
+    }
+    NSDictionary *result = [_xmlParser finishIncrementalParsing];
+    return [result isKindOfClass:[NSDictionary class]] ? result : nil;
+}
+
+@end
+
+
+static const void *ZLBodyStreamProviderKey = &ZLBodyStreamProviderKey;
+
+/// HTTPBodyStream 只能读一遍，307/308 重定向、鉴权和连接重试时 NSURLSession 会要新的请求体流，由 provider 从头生成
+static void ZLSetBodyStreamProvider(NSURLSessionTask *task, NSInputStream *(^provider)(void)) {
+    objc_setAssociatedObject(task, ZLBodyStreamProviderKey, provider, OBJC_ASSOCIATION_COPY_NONATOMIC);
+}
+
+/// 所有请求 session 的代理，为以流作为请求体的 task 提供新的请求体流
+@interface ZLSessionDelegate : NSObject <NSURLSessionTaskDelegate>
+
+@end
+
+@implementation ZLSessionDelegate
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task
+ needNewBodyStream:(void (^)(NSInputStream * _Nullable bodyStream))completionHandler {
+    NSInputStream *(^provider)(void) = objc_getAssociatedObject(task, ZLBodyStreamProviderKey);
+    completionHandler(provider ? provider() : nil);
+}
+
+@end
+
+
+/// 边接收边解析的 session 的代理，按 taskIdentifier 分发数据
+@interface ZLIncrementalSessionDelegate : ZLSessionDelegate <NSURLSessionDataDelegate>
+
+@property (nonatomic, weak) NSOperationQueue *responseQueue;
+
+- (void)addResponseTask:(ZLIncrementalResponseTask *)responseTask forTask:(NSURLSessionTask *)task;
+
+@end
+
+@implementation ZLIncrementalSessionDelegate {
+    NSMutableDictionary<NSNumber *, ZLIncrementalResponseTask *> *_responseTasks;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _responseTasks = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (void)addResponseTask:(ZLIncrementalResponseTask *)responseTask forTask:(NSURLSessionTask *)task {
+    @synchronized (self) {
+        _responseTasks[@(task.taskIdentifier)] = responseTask;
+    }
+}
+
+- (ZLIncrementalResponseTask *)responseTaskForTask:(NSURLSessionTask *)task remove:(BOOL)remove {
+    @synchronized (self) {
+        ZLIncrementalResponseTask *responseTask = _responseTasks[@(task.taskIdentifier)];
+        if (remove) {
+            [_responseTasks removeObjectForKey:@(task.taskIdentifier)];
+        }
+        return responseTask;
+    }
+}
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask
+                                 didReceiveResponse:(NSURLResponse *)response
+                                  completionHandler:(void (^)(NSURLSessionResponseDisposition disposition))completionHandler {
+    [self responseTaskForTask:dataTask remove:NO].response = response;
+    completionHandler(NSURLSessionResponseAllow);
+}
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask
+    didReceiveData:(NSData *)data {
+    ZLIncrementalResponseTask *responseTask = [self responseTaskForTask:dataTask remove:NO];
+    [responseTask appendData:data];
+    if (responseTask.failed) {
+        // 数据已经无法解析，不必再接收剩下的部分
+        [dataTask cancel];
+    }
+}
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task
+didCompleteWithError:(nullable NSError *)error {
+    ZLIncrementalResponseTask *responseTask = [self responseTaskForTask:task remove:YES];
+    if (responseTask == nil) {
+        return;
+    }
+    
+    id res = error == nil ? [responseTask finish] : nil;
+    [self.responseQueue addOperationWithBlock:^{
+        if (error != nil && !responseTask.failed) {
+            responseTask.failure(error);
+            return;
+        }
+        
+        if (res == nil) {
+            responseTask.failure([NSError errorWithDomain:@"data error" code:-999999 userInfo:nil]);
+            return;
+        }
+        responseTask.success((NSHTTPURLResponse *)responseTask.response, res);
+    }];
+}
+
+@end
+
 
 @interface ZLMultipartFormDataItem : NSObject
 
@@ -130,6 +507,9 @@ static id ZLParseResponseBody(ZLResponseBodyType type, NSData *data) {
 
 @property (nonatomic, copy) NSString *mimetype;
 
+/// 数据长度，文件只读取属性，不读取内容
+@property (nonatomic, assign, readonly) unsigned long long contentLength;
+
 - (instancetype)initWithURL:(NSURL *)url
                    filename:(NSString *)filename
                        name:(NSString *)name
@@ -196,11 +576,165 @@ static id ZLParseResponseBody(ZLResponseBodyType type, NSData *data) {
     return self;
 }
 
-- (NSData *)data {
-    if (_data == nil) {
-        _data = [NSData dataWithContentsOfURL:self.url];
+- (unsigned long long)contentLength {
+    if (self.data != nil) {
+        return self.data.length;
+    }
+    NSNumber *fileSize = nil;
+    if (![self.url getResourceValue:&fileSize forKey:NSURLFileSizeKey error:nil]) {
+        return 0;
+    }
+    return fileSize.unsignedLongLongValue;
+}
+
+@end
+
+
+/// 按顺序读取 multipart 各部分的流，文件部分在读取时才打开，内存占用与文件大小无关
+@interface ZLMultipartBodyStream : NSInputStream <NSStreamDelegate>
+
+- (instancetype)initWithBodyParts:(NSArray *)bodyParts
+                  bodyPartLengths:(NSArray<NSNumber *> *)bodyPartLengths
+                    contentLength:(unsigned long long)contentLength
+                         progress:(void (^)(float uploadProgress))uploadProgressBlock;
+
+@end
+
+@implementation ZLMultipartBodyStream {
+    NSArray *_bodyParts;
+    NSArray<NSNumber *> *_bodyPartLengths;
+    NSUInteger _bodyPartIndex;
+    unsigned long long _bodyPartOffset;
+    NSInputStream *_fileStream;
+    unsigned long long _contentLength;
+    unsigned long long _sentLength;
+    void (^_uploadProgressBlock)(float uploadProgress);
+    NSStreamStatus _streamStatus;
+    NSError *_streamError;
+}
+
+@synthesize delegate;
+
+- (instancetype)initWithBodyParts:(NSArray *)bodyParts
+                  bodyPartLengths:(NSArray<NSNumber *> *)bodyPartLengths
+                    contentLength:(unsigned long long)contentLength
+                         progress:(void (^)(float uploadProgress))uploadProgressBlock {
+    if (self = [super initWithData:[NSData data]]) {
+        _bodyParts = bodyParts.copy;
+        // 长度在拼装时就已确定并写进了 Content-Length，读取时以此为准
+        _bodyPartLengths = bodyPartLengths.copy;
+        _contentLength = contentLength;
+        _uploadProgressBlock = [uploadProgressBlock copy];
+        _streamStatus = NSStreamStatusNotOpen;
+    }
+    return self;
+}
+
+- (void)open {
+    if (_streamStatus == NSStreamStatusNotOpen) {
+        _streamStatus = NSStreamStatusOpen;
+    }
+}
+
+- (void)close {
+    [_fileStream close];
+    _fileStream = nil;
+    _streamStatus = NSStreamStatusClosed;
+}
+
+- (NSStreamStatus)streamStatus {
+    return _streamStatus;
+}
+
+- (NSError *)streamError {
+    return _streamError;
+}
+
+- (BOOL)hasBytesAvailable {
+    return _streamStatus == NSStreamStatusOpen && _bodyPartIndex < _bodyParts.count;
+}
+
+- (BOOL)getBuffer:(uint8_t * _Nullable *)buffer length:(NSUInteger *)len {
+    return NO;
+}
+
+- (void)failWithError:(NSError *)error {
+    [_fileStream close];
+    _fileStream = nil;
+    _streamError = error ?: [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadUnknownError userInfo:nil];
+    _streamStatus = NSStreamStatusError;
+}
+
+- (NSInteger)read:(uint8_t *)buffer maxLength:(NSUInteger)len {
+    if (_streamStatus != NSStreamStatusOpen) {
+        return _streamStatus == NSStreamStatusError ? -1 : 0;
+    }
+    
+    NSUInteger totalLength = 0;
+    while (totalLength < len && _bodyPartIndex < _bodyParts.count) {
+        id bodyPart = _bodyParts[_bodyPartIndex];
+        unsigned long long remainLength = _bodyPartLengths[_bodyPartIndex].unsignedLongLongValue - _bodyPartOffset;
+        NSUInteger maxLength = (NSUInteger)MIN(remainLength, (unsigned long long)(len - totalLength));
+        
+        if ([bodyPart isKindOfClass:[NSData class]]) {
+            [(NSData *)bodyPart getBytes:buffer + totalLength range:NSMakeRange((NSUInteger)_bodyPartOffset, maxLength)];
+        } else if (maxLength > 0) {
+            if (_fileStream == nil) {
+                _fileStream = [NSInputStream inputStreamWithURL:[(ZLMultipartFormDataItem *)bodyPart url]];
+                [_fileStream open];
+            }
+            NSInteger readLength = [_fileStream read:buffer + totalLength maxLength:maxLength];
+            if (readLength <= 0) {
+                // 文件在上传过程中被删除或截短，已经发出的 Content-Length 无法再满足
+                [self failWithError:_fileStream.streamError];
+                return -1;
+            }
+            maxLength = readLength;
+        }
+        
+        totalLength += maxLength;
+        _bodyPartOffset += maxLength;
+        if (_bodyPartOffset == _bodyPartLengths[_bodyPartIndex].unsignedLongLongValue) {
+            [_fileStream close];
+            _fileStream = nil;
+            _bodyPartIndex++;
+            _bodyPartOffset = 0;
+        }
+    }
+    
+    if (_bodyPartIndex >= _bodyParts.count) {
+        _streamStatus = NSStreamStatusAtEnd;
+    }
+    
+    _sentLength += totalLength;
+    if (_uploadProgressBlock && totalLength > 0 && _contentLength > 0) {
+        _uploadProgressBlock((float)((double)_sentLength / _contentLength));
     }
-    return _data;
+    return totalLength;
+}
+
+- (id)propertyForKey:(NSStreamPropertyKey)key {
+    return nil;
+}
+
+- (BOOL)setProperty:(id)property forKey:(NSStreamPropertyKey)key {
+    return NO;
+}
+
+- (void)scheduleInRunLoop:(NSRunLoop *)aRunLoop forMode:(NSRunLoopMode)mode {}
+
+- (void)removeFromRunLoop:(NSRunLoop *)aRunLoop forMode:(NSRunLoopMode)mode {}
+
+// NSURLSession 通过 CFReadStream 使用 HTTPBodyStream，NSInputStream 子类需要实现以下方法
+
+- (void)_scheduleInCFRunLoop:(__unused CFRunLoopRef)aRunLoop forMode:(__unused CFStringRef)aMode {}
+
+- (void)_unscheduleFromCFRunLoop:(__unused CFRunLoopRef)aRunLoop forMode:(__unused CFStringRef)aMode {}
+
+- (BOOL)_setCFClientFlags:(__unused CFOptionFlags)inFlags
+                 callback:(__unused CFReadStreamClientCallBack)inCallback
+                  context:(__unused CFStreamClientContext *)inContext {
+    return NO;
 }
 
 @end
@@ -208,41 +742,77 @@ static id ZLParseResponseBody(ZLResponseBodyType type, NSData *data) {
 
 @interface ZLMultipartFormData ()
 
-@property (nonatomic, strong) NSMutableData *data;
+/// NSData 或基于文件的 ZLMultipartFormDataItem，上传时按顺序读取
+@property (nonatomic, strong) NSMutableArray *bodyParts;
+
+@property (nonatomic, strong) NSMutableArray<NSNumber *> *bodyPartLengths;
+
+@property (nonatomic, assign) unsigned long long contentLength;
 
 @property (nonatomic, strong) NSString *boundary;
 
 - (void)finalData;
 
+- (NSInputStream *)bodyStreamWithProgress:(void (^)(float uploadProgress))uploadProgressBlock;
+
 @end
 
 @implementation ZLMultipartFormData
 
 - (instancetype)init {
     if (self = [super init]) {
-        _data = [NSMutableData data];
+        _bodyParts = [NSMutableArray array];
+        _bodyPartLengths = [NSMutableArray array];
     }
     return self;
 }
 
+- (void)appendBodyPart:(id)bodyPart length:(unsigned long long)length {
+    // 相邻的内存数据合并，减少读取时的分段
+    NSMutableData *lastData = self.bodyParts.lastObject;
+    if ([bodyPart isKindOfClass:[NSData class]] && [lastData isKindOfClass:[NSMutableData class]]) {
+        [lastData appendData:bodyPart];
+        self.bodyPartLengths[self.bodyPartLengths.count - 1] = @(lastData.length);
+    } else {
+        [self.bodyParts addObject:[bodyPart isKindOfClass:[NSData class]] ? [bodyPart mutableCopy] : bodyPart];
+        [self.bodyPartLengths addObject:@(length)];
+    }
+    self.contentLength += length;
+}
+
+- (void)appendString:(NSString *)string {
+    NSData *data = [string dataUsingEncoding:NSUTF8StringEncoding];
+    [self appendBodyPart:data length:data.length];
+}
+
 - (void)finalData {
-    NSString *finalStr = [self.boundary stringByAppendingFormat:@"--%@", kZLMultipartFormCRLF];
-    [self.data appendData:[finalStr dataUsingEncoding:NSUTF8StringEncoding]];
+    [self appendString:[self.boundary stringByAppendingFormat:@"--%@", kZLMultipartFormCRLF]];
 }
 
 - (BOOL)appendItem:(ZLMultipartFormDataItem *)item {
-    NSData *data = item.data;
-    if (data == nil || data.length == 0) {
+    unsigned long long length = item.contentLength;
+    if (length == 0) {
         return NO;
     }
     
     NSString *headerStr = [self.boundary stringByAppendingFormat:@"%@Content-Disposition: form-data; name=\"%@\"; filename=\"%@\"%@Content-Type: %@%@%@", kZLMultipartFormCRLF, item.name, item.filename, kZLMultipartFormCRLF, item.mimetype, kZLMultipartFormCRLF, kZLMultipartFormCRLF];
-    [self.data appendData:[headerStr dataUsingEncoding:NSUTF8StringEncoding]];
-    [self.data appendData:data];
-    [self.data appendData:[kZLMultipartFormCRLF dataUsingEncoding:NSUTF8StringEncoding]];
+    [self appendString:headerStr];
+    if (item.data != nil) {
+        [self appendBodyPart:item.data length:length];
+    } else {
+        [self appendBodyPart:item length:length];
+    }
+    [self appendString:kZLMultipartFormCRLF];
     return YES;
 }
 
+- (NSInputStream *)bodyStreamWithProgress:(void (^)(float uploadProgress))uploadProgressBlock {
+    return [[ZLMultipartBodyStream alloc] initWithBodyParts:self.bodyParts
+                                            bodyPartLengths:self.bodyPartLengths
+                                              contentLength:self.contentLength
+                                                   progress:uploadProgressBlock];
+}
+
 - (BOOL)appendPartWithFileURL:(NSURL *)fileURL
                          name:(NSString *)name {
     ZLMultipartFormDataItem *item = [[ZLMultipartFormDataItem alloc] initWithURL:fileURL filename:nil name:name mimetype:nil];
@@ -275,6 +845,7 @@ static id ZLParseResponseBody(ZLResponseBodyType type, NSData *data) {
     unsigned long receivedLength;
 }
 
+/// 与 ZLURLSessionManager 共用，读写时以它自身加锁
 @property (nonatomic, strong) NSMutableDictionary<NSURL *, ZLDownloadOperation *> *mainDownloadItems;
 
 @property (nonatomic, strong) NSURLSession *urlSession;
@@ -293,10 +864,29 @@ static id ZLParseResponseBody(ZLResponseBodyType type, NSData *data) {
 
 @property (nonatomic, copy) void (^downloadProgressBlock)(float downloadProgress);
 
+@property (nonatomic, copy) void (^receivedDataBlock)(NSData *receivedData, BOOL finished);
+
+/// 仅在设置了 receivedDataBlock 时在内存中保留已下载的数据
+@property (nonatomic, strong) NSMutableData *receivedData;
+
 @property (nonatomic, copy) void (^completionHandler)(NSURLResponse *response, NSURL *filePath, NSError *error);
 
+/// 同一 URL 后来的下载请求，只在持有 mainDownloadItems 的锁时访问
 @property (nonatomic, strong) NSMutableArray<void (^)(NSURLResponse *response, NSURL *filePath, NSError *error)> *otherCompletionHandlers;
 
+/// 以下三项由 ZLDownloadScheduler 读写
+@property (nonatomic, assign) ZLRequestPriority priority;
+
+/// 同优先级中后加入的先开始
+@property (nonatomic, assign) BOOL lifo;
+
+@property (nonatomic, assign) CFAbsoluteTime enqueueTime;
+
+- (void)finishWithError:(NSError *)error;
+
+/// 开始前就被取消时也要结束 operation，否则会一直占着队列的并发数
+- (void)finishCancelledOperation;
+
 @end
 
 @implementation ZLDownloadOperation
@@ -330,46 +920,20 @@ static id ZLParseResponseBody(ZLResponseBodyType type, NSData *data) {
 
 - (void)main {
     if (self.isCancelled) {
-        [self handleCancelAction];
+        [self finishCancelledOperation];
         return;
     }
     
-    NSOperationQueue *queue = [[NSOperationQueue alloc] init];
-    queue.maxConcurrentOperationCount = 1;
-        
-    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration defaultSessionConfiguration];
-    configuration.HTTPShouldSetCookies = YES;
-    configuration.HTTPShouldUsePipelining = NO;
-    if (@available(iOS 16.0, *)) {
-        configuration.requiresDNSSECValidation = YES;
-    } else {
-        // Fallback on earlier versions
-    }
-    
-    configuration.timeoutIntervalForRequest = 3600;
-    configuration.allowsCellularAccess = YES;
+    [self prepareURLSession];
     
-    self.urlRequest.timeoutInterval = 3600;
-    
-    self.urlSession = [NSURLSession sessionWithConfiguration:configuration delegate:self delegateQueue:queue];
-    
-    if (self.headers != nil) {
-        for (NSString *headerField in self.headers.keyEnumerator) {
-            [self.urlRequest setValue:self.headers[headerField] forHTTPHeaderField:headerField];
-        }
+    // 旧版本的分段下载与普通下载共用临时文件名，旁边有 manifest 的是预分配了完整长度的文件，不能当作前缀续传
+    NSString *legacyManifestPath = [self.filePath stringByAppendingPathExtension:@"manifest"];
+    if ([[NSFileManager defaultManager] fileExistsAtPath:legacyManifestPath]) {
+        [[NSFileManager defaultManager] removeItemAtPath:self.filePath error:nil];
+        [[NSFileManager defaultManager] removeItemAtPath:legacyManifestPath error:nil];
     }
     
-    NSString *downloadTemp = [[ZLURLSessionManager shared].workspaceDirURLString stringByAppendingPathComponent:@"temp"];
-    NSString *fileName = ZLSha256HashFor(self.urlRequest.URL.absoluteString);
-    self.filePath = [downloadTemp stringByAppendingPathComponent:fileName];
-    
     BOOL isDir = NO;
-    if (![[NSFileManager defaultManager] fileExistsAtPath:downloadTemp isDirectory:&isDir] || !isDir) {
-        if (![[NSFileManager defaultManager] createDirectoryAtPath:downloadTemp withIntermediateDirectories:YES attributes:nil error:nil]) {
-            NSLog(@"file system error");
-        }
-    }
-    
     if ([[NSFileManager defaultManager] fileExistsAtPath:self.filePath isDirectory:&isDir] && !isDir) {
         NSDictionary *fileDic = [[NSFileManager defaultManager] attributesOfItemAtPath:self.filePath error:nil];//获取文件的属性
         unsigned long size = [[fileDic objectForKey:NSFileSize] longLongValue];
@@ -381,8 +945,18 @@ static id ZLParseResponseBody(ZLResponseBodyType type, NSData *data) {
         receivedLength = 0;
     }
     
+    if (self.receivedDataBlock) {
+        // 断点续传时先把已下载的部分读进来，保证回调拿到的是完整的前缀数据
+        self.receivedData = receivedLength > 0 ? [NSMutableData dataWithContentsOfFile:self.filePath] : [NSMutableData data];
+        if (self.receivedData == nil || self.receivedData.length != receivedLength) {
+            self.receivedDataBlock = nil;
+            self.receivedData = nil;
+        }
+    }
+    
     if (self.isCancelled) {
-        [self handleCancelAction];
+        [self.urlSession invalidateAndCancel];
+        [self finishCancelledOperation];
         return;
     }
     
@@ -395,6 +969,48 @@ static id ZLParseResponseBody(ZLResponseBodyType type, NSData *data) {
     [self didChangeValueForKey:@"executing"];
 }
 
+- (NSURLSessionConfiguration *)sessionConfiguration {
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration defaultSessionConfiguration];
+    configuration.HTTPShouldSetCookies = YES;
+    configuration.HTTPShouldUsePipelining = NO;
+    if (@available(iOS 16.0, *)) {
+        configuration.requiresDNSSECValidation = YES;
+    } else {
+        // Fallback on earlier versions
+    }
+    
+    configuration.timeoutIntervalForRequest = 3600;
+    configuration.allowsCellularAccess = YES;
+    return configuration;
+}
+
+/// 创建代理 session，合并请求头，并确定临时文件路径
+- (void)prepareURLSession {
+    NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+    queue.maxConcurrentOperationCount = 1;
+    
+    self.urlRequest.timeoutInterval = 3600;
+    
+    self.urlSession = [NSURLSession sessionWithConfiguration:[self sessionConfiguration] delegate:self delegateQueue:queue];
+    
+    if (self.headers != nil) {
+        for (NSString *headerField in self.headers.keyEnumerator) {
+            [self.urlRequest setValue:self.headers[headerField] forHTTPHeaderField:headerField];
+        }
+    }
+    
+    NSString *downloadTemp = [[ZLURLSessionManager shared].workspaceDirURLString stringByAppendingPathComponent:@"temp"];
+    NSString *fileName = ZLSha256HashFor(self.urlRequest.URL.absoluteString);
+    self.filePath = [downloadTemp stringByAppendingPathComponent:fileName];
+    
+    BOOL isDir = NO;
+    if (![[NSFileManager defaultManager] fileExistsAtPath:downloadTemp isDirectory:&isDir] || !isDir) {
+        if (![[NSFileManager defaultManager] createDirectoryAtPath:downloadTemp withIntermediateDirectories:YES attributes:nil error:nil]) {
+            NSLog(@"file system error");
+        }
+    }
+}
+
 - (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask
                                  didReceiveResponse:(NSURLResponse *)response
                                   completionHandler:(void (^)(NSURLSessionResponseDisposition disposition))completionHandler {
@@ -431,6 +1047,11 @@ static id ZLParseResponseBody(ZLResponseBodyType type, NSData *data) {
     [self.fileHandle writeData:data];
     receivedLength += data.length;
     
+    if (self.receivedDataBlock) {
+        [self.receivedData appendData:data];
+        self.receivedDataBlock(self.receivedData, NO);
+    }
+    
     if (self.downloadProgressBlock) {
         self.downloadProgressBlock(1.0 * receivedLength / contentLength);
     }
@@ -447,34 +1068,47 @@ didCompleteWithError:(nullable NSError *)error {
             [self handleCancelAction];
         }
         
-        if (self.completionHandler) {
-            self.completionHandler(self.response, self.destinationURL, error);
-        }
-        for (void (^completionHandler)(NSURLResponse *response, NSURL *filePath, NSError *error) in self.otherCompletionHandlers) {
-            completionHandler(self.response, self.destinationURL, error);
-        }
+        [self finishWithError:error];
     } else {
         if (receivedLength >= contentLength) {
             NSError *error = nil;
             [[NSFileManager defaultManager] moveItemAtURL:[NSURL fileURLWithPath:self.filePath] toURL:self.destinationURL error:&error];
             
-            if (self.completionHandler) {
-                self.completionHandler(self.response, self.destinationURL, error);
-            }
-            for (void (^completionHandler)(NSURLResponse *response, NSURL *filePath, NSError *error) in self.otherCompletionHandlers) {
-                completionHandler(self.response, self.destinationURL, error);
+            if (self.receivedDataBlock && error == nil) {
+                self.receivedDataBlock(self.receivedData, YES);
             }
+            
+            [self finishWithError:error];
         } else {
-            if (self.completionHandler) {
-                self.completionHandler(self.response, self.destinationURL, [NSError errorWithDomain:@"FILE IO Error" code:NSURLErrorCannotMoveFile userInfo:nil]);
-            }
-            for (void (^completionHandler)(NSURLResponse *response, NSURL *filePath, NSError *error) in self.otherCompletionHandlers) {
-                completionHandler(self.response, self.destinationURL, [NSError errorWithDomain:@"FILE IO Error" code:NSURLErrorCannotMoveFile userInfo:nil]);
-            }
+            [self finishWithError:[NSError errorWithDomain:@"FILE IO Error" code:NSURLErrorCannotMoveFile userInfo:nil]];
+        }
+    }
+}
+
+/// 回调所有 completionHandler 并结束 operation
+- (void)finishWithError:(NSError *)error {
+    if (_isFinished) {
+        return;
+    }
+    
+    // 先从 mainDownloadItems 移除再取出其它回调，之后同一 URL 的请求会开始新的下载，不会丢失回调
+    NSArray<void (^)(NSURLResponse *response, NSURL *filePath, NSError *error)> *otherCompletionHandlers = nil;
+    @synchronized (self.mainDownloadItems) {
+        if (self.mainDownloadItems[self.urlRequest.URL] == self) {
+            [self.mainDownloadItems removeObjectForKey:self.urlRequest.URL];
         }
+        otherCompletionHandlers = [self.otherCompletionHandlers copy];
+        [self.otherCompletionHandlers removeAllObjects];
     }
     
-    [self.mainDownloadItems removeObjectForKey:self.urlRequest.URL];
+    if (self.completionHandler) {
+        self.completionHandler(self.response, self.destinationURL, error);
+    }
+    for (void (^completionHandler)(NSURLResponse *response, NSURL *filePath, NSError *error) in otherCompletionHandlers) {
+        completionHandler(self.response, self.destinationURL, error);
+    }
+    
+    self.receivedData = nil;
     
     [self willChangeValueForKey:@"executing"];
     _isExecuting = NO;
@@ -485,108 +1119,1251 @@ didCompleteWithError:(nullable NSError *)error {
     [self didChangeValueForKey:@"finished"];
 }
 
+- (void)finishCancelledOperation {
+    [self handleCancelAction];
+    [self finishWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+}
+
 - (void)handleCancelAction {
 //    NSLog(@"%s", __FUNCTION__);
 }
 
 @end
 
-@interface ZLURLSessionManager ()
+/// 分段下载时每段的最小长度，文件较小时减少并发连接数
+static unsigned long long const ZLDownloadSegmentMinLength = 1024 * 1024;
 
-@property (nonatomic, strong) NSURLSessionConfiguration *configuration;
+/// 下载临时文件超过这么久没有修改视为放弃，启动时清理
+static NSTimeInterval const ZLDownloadTempFileMaxAge = 7 * 24 * 60 * 60;
 
-@property (nonatomic, strong) NSMutableDictionary<NSString *, NSURLSession *> *urlSessionCaches;
+/// 下载过程中 manifest 最多每隔这么久写一次，进程被杀时最多丢这么久的进度；每段完成时另外立即写
+static CFAbsoluteTime const ZLDownloadManifestSaveInterval = 1;
 
-@property (nonatomic, strong) NSOperationQueue *responseQueue;
+/// 解析 "bytes start-end/total"，total 为 * 时视为失败
+static BOOL ZLParseContentRange(NSString *contentRange, unsigned long long *start, unsigned long long *end, unsigned long long *total) {
+    if (![contentRange isKindOfClass:[NSString class]]) {
+        return NO;
+    }
+    if (sscanf(contentRange.UTF8String, "bytes %llu-%llu/%llu", start, end, total) != 3) {
+        return NO;
+    }
+    return *start <= *end && *end < *total;
+}
 
-@property (nonatomic, strong) NSOperationQueue *downloadQueue;
+/// If-Range 只能使用强 ETag 或 Last-Modified
+static NSString * ZLRangeValidatorForResponse(NSHTTPURLResponse *response) {
+    NSString *etag = response.allHeaderFields[@"ETag"];
+    if (etag.length > 0 && ![etag hasPrefix:@"W/"]) {
+        return etag;
+    }
+    NSString *lastModified = response.allHeaderFields[@"Last-Modified"];
+    return lastModified.length > 0 ? lastModified : nil;
+}
 
-@property (nonatomic, strong) NSMutableDictionary<NSURL *, ZLDownloadOperation *> *downloadItems;
+static BOOL ZLWriteAtOffset(int fd, const void *bytes, size_t length, unsigned long long offset) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, bytes, length, (off_t)offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NO;
+        }
+        bytes = (const uint8_t *)bytes + written;
+        length -= written;
+        offset += written;
+    }
+    return YES;
+}
 
-@property (nonatomic, copy, readwrite) NSString *workspaceDirURLString;
+@interface ZLDownloadSegment : NSObject
+
+@property (nonatomic, assign) unsigned long long start;
+
+/// 包含在本段内
+@property (nonatomic, assign) unsigned long long end;
+
+@property (nonatomic, assign) unsigned long long receivedLength;
+
+@property (nonatomic, strong) NSURLSessionDataTask *task;
+
+@property (nonatomic, assign, readonly, getter=isFinished) BOOL finished;
 
 @end
 
-@implementation ZLURLSessionManager
+@implementation ZLDownloadSegment
 
-- (NSMutableDictionary<NSURL *,ZLDownloadOperation *> *)downloadItems {
-    if (_downloadItems == nil) {
-        _downloadItems = [NSMutableDictionary dictionary];
-    }
-    return _downloadItems;
+- (BOOL)isFinished {
+    return self.start + self.receivedLength > self.end;
 }
 
-+ (instancetype)shared {
-    static ZLURLSessionManager *manager = nil;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        manager = [self new];
-    });
-    return manager;
+@end
+
+/// 先用 bytes=0-0 探测服务器是否支持 Range，支持时把文件切成若干段并行下载，用 pwrite 写入预分配好的临时文件；
+/// 每段的进度记录在临时文件旁的 manifest 中，断点续传时用 If-Range 校验资源未变化后只补下载缺少的部分。
+/// 临时文件预分配了完整长度，中间可能还有空洞，与普通下载的临时文件分开命名，避免被当作已下载的前缀续传。
+/// 服务器不支持 Range 或资源已变化时，探测请求会直接返回 200 全量数据，此时退回单连接下载
+@interface ZLSegmentedDownloadOperation : ZLDownloadOperation
+
+@property (nonatomic, assign) NSUInteger segmentCount;
+
+@end
+
+@implementation ZLSegmentedDownloadOperation {
+    int _fd;
+    NSString *_manifestPath;
+    CFAbsoluteTime _manifestSaveTime;
+    NSString *_validator;
+    NSArray<ZLDownloadSegment *> *_segments;
+    NSMutableDictionary<NSNumber *, ZLDownloadSegment *> *_segmentTasks;
+    NSURLSessionDataTask *_probeTask;
+    BOOL _singleStream;
+    NSError *_segmentError;
 }
 
 - (instancetype)init {
-    self = [super init];
-    if (self) {
-        _timeoutIntervalForRequest = 10;
-        _urlSessionCaches = [NSMutableDictionary dictionary];
-        _responseQueue = [[NSOperationQueue alloc] init];
-        _responseQueue.maxConcurrentOperationCount = countOfCores();
-        _downloadQueue = [[NSOperationQueue alloc] init];
-        _downloadQueue.maxConcurrentOperationCount = _responseQueue.maxConcurrentOperationCount;
-        _reachablity = [ZHLReachability reachabilityWithHostName:@"www.apple.com"];
-        _workspaceDirURLString = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES).firstObject stringByAppendingPathComponent:@"ZHLNetworking"];
+    if (self = [super init]) {
+        _fd = -1;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+- (void)cancel {
+    [super cancel];
+    
+    [self.urlSession.delegateQueue addOperationWithBlock:^{
+        [self->_probeTask cancel];
+        for (ZLDownloadSegment *segment in self->_segmentTasks.allValues) {
+            [segment.task cancel];
+        }
+    }];
+}
+
+- (NSURLSessionConfiguration *)sessionConfiguration {
+    NSURLSessionConfiguration *configuration = [super sessionConfiguration];
+    configuration.HTTPMaximumConnectionsPerHost = MAX(configuration.HTTPMaximumConnectionsPerHost, (NSInteger)self.segmentCount);
+    return configuration;
+}
+
+- (void)main {
+    if (self.isCancelled) {
+        [self finishCancelledOperation];
+        return;
+    }
+    
+    [self prepareURLSession];
+    self.filePath = [self.filePath stringByAppendingPathExtension:@"segmented"];
+    _manifestPath = [self.filePath stringByAppendingPathExtension:@"manifest"];
+    
+    [self willChangeValueForKey:@"executing"];
+    _isExecuting = YES;
+    [self didChangeValueForKey:@"executing"];
+    
+    _fd = open(self.filePath.fileSystemRepresentation, O_RDWR | O_CREAT, 0644);
+    if (_fd < 0) {
+        [self finishWithError:[NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]];
+        return;
+    }
+    
+    [self loadManifest];
+    
+    NSMutableURLRequest *probeRequest = self.urlRequest.mutableCopy;
+    [probeRequest setValue:@"bytes=0-0" forHTTPHeaderField:@"Range"];
+    if (_validator != nil) {
+        [probeRequest setValue:_validator forHTTPHeaderField:@"If-Range"];
+    }
+    _probeTask = [self.urlSession dataTaskWithRequest:probeRequest];
+    [_probeTask resume];
+}
+
+- (void)loadManifest {
+    NSDictionary *manifest = [NSDictionary dictionaryWithContentsOfFile:_manifestPath];
+    NSString *validator = manifest[@"validator"];
+    NSNumber *length = manifest[@"length"];
+    NSArray<NSArray<NSNumber *> *> *ranges = manifest[@"segments"];
+    if (![validator isKindOfClass:[NSString class]] || ![length isKindOfClass:[NSNumber class]] || ![ranges isKindOfClass:[NSArray class]] || ranges.count == 0) {
+        return;
+    }
+    
+    NSMutableArray<ZLDownloadSegment *> *segments = [NSMutableArray arrayWithCapacity:ranges.count];
+    for (NSArray<NSNumber *> *range in ranges) {
+        if (![range isKindOfClass:[NSArray class]] || range.count != 3) {
+            return;
+        }
+        ZLDownloadSegment *segment = [[ZLDownloadSegment alloc] init];
+        segment.start = range[0].unsignedLongLongValue;
+        segment.end = range[1].unsignedLongLongValue;
+        segment.receivedLength = MIN(range[2].unsignedLongLongValue, segment.end - segment.start + 1);
+        [segments addObject:segment];
+    }
+    
+    _validator = validator;
+    _segments = segments;
+    contentLength = (unsigned long)length.unsignedLongLongValue;
+}
+
+- (void)saveManifest {
+    if (![self writeManifest]) {
+        // 没有可用于 If-Range 的校验值时无法安全续传
+        [self removeTempFiles];
+    }
+}
+
+/// 下载过程中随时可以调用：记录的进度只包括已经 pwrite 完成的字节
+- (BOOL)writeManifest {
+    if (_segments == nil || _validator == nil) {
+        return NO;
+    }
+    
+    _manifestSaveTime = CFAbsoluteTimeGetCurrent();
+    NSMutableArray<NSArray<NSNumber *> *> *ranges = [NSMutableArray arrayWithCapacity:_segments.count];
+    for (ZLDownloadSegment *segment in _segments) {
+        [ranges addObject:@[@(segment.start), @(segment.end), @(segment.receivedLength)]];
+    }
+    return [@{@"validator": _validator, @"length": @(contentLength), @"segments": ranges} writeToFile:_manifestPath atomically:YES];
+}
+
+- (void)removeTempFiles {
+    [[NSFileManager defaultManager] removeItemAtPath:_manifestPath error:nil];
+    [[NSFileManager defaultManager] removeItemAtPath:self.filePath error:nil];
+}
+
+- (void)startSegments {
+    if (ftruncate(_fd, (off_t)contentLength) != 0) {
+        [self finishSegmentsWithError:[NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]];
+        return;
+    }
+    
+    if (_segments == nil) {
+        [[NSFileManager defaultManager] removeItemAtPath:_manifestPath error:nil];
         
-        NSString *downloadTemp = [_workspaceDirURLString stringByAppendingPathComponent:@"temp"];
+        unsigned long long count = (contentLength + ZLDownloadSegmentMinLength - 1) / ZLDownloadSegmentMinLength;
+        count = MAX(1, MIN(count, self.segmentCount));
+        unsigned long long segmentLength = contentLength / count;
+        NSMutableArray<ZLDownloadSegment *> *segments = [NSMutableArray arrayWithCapacity:(NSUInteger)count];
+        for (unsigned long long i = 0; i < count; ++i) {
+            ZLDownloadSegment *segment = [[ZLDownloadSegment alloc] init];
+            segment.start = i * segmentLength;
+            segment.end = i == count - 1 ? contentLength - 1 : segment.start + segmentLength - 1;
+            [segments addObject:segment];
+        }
+        _segments = segments;
+        [self writeManifest];
+    }
+    
+    receivedLength = 0;
+    _segmentTasks = [NSMutableDictionary dictionaryWithCapacity:_segments.count];
+    for (ZLDownloadSegment *segment in _segments) {
+        receivedLength += segment.receivedLength;
+        if (segment.isFinished) {
+            continue;
+        }
         
-        BOOL isDir = NO;
-        if (![[NSFileManager defaultManager] fileExistsAtPath:downloadTemp isDirectory:&isDir] || !isDir) {
-            if (![[NSFileManager defaultManager] createDirectoryAtPath:downloadTemp withIntermediateDirectories:YES attributes:nil error:nil]) {
-                NSLog(@"file system error");
+        NSMutableURLRequest *request = self.urlRequest.mutableCopy;
+        [request setValue:[NSString stringWithFormat:@"bytes=%llu-%llu", segment.start + segment.receivedLength, segment.end] forHTTPHeaderField:@"Range"];
+        if (_validator != nil) {
+            [request setValue:_validator forHTTPHeaderField:@"If-Range"];
+        }
+        segment.task = [self.urlSession dataTaskWithRequest:request];
+        _segmentTasks[@(segment.task.taskIdentifier)] = segment;
+    }
+    
+    if (_segmentTasks.count == 0) {
+        [self finishSegmentsWithError:nil];
+        return;
+    }
+    for (ZLDownloadSegment *segment in _segmentTasks.allValues) {
+        [segment.task resume];
+    }
+}
+
+- (void)failSegmentsWithError:(NSError *)error {
+    if (_segmentError == nil) {
+        _segmentError = error;
+    }
+    for (ZLDownloadSegment *segment in _segmentTasks.allValues) {
+        [segment.task cancel];
+    }
+}
+
+- (void)finishSegmentsWithError:(NSError *)error {
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+    [self.urlSession finishTasksAndInvalidate];
+    
+    if (error != nil) {
+        if (_singleStream) {
+            [self removeTempFiles];
+        } else {
+            [self saveManifest];
+        }
+        [self finishWithError:error];
+        return;
+    }
+    
+    [[NSFileManager defaultManager] removeItemAtPath:_manifestPath error:nil];
+    [[NSFileManager defaultManager] moveItemAtURL:[NSURL fileURLWithPath:self.filePath] toURL:self.destinationURL error:&error];
+    [self finishWithError:error];
+}
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask
+                                 didReceiveResponse:(NSURLResponse *)response
+                                  completionHandler:(void (^)(NSURLSessionResponseDisposition disposition))completionHandler {
+    if (self.isCancelled) {
+        completionHandler(NSURLSessionResponseCancel);
+        return;
+    }
+    
+    NSHTTPURLResponse *rp = [response isKindOfClass:[NSHTTPURLResponse class]] ? (NSHTTPURLResponse *)response : nil;
+    unsigned long long start = 0, end = 0, total = 0;
+    BOOL isPartial = rp.statusCode == 206 && ZLParseContentRange(rp.allHeaderFields[@"Content-Range"], &start, &end, &total);
+    
+    if (dataTask == _probeTask) {
+        self.response = response;
+        if (isPartial) {
+            NSString *validator = ZLRangeValidatorForResponse(rp);
+            if (validator == nil || ![validator isEqualToString:_validator] || contentLength != total) {
+                _segments = nil;
             }
+            _validator = validator;
+            contentLength = (unsigned long)total;
+            completionHandler(NSURLSessionResponseCancel);
+            // 探测请求到此为止，它随后的完成回调不再处理，startSegments 失败时只会结束一次
+            _probeTask = nil;
+            [self startSegments];
+            return;
+        }
+        
+        // 不支持 Range 或 If-Range 校验失败，直接使用这次的全量响应
+        _singleStream = YES;
+        _segments = nil;
+        [[NSFileManager defaultManager] removeItemAtPath:_manifestPath error:nil];
+        if (ftruncate(_fd, 0) != 0) {
+            completionHandler(NSURLSessionResponseCancel);
+            _segmentError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+            return;
+        }
+        receivedLength = 0;
+        contentLength = (unsigned long)[rp.allHeaderFields[@"Content-Length"] longLongValue];
+        completionHandler(NSURLSessionResponseAllow);
+        return;
+    }
+    
+    ZLDownloadSegment *segment = _segmentTasks[@(dataTask.taskIdentifier)];
+    if (!isPartial || start != segment.start + segment.receivedLength || end != segment.end || total != contentLength) {
+        // 资源在分段下载期间发生了变化，已下载的部分不再可信
+        _segments = nil;
+        completionHandler(NSURLSessionResponseCancel);
+        [self failSegmentsWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCannotParseResponse userInfo:nil]];
+        return;
+    }
+    completionHandler(NSURLSessionResponseAllow);
+}
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask
+    didReceiveData:(NSData *)data {
+    if (self.isCancelled) {
+        [dataTask cancel];
+        return;
+    }
+    
+    ZLDownloadSegment *segment = nil;
+    unsigned long long offset = receivedLength;
+    if (!_singleStream) {
+        segment = _segmentTasks[@(dataTask.taskIdentifier)];
+        if (segment == nil || segment.start + segment.receivedLength + data.length > segment.end + 1) {
+            [self failSegmentsWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCannotParseResponse userInfo:nil]];
+            return;
+        }
+        offset = segment.start + segment.receivedLength;
+    }
+    
+    int fd = _fd;
+    __block BOOL failed = NO;
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        if (!ZLWriteAtOffset(fd, bytes, byteRange.length, offset + byteRange.location)) {
+            failed = YES;
+            *stop = YES;
+        }
+    }];
+    if (failed) {
+        NSError *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+        if (_singleStream) {
+            _segmentError = error;
+            [dataTask cancel];
+        } else {
+            [self failSegmentsWithError:error];
+        }
+        return;
+    }
+    
+    segment.receivedLength += data.length;
+    receivedLength += data.length;
+    
+    if (segment != nil && (segment.isFinished || CFAbsoluteTimeGetCurrent() - _manifestSaveTime >= ZLDownloadManifestSaveInterval)) {
+        [self writeManifest];
+    }
+    
+    if (self.downloadProgressBlock && contentLength > 0) {
+        self.downloadProgressBlock(1.0 * receivedLength / contentLength);
+    }
+}
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task
+didCompleteWithError:(nullable NSError *)error {
+    if (task == _probeTask) {
+        _probeTask = nil;
+        if (_singleStream) {
+            error = _segmentError ?: error;
+            if (error == nil && receivedLength < contentLength) {
+                error = [NSError errorWithDomain:@"FILE IO Error" code:NSURLErrorCannotMoveFile userInfo:nil];
+            }
+            [self finishSegmentsWithError:error];
+        } else if (_segmentTasks == nil) {
+            // 探测请求本身失败
+            [self finishSegmentsWithError:error ?: [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadServerResponse userInfo:nil]];
+        }
+        return;
+    }
+    
+    ZLDownloadSegment *segment = _segmentTasks[@(task.taskIdentifier)];
+    if (segment == nil) {
+        return;
+    }
+    segment.task = nil;
+    [_segmentTasks removeObjectForKey:@(task.taskIdentifier)];
+    
+    if (error != nil) {
+        [self failSegmentsWithError:error];
+    } else if (!segment.isFinished) {
+        [self failSegmentsWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil]];
+    }
+    
+    if (_segmentTasks.count == 0) {
+        [self finishSegmentsWithError:_segmentError];
+    }
+}
+
+@end
+
+/// 下载调度：按优先级和 host 把 operation 交给 downloadQueue。
+/// 还没交出去的 operation 留在这里，可以调整优先级或直接移除；每个 host 同时进行的下载不超过 maxConcurrentCountPerHost
+@interface ZLDownloadScheduler : NSObject
+
+@property (atomic, assign) NSUInteger maxConcurrentCountPerHost;
+
+@property (atomic, copy) void (^queueWaitTimeBlock)(NSURL *url, ZLRequestPriority priority, NSTimeInterval queueWaitTime);
+
+- (instancetype)initWithOperationQueue:(NSOperationQueue *)operationQueue;
+
+- (void)addOperation:(ZLDownloadOperation *)operation;
+
+/// 只影响还在排队的 operation
+- (void)setPriority:(ZLRequestPriority)priority forOperation:(ZLDownloadOperation *)operation;
+
+/// 还在排队时移除并返回 YES，已经开始时返回 NO
+- (BOOL)removePendingOperation:(ZLDownloadOperation *)operation;
+
+@end
+
+@implementation ZLDownloadScheduler {
+    NSOperationQueue *_operationQueue;
+    /// 下标为优先级，每个数组从头部开始取
+    NSArray<NSMutableArray<ZLDownloadOperation *> *> *_pendingOperations;
+    NSCountedSet<NSString *> *_runningHosts;
+    NSUInteger _runningCount;
+}
+
+- (instancetype)initWithOperationQueue:(NSOperationQueue *)operationQueue {
+    if (self = [super init]) {
+        _operationQueue = operationQueue;
+        _pendingOperations = @[[NSMutableArray array], [NSMutableArray array], [NSMutableArray array]];
+        _runningHosts = [NSCountedSet set];
+        _maxConcurrentCountPerHost = 4;
+    }
+    return self;
+}
+
+static inline NSString * ZLDownloadHostForOperation(ZLDownloadOperation *operation) {
+    return operation.urlRequest.URL.host ?: @"";
+}
+
+static inline NSUInteger ZLDownloadPriorityIndex(ZLRequestPriority priority) {
+    return (NSUInteger)MAX(ZLRequestPriorityBackground, MIN(priority, ZLRequestPriorityVisible));
+}
+
+/// LIFO 的插到头部，FIFO 的排在末尾
+- (void)insertPendingOperation:(ZLDownloadOperation *)operation {
+    NSMutableArray<ZLDownloadOperation *> *operations = _pendingOperations[ZLDownloadPriorityIndex(operation.priority)];
+    if (operation.lifo) {
+        [operations insertObject:operation atIndex:0];
+    } else {
+        [operations addObject:operation];
+    }
+}
+
+- (void)addOperation:(ZLDownloadOperation *)operation {
+    operation.enqueueTime = CFAbsoluteTimeGetCurrent();
+    @synchronized (self) {
+        [self insertPendingOperation:operation];
+    }
+    [self schedule];
+}
+
+- (void)setPriority:(ZLRequestPriority)priority forOperation:(ZLDownloadOperation *)operation {
+    @synchronized (self) {
+        NSMutableArray<ZLDownloadOperation *> *operations = _pendingOperations[ZLDownloadPriorityIndex(operation.priority)];
+        NSUInteger index = [operations indexOfObjectIdenticalTo:operation];
+        operation.priority = priority;
+        if (index == NSNotFound) {
+            return;
+        }
+        [operations removeObjectAtIndex:index];
+        [self insertPendingOperation:operation];
+    }
+    [self schedule];
+}
+
+- (BOOL)removePendingOperation:(ZLDownloadOperation *)operation {
+    @synchronized (self) {
+        NSMutableArray<ZLDownloadOperation *> *operations = _pendingOperations[ZLDownloadPriorityIndex(operation.priority)];
+        NSUInteger index = [operations indexOfObjectIdenticalTo:operation];
+        if (index == NSNotFound) {
+            return NO;
+        }
+        [operations removeObjectAtIndex:index];
+        return YES;
+    }
+}
+
+/// 从高优先级到低优先级，取第一个 host 还有空闲连接的 operation
+- (ZLDownloadOperation *)dequeueOperation {
+    if (_runningCount >= (NSUInteger)MAX(_operationQueue.maxConcurrentOperationCount, 1)) {
+        return nil;
+    }
+    for (NSInteger priority = ZLRequestPriorityVisible; priority >= ZLRequestPriorityBackground; priority--) {
+        NSMutableArray<ZLDownloadOperation *> *operations = _pendingOperations[priority];
+        for (NSUInteger i = 0; i < operations.count; i++) {
+            ZLDownloadOperation *operation = operations[i];
+            NSString *host = ZLDownloadHostForOperation(operation);
+            if ([_runningHosts countForObject:host] < _maxConcurrentCountPerHost) {
+                [operations removeObjectAtIndex:i];
+                [_runningHosts addObject:host];
+                _runningCount++;
+                return operation;
+            }
+        }
+    }
+    return nil;
+}
+
+- (void)schedule {
+    NSMutableArray<ZLDownloadOperation *> *readyOperations = [NSMutableArray array];
+    @synchronized (self) {
+        ZLDownloadOperation *operation = nil;
+        while ((operation = [self dequeueOperation]) != nil) {
+            [readyOperations addObject:operation];
+        }
+    }
+    
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    void (^queueWaitTimeBlock)(NSURL *, ZLRequestPriority, NSTimeInterval) = self.queueWaitTimeBlock;
+    for (ZLDownloadOperation *operation in readyOperations) {
+        NSString *host = ZLDownloadHostForOperation(operation);
+        __weak typeof(self) weakSelf = self;
+        operation.completionBlock = ^{
+            [weakSelf operationDidFinishWithHost:host];
+        };
+        if (queueWaitTimeBlock) {
+            queueWaitTimeBlock(operation.urlRequest.URL, operation.priority, now - operation.enqueueTime);
+        }
+        [_operationQueue addOperation:operation];
+    }
+}
+
+- (void)operationDidFinishWithHost:(NSString *)host {
+    @synchronized (self) {
+        [_runningHosts removeObject:host];
+        _runningCount--;
+    }
+    [self schedule];
+}
+
+@end
+
+@class ZLCoalescedDataTask;
+
+/// 合并在一起的一组相同请求，共用一个 NSURLSessionDataTask，响应只解析一次
+@interface ZLCoalescedRequestGroup : NSObject
+
+@property (nonatomic, strong) NSURLSessionDataTask *task;
+
+@property (nonatomic, weak) NSOperationQueue *responseQueue;
+
+@property (nonatomic, copy) NSString *key;
+
+/// ZLURLSessionManager 中进行中的合并请求，先锁它再锁 group
+@property (nonatomic, weak) NSMutableDictionary<NSString *, ZLCoalescedRequestGroup *> *groups;
+
+- (void)addMember:(ZLCoalescedDataTask *)member;
+
+/// 成员全部取消后把自己从 groups 中移除并取消底层的 task，之后相同的请求会重新发起
+- (BOOL)removeMember:(ZLCoalescedDataTask *)member;
+
+/// 取出还在等待结果的成员，之后再取消不会产生影响
+- (NSArray<ZLCoalescedDataTask *> *)takeMembers;
+
+@end
+
+/// 返回给每个调用方的代理对象，除 cancel 外的消息都转发给共用的 task；
+/// cancel 只让自己收到取消错误，最后一个成员取消时才真正取消 task
+@interface ZLCoalescedDataTask : NSProxy
+
+@property (nonatomic, copy, readonly) void (^success)(NSHTTPURLResponse *urlResponse, id responseObject);
+
+@property (nonatomic, copy, readonly) void (^failure)(NSError *error);
+
+- (instancetype)initWithGroup:(ZLCoalescedRequestGroup *)group
+                      success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
+                      failure:(void (^)(NSError *error))failure;
+
+@end
+
+@implementation ZLCoalescedRequestGroup {
+    NSMutableArray<ZLCoalescedDataTask *> *_members;
+}
+
+- (instancetype)init {
+    if (self = [super init]) {
+        _members = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)addMember:(ZLCoalescedDataTask *)member {
+    @synchronized (self) {
+        [_members addObject:member];
+    }
+}
+
+- (BOOL)removeMember:(ZLCoalescedDataTask *)member {
+    BOOL removed = NO;
+    BOOL empty = NO;
+    NSMutableDictionary<NSString *, ZLCoalescedRequestGroup *> *groups = self.groups;
+    @synchronized (groups) {
+        @synchronized (self) {
+            NSUInteger index = [_members indexOfObjectIdenticalTo:member];
+            if (index != NSNotFound) {
+                [_members removeObjectAtIndex:index];
+                removed = YES;
+                empty = _members.count == 0;
+            }
+        }
+        if (empty && groups[self.key] == self) {
+            [groups removeObjectForKey:self.key];
+        }
+    }
+    if (empty) {
+        [self.task cancel];
+    }
+    return removed;
+}
+
+- (NSArray<ZLCoalescedDataTask *> *)takeMembers {
+    @synchronized (self) {
+        NSArray *members = [_members copy];
+        [_members removeAllObjects];
+        return members;
+    }
+}
+
+@end
+
+@implementation ZLCoalescedDataTask {
+    NSURLSessionDataTask *_task;
+    __weak ZLCoalescedRequestGroup *_group;
+}
+
+- (instancetype)initWithGroup:(ZLCoalescedRequestGroup *)group
+                      success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
+                      failure:(void (^)(NSError *error))failure {
+    _task = group.task;
+    _group = group;
+    _success = [success copy];
+    _failure = [failure copy];
+    return self;
+}
+
+- (void)cancel {
+    ZLCoalescedRequestGroup *group = _group;
+    if (![group removeMember:self]) {
+        return;
+    }
+    void (^failure)(NSError *error) = self.failure;
+    NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:@{NSURLErrorFailingURLErrorKey: _task.originalRequest.URL ?: [NSNull null]}];
+    [group.responseQueue addOperationWithBlock:^{
+        failure(error);
+    }];
+}
+
+- (id)forwardingTargetForSelector:(SEL)selector {
+    return _task;
+}
+
+- (NSMethodSignature *)methodSignatureForSelector:(SEL)selector {
+    return [_task methodSignatureForSelector:selector];
+}
+
+- (void)forwardInvocation:(NSInvocation *)invocation {
+    [invocation invokeWithTarget:_task];
+}
+
+- (BOOL)respondsToSelector:(SEL)selector {
+    return [_task respondsToSelector:selector];
+}
+
+- (BOOL)isKindOfClass:(Class)aClass {
+    return [_task isKindOfClass:aClass];
+}
+
+- (BOOL)isMemberOfClass:(Class)aClass {
+    return [_task isMemberOfClass:aClass];
+}
+
+- (BOOL)conformsToProtocol:(Protocol *)aProtocol {
+    return [_task conformsToProtocol:aProtocol];
+}
+
+- (NSString *)description {
+    return [_task description];
+}
+
+- (NSString *)debugDescription {
+    return [_task debugDescription];
+}
+
+@end
+
+/// 响应缓存请求返回给调用方的 task。缓存在后台查找，查完之前真正的请求还没有创建，这期间转发给一个不会启动的占位 task；
+/// 命中新鲜缓存时不会发出请求，304 需要无条件重试时会换成新的 task
+@interface ZLCachedDataTask : NSProxy
+
+- (instancetype)initWithPlaceholderTask:(NSURLSessionDataTask *)placeholderTask
+                          responseQueue:(NSOperationQueue *)responseQueue
+                                failure:(void (^)(NSError *error))failure;
+
+/// 缓存查找结束时调用，返回 NO 表示调用方已经取消，不要再回调；之后的取消只作用于真正的请求
+- (BOOL)finishLookup;
+
+/// 换成真正的请求：调用方已经 resume 过时立即开始，已经取消时直接取消
+- (void)startTask:(NSURLSessionDataTask *)task;
+
+@end
+
+@implementation ZLCachedDataTask {
+    NSURLSessionDataTask *_placeholderTask;
+    NSURLSessionDataTask *_task;
+    __weak NSOperationQueue *_responseQueue;
+    void (^_failure)(NSError *error);
+    BOOL _lookupFinished;
+    BOOL _resumed;
+    BOOL _cancelled;
+}
+
+- (instancetype)initWithPlaceholderTask:(NSURLSessionDataTask *)placeholderTask
+                          responseQueue:(NSOperationQueue *)responseQueue
+                                failure:(void (^)(NSError *error))failure {
+    _placeholderTask = placeholderTask;
+    _responseQueue = responseQueue;
+    _failure = [failure copy];
+    return self;
+}
+
+- (NSURLSessionDataTask *)currentTask {
+    @synchronized (self) {
+        return _task ?: _placeholderTask;
+    }
+}
+
+- (BOOL)finishLookup {
+    @synchronized (self) {
+        if (_cancelled) {
+            return NO;
+        }
+        _lookupFinished = YES;
+        return YES;
+    }
+}
+
+- (void)startTask:(NSURLSessionDataTask *)task {
+    BOOL resumed = NO, cancelled = NO;
+    @synchronized (self) {
+        _task = task;
+        resumed = _resumed;
+        cancelled = _cancelled;
+    }
+    if (cancelled) {
+        [task cancel];
+    } else if (resumed) {
+        [task resume];
+    }
+}
+
+- (void)resume {
+    NSURLSessionDataTask *task = nil;
+    @synchronized (self) {
+        _resumed = YES;
+        task = _task;
+    }
+    [task resume];
+}
+
+- (void)cancel {
+    NSURLSessionDataTask *task = nil;
+    BOOL notifies = NO;
+    @synchronized (self) {
+        notifies = !_cancelled && !_lookupFinished;
+        _cancelled = YES;
+        task = _task;
+    }
+    [task cancel];
+    if (!notifies || _failure == nil) {
+        return;
+    }
+    // 还在查缓存，没有请求可以取消，直接按取消失败回调
+    void (^failure)(NSError *error) = _failure;
+    NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:@{NSURLErrorFailingURLErrorKey: _placeholderTask.originalRequest.URL ?: [NSNull null]}];
+    [_responseQueue addOperationWithBlock:^{
+        failure(error);
+    }];
+}
+
+- (id)forwardingTargetForSelector:(SEL)selector {
+    return [self currentTask];
+}
+
+- (NSMethodSignature *)methodSignatureForSelector:(SEL)selector {
+    return [[self currentTask] methodSignatureForSelector:selector];
+}
+
+- (void)forwardInvocation:(NSInvocation *)invocation {
+    [invocation invokeWithTarget:[self currentTask]];
+}
+
+- (BOOL)respondsToSelector:(SEL)selector {
+    return [[self currentTask] respondsToSelector:selector];
+}
+
+- (BOOL)isKindOfClass:(Class)aClass {
+    return [[self currentTask] isKindOfClass:aClass];
+}
+
+- (BOOL)isMemberOfClass:(Class)aClass {
+    return [[self currentTask] isMemberOfClass:aClass];
+}
+
+- (BOOL)conformsToProtocol:(Protocol *)aProtocol {
+    return [[self currentTask] conformsToProtocol:aProtocol];
+}
+
+- (NSString *)description {
+    return [[self currentTask] description];
+}
+
+- (NSString *)debugDescription {
+    return [[self currentTask] debugDescription];
+}
+
+@end
+
+@interface ZLURLSessionManager ()
+
+@property (nonatomic, strong) NSURLSessionConfiguration *configuration;
+
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSURLSession *> *urlSessionCaches;
+
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSURLSession *> *incrementalURLSessionCaches;
+
+@property (nonatomic, strong) NSOperationQueue *responseQueue;
+
+@property (nonatomic, strong) NSOperationQueue *downloadQueue;
+
+@property (nonatomic, strong) ZLDownloadScheduler *downloadScheduler;
+
+@property (nonatomic, strong) NSMutableDictionary<NSURL *, ZLDownloadOperation *> *downloadItems;
+
+@property (nonatomic, strong) ZLHTTPResponseCache *responseCache;
+
+/// 进行中的合并请求，以自身加锁
+@property (nonatomic, strong) NSMutableDictionary<NSString *, ZLCoalescedRequestGroup *> *coalescedRequestGroups;
+
+@property (nonatomic, copy, readwrite) NSString *workspaceDirURLString;
+
+@end
+
+@implementation ZLURLSessionManager
+
+- (ZLHTTPResponseCache *)responseCache {
+    @synchronized (self) {
+        if (_responseCache == nil) {
+            NSString *directory = [self.workspaceDirURLString stringByAppendingPathComponent:@"responses"];
+            _responseCache = [[ZLHTTPResponseCache alloc] initWithDirectory:directory memoryCapacity:4 * 1024 * 1024 diskCapacity:50 * 1024 * 1024];
+        }
+        return _responseCache;
+    }
+}
+
+- (NSUInteger)responseCacheMemoryCapacity {
+    return self.responseCache.memoryCapacity;
+}
+
+- (void)setResponseCacheMemoryCapacity:(NSUInteger)responseCacheMemoryCapacity {
+    self.responseCache.memoryCapacity = responseCacheMemoryCapacity;
+}
+
+- (NSUInteger)responseCacheDiskCapacity {
+    return self.responseCache.diskCapacity;
+}
+
+- (void)setResponseCacheDiskCapacity:(NSUInteger)responseCacheDiskCapacity {
+    self.responseCache.diskCapacity = responseCacheDiskCapacity;
+}
+
++ (instancetype)shared {
+    static ZLURLSessionManager *manager = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        manager = [self new];
+    });
+    return manager;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _timeoutIntervalForRequest = 10;
+        _urlSessionCaches = [NSMutableDictionary dictionary];
+        _incrementalURLSessionCaches = [NSMutableDictionary dictionary];
+        _downloadItems = [NSMutableDictionary dictionary];
+        _coalescedRequestGroups = [NSMutableDictionary dictionary];
+        _responseQueue = [[NSOperationQueue alloc] init];
+        _responseQueue.maxConcurrentOperationCount = countOfCores();
+        _downloadQueue = [[NSOperationQueue alloc] init];
+        _downloadQueue.maxConcurrentOperationCount = _responseQueue.maxConcurrentOperationCount;
+        _downloadScheduler = [[ZLDownloadScheduler alloc] initWithOperationQueue:_downloadQueue];
+        _reachablity = [ZHLReachability reachabilityWithHostName:@"www.apple.com"];
+        _workspaceDirURLString = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES).firstObject stringByAppendingPathComponent:@"ZHLNetworking"];
+        
+        NSString *downloadTemp = [_workspaceDirURLString stringByAppendingPathComponent:@"temp"];
+        
+        BOOL isDir = NO;
+        if (![[NSFileManager defaultManager] fileExistsAtPath:downloadTemp isDirectory:&isDir] || !isDir) {
+            if (![[NSFileManager defaultManager] createDirectoryAtPath:downloadTemp withIntermediateDirectories:YES attributes:nil error:nil]) {
+                NSLog(@"file system error");
+            }
+        }
+        
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+            [ZLURLSessionManager removeFilesInDirPath:downloadTemp notModifiedSince:[NSDate dateWithTimeIntervalSinceNow:-ZLDownloadTempFileMaxAge]];
+        });
+    }
+    return self;
+}
+
+- (NSURLSessionConfiguration *)configuration {
+    if (_configuration == nil) {
+        @synchronized (self) {
+            if (_configuration == nil) {
+                _configuration = [NSURLSessionConfiguration defaultSessionConfiguration];
+                _configuration.timeoutIntervalForResource = 10;
+                
+                _configuration.allowsCellularAccess = YES;
+                
+                if (@available(iOS 11.0, *)) {
+                    _configuration.waitsForConnectivity = YES;
+                } else {
+                    // Fallback on earlier versions
+                }
+            }
+        }
+    }
+    
+    _configuration.connectionProxyDictionary = self.connectionProxyDictionary;
+    
+    _configuration.timeoutIntervalForRequest = self.timeoutIntervalForRequest;
+    
+    return _configuration;
+}
+
+- (NSURLSession *)getAvaliableURLSessionWithURL:(NSURL *)url {
+    NSURLSession *urlSession = self.urlSessionCaches[url.host];
+    if (urlSession == nil) {
+        @synchronized (self) {
+            if (urlSession == nil) {
+                NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+                queue.maxConcurrentOperationCount = 1;
+                urlSession = [NSURLSession sessionWithConfiguration:self.configuration delegate:[[ZLSessionDelegate alloc] init] delegateQueue:queue];
+                self.urlSessionCaches[url.host] = urlSession;
+            }
+        }
+    }
+    return urlSession;
+}
+
+- (NSURLSession *)getAvaliableIncrementalURLSessionWithURL:(NSURL *)url {
+    @synchronized (self) {
+        NSURLSession *urlSession = self.incrementalURLSessionCaches[url.host];
+        if (urlSession == nil) {
+            NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+            queue.maxConcurrentOperationCount = 1;
+            ZLIncrementalSessionDelegate *delegate = [[ZLIncrementalSessionDelegate alloc] init];
+            delegate.responseQueue = self.responseQueue;
+            urlSession = [NSURLSession sessionWithConfiguration:self.configuration delegate:delegate delegateQueue:queue];
+            self.incrementalURLSessionCaches[url.host] = urlSession;
+        }
+        return urlSession;
+    }
+}
+
+/// Json/Xml 响应在开启 parsesResponseIncrementally 或传入 elementBlock 时边接收边解析，其余情况收完再解析；返回的 task 需要调用方 resume
+- (NSURLSessionDataTask *)dataTaskWithRequest:(NSURLRequest *)urlRequest
+                             responseBodyType:(ZLResponseBodyType)responseBodyType
+                                      element:(void (^)(id element))elementBlock
+                                      success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
+                                      failure:(void (^)(NSError *error))failure {
+    if ((self.parsesResponseIncrementally || elementBlock != nil) &&
+        (responseBodyType == ZLResponseBodyTypeJson || responseBodyType == ZLResponseBodyTypeXml)) {
+        NSURLSession *urlSession = [self getAvaliableIncrementalURLSessionWithURL:urlRequest.URL];
+        NSURLSessionDataTask *task = [urlSession dataTaskWithRequest:urlRequest];
+        ZLIncrementalResponseTask *responseTask = [[ZLIncrementalResponseTask alloc] initWithResponseBodyType:responseBodyType element:elementBlock];
+        responseTask.success = success;
+        responseTask.failure = failure;
+        [(ZLIncrementalSessionDelegate *)urlSession.delegate addResponseTask:responseTask forTask:task];
+        return task;
+    }
+    
+    NSURLSession *urlSession = [self getAvaliableURLSessionWithURL:urlRequest.URL];
+    __weak typeof(self) weakSelf = self;
+    return [urlSession dataTaskWithRequest:urlRequest completionHandler:^(NSData * _Nullable data, NSURLResponse * _Nullable response, NSError * _Nullable error) {
+        [weakSelf.responseQueue addOperationWithBlock:^{
+            if (error != nil) {
+                failure(error);
+                return;
+            }
+            
+            id res = ZLParseResponseBody(responseBodyType, data);
+            if (res == nil) {
+                failure([NSError errorWithDomain:@"data error" code:-999999 userInfo:nil]);
+                return;
+            }
+            success((NSHTTPURLResponse *)response, res);
+        }];
+    }];
+}
+
+/// method + URL + 全部请求头 + 响应类型相同的请求视为相同
+static NSString * ZLCoalescingKeyForRequest(NSURLRequest *urlRequest, ZLResponseBodyType responseBodyType) {
+    NSMutableString *key = [NSMutableString stringWithFormat:@"%ld %@ %@", (long)responseBodyType, urlRequest.HTTPMethod, urlRequest.URL.absoluteString];
+    NSDictionary<NSString *, NSString *> *headers = urlRequest.allHTTPHeaderFields;
+    for (NSString *field in [headers.allKeys sortedArrayUsingSelector:@selector(caseInsensitiveCompare:)]) {
+        [key appendFormat:@"\n%@: %@", field.lowercaseString, headers[field]];
+    }
+    return key;
+}
+
+/// 相同的请求进行中时挂到已有的 task 上，返回每个调用方各自的 ZLCoalescedDataTask；返回的 task 需要调用方 resume
+- (NSURLSessionDataTask *)coalescedDataTaskWithRequest:(NSURLRequest *)urlRequest
+                                      responseBodyType:(ZLResponseBodyType)responseBodyType
+                                               success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
+                                               failure:(void (^)(NSError *error))failure {
+    NSString *key = ZLCoalescingKeyForRequest(urlRequest, responseBodyType);
+    @synchronized (self.coalescedRequestGroups) {
+        ZLCoalescedRequestGroup *group = self.coalescedRequestGroups[key];
+        if (group == nil) {
+            group = [[ZLCoalescedRequestGroup alloc] init];
+            group.responseQueue = self.responseQueue;
+            group.key = key;
+            group.groups = self.coalescedRequestGroups;
+            
+            NSURLSession *urlSession = [self getAvaliableURLSessionWithURL:urlRequest.URL];
+            __weak typeof(self) weakSelf = self;
+            __weak ZLCoalescedRequestGroup *weakGroup = group;
+            group.task = [urlSession dataTaskWithRequest:urlRequest completionHandler:^(NSData * _Nullable data, NSURLResponse * _Nullable response, NSError * _Nullable error) {
+                __strong typeof(weakSelf) strongSelf = weakSelf;
+                ZLCoalescedRequestGroup *strongGroup = weakGroup;
+                NSArray<ZLCoalescedDataTask *> *members = nil;
+                @synchronized (strongSelf.coalescedRequestGroups) {
+                    if (strongGroup != nil && strongSelf.coalescedRequestGroups[key] == strongGroup) {
+                        [strongSelf.coalescedRequestGroups removeObjectForKey:key];
+                    }
+                    members = [strongGroup takeMembers];
+                }
+                if (members.count == 0) {
+                    return;
+                }
+                
+                [strongSelf.responseQueue addOperationWithBlock:^{
+                    if (error != nil) {
+                        for (ZLCoalescedDataTask *member in members) {
+                            member.failure(error);
+                        }
+                        return;
+                    }
+                    
+                    id res = ZLParseSharedResponseBody(responseBodyType, data);
+                    for (ZLCoalescedDataTask *member in members) {
+                        if (res == nil) {
+                            member.failure([NSError errorWithDomain:@"data error" code:-999999 userInfo:nil]);
+                        } else {
+                            member.success((NSHTTPURLResponse *)response, res);
+                        }
+                    }
+                }];
+            }];
+            self.coalescedRequestGroups[key] = group;
         }
+        
+        ZLCoalescedDataTask *member = [[ZLCoalescedDataTask alloc] initWithGroup:group success:success failure:failure];
+        [group addMember:member];
+        return (NSURLSessionDataTask *)member;
     }
-    return self;
 }
 
-- (NSURLSessionConfiguration *)configuration {
-    if (_configuration == nil) {
-        @synchronized (self) {
-            if (_configuration == nil) {
-                _configuration = [NSURLSessionConfiguration defaultSessionConfiguration];
-                _configuration.timeoutIntervalForResource = 10;
-                
-                _configuration.allowsCellularAccess = YES;
-                
-                if (@available(iOS 11.0, *)) {
-                    _configuration.waitsForConnectivity = YES;
-                } else {
-                    // Fallback on earlier versions
+/// 响应缓存的请求路径，总是收完整个响应再解析，以便写入缓存；返回的 task 需要调用方 resume。
+/// 缓存在后台查找，不阻塞调用线程；命中新鲜缓存时不会发出请求
+- (NSURLSessionDataTask *)cachedDataTaskWithRequest:(NSMutableURLRequest *)urlRequest
+                                   responseBodyType:(ZLResponseBodyType)responseBodyType
+                                        cachePolicy:(ZLRequestCachePolicy)cachePolicy
+                                            success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
+                                            failure:(void (^)(NSError *error))failure {
+    // 条件请求由这里自己发，不让系统的 NSURLCache 介入，否则 304 会被系统直接换成它自己缓存的内容
+    urlRequest.cachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+    NSURLRequest *cacheKeyRequest = [urlRequest copy];
+    NSURLSession *urlSession = [self getAvaliableURLSessionWithURL:cacheKeyRequest.URL];
+    ZLCachedDataTask *cachedTask = [[ZLCachedDataTask alloc] initWithPlaceholderTask:[urlSession dataTaskWithRequest:cacheKeyRequest]
+                                                                       responseQueue:self.responseQueue
+                                                                             failure:failure];
+    __weak typeof(self) weakSelf = self;
+    [self.responseCache cachedResponseForRequest:cacheKeyRequest completionHandler:^(ZLHTTPCachedResponse *cachedResponse) {
+        __strong typeof(weakSelf) strongSelf = weakSelf;
+        if (strongSelf == nil || ![cachedTask finishLookup]) {
+            return;
+        }
+        
+        void (^requestSuccess)(NSHTTPURLResponse *, id) = success;
+        void (^requestFailure)(NSError *) = failure;
+        BOOL fresh = cachedResponse.isFresh;
+        if (cachedResponse != nil &&
+            (fresh || (cachePolicy == ZLRequestCachePolicyStaleWhileRevalidate && !cachedResponse.requiresRevalidation))) {
+            [strongSelf.responseQueue addOperationWithBlock:^{
+                id res = ZLParseResponseBody(responseBodyType, cachedResponse.data);
+                if (res == nil) {
+                    failure([NSError errorWithDomain:@"data error" code:-999999 userInfo:nil]);
+                    return;
                 }
+                success(cachedResponse.response, res);
+            }];
+            if (fresh) {
+                return;
             }
+            // 已经回调过，后台验证只更新缓存
+            requestSuccess = nil;
+            requestFailure = nil;
         }
-    }
-    
-    _configuration.connectionProxyDictionary = self.connectionProxyDictionary;
-    
-    _configuration.timeoutIntervalForRequest = self.timeoutIntervalForRequest;
-    
-    return _configuration;
+        
+        NSMutableURLRequest *request = [cacheKeyRequest mutableCopy];
+        if (cachedResponse != nil) {
+            [ZLHTTPResponseCache addConditionalHeadersFromCachedResponse:cachedResponse toRequest:request];
+        }
+        [cachedTask startTask:[strongSelf responseCacheTaskWithRequest:request
+                                                       cacheKeyRequest:cacheKeyRequest
+                                                        cachedResponse:cachedResponse
+                                                            urlSession:urlSession
+                                                            cachedTask:cachedTask
+                                                      responseBodyType:responseBodyType
+                                                               success:requestSuccess
+                                                               failure:requestFailure]];
+    }];
+    return (NSURLSessionDataTask *)cachedTask;
 }
 
-- (NSURLSession *)getAvaliableURLSessionWithURL:(NSURL *)url {
-    NSURLSession *urlSession = self.urlSessionCaches[url.host];
-    if (urlSession == nil) {
-        @synchronized (self) {
-            if (urlSession == nil) {
-                NSOperationQueue *queue = [[NSOperationQueue alloc] init];
-                queue.maxConcurrentOperationCount = 1;
-                urlSession = [NSURLSession sessionWithConfiguration:self.configuration delegate:nil delegateQueue:queue];
-                self.urlSessionCaches[url.host] = urlSession;
+/// 304 时用缓存的正文回调；没有缓存却收到 304（调用方自己带了条件头，或者中间代理返回的）时，
+/// 去掉条件头无条件重试一次，重试仍是 304 时按错误的响应处理
+- (NSURLSessionDataTask *)responseCacheTaskWithRequest:(NSURLRequest *)request
+                                       cacheKeyRequest:(NSURLRequest *)cacheKeyRequest
+                                        cachedResponse:(ZLHTTPCachedResponse *)cachedResponse
+                                            urlSession:(NSURLSession *)urlSession
+                                            cachedTask:(ZLCachedDataTask *)cachedTask
+                                      responseBodyType:(ZLResponseBodyType)responseBodyType
+                                               success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
+                                               failure:(void (^)(NSError *error))failure {
+    ZLHTTPResponseCache *responseCache = self.responseCache;
+    __weak typeof(self) weakSelf = self;
+    // cachedTask 持有这里创建的 task，反过来只能弱引用
+    __weak ZLCachedDataTask *weakCachedTask = cachedTask;
+    return [urlSession dataTaskWithRequest:request completionHandler:^(NSData * _Nullable data, NSURLResponse * _Nullable response, NSError * _Nullable error) {
+        __strong typeof(weakSelf) strongSelf = weakSelf;
+        NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse *)response;
+        if (error == nil && httpResponse.statusCode == 304 && cachedResponse == nil) {
+            NSMutableURLRequest *unconditionalRequest = [request mutableCopy];
+            [ZLHTTPResponseCache removeConditionalHeadersFromRequest:unconditionalRequest];
+            if (![unconditionalRequest.allHTTPHeaderFields isEqualToDictionary:request.allHTTPHeaderFields] && strongSelf != nil) {
+                ZLCachedDataTask *strongCachedTask = weakCachedTask;
+                NSURLSessionDataTask *retryTask = [strongSelf responseCacheTaskWithRequest:unconditionalRequest
+                                                                           cacheKeyRequest:cacheKeyRequest
+                                                                            cachedResponse:nil
+                                                                                urlSession:urlSession
+                                                                                cachedTask:strongCachedTask
+                                                                          responseBodyType:responseBodyType
+                                                                                   success:success
+                                                                                   failure:failure];
+                if (strongCachedTask != nil) {
+                    [strongCachedTask startTask:retryTask];
+                } else {
+                    [retryTask resume];
+                }
+                return;
             }
+            error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorBadServerResponse userInfo:@{NSURLErrorFailingURLErrorKey: request.URL ?: [NSNull null]}];
         }
-    }
-    return urlSession;
+        
+        [strongSelf.responseQueue addOperationWithBlock:^{
+            if (error != nil) {
+                if (failure) {
+                    failure(error);
+                }
+                return;
+            }
+            
+            NSHTTPURLResponse *finalResponse = httpResponse;
+            NSData *responseData = data;
+            if (httpResponse.statusCode == 304) {
+                ZLHTTPCachedResponse *refreshedResponse = [responseCache cachedResponse:cachedResponse refreshedWithNotModifiedResponse:httpResponse forRequest:cacheKeyRequest];
+                finalResponse = refreshedResponse.response;
+                responseData = refreshedResponse.data;
+            } else {
+                [responseCache storeResponse:httpResponse data:data forRequest:cacheKeyRequest];
+            }
+            
+            if (success == nil) {
+                return;
+            }
+            id res = ZLParseResponseBody(responseBodyType, responseData);
+            if (res == nil) {
+                failure([NSError errorWithDomain:@"data error" code:-999999 userInfo:nil]);
+                return;
+            }
+            success(finalResponse, res);
+        }];
+    }];
 }
 
 - (NSMutableURLRequest *)createURLRequestWithURL:(NSURL *)url
@@ -630,6 +2407,8 @@ didCompleteWithError:(nullable NSError *)error {
                                               parameters:(id)parameters
                                                  headers:(NSDictionary <NSString *, NSString *> *)headers
                                         responseBodyType:(ZLResponseBodyType)responseBodyType
+                                                 element:(void (^)(id element))elementBlock
+                                             cachePolicy:(ZLRequestCachePolicy)cachePolicy
                                                  success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
                                                  failure:(void (^)(NSError *error))failure {
     NSURL *url = nil;
@@ -652,27 +2431,34 @@ didCompleteWithError:(nullable NSError *)error {
     
     NSParameterAssert(url != nil);
     
-    NSURLSession *urlSession = [self getAvaliableURLSessionWithURL:url];
-    
     NSMutableURLRequest *urlRequest = [self createURLRequestWithURL:url headers:headers];
     urlRequest.HTTPMethod = httpMethod;
     
-    __weak typeof(self) weakSelf = self;
-    NSURLSessionDataTask *task = [urlSession dataTaskWithRequest:urlRequest completionHandler:^(NSData * _Nullable data, NSURLResponse * _Nullable response, NSError * _Nullable error) {
-        [weakSelf.responseQueue addOperationWithBlock:^{
-            if (error != nil) {
-                failure(error);
-                return;
-            }
-            
-            id res = ZLParseResponseBody(responseBodyType, data);
-            if (res == nil) {
-                failure([NSError errorWithDomain:@"data error" code:-999999 userInfo:nil]);
-                return;
-            }
-            success((NSHTTPURLResponse *)response, res);
-        }];
-    }];
+    if (self.coalescesIdenticalRequests && elementBlock == nil && cachePolicy == ZLRequestCachePolicyNone &&
+        ([httpMethod isEqualToString:@"GET"] || [httpMethod isEqualToString:@"HEAD"])) {
+        NSURLSessionDataTask *task = [self coalescedDataTaskWithRequest:urlRequest
+                                                       responseBodyType:responseBodyType
+                                                                success:success
+                                                                failure:failure];
+        [task resume];
+        return task;
+    }
+    
+    if (cachePolicy != ZLRequestCachePolicyNone && [httpMethod isEqualToString:@"GET"]) {
+        NSURLSessionDataTask *task = [self cachedDataTaskWithRequest:urlRequest
+                                                    responseBodyType:responseBodyType
+                                                         cachePolicy:cachePolicy
+                                                             success:success
+                                                             failure:failure];
+        [task resume];
+        return task;
+    }
+    
+    NSURLSessionDataTask *task = [self dataTaskWithRequest:urlRequest
+                                          responseBodyType:responseBodyType
+                                                   element:elementBlock
+                                                   success:success
+                                                   failure:failure];
     [task resume];
     return task;
 }
@@ -688,6 +2474,44 @@ didCompleteWithError:(nullable NSError *)error {
                                      parameters:parameters
                                         headers:headers
                                responseBodyType:responseBodyType
+                                        element:nil
+                                    cachePolicy:ZLRequestCachePolicyNone
+                                        success:success
+                                        failure:failure];
+}
+
+- (NSURLSessionDataTask *)GET:(NSString *)URLString
+                   parameters:(id)parameters
+                      headers:(NSDictionary <NSString *, NSString *> *)headers
+             responseBodyType:(ZLResponseBodyType)responseBodyType
+                      element:(void (^)(id element))elementBlock
+                      success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
+                      failure:(void (^)(NSError *error))failure {
+    return [self privateHandleRequestExceptPOST:@"GET"
+                                      urlString:URLString
+                                     parameters:parameters
+                                        headers:headers
+                               responseBodyType:responseBodyType
+                                        element:elementBlock
+                                    cachePolicy:ZLRequestCachePolicyNone
+                                        success:success
+                                        failure:failure];
+}
+
+- (NSURLSessionDataTask *)GET:(NSString *)URLString
+                   parameters:(id)parameters
+                      headers:(NSDictionary <NSString *, NSString *> *)headers
+             responseBodyType:(ZLResponseBodyType)responseBodyType
+                  cachePolicy:(ZLRequestCachePolicy)cachePolicy
+                      success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
+                      failure:(void (^)(NSError *error))failure {
+    return [self privateHandleRequestExceptPOST:@"GET"
+                                      urlString:URLString
+                                     parameters:parameters
+                                        headers:headers
+                               responseBodyType:responseBodyType
+                                        element:nil
+                                    cachePolicy:cachePolicy
                                         success:success
                                         failure:failure];
 }
@@ -703,6 +2527,8 @@ didCompleteWithError:(nullable NSError *)error {
                                      parameters:parameters
                                         headers:headers
                                responseBodyType:responseBodyType
+                                        element:nil
+                                    cachePolicy:ZLRequestCachePolicyNone
                                         success:success
                                         failure:failure];
 }
@@ -718,6 +2544,8 @@ didCompleteWithError:(nullable NSError *)error {
                                      parameters:parameters
                                         headers:headers
                                responseBodyType:responseBodyType
+                                        element:nil
+                                    cachePolicy:ZLRequestCachePolicyNone
                                         success:success
                                         failure:failure];
 }
@@ -733,6 +2561,8 @@ didCompleteWithError:(nullable NSError *)error {
                                      parameters:parameters
                                         headers:headers
                                responseBodyType:responseBodyType
+                                        element:nil
+                                    cachePolicy:ZLRequestCachePolicyNone
                                         success:success
                                         failure:failure];
 }
@@ -748,6 +2578,8 @@ didCompleteWithError:(nullable NSError *)error {
                                      parameters:parameters
                                         headers:headers
                                responseBodyType:responseBodyType
+                                        element:nil
+                                    cachePolicy:ZLRequestCachePolicyNone
                                         success:success
                                         failure:failure];
 }
@@ -763,6 +2595,8 @@ didCompleteWithError:(nullable NSError *)error {
                                      parameters:parameters
                                         headers:headers
                                responseBodyType:responseBodyType
+                                        element:nil
+                                    cachePolicy:ZLRequestCachePolicyNone
                                         success:success
                                         failure:failure];
 }
@@ -778,6 +2612,8 @@ didCompleteWithError:(nullable NSError *)error {
                                      parameters:parameters
                                         headers:headers
                                responseBodyType:responseBodyType
+                                        element:nil
+                                    cachePolicy:ZLRequestCachePolicyNone
                                         success:success
                                         failure:failure];
 }
@@ -793,6 +2629,8 @@ didCompleteWithError:(nullable NSError *)error {
                                      parameters:parameters
                                         headers:headers
                                responseBodyType:responseBodyType
+                                        element:nil
+                                    cachePolicy:ZLRequestCachePolicyNone
                                         success:success
                                         failure:failure];
 }
@@ -825,8 +2663,6 @@ didCompleteWithError:(nullable NSError *)error {
     
     NSParameterAssert(url != nil);
     
-    NSURLSession *urlSession = [self getAvaliableURLSessionWithURL:url];
-    
     NSMutableURLRequest *urlRequest = [self createURLRequestWithURL:url headers:headers];
     urlRequest.HTTPMethod = @"POST";
     if (bodyParameters != nil) {
@@ -862,25 +2698,24 @@ didCompleteWithError:(nullable NSError *)error {
                     [urlRequest setValue:@"application/xml" forHTTPHeaderField:@"Content-Type"];
                 }
             }
+        } else if (requestBodyType == ZLRequestBodyTypeMessagePack || requestBodyType == ZLRequestBodyTypeCBOR) {
+            if ([bodyParameters isKindOfClass:[NSDictionary class]] ||
+                [bodyParameters isKindOfClass:[NSArray class]]) {
+                BOOL isMessagePack = requestBodyType == ZLRequestBodyTypeMessagePack;
+                NSError *error = nil;
+                urlRequest.HTTPBody = isMessagePack ? [ZLMessagePackSerialization dataWithObject:bodyParameters error:&error] : [ZLCBORSerialization dataWithObject:bodyParameters error:&error];
+                if (error == nil) {
+                    [urlRequest setValue:isMessagePack ? @"application/x-msgpack" : @"application/cbor" forHTTPHeaderField:@"Content-Type"];
+                }
+            }
         }
     }
     
-    __weak typeof(self) weakSelf = self;
-    NSURLSessionDataTask *task = [urlSession dataTaskWithRequest:urlRequest completionHandler:^(NSData * _Nullable data, NSURLResponse * _Nullable response, NSError * _Nullable error) {
-        [weakSelf.responseQueue addOperationWithBlock:^{
-            if (error != nil) {
-                failure(error);
-                return;
-            }
-            
-            id res = ZLParseResponseBody(responseBodyType, data);
-            if (res == nil) {
-                failure([NSError errorWithDomain:@"data error" code:-999999 userInfo:nil]);
-                return;
-            }
-            success((NSHTTPURLResponse *)response, res);
-        }];
-    }];
+    NSURLSessionDataTask *task = [self dataTaskWithRequest:urlRequest
+                                          responseBodyType:responseBodyType
+                                                   element:nil
+                                                   success:success
+                                                   failure:failure];
     [task resume];
     return task;
 }
@@ -892,6 +2727,24 @@ constructingBodyWithBlock:(void (^)(ZLMultipartFormData *formData))block
 responseBodyType:(ZLResponseBodyType)responseBodyType
      success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
      failure:(void (^)(NSError *error))failure {
+    [self POST:URLString
+    parameters:parameters
+constructingBodyWithBlock:block
+       headers:headers
+responseBodyType:responseBodyType
+      progress:nil
+       success:success
+       failure:failure];
+}
+
+- (void)POST:(NSString *)URLString
+  parameters:(id)parameters
+constructingBodyWithBlock:(void (^)(ZLMultipartFormData *formData))block
+     headers:(NSDictionary <NSString *, NSString *> *)headers
+responseBodyType:(ZLResponseBodyType)responseBodyType
+    progress:(void (^)(float uploadProgress))uploadProgressBlock
+     success:(void (^)(NSHTTPURLResponse *urlResponse, id responseObject))success
+     failure:(void (^)(NSError *error))failure {
     NSURL *url = nil;
     if (parameters != nil) {
         NSString *queryString = [self getURLQueryWithParameters:parameters];
@@ -912,8 +2765,6 @@ responseBodyType:(ZLResponseBodyType)responseBodyType
     
     NSParameterAssert(url != nil);
     
-    NSURLSession *urlSession = [self getAvaliableURLSessionWithURL:url];
-    
     __block NSMutableURLRequest *urlRequest = [self createURLRequestWithURL:url headers:headers];
     urlRequest.HTTPMethod = @"POST";
     
@@ -925,28 +2776,21 @@ responseBodyType:(ZLResponseBodyType)responseBodyType
         block(formData);
         
         [formData finalData];
-        urlRequest.HTTPBody = formData.data;
+        urlRequest.HTTPBodyStream = [formData bodyStreamWithProgress:uploadProgressBlock];
         
         [urlRequest setValue:[NSString stringWithFormat:@"multipart/form-data; boundary=%@", boundary]
           forHTTPHeaderField:@"Content-Type"];
-        [urlRequest setValue:@(urlRequest.HTTPBody.length).stringValue
+        [urlRequest setValue:@(formData.contentLength).stringValue
           forHTTPHeaderField:@"Content-Length"];
                         
-        NSURLSessionDataTask *task = [urlSession dataTaskWithRequest:urlRequest completionHandler:^(NSData * _Nullable data, NSURLResponse * _Nullable response, NSError * _Nullable error) {
-            [weakSelf.responseQueue addOperationWithBlock:^{
-                if (error != nil) {
-                    failure(error);
-                    return;
-                }
-                
-                id res = ZLParseResponseBody(responseBodyType, data);
-                if (res == nil) {
-                    failure([NSError errorWithDomain:@"data error" code:-999999 userInfo:nil]);
-                    return;
-                }
-                success((NSHTTPURLResponse *)response, res);
-            }];
-        }];
+        NSURLSessionDataTask *task = [weakSelf dataTaskWithRequest:urlRequest
+                                                  responseBodyType:responseBodyType
+                                                           element:nil
+                                                           success:success
+                                                           failure:failure];
+        ZLSetBodyStreamProvider(task, ^NSInputStream *{
+            return [formData bodyStreamWithProgress:uploadProgressBlock];
+        });
         [task resume];
     }];
 }
@@ -956,26 +2800,169 @@ responseBodyType:(ZLResponseBodyType)responseBodyType
                 destination:(NSURL *)destinationURL
                    progress:(void (^)(float downloadProgress))downloadProgressBlock
           completionHandler:(void (^)(NSURLResponse *response, NSURL *filePath, NSError *error))completionHandler {
+    [self downloadWithRequest:request
+                      headers:headers
+                  destination:destinationURL
+                     progress:downloadProgressBlock
+                 receivedData:nil
+            completionHandler:completionHandler];
+}
+
+- (void)downloadWithRequest:(NSURLRequest *)request
+                    headers:(NSDictionary <NSString *, NSString *> *)headers
+                destination:(NSURL *)destinationURL
+                   progress:(void (^)(float downloadProgress))downloadProgressBlock
+               receivedData:(void (^)(NSData *receivedData, BOOL finished))receivedDataBlock
+          completionHandler:(void (^)(NSURLResponse *response, NSURL *filePath, NSError *error))completionHandler {
+    [self downloadWithRequest:request
+                      headers:headers
+                  destination:destinationURL
+                     priority:ZLRequestPriorityVisible
+                         lifo:NO
+                     progress:downloadProgressBlock
+                 receivedData:receivedDataBlock
+            completionHandler:completionHandler];
+}
+
+- (void)downloadWithRequest:(NSURLRequest *)request
+                    headers:(NSDictionary <NSString *, NSString *> *)headers
+                destination:(NSURL *)destinationURL
+                   priority:(ZLRequestPriority)priority
+                   progress:(void (^)(float downloadProgress))downloadProgressBlock
+               receivedData:(void (^)(NSData *receivedData, BOOL finished))receivedDataBlock
+          completionHandler:(void (^)(NSURLResponse *response, NSURL *filePath, NSError *error))completionHandler {
+    [self downloadWithRequest:request
+                      headers:headers
+                  destination:destinationURL
+                     priority:priority
+                         lifo:YES
+                     progress:downloadProgressBlock
+                 receivedData:receivedDataBlock
+            completionHandler:completionHandler];
+}
+
+/// 同一 URL 已在下载时只追加 completionHandler，并按两者中较高的优先级处理，返回 nil；
+/// 否则创建 operationClass 的实例登记到 downloadItems 并返回，由调用方设置好后交给 downloadScheduler
+- (__kindof ZLDownloadOperation *)registerDownloadOperationOfClass:(Class)operationClass
+                                                           request:(NSURLRequest *)request
+                                                          priority:(ZLRequestPriority)priority
+                                                 completionHandler:(void (^)(NSURLResponse *response, NSURL *filePath, NSError *error))completionHandler {
     NSURL *requestURL = request.URL;
     if (requestURL == nil) {
         completionHandler(nil, nil, [NSError errorWithDomain:@"" code:-1 userInfo:nil]);
+        return nil;
+    }
+    ZLDownloadOperation *operation = nil;
+    @synchronized (self.downloadItems) {
+        ZLDownloadOperation *_operation = self.downloadItems[requestURL];
+        if (_operation != nil) {
+            [_operation.otherCompletionHandlers addObject:completionHandler];
+            // 已在排队的下载按更高的优先级处理
+            if (priority > _operation.priority) {
+                [self.downloadScheduler setPriority:priority forOperation:_operation];
+            }
+            return nil;
+        }
+        
+        operation = [[operationClass alloc] init];
+        self.downloadItems[requestURL] = operation;
+    }
+    operation.mainDownloadItems = self.downloadItems;
+    operation.urlRequest = request.mutableCopy;
+    operation.completionHandler = completionHandler;
+    operation.priority = priority;
+    return operation;
+}
+
+- (void)downloadWithRequest:(NSURLRequest *)request
+                    headers:(NSDictionary <NSString *, NSString *> *)headers
+                destination:(NSURL *)destinationURL
+                   priority:(ZLRequestPriority)priority
+                       lifo:(BOOL)lifo
+                   progress:(void (^)(float downloadProgress))downloadProgressBlock
+               receivedData:(void (^)(NSData *receivedData, BOOL finished))receivedDataBlock
+          completionHandler:(void (^)(NSURLResponse *response, NSURL *filePath, NSError *error))completionHandler {
+    ZLDownloadOperation *operation = [self registerDownloadOperationOfClass:[ZLDownloadOperation class]
+                                                                    request:request
+                                                                   priority:priority
+                                                          completionHandler:completionHandler];
+    if (operation == nil) {
         return;
     }
-    ZLDownloadOperation *_operation = self.downloadItems[requestURL];
-    if (_operation != nil) {
-        [_operation.otherCompletionHandlers addObject:completionHandler];
+    operation.headers = headers;
+    operation.destinationURL = destinationURL;
+    operation.downloadProgressBlock = downloadProgressBlock;
+    operation.receivedDataBlock = receivedDataBlock;
+    operation.lifo = lifo;
+    [self.downloadScheduler addOperation:operation];
+}
+
+- (void)downloadWithRequest:(NSURLRequest *)request
+                    headers:(NSDictionary <NSString *, NSString *> *)headers
+                destination:(NSURL *)destinationURL
+               segmentCount:(NSUInteger)segmentCount
+                   progress:(void (^)(float downloadProgress))downloadProgressBlock
+          completionHandler:(void (^)(NSURLResponse *response, NSURL *filePath, NSError *error))completionHandler {
+    [self downloadWithRequest:request
+                      headers:headers
+                  destination:destinationURL
+                 segmentCount:segmentCount
+                     priority:ZLRequestPriorityVisible
+                         lifo:NO
+                     progress:downloadProgressBlock
+            completionHandler:completionHandler];
+}
+
+- (void)downloadWithRequest:(NSURLRequest *)request
+                    headers:(NSDictionary <NSString *, NSString *> *)headers
+                destination:(NSURL *)destinationURL
+               segmentCount:(NSUInteger)segmentCount
+                   priority:(ZLRequestPriority)priority
+                   progress:(void (^)(float downloadProgress))downloadProgressBlock
+          completionHandler:(void (^)(NSURLResponse *response, NSURL *filePath, NSError *error))completionHandler {
+    [self downloadWithRequest:request
+                      headers:headers
+                  destination:destinationURL
+                 segmentCount:segmentCount
+                     priority:priority
+                         lifo:YES
+                     progress:downloadProgressBlock
+            completionHandler:completionHandler];
+}
+
+- (void)downloadWithRequest:(NSURLRequest *)request
+                    headers:(NSDictionary <NSString *, NSString *> *)headers
+                destination:(NSURL *)destinationURL
+               segmentCount:(NSUInteger)segmentCount
+                   priority:(ZLRequestPriority)priority
+                       lifo:(BOOL)lifo
+                   progress:(void (^)(float downloadProgress))downloadProgressBlock
+          completionHandler:(void (^)(NSURLResponse *response, NSURL *filePath, NSError *error))completionHandler {
+    if (segmentCount <= 1) {
+        [self downloadWithRequest:request
+                          headers:headers
+                      destination:destinationURL
+                         priority:priority
+                             lifo:lifo
+                         progress:downloadProgressBlock
+                     receivedData:nil
+                completionHandler:completionHandler];
         return;
     }
     
-    ZLDownloadOperation *operation = [[ZLDownloadOperation alloc] init];
-    self.downloadItems[requestURL] = operation;
-    operation.mainDownloadItems = self.downloadItems;
-    operation.urlRequest = request.mutableCopy;
+    ZLSegmentedDownloadOperation *operation = [self registerDownloadOperationOfClass:[ZLSegmentedDownloadOperation class]
+                                                                             request:request
+                                                                            priority:priority
+                                                                   completionHandler:completionHandler];
+    if (operation == nil) {
+        return;
+    }
     operation.headers = headers;
     operation.destinationURL = destinationURL;
+    operation.segmentCount = segmentCount;
     operation.downloadProgressBlock = downloadProgressBlock;
-    operation.completionHandler = completionHandler;
-    [self.downloadQueue addOperation:operation];
+    operation.lifo = lifo;
+    [self.downloadScheduler addOperation:operation];
 }
 
 - (void)clearDiskCache {
@@ -985,6 +2972,26 @@ responseBodyType:(ZLResponseBodyType)responseBodyType
     [[NSFileManager defaultManager] createDirectoryAtPath:downloadTemp withIntermediateDirectories:YES attributes:nil error:nil];
 }
 
+- (void)clearResponseCache {
+    [self.responseCache removeAllCachedResponses];
+}
+
+/// 清理断点续传留下的、长时间没有再继续的临时文件
++ (void)removeFilesInDirPath:(NSString *)dirPath notModifiedSince:(NSDate *)date {
+    NSArray *resourceKeys = @[NSURLIsDirectoryKey, NSURLContentModificationDateKey];
+    NSDirectoryEnumerator<NSURL *> *enumerator = [[NSFileManager defaultManager] enumeratorAtURL:[NSURL fileURLWithPath:dirPath isDirectory:YES] includingPropertiesForKeys:resourceKeys options:NSDirectoryEnumerationSkipsHiddenFiles errorHandler:nil];
+    for (NSURL *fileURL in enumerator) {
+        NSDictionary *values = [fileURL resourceValuesForKeys:resourceKeys error:NULL];
+        if ([values[NSURLIsDirectoryKey] boolValue]) {
+            continue;
+        }
+        NSDate *modificationDate = values[NSURLContentModificationDateKey];
+        if (modificationDate != nil && [modificationDate compare:date] == NSOrderedAscending) {
+            [[NSFileManager defaultManager] removeItemAtURL:fileURL error:NULL];
+        }
+    }
+}
+
 + (void)deleteDirPath:(NSString *)dirPath {
     NSArray *contents = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:dirPath error:NULL];
     for (NSString *filename in contents) {
@@ -1002,11 +3009,66 @@ responseBodyType:(ZLResponseBodyType)responseBodyType
 }
 
 - (void)cancelDownloadForURL:(NSURL *)url {
-    ZLDownloadOperation *_operation = [self.downloadItems objectForKey:url];
+    ZLDownloadOperation *_operation = nil;
+    @synchronized (self.downloadItems) {
+        _operation = [self.downloadItems objectForKey:url];
+    }
     if (_operation == nil) {
         return;
     }
     [_operation cancel];
+    if ([self.downloadScheduler removePendingOperation:_operation]) {
+        [_operation finishCancelledOperation];
+    }
+}
+
+- (void)setPriority:(ZLRequestPriority)priority forDownloadURL:(NSURL *)url {
+    ZLDownloadOperation *_operation = nil;
+    @synchronized (self.downloadItems) {
+        _operation = [self.downloadItems objectForKey:url];
+    }
+    if (_operation != nil) {
+        [self.downloadScheduler setPriority:priority forOperation:_operation];
+    }
+}
+
+- (void)deprioritizeDownloadForURL:(NSURL *)url {
+    ZLDownloadOperation *_operation = nil;
+    BOOL cancelled = NO;
+    @synchronized (self.downloadItems) {
+        _operation = [self.downloadItems objectForKey:url];
+        // 没有其它等待者时才取消，移出 downloadItems 后再来的请求会重新下载
+        if (_operation != nil && _operation.otherCompletionHandlers.count == 0 &&
+            [self.downloadScheduler removePendingOperation:_operation]) {
+            [self.downloadItems removeObjectForKey:url];
+            cancelled = YES;
+        }
+    }
+    if (_operation == nil) {
+        return;
+    }
+    if (cancelled) {
+        [_operation cancel];
+        [_operation finishCancelledOperation];
+    } else {
+        [self.downloadScheduler setPriority:ZLRequestPriorityBackground forOperation:_operation];
+    }
+}
+
+- (NSUInteger)maxConcurrentDownloadsPerHost {
+    return self.downloadScheduler.maxConcurrentCountPerHost;
+}
+
+- (void)setMaxConcurrentDownloadsPerHost:(NSUInteger)maxConcurrentDownloadsPerHost {
+    self.downloadScheduler.maxConcurrentCountPerHost = MAX(maxConcurrentDownloadsPerHost, 1);
+}
+
+- (void (^)(NSURL *, ZLRequestPriority, NSTimeInterval))downloadQueueWaitTimeBlock {
+    return self.downloadScheduler.queueWaitTimeBlock;
+}
+
+- (void)setDownloadQueueWaitTimeBlock:(void (^)(NSURL *, ZLRequestPriority, NSTimeInterval))downloadQueueWaitTimeBlock {
+    self.downloadScheduler.queueWaitTimeBlock = downloadQueueWaitTimeBlock;
 }
 
 @end
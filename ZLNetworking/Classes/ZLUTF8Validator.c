@@ -0,0 +1,299 @@
+//
+//  ZLUTF8Validator.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/2/15.
+//
+
+#include "ZLUTF8Validator.h"
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+void ZLUTF8ValidatorReset(ZLUTF8ValidatorState *state) {
+    state->pending = 0;
+    state->lower = 0x80;
+    state->upper = 0xBF;
+}
+
+/// 从 offset 开始跳过连续的 ASCII 字节，返回第一个非 ASCII 字节的位置（不超过 length）
+static size_t ZLUTF8SkipASCII(const uint8_t *bytes, size_t offset, size_t length) {
+#if defined(__AVX2__)
+    while (length - offset >= sizeof(__m256i)) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(bytes + offset));
+        if (_mm256_movemask_epi8(chunk) != 0) {
+            break;
+        }
+        offset += sizeof(__m256i);
+    }
+#endif
+#if defined(__SSE2__)
+    while (length - offset >= sizeof(__m128i)) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(bytes + offset));
+        if (_mm_movemask_epi8(chunk) != 0) {
+            break;
+        }
+        offset += sizeof(__m128i);
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    while (length - offset >= sizeof(uint8x16_t)) {
+        uint8x16_t chunk = vld1q_u8(bytes + offset);
+        if (vmaxvq_u8(chunk) >= 0x80) {
+            break;
+        }
+        offset += sizeof(uint8x16_t);
+    }
+#endif
+    while (length - offset >= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + offset, sizeof(word));
+        if (word & UINT64_C(0x8080808080808080)) {
+            break;
+        }
+        offset += sizeof(uint64_t);
+    }
+    while (offset < length && bytes[offset] < 0x80) {
+        offset++;
+    }
+    return offset;
+}
+
+/* 多字节字符的向量校验 */
+
+// 按 Keiser 和 Lemire 的查表法（"Validating UTF-8 In Less Than One Instruction Per Byte"），每次校验 16 字节：
+// 前一个字节的高、低半字节和当前字节的高半字节各查一张 16 项的表，三者按位与之后非 0 就是非法的两字节组合；
+// 再用往前第 2、3 个字节是否为三、四字节首字节，检查续字节的个数是否恰好对得上
+#if defined(__SSSE3__) || (defined(__ARM_NEON) && defined(__aarch64__))
+#define ZLUTF8_VECTOR 1
+
+#define ZLUTF8TooShort       (1 << 0)   // 首字节或 ASCII 后面跟着首字节
+#define ZLUTF8TooLong        (1 << 1)   // ASCII 后面跟着续字节
+#define ZLUTF8Overlong3      (1 << 2)
+#define ZLUTF8TooLarge       (1 << 3)
+#define ZLUTF8Surrogate      (1 << 4)
+#define ZLUTF8Overlong2      (1 << 5)
+#define ZLUTF8TooLarge1000   (1 << 6)
+#define ZLUTF8Overlong4      (1 << 6)
+#define ZLUTF8TwoConts       (1 << 7)   // 续字节后面跟着续字节，是否合法由 ZLUTF8MustBeContinuation 决定
+#define ZLUTF8Carry          (ZLUTF8TooShort | ZLUTF8TooLong | ZLUTF8TwoConts)
+
+#define ZLUTF8Byte1High \
+    ZLUTF8TooLong, ZLUTF8TooLong, ZLUTF8TooLong, ZLUTF8TooLong, \
+    ZLUTF8TooLong, ZLUTF8TooLong, ZLUTF8TooLong, ZLUTF8TooLong, \
+    ZLUTF8TwoConts, ZLUTF8TwoConts, ZLUTF8TwoConts, ZLUTF8TwoConts, \
+    ZLUTF8TooShort | ZLUTF8Overlong2, \
+    ZLUTF8TooShort, \
+    ZLUTF8TooShort | ZLUTF8Overlong3 | ZLUTF8Surrogate, \
+    ZLUTF8TooShort | ZLUTF8TooLarge | ZLUTF8TooLarge1000 | ZLUTF8Overlong4
+
+#define ZLUTF8Byte1Low \
+    ZLUTF8Carry | ZLUTF8Overlong3 | ZLUTF8Overlong2 | ZLUTF8Overlong4, \
+    ZLUTF8Carry | ZLUTF8Overlong2, \
+    ZLUTF8Carry, \
+    ZLUTF8Carry, \
+    ZLUTF8Carry | ZLUTF8TooLarge, \
+    ZLUTF8Carry | ZLUTF8TooLarge | ZLUTF8TooLarge1000, \
+    ZLUTF8Carry | ZLUTF8TooLarge | ZLUTF8TooLarge1000, \
+    ZLUTF8Carry | ZLUTF8TooLarge | ZLUTF8TooLarge1000, \
+    ZLUTF8Carry | ZLUTF8TooLarge | ZLUTF8TooLarge1000, \
+    ZLUTF8Carry | ZLUTF8TooLarge | ZLUTF8TooLarge1000, \
+    ZLUTF8Carry | ZLUTF8TooLarge | ZLUTF8TooLarge1000, \
+    ZLUTF8Carry | ZLUTF8TooLarge | ZLUTF8TooLarge1000, \
+    ZLUTF8Carry | ZLUTF8TooLarge | ZLUTF8TooLarge1000, \
+    ZLUTF8Carry | ZLUTF8TooLarge | ZLUTF8TooLarge1000 | ZLUTF8Surrogate, \
+    ZLUTF8Carry | ZLUTF8TooLarge | ZLUTF8TooLarge1000, \
+    ZLUTF8Carry | ZLUTF8TooLarge | ZLUTF8TooLarge1000
+
+#define ZLUTF8Byte2High \
+    ZLUTF8TooShort, ZLUTF8TooShort, ZLUTF8TooShort, ZLUTF8TooShort, \
+    ZLUTF8TooShort, ZLUTF8TooShort, ZLUTF8TooShort, ZLUTF8TooShort, \
+    ZLUTF8TooLong | ZLUTF8Overlong2 | ZLUTF8TwoConts | ZLUTF8Overlong3 | ZLUTF8TooLarge1000 | ZLUTF8Overlong4, \
+    ZLUTF8TooLong | ZLUTF8Overlong2 | ZLUTF8TwoConts | ZLUTF8Overlong3 | ZLUTF8TooLarge, \
+    ZLUTF8TooLong | ZLUTF8Overlong2 | ZLUTF8TwoConts | ZLUTF8Surrogate | ZLUTF8TooLarge, \
+    ZLUTF8TooLong | ZLUTF8Overlong2 | ZLUTF8TwoConts | ZLUTF8Surrogate | ZLUTF8TooLarge, \
+    ZLUTF8TooShort, ZLUTF8TooShort, ZLUTF8TooShort, ZLUTF8TooShort
+
+#if defined(__SSSE3__)
+typedef __m128i ZLUTF8Vector;
+
+static inline ZLUTF8Vector ZLUTF8Load(const uint8_t *bytes) {
+    return _mm_loadu_si128((const __m128i *)bytes);
+}
+
+/// input 之前的 16 字节是 previous，返回每个位置往前第 1、2、3 个字节
+#define ZLUTF8Previous(input, previous, n) _mm_alignr_epi8((input), (previous), 16 - (n))
+
+static inline ZLUTF8Vector ZLUTF8BlockError(ZLUTF8Vector input, ZLUTF8Vector previous) {
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i byte1HighTable = _mm_setr_epi8(ZLUTF8Byte1High);
+    const __m128i byte1LowTable = _mm_setr_epi8(ZLUTF8Byte1Low);
+    const __m128i byte2HighTable = _mm_setr_epi8(ZLUTF8Byte2High);
+
+    __m128i prev1 = ZLUTF8Previous(input, previous, 1);
+    __m128i byte1High = _mm_shuffle_epi8(byte1HighTable, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+    __m128i byte1Low = _mm_shuffle_epi8(byte1LowTable, _mm_and_si128(prev1, nibble));
+    __m128i byte2High = _mm_shuffle_epi8(byte2HighTable, _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    __m128i special = _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);
+
+    // 往前第 2 个字节 >= 0xE0 或往前第 3 个字节 >= 0xF0 时，当前字节必须是续字节
+    __m128i isThird = _mm_subs_epu8(ZLUTF8Previous(input, previous, 2), _mm_set1_epi8((char)(0xE0 - 0x80)));
+    __m128i isFourth = _mm_subs_epu8(ZLUTF8Previous(input, previous, 3), _mm_set1_epi8((char)(0xF0 - 0x80)));
+    __m128i must = _mm_and_si128(_mm_or_si128(isThird, isFourth), _mm_set1_epi8((char)0x80));
+    return _mm_xor_si128(must, special);
+}
+
+static inline ZLUTF8Vector ZLUTF8Zero(void) {
+    return _mm_setzero_si128();
+}
+
+static inline ZLUTF8Vector ZLUTF8Or(ZLUTF8Vector a, ZLUTF8Vector b) {
+    return _mm_or_si128(a, b);
+}
+
+static inline bool ZLUTF8IsZero(ZLUTF8Vector vector) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(vector, _mm_setzero_si128())) == 0xFFFF;
+}
+#else
+typedef uint8x16_t ZLUTF8Vector;
+
+static inline ZLUTF8Vector ZLUTF8Load(const uint8_t *bytes) {
+    return vld1q_u8(bytes);
+}
+
+#define ZLUTF8Previous(input, previous, n) vextq_u8((previous), (input), 16 - (n))
+
+static inline ZLUTF8Vector ZLUTF8BlockError(ZLUTF8Vector input, ZLUTF8Vector previous) {
+    static const uint8_t byte1HighValues[16] = { ZLUTF8Byte1High };
+    static const uint8_t byte1LowValues[16] = { ZLUTF8Byte1Low };
+    static const uint8_t byte2HighValues[16] = { ZLUTF8Byte2High };
+
+    uint8x16_t prev1 = ZLUTF8Previous(input, previous, 1);
+    uint8x16_t byte1High = vqtbl1q_u8(vld1q_u8(byte1HighValues), vshrq_n_u8(prev1, 4));
+    uint8x16_t byte1Low = vqtbl1q_u8(vld1q_u8(byte1LowValues), vandq_u8(prev1, vdupq_n_u8(0x0F)));
+    uint8x16_t byte2High = vqtbl1q_u8(vld1q_u8(byte2HighValues), vshrq_n_u8(input, 4));
+    uint8x16_t special = vandq_u8(vandq_u8(byte1High, byte1Low), byte2High);
+
+    uint8x16_t isThird = vqsubq_u8(ZLUTF8Previous(input, previous, 2), vdupq_n_u8(0xE0 - 0x80));
+    uint8x16_t isFourth = vqsubq_u8(ZLUTF8Previous(input, previous, 3), vdupq_n_u8(0xF0 - 0x80));
+    uint8x16_t must = vandq_u8(vorrq_u8(isThird, isFourth), vdupq_n_u8(0x80));
+    return veorq_u8(must, special);
+}
+
+static inline ZLUTF8Vector ZLUTF8Zero(void) {
+    return vdupq_n_u8(0);
+}
+
+static inline ZLUTF8Vector ZLUTF8Or(ZLUTF8Vector a, ZLUTF8Vector b) {
+    return vorrq_u8(a, b);
+}
+
+static inline bool ZLUTF8IsZero(ZLUTF8Vector vector) {
+    return vmaxvq_u8(vector) == 0;
+}
+#endif
+
+/// 从字符边界 offset 开始按 16 字节一块校验，遇到非法序列返回 SIZE_MAX。
+/// 最后一块可能停在多字节字符中间，这时退回到这个字符的首字节，交给逐字节的状态机，返回值总在字符边界上
+static size_t ZLUTF8ValidateBlocks(const uint8_t *bytes, size_t offset, size_t length) {
+    if (length - offset < sizeof(ZLUTF8Vector)) {
+        return offset;
+    }
+    // offset 在字符边界上，相当于前面都是 ASCII
+    ZLUTF8Vector previous = ZLUTF8Zero();
+    ZLUTF8Vector error = ZLUTF8Zero();
+    while (length - offset >= sizeof(ZLUTF8Vector)) {
+        ZLUTF8Vector input = ZLUTF8Load(bytes + offset);
+        error = ZLUTF8Or(error, ZLUTF8BlockError(input, previous));
+        previous = input;
+        offset += sizeof(ZLUTF8Vector);
+    }
+    if (!ZLUTF8IsZero(error)) {
+        return SIZE_MAX;
+    }
+
+    // 续字节的数量在块内已经核对过，这里只看末尾的首字节后面是否还缺续字节
+    for (size_t back = 1; back <= 3; back++) {
+        uint8_t byte = bytes[offset - back];
+        if (byte < 0x80) {
+            break;
+        }
+        if (byte >= 0xC0) {
+            size_t needed = byte >= 0xF0 ? 3 : (byte >= 0xE0 ? 2 : 1);
+            if (needed >= back) {
+                offset -= back;
+            }
+            break;
+        }
+    }
+    return offset;
+}
+#endif
+
+bool ZLUTF8ValidatorUpdate(ZLUTF8ValidatorState *state, const uint8_t *bytes, size_t length) {
+    uint8_t pending = state->pending;
+    uint8_t lower = state->lower;
+    uint8_t upper = state->upper;
+    size_t offset = 0;
+
+    while (offset < length) {
+        if (pending == 0) {
+            offset = ZLUTF8SkipASCII(bytes, offset, length);
+#ifdef ZLUTF8_VECTOR
+            // 块校验停下的位置可能是 ASCII，回到循环开头重新判断
+            size_t validated = ZLUTF8ValidateBlocks(bytes, offset, length);
+            if (validated == SIZE_MAX) {
+                return false;
+            }
+            if (validated != offset) {
+                offset = validated;
+                continue;
+            }
+#endif
+            if (offset == length) {
+                break;
+            }
+
+            // 按 RFC 3629 的表，第二个字节的范围取决于首字节，用来排除过长编码、代理区和超出 U+10FFFF 的码点
+            uint8_t lead = bytes[offset++];
+            lower = 0x80;
+            upper = 0xBF;
+            if (lead >= 0xC2 && lead <= 0xDF) {
+                pending = 1;
+            } else if (lead >= 0xE0 && lead <= 0xEF) {
+                pending = 2;
+                if (lead == 0xE0) {
+                    lower = 0xA0;
+                } else if (lead == 0xED) {
+                    upper = 0x9F;
+                }
+            } else if (lead >= 0xF0 && lead <= 0xF4) {
+                pending = 3;
+                if (lead == 0xF0) {
+                    lower = 0x90;
+                } else if (lead == 0xF4) {
+                    upper = 0x8F;
+                }
+            } else {
+                return false;
+            }
+            continue;
+        }
+
+        uint8_t byte = bytes[offset++];
+        if (byte < lower || byte > upper) {
+            return false;
+        }
+        pending--;
+        lower = 0x80;
+        upper = 0xBF;
+    }
+
+    state->pending = pending;
+    state->lower = lower;
+    state->upper = upper;
+    return true;
+}
@@ -0,0 +1,41 @@
+//
+//  ZLUTF8Validator.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/2/15.
+//
+
+#ifndef ZLUTF8Validator_h
+#define ZLUTF8Validator_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 流式 UTF-8 校验状态，跨分片保存未完成的多字节序列
+typedef struct ZLUTF8ValidatorState {
+    uint8_t pending;    // 当前序列还需要的后续字节数
+    uint8_t lower;      // 下一个后续字节允许的范围
+    uint8_t upper;
+} ZLUTF8ValidatorState;
+
+/// 重置为初始状态
+void ZLUTF8ValidatorReset(ZLUTF8ValidatorState *state);
+
+/// 校验紧接在上次数据之后的一段字节，遇到非法序列返回 false，此后状态不再可用
+bool ZLUTF8ValidatorUpdate(ZLUTF8ValidatorState *state, const uint8_t *bytes, size_t length);
+
+/// 已校验的数据是否恰好结束在完整字符边界上
+static inline bool ZLUTF8ValidatorIsComplete(const ZLUTF8ValidatorState *state) {
+    return state->pending == 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLUTF8Validator_h */
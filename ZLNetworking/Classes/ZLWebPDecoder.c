@@ -0,0 +1,513 @@
+//
+//  ZLWebPDecoder.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLWebPDecoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/// 画布和单帧像素数的上限，与 ZLGIFDecoder 相同；超过时当作损坏，交给 ImageIO
+#define ZLWebPMaxPixels (1u << 26)
+
+#define ZLWebPChunkHeaderLength 8
+
+enum {
+    ZLWebPStateHeader = 0,
+    ZLWebPStateChunks,
+    ZLWebPStateDone,
+};
+
+/// 子块在数据中的位置，只记录负载，重新包装时再写块头和补齐字节
+typedef struct ZLWebPChunk {
+    size_t offset;
+    uint32_t length;
+} ZLWebPChunk;
+
+typedef struct ZLWebPFrame {
+    ZLWebPRect rect;
+    uint32_t duration;
+    bool blend;                 // false 表示直接覆盖帧所在的矩形
+    bool disposeBackground;     // 显示完后把矩形清成透明
+    bool lossless;              // VP8L；否则是 VP8，可能带 ALPH
+    ZLWebPChunk alpha;          // length 为 0 表示没有 ALPH
+    ZLWebPChunk image;
+} ZLWebPFrame;
+
+struct ZLWebPDecoder {
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+    size_t offset;              // 下一个待解析的块
+    size_t end;                 // RIFF 头里记录的文件长度
+    int state;
+    bool corrupted;
+
+    ZLWebPFrameDecoder frameDecoder;
+    void *info;
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t loopCount;
+
+    ZLWebPFrame *frames;
+    size_t frameCount;
+    size_t frameCapacity;
+};
+
+struct ZLWebPCanvas {
+    uint32_t width;
+    uint32_t height;
+    uint32_t *pixels;
+    size_t nextFrame;
+
+    // 上一帧的区域和 disposal，在合成下一帧之前处理
+    ZLWebPRect previousRect;
+    bool previousDisposeBackground;
+
+    uint32_t *framePixels;      // frameDecoder 输出的整帧像素
+    size_t framePixelsCapacity;
+    uint8_t *file;              // 重新包装成的单帧 WebP
+    size_t fileCapacity;
+};
+
+static inline uint32_t ZLWebPReadUInt24(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+}
+
+static inline uint32_t ZLWebPReadUInt32(const uint8_t *p) {
+    return ZLWebPReadUInt24(p) | ((uint32_t)p[3] << 24);
+}
+
+static inline void ZLWebPWriteUInt24(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+}
+
+static inline void ZLWebPWriteUInt32(uint8_t *p, uint32_t value) {
+    ZLWebPWriteUInt24(p, value);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+/// 块长度为奇数时后面补一个字节；最后一个块的补齐字节可能被省略，所以不超过 limit
+static inline size_t ZLWebPChunkEnd(size_t offset, uint32_t length, size_t limit) {
+    size_t end = offset + ZLWebPChunkHeaderLength + length;
+    return (length & 1) && end < limit ? end + 1 : end;
+}
+
+ZLWebPSniffResult ZLWebPSniff(const uint8_t *bytes, size_t length) {
+    static const char signature[12] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'E', 'B', 'P'};
+    for (size_t i = 0; i < length && i < 12; i++) {
+        if ((i < 4 || i >= 8) && bytes[i] != (uint8_t)signature[i]) {
+            return ZLWebPSniffNotAnimated;
+        }
+    }
+    if (length < 21) {
+        return ZLWebPSniffNeedMoreData;
+    }
+    if (memcmp(bytes + 12, "VP8X", 4) != 0) {
+        return ZLWebPSniffNotAnimated;
+    }
+    return (bytes[20] & 0x02) ? ZLWebPSniffAnimated : ZLWebPSniffNotAnimated;
+}
+
+static bool ZLWebPParseHeader(ZLWebPDecoder *decoder) {
+    const uint8_t *p = decoder->data;
+    if (ZLWebPSniff(p, decoder->length) == ZLWebPSniffNotAnimated) {
+        return false;
+    }
+    if (decoder->length < 12 + ZLWebPChunkHeaderLength + 10) {
+        return true;
+    }
+    uint32_t chunkLength = ZLWebPReadUInt32(p + 16);
+    if (chunkLength < 10) {
+        return false;
+    }
+    uint32_t width = 1 + ZLWebPReadUInt24(p + 24);
+    uint32_t height = 1 + ZLWebPReadUInt24(p + 27);
+    if ((uint64_t)width * height > ZLWebPMaxPixels) {
+        return false;
+    }
+
+    decoder->end = (size_t)ZLWebPReadUInt32(p + 4) + 8;
+    decoder->width = width;
+    decoder->height = height;
+    decoder->offset = ZLWebPChunkEnd(12, chunkLength, decoder->end);
+    decoder->state = ZLWebPStateChunks;
+    return decoder->offset <= decoder->end;
+}
+
+/// ANMF 的负载：16 字节的帧头，后面是 ALPH（可选）和 VP8 或 VP8L 子块，不认识的子块跳过
+static bool ZLWebPParseFrame(ZLWebPDecoder *decoder, size_t offset, uint32_t length) {
+    if (length < 16) {
+        return false;
+    }
+    const uint8_t *p = decoder->data + offset;
+    ZLWebPFrame frame = {{0, 0, 0, 0}, 0, false, false, false, {0, 0}, {0, 0}};
+    frame.rect.x = ZLWebPReadUInt24(p) * 2;
+    frame.rect.y = ZLWebPReadUInt24(p + 3) * 2;
+    frame.rect.width = 1 + ZLWebPReadUInt24(p + 6);
+    frame.rect.height = 1 + ZLWebPReadUInt24(p + 9);
+    uint32_t duration = ZLWebPReadUInt24(p + 12);
+    frame.duration = duration <= 10 ? 100 : duration;
+    frame.blend = (p[15] & 0x02) == 0;
+    frame.disposeBackground = (p[15] & 0x01) != 0;
+    if ((uint64_t)frame.rect.width * frame.rect.height > ZLWebPMaxPixels) {
+        return false;
+    }
+
+    size_t end = offset + length;
+    size_t subOffset = offset + 16;
+    while (subOffset + ZLWebPChunkHeaderLength <= end) {
+        const uint8_t *sub = decoder->data + subOffset;
+        uint32_t subLength = ZLWebPReadUInt32(sub + 4);
+        if (subLength > end - subOffset - ZLWebPChunkHeaderLength) {
+            return false;
+        }
+        ZLWebPChunk chunk = {subOffset + ZLWebPChunkHeaderLength, subLength};
+        if (memcmp(sub, "ALPH", 4) == 0) {
+            frame.alpha = chunk;
+        } else if (memcmp(sub, "VP8 ", 4) == 0 || memcmp(sub, "VP8L", 4) == 0) {
+            frame.image = chunk;
+            frame.lossless = sub[3] == 'L';
+            break;
+        }
+        subOffset = ZLWebPChunkEnd(subOffset, subLength, end);
+    }
+    if (frame.image.length == 0) {
+        return false;
+    }
+    // VP8L 自带 alpha，规范要求忽略前面的 ALPH
+    if (frame.lossless) {
+        frame.alpha.length = 0;
+    }
+
+    if (decoder->frameCount == decoder->frameCapacity) {
+        size_t capacity = decoder->frameCapacity ? decoder->frameCapacity * 2 : 16;
+        ZLWebPFrame *frames = realloc(decoder->frames, capacity * sizeof(ZLWebPFrame));
+        if (frames == NULL) {
+            return false;
+        }
+        decoder->frames = frames;
+        decoder->frameCapacity = capacity;
+    }
+    decoder->frames[decoder->frameCount++] = frame;
+    return true;
+}
+
+static bool ZLWebPParseChunks(ZLWebPDecoder *decoder) {
+    while (decoder->offset < decoder->end && decoder->offset + ZLWebPChunkHeaderLength <= decoder->length) {
+        const uint8_t *p = decoder->data + decoder->offset;
+        uint32_t length = ZLWebPReadUInt32(p + 4);
+        size_t end = ZLWebPChunkEnd(decoder->offset, length, decoder->end);
+        if (end > decoder->end) {
+            return false;
+        }
+        if (end > decoder->length) {
+            return true;
+        }
+        if (memcmp(p, "ANIM", 4) == 0) {
+            if (length < 6) {
+                return false;
+            }
+            decoder->loopCount = (uint32_t)p[12] | ((uint32_t)p[13] << 8);
+        } else if (memcmp(p, "ANMF", 4) == 0) {
+            if (!ZLWebPParseFrame(decoder, decoder->offset + ZLWebPChunkHeaderLength, length)) {
+                return false;
+            }
+        }
+        decoder->offset = end;
+    }
+    if (decoder->offset >= decoder->end) {
+        decoder->state = ZLWebPStateDone;
+    }
+    return true;
+}
+
+ZLWebPDecoder *ZLWebPDecoderCreate(ZLWebPFrameDecoder frameDecoder, void *info) {
+    ZLWebPDecoder *decoder = calloc(1, sizeof(ZLWebPDecoder));
+    if (decoder) {
+        decoder->frameDecoder = frameDecoder;
+        decoder->info = info;
+    }
+    return decoder;
+}
+
+void ZLWebPDecoderDestroy(ZLWebPDecoder *decoder) {
+    if (decoder == NULL) {
+        return;
+    }
+    free(decoder->data);
+    free(decoder->frames);
+    free(decoder);
+}
+
+bool ZLWebPDecoderAppend(ZLWebPDecoder *decoder, const uint8_t *bytes, size_t length) {
+    if (decoder->corrupted) {
+        return false;
+    }
+    if (decoder->state == ZLWebPStateDone || length == 0) {
+        return true;
+    }
+
+    if (decoder->length + length > decoder->capacity) {
+        size_t capacity = decoder->capacity ? decoder->capacity : 4096;
+        while (capacity < decoder->length + length) {
+            capacity *= 2;
+        }
+        uint8_t *data = realloc(decoder->data, capacity);
+        if (data == NULL) {
+            return false;
+        }
+        decoder->data = data;
+        decoder->capacity = capacity;
+    }
+    memcpy(decoder->data + decoder->length, bytes, length);
+    decoder->length += length;
+
+    bool valid = true;
+    if (decoder->state == ZLWebPStateHeader) {
+        valid = ZLWebPParseHeader(decoder);
+    }
+    if (valid && decoder->state == ZLWebPStateChunks) {
+        valid = ZLWebPParseChunks(decoder);
+    }
+    if (!valid) {
+        decoder->corrupted = true;
+        decoder->state = ZLWebPStateDone;
+    }
+    return valid;
+}
+
+size_t ZLWebPDecoderDataLength(const ZLWebPDecoder *decoder) {
+    return decoder->length;
+}
+
+bool ZLWebPDecoderIsComplete(const ZLWebPDecoder *decoder) {
+    return decoder->state == ZLWebPStateDone;
+}
+
+uint32_t ZLWebPDecoderWidth(const ZLWebPDecoder *decoder) {
+    return decoder->width;
+}
+
+uint32_t ZLWebPDecoderHeight(const ZLWebPDecoder *decoder) {
+    return decoder->height;
+}
+
+uint32_t ZLWebPDecoderLoopCount(const ZLWebPDecoder *decoder) {
+    return decoder->loopCount;
+}
+
+size_t ZLWebPDecoderFrameCount(const ZLWebPDecoder *decoder) {
+    return decoder->frameCount;
+}
+
+uint32_t ZLWebPDecoderFrameDuration(const ZLWebPDecoder *decoder, size_t index) {
+    return index < decoder->frameCount ? decoder->frames[index].duration : 0;
+}
+
+/* canvas */
+
+ZLWebPCanvas *ZLWebPCanvasCreate(const ZLWebPDecoder *decoder) {
+    if (decoder->width == 0 || decoder->height == 0) {
+        return NULL;
+    }
+    ZLWebPCanvas *canvas = calloc(1, sizeof(ZLWebPCanvas));
+    if (canvas == NULL) {
+        return NULL;
+    }
+    canvas->width = decoder->width;
+    canvas->height = decoder->height;
+    canvas->pixels = calloc((size_t)canvas->width * canvas->height, sizeof(uint32_t));
+    if (canvas->pixels == NULL) {
+        free(canvas);
+        return NULL;
+    }
+    return canvas;
+}
+
+void ZLWebPCanvasDestroy(ZLWebPCanvas *canvas) {
+    if (canvas == NULL) {
+        return;
+    }
+    free(canvas->pixels);
+    free(canvas->framePixels);
+    free(canvas->file);
+    free(canvas);
+}
+
+void ZLWebPCanvasReset(ZLWebPCanvas *canvas) {
+    canvas->nextFrame = 0;
+    canvas->previousDisposeBackground = false;
+    memset(&canvas->previousRect, 0, sizeof(ZLWebPRect));
+}
+
+size_t ZLWebPCanvasNextFrameIndex(const ZLWebPCanvas *canvas) {
+    return canvas->nextFrame;
+}
+
+const uint32_t *ZLWebPCanvasPixels(const ZLWebPCanvas *canvas) {
+    return canvas->pixels;
+}
+
+/// 规范要求帧在画布之内，这里和 GIF 一样只处理重叠的部分
+static ZLWebPRect ZLWebPClipRect(const ZLWebPCanvas *canvas, ZLWebPRect rect) {
+    ZLWebPRect clipped = {0, 0, 0, 0};
+    if (rect.x >= canvas->width || rect.y >= canvas->height) {
+        return clipped;
+    }
+    clipped.x = rect.x;
+    clipped.y = rect.y;
+    clipped.width = rect.width < canvas->width - rect.x ? rect.width : canvas->width - rect.x;
+    clipped.height = rect.height < canvas->height - rect.y ? rect.height : canvas->height - rect.y;
+    return clipped;
+}
+
+static ZLWebPRect ZLWebPUnionRect(ZLWebPRect a, ZLWebPRect b) {
+    if (a.width == 0 || a.height == 0) {
+        return b;
+    }
+    if (b.width == 0 || b.height == 0) {
+        return a;
+    }
+    uint32_t minX = a.x < b.x ? a.x : b.x;
+    uint32_t minY = a.y < b.y ? a.y : b.y;
+    uint32_t maxX = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+    uint32_t maxY = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+    ZLWebPRect rect = {minX, minY, maxX - minX, maxY - minY};
+    return rect;
+}
+
+static inline uint32_t ZLWebPMultiply(uint32_t c, uint32_t a) {
+    uint32_t t = c * a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+/// 预乘颜色的 source-over：dst = src + dst * (1 - srcAlpha)
+static inline uint32_t ZLWebPCompositeOver(uint32_t src, uint32_t dst) {
+    uint32_t alpha = src >> 24;
+    if (alpha == 255 || dst == 0) {
+        return src;
+    }
+    if (alpha == 0) {
+        return dst;
+    }
+    uint32_t inverse = 255 - alpha;
+    uint32_t a = alpha + ZLWebPMultiply(dst >> 24, inverse);
+    uint32_t r = ((src >> 16) & 0xFF) + ZLWebPMultiply((dst >> 16) & 0xFF, inverse);
+    uint32_t g = ((src >> 8) & 0xFF) + ZLWebPMultiply((dst >> 8) & 0xFF, inverse);
+    uint32_t b = (src & 0xFF) + ZLWebPMultiply(dst & 0xFF, inverse);
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+static uint8_t *ZLWebPAppendChunk(uint8_t *p, const char *type, const uint8_t *bytes, uint32_t length) {
+    memcpy(p, type, 4);
+    ZLWebPWriteUInt32(p + 4, length);
+    memcpy(p + ZLWebPChunkHeaderLength, bytes, length);
+    p += ZLWebPChunkHeaderLength + length;
+    if (length & 1) {
+        *p++ = 0;
+    }
+    return p;
+}
+
+static inline size_t ZLWebPPaddedLength(uint32_t length) {
+    return ZLWebPChunkHeaderLength + (size_t)length + (length & 1);
+}
+
+/// 把帧的码流包装成单帧 WebP 交给 frameDecoder，结果放在 canvas->framePixels
+static bool ZLWebPDecodeFrame(ZLWebPCanvas *canvas, const ZLWebPDecoder *decoder, const ZLWebPFrame *frame) {
+    if (decoder->frameDecoder == NULL) {
+        return false;
+    }
+    size_t area = (size_t)frame->rect.width * frame->rect.height;
+    if (area > canvas->framePixelsCapacity) {
+        uint32_t *pixels = realloc(canvas->framePixels, area * sizeof(uint32_t));
+        if (pixels == NULL) {
+            return false;
+        }
+        canvas->framePixels = pixels;
+        canvas->framePixelsCapacity = area;
+    }
+
+    // VP8 码流本身没有 alpha，带 ALPH 时要用扩展格式
+    size_t length = 12 + ZLWebPPaddedLength(frame->image.length);
+    if (frame->alpha.length) {
+        length += ZLWebPPaddedLength(10) + ZLWebPPaddedLength(frame->alpha.length);
+    }
+    if (length > UINT32_MAX) {
+        return false;
+    }
+    if (length > canvas->fileCapacity) {
+        uint8_t *file = realloc(canvas->file, length);
+        if (file == NULL) {
+            return false;
+        }
+        canvas->file = file;
+        canvas->fileCapacity = length;
+    }
+    uint8_t *p = canvas->file;
+    memcpy(p, "RIFF", 4);
+    ZLWebPWriteUInt32(p + 4, (uint32_t)(length - 8));
+    memcpy(p + 8, "WEBP", 4);
+    p += 12;
+    if (frame->alpha.length) {
+        uint8_t header[10] = {0x10, 0, 0, 0};
+        ZLWebPWriteUInt24(header + 4, frame->rect.width - 1);
+        ZLWebPWriteUInt24(header + 7, frame->rect.height - 1);
+        p = ZLWebPAppendChunk(p, "VP8X", header, sizeof(header));
+        p = ZLWebPAppendChunk(p, "ALPH", decoder->data + frame->alpha.offset, frame->alpha.length);
+    }
+    ZLWebPAppendChunk(p, frame->lossless ? "VP8L" : "VP8 ", decoder->data + frame->image.offset, frame->image.length);
+
+    return decoder->frameDecoder(canvas->file, length, frame->rect.width, frame->rect.height, canvas->framePixels, decoder->info);
+}
+
+bool ZLWebPCanvasRenderNextFrame(ZLWebPCanvas *canvas, const ZLWebPDecoder *decoder, ZLWebPRect *dirtyRect) {
+    size_t index = canvas->nextFrame;
+    if (index >= decoder->frameCount) {
+        return false;
+    }
+
+    ZLWebPRect dirty = {0, 0, 0, 0};
+    if (index == 0) {
+        memset(canvas->pixels, 0, (size_t)canvas->width * canvas->height * sizeof(uint32_t));
+        dirty.width = canvas->width;
+        dirty.height = canvas->height;
+    } else if (canvas->previousDisposeBackground) {
+        ZLWebPRect rect = canvas->previousRect;
+        for (uint32_t row = 0; row < rect.height; row++) {
+            memset(canvas->pixels + (size_t)(rect.y + row) * canvas->width + rect.x, 0, rect.width * sizeof(uint32_t));
+        }
+        dirty = rect;
+    }
+
+    const ZLWebPFrame *frame = &decoder->frames[index];
+    ZLWebPRect rect = ZLWebPClipRect(canvas, frame->rect);
+    if (rect.width > 0 && rect.height > 0 && ZLWebPDecodeFrame(canvas, decoder, frame)) {
+        for (uint32_t row = 0; row < rect.height; row++) {
+            const uint32_t *source = canvas->framePixels + (size_t)row * frame->rect.width;
+            uint32_t *target = canvas->pixels + (size_t)(rect.y + row) * canvas->width + rect.x;
+            if (frame->blend) {
+                for (uint32_t x = 0; x < rect.width; x++) {
+                    target[x] = ZLWebPCompositeOver(source[x], target[x]);
+                }
+            } else {
+                memcpy(target, source, rect.width * sizeof(uint32_t));
+            }
+        }
+    }
+
+    canvas->previousRect = rect;
+    canvas->previousDisposeBackground = frame->disposeBackground;
+    canvas->nextFrame = index + 1;
+    if (dirtyRect) {
+        *dirtyRect = ZLWebPUnionRect(dirty, rect);
+    }
+    return true;
+}
@@ -0,0 +1,95 @@
+//
+//  ZLWebPDecoder.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#ifndef ZLWebPDecoder_h
+#define ZLWebPDecoder_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 流式动画 WebP 解码，用法与 ZLGIFDecoder 相同：数据可以分多次追加，每收全一个 ANMF 块就能合成这一帧。
+/// ZLWebPDecoder 只解析 RIFF 容器、记录每帧的码流在哪些块中；帧本身的 VP8/VP8L 码流交给创建时传入的 frameDecoder
+/// （iOS 上是 ImageIO）。ZLWebPCanvas 是一块可复用的画布，按顺序把每帧合成上去，只改动帧所在的矩形并按 blending、disposal 处理。
+/// 同一个 decoder 可以有多块画布，都不加锁，由调用方串行访问
+typedef struct ZLWebPDecoder ZLWebPDecoder;
+
+typedef struct ZLWebPCanvas ZLWebPCanvas;
+
+typedef struct ZLWebPRect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+} ZLWebPRect;
+
+typedef enum ZLWebPSniffResult {
+    ZLWebPSniffNeedMoreData = 0,
+    ZLWebPSniffAnimated,
+    ZLWebPSniffNotAnimated,     // 静态 WebP 或者不是 WebP
+} ZLWebPSniffResult;
+
+/// 解码一个单帧 WebP 文件：RIFF 头，有 ALPH 时再加 VP8X 和 ALPH，最后是 VP8 或 VP8L 块。
+/// 把 width * height 个主机字节序的 32 位 ARGB（预乘）按行写进 pixels；失败返回 false，这一帧不改动画布
+typedef bool (*ZLWebPFrameDecoder)(const uint8_t *bytes, size_t length, uint32_t width, uint32_t height, uint32_t *pixels, void *info);
+
+/// 只看文件头和 VP8X 块的动画标记
+ZLWebPSniffResult ZLWebPSniff(const uint8_t *bytes, size_t length);
+
+ZLWebPDecoder *ZLWebPDecoderCreate(ZLWebPFrameDecoder frameDecoder, void *info);
+
+void ZLWebPDecoderDestroy(ZLWebPDecoder *decoder);
+
+/// 追加新收到的数据并解析其中完整的块；数据不是动画 WebP、结构损坏或画布超过 2^26 像素时返回 false，已解析的帧仍可使用
+bool ZLWebPDecoderAppend(ZLWebPDecoder *decoder, const uint8_t *bytes, size_t length);
+
+/// 已追加的数据长度
+size_t ZLWebPDecoderDataLength(const ZLWebPDecoder *decoder);
+
+/// 读到了 RIFF 的末尾或数据损坏，之后不会再有新的帧
+bool ZLWebPDecoderIsComplete(const ZLWebPDecoder *decoder);
+
+/// 画布尺寸，VP8X 还没收全时为 0
+uint32_t ZLWebPDecoderWidth(const ZLWebPDecoder *decoder);
+
+uint32_t ZLWebPDecoderHeight(const ZLWebPDecoder *decoder);
+
+/// 播放次数，0 表示无限循环
+uint32_t ZLWebPDecoderLoopCount(const ZLWebPDecoder *decoder);
+
+/// 已收全的帧数
+size_t ZLWebPDecoderFrameCount(const ZLWebPDecoder *decoder);
+
+/// 帧的显示时长，单位毫秒；与 GIF 一致，把不超过 10ms 的时长当作 100ms
+uint32_t ZLWebPDecoderFrameDuration(const ZLWebPDecoder *decoder, size_t index);
+
+/// 解码器的画布尺寸还未知时返回 NULL
+ZLWebPCanvas *ZLWebPCanvasCreate(const ZLWebPDecoder *decoder);
+
+void ZLWebPCanvasDestroy(ZLWebPCanvas *canvas);
+
+/// 回到第 0 帧之前的状态
+void ZLWebPCanvasReset(ZLWebPCanvas *canvas);
+
+/// 下一次 ZLWebPCanvasRenderNextFrame 合成的帧
+size_t ZLWebPCanvasNextFrameIndex(const ZLWebPCanvas *canvas);
+
+/// 合成下一帧，dirtyRect 返回这次改动的区域；下一帧还没收全时返回 false
+bool ZLWebPCanvasRenderNextFrame(ZLWebPCanvas *canvas, const ZLWebPDecoder *decoder, ZLWebPRect *dirtyRect);
+
+/// 画布像素，每行 width 个，主机字节序的 32 位 ARGB（预乘，透明像素为 0），与 ZLGIFCanvasPixels 相同
+const uint32_t *ZLWebPCanvasPixels(const ZLWebPCanvas *canvas);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLWebPDecoder_h */
@@ -38,6 +38,19 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (void)webSocket:(ZLWebSocket *)webSocket didReceiveMessageWithData:(NSData *)data;
 
+/**
+ Called with parts of a message as they arrive, instead of buffering the whole message.
+
+ If implemented, `webSocket:didReceiveMessageWithString:` and `webSocket:didReceiveMessageWithData:` are not called.
+ At most `maxPendingMessageChunkBytes` are queued for the delegate, after that the socket stops reading until it catches up.
+
+ @param webSocket An instance of `ZLWebSocket` that received a message.
+ @param chunk     The next part of the message. For text messages this is UTF-8 and may end in the middle of a character.
+ @param isText    Whether the message is a text message.
+ @param isFinal   Whether this is the last part of the message. The last part may be empty.
+ */
+- (void)webSocket:(ZLWebSocket *)webSocket didReceiveMessageChunk:(NSData *)chunk isText:(BOOL)isText isFinal:(BOOL)isFinal;
+
 #pragma mark Status & Connection
 
 /**
@@ -155,6 +168,44 @@ typedef NS_ENUM(NSInteger, ZLStatusCode) {
 @end
 
 
+/**
+ Latency statistics of a network thread. Network threads drive the streams, ping and reconnect timers of the sockets assigned to them.
+ */
+@interface ZLNetworkThreadMetrics : NSObject
+
+/**
+ Name of the thread.
+ */
+@property (nonatomic, copy, readonly) NSString *threadName;
+
+/**
+ Number of sockets assigned to the thread.
+ */
+@property (nonatomic, assign, readonly) NSUInteger socketCount;
+
+/**
+ Number of times the thread woke up to handle stream events or timers.
+ */
+@property (nonatomic, assign, readonly) uint64_t wakeupCount;
+
+/**
+ Average time the thread was busy per wakeup.
+ */
+@property (nonatomic, assign, readonly) NSTimeInterval averageBusyTime;
+
+/**
+ Longest time the thread was busy in a single wakeup, which is the longest an event of another socket on the same thread had to wait.
+ */
+@property (nonatomic, assign, readonly) NSTimeInterval maxBusyTime;
+
+/**
+ Number of pending ping, pong, reconnect and cleanup timers of the sockets on the thread.
+ */
+@property (nonatomic, assign, readonly) NSUInteger timerCount;
+
+@end
+
+
 /*-------------------------------------------------------------------------------*/
 /*-------------------------------------------------------------------------------*/
 /*-------------------------------------------------------------------------------*/
@@ -193,6 +244,79 @@ typedef NS_ENUM(NSInteger, ZLStatusCode) {
  */
 @property (nonatomic, assign) int pingInterval;
 
+/**
+ Time to wait for the pong of a ping. If it doesn't arrive the connection is considered dead and fails with `NSURLErrorTimedOut`. Default: 5s
+ */
+@property (nonatomic, assign) NSTimeInterval pongTimeout;
+
+/**
+ Whether to offer the permessage-deflate extension (RFC 7692) when opening. Default: NO.
+
+ Messages are only compressed if the server accepts the offer. Changes apply to the next `open` or reconnect.
+ */
+@property (nonatomic, assign) BOOL enablesPerMessageDeflate;
+
+/**
+ Largest LZ77 window, in bits, the client compresses with. Valid values are 9-15. Default: 15.
+ */
+@property (nonatomic, assign) uint8_t clientMaxWindowBits;
+
+/**
+ Largest LZ77 window, in bits, the server is asked to compress with. Valid values are 8-15. Default: 15.
+ */
+@property (nonatomic, assign) uint8_t serverMaxWindowBits;
+
+/**
+ Whether the client resets its compression context after each message. Saves memory at the cost of ratio. Default: NO.
+ */
+@property (nonatomic, assign) BOOL clientNoContextTakeover;
+
+/**
+ Whether the server is asked to reset its compression context after each message. Default: NO.
+ */
+@property (nonatomic, assign) BOOL serverNoContextTakeover;
+
+/**
+ Messages with fewer bytes than this are sent uncompressed. Default: 64.
+ */
+@property (nonatomic, assign) NSUInteger compressionThreshold;
+
+/**
+ Largest size a received compressed message may inflate to. Larger messages close the connection with `ZLStatusCodeMessageTooBig`. 0 disables the limit. Default: 64MB.
+ */
+@property (nonatomic, assign) NSUInteger maxInflatedMessageLength;
+
+/**
+ Bytes of message chunks that may be waiting for `webSocket:didReceiveMessageChunk:isText:isFinal:`. Default: 1MB.
+ */
+@property (nonatomic, assign) NSUInteger maxPendingMessageChunkBytes;
+
+/**
+ Whether plain `ws://` connections use the non-blocking socket backend (kqueue on Darwin, epoll on Linux) of the network thread instead of CFStream. Default: NO.
+
+ `wss://` and connections through an HTTP or SOCKS proxy always use CFStream. Changes apply to the next `open` or reconnect.
+ */
+@property (nonatomic, assign) BOOL usesEventLoopSockets;
+
+/**
+ Sockets with the same affinity key run on the same network thread. Sockets without one are assigned to the threads round-robin. Default: `nil`.
+
+ Must be set before the first `open`. The socket keeps its thread across reconnects.
+ */
+@property (nullable, nonatomic, copy) NSString *networkThreadAffinity;
+
+/**
+ Number of network threads shared by all sockets. Default: number of active processors, at most 4.
+
+ Only takes effect if set before the first socket opens.
+ */
+@property (class, nonatomic, assign) NSUInteger networkThreadCount;
+
+/**
+ Snapshot of the latency statistics of every network thread.
+ */
++ (NSArray<ZLNetworkThreadMetrics *> *)networkThreadMetrics;
+
 /**
  An instance of `NSURL` that this socket connects to.
  */
@@ -372,6 +496,37 @@ typedef NS_ENUM(NSInteger, ZLStatusCode) {
  */
 - (BOOL)sendDataNoCopy:(nullable NSData *)data error:(NSError **)error NS_SWIFT_NAME(send(dataNoCopy:));
 
+/**
+ Send a burst of messages to the server at once.
+
+ All frames are built into a single buffer and handed to the stream together,
+ which is much cheaper than sending small messages one by one.
+
+ @param messages Messages to send, in order. `NSString` elements are sent as text messages, `NSData` elements as binary messages.
+ @param error    On input, a pointer to variable for an `NSError` object.
+ If an error occurs, this pointer is set to an `NSError` object containing information about the error.
+ You may specify `nil` to ignore the error information.
+
+ @return `YES` if the messages were scheduled to send, otherwise - `NO`.
+ */
+- (BOOL)sendMessages:(NSArray *)messages error:(NSError **)error NS_SWIFT_NAME(send(messages:));
+
+/**
+ Send the contents of a stream to the server as one binary message, without reading it into memory first.
+
+ The stream is sent in continuation frames and only read while little output is waiting, so memory stays flat
+ regardless of the message size. It is read on the socket's work queue, so it should be backed by a file or memory.
+ Messages sent while the stream is in flight follow after it.
+
+ @param inputStream Stream to send, opened if needed and closed when done.
+ @param error       On input, a pointer to variable for an `NSError` object.
+ If an error occurs, this pointer is set to an `NSError` object containing information about the error.
+ You may specify `nil` to ignore the error information.
+
+ @return `YES` if the stream was scheduled to send, otherwise - `NO`.
+ */
+- (BOOL)sendDataWithInputStream:(NSInputStream *)inputStream error:(NSError **)error NS_SWIFT_NAME(send(inputStream:));
+
 /**
  Send Ping message to the server with optional data.
 
@@ -8,6 +8,16 @@
 #import "ZLWebSocket.h"
 #import <CommonCrypto/CommonDigest.h>
 #import <Security/Security.h>
+#import <zlib.h>
+#import "ZLUTF8Validator.h"
+#import "ZLTimerWheel.h"
+#import "ZLHTTPResponseParser.h"
+#import "ZLProxyResolver.h"
+#import "ZLEventLoop.h"
+#import "ZLSocketStream.h"
+#import <netdb.h>
+#import <stdatomic.h>
+#import <time.h>
 
 typedef NS_ENUM(uint8_t, ZLOpCode) {
     ZLOpCodeTextFrame = 0x1,
@@ -21,7 +31,7 @@ typedef NS_ENUM(uint8_t, ZLOpCode) {
 
 typedef struct {
     BOOL fin;
-    //  BOOL rsv1;
+    BOOL rsv1;
     //  BOOL rsv2;
     //  BOOL rsv3;
     uint8_t opcode;
@@ -45,74 +55,6 @@ static size_t ZLDefaultBufferSize(void) {
     return size;
 }
 
-#if TARGET_OS_IPHONE
-#import <unicode/utf8.h>
-
-static inline int32_t validate_dispatch_data_partial_string(NSData *data) {
-    if ([data length] > INT32_MAX) {
-        // INT32_MAX is the limit so long as this Framework is using 32 bit ints everywhere.
-        return -1;
-    }
-
-    int32_t size = (int32_t)[data length];
-
-    const void * contents = [data bytes];
-    const uint8_t *str = (const uint8_t *)contents;
-
-    UChar32 codepoint = 1;
-    int32_t offset = 0;
-    int32_t lastOffset = 0;
-    while(offset < size && codepoint > 0)  {
-        lastOffset = offset;
-        U8_NEXT(str, offset, size, codepoint);
-    }
-
-    if (codepoint == -1) {
-        // Check to see if the last byte is valid or whether it was just continuing
-        if (!U8_IS_LEAD(str[lastOffset]) || U8_COUNT_TRAIL_BYTES(str[lastOffset]) + lastOffset < (int32_t)size) {
-
-            size = -1;
-        } else {
-            uint8_t leadByte = str[lastOffset];
-            U8_MASK_LEAD_BYTE(leadByte, U8_COUNT_TRAIL_BYTES(leadByte));
-
-            for (int i = lastOffset + 1; i < offset; i++) {
-                if (U8_IS_SINGLE(str[i]) || U8_IS_LEAD(str[i]) || !U8_IS_TRAIL(str[i])) {
-                    size = -1;
-                }
-            }
-
-            if (size != -1) {
-                size = lastOffset;
-            }
-        }
-    }
-
-    if (size != -1 && ![[NSString alloc] initWithBytesNoCopy:(char *)[data bytes] length:size encoding:NSUTF8StringEncoding freeWhenDone:NO]) {
-        size = -1;
-    }
-
-    return size;
-}
-
-#else
-
-// This is a hack, and probably not optimal
-static inline int32_t validate_dispatch_data_partial_string(NSData *data) {
-    static const int maxCodepointSize = 3;
-
-    for (int i = 0; i < maxCodepointSize; i++) {
-        NSString *str = [[NSString alloc] initWithBytesNoCopy:(char *)data.bytes length:data.length - i encoding:NSUTF8StringEncoding freeWhenDone:NO];
-        if (str) {
-            return (int32_t)data.length - i;
-        }
-    }
-
-    return -1;
-}
-
-#endif
-
 static NSData *ZLSHA1HashFromBytes(const char *bytes, size_t length) {
     uint8_t outputLength = CC_SHA1_DIGEST_LENGTH;
     unsigned char output[outputLength];
@@ -257,11 +199,62 @@ static void ZLMaskBytesSIMD(uint8_t *bytes, size_t length, uint8_t *maskKey) {
     ZLMaskBytesManual(bytes + manualStartOffset, manualLength, (uint8_t *) &maskVector);
 }
 
+/**
+ Unmask a chunk of a frame payload that starts `maskOffset` bytes into the frame.
+
+ @param bytes      The bytes to unmask in place.
+ @param length     The number of bytes.
+ @param maskKey    The 4-byte masking key of the frame.
+ @param maskOffset The offset of `bytes` inside the frame payload.
+ */
+static void ZLUnmaskBytesAtOffset(uint8_t *bytes, size_t length, const uint8_t *maskKey, size_t maskOffset) {
+    uint8_t rotatedMaskKey[sizeof(uint32_t)];
+    for (size_t i = 0; i < sizeof(uint32_t); i++) {
+        rotatedMaskKey[i] = maskKey[(maskOffset + i) % sizeof(uint32_t)];
+    }
+    ZLMaskBytesSIMD(bytes, length, rotatedMaskKey);
+}
+
+/**
+ Mask bytes while copying them, so the payload is only touched once.
+
+ @param destination The buffer to write the masked bytes to.
+ @param source      The bytes to mask.
+ @param length      The number of bytes.
+ @param maskKey     The 4-byte masking key.
+ */
+static void ZLMaskBytesCopy(uint8_t *destination, const uint8_t *source, size_t length, const uint8_t *maskKey) {
+    uint8x32_t maskVector = { };
+    memset_pattern4(&maskVector, maskKey, sizeof(uint8x32_t));
+
+    // The vector length is a multiple of the key length, so the mask lines up for every chunk.
+    size_t offset = 0;
+    for (; offset + sizeof(uint8x32_t) <= length; offset += sizeof(uint8x32_t)) {
+        uint8x32_t vector;
+        memcpy(&vector, source + offset, sizeof(uint8x32_t));
+        vector ^= maskVector;
+        memcpy(destination + offset, &vector, sizeof(uint8x32_t));
+    }
+    for (; offset < length; offset++) {
+        destination[offset] = source[offset] ^ maskKey[offset % sizeof(uint32_t)];
+    }
+}
+
+// The payload length comes from the peer, so never reserve more than this up front.
+static const size_t ZLMaxFramePreallocationSize = 16 * 1024 * 1024;
+
+// Size of the chunks streamed messages are delivered and sent in.
+static const size_t ZLMessageChunkSize = 64 * 1024;
+
+// Stop reading from an outgoing stream while this much is still waiting to be written.
+static const size_t ZLOutgoingStreamHighWaterMark = 4 * ZLMessageChunkSize;
+
 static CFHTTPMessageRef ZLHTTPConnectMessageCreate(NSURLRequest *request,
                                                    NSString *securityKey,
                                                    uint8_t webSocketProtocolVersion,
                                                    NSArray<NSHTTPCookie *> *_Nullable cookies,
-                                                   NSArray<NSString *> *_Nullable requestedProtocols) {
+                                                   NSArray<NSString *> *_Nullable requestedProtocols,
+                                                   NSString *_Nullable extensionOffer) {
     NSURL *url = request.URL;
 
     CFHTTPMessageRef message = CFHTTPMessageCreateRequest(NULL, CFSTR("GET"), (__bridge CFURLRef)url, kCFHTTPVersion1_1);
@@ -307,6 +300,10 @@ static CFHTTPMessageRef ZLHTTPConnectMessageCreate(NSURLRequest *request,
                                          (__bridge CFStringRef)[requestedProtocols componentsJoinedByString:@", "]);
     }
 
+    if (extensionOffer.length) {
+        CFHTTPMessageSetHeaderFieldValue(message, CFSTR("Sec-WebSocket-Extensions"), (__bridge CFStringRef)extensionOffer);
+    }
+
     [request.allHTTPHeaderFields enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
         CFHTTPMessageSetHeaderFieldValue(message, (__bridge CFStringRef)key, (__bridge CFStringRef)obj);
     }];
@@ -422,6 +419,287 @@ typedef void (^data_callback)(ZLWebSocket *webSocket,  NSData *data);
 
 @end
 
+typedef NS_ENUM(NSInteger, ZLInflateResult) {
+    ZLInflateResultOK,
+    ZLInflateResultInvalidData,
+    /// The message inflated past `maxInflatedMessageLength`.
+    ZLInflateResultMessageTooBig,
+};
+
+/**
+ permessage-deflate (RFC 7692) state of one connection: the extension negotiation and the zlib streams.
+ */
+@interface ZLPerMessageDeflate : NSObject
+
+/// Messages shorter than this are sent uncompressed.
+@property (nonatomic, assign) NSUInteger compressionThreshold;
+
+/// Largest size one received message may inflate to, 0 for no limit.
+@property (nonatomic, assign) NSUInteger maxInflatedMessageLength;
+
+/// NO when the server limited the client window below what zlib can compress with.
+@property (nonatomic, assign, readonly) BOOL canCompress;
+
+- (instancetype)initWithClientMaxWindowBits:(uint8_t)clientMaxWindowBits
+                        serverMaxWindowBits:(uint8_t)serverMaxWindowBits
+                    clientNoContextTakeover:(BOOL)clientNoContextTakeover
+                    serverNoContextTakeover:(BOOL)serverNoContextTakeover;
+
+/// Value of the `Sec-WebSocket-Extensions` request header.
+- (NSString *)extensionOffer;
+
+/// Applies the `Sec-WebSocket-Extensions` response header, returns NO if it is not a valid answer to our offer.
+- (BOOL)acceptExtensionResponse:(NSString *)response;
+
+/// Inflates a chunk of a compressed message and appends the output to `data`.
+- (ZLInflateResult)inflateBytes:(const void *)bytes length:(size_t)length intoData:(NSMutableData *)data;
+
+/// Flushes the end of a compressed message into `data`.
+- (ZLInflateResult)finishInflatingIntoData:(NSMutableData *)data;
+
+/// Returns the compressed payload, or nil if the message should be sent uncompressed.
+- (nullable NSData *)deflateData:(NSData *)data;
+
+@end
+
+static const uint8_t ZLDeflateTrailer[] = {0x00, 0x00, 0xFF, 0xFF};
+
+@implementation ZLPerMessageDeflate {
+    uint8_t _clientMaxWindowBits;
+    uint8_t _serverMaxWindowBits;
+    BOOL _clientNoContextTakeover;
+    BOOL _serverNoContextTakeover;
+
+    z_stream _inflateStream;
+    BOOL _inflateInitialized;
+    NSUInteger _inflatedMessageLength;
+    z_stream _deflateStream;
+    BOOL _deflateInitialized;
+}
+
+- (instancetype)initWithClientMaxWindowBits:(uint8_t)clientMaxWindowBits
+                        serverMaxWindowBits:(uint8_t)serverMaxWindowBits
+                    clientNoContextTakeover:(BOOL)clientNoContextTakeover
+                    serverNoContextTakeover:(BOOL)serverNoContextTakeover {
+    self = [super init];
+    if (self) {
+        // zlib can't produce raw deflate with an 8 bit window, so never offer it for our side.
+        _clientMaxWindowBits = MIN(MAX(clientMaxWindowBits, 9), MAX_WBITS);
+        _serverMaxWindowBits = MIN(MAX(serverMaxWindowBits, 8), MAX_WBITS);
+        _clientNoContextTakeover = clientNoContextTakeover;
+        _serverNoContextTakeover = serverNoContextTakeover;
+        _canCompress = YES;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_inflateInitialized) {
+        inflateEnd(&_inflateStream);
+    }
+    if (_deflateInitialized) {
+        deflateEnd(&_deflateStream);
+    }
+}
+
+- (NSString *)extensionOffer {
+    NSMutableString *offer = [NSMutableString stringWithString:@"permessage-deflate"];
+    if (_clientNoContextTakeover) {
+        [offer appendString:@"; client_no_context_takeover"];
+    }
+    if (_serverNoContextTakeover) {
+        [offer appendString:@"; server_no_context_takeover"];
+    }
+    if (_serverMaxWindowBits < MAX_WBITS) {
+        [offer appendFormat:@"; server_max_window_bits=%d", _serverMaxWindowBits];
+    }
+    if (_clientMaxWindowBits < MAX_WBITS) {
+        [offer appendFormat:@"; client_max_window_bits=%d", _clientMaxWindowBits];
+    } else {
+        [offer appendString:@"; client_max_window_bits"];
+    }
+    return offer;
+}
+
+static BOOL ZLParseWindowBits(NSString *value, uint8_t maxWindowBits, uint8_t *windowBits) {
+    if (value.length == 0 || value.length > 2 || [value rangeOfCharacterFromSet:[NSCharacterSet decimalDigitCharacterSet].invertedSet].location != NSNotFound) {
+        return NO;
+    }
+    NSInteger bits = value.integerValue;
+    if (bits < 8 || bits > maxWindowBits) {
+        return NO;
+    }
+    *windowBits = (uint8_t)bits;
+    return YES;
+}
+
+- (BOOL)acceptExtensionResponse:(NSString *)response {
+    // We offered a single extension, so the server can't answer with more than that.
+    NSArray<NSString *> *extensions = [response componentsSeparatedByString:@","];
+    if (extensions.count != 1) {
+        return NO;
+    }
+
+    NSCharacterSet *whitespace = [NSCharacterSet whitespaceCharacterSet];
+    NSArray<NSString *> *params = [extensions.firstObject componentsSeparatedByString:@";"];
+    if (![[params.firstObject stringByTrimmingCharactersInSet:whitespace] isEqualToString:@"permessage-deflate"]) {
+        return NO;
+    }
+
+    NSMutableSet<NSString *> *seenParams = [NSMutableSet set];
+    uint8_t clientWindowBits = _clientMaxWindowBits;
+    uint8_t serverWindowBits = _serverMaxWindowBits;
+    for (NSUInteger i = 1; i < params.count; i++) {
+        NSString *param = [params[i] stringByTrimmingCharactersInSet:whitespace];
+        NSString *name = param;
+        NSString *value = nil;
+        NSRange separator = [param rangeOfString:@"="];
+        if (separator.location != NSNotFound) {
+            name = [[param substringToIndex:separator.location] stringByTrimmingCharactersInSet:whitespace];
+            value = [[param substringFromIndex:NSMaxRange(separator)] stringByTrimmingCharactersInSet:whitespace];
+            value = [value stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@"\""]];
+        }
+        if ([seenParams containsObject:name]) {
+            return NO;
+        }
+        [seenParams addObject:name];
+
+        if ([name isEqualToString:@"server_no_context_takeover"] && value == nil) {
+            _serverNoContextTakeover = YES;
+        } else if ([name isEqualToString:@"client_no_context_takeover"] && value == nil) {
+            _clientNoContextTakeover = YES;
+        } else if ([name isEqualToString:@"server_max_window_bits"]) {
+            if (!ZLParseWindowBits(value, _serverMaxWindowBits, &serverWindowBits)) {
+                return NO;
+            }
+        } else if ([name isEqualToString:@"client_max_window_bits"]) {
+            if (!ZLParseWindowBits(value, _clientMaxWindowBits, &clientWindowBits)) {
+                return NO;
+            }
+        } else {
+            return NO;
+        }
+    }
+
+    _clientMaxWindowBits = clientWindowBits;
+    _serverMaxWindowBits = serverWindowBits;
+    _canCompress = clientWindowBits >= 9;
+    return YES;
+}
+
+- (ZLInflateResult)inflateBytes:(const void *)bytes length:(size_t)length intoData:(NSMutableData *)data {
+    if (!_inflateInitialized) {
+        if (inflateInit2(&_inflateStream, -MAX_WBITS) != Z_OK) {
+            return ZLInflateResultInvalidData;
+        }
+        _inflateInitialized = YES;
+    }
+    if (length > UINT32_MAX) {
+        return ZLInflateResultInvalidData;
+    }
+
+    z_stream *stream = &_inflateStream;
+    stream->next_in = (Bytef *)bytes;
+    stream->avail_in = (uInt)length;
+
+    // Inflate straight into the frame buffer, growing it as we go.
+    NSUInteger usedLength = data.length;
+    while (YES) {
+        NSUInteger capacity = MIN(MAX(length * 2, ZLDefaultBufferSize()), (NSUInteger)UINT_MAX);
+        if (_maxInflatedMessageLength) {
+            // One byte past the limit is enough to tell that the message is too big.
+            capacity = MIN(capacity, _maxInflatedMessageLength - MIN(_inflatedMessageLength, _maxInflatedMessageLength) + 1);
+        }
+        data.length = usedLength + capacity;
+        stream->next_out = (Bytef *)data.mutableBytes + usedLength;
+        stream->avail_out = (uInt)capacity;
+
+        int result = inflate(stream, Z_SYNC_FLUSH);
+        NSUInteger inflatedLength = capacity - stream->avail_out;
+        usedLength += inflatedLength;
+        _inflatedMessageLength += inflatedLength;
+
+        if (_maxInflatedMessageLength && _inflatedMessageLength > _maxInflatedMessageLength) {
+            data.length = usedLength;
+            return ZLInflateResultMessageTooBig;
+        }
+        if (result == Z_STREAM_END) {
+            // The peer ended the deflate stream (BFINAL), anything after starts a new one.
+            inflateReset(stream);
+        } else if (result != Z_OK && !(result == Z_BUF_ERROR && stream->avail_in == 0)) {
+            data.length = usedLength;
+            return ZLInflateResultInvalidData;
+        }
+        if (stream->avail_in == 0 && stream->avail_out != 0) {
+            break;
+        }
+    }
+    data.length = usedLength;
+    return ZLInflateResultOK;
+}
+
+- (ZLInflateResult)finishInflatingIntoData:(NSMutableData *)data {
+    ZLInflateResult result = [self inflateBytes:ZLDeflateTrailer length:sizeof(ZLDeflateTrailer) intoData:data];
+    if (_serverNoContextTakeover && _inflateInitialized) {
+        inflateReset(&_inflateStream);
+    }
+    _inflatedMessageLength = 0;
+    return result;
+}
+
+- (nullable NSData *)deflateData:(NSData *)data {
+    if (!_canCompress || data.length < _compressionThreshold || data.length > UINT32_MAX) {
+        return nil;
+    }
+    if (!_deflateInitialized) {
+        if (deflateInit2(&_deflateStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -_clientMaxWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return nil;
+        }
+        _deflateInitialized = YES;
+    }
+
+    z_stream *stream = &_deflateStream;
+    stream->next_in = (Bytef *)data.bytes;
+    stream->avail_in = (uInt)data.length;
+
+    NSMutableData *output = [[NSMutableData alloc] initWithLength:deflateBound(stream, data.length) + sizeof(ZLDeflateTrailer)];
+    NSUInteger usedLength = 0;
+    int result;
+    do {
+        if (usedLength == output.length) {
+            output.length += ZLDefaultBufferSize();
+        }
+        stream->next_out = (Bytef *)output.mutableBytes + usedLength;
+        stream->avail_out = (uInt)(output.length - usedLength);
+        result = deflate(stream, Z_SYNC_FLUSH);
+        usedLength = output.length - stream->avail_out;
+    } while (result == Z_OK && stream->avail_out == 0);
+
+    if ((result != Z_OK && result != Z_BUF_ERROR) || stream->avail_in != 0) {
+        deflateReset(stream);
+        return nil;
+    }
+
+    // The sync flush ends with an empty stored block, which the receiver adds back.
+    if (usedLength >= sizeof(ZLDeflateTrailer) && memcmp((uint8_t *)output.bytes + usedLength - sizeof(ZLDeflateTrailer), ZLDeflateTrailer, sizeof(ZLDeflateTrailer)) == 0) {
+        usedLength -= sizeof(ZLDeflateTrailer);
+    }
+
+    // Dropping compressed output is only safe if the next message doesn't reference it.
+    if (usedLength >= data.length) {
+        deflateReset(stream);
+        return nil;
+    }
+    if (_clientNoContextTakeover) {
+        deflateReset(stream);
+    }
+
+    output.length = usedLength;
+    return output;
+}
+
+@end
+
 @interface ZLSecurityPolicy ()
 
 @property (nonatomic, assign, readonly) BOOL certificateChainValidationEnabled;
@@ -459,31 +737,136 @@ typedef void (^data_callback)(ZLWebSocket *webSocket,  NSData *data);
 
 @end
 
+@interface ZLNetworkThreadMetrics ()
+
+@property (nonatomic, copy, readwrite) NSString *threadName;
+@property (nonatomic, assign, readwrite) NSUInteger socketCount;
+@property (nonatomic, assign, readwrite) uint64_t wakeupCount;
+@property (nonatomic, assign, readwrite) NSTimeInterval averageBusyTime;
+@property (nonatomic, assign, readwrite) NSTimeInterval maxBusyTime;
+@property (nonatomic, assign, readwrite) NSUInteger timerCount;
+
+@end
+
+@implementation ZLNetworkThreadMetrics
+
+@end
+
 @interface ZLRunLoopThread : NSThread
 
 @property (nonatomic, strong) NSRunLoop *runLoop;
 
-+ (instancetype)sharedThread;
+// Sockets with the same affinity share a thread, `nil` picks the next thread round-robin.
++ (instancetype)threadForAffinity:(nullable NSString *)affinity;
+
++ (NSArray<ZLRunLoopThread *> *)allThreads;
+
+- (void)addSocket;
+- (void)removeSocket;
+
+// Runs `block` on this thread after `delay`, rounded up to the next wheel tick. Returns 0 on failure.
+// Can be called from any thread.
+- (uint64_t)scheduleTimerWithDelay:(NSTimeInterval)delay block:(dispatch_block_t)block;
+// Ignores timers that already fired or were cancelled.
+- (void)cancelTimer:(uint64_t)timerID;
+
+- (ZLNetworkThreadMetrics *)metrics;
+
+// Event loop for sockets that bypass CFStream, created on first use. Its callbacks run on this thread.
+// Returns NULL if it can't be created.
+- (nullable ZLEventLoop *)eventLoop;
 
 @end
 
 @interface ZLRunLoopThread () {
     dispatch_group_t _waitGroup;
+
+    atomic_long _socketCount;
+
+    // Timers of all sockets on this thread share one timing wheel driven by a single run loop timer,
+    // so thousands of idle sockets don't mean thousands of run loop timers.
+    dispatch_semaphore_t _timerLock;
+    ZLTimerWheel *_timerWheel;
+    CFRunLoopTimerRef _wheelTimer;
+    uint64_t _armedTick;
+
+    // Written only by the thread itself, read by `metrics` from any thread.
+    uint64_t _wakeupTime;
+    _Atomic uint64_t _wakeupCount;
+    _Atomic uint64_t _busyNanoseconds;
+    _Atomic uint64_t _maxBusyNanoseconds;
+
+    ZLEventLoop *_eventLoop;
+    CFFileDescriptorRef _eventLoopDescriptor;
 }
 
+- (void)runLoopDidWakeUp;
+- (void)runLoopWillSleep;
+
 @end
 
+// 0 means one thread per active processor, at most 4.
+static NSUInteger ZLNetworkThreadCount = 0;
+static NSArray<ZLRunLoopThread *> *ZLNetworkThreads = nil;
+
+static NSUInteger ZLResolvedNetworkThreadCount(void) {
+    return ZLNetworkThreadCount ?: MIN(MAX([NSProcessInfo processInfo].activeProcessorCount, (NSUInteger)1), (NSUInteger)4);
+}
+
+// Timers due within the same tick fire in one wakeup.
+static const uint64_t ZLTimerWheelTickNanoseconds = 50 * NSEC_PER_MSEC;
+
+// The wheel timer repeats so it stays valid after firing, `armWheelTimer` decides when it actually fires.
+static const CFTimeInterval ZLWheelTimerIdleInterval = 1.0e9;
+
+static uint64_t ZLTimerWheelCurrentTick(void) {
+    return clock_gettime_nsec_np(CLOCK_UPTIME_RAW) / ZLTimerWheelTickNanoseconds;
+}
+
+static void ZLRunLoopThreadCollectTimer(void *context, void *info) {
+    [(__bridge NSMutableArray<dispatch_block_t> *)info addObject:(__bridge_transfer dispatch_block_t)context];
+}
+
+static void ZLRunLoopThreadObserverCallBack(CFRunLoopObserverRef observer, CFRunLoopActivity activity, void *info) {
+    ZLRunLoopThread *thread = (__bridge ZLRunLoopThread *)info;
+    if (activity == kCFRunLoopAfterWaiting) {
+        [thread runLoopDidWakeUp];
+    } else {
+        [thread runLoopWillSleep];
+    }
+}
+
+// The run loop watches the event loop's kqueue, so socket events count towards the thread metrics like any other source.
+static void ZLRunLoopThreadEventLoopCallBack(CFFileDescriptorRef descriptor, CFOptionFlags callBackTypes, void *info) {
+    ZLEventLoopRunOnce(info, 0);
+    // File descriptor callbacks are one-shot.
+    CFFileDescriptorEnableCallBacks(descriptor, kCFFileDescriptorReadCallBack);
+}
+
 @implementation ZLRunLoopThread
 
-+ (instancetype)sharedThread {
-    static ZLRunLoopThread *thread;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        thread = [[ZLRunLoopThread alloc] init];
-        thread.name = @"com.richie.ZLWebSocket.NetworkThread";
-        [thread start];
-    });
-    return thread;
++ (NSArray<ZLRunLoopThread *> *)allThreads {
+    @synchronized (self) {
+        if (ZLNetworkThreads == nil) {
+            NSUInteger count = ZLResolvedNetworkThreadCount();
+            NSMutableArray<ZLRunLoopThread *> *threads = [NSMutableArray arrayWithCapacity:count];
+            for (NSUInteger i = 0; i < count; i++) {
+                ZLRunLoopThread *thread = [[ZLRunLoopThread alloc] init];
+                thread.name = [NSString stringWithFormat:@"com.richie.ZLWebSocket.NetworkThread.%lu", (unsigned long)i];
+                [thread start];
+                [threads addObject:thread];
+            }
+            ZLNetworkThreads = [threads copy];
+        }
+        return ZLNetworkThreads;
+    }
+}
+
++ (instancetype)threadForAffinity:(NSString *)affinity {
+    static atomic_uint nextIndex;
+    NSArray<ZLRunLoopThread *> *threads = [self allThreads];
+    NSUInteger index = affinity != nil ? affinity.hash : atomic_fetch_add(&nextIndex, 1);
+    return threads[index % threads.count];
 }
 
 - (instancetype)init {
@@ -491,6 +874,16 @@ typedef void (^data_callback)(ZLWebSocket *webSocket,  NSData *data);
     if (self) {
         _waitGroup = dispatch_group_create();
         dispatch_group_enter(_waitGroup);
+
+        _timerLock = dispatch_semaphore_create(1);
+        _timerWheel = ZLTimerWheelCreate(ZLTimerWheelCurrentTick());
+        _armedTick = UINT64_MAX;
+        // Idle until `armWheelTimer` moves the fire date to the next tick that has work.
+        __weak typeof(self) weakSelf = self;
+        _wheelTimer = CFRunLoopTimerCreateWithHandler(NULL, CFAbsoluteTimeGetCurrent() + ZLWheelTimerIdleInterval, ZLWheelTimerIdleInterval, 0, 0, ^(CFRunLoopTimerRef timer) {
+            [weakSelf fireTimers];
+        });
+        CFRunLoopTimerSetTolerance(_wheelTimer, ZLTimerWheelTickNanoseconds / 2 / (double)NSEC_PER_SEC);
     }
     return self;
 }
@@ -517,6 +910,20 @@ typedef void (^data_callback)(ZLWebSocket *webSocket,  NSData *data);
         CFRunLoopAddSource(CFRunLoopGetCurrent(), source, kCFRunLoopDefaultMode);
         CFRelease(source);
 
+        // Time between waking up and going back to sleep is how long events of other sockets on this thread may be delayed.
+        CFRunLoopObserverContext observerCtx = {
+            .version = 0,
+            .info = (__bridge void *)self,
+            .retain = NULL,
+            .release = NULL,
+            .copyDescription = NULL
+        };
+        CFRunLoopObserverRef observer = CFRunLoopObserverCreate(NULL, kCFRunLoopAfterWaiting | kCFRunLoopBeforeWaiting, true, 0, ZLRunLoopThreadObserverCallBack, &observerCtx);
+        CFRunLoopAddObserver(CFRunLoopGetCurrent(), observer, kCFRunLoopCommonModes);
+        CFRelease(observer);
+
+        CFRunLoopAddTimer(CFRunLoopGetCurrent(), _wheelTimer, kCFRunLoopCommonModes);
+
         while ([_runLoop runMode:NSDefaultRunLoopMode beforeDate:[NSDate distantFuture]]) {
 
         }
@@ -529,6 +936,417 @@ typedef void (^data_callback)(ZLWebSocket *webSocket,  NSData *data);
     return _runLoop;
 }
 
+- (void)runLoopDidWakeUp {
+    _wakeupTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
+
+- (void)runLoopWillSleep {
+    if (_wakeupTime == 0) {
+        return;
+    }
+    uint64_t busy = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - _wakeupTime;
+    _wakeupTime = 0;
+
+    atomic_fetch_add(&_wakeupCount, 1);
+    atomic_fetch_add(&_busyNanoseconds, busy);
+    uint64_t maxBusy = atomic_load(&_maxBusyNanoseconds);
+    while (busy > maxBusy && !atomic_compare_exchange_weak(&_maxBusyNanoseconds, &maxBusy, busy)) {
+    }
+}
+
+- (void)addSocket {
+    atomic_fetch_add(&_socketCount, 1);
+}
+
+- (void)removeSocket {
+    atomic_fetch_sub(&_socketCount, 1);
+}
+
+- (ZLEventLoop *)eventLoop {
+    @synchronized (self) {
+        if (_eventLoop == NULL) {
+            ZLEventLoop *eventLoop = ZLEventLoopCreate();
+            if (eventLoop == NULL) {
+                return NULL;
+            }
+            CFFileDescriptorContext context = {
+                .version = 0,
+                .info = eventLoop,
+                .retain = NULL,
+                .release = NULL,
+                .copyDescription = NULL
+            };
+            CFFileDescriptorRef descriptor = CFFileDescriptorCreate(NULL, ZLEventLoopFileDescriptor(eventLoop), false, ZLRunLoopThreadEventLoopCallBack, &context);
+            CFRunLoopSourceRef source = descriptor ? CFFileDescriptorCreateRunLoopSource(NULL, descriptor, 0) : NULL;
+            if (source == NULL) {
+                if (descriptor) {
+                    CFRelease(descriptor);
+                }
+                ZLEventLoopDestroy(eventLoop);
+                return NULL;
+            }
+            CFFileDescriptorEnableCallBacks(descriptor, kCFFileDescriptorReadCallBack);
+            // Network threads never exit, so neither the source nor the loop is ever torn down.
+            CFRunLoopRef runLoop = [self.runLoop getCFRunLoop];
+            CFRunLoopAddSource(runLoop, source, kCFRunLoopCommonModes);
+            CFRunLoopWakeUp(runLoop);
+            CFRelease(source);
+            _eventLoopDescriptor = descriptor;
+            _eventLoop = eventLoop;
+        }
+        return _eventLoop;
+    }
+}
+
+#pragma mark - Timers
+
+- (uint64_t)scheduleTimerWithDelay:(NSTimeInterval)delay block:(dispatch_block_t)block {
+    uint64_t nanoseconds = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    uint64_t now = nanoseconds / ZLTimerWheelTickNanoseconds;
+    // Round up so a timer never fires early.
+    uint64_t deadline = (nanoseconds + (uint64_t)(MAX(delay, 0) * NSEC_PER_SEC) + ZLTimerWheelTickNanoseconds - 1) / ZLTimerWheelTickNanoseconds;
+    void *context = (__bridge_retained void *)[block copy];
+
+    dispatch_semaphore_wait(_timerLock, DISPATCH_TIME_FOREVER);
+    if (ZLTimerWheelCount(_timerWheel) == 0) {
+        // Catch an idle wheel up with the clock, otherwise the timer lands far up in the wheel.
+        ZLTimerWheelAdvance(_timerWheel, now, ZLRunLoopThreadCollectTimer, NULL);
+    }
+    uint64_t timerID = ZLTimerWheelSchedule(_timerWheel, deadline, context);
+    if (timerID != 0) {
+        [self armWheelTimer];
+    }
+    dispatch_semaphore_signal(_timerLock);
+
+    if (timerID == 0) {
+        CFBridgingRelease(context);
+    }
+    return timerID;
+}
+
+- (void)cancelTimer:(uint64_t)timerID {
+    if (timerID == 0) {
+        return;
+    }
+    void *context = NULL;
+    dispatch_semaphore_wait(_timerLock, DISPATCH_TIME_FOREVER);
+    BOOL cancelled = ZLTimerWheelCancel(_timerWheel, timerID, &context);
+    dispatch_semaphore_signal(_timerLock);
+
+    // Released outside the lock, the block may hold the last reference to a socket.
+    if (cancelled) {
+        CFBridgingRelease(context);
+    }
+}
+
+// Called with `_timerLock` held. A timer firing a little early only costs an extra wakeup.
+- (void)armWheelTimer {
+    uint64_t next = ZLTimerWheelNextTick(_timerWheel);
+    if (next == _armedTick) {
+        return;
+    }
+    _armedTick = next;
+    CFAbsoluteTime fireDate = CFAbsoluteTimeGetCurrent() + ZLWheelTimerIdleInterval;
+    if (next != UINT64_MAX) {
+        int64_t nanoseconds = (int64_t)(next * ZLTimerWheelTickNanoseconds - clock_gettime_nsec_np(CLOCK_UPTIME_RAW));
+        fireDate = CFAbsoluteTimeGetCurrent() + MAX(nanoseconds, 0) / (double)NSEC_PER_SEC;
+    }
+    CFRunLoopTimerSetNextFireDate(_wheelTimer, fireDate);
+}
+
+- (void)fireTimers {
+    NSMutableArray<dispatch_block_t> *blocks = [NSMutableArray array];
+    dispatch_semaphore_wait(_timerLock, DISPATCH_TIME_FOREVER);
+    ZLTimerWheelAdvance(_timerWheel, ZLTimerWheelCurrentTick(), ZLRunLoopThreadCollectTimer, (__bridge void *)blocks);
+    _armedTick = UINT64_MAX;
+    [self armWheelTimer];
+    dispatch_semaphore_signal(_timerLock);
+
+    // Run outside the lock so blocks can schedule and cancel timers.
+    for (dispatch_block_t block in blocks) {
+        block();
+    }
+}
+
+- (ZLNetworkThreadMetrics *)metrics {
+    ZLNetworkThreadMetrics *metrics = [[ZLNetworkThreadMetrics alloc] init];
+    metrics.threadName = self.name;
+    metrics.socketCount = (NSUInteger)MAX(atomic_load(&_socketCount), 0);
+    uint64_t wakeupCount = atomic_load(&_wakeupCount);
+    metrics.wakeupCount = wakeupCount;
+    metrics.averageBusyTime = wakeupCount ? atomic_load(&_busyNanoseconds) / (double)wakeupCount / NSEC_PER_SEC : 0;
+    metrics.maxBusyTime = atomic_load(&_maxBusyNanoseconds) / (double)NSEC_PER_SEC;
+    dispatch_semaphore_wait(_timerLock, DISPATCH_TIME_FOREVER);
+    metrics.timerCount = ZLTimerWheelCount(_timerWheel);
+    dispatch_semaphore_signal(_timerLock);
+    return metrics;
+}
+
+@end
+
+@class ZLSocketInputStream;
+@class ZLSocketOutputStream;
+
+// Shares one ZLSocketStream between an input and an output stream the way CFStreamCreatePairWithSocket does,
+// so ZLProxyConnect and ZLWebSocket drive it exactly like a CFStream pair.
+// Events are delivered on the network thread that owns the event loop; reads and writes may happen on any thread.
+@interface ZLSocketStreamConnection : NSObject
+
+@property (nonatomic, weak) ZLSocketInputStream *inputStream;
+@property (nonatomic, weak) ZLSocketOutputStream *outputStream;
+
+- (nullable instancetype)initWithEventLoop:(ZLEventLoop *)eventLoop address:(NSData *)address;
+
+- (ZLSocketStream *)stream;
+// Both streams of a pair call `open`; the socket connects on the first one. Failures arrive as an error event.
+- (void)open;
+- (void)streamDidClose;
+- (NSStreamStatus)streamStatus;
+- (nullable NSError *)streamError;
+- (void)handleEvent:(ZLSocketStreamEvent)event;
+
++ (void)createPairWithEventLoop:(ZLEventLoop *)eventLoop
+                        address:(NSData *)address
+                    inputStream:(NSInputStream *_Nullable *_Nonnull)inputStream
+                   outputStream:(NSOutputStream *_Nullable *_Nonnull)outputStream;
+
+@end
+
+@interface ZLSocketInputStream : NSInputStream
+
+- (instancetype)initWithConnection:(ZLSocketStreamConnection *)connection;
+
+@property (nonatomic, assign, readonly, getter=isClosed) BOOL closed;
+
+@end
+
+@interface ZLSocketOutputStream : NSOutputStream
+
+- (instancetype)initWithConnection:(ZLSocketStreamConnection *)connection;
+
+@property (nonatomic, assign, readonly, getter=isClosed) BOOL closed;
+
+@end
+
+static void ZLSocketStreamConnectionCallBack(ZLSocketStream *stream, ZLSocketStreamEvent event, void *info);
+
+@implementation ZLSocketStreamConnection {
+    ZLSocketStream *_stream;
+    NSData *_address;
+    atomic_bool _opened;
+    atomic_int _closedCount;
+}
+
+- (instancetype)initWithEventLoop:(ZLEventLoop *)eventLoop address:(NSData *)address {
+    self = [super init];
+    if (self) {
+        _address = [address copy];
+        // The C stream only keeps a raw pointer; `dealloc` closes it, which waits for a callback in progress.
+        _stream = ZLSocketStreamCreate(eventLoop, ZLSocketStreamConnectionCallBack, (__bridge void *)self);
+        if (_stream == NULL) {
+            return nil;
+        }
+    }
+    return self;
+}
+
++ (void)createPairWithEventLoop:(ZLEventLoop *)eventLoop
+                        address:(NSData *)address
+                    inputStream:(NSInputStream **)inputStream
+                   outputStream:(NSOutputStream **)outputStream {
+    ZLSocketStreamConnection *connection = [[ZLSocketStreamConnection alloc] initWithEventLoop:eventLoop address:address];
+    ZLSocketInputStream *input = connection ? [[ZLSocketInputStream alloc] initWithConnection:connection] : nil;
+    ZLSocketOutputStream *output = connection ? [[ZLSocketOutputStream alloc] initWithConnection:connection] : nil;
+    connection.inputStream = input;
+    connection.outputStream = output;
+    *inputStream = input;
+    *outputStream = output;
+}
+
+- (void)dealloc {
+    ZLSocketStreamClose(_stream);
+    ZLSocketStreamRelease(_stream);
+}
+
+- (ZLSocketStream *)stream {
+    return _stream;
+}
+
+- (void)open {
+    if (!atomic_exchange(&_opened, true)) {
+        ZLSocketStreamConnect(_stream, _address.bytes, (socklen_t)_address.length);
+    }
+}
+
+// The socket is closed once both streams of the pair are.
+- (void)streamDidClose {
+    if (atomic_fetch_add(&_closedCount, 1) == 1) {
+        ZLSocketStreamClose(_stream);
+    }
+}
+
+- (NSStreamStatus)streamStatus {
+    return (NSStreamStatus)ZLSocketStreamGetStatus(_stream);
+}
+
+- (NSError *)streamError {
+    int error = ZLSocketStreamGetError(_stream);
+    return error ? [NSError errorWithDomain:NSPOSIXErrorDomain code:error userInfo:nil] : nil;
+}
+
+- (void)handleEvent:(ZLSocketStreamEvent)event {
+    // Hold the streams for the duration of the callback, a delegate may drop the last reference to them.
+    ZLSocketInputStream *inputStream = self.inputStream;
+    ZLSocketOutputStream *outputStream = self.outputStream;
+    NSInputStream *activeInput = inputStream.isClosed ? nil : inputStream;
+    NSOutputStream *activeOutput = outputStream.isClosed ? nil : outputStream;
+
+    switch (event) {
+        case ZLSocketStreamEventOpenCompleted:
+            [activeInput.delegate stream:activeInput handleEvent:NSStreamEventOpenCompleted];
+            [activeOutput.delegate stream:activeOutput handleEvent:NSStreamEventOpenCompleted];
+            break;
+        case ZLSocketStreamEventHasBytesAvailable:
+            [activeInput.delegate stream:activeInput handleEvent:NSStreamEventHasBytesAvailable];
+            break;
+        case ZLSocketStreamEventHasSpaceAvailable:
+            [activeOutput.delegate stream:activeOutput handleEvent:NSStreamEventHasSpaceAvailable];
+            break;
+        // One socket, so errors and the end of the stream are reported once, on the input side.
+        case ZLSocketStreamEventErrorOccurred: {
+            NSStream *stream = activeInput ?: (NSStream *)activeOutput;
+            [stream.delegate stream:stream handleEvent:NSStreamEventErrorOccurred];
+            break;
+        }
+        case ZLSocketStreamEventEndEncountered:
+            [activeInput.delegate stream:activeInput handleEvent:NSStreamEventEndEncountered];
+            break;
+    }
+}
+
+@end
+
+static void ZLSocketStreamConnectionCallBack(ZLSocketStream *stream, ZLSocketStreamEvent event, void *info) {
+    ZLSocketStreamConnection *connection = (__bridge ZLSocketStreamConnection *)info;
+    [connection handleEvent:event];
+}
+
+@implementation ZLSocketInputStream {
+    ZLSocketStreamConnection *_connection;
+}
+
+@synthesize delegate;
+
+- (instancetype)initWithConnection:(ZLSocketStreamConnection *)connection {
+    if (self = [super initWithData:[NSData data]]) {
+        _connection = connection;
+    }
+    return self;
+}
+
+- (void)open {
+    [_connection open];
+}
+
+- (void)close {
+    if (!_closed) {
+        _closed = YES;
+        [_connection streamDidClose];
+    }
+}
+
+- (NSStreamStatus)streamStatus {
+    return _closed ? NSStreamStatusClosed : [_connection streamStatus];
+}
+
+- (NSError *)streamError {
+    return [_connection streamError];
+}
+
+- (BOOL)hasBytesAvailable {
+    return !_closed && ZLSocketStreamHasBytesAvailable([_connection stream]);
+}
+
+- (NSInteger)read:(uint8_t *)buffer maxLength:(NSUInteger)len {
+    return _closed ? -1 : ZLSocketStreamRead([_connection stream], buffer, len);
+}
+
+- (BOOL)getBuffer:(uint8_t * _Nullable *)buffer length:(NSUInteger *)len {
+    return NO;
+}
+
+- (id)propertyForKey:(NSStreamPropertyKey)key {
+    return nil;
+}
+
+- (BOOL)setProperty:(id)property forKey:(NSStreamPropertyKey)key {
+    return NO;
+}
+
+// Events come from the event loop of the network thread, not from a run loop source.
+- (void)scheduleInRunLoop:(NSRunLoop *)aRunLoop forMode:(NSRunLoopMode)mode {}
+
+- (void)removeFromRunLoop:(NSRunLoop *)aRunLoop forMode:(NSRunLoopMode)mode {}
+
+@end
+
+@implementation ZLSocketOutputStream {
+    ZLSocketStreamConnection *_connection;
+}
+
+@synthesize delegate;
+
+- (instancetype)initWithConnection:(ZLSocketStreamConnection *)connection {
+    if (self = [super initToMemory]) {
+        _connection = connection;
+    }
+    return self;
+}
+
+- (void)open {
+    [_connection open];
+}
+
+- (void)close {
+    if (!_closed) {
+        _closed = YES;
+        [_connection streamDidClose];
+    }
+}
+
+// The peer closing its side doesn't stop us from writing.
+- (NSStreamStatus)streamStatus {
+    if (_closed) {
+        return NSStreamStatusClosed;
+    }
+    NSStreamStatus status = [_connection streamStatus];
+    return status == NSStreamStatusAtEnd ? NSStreamStatusOpen : status;
+}
+
+- (NSError *)streamError {
+    return [_connection streamError];
+}
+
+- (BOOL)hasSpaceAvailable {
+    return !_closed && ZLSocketStreamHasSpaceAvailable([_connection stream]);
+}
+
+- (NSInteger)write:(const uint8_t *)buffer maxLength:(NSUInteger)len {
+    return _closed ? -1 : ZLSocketStreamWrite([_connection stream], buffer, len);
+}
+
+- (id)propertyForKey:(NSStreamPropertyKey)key {
+    return nil;
+}
+
+- (BOOL)setProperty:(id)property forKey:(NSStreamPropertyKey)key {
+    return NO;
+}
+
+- (void)scheduleInRunLoop:(NSRunLoop *)aRunLoop forMode:(NSRunLoopMode)mode {}
+
+- (void)removeFromRunLoop:(NSRunLoop *)aRunLoop forMode:(NSRunLoopMode)mode {}
+
 @end
 
 typedef void(^ZLProxyConnectCompletion)(NSError *_Nullable error,
@@ -537,7 +1355,8 @@ typedef void(^ZLProxyConnectCompletion)(NSError *_Nullable error,
 
 @interface ZLProxyConnect : NSObject
 
-- (instancetype)initWithURL:(NSURL *)url;
+// With an event loop, plain ws:// connections without a proxy use ZLSocketStream instead of CFStream.
+- (instancetype)initWithURL:(NSURL *)url runLoop:(NSRunLoop *)runLoop eventLoop:(nullable ZLEventLoop *)eventLoop;
 
 - (void)openNetworkStreamWithCompletion:(ZLProxyConnectCompletion)completion;
 
@@ -549,7 +1368,8 @@ typedef void(^ZLProxyConnectCompletion)(NSError *_Nullable error,
     NSString *_httpProxyHost;
     uint32_t _httpProxyPort;
 
-    CFHTTPMessageRef _receivedHTTPHeaders;
+    ZLHTTPResponseHead _responseHead;
+    NSMutableData *_responseHeadData;
 
     NSString *_socksProxyHost;
     uint32_t _socksProxyPort;
@@ -560,6 +1380,12 @@ typedef void(^ZLProxyConnectCompletion)(NSError *_Nullable error,
 
     NSMutableArray<NSData *> *_inputQueue;
     dispatch_queue_t _writeQueue;
+
+    NSRunLoop *_runLoop;
+
+    ZLEventLoop *_eventLoop;
+    // Resolved addresses not tried yet, in getaddrinfo order.
+    NSMutableArray<NSData *> *_socketAddresses;
 }
 
 @property (nonatomic, strong) NSURL *url;
@@ -574,11 +1400,13 @@ typedef void(^ZLProxyConnectCompletion)(NSError *_Nullable error,
 #pragma mark - Init
 ///--------------------------------------
 
--(instancetype)initWithURL:(NSURL *)url {
+-(instancetype)initWithURL:(NSURL *)url runLoop:(NSRunLoop *)runLoop eventLoop:(ZLEventLoop *)eventLoop {
     self = [super init];
     if (!self) return self;
 
     _url = url;
+    _runLoop = runLoop;
+    _eventLoop = eventLoop;
     _connectionRequiresSSL = ZLURLRequiresSSL(url);
 
     _writeQueue = dispatch_queue_create("com.richie.ZLWebSocket.proxyconnect.write", DISPATCH_QUEUE_SERIAL);
@@ -590,7 +1418,7 @@ typedef void(^ZLProxyConnectCompletion)(NSError *_Nullable error,
 - (void)dealloc {
     // If we get deallocated before the socket open finishes - we need to cleanup everything.
 
-    [self.inputStream removeFromRunLoop:[ZLRunLoopThread sharedThread].runLoop forMode:NSDefaultRunLoopMode];
+    [self.inputStream removeFromRunLoop:_runLoop forMode:NSDefaultRunLoopMode];
     self.inputStream.delegate = nil;
     [self.inputStream close];
     self.inputStream = nil;
@@ -620,10 +1448,7 @@ typedef void(^ZLProxyConnectCompletion)(NSError *_Nullable error,
             [self.outputStream setProperty:self.url.host forKey:@"_kCFStreamPropertySocketPeerName"];
         }
     }
-    if (_receivedHTTPHeaders) {
-        CFRelease(_receivedHTTPHeaders);
-        _receivedHTTPHeaders = NULL;
-    }
+    _responseHeadData = nil;
 
     NSInputStream *inputStream = self.inputStream;
     NSOutputStream *outputStream = self.outputStream;
@@ -631,7 +1456,7 @@ typedef void(^ZLProxyConnectCompletion)(NSError *_Nullable error,
     self.inputStream = nil;
     self.outputStream = nil;
 
-    [inputStream removeFromRunLoop:[ZLRunLoopThread sharedThread].runLoop forMode:NSDefaultRunLoopMode];
+    [inputStream removeFromRunLoop:_runLoop forMode:NSDefaultRunLoopMode];
     inputStream.delegate = nil;
     outputStream.delegate = nil;
 
@@ -646,15 +1471,12 @@ typedef void(^ZLProxyConnectCompletion)(NSError *_Nullable error,
                                             ZLHTTPResponseErrorKey: @(2132) }];
     }
 
-    if (_receivedHTTPHeaders) {
-        CFRelease(_receivedHTTPHeaders);
-        _receivedHTTPHeaders = NULL;
-    }
+    _responseHeadData = nil;
 
     self.inputStream.delegate = nil;
     self.outputStream.delegate = nil;
 
-    [self.inputStream removeFromRunLoop:[ZLRunLoopThread sharedThread].runLoop
+    [self.inputStream removeFromRunLoop:_runLoop
                                 forMode:NSDefaultRunLoopMode];
     [self.inputStream close];
     [self.outputStream close];
@@ -663,42 +1485,16 @@ typedef void(^ZLProxyConnectCompletion)(NSError *_Nullable error,
     _completion(error, nil, nil);
 }
 
-// get proxy setting from device setting
+// get proxy setting from device setting, cached per host by the shared resolver
 - (void)_configureProxy {
-    NSDictionary *proxySettings = CFBridgingRelease(CFNetworkCopySystemProxySettings());
-
-    // CFNetworkCopyProxiesForURL doesn't understand ws:// or wss://
-    NSURL *httpURL;
-    if (_connectionRequiresSSL) {
-        httpURL = [NSURL URLWithString:[NSString stringWithFormat:@"https://%@", _url.host]];
-    } else {
-        httpURL = [NSURL URLWithString:[NSString stringWithFormat:@"http://%@", _url.host]];
-    }
-
-    NSArray *proxies = CFBridgingRelease(CFNetworkCopyProxiesForURL((__bridge CFURLRef)httpURL, (__bridge CFDictionaryRef)proxySettings));
-    if (proxies.count == 0) {
-        [self _openConnection];
-        return;                 // no proxy
-    }
-    NSDictionary *settings = [proxies objectAtIndex:0];
-    NSString *proxyType = settings[(NSString *)kCFProxyTypeKey];
-    if ([proxyType isEqualToString:(NSString *)kCFProxyTypeAutoConfigurationURL]) {
-        NSURL *pacURL = settings[(NSString *)kCFProxyAutoConfigurationURLKey];
-        if (pacURL) {
-            [self _fetchPAC:pacURL withProxySettings:proxySettings];
-            return;
-        }
-    }
-    if ([proxyType isEqualToString:(__bridge NSString *)kCFProxyTypeAutoConfigurationJavaScript]) {
-        NSString *script = settings[(__bridge NSString *)kCFProxyAutoConfigurationJavaScriptKey];
-        if (script) {
-            [self _runPACScript:script withProxySettings:proxySettings];
-            return;
+    __weak typeof(self) wself = self;
+    [[ZLProxyResolver sharedResolver] resolveProxyForURL:_url completion:^(NSDictionary *proxy) {
+        __strong typeof(wself) sself = wself;
+        if (proxy) {
+            [sself _readProxySettingWithType:proxy[(__bridge NSString *)kCFProxyTypeKey] settings:proxy];
         }
-    }
-    [self _readProxySettingWithType:proxyType settings:settings];
-
-    [self _openConnection];
+        [sself _openConnection];
+    }];
 }
 
 - (void)_readProxySettingWithType:(NSString *)proxyType settings:(NSDictionary *)settings {
@@ -720,78 +1516,17 @@ typedef void(^ZLProxyConnectCompletion)(NSError *_Nullable error,
     }
 }
 
-- (void)_fetchPAC:(NSURL *)PACurl withProxySettings:(NSDictionary *)proxySettings {
-    if ([PACurl isFileURL]) {
-        NSError *error = nil;
-        NSString *script = [NSString stringWithContentsOfURL:PACurl
-                                                usedEncoding:NULL
-                                                       error:&error];
-
-        if (error) {
-            [self _openConnection];
-        } else {
-            [self _runPACScript:script withProxySettings:proxySettings];
-        }
-        return;
-    }
-
-    NSString *scheme = [PACurl.scheme lowercaseString];
-    if (![scheme isEqualToString:@"http"] && ![scheme isEqualToString:@"https"]) {
-        // Don't know how to read data from this URL, we'll have to give up
-        // We'll simply assume no proxies, and start the request as normal
-        [self _openConnection];
-        return;
-    }
-    __weak typeof(self) wself = self;
-    NSURLRequest *request = [NSURLRequest requestWithURL:PACurl];
-    NSURLSession *session = [NSURLSession sharedSession];
-    [[session dataTaskWithRequest:request completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
-        __strong typeof(wself) sself = wself;
-        if (!error) {
-            NSString *script = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
-            [sself _runPACScript:script withProxySettings:proxySettings];
-        } else {
-            [sself _openConnection];
-        }
-    }] resume];
-}
-
-- (void)_runPACScript:(NSString *)script withProxySettings:(NSDictionary *)proxySettings {
-    if (!script) {
-        [self _openConnection];
+- (void)_openConnection {
+    if (_eventLoop && !_connectionRequiresSSL && !_httpProxyHost && !_socksProxyHost) {
+        [self _resolveSocketAddresses];
         return;
     }
-    // From: http://developer.apple.com/samplecode/CFProxySupportTool/listing1.html
-    // Work around <rdar://problem/5530166>.  This dummy call to
-    // CFNetworkCopyProxiesForURL initialise some state within CFNetwork
-    // that is required by CFNetworkCopyProxiesForAutoConfigurationScript.
-    CFBridgingRelease(CFNetworkCopyProxiesForURL((__bridge CFURLRef)_url, (__bridge CFDictionaryRef)proxySettings));
-
-    // Obtain the list of proxies by running the autoconfiguration script
-    CFErrorRef err = NULL;
 
-    // CFNetworkCopyProxiesForAutoConfigurationScript doesn't understand ws:// or wss://
-    NSURL *httpURL;
-    if (_connectionRequiresSSL)
-        httpURL = [NSURL URLWithString:[NSString stringWithFormat:@"https://%@", _url.host]];
-    else
-        httpURL = [NSURL URLWithString:[NSString stringWithFormat:@"http://%@", _url.host]];
-
-    NSArray *proxies = CFBridgingRelease(CFNetworkCopyProxiesForAutoConfigurationScript((__bridge CFStringRef)script,(__bridge CFURLRef)httpURL, &err));
-    if (!err && [proxies count] > 0) {
-        NSDictionary *settings = [proxies objectAtIndex:0];
-        NSString *proxyType = settings[(NSString *)kCFProxyTypeKey];
-        [self _readProxySettingWithType:proxyType settings:settings];
-    }
-    [self _openConnection];
-}
-
-- (void)_openConnection {
     [self _initializeStreams];
 
-    [self.inputStream scheduleInRunLoop:[ZLRunLoopThread sharedThread].runLoop
+    [self.inputStream scheduleInRunLoop:_runLoop
                                 forMode:NSDefaultRunLoopMode];
-//    [self.outputStream scheduleInRunLoop:[ZLRunLoopThread sharedThread].runLoop
+//    [self.outputStream scheduleInRunLoop:_runLoop
 //                               forMode:NSDefaultRunLoopMode];
     [self.outputStream open];
     [self.inputStream open];
@@ -837,6 +1572,66 @@ typedef void(^ZLProxyConnectCompletion)(NSError *_Nullable error,
     self.outputStream.delegate = self;
 }
 
+// getaddrinfo blocks, the resolver may call back on the main queue.
+- (void)_resolveSocketAddresses {
+    uint32_t port = _url.port.unsignedIntValue ?: 80;
+    NSString *host = _url.host;
+    __weak typeof(self) wself = self;
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        NSMutableArray<NSData *> *addresses = [NSMutableArray array];
+        struct addrinfo hints = {
+            .ai_family = AF_UNSPEC,
+            .ai_socktype = SOCK_STREAM,
+        };
+        struct addrinfo *result = NULL;
+        if (host && getaddrinfo(host.UTF8String, [NSString stringWithFormat:@"%u", port].UTF8String, &hints, &result) == 0) {
+            for (struct addrinfo *info = result; info; info = info->ai_next) {
+                [addresses addObject:[NSData dataWithBytes:info->ai_addr length:info->ai_addrlen]];
+            }
+            freeaddrinfo(result);
+        }
+
+        __strong typeof(wself) sself = wself;
+        if (sself == nil) {
+            return;
+        }
+        if (addresses.count == 0) {
+            [sself _failWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCannotFindHost userInfo:@{NSLocalizedDescriptionKey: @"Unable to resolve host."}]];
+            return;
+        }
+        sself->_socketAddresses = addresses;
+        [sself _connectNextSocketAddress];
+    });
+}
+
+// Returns NO when there is no address left to try.
+- (BOOL)_connectNextSocketAddress {
+    if (_socketAddresses.count == 0) {
+        return NO;
+    }
+    NSData *address = _socketAddresses.firstObject;
+    [_socketAddresses removeObjectAtIndex:0];
+
+    self.inputStream.delegate = nil;
+    self.outputStream.delegate = nil;
+    [self.inputStream close];
+    [self.outputStream close];
+
+    NSInputStream *inputStream = nil;
+    NSOutputStream *outputStream = nil;
+    [ZLSocketStreamConnection createPairWithEventLoop:_eventLoop address:address inputStream:&inputStream outputStream:&outputStream];
+    if (inputStream == nil) {
+        return [self _connectNextSocketAddress];
+    }
+    self.inputStream = inputStream;
+    self.outputStream = outputStream;
+    self.inputStream.delegate = self;
+    self.outputStream.delegate = self;
+    [self.outputStream open];
+    [self.inputStream open];
+    return YES;
+}
+
 - (void)stream:(NSStream *)aStream handleEvent:(NSStreamEvent)eventCode; {
     switch (eventCode) {
         case NSStreamEventOpenCompleted: {
@@ -849,7 +1644,11 @@ typedef void(^ZLProxyConnectCompletion)(NSError *_Nullable error,
             }
         }  break;
         case NSStreamEventErrorOccurred: {
-            [self _failWithError:aStream.streamError];
+            // A host with several addresses, e.g. IPv6 and IPv4: fall back to the next one.
+            NSError *error = aStream.streamError;
+            if (![self _connectNextSocketAddress]) {
+                [self _failWithError:error];
+            }
         } break;
         case NSStreamEventEndEncountered: {
             [self _failWithError:aStream.streamError];
@@ -911,12 +1710,19 @@ typedef void(^ZLProxyConnectCompletion)(NSError *_Nullable error,
 }
 //handle checking the proxy  connection status
 - (BOOL)_proxyProcessHTTPResponseWithData:(NSData *)data {
-    if (_receivedHTTPHeaders == NULL) {
-        _receivedHTTPHeaders = CFHTTPMessageCreateEmpty(NULL, NO);
+    if (_responseHeadData == nil) {
+        _responseHeadData = [[NSMutableData alloc] init];
+        ZLHTTPResponseHeadReset(&_responseHead);
     }
 
-    CFHTTPMessageAppendBytes(_receivedHTTPHeaders, (const UInt8 *)data.bytes, data.length);
-    if (CFHTTPMessageIsHeaderComplete(_receivedHTTPHeaders)) {
+    [_responseHeadData appendData:data];
+    ZLHTTPParseResult result = ZLHTTPResponseHeadParse(&_responseHead, _responseHeadData.bytes, _responseHeadData.length);
+    if (result == ZLHTTPParseError) {
+        NSError *error = [NSError errorWithDomain:ZLWebSocketErrorDomain code:2133 userInfo:@{NSLocalizedDescriptionKey: @"Invalid HTTP response from proxy server."}];
+        [self _failWithError:error];
+        return YES;
+    }
+    if (result == ZLHTTPParseComplete) {
         [self _proxyHTTPHeadersDidFinish];
         return YES;
     }
@@ -925,7 +1731,7 @@ typedef void(^ZLProxyConnectCompletion)(NSError *_Nullable error,
 }
 
 - (void)_proxyHTTPHeadersDidFinish {
-    NSInteger responseCode = CFHTTPMessageGetResponseStatusCode(_receivedHTTPHeaders);
+    NSInteger responseCode = _responseHead.statusCode;
 
     if (responseCode >= 299) {
         NSError *error = [NSError errorWithDomain:ZLWebSocketErrorDomain
@@ -992,12 +1798,13 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
     uint8_t _currentFrameOpcode;
     size_t _currentFrameCount;
     size_t _readOpCount;
-    uint32_t _currentStringScanPosition;
+    ZLUTF8ValidatorState _currentStringValidator;
     NSMutableData *_currentFrameData;
 
     NSString *_closeReason;
 
     NSString *_secKey;
+    ZLHTTPResponseHead _responseHead;
 
     ZLSecurityPolicy *_securityPolicy;
     BOOL _requestRequiresSSL;
@@ -1025,14 +1832,36 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
 
     // proxy support
     ZLProxyConnect *_proxyConnect;
+
+    // streamed messages
+    BOOL _currentFrameStreaming;
+    NSUInteger _pendingMessageChunkBytes;
+    BOOL _readPaused;              // socket reads or the scanner stopped until the delegate drains chunks
+    NSInputStream *_outgoingStream;
+    BOOL _outgoingStreamStarted;
+    BOOL _isPumpingOutgoingStream;
+    NSMutableArray<NSArray *> *_deferredFrames; // [opCodes, payloads] sent while a stream is in flight
+
+    // mask keys for outgoing frames
+    uint8_t _maskKeyPool[256];
+    size_t _maskKeyPoolOffset;
+
+    // permessage-deflate, nil unless negotiated
+    ZLPerMessageDeflate *_perMessageDeflate;
+    BOOL _currentFrameCompressed;
     
     BOOL _awaitingPong;
     unsigned long _sentPingCount;
-    NSTimer *_pingTimer;
+    // Timer IDs on the network thread's timing wheel, 0 when not scheduled. Guarded by @synchronized(self).
+    uint64_t _pingTimerID;
+    uint64_t _pongTimerID;
     
     NSTimeInterval _reconnectInterval;
     unsigned int _reconnectCount;
-    NSTimer *_reconnectTimer;
+    uint64_t _reconnectTimerID;
+
+    // Picked on first open and kept across reconnects.
+    ZLRunLoopThread *_networkThread;
 }
 
 @property (atomic, assign, readwrite) ZLReadyState readyState;
@@ -1072,6 +1901,9 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
     _securityPolicy = securityPolicy;
     _requestRequiresSSL = ZLURLRequiresSSL(_url);
 
+    // Resolve the proxy in the background so `open` usually finds it cached.
+    [[ZLProxyResolver sharedResolver] prefetchProxyForURL:_url];
+
     _readyState = ZL_UNKNOWN;
 
     _kvoLock = [[NSRecursiveLock alloc] init];
@@ -1093,6 +1925,17 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
     _scheduledRunloops = [[NSMutableSet alloc] init];
     
     _pingInterval = 5;
+    _pongTimeout = 5;
+
+    _clientMaxWindowBits = 15;
+    _serverMaxWindowBits = 15;
+    _compressionThreshold = 64;
+    _maxInflatedMessageLength = 64 * 1024 * 1024;
+
+    _maskKeyPoolOffset = sizeof(_maskKeyPool);
+
+    _maxPendingMessageChunkBytes = 1024 * 1024;
+    _deferredFrames = [[NSMutableArray alloc] init];
     
     _reconnectInterval = 1.5;
     
@@ -1132,49 +1975,121 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
         _receivedHTTPHeaders = NULL;
     }
 
+    [_networkThread cancelTimer:_pingTimerID];
+    [_networkThread cancelTimer:_pongTimerID];
+    [_networkThread cancelTimer:_reconnectTimerID];
+    [_networkThread removeSocket];
+
     _kvoLock = nil;
 }
 
+#pragma mark - Network Thread
+
++ (NSUInteger)networkThreadCount {
+    @synchronized ([ZLRunLoopThread class]) {
+        return ZLNetworkThreads ? ZLNetworkThreads.count : ZLResolvedNetworkThreadCount();
+    }
+}
+
++ (void)setNetworkThreadCount:(NSUInteger)networkThreadCount {
+    @synchronized ([ZLRunLoopThread class]) {
+        // The threads run forever, so the pool can't be resized once created.
+        if (ZLNetworkThreads == nil) {
+            ZLNetworkThreadCount = networkThreadCount;
+        }
+    }
+}
+
++ (NSArray<ZLNetworkThreadMetrics *> *)networkThreadMetrics {
+    NSMutableArray<ZLNetworkThreadMetrics *> *metrics = [NSMutableArray array];
+    for (ZLRunLoopThread *thread in [ZLRunLoopThread allThreads]) {
+        [metrics addObject:[thread metrics]];
+    }
+    return metrics;
+}
+
+- (ZLRunLoopThread *)networkThread {
+    @synchronized (self) {
+        if (_networkThread == nil) {
+            _networkThread = [ZLRunLoopThread threadForAffinity:_networkThreadAffinity];
+            [_networkThread addSocket];
+        }
+        return _networkThread;
+    }
+}
+
 #pragma mark - Ping
-- (void)initPingTimer {
-    if (_pingTimer) {
-        if (_pingTimer.isValid) {
-            if ([_pingTimer.fireDate isEqualToDate:[NSDate distantFuture]]) {
-                _pingTimer.fireDate = [NSDate date];
-                return;
-            }
-            return;
+- (void)initPingTimer {
+    @synchronized (self) {
+        // A pong still outstanding from the previous connection will never arrive.
+        [[self networkThread] cancelTimer:_pongTimerID];
+        _pongTimerID = 0;
+        _awaitingPong = NO;
+
+        if (_pingTimerID == 0) {
+            [self schedulePingTimer];
         }
-        
-        _pingTimer = nil;
     }
+}
+
+// Called inside @synchronized(self).
+- (void)schedulePingTimer {
+    // Jitter the interval by ±10% so sockets opened together don't keep pinging in bursts.
+    NSTimeInterval delay = self.pingInterval * (0.9 + 0.2 * arc4random_uniform(1001) / 1000.0);
     __weak typeof(self) weakSelf = self;
-    _pingTimer = [NSTimer timerWithTimeInterval:self.pingInterval repeats:YES block:^(NSTimer * _Nonnull timer) {
-        __strong typeof(self) strongSelf = weakSelf;
-        if (strongSelf == nil) {
+    _pingTimerID = [[self networkThread] scheduleTimerWithDelay:delay block:^{
+        [weakSelf pingTimerDidFire];
+    }];
+}
+
+- (void)pingTimerDidFire {
+    BOOL open = self.readyState == ZL_OPEN;
+    @synchronized (self) {
+        _pingTimerID = 0;
+        // Closed sockets stop pinging, `initPingTimer` starts again on the next open.
+        if (!open) {
             return;
         }
-        [strongSelf writePingFrame];
-    }];
-    [[ZLRunLoopThread sharedThread].runLoop addTimer:_pingTimer forMode:NSRunLoopCommonModes];
+        [self schedulePingTimer];
+    }
+    [self writePingFrame];
 }
 
 - (void)pausePingTimer {
-    if (_pingTimer && _pingTimer.isValid) {
-        _pingTimer.fireDate = [NSDate distantFuture];
+    @synchronized (self) {
+        [[self networkThread] cancelTimer:_pingTimerID];
+        [[self networkThread] cancelTimer:_pongTimerID];
+        _pingTimerID = 0;
+        _pongTimerID = 0;
     }
 }
 
 - (void)writePingFrame {
-    if (self.readyState == ZL_OPEN) {
-        if (_awaitingPong) {
-            // TODO
-            [self close];
-            return;
-        }
-        [self sendPing:nil error:nil];
-        _awaitingPong = YES;
+    // While a pong is outstanding its deadline decides whether the connection is dead.
+    if (self.readyState != ZL_OPEN || _awaitingPong) {
+        return;
+    }
+    _awaitingPong = YES;
+    [self sendPing:nil error:nil];
+
+    @synchronized (self) {
+        __weak typeof(self) weakSelf = self;
+        _pongTimerID = [[self networkThread] scheduleTimerWithDelay:self.pongTimeout block:^{
+            [weakSelf pongTimerDidFire];
+        }];
+    }
+}
+
+- (void)pongTimerDidFire {
+    @synchronized (self) {
+        _pongTimerID = 0;
+    }
+    if (!_awaitingPong || self.readyState != ZL_OPEN) {
+        return;
     }
+    _awaitingPong = NO;
+    NSError *error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorTimedOut userInfo:@{NSLocalizedDescriptionKey: @"Timed out waiting for pong."}];
+    [self _failWithError:error];
 }
 
 #pragma mark readyState
@@ -1216,7 +2131,8 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
         });
     }
 
-    _proxyConnect = [[ZLProxyConnect alloc] initWithURL:_url];
+    ZLRunLoopThread *networkThread = [self networkThread];
+    _proxyConnect = [[ZLProxyConnect alloc] initWithURL:_url runLoop:networkThread.runLoop eventLoop:_usesEventLoopSockets ? networkThread.eventLoop : NULL];
 
     __weak typeof(self) wself = self;
     [_proxyConnect openNetworkStreamWithCompletion:^(NSError *error, NSInputStream *readStream, NSOutputStream *writeStream) {
@@ -1246,8 +2162,12 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
     _currentFrameOpcode = 0;
     _currentFrameCount = 0;
     _readOpCount = 0;
-    _currentStringScanPosition = 0;
+    ZLUTF8ValidatorReset(&_currentStringValidator);
     _currentReadMaskOffset = 0;
+    _currentFrameCompressed = NO;
+    _currentFrameStreaming = NO;
+    _pendingMessageChunkBytes = 0;
+    _readPaused = NO;
     
     _readBuffer = dispatch_data_empty;
     _outputBuffer = dispatch_data_empty;
@@ -1257,6 +2177,7 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
         CFRelease(_receivedHTTPHeaders);
         _receivedHTTPHeaders = NULL;
     }
+    ZLHTTPResponseHeadReset(&_responseHead);
     
     if ([self.delegate respondsToSelector:@selector(webSocketReConnectURL)]) {
         _url = [self.delegate webSocketReConnectURL];
@@ -1269,21 +2190,23 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
 }
 
 - (void)privateReconnect {
-    if (_reconnectTimer != NULL) {
-        return;
-    }
-    
-    __weak typeof(self) weakSelf = self;
-    _reconnectTimer = [NSTimer timerWithTimeInterval:(_reconnectCount + 1) * _reconnectInterval repeats:NO block:^(NSTimer * _Nonnull timer) {
-        __strong typeof(self) strongSelf = weakSelf;
-        if (strongSelf == nil) {
+    @synchronized (self) {
+        if (_reconnectTimerID != 0) {
             return;
         }
-        [strongSelf reconnect];
-        [strongSelf->_reconnectTimer invalidate];
-        strongSelf->_reconnectTimer = nil;
-    }];
-    [[ZLRunLoopThread sharedThread].runLoop addTimer:_reconnectTimer forMode:NSRunLoopCommonModes];
+        
+        __weak typeof(self) weakSelf = self;
+        _reconnectTimerID = [[self networkThread] scheduleTimerWithDelay:(_reconnectCount + 1) * _reconnectInterval block:^{
+            __strong typeof(self) strongSelf = weakSelf;
+            if (strongSelf == nil) {
+                return;
+            }
+            @synchronized (strongSelf) {
+                strongSelf->_reconnectTimerID = 0;
+            }
+            [strongSelf reconnect];
+        }];
+    }
 }
 
 - (void)scheduleInRunLoop:(NSRunLoop *)aRunLoop forMode:(NSString *)mode {
@@ -1387,6 +2310,75 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
     return YES;
 }
 
+- (BOOL)sendMessages:(NSArray *)messages error:(NSError **)error {
+    if (self.readyState != ZL_OPEN) {
+        NSString *message = @"Invalid State: Cannot call `sendMessages:error:` until connection is open.";
+        if (error) {
+            *error = [NSError errorWithDomain:ZLWebSocketErrorDomain code:2134 userInfo:@{NSLocalizedDescriptionKey: message}];
+        }
+        return NO;
+    }
+
+    NSUInteger count = messages.count;
+    NSMutableArray<NSData *> *payloads = [NSMutableArray arrayWithCapacity:count];
+    NSMutableData *opCodes = [NSMutableData dataWithLength:count];
+    uint8_t *opCodesPointer = opCodes.mutableBytes;
+    for (NSUInteger i = 0; i < count; i++) {
+        id message = messages[i];
+        NSData *payload = nil;
+        if ([message isKindOfClass:[NSString class]]) {
+            payload = [message dataUsingEncoding:NSUTF8StringEncoding];
+            opCodesPointer[i] = ZLOpCodeTextFrame;
+        } else if ([message isKindOfClass:[NSData class]]) {
+            payload = [message copy];
+            opCodesPointer[i] = ZLOpCodeBinaryFrame;
+        }
+        if (payload) {
+            [payloads addObject:payload];
+        } else {
+            if (error) {
+                *error = [NSError errorWithDomain:ZLWebSocketErrorDomain code:2134 userInfo:@{NSLocalizedDescriptionKey: @"Invalid Argument: `sendMessages:error:` only accepts `NSString` and `NSData` messages that can be encoded."}];
+            }
+            return NO;
+        }
+    }
+
+    dispatch_async(_workQueue, ^{
+        [self _sendFramesWithOpCodes:opCodes.bytes payloads:payloads];
+    });
+    return YES;
+}
+
+- (BOOL)sendDataWithInputStream:(NSInputStream *)inputStream error:(NSError **)error {
+    if (self.readyState != ZL_OPEN) {
+        NSString *message = @"Invalid State: Cannot call `sendDataWithInputStream:error:` until connection is open.";
+        if (error) {
+            *error = [NSError errorWithDomain:ZLWebSocketErrorDomain code:2134 userInfo:@{NSLocalizedDescriptionKey: message}];
+        }
+        return NO;
+    }
+
+    dispatch_async(_workQueue, ^{
+        [self _sendStream:inputStream];
+    });
+    return YES;
+}
+
+- (void)_sendStream:(NSInputStream *)inputStream {
+    [self assertOnWorkQueue];
+
+    if (_outgoingStream) {
+        // Queue behind the stream in flight, like any other data message.
+        [_deferredFrames addObject:@[[NSData data], inputStream]];
+        return;
+    }
+    if (inputStream.streamStatus == NSStreamStatusNotOpen) {
+        [inputStream open];
+    }
+    _outgoingStream = inputStream;
+    [self _pumpOutgoingStream];
+}
+
 - (BOOL)sendPing:(nullable NSData *)data error:(NSError **)error {
     if (self.readyState != ZL_OPEN) {
         NSString *message = @"Invalid State: Cannot call `sendPing:error:` until connection is open.";
@@ -1407,11 +2399,23 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
     _secKey = ZLBase64EncodedStringFromData(ZLRandomData(16));
     assert([_secKey length] == 24);
 
+    // Every connection negotiates and compresses from scratch.
+    _perMessageDeflate = nil;
+    if (self.enablesPerMessageDeflate) {
+        _perMessageDeflate = [[ZLPerMessageDeflate alloc] initWithClientMaxWindowBits:self.clientMaxWindowBits
+                                                                  serverMaxWindowBits:self.serverMaxWindowBits
+                                                              clientNoContextTakeover:self.clientNoContextTakeover
+                                                              serverNoContextTakeover:self.serverNoContextTakeover];
+        _perMessageDeflate.compressionThreshold = self.compressionThreshold;
+        _perMessageDeflate.maxInflatedMessageLength = self.maxInflatedMessageLength;
+    }
+
     CFHTTPMessageRef message = ZLHTTPConnectMessageCreate(_urlRequest,
                                                           _secKey,
                                                           ZLWebSocketProtocolVersion,
                                                           self.requestCookies,
-                                                          _requestedProtocols);
+                                                          _requestedProtocols,
+                                                          _perMessageDeflate.extensionOffer);
 
     NSData *messageData = CFBridgingRelease(CFHTTPMessageCopySerializedMessage(message));
 
@@ -1428,37 +2432,70 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
 }
 
 - (void)_readHTTPHeader {
-    if (_receivedHTTPHeaders == NULL) {
-        _receivedHTTPHeaders = CFHTTPMessageCreateEmpty(NULL, NO);
-    }
-
-    [self _readUntilHeaderCompleteWithCallback:^(ZLWebSocket *socket,  NSData *data) {
-        CFHTTPMessageRef receivedHeaders = self->_receivedHTTPHeaders;
-        CFHTTPMessageAppendBytes(receivedHeaders, (const UInt8 *)data.bytes, data.length);
+    ZLHTTPResponseHeadReset(&_responseHead);
+
+    // The scanner sees everything received since the head started, so the parser
+    // only has to look at the bytes appended since the previous call.
+    __block BOOL reportedError = NO;
+    [self _addConsumerWithScanner:^size_t(NSData *data) {
+        ZLHTTPParseResult result = ZLHTTPResponseHeadParse(&self->_responseHead, data.bytes, data.length);
+        if (result == ZLHTTPParseError) {
+            if (!reportedError) {
+                reportedError = YES;
+                NSError *error = [NSError errorWithDomain:ZLWebSocketErrorDomain code:2133 userInfo:@{NSLocalizedDescriptionKey: @"Invalid HTTP response head."}];
+                [self _failWithError:error];
+            }
+            return 0;
+        }
+        return result == ZLHTTPParseComplete ? self->_responseHead.headLength : 0;
+    } callback:^(ZLWebSocket *socket, NSData *data) {
+        [socket _HTTPHeadersDidFinishWithData:data];
+    }];
+}
 
-        if (CFHTTPMessageIsHeaderComplete(receivedHeaders)) {
-            [self _HTTPHeadersDidFinish];
+// Value of the named header field, repeated fields joined with ", " like CFHTTPMessage does.
+static NSString *ZLHTTPResponseHeadFieldValue(const ZLHTTPResponseHead *head, NSData *data, const char *name) {
+    const uint8_t *bytes = data.bytes;
+    NSMutableString *value = nil;
+    for (size_t i = 0; i < head->headerCount; i++) {
+        const ZLHTTPHeaderField *field = &head->headers[i];
+        if (!ZLHTTPSpanEqualsIgnoringCase(bytes, field->name, name)) {
+            continue;
+        }
+        NSString *string = [[NSString alloc] initWithBytes:bytes + field->value.offset length:field->value.length encoding:NSUTF8StringEncoding] ?:
+                           [[NSString alloc] initWithBytes:bytes + field->value.offset length:field->value.length encoding:NSISOLatin1StringEncoding];
+        if (value == nil) {
+            value = [string mutableCopy];
         } else {
-            [self _readHTTPHeader];
+            [value appendFormat:@", %@", string];
         }
-    }];
+    }
+    return value;
 }
 
-- (BOOL)_checkHandshake:(CFHTTPMessageRef)httpMessage {
-    NSString *acceptHeader = CFBridgingRelease(CFHTTPMessageCopyHeaderFieldValue(httpMessage, CFSTR("Sec-WebSocket-Accept")));
+- (BOOL)_checkHandshakeWithData:(NSData *)data {
+    const ZLHTTPHeaderField *acceptField = ZLHTTPResponseHeadFindField(&_responseHead, data.bytes, "Sec-WebSocket-Accept");
 
-    if (acceptHeader == nil) {
+    if (acceptField == NULL) {
         return NO;
     }
 
     NSString *concattedString = [_secKey stringByAppendingString:ZLWebSocketAppendToSecKeyString];
     NSData *hashedString = ZLSHA1HashFromString(concattedString);
     NSString *expectedAccept = ZLBase64EncodedStringFromData(hashedString);
-    return [acceptHeader isEqualToString:expectedAccept];
+    const char *expectedBytes = expectedAccept.UTF8String;
+    return ZLHTTPSpanEquals(data.bytes, acceptField->value, expectedBytes, strlen(expectedBytes));
 }
 
-- (void)_HTTPHeadersDidFinish {
-    NSInteger responseCode = CFHTTPMessageGetResponseStatusCode(_receivedHTTPHeaders);
+- (void)_HTTPHeadersDidFinishWithData:(NSData *)data {
+    // Keep `receivedHTTPHeaders` available to callers; the head is complete so this is a single pass.
+    if (_receivedHTTPHeaders) {
+        CFRelease(_receivedHTTPHeaders);
+    }
+    _receivedHTTPHeaders = CFHTTPMessageCreateEmpty(NULL, NO);
+    CFHTTPMessageAppendBytes(_receivedHTTPHeaders, (const UInt8 *)data.bytes, data.length);
+
+    NSInteger responseCode = _responseHead.statusCode;
     if (responseCode >= 400) {
         NSError *error = [NSError errorWithDomain:ZLWebSocketErrorDomain
                                              code:responseCode
@@ -1469,13 +2506,13 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
         return;
     }
 
-    if(![self _checkHandshake:_receivedHTTPHeaders]) {
+    if(![self _checkHandshakeWithData:data]) {
         NSError *error = [NSError errorWithDomain:ZLWebSocketErrorDomain code:2133 userInfo:@{NSLocalizedDescriptionKey: @"Invalid Sec-WebSocket-Accept response."}];
         [self _failWithError:error];
         return;
     }
 
-    NSString *negotiatedProtocol = CFBridgingRelease(CFHTTPMessageCopyHeaderFieldValue(_receivedHTTPHeaders, CFSTR("Sec-WebSocket-Protocol")));
+    NSString *negotiatedProtocol = ZLHTTPResponseHeadFieldValue(&_responseHead, data, "Sec-WebSocket-Protocol");
     if (negotiatedProtocol) {
         // Make sure we requested the protocol
         if ([_requestedProtocols indexOfObject:negotiatedProtocol] == NSNotFound) {
@@ -1487,6 +2524,20 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
         _protocol = negotiatedProtocol;
     }
 
+    NSString *negotiatedExtensions = ZLHTTPResponseHeadFieldValue(&_responseHead, data, "Sec-WebSocket-Extensions");
+    if (negotiatedExtensions.length) {
+        if (!_perMessageDeflate || ![_perMessageDeflate acceptExtensionResponse:negotiatedExtensions]) {
+            NSError *error = [NSError errorWithDomain:ZLWebSocketErrorDomain code:2133 userInfo:@{NSLocalizedDescriptionKey: @"Server specified Sec-WebSocket-Extensions that wasn't requested."}];
+            [self _failWithError:error];
+            return;
+        }
+    } else {
+        _perMessageDeflate = nil;
+    }
+
+    // A message streamed on a previous connection can't be continued on this one.
+    [self _finishOutgoingStream];
+
     self.readyState = ZL_OPEN;
 
     if (!_didFail) {
@@ -1549,7 +2600,7 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
         [self _updateSecureStreamOptions];
 
         if (!_scheduledRunloops.count) {
-            [self scheduleInRunLoop:[ZLRunLoopThread sharedThread].runLoop forMode:NSDefaultRunLoopMode];
+            [self scheduleInRunLoop:[self networkThread].runLoop forMode:NSDefaultRunLoopMode];
         }
 
         // If we don't require SSL validation - consider that we connected.
@@ -1581,12 +2632,13 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
 
         // Cleanup NSStream delegate's in the same RunLoop used by the streams themselves:
         // This way we'll prevent race conditions between handleEvent and ZLWebSocket's dealloc
-        NSTimer *timer = [NSTimer timerWithTimeInterval:(0.0f) target:self selector:@selector(_cleanupSelfReference:) userInfo:nil repeats:NO];
-        [[ZLRunLoopThread sharedThread].runLoop addTimer:timer forMode:NSDefaultRunLoopMode];
+        [[self networkThread] scheduleTimerWithDelay:0 block:^{
+            [self _cleanupSelfReference];
+        }];
     }
 }
 
-- (void)_cleanupSelfReference:(NSTimer *)timer {
+- (void)_cleanupSelfReference {
     @synchronized(self) {
         // Nuke NSStream delegate's
         _inputStream.delegate = nil;
@@ -1672,46 +2724,22 @@ static NSTimeInterval const SRProxyConnectWriteTimeout = 5.0;
 - (void)_writeData:(NSData *)data {
     [self assertOnWorkQueue];
 
-    if (_closeWhenFinishedWriting) {
-        return;
-    }
-
     __block NSData *strongData = data;
     dispatch_data_t newData = dispatch_data_create(data.bytes, data.length, nil, ^{
         strongData = nil;
     });
-    _outputBuffer = dispatch_data_create_concat(_outputBuffer, newData);
-    [self _pumpWriting];
+    [self _writeDispatchData:newData];
 }
 
-static const char CRLFCRLFBytes[] = {'\r', '\n', '\r', '\n'};
-
-- (void)_readUntilHeaderCompleteWithCallback:(data_callback)dataHandler {
-    [self _readUntilBytes:CRLFCRLFBytes length:sizeof(CRLFCRLFBytes) callback:dataHandler];
-}
+- (void)_writeDispatchData:(dispatch_data_t)data {
+    [self assertOnWorkQueue];
 
-- (void)_readUntilBytes:(const void *)bytes length:(size_t)length callback:(data_callback)dataHandler {
-    // TODO optimize so this can continue from where we last searched
-    stream_scanner consumer = ^size_t(NSData *data) {
-        __block size_t found_size = 0;
-        __block size_t match_count = 0;
+    if (_closeWhenFinishedWriting) {
+        return;
+    }
 
-        size_t size = data.length;
-        const unsigned char *buffer = data.bytes;
-        for (size_t i = 0; i < size; i++) {
-            if (((const unsigned char *)buffer)[i] == ((const unsigned char *)bytes)[match_count]) {
-                match_count += 1;
-                if (match_count == length) {
-                    found_size = i + 1;
-                    break;
-                }
-            } else {
-                match_count = 0;
-            }
-        }
-        return found_size;
-    };
-    [self _addConsumerWithScanner:consumer callback:dataHandler];
+    _outputBuffer = dispatch_data_create_concat(_outputBuffer, data);
+    [self _pumpWriting];
 }
 
 - (void)_addConsumerWithScanner:(stream_scanner)consumer callback:(data_callback)callback {
@@ -1747,6 +2775,13 @@ static const char CRLFCRLFBytes[] = {'\r', '\n', '\r', '\n'};
         return didWork;
     }
 
+    if ([self _isMessageChunkDeliveryBackedUp]) {
+        // Bytes may already be buffered with nothing left to read from the socket,
+        // so the delegate draining its chunks has to restart the scanner itself.
+        _readPaused = YES;
+        return didWork;
+    }
+
     size_t curSize = readBufferSize - _readBufferOffset;
     if (!curSize) {
         return didWork;
@@ -1779,52 +2814,57 @@ static const char CRLFCRLFBytes[] = {'\r', '\n', '\r', '\n'};
             _readBufferOffset = 0;
         }
 
-        if (consumer.unmaskBytes) {
-            __block NSMutableData *mutableSlice = [slice mutableCopy];
-
-            NSUInteger len = mutableSlice.length;
-            uint8_t *bytes = mutableSlice.mutableBytes;
+        if (consumer.readToCurrentFrame) {
+            NSUInteger frameOffset = _currentFrameData.length;
+            if (_currentFrameCompressed) {
+                // Inflate straight from the read buffer regions into the frame buffer.
+                __block ZLInflateResult inflateResult = ZLInflateResultOK;
+                if (consumer.unmaskBytes && foundSize) {
+                    NSMutableData *unmasked = [(NSData *)slice mutableCopy];
+                    ZLUnmaskBytesAtOffset(unmasked.mutableBytes, foundSize, _currentReadMaskKey, _currentReadMaskOffset);
+                    _currentReadMaskOffset += foundSize;
+                    inflateResult = [_perMessageDeflate inflateBytes:unmasked.bytes length:foundSize intoData:_currentFrameData];
+                } else {
+                    dispatch_data_apply(slice, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
+                        inflateResult = [_perMessageDeflate inflateBytes:buffer length:size intoData:_currentFrameData];
+                        return inflateResult == ZLInflateResultOK;
+                    });
+                }
+                if (inflateResult != ZLInflateResultOK) {
+                    [self _closeWithInflateResult:inflateResult];
+                    return didWork;
+                }
+            } else {
+                // Copy straight from the read buffer regions into the frame buffer, then unmask in place.
+                dispatch_data_apply(slice, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
+                    [_currentFrameData appendBytes:buffer length:size];
+                    return true;
+                });
 
-            for (NSUInteger i = 0; i < len; i++) {
-                bytes[i] = bytes[i] ^ _currentReadMaskKey[_currentReadMaskOffset % sizeof(_currentReadMaskKey)];
-                _currentReadMaskOffset += 1;
+                if (consumer.unmaskBytes && foundSize) {
+                    ZLUnmaskBytesAtOffset((uint8_t *)_currentFrameData.mutableBytes + frameOffset, foundSize, _currentReadMaskKey, _currentReadMaskOffset);
+                    _currentReadMaskOffset += foundSize;
+                }
             }
-
-            slice = dispatch_data_create(bytes, len, nil, ^{
-                mutableSlice = nil;
-            });
-        }
-
-        if (consumer.readToCurrentFrame) {
-            dispatch_data_apply(slice, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
-                [_currentFrameData appendBytes:buffer length:size];
-                return true;
-            });
+            size_t appendedSize = _currentFrameData.length - frameOffset;
 
             _readOpCount += 1;
 
-            if (_currentFrameOpcode == ZLOpCodeTextFrame) {
-                // Validate UTF8 stuff.
-                size_t currentDataSize = _currentFrameData.length;
-                if (_currentFrameOpcode == ZLOpCodeTextFrame && currentDataSize > 0) {
-                    // TODO: Optimize the crap out of this.  Don't really have to copy all the data each time
-
-                    size_t scanSize = currentDataSize - _currentStringScanPosition;
-
-                    NSData *scan_data = [_currentFrameData subdataWithRange:NSMakeRange(_currentStringScanPosition, scanSize)];
-                    int32_t valid_utf8_size = validate_dispatch_data_partial_string(scan_data);
-
-                    if (valid_utf8_size == -1) {
-                        [self closeWithCode:ZLStatusCodeInvalidUTF8 reason:@"Text frames must be valid UTF-8"];
-                        dispatch_async(_workQueue, ^{
-                            [self closeConnection];
-                        });
-                        return didWork;
-                    } else {
-                        _currentStringScanPosition += valid_utf8_size;
-                    }
+            if (_currentFrameOpcode == ZLOpCodeTextFrame && appendedSize) {
+                // Only the newly appended bytes are scanned, partial sequences are carried in the validator state.
+                const uint8_t *scanBytes = (const uint8_t *)_currentFrameData.bytes + frameOffset;
+                if (!ZLUTF8ValidatorUpdate(&_currentStringValidator, scanBytes, appendedSize)) {
+                    [self closeWithCode:ZLStatusCodeInvalidUTF8 reason:@"Text frames must be valid UTF-8"];
+                    dispatch_async(_workQueue, ^{
+                        [self closeConnection];
+                    });
+                    return didWork;
                 }
+            }
 
+            if (_currentFrameStreaming && _currentFrameData.length >= ZLMessageChunkSize) {
+                [self _deliverMessageChunk:_currentFrameData isFinal:NO];
+                _currentFrameData = [[NSMutableData alloc] initWithCapacity:ZLMessageChunkSize];
             }
 
             consumer.bytesNeeded -= foundSize;
@@ -1836,6 +2876,23 @@ static const char CRLFCRLFBytes[] = {'\r', '\n', '\r', '\n'};
                 didWork = YES;
             }
         } else if (foundSize) {
+            if (consumer.unmaskBytes) {
+                // dispatch_data is immutable, so unmasking needs exactly one copy.
+                uint8_t *bytes = malloc(foundSize);
+                if (!bytes) {
+                    NSError *error = [NSError errorWithDomain:ZLWebSocketErrorDomain code:ZLStatusCodeMessageTooBig userInfo:@{ NSLocalizedDescriptionKey: @"Unable to allocate memory to unmask frame."}];
+                    [self _failWithError:error];
+                    return didWork;
+                }
+                dispatch_data_apply(slice, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
+                    memcpy(bytes + offset, buffer, size);
+                    return true;
+                });
+                ZLUnmaskBytesAtOffset(bytes, foundSize, _currentReadMaskKey, _currentReadMaskOffset);
+                _currentReadMaskOffset += foundSize;
+                slice = dispatch_data_create(bytes, foundSize, nil, DISPATCH_DATA_DESTRUCTOR_FREE);
+            }
+
             [_consumers removeObjectAtIndex:0];
             consumer.handler(self, (NSData *)slice);
             [_consumerPool returnConsumer:consumer];
@@ -1944,6 +3001,10 @@ static const char CRLFCRLFBytes[] = {'\r', '\n', '\r', '\n'};
 
 - (void)handlePong:(NSData *)pongData {
     _awaitingPong = NO;
+    @synchronized (self) {
+        [[self networkThread] cancelTimer:_pongTimerID];
+        _pongTimerID = 0;
+    }
     [self performDelegateBlock:^(ZLWebSocket *webSocket) {
         if (webSocket.delegate && [webSocket.delegate respondsToSelector:@selector(webSocket:didReceivePong:)]) {
             [webSocket.delegate webSocket:webSocket didReceivePong:pongData];
@@ -1952,7 +3013,8 @@ static const char CRLFCRLFBytes[] = {'\r', '\n', '\r', '\n'};
 }
 
 
-static const size_t ZLFrameHeaderOverhead = 32;
+// 2 bytes of header, up to 8 bytes of extended payload length and the 4 byte mask key.
+static const size_t ZLFrameHeaderOverhead = 14;
 
 - (void)_sendFrameWithOpcode:(ZLOpCode)opCode data:(NSData *)data {
     [self assertOnWorkQueue];
@@ -1961,66 +3023,173 @@ static const size_t ZLFrameHeaderOverhead = 32;
         return;
     }
 
-    size_t payloadLength = data.length;
+    uint8_t opCodes[] = {opCode};
+    [self _sendFramesWithOpCodes:opCodes payloads:@[data]];
+}
+
+- (void)_sendFramesWithOpCodes:(const uint8_t *)opCodes payloads:(NSArray<NSData *> *)payloads {
+    [self assertOnWorkQueue];
 
-    NSMutableData *frameData = [[NSMutableData alloc] initWithLength:payloadLength + ZLFrameHeaderOverhead];
-    if (!frameData) {
-        [self closeWithCode:ZLStatusCodeMessageTooBig reason:@"Message too big"];
+    NSUInteger count = payloads.count;
+    if (count == 0) {
+        return;
+    }
+
+    // Data frames of other messages can't be interleaved with a streamed message, hold them back until it's done.
+    if (_outgoingStream && (opCodes[0] == ZLOpCodeTextFrame || opCodes[0] == ZLOpCodeBinaryFrame)) {
+        [_deferredFrames addObject:@[[NSData dataWithBytes:opCodes length:count], payloads]];
         return;
     }
-    uint8_t *frameBuffer = (uint8_t *)frameData.mutableBytes;
 
-    // set fin
-    frameBuffer[0] = SRFinMask | opCode;
+    // Compress first, so the output buffer for all frames can be sized exactly.
+    NSMutableArray<NSData *> *framePayloads = payloads.mutableCopy;
+    NSMutableData *firstBytes = [NSMutableData dataWithLength:count];
+    uint8_t *firstBytesPointer = firstBytes.mutableBytes;
+    size_t bufferSize = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        ZLOpCode opCode = opCodes[i];
+        firstBytesPointer[i] = SRFinMask | opCode;
+        if (_perMessageDeflate && (opCode == ZLOpCodeTextFrame || opCode == ZLOpCodeBinaryFrame)) {
+            NSData *deflatedData = [_perMessageDeflate deflateData:framePayloads[i]];
+            if (deflatedData) {
+                framePayloads[i] = deflatedData;
+                firstBytesPointer[i] |= SRRsv1Mask;
+            }
+        }
+        bufferSize += ZLFrameHeaderOverhead + framePayloads[i].length;
+    }
 
-    // set the mask and header
-    frameBuffer[1] |= SRMaskMask;
+    [self _writeFramesWithFirstBytes:firstBytesPointer payloads:framePayloads bufferSize:bufferSize];
+}
 
-    size_t frameBufferSize = 2;
+- (void)_writeFramesWithFirstBytes:(const uint8_t *)firstBytes payloads:(NSArray<NSData *> *)payloads bufferSize:(size_t)bufferSize {
+    NSUInteger count = payloads.count;
+    uint8_t *frameBuffer = malloc(bufferSize);
+    if (!frameBuffer) {
+        [self closeWithCode:ZLStatusCodeMessageTooBig reason:@"Message too big"];
+        return;
+    }
 
-    if (payloadLength < 126) {
-        frameBuffer[1] |= payloadLength;
-    } else {
-        uint64_t declaredPayloadLength = 0;
-        size_t declaredPayloadLengthSize = 0;
+    size_t frameBufferSize = 0;
+    for (NSUInteger i = 0; i < count; i++) {
+        NSData *data = payloads[i];
+        size_t payloadLength = data.length;
+        uint8_t *header = frameBuffer + frameBufferSize;
 
-        if (payloadLength <= UINT16_MAX) {
-            frameBuffer[1] |= 126;
+        header[0] = firstBytes[i];
+        // set the mask and header
+        header[1] = SRMaskMask;
+        frameBufferSize += 2;
 
-            declaredPayloadLength = CFSwapInt16BigToHost((uint16_t)payloadLength);
-            declaredPayloadLengthSize = sizeof(uint16_t);
+        if (payloadLength < 126) {
+            header[1] |= payloadLength;
         } else {
-            frameBuffer[1] |= 127;
+            uint64_t declaredPayloadLength = 0;
+            size_t declaredPayloadLengthSize = 0;
+
+            if (payloadLength <= UINT16_MAX) {
+                header[1] |= 126;
+
+                declaredPayloadLength = CFSwapInt16BigToHost((uint16_t)payloadLength);
+                declaredPayloadLengthSize = sizeof(uint16_t);
+            } else {
+                header[1] |= 127;
+
+                declaredPayloadLength = CFSwapInt64BigToHost((uint64_t)payloadLength);
+                declaredPayloadLengthSize = sizeof(uint64_t);
+            }
 
-            declaredPayloadLength = CFSwapInt64BigToHost((uint64_t)payloadLength);
-            declaredPayloadLengthSize = sizeof(uint64_t);
+            memcpy(frameBuffer + frameBufferSize, &declaredPayloadLength, declaredPayloadLengthSize);
+            frameBufferSize += declaredPayloadLengthSize;
         }
 
-        memcpy((frameBuffer + frameBufferSize), &declaredPayloadLength, declaredPayloadLengthSize);
-        frameBufferSize += declaredPayloadLengthSize;
+        uint8_t *maskKey = frameBuffer + frameBufferSize;
+        [self _copyMaskKey:maskKey];
+        frameBufferSize += sizeof(uint32_t);
+
+        // Mask straight from the caller's buffer into the output buffer.
+        ZLMaskBytesCopy(frameBuffer + frameBufferSize, data.bytes, payloadLength, maskKey);
+        frameBufferSize += payloadLength;
     }
 
-    const uint8_t *unmaskedPayloadBuffer = (uint8_t *)data.bytes;
-    uint8_t *maskKey = frameBuffer + frameBufferSize;
+    assert(frameBufferSize <= bufferSize);
+    dispatch_data_t frames = dispatch_data_create(frameBuffer, frameBufferSize, nil, DISPATCH_DATA_DESTRUCTOR_FREE);
+    [self _writeDispatchData:frames];
+}
 
-    size_t randomBytesSize = sizeof(uint32_t);
-    int result = SecRandomCopyBytes(kSecRandomDefault, randomBytesSize, maskKey);
-    if (result != 0) {
-        //TODO: (nlutsenko) Check if there was an error.
+- (void)_pumpOutgoingStream {
+    [self assertOnWorkQueue];
+
+    if (!_outgoingStream || _isPumpingOutgoingStream) {
+        return;
+    }
+    if (self.readyState != ZL_OPEN) {
+        [self _finishOutgoingStream];
+        return;
     }
-    frameBufferSize += randomBytesSize;
 
-    // Copy and unmask the buffer
-    uint8_t *frameBufferPayloadPointer = frameBuffer + frameBufferSize;
+    _isPumpingOutgoingStream = YES;
+    while (_outgoingStream && dispatch_data_get_size(_outputBuffer) - _outputBufferOffset < ZLOutgoingStreamHighWaterMark) {
+        NSMutableData *chunk = [[NSMutableData alloc] initWithLength:ZLMessageChunkSize];
+        NSInteger bytesRead = [_outgoingStream read:chunk.mutableBytes maxLength:ZLMessageChunkSize];
+        if (bytesRead < 0) {
+            // The message can't be finished, and a half sent message can't be recovered from.
+            [self _finishOutgoingStream];
+            [self closeWithCode:ZLStatusCodeInternalError reason:@"Failed to read outgoing message"];
+            break;
+        }
+        chunk.length = bytesRead;
+
+        BOOL isFinal = bytesRead == 0;
+        uint8_t firstByte = _outgoingStreamStarted ? 0 : ZLOpCodeBinaryFrame;
+        if (isFinal) {
+            firstByte |= SRFinMask;
+        }
+        _outgoingStreamStarted = YES;
+        [self _writeFramesWithFirstBytes:&firstByte payloads:@[chunk] bufferSize:ZLFrameHeaderOverhead + chunk.length];
+
+        if (isFinal) {
+            [self _finishOutgoingStream];
+        }
+    }
+    _isPumpingOutgoingStream = NO;
+}
 
-    memcpy(frameBufferPayloadPointer, unmaskedPayloadBuffer, payloadLength);
-    ZLMaskBytesSIMD(frameBufferPayloadPointer, payloadLength, maskKey);
-    frameBufferSize += payloadLength;
+- (void)_finishOutgoingStream {
+    [_outgoingStream close];
+    _outgoingStream = nil;
+    _outgoingStreamStarted = NO;
 
-    assert(frameBufferSize <= frameData.length);
-    frameData.length = frameBufferSize;
+    NSArray<NSArray *> *deferredFrames = _deferredFrames.copy;
+    [_deferredFrames removeAllObjects];
+    if (self.readyState != ZL_OPEN) {
+        return;
+    }
+    for (NSUInteger i = 0; i < deferredFrames.count; i++) {
+        NSArray *frames = deferredFrames[i];
+        if ([frames[1] isKindOfClass:[NSInputStream class]]) {
+            [self _sendStream:frames[1]];
+        } else {
+            [self _sendFramesWithOpCodes:[frames[0] bytes] payloads:frames[1]];
+        }
+        if (_outgoingStream) {
+            // One of the deferred messages is a stream itself, keep the rest behind it.
+            [_deferredFrames addObjectsFromArray:[deferredFrames subarrayWithRange:NSMakeRange(i + 1, deferredFrames.count - i - 1)]];
+            break;
+        }
+    }
+}
 
-    [self _writeData:frameData];
+- (void)_copyMaskKey:(uint8_t *)maskKey {
+    // Pull mask keys from a buffered random stream instead of asking the system for every frame.
+    if (_maskKeyPoolOffset + sizeof(uint32_t) > sizeof(_maskKeyPool)) {
+        if (SecRandomCopyBytes(kSecRandomDefault, sizeof(_maskKeyPool), _maskKeyPool) != errSecSuccess) {
+            arc4random_buf(_maskKeyPool, sizeof(_maskKeyPool));
+        }
+        _maskKeyPoolOffset = 0;
+    }
+    memcpy(maskKey, _maskKeyPool + _maskKeyPoolOffset, sizeof(uint32_t));
+    _maskKeyPoolOffset += sizeof(uint32_t);
 }
 
 static inline BOOL closeCodeIsValid(int closeCode) {
@@ -2115,6 +3284,15 @@ static inline BOOL closeCodeIsValid(int closeCode) {
     if (!isControlFrame) {
         _currentFrameOpcode = frame_header.opcode;
         _currentFrameCount += 1;
+        if (_currentFrameCount == 1) {
+            _currentFrameCompressed = frame_header.rsv1;
+            id<ZLWebSocketDelegate> delegate = self.delegate;
+            _currentFrameStreaming = [delegate respondsToSelector:@selector(webSocket:didReceiveMessageChunk:isText:isFinal:)];
+        }
+    }
+
+    if (frame_header.masked) {
+        _currentReadMaskOffset = 0;
     }
 
     if (frame_header.payload_length == 0) {
@@ -2122,20 +3300,31 @@ static inline BOOL closeCodeIsValid(int closeCode) {
             [self _handleFrameWithData:curData opCode:frame_header.opcode];
         } else {
             if (frame_header.fin) {
-                [self _handleFrameWithData:_currentFrameData opCode:frame_header.opcode];
+                [self _handleCurrentFrameDataWithOpCode:frame_header.opcode];
             } else {
                 // TODO add assert that opcode is not a control;
                 [self _readFrameContinue];
             }
         }
+    } else if (!isControlFrame && frame_header.fin && _currentFrameCount == 1 && !frame_header.rsv1 && !_currentFrameStreaming) {
+        // Unfragmented message: hand out a view over the read buffer instead of assembling it in _currentFrameData.
+        assert(frame_header.payload_length <= SIZE_T_MAX);
+        [self _addConsumerWithDataLength:(size_t)frame_header.payload_length callback:^(ZLWebSocket *sself, NSData *newData) {
+            [sself _handleFrameWithData:newData opCode:frame_header.opcode];
+        } readToCurrentFrame:NO unmaskBytes:frame_header.masked];
     } else {
         assert(frame_header.payload_length <= SIZE_T_MAX);
+        if (!isControlFrame && _currentFrameData.length == 0) {
+            // First fragment of a message, reserve the frame buffer from the header's payload length.
+            size_t maxPreallocationSize = _currentFrameStreaming ? ZLMessageChunkSize : ZLMaxFramePreallocationSize;
+            _currentFrameData = [[NSMutableData alloc] initWithCapacity:(NSUInteger)MIN(frame_header.payload_length, maxPreallocationSize)];
+        }
         [self _addConsumerWithDataLength:(size_t)frame_header.payload_length callback:^(ZLWebSocket *sself, NSData *newData) {
             if (isControlFrame) {
                 [sself _handleFrameWithData:newData opCode:frame_header.opcode];
             } else {
                 if (frame_header.fin) {
-                    [sself _handleFrameWithData:sself->_currentFrameData opCode:frame_header.opcode];
+                    [sself _handleCurrentFrameDataWithOpCode:frame_header.opcode];
                 } else {
                     // TODO add assert that opcode is not a control;
                     [sself _readFrameContinue];
@@ -2144,6 +3333,61 @@ static inline BOOL closeCodeIsValid(int closeCode) {
         } readToCurrentFrame:!isControlFrame unmaskBytes:frame_header.masked];
     }
 }
+
+- (void)_handleCurrentFrameDataWithOpCode:(ZLOpCode)opcode {
+    NSUInteger frameOffset = _currentFrameData.length;
+    if (_currentFrameCompressed) {
+        ZLInflateResult inflateResult = [_perMessageDeflate finishInflatingIntoData:_currentFrameData];
+        if (inflateResult != ZLInflateResultOK) {
+            [self _closeWithInflateResult:inflateResult];
+            return;
+        }
+    }
+    if (_currentFrameStreaming) {
+        // Chunks never go through NSString, so the end of the message has to be checked here.
+        if (opcode == ZLOpCodeTextFrame &&
+            (!ZLUTF8ValidatorUpdate(&_currentStringValidator, (const uint8_t *)_currentFrameData.bytes + frameOffset, _currentFrameData.length - frameOffset) ||
+             !ZLUTF8ValidatorIsComplete(&_currentStringValidator))) {
+            [self closeWithCode:ZLStatusCodeInvalidUTF8 reason:@"Text frames must be valid UTF-8."];
+            dispatch_async(_workQueue, ^{
+                [self closeConnection];
+            });
+            return;
+        }
+        [self _deliverMessageChunk:_currentFrameData isFinal:YES];
+        [self _readFrameNew];
+        return;
+    }
+    [self _handleFrameWithData:_currentFrameData opCode:opcode];
+}
+
+- (BOOL)_isMessageChunkDeliveryBackedUp {
+    return _currentFrameStreaming && _pendingMessageChunkBytes >= MAX(self.maxPendingMessageChunkBytes, ZLMessageChunkSize);
+}
+
+- (void)_deliverMessageChunk:(NSData *)chunk isFinal:(BOOL)isFinal {
+    [self assertOnWorkQueue];
+
+    BOOL isText = _currentFrameOpcode == ZLOpCodeTextFrame;
+    NSUInteger chunkLength = chunk.length;
+    _pendingMessageChunkBytes += chunkLength;
+    [self performDelegateBlock:^(ZLWebSocket *webSocket) {
+        id<ZLWebSocketDelegate> delegate = webSocket.delegate;
+        if ([delegate respondsToSelector:@selector(webSocket:didReceiveMessageChunk:isText:isFinal:)]) {
+            [delegate webSocket:webSocket didReceiveMessageChunk:chunk isText:isText isFinal:isFinal];
+        }
+        dispatch_async(webSocket->_workQueue, ^{
+            webSocket->_pendingMessageChunkBytes -= MIN(chunkLength, webSocket->_pendingMessageChunkBytes);
+            if (webSocket->_readPaused && ![webSocket _isMessageChunkDeliveryBackedUp]) {
+                webSocket->_readPaused = NO;
+                if ([webSocket _readAvailableBytes]) {
+                    [webSocket _pumpScanner];
+                }
+            }
+        });
+    }];
+}
+
 /* From RFC:
 
  0                   1                   2                   3
@@ -2169,6 +3413,7 @@ static inline BOOL closeCodeIsValid(int closeCode) {
 static const uint8_t SRFinMask          = 0x80;
 static const uint8_t SROpCodeMask       = 0x0F;
 static const uint8_t SRRsvMask          = 0x70;
+static const uint8_t SRRsv1Mask         = 0x40;
 static const uint8_t SRMaskMask         = 0x80;
 static const uint8_t SRPayloadLenMask   = 0x7F;
 
@@ -2191,6 +3436,20 @@ static const uint8_t SRPayloadLenMask   = 0x7F;
     });
 }
 
+- (void)_closeWithInflateResult:(ZLInflateResult)result {
+    if (result != ZLInflateResultMessageTooBig) {
+        [self _closeWithProtocolError:@"Invalid compressed data"];
+        return;
+    }
+    // The connection is dropped without waiting for the server's close frame, so report our own code.
+    _closeCode = ZLStatusCodeMessageTooBig;
+    _closeReason = @"Message too big";
+    [self closeWithCode:_closeCode reason:_closeReason];
+    dispatch_async(_workQueue, ^{
+        [self closeConnection];
+    });
+}
+
 - (void)_readFrameContinue {
     assert((_currentFrameCount == 0 && _currentFrameOpcode == 0) || (_currentFrameCount > 0 && _currentFrameOpcode > 0));
 
@@ -2200,15 +3459,18 @@ static const uint8_t SRPayloadLenMask   = 0x7F;
         const uint8_t *headerBuffer = data.bytes;
         assert(data.length >= 2);
 
-        if (headerBuffer[0] & SRRsvMask) {
-            [sself _closeWithProtocolError:@"Server used RSV bits"];
-            return;
-        }
-
         uint8_t receivedOpcode = (SROpCodeMask & headerBuffer[0]);
 
         BOOL isControlFrame = (receivedOpcode == ZLOpCodePing || receivedOpcode == ZLOpCodePong || receivedOpcode == ZLOpCodeConnectionClose);
 
+        // RSV1 marks a compressed message, it is only allowed on the first frame of a data message.
+        uint8_t rsvBits = headerBuffer[0] & SRRsvMask;
+        BOOL compressed = rsvBits == SRRsv1Mask && sself->_perMessageDeflate && !isControlFrame && receivedOpcode != 0;
+        if (rsvBits && !compressed) {
+            [sself _closeWithProtocolError:@"Server used RSV bits"];
+            return;
+        }
+
         if (!isControlFrame && receivedOpcode != 0 && sself->_currentFrameCount > 0) {
             [sself _closeWithProtocolError:@"all data frames after the initial data frame must have opcode 0"];
             return;
@@ -2222,6 +3484,7 @@ static const uint8_t SRPayloadLenMask   = 0x7F;
         header.opcode = receivedOpcode == 0 ? sself->_currentFrameOpcode : receivedOpcode;
 
         header.fin = !!(SRFinMask & headerBuffer[0]);
+        header.rsv1 = compressed;
 
 
         header.masked = !!(SRMaskMask & headerBuffer[1]);
@@ -2291,7 +3554,9 @@ static const uint8_t SRPayloadLenMask   = 0x7F;
         self->_currentFrameOpcode = 0;
         self->_currentFrameCount = 0;
         self->_readOpCount = 0;
-        self->_currentStringScanPosition = 0;
+        ZLUTF8ValidatorReset(&self->_currentStringValidator);
+        self->_currentFrameCompressed = NO;
+        self->_currentFrameStreaming = NO;
 
         [self _readFrameContinue];
     });
@@ -2322,6 +3587,44 @@ static const uint8_t SRPayloadLenMask   = 0x7F;
     });
 }
 
+// Returns NO if reading failed
+- (BOOL)_readAvailableBytes {
+    [self assertOnWorkQueue];
+
+    while (_inputStream.hasBytesAvailable) {
+        if ([self _isMessageChunkDeliveryBackedUp]) {
+            // Leave the bytes in the socket until the delegate catches up, TCP flow control does the rest.
+            _readPaused = YES;
+            break;
+        }
+
+        // Read into a heap buffer that the read buffer takes ownership of, so received bytes are never copied again.
+        uint8_t *buffer = malloc(ZLDefaultBufferSize());
+        if (!buffer) {
+            NSError *error = [NSError errorWithDomain:ZLWebSocketErrorDomain code:ZLStatusCodeMessageTooBig userInfo:@{ NSLocalizedDescriptionKey: @"Unable to allocate memory to read from socket."}];
+            [self _failWithError:error];
+            return NO;
+        }
+        NSInteger bytesRead = [_inputStream read:buffer maxLength:ZLDefaultBufferSize()];
+        if (bytesRead > 0) {
+            dispatch_data_t data = dispatch_data_create(buffer, bytesRead, nil, DISPATCH_DATA_DESTRUCTOR_FREE);
+            if (!data) {
+                NSError *error = [NSError errorWithDomain:ZLWebSocketErrorDomain code:ZLStatusCodeMessageTooBig userInfo:@{ NSLocalizedDescriptionKey: @"Unable to allocate memory to read from socket."}];
+                [self _failWithError:error];
+                return NO;
+            }
+            _readBuffer = dispatch_data_create_concat(_readBuffer, data);
+        } else {
+            free(buffer);
+            if (bytesRead == -1) {
+                [self _failWithError:_inputStream.streamError];
+            }
+            break;
+        }
+    }
+    return YES;
+}
+
 - (void)safeHandleEvent:(NSStreamEvent)eventCode stream:(NSStream *)aStream {
     switch (eventCode) {
         case NSStreamEventOpenCompleted: {
@@ -2383,28 +3686,15 @@ static const uint8_t SRPayloadLenMask   = 0x7F;
         }
 
         case NSStreamEventHasBytesAvailable: {
-            uint8_t buffer[ZLDefaultBufferSize()];
-
-            while (_inputStream.hasBytesAvailable) {
-                NSInteger bytesRead = [_inputStream read:buffer maxLength:ZLDefaultBufferSize()];
-                if (bytesRead > 0) {
-                    dispatch_data_t data = dispatch_data_create(buffer, bytesRead, nil, DISPATCH_DATA_DESTRUCTOR_DEFAULT);
-                    if (!data) {
-                        NSError *error = [NSError errorWithDomain:ZLWebSocketErrorDomain code:ZLStatusCodeMessageTooBig userInfo:@{ NSLocalizedDescriptionKey: @"Unable to allocate memory to read from socket."}];
-                        [self _failWithError:error];
-                        return;
-                    }
-                    _readBuffer = dispatch_data_create_concat(_readBuffer, data);
-                } else if (bytesRead == -1) {
-                    [self _failWithError:_inputStream.streamError];
-                }
+            if ([self _readAvailableBytes]) {
+                [self _pumpScanner];
             }
-            [self _pumpScanner];
             break;
         }
 
         case NSStreamEventHasSpaceAvailable: {
             [self _pumpWriting];
+            [self _pumpOutgoingStream];
             break;
         }
 
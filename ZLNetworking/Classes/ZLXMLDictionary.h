@@ -73,6 +73,11 @@ typedef NS_ENUM(NSInteger, ZLXMLDictionaryNodeNameMode)
 - (nullable NSDictionary<NSString *, id> *)dictionaryWithString:(NSString *)string;
 - (nullable NSDictionary<NSString *, id> *)dictionaryWithFile:(NSString *)path;
 
+// Incremental parsing: feed the document in order as it arrives, then call
+// finishIncrementalParsing once to get the result. Not thread safe.
+- (void)appendIncrementalData:(NSData *)data;
+- (nullable NSDictionary<NSString *, id> *)finishIncrementalParsing;
+
 @end
 
 
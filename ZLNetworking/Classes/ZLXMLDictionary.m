@@ -30,6 +30,8 @@
 //
 
 #import "ZLXMLDictionary.h"
+#import "ZLXMLPullParser.h"
+#import "ZLUTF8Validator.h"
 
 
 #pragma GCC diagnostic ignored "-Wobjc-missing-property-synthesis"
@@ -74,12 +76,21 @@ static NSString *const ZLXMLDictionaryAttributePrefix = @"_";
 
 @property (nonatomic, strong) NSMutableDictionary<NSString *, id> *root;
 @property (nonatomic, strong) NSMutableArray *stack;
+@property (nonatomic, strong) NSMutableArray<NSString *> *nameStack;
 @property (nonatomic, strong) NSMutableString *text;
 
 @end
 
 
 @implementation ZLXMLDictionaryParser
+{
+    ZLXMLPullParser *_pullParser;
+    NSMutableArray<NSString *> *_names;
+    NSMutableDictionary<NSNumber *, NSString *> *_prefixedNames;
+    NSMutableData *_incrementalData;
+    ZLUTF8ValidatorState _incrementalValidator;
+    BOOL _pullParserFailed;
+}
 
 + (ZLXMLDictionaryParser *)sharedInstance
 {
@@ -127,16 +138,222 @@ static NSString *const ZLXMLDictionaryAttributePrefix = @"_";
     id result = _root;
     _root = nil;
     _stack = nil;
+    _nameStack = nil;
     _text = nil;
     return result;
 }
 
 - (NSDictionary<NSString *, id> *)dictionaryWithData:(NSData *)data
 {
+    NSDictionary<NSString *, id> *result = nil;
+    if ([self parseBytesOfData:data result:&result])
+    {
+        return result;
+    }
 	NSXMLParser *parser = [[NSXMLParser alloc] initWithData:data];
     return [self dictionaryWithParser:parser];
 }
 
+static inline NSString *ZLXMLStringWithBytes(const char *bytes, size_t length)
+{
+    return [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+}
+
+// 直接在字节上解析 UTF-8 文档，名字只创建一次 NSString，纯空白文本不创建对象；
+// 遇到不支持的输入返回 NO，由 NSXMLParser 重新解析，保证结果与原来一致
+- (BOOL)parseBytesOfData:(NSData *)data result:(NSDictionary<NSString *, id> **)result
+{
+    ZLUTF8ValidatorState validator;
+    ZLUTF8ValidatorReset(&validator);
+    if (!ZLUTF8ValidatorUpdate(&validator, data.bytes, data.length) || !ZLUTF8ValidatorIsComplete(&validator))
+    {
+        return NO;
+    }
+    
+    _pullParser = ZLXMLPullParserCreate(data.bytes, data.length);
+    if (!_pullParser)
+    {
+        return NO;
+    }
+    
+    BOOL finished = [self drainPullParser] == ZLXMLEventEndDocument;
+    if (finished)
+    {
+        *result = _root;
+    }
+    [self resetPullParser];
+    return finished;
+}
+
+- (void)resetPullParser
+{
+    ZLXMLPullParserDestroy(_pullParser);
+    _pullParser = NULL;
+    _names = nil;
+    _prefixedNames = nil;
+    _root = nil;
+    _stack = nil;
+    _nameStack = nil;
+    _text = nil;
+}
+
+- (NSString *)nameForID:(uint32_t)name
+{
+    if (!_names)
+    {
+        _names = [NSMutableArray array];
+    }
+    while (_names.count <= name)
+    {
+        size_t length = 0;
+        const char *bytes = ZLXMLPullParserNameBytes(_pullParser, (uint32_t)_names.count, &length);
+        [_names addObject:ZLXMLStringWithBytes(bytes, length) ?: @""];
+    }
+    return _names[name];
+}
+
+- (NSString *)prefixedNameForID:(uint32_t)name
+{
+    if (!_prefixedNames)
+    {
+        _prefixedNames = [NSMutableDictionary dictionary];
+    }
+    NSString *prefixedName = _prefixedNames[@(name)];
+    if (!prefixedName)
+    {
+        prefixedName = [ZLXMLDictionaryAttributePrefix stringByAppendingString:[self nameForID:name]];
+        _prefixedNames[@(name)] = prefixedName;
+    }
+    return prefixedName;
+}
+
+// 处理解析器中已有的事件，返回 EndDocument、NeedMoreData 或 Error
+- (ZLXMLEvent)drainPullParser
+{
+    for (;;)
+    {
+        ZLXMLEvent event = ZLXMLPullParserNext(_pullParser);
+        switch (event)
+        {
+            case ZLXMLEventStartElement:
+            case ZLXMLEventEndElement:
+            {
+                size_t length = 0;
+                const char *bytes = ZLXMLPullParserText(_pullParser, &length);
+                if (_trimWhiteSpace)
+                {
+                    while (length && (bytes[0] == ' ' || bytes[0] == '\t' || bytes[0] == '\n' || bytes[0] == '\r'))
+                    {
+                        bytes++;
+                        length--;
+                    }
+                    while (length && (bytes[length - 1] == ' ' || bytes[length - 1] == '\t' || bytes[length - 1] == '\n' || bytes[length - 1] == '\r'))
+                    {
+                        length--;
+                    }
+                }
+                if (length)
+                {
+                    NSString *text = ZLXMLStringWithBytes(bytes, length);
+                    if (_trimWhiteSpace && ((uint8_t)bytes[0] >= 0x80 || (uint8_t)bytes[length - 1] >= 0x80))
+                    {
+                        // 非 ASCII 的空白（如 U+00A0）交给 NSCharacterSet 处理
+                        text = [text stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+                    }
+                    [self endTextWithString:text];
+                }
+                
+                if (event == ZLXMLEventEndElement)
+                {
+                    [self endElement];
+                    break;
+                }
+                
+                NSString *elementName = [self nameForID:ZLXMLPullParserElementName(_pullParser)];
+                size_t attributeCount = ZLXMLPullParserAttributeCount(_pullParser);
+                NSMutableDictionary<NSString *, NSString *> *attributeDict = attributeCount ? [NSMutableDictionary dictionaryWithCapacity:attributeCount] : nil;
+                for (size_t i = 0; i < attributeCount && _attributesMode != ZLXMLDictionaryAttributesModeDiscard; i++)
+                {
+                    uint32_t name = 0;
+                    const char *value = ZLXMLPullParserAttribute(_pullParser, i, &name, &length);
+                    NSString *key = _attributesMode == ZLXMLDictionaryAttributesModePrefixed ? [self prefixedNameForID:name] : [self nameForID:name];
+                    attributeDict[key] = ZLXMLStringWithBytes(value, length) ?: @"";
+                }
+                [self startElement:elementName attributes:attributeDict attributesPrefixed:_attributesMode == ZLXMLDictionaryAttributesModePrefixed];
+                break;
+            }
+            case ZLXMLEventComment:
+            {
+                size_t length = 0;
+                const char *bytes = ZLXMLPullParserComment(_pullParser, &length);
+                [self addComment:ZLXMLStringWithBytes(bytes, length) ?: @""];
+                break;
+            }
+            case ZLXMLEventEndDocument:
+            case ZLXMLEventNeedMoreData:
+            case ZLXMLEventError:
+            {
+                return event;
+            }
+        }
+    }
+}
+
+- (void)appendIncrementalData:(NSData *)data
+{
+    if (!_incrementalData)
+    {
+        _incrementalData = [NSMutableData data];
+        _pullParser = ZLXMLPullParserCreate(NULL, 0);
+        _pullParserFailed = _pullParser == NULL;
+        ZLUTF8ValidatorReset(&_incrementalValidator);
+    }
+    // 保留完整数据，快速解析失败时交给 NSXMLParser 重新解析
+    [_incrementalData appendData:data];
+    if (_pullParserFailed)
+    {
+        return;
+    }
+    
+    if (!ZLUTF8ValidatorUpdate(&_incrementalValidator, data.bytes, data.length))
+    {
+        _pullParserFailed = YES;
+        return;
+    }
+    ZLXMLPullParserFeed(_pullParser, _incrementalData.bytes, _incrementalData.length, false);
+    _pullParserFailed = [self drainPullParser] == ZLXMLEventError;
+}
+
+- (NSDictionary<NSString *, id> *)finishIncrementalParsing
+{
+    NSData *data = _incrementalData ?: [NSData data];
+    NSDictionary<NSString *, id> *result = nil;
+    BOOL finished = NO;
+    if (_incrementalData && !_pullParserFailed && ZLUTF8ValidatorIsComplete(&_incrementalValidator))
+    {
+        ZLXMLPullParserFeed(_pullParser, data.bytes, data.length, true);
+        finished = [self drainPullParser] == ZLXMLEventEndDocument;
+        if (finished)
+        {
+            result = _root;
+        }
+    }
+    [self resetPullParser];
+    _incrementalData = nil;
+    _pullParserFailed = NO;
+    
+    if (!finished)
+    {
+        result = [self dictionaryWithParser:[[NSXMLParser alloc] initWithData:data]];
+    }
+    return result;
+}
+
+- (void)dealloc
+{
+    ZLXMLPullParserDestroy(_pullParser);
+}
+
 - (NSDictionary<NSString *, id> *)dictionaryWithString:(NSString *)string
 {
     NSData *data = [string dataUsingEncoding:NSUTF8StringEncoding];
@@ -190,24 +407,29 @@ static NSString *const ZLXMLDictionaryAttributePrefix = @"_";
 	{
 		_text = [[_text stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]] mutableCopy];
 	}
-	if (_text.length)
+	[self endTextWithString:_text];
+	_text = nil;
+}
+
+- (void)endTextWithString:(NSString *)text
+{
+	if (text.length)
 	{
         NSMutableDictionary *top = _stack.lastObject;
 		id existing = top[ZLXMLDictionaryTextKey];
         if ([existing isKindOfClass:[NSArray class]])
         {
-            [existing addObject:_text];
+            [existing addObject:text];
         }
         else if (existing)
         {
-            top[ZLXMLDictionaryTextKey] = [@[existing, _text] mutableCopy];
+            top[ZLXMLDictionaryTextKey] = [@[existing, text] mutableCopy];
         }
 		else
 		{
-			top[ZLXMLDictionaryTextKey] = _text;
+			top[ZLXMLDictionaryTextKey] = text;
 		}
 	}
-	_text = nil;
 }
 
 - (void)addText:(NSString *)text
@@ -225,7 +447,12 @@ static NSString *const ZLXMLDictionaryAttributePrefix = @"_";
 - (void)parser:(__unused NSXMLParser *)parser didStartElement:(NSString *)elementName namespaceURI:(__unused NSString *)namespaceURI qualifiedName:(__unused NSString *)qName attributes:(NSDictionary *)attributeDict
 {	
 	[self endText];
-	
+	[self startElement:elementName attributes:attributeDict attributesPrefixed:NO];
+}
+
+// attributesPrefixed 为 YES 时 attributeDict 的键已经带有前缀
+- (void)startElement:(NSString *)elementName attributes:(NSDictionary *)attributeDict attributesPrefixed:(BOOL)attributesPrefixed
+{
 	NSMutableDictionary<NSString *, id> *node = [NSMutableDictionary dictionary];
 	switch (_nodeNameMode)
 	{
@@ -254,6 +481,11 @@ static NSString *const ZLXMLDictionaryAttributePrefix = @"_";
         {
             case ZLXMLDictionaryAttributesModePrefixed:
             {
+                if (attributesPrefixed)
+                {
+                    [node addEntriesFromDictionary:attributeDict];
+                    break;
+                }
                 for (NSString *key in attributeDict)
                 {
                     node[[ZLXMLDictionaryAttributePrefix stringByAppendingString:key]] = attributeDict[key];
@@ -281,6 +513,7 @@ static NSString *const ZLXMLDictionaryAttributePrefix = @"_";
 	{
         _root = node;
         _stack = [NSMutableArray arrayWithObject:node];
+        _nameStack = [NSMutableArray arrayWithObject:elementName];
         if (_wrapRootNode)
         {
             _root = [NSMutableDictionary dictionaryWithObject:_root forKey:elementName];
@@ -308,44 +541,28 @@ static NSString *const ZLXMLDictionaryAttributePrefix = @"_";
 			top[elementName] = node;
 		}
 		[_stack addObject:node];
+		[_nameStack addObject:elementName];
 	}
 }
 
-- (NSString *)nameForNode:(NSDictionary<NSString *, id> *)node inDictionary:(NSDictionary<NSString *, id> *)dict
-{
-	if (node.nodeName)
-	{
-		return node.nodeName;
-	}
-	else
-	{
-		for (NSString *name in dict)
-		{
-			id object = dict[name];
-			if (object == node)
-			{
-				return name;
-			}
-			else if ([object isKindOfClass:[NSArray class]] && [(NSArray *)object containsObject:node])
-			{
-				return name;
-			}
-		}
-	}
-	return nil;
-}
-
 - (void)parser:(__unused NSXMLParser *)parser didEndElement:(__unused NSString *)elementName namespaceURI:(__unused NSString *)namespaceURI qualifiedName:(__unused NSString *)qName
 {	
 	[self endText];
-    
+	[self endElement];
+}
+
+- (void)endElement
+{
     NSMutableDictionary<NSString *, id> *top = _stack.lastObject;
     [_stack removeLastObject];
+    NSString *elementName = _nameStack.lastObject;
+    [_nameStack removeLastObject];
     
 	if (!top.attributes && !top.childNodes && !top.comments)
     {
         NSMutableDictionary<NSString *, id> *newTop = _stack.lastObject;
-        NSString *nodeName = [self nameForNode:top inDictionary:newTop];
+        // 节点在父节点中的键就是它的标签名，不必在父节点里查找
+        NSString *nodeName = newTop ? elementName : top.nodeName;
         if (nodeName)
         {
             id parentNode = newTop[nodeName];
@@ -394,6 +611,11 @@ static NSString *const ZLXMLDictionaryAttributePrefix = @"_";
 }
 
 - (void)parser:(__unused NSXMLParser *)parser foundComment:(NSString *)comment
+{
+	[self addComment:comment];
+}
+
+- (void)addComment:(NSString *)comment
 {
 	if (_preserveComments)
 	{
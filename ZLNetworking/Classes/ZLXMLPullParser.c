@@ -0,0 +1,714 @@
+//
+//  ZLXMLPullParser.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/2.
+//
+
+#include "ZLXMLPullParser.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct ZLXMLBuffer {
+    char *bytes;
+    size_t length;
+    size_t capacity;
+} ZLXMLBuffer;
+
+typedef struct ZLXMLSpan {
+    uint32_t offset;
+    uint32_t length;
+} ZLXMLSpan;
+
+typedef struct ZLXMLAttribute {
+    uint32_t name;
+    ZLXMLSpan value;
+} ZLXMLAttribute;
+
+struct ZLXMLPullParser {
+    const uint8_t *base;
+    const uint8_t *cur;
+    const uint8_t *end;
+    bool final;
+    bool checkedBOM;
+
+    // 驻留的名字，names 中依次存放，nameSpans 以编号为下标，table 为开放寻址哈希表，存放编号 + 1
+    ZLXMLBuffer names;
+    ZLXMLSpan *nameSpans;
+    uint32_t nameCount;
+    uint32_t nameCapacity;
+    uint32_t *table;
+    uint32_t tableCapacity;
+
+    uint32_t *stack;
+    size_t depth;
+    size_t stackCapacity;
+
+    ZLXMLBuffer text;
+    ZLXMLBuffer scratch;
+    ZLXMLAttribute *attributes;
+    size_t attributeCount;
+    size_t attributeCapacity;
+    ZLXMLSpan comment;
+
+    uint32_t element;
+    bool pendingEnd;
+    bool resetText;
+    bool seenRoot;
+    bool failed;
+};
+
+static bool ZLXMLBufferReserve(ZLXMLBuffer *buffer, size_t length) {
+    if (buffer->capacity - buffer->length >= length) {
+        return true;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 256;
+    while (capacity - buffer->length < length) {
+        if (capacity > SIZE_MAX / 2) {
+            return false;
+        }
+        capacity *= 2;
+    }
+    char *bytes = realloc(buffer->bytes, capacity);
+    if (bytes == NULL) {
+        return false;
+    }
+    buffer->bytes = bytes;
+    buffer->capacity = capacity;
+    return true;
+}
+
+static bool ZLXMLBufferAppend(ZLXMLBuffer *buffer, const void *bytes, size_t length) {
+    if (!ZLXMLBufferReserve(buffer, length)) {
+        return false;
+    }
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+    return true;
+}
+
+static inline bool ZLXMLIsSpace(uint8_t c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool ZLXMLIsNameTerminator(uint8_t c) {
+    return ZLXMLIsSpace(c) || c == '/' || c == '>' || c == '=' || c == '<' || c == '"' || c == '\'' || c == '&';
+}
+
+static uint32_t ZLXMLHash(const uint8_t *bytes, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool ZLXMLGrowNameTable(ZLXMLPullParser *parser) {
+    uint32_t capacity = parser->tableCapacity ? parser->tableCapacity * 2 : 64;
+    uint32_t *table = calloc(capacity, sizeof(uint32_t));
+    if (table == NULL) {
+        return false;
+    }
+    for (uint32_t name = 0; name < parser->nameCount; name++) {
+        ZLXMLSpan span = parser->nameSpans[name];
+        uint32_t slot = ZLXMLHash((const uint8_t *)parser->names.bytes + span.offset, span.length) & (capacity - 1);
+        while (table[slot] != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        table[slot] = name + 1;
+    }
+    free(parser->table);
+    parser->table = table;
+    parser->tableCapacity = capacity;
+    return true;
+}
+
+/// 返回名字编号，insert 为 false 且名字未出现过时返回 UINT32_MAX
+static uint32_t ZLXMLInternName(ZLXMLPullParser *parser, const uint8_t *bytes, size_t length, bool insert) {
+    if (length > UINT32_MAX || parser->names.length > UINT32_MAX - length) {
+        return UINT32_MAX;
+    }
+    if ((parser->nameCount + 1) * 2 > parser->tableCapacity && !ZLXMLGrowNameTable(parser)) {
+        return UINT32_MAX;
+    }
+    uint32_t slot = ZLXMLHash(bytes, length) & (parser->tableCapacity - 1);
+    while (parser->table[slot] != 0) {
+        uint32_t name = parser->table[slot] - 1;
+        ZLXMLSpan span = parser->nameSpans[name];
+        if (span.length == length && memcmp(parser->names.bytes + span.offset, bytes, length) == 0) {
+            return name;
+        }
+        slot = (slot + 1) & (parser->tableCapacity - 1);
+    }
+    if (!insert) {
+        return UINT32_MAX;
+    }
+
+    if (parser->nameCount == parser->nameCapacity) {
+        uint32_t capacity = parser->nameCapacity ? parser->nameCapacity * 2 : 32;
+        ZLXMLSpan *nameSpans = realloc(parser->nameSpans, capacity * sizeof(ZLXMLSpan));
+        if (nameSpans == NULL) {
+            return UINT32_MAX;
+        }
+        parser->nameSpans = nameSpans;
+        parser->nameCapacity = capacity;
+    }
+    ZLXMLSpan span = { (uint32_t)parser->names.length, (uint32_t)length };
+    if (!ZLXMLBufferAppend(&parser->names, bytes, length)) {
+        return UINT32_MAX;
+    }
+    parser->nameSpans[parser->nameCount] = span;
+    parser->table[slot] = parser->nameCount + 1;
+    return parser->nameCount++;
+}
+
+static size_t ZLXMLEncodeUTF8(uint32_t codepoint, char *out) {
+    if (codepoint < 0x80) {
+        out[0] = (char)codepoint;
+        return 1;
+    } else if (codepoint < 0x800) {
+        out[0] = (char)(0xC0 | (codepoint >> 6));
+        out[1] = (char)(0x80 | (codepoint & 0x3F));
+        return 2;
+    } else if (codepoint < 0x10000) {
+        out[0] = (char)(0xE0 | (codepoint >> 12));
+        out[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (codepoint & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (codepoint >> 18));
+    out[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (codepoint & 0x3F));
+    return 4;
+}
+
+/// 解析 & 之后的实体引用，成功时把解码结果写入 out 并返回消耗的字节数（包括分号）
+static size_t ZLXMLDecodeEntity(const uint8_t *bytes, const uint8_t *end, char *out, size_t *outLength) {
+    const uint8_t *semicolon = memchr(bytes, ';', (size_t)(end - bytes) < 16 ? (size_t)(end - bytes) : 16);
+    if (semicolon == NULL) {
+        return 0;
+    }
+    size_t length = (size_t)(semicolon - bytes);
+    static const struct { const char *name; char value; } predefined[] = {
+        { "lt", '<' }, { "gt", '>' }, { "amp", '&' }, { "quot", '"' }, { "apos", '\'' },
+    };
+    for (size_t i = 0; i < sizeof(predefined) / sizeof(predefined[0]); i++) {
+        if (strlen(predefined[i].name) == length && memcmp(predefined[i].name, bytes, length) == 0) {
+            out[0] = predefined[i].value;
+            *outLength = 1;
+            return length + 1;
+        }
+    }
+
+    if (length < 2 || bytes[0] != '#') {
+        return 0;
+    }
+    uint32_t codepoint = 0;
+    size_t i = 1;
+    bool hex = bytes[1] == 'x';
+    if (hex) {
+        i = 2;
+    }
+    if (i == length) {
+        return 0;
+    }
+    for (; i < length; i++) {
+        uint8_t c = bytes[i];
+        uint32_t digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (hex && c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (hex && c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return 0;
+        }
+        codepoint = codepoint * (hex ? 16 : 10) + digit;
+        if (codepoint > 0x10FFFF) {
+            return 0;
+        }
+    }
+    if (codepoint == 0 || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+        return 0;
+    }
+    *outLength = ZLXMLEncodeUTF8(codepoint, out);
+    return length + 1;
+}
+
+/// 追加一段文本或属性值：解码实体，统一换行符，属性值中的空白字符按规范替换成空格
+static bool ZLXMLAppendDecoded(ZLXMLBuffer *buffer, const uint8_t *bytes, const uint8_t *end, bool attribute, bool entities) {
+    if (!ZLXMLBufferReserve(buffer, (size_t)(end - bytes))) {
+        return false;
+    }
+    while (bytes < end) {
+        const uint8_t *run = bytes;
+        while (run < end && *run != '&' && *run != '\r' && !(attribute && (*run == '\n' || *run == '\t'))) {
+            run++;
+        }
+        // 实体解码后不会比原文长，预留的空间足够
+        memcpy(buffer->bytes + buffer->length, bytes, (size_t)(run - bytes));
+        buffer->length += (size_t)(run - bytes);
+        if (run == end) {
+            break;
+        }
+
+        if (*run == '&') {
+            if (!entities) {
+                buffer->bytes[buffer->length++] = '&';
+                bytes = run + 1;
+                continue;
+            }
+            size_t decodedLength = 0;
+            size_t consumed = ZLXMLDecodeEntity(run + 1, end, buffer->bytes + buffer->length, &decodedLength);
+            if (consumed == 0) {
+                return false;
+            }
+            buffer->length += decodedLength;
+            bytes = run + 1 + consumed;
+        } else if (*run == '\r') {
+            buffer->bytes[buffer->length++] = attribute ? ' ' : '\n';
+            bytes = run + 1;
+            if (bytes < end && *bytes == '\n') {
+                bytes++;
+            }
+        } else {
+            buffer->bytes[buffer->length++] = ' ';
+            bytes = run + 1;
+        }
+    }
+    return true;
+}
+
+static const uint8_t *ZLXMLFind(const uint8_t *bytes, const uint8_t *end, const char *pattern) {
+    size_t length = strlen(pattern);
+    while ((size_t)(end - bytes) >= length) {
+        const uint8_t *found = memchr(bytes, pattern[0], (size_t)(end - bytes) - length + 1);
+        if (found == NULL) {
+            return NULL;
+        }
+        if (memcmp(found, pattern, length) == 0) {
+            return found;
+        }
+        bytes = found + 1;
+    }
+    return NULL;
+}
+
+static bool ZLXMLHasPrefix(const uint8_t *bytes, const uint8_t *end, const char *prefix) {
+    size_t length = strlen(prefix);
+    return (size_t)(end - bytes) >= length && memcmp(bytes, prefix, length) == 0;
+}
+
+/// 只接受 UTF-8 及其子集的编码声明
+static bool ZLXMLCheckDeclaration(const uint8_t *bytes, const uint8_t *end) {
+    const uint8_t *encoding = ZLXMLFind(bytes, end, "encoding");
+    if (encoding == NULL) {
+        return true;
+    }
+    const uint8_t *cur = encoding + 8;
+    while (cur < end && (ZLXMLIsSpace(*cur) || *cur == '=')) {
+        cur++;
+    }
+    if (cur == end || (*cur != '"' && *cur != '\'')) {
+        return false;
+    }
+    uint8_t quote = *cur++;
+    const uint8_t *valueEnd = memchr(cur, quote, (size_t)(end - cur));
+    if (valueEnd == NULL) {
+        return false;
+    }
+    static const char *encodings[] = { "utf-8", "utf8", "us-ascii", "ascii" };
+    size_t length = (size_t)(valueEnd - cur);
+    for (size_t i = 0; i < sizeof(encodings) / sizeof(encodings[0]); i++) {
+        if (strlen(encodings[i]) != length) {
+            continue;
+        }
+        size_t j = 0;
+        while (j < length && (cur[j] | 0x20) == encodings[i][j]) {
+            j++;
+        }
+        if (j == length) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool ZLXMLSkipDoctype(ZLXMLPullParser *parser) {
+    const uint8_t *cur = parser->cur;
+    int brackets = 0;
+    while (cur < parser->end) {
+        uint8_t c = *cur;
+        if (c == '"' || c == '\'') {
+            const uint8_t *close = memchr(cur + 1, c, (size_t)(parser->end - cur - 1));
+            if (close == NULL) {
+                return false;
+            }
+            cur = close + 1;
+            continue;
+        }
+        if (c == '[') {
+            brackets++;
+        } else if (c == ']') {
+            brackets--;
+        } else if (c == '>' && brackets == 0) {
+            parser->cur = cur + 1;
+            return true;
+        }
+        cur++;
+    }
+    return false;
+}
+
+static const uint8_t *ZLXMLScanName(const uint8_t *cur, const uint8_t *end) {
+    if (cur == end || ZLXMLIsNameTerminator(*cur) || (*cur >= '0' && *cur <= '9') || *cur == '-' || *cur == '.') {
+        return NULL;
+    }
+    while (cur < end && !ZLXMLIsNameTerminator(*cur)) {
+        cur++;
+    }
+    return cur;
+}
+
+static inline const uint8_t *ZLXMLSkipSpaces(const uint8_t *cur, const uint8_t *end) {
+    while (cur < end && ZLXMLIsSpace(*cur)) {
+        cur++;
+    }
+    return cur;
+}
+
+static ZLXMLEvent ZLXMLFail(ZLXMLPullParser *parser) {
+    parser->failed = true;
+    return ZLXMLEventError;
+}
+
+static ZLXMLEvent ZLXMLParseStartTag(ZLXMLPullParser *parser) {
+    const uint8_t *end = parser->end;
+    const uint8_t *nameStart = parser->cur + 1;
+    const uint8_t *cur = ZLXMLScanName(nameStart, end);
+    if (cur == NULL || (parser->seenRoot && parser->depth == 0)) {
+        return ZLXMLFail(parser);
+    }
+    uint32_t element = ZLXMLInternName(parser, nameStart, (size_t)(cur - nameStart), true);
+    if (element == UINT32_MAX) {
+        return ZLXMLFail(parser);
+    }
+
+    for (;;) {
+        const uint8_t *afterSpace = ZLXMLSkipSpaces(cur, end);
+        if (afterSpace == end) {
+            return ZLXMLFail(parser);
+        }
+        if (*afterSpace == '>') {
+            cur = afterSpace + 1;
+            break;
+        }
+        if (*afterSpace == '/') {
+            if (afterSpace + 1 == end || afterSpace[1] != '>') {
+                return ZLXMLFail(parser);
+            }
+            parser->pendingEnd = true;
+            cur = afterSpace + 2;
+            break;
+        }
+        if (afterSpace == cur) {
+            return ZLXMLFail(parser);
+        }
+
+        const uint8_t *attributeName = afterSpace;
+        cur = ZLXMLScanName(attributeName, end);
+        if (cur == NULL) {
+            return ZLXMLFail(parser);
+        }
+        uint32_t name = ZLXMLInternName(parser, attributeName, (size_t)(cur - attributeName), true);
+        cur = ZLXMLSkipSpaces(cur, end);
+        if (name == UINT32_MAX || cur == end || *cur != '=') {
+            return ZLXMLFail(parser);
+        }
+        cur = ZLXMLSkipSpaces(cur + 1, end);
+        if (cur == end || (*cur != '"' && *cur != '\'')) {
+            return ZLXMLFail(parser);
+        }
+        uint8_t quote = *cur++;
+        const uint8_t *valueEnd = memchr(cur, quote, (size_t)(end - cur));
+        if (valueEnd == NULL || memchr(cur, '<', (size_t)(valueEnd - cur)) != NULL) {
+            return ZLXMLFail(parser);
+        }
+        for (size_t i = 0; i < parser->attributeCount; i++) {
+            if (parser->attributes[i].name == name) {
+                return ZLXMLFail(parser);
+            }
+        }
+
+        if (parser->attributeCount == parser->attributeCapacity) {
+            size_t capacity = parser->attributeCapacity ? parser->attributeCapacity * 2 : 8;
+            ZLXMLAttribute *attributes = realloc(parser->attributes, capacity * sizeof(ZLXMLAttribute));
+            if (attributes == NULL) {
+                return ZLXMLFail(parser);
+            }
+            parser->attributes = attributes;
+            parser->attributeCapacity = capacity;
+        }
+        size_t offset = parser->scratch.length;
+        if (offset > UINT32_MAX || !ZLXMLAppendDecoded(&parser->scratch, cur, valueEnd, true, true) || parser->scratch.length - offset > UINT32_MAX) {
+            return ZLXMLFail(parser);
+        }
+        ZLXMLAttribute *attribute = &parser->attributes[parser->attributeCount++];
+        attribute->name = name;
+        attribute->value.offset = (uint32_t)offset;
+        attribute->value.length = (uint32_t)(parser->scratch.length - offset);
+        cur = valueEnd + 1;
+    }
+
+    if (parser->depth == parser->stackCapacity) {
+        size_t capacity = parser->stackCapacity ? parser->stackCapacity * 2 : 32;
+        uint32_t *stack = realloc(parser->stack, capacity * sizeof(uint32_t));
+        if (stack == NULL) {
+            return ZLXMLFail(parser);
+        }
+        parser->stack = stack;
+        parser->stackCapacity = capacity;
+    }
+    parser->stack[parser->depth++] = element;
+    parser->element = element;
+    parser->seenRoot = true;
+    parser->cur = cur;
+    parser->resetText = true;
+    return ZLXMLEventStartElement;
+}
+
+static ZLXMLEvent ZLXMLParseEndTag(ZLXMLPullParser *parser) {
+    const uint8_t *end = parser->end;
+    const uint8_t *nameStart = parser->cur + 2;
+    const uint8_t *cur = ZLXMLScanName(nameStart, end);
+    if (cur == NULL || parser->depth == 0) {
+        return ZLXMLFail(parser);
+    }
+    uint32_t element = ZLXMLInternName(parser, nameStart, (size_t)(cur - nameStart), false);
+    cur = ZLXMLSkipSpaces(cur, end);
+    if (element != parser->stack[parser->depth - 1] || cur == end || *cur != '>') {
+        return ZLXMLFail(parser);
+    }
+    parser->depth--;
+    parser->element = element;
+    parser->cur = cur + 1;
+    parser->resetText = true;
+    return ZLXMLEventEndElement;
+}
+
+ZLXMLPullParser *ZLXMLPullParserCreate(const uint8_t *bytes, size_t length) {
+    ZLXMLPullParser *parser = calloc(1, sizeof(ZLXMLPullParser));
+    if (parser == NULL) {
+        return NULL;
+    }
+    parser->base = bytes;
+    parser->cur = bytes;
+    parser->end = bytes + length;
+    parser->final = true;
+    return parser;
+}
+
+void ZLXMLPullParserFeed(ZLXMLPullParser *parser, const uint8_t *bytes, size_t length, bool isFinal) {
+    size_t offset = (size_t)(parser->cur - parser->base);
+    parser->base = bytes;
+    parser->cur = bytes + offset;
+    parser->end = bytes + length;
+    parser->final = isFinal;
+}
+
+/// 未完成的结构在数据不完整时等待更多数据，否则视为格式错误
+static ZLXMLEvent ZLXMLNeedMoreData(ZLXMLPullParser *parser) {
+    if (parser->final) {
+        return ZLXMLFail(parser);
+    }
+    return ZLXMLEventNeedMoreData;
+}
+
+/// 开始标签的结束位置，跳过引号中的 >
+static const uint8_t *ZLXMLFindTagEnd(const uint8_t *cur, const uint8_t *end) {
+    uint8_t quote = 0;
+    for (; cur < end; cur++) {
+        if (quote) {
+            if (*cur == quote) {
+                quote = 0;
+            }
+        } else if (*cur == '"' || *cur == '\'') {
+            quote = *cur;
+        } else if (*cur == '>') {
+            return cur;
+        }
+    }
+    return NULL;
+}
+
+void ZLXMLPullParserDestroy(ZLXMLPullParser *parser) {
+    if (parser == NULL) {
+        return;
+    }
+    free(parser->names.bytes);
+    free(parser->nameSpans);
+    free(parser->table);
+    free(parser->stack);
+    free(parser->text.bytes);
+    free(parser->scratch.bytes);
+    free(parser->attributes);
+    free(parser);
+}
+
+ZLXMLEvent ZLXMLPullParserNext(ZLXMLPullParser *parser) {
+    if (parser->failed) {
+        return ZLXMLEventError;
+    }
+
+    if (!parser->checkedBOM) {
+        const uint8_t *bytes = parser->cur;
+        size_t length = (size_t)(parser->end - bytes);
+        if (length < 3 && !parser->final) {
+            return ZLXMLEventNeedMoreData;
+        }
+        if (length >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) {
+            parser->cur += 3;
+        } else if (length >= 2 && ((bytes[0] == 0xFE && bytes[1] == 0xFF) || (bytes[0] == 0xFF && bytes[1] == 0xFE))) {
+            return ZLXMLFail(parser);
+        }
+        parser->checkedBOM = true;
+    }
+
+    parser->scratch.length = 0;
+    parser->attributeCount = 0;
+    if (parser->resetText) {
+        parser->text.length = 0;
+        parser->resetText = false;
+    }
+
+    if (parser->pendingEnd) {
+        // <a/> 在开始事件之后紧跟一个没有文本的结束事件
+        parser->pendingEnd = false;
+        parser->depth--;
+        parser->resetText = true;
+        return ZLXMLEventEndElement;
+    }
+
+    const uint8_t *end = parser->end;
+    while (parser->cur < end) {
+        const uint8_t *cur = parser->cur;
+        if (*cur != '<') {
+            const uint8_t *textEnd = memchr(cur, '<', (size_t)(end - cur));
+            if (textEnd == NULL) {
+                if (!parser->final) {
+                    // 文本末尾可能是不完整的实体，等到下一个标签出现再解码
+                    return ZLXMLEventNeedMoreData;
+                }
+                textEnd = end;
+            }
+            if (parser->depth == 0) {
+                // 根节点之外只允许空白
+                if (ZLXMLSkipSpaces(cur, textEnd) != textEnd) {
+                    return ZLXMLFail(parser);
+                }
+            } else if (!ZLXMLAppendDecoded(&parser->text, cur, textEnd, false, true)) {
+                return ZLXMLFail(parser);
+            }
+            parser->cur = textEnd;
+            continue;
+        }
+
+        if (cur + 1 == end || (cur[1] == '!' && end - cur < 9 && !parser->final)) {
+            return ZLXMLNeedMoreData(parser);
+        }
+
+        if (cur[1] == '/') {
+            if (memchr(cur, '>', (size_t)(end - cur)) == NULL) {
+                return ZLXMLNeedMoreData(parser);
+            }
+            return ZLXMLParseEndTag(parser);
+        } else if (cur[1] == '?') {
+            const uint8_t *close = ZLXMLFind(cur + 2, end, "?>");
+            if (close == NULL) {
+                return ZLXMLNeedMoreData(parser);
+            }
+            if (ZLXMLHasPrefix(cur, end, "<?xml") && ZLXMLIsSpace(cur[5]) && !ZLXMLCheckDeclaration(cur + 5, close)) {
+                return ZLXMLFail(parser);
+            }
+            parser->cur = close + 2;
+        } else if (ZLXMLHasPrefix(cur, end, "<!--")) {
+            const uint8_t *close = ZLXMLFind(cur + 4, end, "-->");
+            if (close == NULL) {
+                return ZLXMLNeedMoreData(parser);
+            }
+            if (!ZLXMLAppendDecoded(&parser->scratch, cur + 4, close, false, false) || parser->scratch.length > UINT32_MAX) {
+                return ZLXMLFail(parser);
+            }
+            parser->comment.offset = 0;
+            parser->comment.length = (uint32_t)parser->scratch.length;
+            parser->cur = close + 3;
+            return ZLXMLEventComment;
+        } else if (ZLXMLHasPrefix(cur, end, "<![CDATA[")) {
+            const uint8_t *close = ZLXMLFind(cur + 9, end, "]]>");
+            if (close == NULL) {
+                return ZLXMLNeedMoreData(parser);
+            }
+            if (parser->depth == 0 || !ZLXMLAppendDecoded(&parser->text, cur + 9, close, false, false)) {
+                return ZLXMLFail(parser);
+            }
+            parser->cur = close + 3;
+        } else if (ZLXMLHasPrefix(cur, end, "<!DOCTYPE")) {
+            if (parser->seenRoot) {
+                return ZLXMLFail(parser);
+            }
+            parser->cur = cur + 9;
+            if (!ZLXMLSkipDoctype(parser)) {
+                parser->cur = cur;
+                return ZLXMLNeedMoreData(parser);
+            }
+        } else if (cur[1] == '!') {
+            return ZLXMLFail(parser);
+        } else {
+            if (ZLXMLFindTagEnd(cur + 1, end) == NULL) {
+                return ZLXMLNeedMoreData(parser);
+            }
+            return ZLXMLParseStartTag(parser);
+        }
+    }
+
+    if (!parser->final) {
+        return ZLXMLEventNeedMoreData;
+    }
+    if (parser->depth > 0 || !parser->seenRoot) {
+        return ZLXMLFail(parser);
+    }
+    return ZLXMLEventEndDocument;
+}
+
+uint32_t ZLXMLPullParserElementName(const ZLXMLPullParser *parser) {
+    return parser->element;
+}
+
+const char *ZLXMLPullParserNameBytes(const ZLXMLPullParser *parser, uint32_t name, size_t *length) {
+    ZLXMLSpan span = parser->nameSpans[name];
+    *length = span.length;
+    return parser->names.bytes + span.offset;
+}
+
+const char *ZLXMLPullParserText(const ZLXMLPullParser *parser, size_t *length) {
+    *length = parser->text.length;
+    return parser->text.bytes;
+}
+
+size_t ZLXMLPullParserAttributeCount(const ZLXMLPullParser *parser) {
+    return parser->attributeCount;
+}
+
+const char *ZLXMLPullParserAttribute(const ZLXMLPullParser *parser, size_t index, uint32_t *name, size_t *length) {
+    ZLXMLAttribute attribute = parser->attributes[index];
+    *name = attribute.name;
+    *length = attribute.value.length;
+    return parser->scratch.bytes + attribute.value.offset;
+}
+
+const char *ZLXMLPullParserComment(const ZLXMLPullParser *parser, size_t *length) {
+    *length = parser->comment.length;
+    return parser->scratch.bytes + parser->comment.offset;
+}
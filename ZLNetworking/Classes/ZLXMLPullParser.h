@@ -0,0 +1,65 @@
+//
+//  ZLXMLPullParser.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/3/2.
+//
+
+#ifndef ZLXMLPullParser_h
+#define ZLXMLPullParser_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 直接在 UTF-8 字节上工作的拉取式 XML 解析器。
+/// 标签名和属性名会被驻留为递增的编号，文本、属性值、注释解码后放在解析器自己的缓冲区里，不为每个节点单独分配内存。
+/// 只支持 UTF-8 输入和预定义实体，遇到其它编码、自定义实体或格式错误时返回 ZLXMLEventError，由调用方退回完整的解析器
+typedef enum ZLXMLEvent {
+    ZLXMLEventEndDocument = 0,
+    ZLXMLEventStartElement,
+    ZLXMLEventEndElement,
+    ZLXMLEventComment,
+    ZLXMLEventNeedMoreData,
+    ZLXMLEventError,
+} ZLXMLEvent;
+
+typedef struct ZLXMLPullParser ZLXMLPullParser;
+
+/// bytes 在解析器销毁前必须保持有效，不会被复制
+ZLXMLPullParser *ZLXMLPullParserCreate(const uint8_t *bytes, size_t length);
+
+void ZLXMLPullParserDestroy(ZLXMLPullParser *parser);
+
+/// 分片输入：bytes 为到目前为止收到的全部数据（可以是重新分配过的新地址），isFinal 为 false 时，
+/// 解析到不完整的结构会返回 ZLXMLEventNeedMoreData，补充数据后重新调用即可从原位置继续
+void ZLXMLPullParserFeed(ZLXMLPullParser *parser, const uint8_t *bytes, size_t length, bool isFinal);
+
+ZLXMLEvent ZLXMLPullParserNext(ZLXMLPullParser *parser);
+
+/// 当前开始/结束标签的名字编号
+uint32_t ZLXMLPullParserElementName(const ZLXMLPullParser *parser);
+
+/// 名字编号按首次出现的顺序从 0 开始分配，返回的字节在解析器销毁前有效
+const char *ZLXMLPullParserNameBytes(const ZLXMLPullParser *parser, uint32_t name, size_t *length);
+
+/// 当前开始/结束标签之前累积的文本（包括 CDATA，中间的注释不会打断），到下一个标签事件前有效
+const char *ZLXMLPullParserText(const ZLXMLPullParser *parser, size_t *length);
+
+/// 当前开始标签的属性，到下一次调用 ZLXMLPullParserNext 前有效
+size_t ZLXMLPullParserAttributeCount(const ZLXMLPullParser *parser);
+
+const char *ZLXMLPullParserAttribute(const ZLXMLPullParser *parser, size_t index, uint32_t *name, size_t *length);
+
+/// 当前注释的内容，到下一次调用 ZLXMLPullParserNext 前有效
+const char *ZLXMLPullParserComment(const ZLXMLPullParser *parser, size_t *length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZLXMLPullParser_h */
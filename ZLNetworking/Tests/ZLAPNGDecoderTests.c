@@ -0,0 +1,749 @@
+//
+//  ZLAPNGDecoderTests.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLTestSupport.h"
+#include "ZLAPNGDecoder.h"
+
+#include <zlib.h>
+
+/// 随机生成动画（各种颜色类型、位深、隔行、过滤方式、dispose 和 blend），用测试里的编码器写成 APNG，
+/// 再用一个逐像素的参考合成器算出每帧画面，与解码器整体追加、随机分片追加的结果逐帧比较
+#define ZLAPNGTestMaxFrames 6
+
+typedef struct ZLAPNGTestFrame {
+    ZLAPNGRect rect;
+    uint16_t delayNumerator;
+    uint16_t delayDenominator;
+    uint8_t dispose;
+    uint8_t blend;
+    uint16_t *samples;          // rect.width * rect.height * 通道数个样本
+} ZLAPNGTestFrame;
+
+typedef struct ZLAPNGTestImage {
+    uint32_t width;
+    uint32_t height;
+    uint8_t colorType;
+    uint8_t bitDepth;
+    bool interlaced;
+    uint32_t plays;
+    uint8_t palette[256 * 3];
+    uint32_t paletteCount;
+    uint8_t paletteAlpha[256];
+    uint32_t paletteAlphaCount;
+    bool hasKey;
+    uint16_t key[3];
+    bool defaultIsFrame;        // IDAT 同时是第一帧；否则 IDAT 是单独的默认图像
+    ZLAPNGTestFrame defaultImage;
+    ZLAPNGTestFrame frames[ZLAPNGTestMaxFrames];
+    size_t frameCount;
+} ZLAPNGTestImage;
+
+static uint32_t ZLAPNGTestChannels(uint8_t colorType) {
+    switch (colorType) {
+        case 2:
+            return 3;
+        case 4:
+            return 2;
+        case 6:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+/* 编码器 */
+
+static void ZLAPNGTestAppendUInt32(ZLTestBuffer *buffer, uint32_t value) {
+    uint8_t bytes[4] = {(uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value};
+    ZLTestBufferAppend(buffer, bytes, 4);
+}
+
+static void ZLAPNGTestAppendUInt16(ZLTestBuffer *buffer, uint16_t value) {
+    uint8_t bytes[2] = {(uint8_t)(value >> 8), (uint8_t)value};
+    ZLTestBufferAppend(buffer, bytes, 2);
+}
+
+static void ZLAPNGTestAppendChunk(ZLTestBuffer *file, const char *type, const void *data, size_t length) {
+    ZLAPNGTestAppendUInt32(file, (uint32_t)length);
+    size_t start = file->length;
+    ZLTestBufferAppend(file, type, 4);
+    ZLTestBufferAppend(file, data, length);
+    ZLAPNGTestAppendUInt32(file, (uint32_t)crc32(0, (const Bytef *)file->bytes + start, (uInt)(length + 4)));
+}
+
+static void ZLAPNGTestPackRow(const ZLAPNGTestImage *image, const uint16_t *samples, uint32_t count, uint8_t *row) {
+    uint32_t depth = image->bitDepth;
+    if (depth == 16) {
+        for (uint32_t i = 0; i < count; i++) {
+            row[i * 2] = (uint8_t)(samples[i] >> 8);
+            row[i * 2 + 1] = (uint8_t)samples[i];
+        }
+    } else if (depth == 8) {
+        for (uint32_t i = 0; i < count; i++) {
+            row[i] = (uint8_t)samples[i];
+        }
+    } else {
+        memset(row, 0, (count * depth + 7) / 8);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t bit = i * depth;
+            row[bit / 8] |= (uint8_t)(samples[i] << (8 - depth - bit % 8));
+        }
+    }
+}
+
+static uint8_t ZLAPNGTestPaeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return (uint8_t)(pa <= pb && pa <= pc ? a : (pb <= pc ? b : c));
+}
+
+/// 按 PNG 规范正向过滤一行，previous 为 NULL 时上一行按 0 处理
+static void ZLAPNGTestFilterRow(uint8_t filter, const uint8_t *row, const uint8_t *previous, size_t length, size_t pixelBytes, uint8_t *output) {
+    output[0] = filter;
+    for (size_t i = 0; i < length; i++) {
+        int left = i >= pixelBytes ? row[i - pixelBytes] : 0;
+        int up = previous ? previous[i] : 0;
+        int upLeft = previous && i >= pixelBytes ? previous[i - pixelBytes] : 0;
+        int predictor = 0;
+        switch (filter) {
+            case 1:
+                predictor = left;
+                break;
+            case 2:
+                predictor = up;
+                break;
+            case 3:
+                predictor = (left + up) / 2;
+                break;
+            case 4:
+                predictor = ZLAPNGTestPaeth(left, up, upLeft);
+                break;
+        }
+        output[1 + i] = (uint8_t)(row[i] - predictor);
+    }
+}
+
+/// 一帧的扫描行（含过滤类型字节），隔行时按 Adam7 的七遍依次排列
+static void ZLAPNGTestScanlines(ZLTestRandom *random, const ZLAPNGTestImage *image, const ZLAPNGTestFrame *frame, ZLTestBuffer *output) {
+    static const uint32_t startX[7] = {0, 4, 0, 2, 0, 1, 0}, startY[7] = {0, 0, 4, 0, 2, 0, 1};
+    static const uint32_t stepX[7] = {8, 8, 4, 4, 2, 2, 1}, stepY[7] = {8, 8, 8, 4, 4, 2, 2};
+    uint32_t channels = ZLAPNGTestChannels(image->colorType);
+    size_t pixelBytes = (channels * image->bitDepth + 7) / 8;
+    int passes = image->interlaced ? 7 : 1;
+    uint8_t filterChoice = (uint8_t)ZLTestRandomBelow(random, 6);
+    for (int pass = 0; pass < passes; pass++) {
+        uint32_t x0 = image->interlaced ? startX[pass] : 0, y0 = image->interlaced ? startY[pass] : 0;
+        uint32_t dx = image->interlaced ? stepX[pass] : 1, dy = image->interlaced ? stepY[pass] : 1;
+        uint32_t width = frame->rect.width > x0 ? (frame->rect.width - x0 + dx - 1) / dx : 0;
+        uint32_t height = frame->rect.height > y0 ? (frame->rect.height - y0 + dy - 1) / dy : 0;
+        if (width == 0 || height == 0) {
+            continue;
+        }
+        size_t rowBytes = ((size_t)width * channels * image->bitDepth + 7) / 8;
+        uint16_t *samples = malloc((size_t)width * channels * sizeof(uint16_t));
+        uint8_t *rows = calloc(2, rowBytes);
+        uint8_t *filtered = malloc(rowBytes + 1);
+        if (samples == NULL || rows == NULL || filtered == NULL) {
+            abort();
+        }
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                const uint16_t *pixel = frame->samples + ((size_t)(y0 + y * dy) * frame->rect.width + x0 + x * dx) * channels;
+                memcpy(samples + (size_t)x * channels, pixel, channels * sizeof(uint16_t));
+            }
+            uint8_t *row = rows + (y % 2) * rowBytes;
+            const uint8_t *previous = y ? rows + ((y + 1) % 2) * rowBytes : NULL;
+            ZLAPNGTestPackRow(image, samples, width * channels, row);
+            // 0-4 固定用一种过滤，5 每行随机
+            uint8_t filter = filterChoice < 5 ? filterChoice : (uint8_t)ZLTestRandomBelow(random, 5);
+            ZLAPNGTestFilterRow(filter, row, previous, rowBytes, pixelBytes, filtered);
+            ZLTestBufferAppend(output, filtered, rowBytes + 1);
+        }
+        free(samples);
+        free(rows);
+        free(filtered);
+    }
+}
+
+/// 压缩后的数据随机拆成若干个 IDAT 或 fdAT 块
+static void ZLAPNGTestAppendImageData(ZLTestRandom *random, const ZLAPNGTestImage *image, const ZLAPNGTestFrame *frame,
+                                      bool isDefaultImage, uint32_t *sequence, ZLTestBuffer *file) {
+    ZLTestBuffer scanlines = {0};
+    ZLAPNGTestScanlines(random, image, frame, &scanlines);
+    uLongf compressedLength = compressBound((uLong)scanlines.length);
+    uint8_t *compressed = malloc(compressedLength);
+    if (compressed == NULL ||
+        compress2(compressed, &compressedLength, (const Bytef *)scanlines.bytes, (uLong)scanlines.length, (int)ZLTestRandomBelow(random, 10)) != Z_OK) {
+        abort();
+    }
+    size_t offset = 0;
+    while (offset < compressedLength) {
+        size_t length = compressedLength - offset;
+        if (ZLTestRandomBelow(random, 2)) {
+            length = 1 + (size_t)ZLTestRandomBelow(random, length);
+        }
+        if (isDefaultImage) {
+            ZLAPNGTestAppendChunk(file, "IDAT", compressed + offset, length);
+        } else {
+            ZLTestBuffer chunk = {0};
+            ZLAPNGTestAppendUInt32(&chunk, (*sequence)++);
+            ZLTestBufferAppend(&chunk, compressed + offset, length);
+            ZLAPNGTestAppendChunk(file, "fdAT", chunk.bytes, chunk.length);
+            ZLTestBufferFree(&chunk);
+        }
+        offset += length;
+    }
+    free(compressed);
+    ZLTestBufferFree(&scanlines);
+}
+
+static void ZLAPNGTestAppendFrameControl(const ZLAPNGTestFrame *frame, uint32_t *sequence, ZLTestBuffer *file) {
+    ZLTestBuffer chunk = {0};
+    ZLAPNGTestAppendUInt32(&chunk, (*sequence)++);
+    ZLAPNGTestAppendUInt32(&chunk, frame->rect.width);
+    ZLAPNGTestAppendUInt32(&chunk, frame->rect.height);
+    ZLAPNGTestAppendUInt32(&chunk, frame->rect.x);
+    ZLAPNGTestAppendUInt32(&chunk, frame->rect.y);
+    ZLAPNGTestAppendUInt16(&chunk, frame->delayNumerator);
+    ZLAPNGTestAppendUInt16(&chunk, frame->delayDenominator);
+    uint8_t ops[2] = {frame->dispose, frame->blend};
+    ZLTestBufferAppend(&chunk, ops, 2);
+    ZLAPNGTestAppendChunk(file, "fcTL", chunk.bytes, chunk.length);
+    ZLTestBufferFree(&chunk);
+}
+
+static void ZLAPNGTestEncode(ZLTestRandom *random, const ZLAPNGTestImage *image, ZLTestBuffer *file) {
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    ZLTestBufferAppend(file, signature, sizeof(signature));
+
+    ZLTestBuffer chunk = {0};
+    ZLAPNGTestAppendUInt32(&chunk, image->width);
+    ZLAPNGTestAppendUInt32(&chunk, image->height);
+    uint8_t header[5] = {image->bitDepth, image->colorType, 0, 0, image->interlaced};
+    ZLTestBufferAppend(&chunk, header, sizeof(header));
+    ZLAPNGTestAppendChunk(file, "IHDR", chunk.bytes, chunk.length);
+
+    // acTL 放在 PLTE 前后都可以
+    bool controlFirst = ZLTestRandomBelow(random, 2);
+    ZLTestBufferClear(&chunk);
+    ZLAPNGTestAppendUInt32(&chunk, (uint32_t)image->frameCount);
+    ZLAPNGTestAppendUInt32(&chunk, image->plays);
+    if (controlFirst) {
+        ZLAPNGTestAppendChunk(file, "acTL", chunk.bytes, chunk.length);
+    }
+    if (image->colorType == 3) {
+        ZLAPNGTestAppendChunk(file, "PLTE", image->palette, image->paletteCount * 3);
+        if (image->paletteAlphaCount) {
+            ZLAPNGTestAppendChunk(file, "tRNS", image->paletteAlpha, image->paletteAlphaCount);
+        }
+    } else if (image->hasKey) {
+        ZLTestBuffer key = {0};
+        for (uint32_t i = 0; i < (image->colorType == 2 ? 3u : 1u); i++) {
+            ZLAPNGTestAppendUInt16(&key, image->key[i]);
+        }
+        ZLAPNGTestAppendChunk(file, "tRNS", key.bytes, key.length);
+        ZLTestBufferFree(&key);
+    }
+    if (!controlFirst) {
+        ZLAPNGTestAppendChunk(file, "acTL", chunk.bytes, chunk.length);
+    }
+    ZLTestBufferFree(&chunk);
+
+    uint32_t sequence = 0;
+    size_t first = 0;
+    if (image->defaultIsFrame) {
+        ZLAPNGTestAppendFrameControl(&image->frames[0], &sequence, file);
+        ZLAPNGTestAppendImageData(random, image, &image->frames[0], true, &sequence, file);
+        first = 1;
+    } else {
+        ZLAPNGTestAppendImageData(random, image, &image->defaultImage, true, &sequence, file);
+    }
+    for (size_t i = first; i < image->frameCount; i++) {
+        if (ZLTestRandomBelow(random, 4) == 0) {
+            ZLAPNGTestAppendChunk(file, "tEXt", "Comment\0frame", 13);
+        }
+        ZLAPNGTestAppendFrameControl(&image->frames[i], &sequence, file);
+        ZLAPNGTestAppendImageData(random, image, &image->frames[i], false, &sequence, file);
+    }
+    ZLAPNGTestAppendChunk(file, "IEND", NULL, 0);
+}
+
+/* 随机图像 */
+
+static uint16_t ZLAPNGTestSample(ZLTestRandom *random, const ZLAPNGTestImage *image, uint32_t channel) {
+    uint32_t limit = image->colorType == 3 ? image->paletteCount + 2 : 1u << image->bitDepth;
+    if (image->colorType == 3 && limit > (1u << image->bitDepth)) {
+        limit = 1u << image->bitDepth;
+    }
+    // 透明色出现得多一些，alpha 偏向 0 和最大值
+    if (image->hasKey && ZLTestRandomBelow(random, 4) == 0) {
+        return image->key[channel];
+    }
+    bool isAlpha = (image->colorType == 4 && channel == 1) || (image->colorType == 6 && channel == 3);
+    if (isAlpha && ZLTestRandomBelow(random, 2)) {
+        return ZLTestRandomBelow(random, 2) ? (uint16_t)(limit - 1) : 0;
+    }
+    return (uint16_t)ZLTestRandomBelow(random, limit);
+}
+
+static void ZLAPNGTestRandomSamples(ZLTestRandom *random, const ZLAPNGTestImage *image, ZLAPNGTestFrame *frame) {
+    uint32_t channels = ZLAPNGTestChannels(image->colorType);
+    size_t count = (size_t)frame->rect.width * frame->rect.height;
+    frame->samples = malloc(count * channels * sizeof(uint16_t));
+    if (frame->samples == NULL) {
+        abort();
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (image->hasKey && ZLTestRandomBelow(random, 4) == 0) {
+            memcpy(frame->samples + i * channels, image->key, channels * sizeof(uint16_t));
+            continue;
+        }
+        for (uint32_t c = 0; c < channels; c++) {
+            frame->samples[i * channels + c] = ZLAPNGTestSample(random, image, c);
+        }
+    }
+}
+
+static void ZLAPNGTestRandomImage(ZLTestRandom *random, ZLAPNGTestImage *image) {
+    static const uint8_t colorTypes[5] = {0, 2, 3, 4, 6};
+    memset(image, 0, sizeof(*image));
+    image->width = 1 + (uint32_t)ZLTestRandomBelow(random, 24);
+    image->height = 1 + (uint32_t)ZLTestRandomBelow(random, 24);
+    image->colorType = colorTypes[ZLTestRandomBelow(random, 5)];
+    switch (image->colorType) {
+        case 0:
+            image->bitDepth = (uint8_t)(1u << ZLTestRandomBelow(random, 5));
+            break;
+        case 3:
+            image->bitDepth = (uint8_t)(1u << ZLTestRandomBelow(random, 4));
+            break;
+        default:
+            image->bitDepth = ZLTestRandomBelow(random, 2) ? 16 : 8;
+            break;
+    }
+    image->interlaced = ZLTestRandomBelow(random, 2);
+    image->plays = (uint32_t)ZLTestRandomBelow(random, 3);
+
+    if (image->colorType == 3) {
+        image->paletteCount = 1 + (uint32_t)ZLTestRandomBelow(random, 1u << image->bitDepth);
+        for (uint32_t i = 0; i < image->paletteCount * 3; i++) {
+            image->palette[i] = (uint8_t)ZLTestRandomNext(random);
+        }
+        image->paletteAlphaCount = (uint32_t)ZLTestRandomBelow(random, image->paletteCount + 1);
+        for (uint32_t i = 0; i < image->paletteAlphaCount; i++) {
+            image->paletteAlpha[i] = (uint8_t)ZLTestRandomNext(random);
+        }
+    } else if ((image->colorType == 0 || image->colorType == 2) && ZLTestRandomBelow(random, 2)) {
+        image->hasKey = true;
+        for (uint32_t i = 0; i < 3; i++) {
+            image->key[i] = (uint16_t)ZLTestRandomBelow(random, 1u << image->bitDepth);
+        }
+    }
+
+    image->defaultIsFrame = ZLTestRandomBelow(random, 3) != 0;
+    if (!image->defaultIsFrame) {
+        image->defaultImage.rect.width = image->width;
+        image->defaultImage.rect.height = image->height;
+        ZLAPNGTestRandomSamples(random, image, &image->defaultImage);
+    }
+    image->frameCount = 1 + (size_t)ZLTestRandomBelow(random, ZLAPNGTestMaxFrames);
+    for (size_t i = 0; i < image->frameCount; i++) {
+        ZLAPNGTestFrame *frame = &image->frames[i];
+        if (i == 0 && image->defaultIsFrame) {
+            frame->rect.width = image->width;
+            frame->rect.height = image->height;
+        } else {
+            frame->rect.x = (uint32_t)ZLTestRandomBelow(random, image->width);
+            frame->rect.y = (uint32_t)ZLTestRandomBelow(random, image->height);
+            frame->rect.width = 1 + (uint32_t)ZLTestRandomBelow(random, image->width - frame->rect.x);
+            frame->rect.height = 1 + (uint32_t)ZLTestRandomBelow(random, image->height - frame->rect.y);
+        }
+        frame->delayNumerator = (uint16_t)ZLTestRandomBelow(random, 200);
+        frame->delayDenominator = (uint16_t)ZLTestRandomBelow(random, 3) * 50;
+        frame->dispose = (uint8_t)ZLTestRandomBelow(random, 3);
+        frame->blend = (uint8_t)ZLTestRandomBelow(random, 2);
+        ZLAPNGTestRandomSamples(random, image, frame);
+    }
+}
+
+static void ZLAPNGTestFreeImage(ZLAPNGTestImage *image) {
+    free(image->defaultImage.samples);
+    for (size_t i = 0; i < image->frameCount; i++) {
+        free(image->frames[i].samples);
+    }
+}
+
+/* 参考合成器 */
+
+static uint32_t ZLAPNGTestScale(uint32_t c, uint32_t a) {
+    return (c * a * 2 + 255) / 510;
+}
+
+static uint32_t ZLAPNGTestPremultiply(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+    if (a == 0) {
+        return 0;
+    }
+    return (a << 24) | (ZLAPNGTestScale(r, a) << 16) | (ZLAPNGTestScale(g, a) << 8) | ZLAPNGTestScale(b, a);
+}
+
+static uint32_t ZLAPNGTestPixel(const ZLAPNGTestImage *image, const uint16_t *s) {
+    uint32_t depth = image->bitDepth;
+    uint32_t shift = depth == 16 ? 8 : 0;
+    switch (image->colorType) {
+        case 0: {
+            if (image->hasKey && s[0] == image->key[0]) {
+                return 0;
+            }
+            uint32_t value = depth < 8 ? s[0] * (255 / ((1u << depth) - 1)) : (uint32_t)s[0] >> shift;
+            return ZLAPNGTestPremultiply(value, value, value, 255);
+        }
+        case 2:
+            if (image->hasKey && s[0] == image->key[0] && s[1] == image->key[1] && s[2] == image->key[2]) {
+                return 0;
+            }
+            return ZLAPNGTestPremultiply(s[0] >> shift, s[1] >> shift, s[2] >> shift, 255);
+        case 3: {
+            if (s[0] >= image->paletteCount) {
+                return 0xFF000000u;
+            }
+            const uint8_t *rgb = image->palette + s[0] * 3;
+            uint32_t alpha = s[0] < image->paletteAlphaCount ? image->paletteAlpha[s[0]] : 255;
+            return ZLAPNGTestPremultiply(rgb[0], rgb[1], rgb[2], alpha);
+        }
+        case 4:
+            return ZLAPNGTestPremultiply(s[0] >> shift, s[0] >> shift, s[0] >> shift, s[1] >> shift);
+        default:
+            return ZLAPNGTestPremultiply(s[0] >> shift, s[1] >> shift, s[2] >> shift, s[3] >> shift);
+    }
+}
+
+static uint32_t ZLAPNGTestOver(uint32_t src, uint32_t dst) {
+    uint32_t inverse = 255 - (src >> 24);
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        result |= (((src >> shift) & 0xFF) + ZLAPNGTestScale((dst >> shift) & 0xFF, inverse)) << shift;
+    }
+    return result;
+}
+
+/// 每帧合成后的完整画面，frameCount 块依次排列
+static uint32_t *ZLAPNGTestReference(const ZLAPNGTestImage *image) {
+    size_t area = (size_t)image->width * image->height;
+    uint32_t channels = ZLAPNGTestChannels(image->colorType);
+    uint32_t *snapshots = calloc(area * image->frameCount, sizeof(uint32_t));
+    uint32_t *canvas = calloc(area, sizeof(uint32_t));
+    uint32_t *saved = malloc(area * sizeof(uint32_t));
+    if (snapshots == NULL || canvas == NULL || saved == NULL) {
+        abort();
+    }
+    for (size_t i = 0; i < image->frameCount; i++) {
+        const ZLAPNGTestFrame *frame = &image->frames[i];
+        uint8_t dispose = i == 0 && frame->dispose == 2 ? 1 : frame->dispose;
+        memcpy(saved, canvas, area * sizeof(uint32_t));
+        for (uint32_t y = 0; y < frame->rect.height; y++) {
+            for (uint32_t x = 0; x < frame->rect.width; x++) {
+                uint32_t pixel = ZLAPNGTestPixel(image, frame->samples + ((size_t)y * frame->rect.width + x) * channels);
+                uint32_t *target = canvas + (size_t)(frame->rect.y + y) * image->width + frame->rect.x + x;
+                *target = frame->blend ? ZLAPNGTestOver(pixel, *target) : pixel;
+            }
+        }
+        memcpy(snapshots + area * i, canvas, area * sizeof(uint32_t));
+        for (uint32_t y = 0; y < frame->rect.height; y++) {
+            size_t row = (size_t)(frame->rect.y + y) * image->width + frame->rect.x;
+            if (dispose == 1) {
+                memset(canvas + row, 0, frame->rect.width * sizeof(uint32_t));
+            } else if (dispose == 2) {
+                memcpy(canvas + row, saved + row, frame->rect.width * sizeof(uint32_t));
+            }
+        }
+    }
+    free(canvas);
+    free(saved);
+    return snapshots;
+}
+
+static uint32_t ZLAPNGTestDuration(const ZLAPNGTestFrame *frame) {
+    uint32_t denominator = frame->delayDenominator ? frame->delayDenominator : 100;
+    uint32_t milliseconds = (frame->delayNumerator * 1000u + denominator / 2) / denominator;
+    return milliseconds <= 10 ? 100 : milliseconds;
+}
+
+/* 差分比较 */
+
+/// 合成所有已收全的帧，逐帧与参考画面比较，并检查 dirtyRect 之外的像素没有变化
+static void ZLAPNGTestRenderAvailable(ZLAPNGCanvas *canvas, const ZLAPNGDecoder *decoder, const ZLAPNGTestImage *image,
+                                      const uint32_t *reference, uint32_t *before, uint64_t seed) {
+    size_t area = (size_t)image->width * image->height;
+    while (ZLAPNGCanvasNextFrameIndex(canvas) < ZLAPNGDecoderFrameCount(decoder)) {
+        size_t index = ZLAPNGCanvasNextFrameIndex(canvas);
+        memcpy(before, ZLAPNGCanvasPixels(canvas), area * sizeof(uint32_t));
+        ZLAPNGRect dirty;
+        ZLTestCheck(ZLAPNGCanvasRenderNextFrame(canvas, decoder, &dirty), "seed %" PRIu64 " frame %zu", seed, index);
+        const uint32_t *pixels = ZLAPNGCanvasPixels(canvas);
+        size_t mismatch = SIZE_MAX, outside = SIZE_MAX;
+        for (size_t p = 0; p < area; p++) {
+            uint32_t x = (uint32_t)(p % image->width), y = (uint32_t)(p / image->width);
+            if (mismatch == SIZE_MAX && pixels[p] != reference[area * index + p]) {
+                mismatch = p;
+            }
+            bool inside = x >= dirty.x && x - dirty.x < dirty.width && y >= dirty.y && y - dirty.y < dirty.height;
+            if (outside == SIZE_MAX && !inside && pixels[p] != before[p]) {
+                outside = p;
+            }
+        }
+        ZLTestCheck(mismatch == SIZE_MAX, "seed %" PRIu64 " frame %zu pixel %zu: %08x, expected %08x (color type %u depth %u interlaced %d)",
+                    seed, index, mismatch, pixels[mismatch == SIZE_MAX ? 0 : mismatch], reference[area * index + (mismatch == SIZE_MAX ? 0 : mismatch)],
+                    image->colorType, image->bitDepth, image->interlaced);
+        ZLTestCheck(outside == SIZE_MAX, "seed %" PRIu64 " frame %zu changed pixel %zu outside the dirty rect", seed, index, outside);
+    }
+}
+
+static void ZLAPNGTestDecode(ZLTestRandom *random, const ZLAPNGTestImage *image, const ZLTestBuffer *file,
+                             const uint32_t *reference, bool chunked, uint64_t seed) {
+    ZLAPNGDecoder *decoder = ZLAPNGDecoderCreate();
+    ZLAPNGCanvas *canvas = NULL;
+    uint32_t *before = malloc((size_t)image->width * image->height * sizeof(uint32_t));
+    if (decoder == NULL || before == NULL) {
+        abort();
+    }
+    size_t offset = 0;
+    size_t previousFrameCount = 0;
+    while (offset < file->length) {
+        size_t length = chunked ? 1 + (size_t)ZLTestRandomBelow(random, ZLTestRandomBelow(random, 2) ? 16 : 512) : file->length;
+        if (length > file->length - offset) {
+            length = file->length - offset;
+        }
+        uint8_t *bytes = ZLTestCopyBytes(file->bytes + offset, length);
+        ZLTestCheck(ZLAPNGDecoderAppend(decoder, bytes, length), "seed %" PRIu64 " append at %zu", seed, offset);
+        free(bytes);
+        offset += length;
+
+        size_t frameCount = ZLAPNGDecoderFrameCount(decoder);
+        ZLTestCheck(frameCount >= previousFrameCount && frameCount <= image->frameCount, "seed %" PRIu64 " frame count %zu", seed, frameCount);
+        previousFrameCount = frameCount;
+        ZLTestCheck(ZLAPNGDecoderIsComplete(decoder) == (offset == file->length), "seed %" PRIu64 " complete at %zu", seed, offset);
+        if (canvas == NULL) {
+            canvas = ZLAPNGCanvasCreate(decoder);
+        }
+        if (canvas) {
+            ZLAPNGTestRenderAvailable(canvas, decoder, image, reference, before, seed);
+        }
+    }
+
+    ZLTestCheck(ZLAPNGDecoderFrameCount(decoder) == image->frameCount, "seed %" PRIu64 " %zu frames, expected %zu", seed,
+                ZLAPNGDecoderFrameCount(decoder), image->frameCount);
+    ZLTestCheck(ZLAPNGDecoderWidth(decoder) == image->width && ZLAPNGDecoderHeight(decoder) == image->height, "seed %" PRIu64 " size", seed);
+    ZLTestCheck(ZLAPNGDecoderLoopCount(decoder) == image->plays, "seed %" PRIu64 " loop count", seed);
+    ZLTestCheck(ZLAPNGDecoderDataLength(decoder) == file->length, "seed %" PRIu64 " data length", seed);
+    for (size_t i = 0; i < image->frameCount; i++) {
+        ZLTestCheck(ZLAPNGDecoderFrameDuration(decoder, i) == ZLAPNGTestDuration(&image->frames[i]), "seed %" PRIu64 " frame %zu duration %u",
+                    seed, i, ZLAPNGDecoderFrameDuration(decoder, i));
+    }
+    // 回到开头再播一遍，复用 backup 和解压缓冲
+    if (canvas) {
+        ZLAPNGCanvasReset(canvas);
+        ZLAPNGTestRenderAvailable(canvas, decoder, image, reference, before, seed);
+        ZLTestCheck(!ZLAPNGCanvasRenderNextFrame(canvas, decoder, NULL), "seed %" PRIu64 " render past the end", seed);
+    }
+    ZLAPNGCanvasDestroy(canvas);
+    ZLAPNGDecoderDestroy(decoder);
+    free(before);
+}
+
+static void ZLAPNGTestRandomImages(ZLTestRandom *random, size_t rounds) {
+    for (size_t round = 0; round < rounds; round++) {
+        uint64_t seed = ZLTestRandomNext(random);
+        ZLTestRandom imageRandom = ZLTestRandomMake(seed);
+        ZLAPNGTestImage image;
+        ZLAPNGTestRandomImage(&imageRandom, &image);
+        ZLTestBuffer file = {0};
+        ZLAPNGTestEncode(&imageRandom, &image, &file);
+        uint32_t *reference = ZLAPNGTestReference(&image);
+
+        ZLTestCheck(ZLAPNGSniff((const uint8_t *)file.bytes, file.length) == ZLAPNGSniffAnimated, "seed %" PRIu64 " sniff", seed);
+        ZLAPNGTestDecode(&imageRandom, &image, &file, reference, false, seed);
+        ZLAPNGTestDecode(&imageRandom, &image, &file, reference, true, seed);
+
+        free(reference);
+        ZLTestBufferFree(&file);
+        ZLAPNGTestFreeImage(&image);
+    }
+}
+
+/* 变异 */
+
+/// 变异后重新计算每个块的 CRC，否则几乎所有变异都会停在 CRC 校验，走不到块内容和解压
+static void ZLAPNGTestResign(uint8_t *bytes, size_t length) {
+    size_t offset = 8;
+    while (offset + 12 <= length) {
+        uint32_t chunkLength = ((uint32_t)bytes[offset] << 24) | ((uint32_t)bytes[offset + 1] << 16) | ((uint32_t)bytes[offset + 2] << 8) | bytes[offset + 3];
+        if (chunkLength > length - offset - 12) {
+            return;
+        }
+        uint32_t crc = (uint32_t)crc32(0, bytes + offset + 4, chunkLength + 4);
+        uint8_t *p = bytes + offset + 8 + chunkLength;
+        p[0] = (uint8_t)(crc >> 24);
+        p[1] = (uint8_t)(crc >> 16);
+        p[2] = (uint8_t)(crc >> 8);
+        p[3] = (uint8_t)crc;
+        offset += 12 + chunkLength;
+    }
+}
+
+/// 只要求不崩溃、不越界；数据损坏后已解析的帧仍能合成
+static void ZLAPNGTestMutations(ZLTestRandom *random, size_t rounds) {
+    for (size_t round = 0; round < rounds; round++) {
+        ZLAPNGTestImage image;
+        ZLAPNGTestRandomImage(random, &image);
+        ZLTestBuffer file = {0};
+        ZLAPNGTestEncode(random, &image, &file);
+        size_t length;
+        uint8_t *mutated = ZLTestMutate(random, (const uint8_t *)file.bytes, file.length, NULL, &length);
+        if (ZLTestRandomBelow(random, 4)) {
+            ZLAPNGTestResign(mutated, length);
+        }
+        ZLAPNGSniff(mutated, length);
+
+        ZLAPNGDecoder *decoder = ZLAPNGDecoderCreate();
+        ZLAPNGCanvas *canvas = NULL;
+        size_t offset = 0;
+        while (offset < length) {
+            size_t chunk = 1 + (size_t)ZLTestRandomBelow(random, 256);
+            if (chunk > length - offset) {
+                chunk = length - offset;
+            }
+            uint8_t *bytes = ZLTestCopyBytes(mutated + offset, chunk);
+            bool valid = ZLAPNGDecoderAppend(decoder, bytes, chunk);
+            free(bytes);
+            offset += chunk;
+            if (canvas == NULL) {
+                canvas = ZLAPNGCanvasCreate(decoder);
+            }
+            while (canvas && ZLAPNGCanvasRenderNextFrame(canvas, decoder, NULL)) {
+            }
+            if (!valid) {
+                ZLTestCheck(ZLAPNGDecoderIsComplete(decoder), "round %zu corrupted but not complete", round);
+                ZLTestCheck(!ZLAPNGDecoderAppend(decoder, mutated, 1), "round %zu append after corruption", round);
+                break;
+            }
+        }
+        ZLAPNGCanvasDestroy(canvas);
+        ZLAPNGDecoderDestroy(decoder);
+        free(mutated);
+        ZLTestBufferFree(&file);
+        ZLAPNGTestFreeImage(&image);
+    }
+}
+
+/* 固定用例 */
+
+/// 一个 1x2 的 RGBA 帧，level 为 0 时数据不压缩，方便按行截断
+static void ZLAPNGTestSimpleFile(ZLTestBuffer *file, bool animated, uint32_t frameSequence, int level, size_t keepCompressed) {
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    ZLTestBufferAppend(file, signature, sizeof(signature));
+    uint8_t header[13] = {0, 0, 0, 1, 0, 0, 0, 2, 8, 6, 0, 0, 0};
+    ZLAPNGTestAppendChunk(file, "IHDR", header, sizeof(header));
+    if (animated) {
+        uint8_t control[8] = {0, 0, 0, 1, 0, 0, 0, 0};
+        ZLAPNGTestAppendChunk(file, "acTL", control, sizeof(control));
+        ZLAPNGTestFrame frame = {{0, 0, 1, 2}, 1, 50, 0, 0, NULL};
+        ZLAPNGTestAppendFrameControl(&frame, &frameSequence, file);
+    }
+    uint8_t scanlines[10] = {0, 255, 0, 0, 255, 0, 0, 0, 255, 128};
+    uLongf compressedLength = compressBound(sizeof(scanlines));
+    uint8_t compressed[64];
+    compress2(compressed, &compressedLength, scanlines, sizeof(scanlines), level);
+    ZLAPNGTestAppendChunk(file, "IDAT", compressed, keepCompressed < compressedLength ? keepCompressed : compressedLength);
+    ZLAPNGTestAppendChunk(file, "IEND", NULL, 0);
+}
+
+static void ZLAPNGTestFixedCases(void) {
+    ZLTestBuffer file = {0};
+    ZLAPNGTestSimpleFile(&file, true, 0, 9, SIZE_MAX);
+    const uint8_t *bytes = (const uint8_t *)file.bytes;
+    ZLTestCheck(ZLAPNGSniff(bytes, 4) == ZLAPNGSniffNeedMoreData, "signature prefix");
+    ZLTestCheck(ZLAPNGSniff(bytes, 8 + 25 + 4) == ZLAPNGSniffNeedMoreData, "IHDR only");
+    ZLTestCheck(ZLAPNGSniff(bytes, 8 + 25 + 8) == ZLAPNGSniffAnimated, "acTL header");
+    ZLTestCheck(ZLAPNGSniff((const uint8_t *)"GIF89a", 6) == ZLAPNGSniffNotAnimated, "GIF");
+
+    ZLAPNGDecoder *decoder = ZLAPNGDecoderCreate();
+    ZLTestCheck(ZLAPNGDecoderAppend(decoder, bytes, file.length) && ZLAPNGDecoderFrameCount(decoder) == 1, "simple APNG");
+    ZLTestCheck(ZLAPNGDecoderFrameDuration(decoder, 0) == 20 && ZLAPNGDecoderFrameDuration(decoder, 1) == 0, "duration");
+    ZLAPNGCanvas *canvas = ZLAPNGCanvasCreate(decoder);
+    ZLAPNGRect dirty;
+    ZLTestCheck(canvas && ZLAPNGCanvasRenderNextFrame(canvas, decoder, &dirty), "render simple APNG");
+    if (canvas) {
+        const uint32_t *pixels = ZLAPNGCanvasPixels(canvas);
+        ZLTestCheck(pixels[0] == 0xFFFF0000u && pixels[1] == 0x80000080u, "pixels %08x %08x", pixels[0], pixels[1]);
+        ZLTestCheck(dirty.x == 0 && dirty.y == 0 && dirty.width == 1 && dirty.height == 2, "dirty rect");
+    }
+    ZLAPNGCanvasDestroy(canvas);
+    ZLAPNGDecoderDestroy(decoder);
+
+    // 普通 PNG 交给系统解码
+    ZLTestBufferClear(&file);
+    ZLAPNGTestSimpleFile(&file, false, 0, 9, SIZE_MAX);
+    ZLTestCheck(ZLAPNGSniff((const uint8_t *)file.bytes, file.length) == ZLAPNGSniffNotAnimated, "sniff plain PNG");
+    decoder = ZLAPNGDecoderCreate();
+    ZLTestCheck(!ZLAPNGDecoderAppend(decoder, (const uint8_t *)file.bytes, file.length) && ZLAPNGDecoderIsComplete(decoder), "plain PNG");
+    ZLAPNGDecoderDestroy(decoder);
+
+    // 序号不对
+    ZLTestBufferClear(&file);
+    ZLAPNGTestSimpleFile(&file, true, 1, 9, SIZE_MAX);
+    decoder = ZLAPNGDecoderCreate();
+    ZLTestCheck(!ZLAPNGDecoderAppend(decoder, (const uint8_t *)file.bytes, file.length), "bad sequence number");
+    ZLAPNGDecoderDestroy(decoder);
+
+    // CRC 不对
+    ZLTestBufferClear(&file);
+    ZLAPNGTestSimpleFile(&file, true, 0, 9, SIZE_MAX);
+    file.bytes[8 + 8 + 13] ^= 1;
+    decoder = ZLAPNGDecoderCreate();
+    ZLTestCheck(!ZLAPNGDecoderAppend(decoder, (const uint8_t *)file.bytes, file.length), "bad CRC");
+    ZLAPNGDecoderDestroy(decoder);
+
+    // zlib 数据在第二行中间断开：第一行照常显示，不完整的第二行保持透明
+    ZLTestBufferClear(&file);
+    ZLAPNGTestSimpleFile(&file, true, 0, 0, 2 + 5 + 5 + 2);
+    decoder = ZLAPNGDecoderCreate();
+    ZLTestCheck(ZLAPNGDecoderAppend(decoder, (const uint8_t *)file.bytes, file.length) && ZLAPNGDecoderFrameCount(decoder) == 1, "truncated zlib");
+    canvas = ZLAPNGCanvasCreate(decoder);
+    ZLTestCheck(canvas && ZLAPNGCanvasRenderNextFrame(canvas, decoder, NULL), "render truncated zlib");
+    if (canvas) {
+        const uint32_t *pixels = ZLAPNGCanvasPixels(canvas);
+        ZLTestCheck(pixels[0] == 0xFFFF0000u && pixels[1] == 0, "incomplete row stays transparent: %08x %08x", pixels[0], pixels[1]);
+    }
+    ZLAPNGCanvasDestroy(canvas);
+    ZLAPNGDecoderDestroy(decoder);
+
+    // 超过像素上限的文件头
+    ZLTestBufferClear(&file);
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    ZLTestBufferAppend(&file, signature, sizeof(signature));
+    uint8_t header[13] = {0, 0, 0x40, 0, 0, 0, 0x40, 0, 8, 6, 0, 0, 0};
+    ZLAPNGTestAppendChunk(&file, "IHDR", header, sizeof(header));
+    decoder = ZLAPNGDecoderCreate();
+    ZLTestCheck(!ZLAPNGDecoderAppend(decoder, (const uint8_t *)file.bytes, file.length) && ZLAPNGDecoderWidth(decoder) == 0, "oversized header");
+    ZLAPNGDecoderDestroy(decoder);
+
+    ZLTestBufferFree(&file);
+}
+
+int main(int argc, char **argv) {
+    ZLTestRandom random = ZLTestRandomMake(ZLTestSeed(argc, argv));
+
+    ZLAPNGTestFixedCases();
+
+    size_t rounds = ZLTestIterations(400);
+    ZLAPNGTestRandomImages(&random, rounds);
+    fprintf(stderr, "%zu random animations\n", rounds);
+
+    ZLAPNGTestMutations(&random, ZLTestIterations(2000));
+
+    return ZLTestFinish("ZLAPNGDecoderTests");
+}
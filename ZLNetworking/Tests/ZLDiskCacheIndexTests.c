@@ -0,0 +1,319 @@
+//
+//  ZLDiskCacheIndexTests.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLTestSupport.h"
+#include "ZLDiskCacheIndex.h"
+
+/// 随机模型测试：同一串操作同时作用于索引和一个按访问顺序排列的数组（下标 0 最久未访问），每一步比较两者
+typedef struct ZLDiskCacheModel {
+    ZLDiskCacheEntry *entries;
+    size_t count;
+    size_t capacity;
+    uint64_t totalSize;
+} ZLDiskCacheModel;
+
+static size_t ZLDiskCacheModelFind(const ZLDiskCacheModel *model, uint64_t key) {
+    for (size_t i = 0; i < model->count; i++) {
+        if (model->entries[i].key == key) {
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+static void ZLDiskCacheModelErase(ZLDiskCacheModel *model, size_t position) {
+    model->totalSize -= model->entries[position].size;
+    memmove(model->entries + position, model->entries + position + 1, (model->count - position - 1) * sizeof(ZLDiskCacheEntry));
+    model->count--;
+}
+
+static void ZLDiskCacheModelAppend(ZLDiskCacheModel *model, ZLDiskCacheEntry entry) {
+    if (model->count == model->capacity) {
+        model->capacity = model->capacity ? model->capacity * 2 : 64;
+        model->entries = realloc(model->entries, model->capacity * sizeof(ZLDiskCacheEntry));
+        if (model->entries == NULL) {
+            abort();
+        }
+    }
+    model->entries[model->count++] = entry;
+    model->totalSize += entry.size;
+}
+
+static void ZLDiskCacheModelSet(ZLDiskCacheModel *model, ZLDiskCacheEntry entry) {
+    size_t position = ZLDiskCacheModelFind(model, entry.key);
+    if (position != SIZE_MAX) {
+        ZLDiskCacheModelErase(model, position);
+    }
+    ZLDiskCacheModelAppend(model, entry);
+}
+
+static bool ZLDiskCacheModelTouch(ZLDiskCacheModel *model, uint64_t key, double accessTime) {
+    size_t position = ZLDiskCacheModelFind(model, key);
+    if (position == SIZE_MAX) {
+        return false;
+    }
+    ZLDiskCacheEntry entry = model->entries[position];
+    entry.accessTime = accessTime;
+    ZLDiskCacheModelErase(model, position);
+    ZLDiskCacheModelAppend(model, entry);
+    return true;
+}
+
+static bool ZLDiskCacheModelRemove(ZLDiskCacheModel *model, uint64_t key) {
+    size_t position = ZLDiskCacheModelFind(model, key);
+    if (position == SIZE_MAX) {
+        return false;
+    }
+    ZLDiskCacheModelErase(model, position);
+    return true;
+}
+
+static bool ZLDiskCacheTestEntryEqual(const ZLDiskCacheEntry *a, const ZLDiskCacheEntry *b) {
+    return a->key == b->key && a->size == b->size && a->accessTime == b->accessTime && a->expiry == b->expiry &&
+           memcmp(a->keyDigest, b->keyDigest, ZLDiskCacheKeyDigestLength) == 0;
+}
+
+/// 每一步都做的廉价比较
+static void ZLDiskCacheTestCompareSummary(const ZLDiskCacheIndex *index, const ZLDiskCacheModel *model, size_t step) {
+    ZLTestCheck(ZLDiskCacheIndexCount(index) == model->count, "step %zu: count %zu, model %zu", step, ZLDiskCacheIndexCount(index), model->count);
+    ZLTestCheck(ZLDiskCacheIndexTotalSize(index) == model->totalSize, "step %zu: total size %" PRIu64 ", model %" PRIu64,
+                step, ZLDiskCacheIndexTotalSize(index), model->totalSize);
+    const ZLDiskCacheEntry *oldest = ZLDiskCacheIndexOldest(index);
+    if (model->count == 0) {
+        ZLTestCheck(oldest == NULL, "step %zu: oldest of an empty index", step);
+    } else {
+        ZLTestCheck(oldest && ZLDiskCacheTestEntryEqual(oldest, &model->entries[0]), "step %zu: oldest %" PRIu64 ", model %" PRIu64,
+                    step, oldest ? oldest->key : 0, model->entries[0].key);
+    }
+}
+
+/// 完整比较：逐个查找，序列化结果必须与模型的顺序逐字节一致，再加载回来还是同样的内容
+static void ZLDiskCacheTestCompareFull(const ZLDiskCacheIndex *index, const ZLDiskCacheModel *model, size_t step) {
+    ZLDiskCacheTestCompareSummary(index, model, step);
+    for (size_t i = 0; i < model->count; i++) {
+        const ZLDiskCacheEntry *entry = ZLDiskCacheIndexLookup(index, model->entries[i].key);
+        ZLTestCheck(entry && ZLDiskCacheTestEntryEqual(entry, &model->entries[i]), "step %zu: lookup %" PRIu64, step, model->entries[i].key);
+    }
+
+    size_t length = ZLDiskCacheIndexSerializedLength(index);
+    ZLTestCheck(length == 12 + model->count * sizeof(ZLDiskCacheEntry), "step %zu: serialized length %zu", step, length);
+    uint8_t *bytes = malloc(length);
+    if (bytes == NULL) {
+        abort();
+    }
+    ZLDiskCacheIndexSerialize(index, bytes);
+    ZLTestCheck(model->count == 0 || memcmp(bytes + 12, model->entries, model->count * sizeof(ZLDiskCacheEntry)) == 0,
+                "step %zu: serialized entries are not in LRU order", step);
+
+    ZLDiskCacheIndex *loaded = ZLDiskCacheIndexCreate();
+    ZLTestCheck(ZLDiskCacheIndexLoad(loaded, bytes, length), "step %zu: round trip failed", step);
+    ZLTestCheck(ZLDiskCacheIndexSerializedLength(loaded) == length, "step %zu: round trip length", step);
+    uint8_t *again = malloc(length);
+    if (again == NULL) {
+        abort();
+    }
+    ZLDiskCacheIndexSerialize(loaded, again);
+    ZLTestCheck(memcmp(bytes, again, length) == 0, "step %zu: round trip changed the index", step);
+    free(again);
+    ZLDiskCacheIndexDestroy(loaded);
+    free(bytes);
+}
+
+/// key 取自一个较小的集合，覆盖、删除后重新插入和探测链上的前移都会频繁发生
+static uint64_t ZLDiskCacheTestKey(ZLTestRandom *random, uint64_t space) {
+    uint64_t number = ZLTestRandomBelow(random, space);
+    char key[32];
+    int length = snprintf(key, sizeof(key), "https://example.com/%" PRIu64, number);
+    return ZLDiskCacheKeyHash(key, (size_t)length);
+}
+
+static void ZLDiskCacheTestRandomOperations(ZLTestRandom *random, size_t steps, uint64_t space) {
+    ZLDiskCacheIndex *index = ZLDiskCacheIndexCreate();
+    ZLDiskCacheModel model = {0};
+    double now = 1000;
+
+    for (size_t step = 0; step < steps; step++) {
+        uint64_t key = ZLDiskCacheTestKey(random, space);
+        now += 1;
+        uint64_t operation = ZLTestRandomBelow(random, 100);
+        if (operation < 45) {
+            ZLDiskCacheEntry entry = {
+                .key = key,
+                .size = ZLTestRandomBelow(random, 1 << 20),
+                .accessTime = now,
+                .expiry = ZLTestRandomBelow(random, 3) == 0 ? 0 : now + (double)ZLTestRandomBelow(random, 3600),
+            };
+            bool hasDigest = ZLTestRandomBelow(random, 4) != 0;
+            for (size_t i = 0; hasDigest && i < ZLDiskCacheKeyDigestLength; i++) {
+                entry.keyDigest[i] = (uint8_t)ZLTestRandomNext(random);
+            }
+            ZLTestCheck(ZLDiskCacheIndexSet(index, entry.key, entry.size, entry.accessTime, entry.expiry, hasDigest ? entry.keyDigest : NULL),
+                        "step %zu: set failed", step);
+            ZLDiskCacheModelSet(&model, entry);
+        } else if (operation < 65) {
+            bool touched = ZLDiskCacheIndexTouch(index, key, now);
+            ZLTestCheck(touched == ZLDiskCacheModelTouch(&model, key, now), "step %zu: touch %" PRIu64 " returned %d", step, key, touched);
+        } else if (operation < 85) {
+            bool removed = ZLDiskCacheIndexRemove(index, key);
+            ZLTestCheck(removed == ZLDiskCacheModelRemove(&model, key), "step %zu: remove %" PRIu64 " returned %d", step, key, removed);
+        } else if (operation < 95) {
+            // 与 ZLDiskCache 的 trim 相同：不断移除最久未访问的条目
+            size_t evictions = (size_t)ZLTestRandomBelow(random, 8);
+            for (size_t i = 0; i < evictions && model.count > 0; i++) {
+                const ZLDiskCacheEntry *oldest = ZLDiskCacheIndexOldest(index);
+                ZLTestCheck(oldest && oldest->key == model.entries[0].key, "step %zu: evicting the wrong entry", step);
+                if (oldest == NULL) {
+                    break;
+                }
+                ZLTestCheck(ZLDiskCacheIndexRemove(index, oldest->key), "step %zu: evict failed", step);
+                ZLDiskCacheModelErase(&model, 0);
+            }
+        } else if (operation < 96) {
+            ZLDiskCacheIndexRemoveAll(index);
+            model.count = 0;
+            model.totalSize = 0;
+        } else {
+            const ZLDiskCacheEntry *entry = ZLDiskCacheIndexLookup(index, key);
+            size_t position = ZLDiskCacheModelFind(&model, key);
+            ZLTestCheck((entry != NULL) == (position != SIZE_MAX), "step %zu: lookup %" PRIu64, step, key);
+        }
+
+        ZLDiskCacheTestCompareSummary(index, &model, step);
+        if (step % 97 == 0) {
+            ZLDiskCacheTestCompareFull(index, &model, step);
+        }
+    }
+    ZLDiskCacheTestCompareFull(index, &model, steps);
+
+    free(model.entries);
+    ZLDiskCacheIndexDestroy(index);
+}
+
+/// 损坏的索引文件：要么加载失败且索引为空，要么加载成功且能原样序列化、再加载
+static void ZLDiskCacheTestCorruptedLoads(ZLTestRandom *random, size_t rounds) {
+    ZLDiskCacheIndex *index = ZLDiskCacheIndexCreate();
+    ZLDiskCacheIndex *loaded = ZLDiskCacheIndexCreate();
+    size_t rejected = 0;
+    for (size_t round = 0; round < rounds; round++) {
+        ZLDiskCacheIndexRemoveAll(index);
+        size_t count = (size_t)ZLTestRandomBelow(random, 40);
+        for (size_t i = 0; i < count; i++) {
+            ZLDiskCacheIndexSet(index, ZLDiskCacheTestKey(random, 64), ZLTestRandomBelow(random, 4096), (double)i, 0, NULL);
+        }
+        size_t length = ZLDiskCacheIndexSerializedLength(index);
+        uint8_t *bytes = malloc(length);
+        if (bytes == NULL) {
+            abort();
+        }
+        ZLDiskCacheIndexSerialize(index, bytes);
+
+        size_t mutatedLength = 0;
+        uint8_t *mutated = ZLTestMutate(random, bytes, length, "\0\1\xff", &mutatedLength);
+        uint8_t *exact = ZLTestCopyBytes(mutated, mutatedLength);
+        if (!ZLDiskCacheIndexLoad(loaded, exact, mutatedLength)) {
+            rejected++;
+            ZLTestCheck(ZLDiskCacheIndexCount(loaded) == 0 && ZLDiskCacheIndexTotalSize(loaded) == 0 && ZLDiskCacheIndexOldest(loaded) == NULL,
+                        "round %zu: rejected load left entries behind", round);
+        } else {
+            // 重复的 key 会被覆盖，条目数只可能变少
+            ZLTestCheck(ZLDiskCacheIndexSerializedLength(loaded) <= mutatedLength, "round %zu: loaded more than the file holds", round);
+            size_t loadedLength = ZLDiskCacheIndexSerializedLength(loaded);
+            uint8_t *again = malloc(loadedLength);
+            if (again == NULL) {
+                abort();
+            }
+            ZLDiskCacheIndexSerialize(loaded, again);
+            ZLDiskCacheIndex *reloaded = ZLDiskCacheIndexCreate();
+            ZLTestCheck(ZLDiskCacheIndexLoad(reloaded, again, loadedLength), "round %zu: reserialized index does not load", round);
+            ZLTestCheck(ZLDiskCacheIndexCount(reloaded) == ZLDiskCacheIndexCount(loaded) &&
+                        ZLDiskCacheIndexTotalSize(reloaded) == ZLDiskCacheIndexTotalSize(loaded), "round %zu: reload changed the index", round);
+            ZLDiskCacheIndexDestroy(reloaded);
+            free(again);
+        }
+        free(exact);
+        free(mutated);
+        free(bytes);
+    }
+    fprintf(stderr, "%zu corrupted index files (%zu rejected)\n", rounds, rejected);
+    ZLDiskCacheIndexDestroy(loaded);
+    ZLDiskCacheIndexDestroy(index);
+}
+
+static void ZLDiskCacheTestFixedCases(void) {
+    ZLTestCheck(ZLDiskCacheKeyHash("", 0) != 0, "hash of the empty key");
+
+    ZLDiskCacheIndex *index = ZLDiskCacheIndexCreate();
+    ZLTestCheck(ZLDiskCacheIndexOldest(index) == NULL, "oldest of a new index");
+    ZLTestCheck(!ZLDiskCacheIndexTouch(index, 1, 0) && !ZLDiskCacheIndexRemove(index, 1), "touch or remove on an empty index");
+
+    ZLDiskCacheIndexSet(index, 1, 10, 1, 0, NULL);
+    ZLDiskCacheIndexSet(index, 2, 20, 2, 0, NULL);
+    ZLDiskCacheIndexSet(index, 3, 30, 3, 0, NULL);
+    ZLTestCheck(ZLDiskCacheIndexOldest(index)->key == 1, "oldest after inserts");
+    ZLDiskCacheIndexTouch(index, 1, 4);
+    ZLTestCheck(ZLDiskCacheIndexOldest(index)->key == 2, "oldest after touch");
+    ZLDiskCacheIndexSet(index, 2, 5, 5, 0, NULL);
+    ZLTestCheck(ZLDiskCacheIndexOldest(index)->key == 3 && ZLDiskCacheIndexTotalSize(index) == 45, "overwrite");
+    ZLDiskCacheIndexRemoveAll(index);
+    ZLTestCheck(ZLDiskCacheIndexCount(index) == 0 && ZLDiskCacheIndexOldest(index) == NULL, "remove all");
+
+    // 摘要原样保存，覆盖时换成新的
+    uint8_t digest[ZLDiskCacheKeyDigestLength];
+    memset(digest, 0xab, sizeof(digest));
+    ZLDiskCacheIndexSet(index, 5, 50, 1, 0, digest);
+    ZLTestCheck(memcmp(ZLDiskCacheIndexLookup(index, 5)->keyDigest, digest, sizeof(digest)) == 0, "digest stored");
+    ZLDiskCacheIndexSet(index, 5, 50, 2, 0, NULL);
+    ZLTestCheck(ZLDiskCacheIndexLookup(index, 5)->keyDigest[0] == 0, "digest cleared on overwrite");
+    ZLDiskCacheIndexRemoveAll(index);
+
+    // 截断、错误的魔数、旧版本、条目数与长度不符、key 为 0
+    ZLDiskCacheIndexSet(index, 7, 70, 1, 0, digest);
+    uint8_t bytes[12 + sizeof(ZLDiskCacheEntry)];
+    ZLDiskCacheIndexSerialize(index, bytes);
+    ZLDiskCacheIndex *loaded = ZLDiskCacheIndexCreate();
+    for (size_t length = 0; length < sizeof(bytes); length++) {
+        uint8_t *exact = ZLTestCopyBytes(bytes, length);
+        ZLTestCheck(!ZLDiskCacheIndexLoad(loaded, exact, length), "truncated to %zu bytes", length);
+        free(exact);
+    }
+    uint8_t broken[sizeof(bytes)];
+    memcpy(broken, bytes, sizeof(bytes));
+    broken[0] ^= 1;
+    ZLTestCheck(!ZLDiskCacheIndexLoad(loaded, broken, sizeof(broken)), "bad magic");
+    memcpy(broken, bytes, sizeof(bytes));
+    broken[4] = 1;
+    ZLTestCheck(!ZLDiskCacheIndexLoad(loaded, broken, sizeof(broken)), "version 1 index without digests");
+    memcpy(broken, bytes, sizeof(bytes));
+    broken[8] = 2;
+    ZLTestCheck(!ZLDiskCacheIndexLoad(loaded, broken, sizeof(broken)), "count does not match length");
+    memcpy(broken, bytes, sizeof(bytes));
+    memset(broken + 12, 0, sizeof(uint64_t));
+    ZLTestCheck(!ZLDiskCacheIndexLoad(loaded, broken, sizeof(broken)) && ZLDiskCacheIndexCount(loaded) == 0, "zero key");
+    ZLTestCheck(ZLDiskCacheIndexLoad(loaded, bytes, sizeof(bytes)) && ZLDiskCacheIndexLookup(loaded, 7)->size == 70 &&
+                memcmp(ZLDiskCacheIndexLookup(loaded, 7)->keyDigest, digest, sizeof(digest)) == 0, "valid file");
+
+    ZLDiskCacheIndexDestroy(loaded);
+    ZLDiskCacheIndexDestroy(index);
+}
+
+int main(int argc, char **argv) {
+    ZLTestRandom random = ZLTestRandomMake(ZLTestSeed(argc, argv));
+
+    ZLDiskCacheTestFixedCases();
+
+    // 小的 key 空间反复覆盖和删除；大的 key 空间让哈希表多次扩容
+    size_t rounds = ZLTestIterations(20);
+    for (size_t i = 0; i < rounds; i++) {
+        ZLDiskCacheTestRandomOperations(&random, 2000, 16 + ZLTestRandomBelow(&random, 48));
+    }
+    ZLDiskCacheTestRandomOperations(&random, ZLTestIterations(30000), 20000);
+    fprintf(stderr, "%zu random operation rounds\n", rounds + 1);
+
+    ZLDiskCacheTestCorruptedLoads(&random, ZLTestIterations(3000));
+
+    return ZLTestFinish("ZLDiskCacheIndexTests");
+}
@@ -0,0 +1,530 @@
+//
+//  ZLEventLoopTests.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLTestSupport.h"
+#include "ZLEventLoop.h"
+#include "ZLSocketStream.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t ZLEventTestNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/// 运行到 *done 为真或超时，返回是否完成
+static bool ZLEventTestRunUntil(ZLEventLoop *loop, const bool *done, uint64_t timeoutMilliseconds) {
+    uint64_t deadline = ZLEventTestNow() + timeoutMilliseconds * 1000000;
+    while (!*done && ZLEventTestNow() < deadline) {
+        ZLEventLoopRunOnce(loop, 10);
+    }
+    return *done;
+}
+
+static bool ZLEventTestReadable(int fd) {
+    struct pollfd entry = { .fd = fd, .events = POLLIN };
+    return poll(&entry, 1, 0) == 1 && (entry.revents & POLLIN);
+}
+
+/* post */
+
+#define ZLEventTestPostThreads 4
+#define ZLEventTestPostsPerThread 5000
+
+typedef struct ZLEventTestPoster {
+    ZLEventLoop *loop;
+    size_t index;
+    size_t *next;               // 每个线程的任务应当按投递顺序执行
+    size_t *executed;
+    bool *done;
+} ZLEventTestPoster;
+
+typedef struct ZLEventTestPostTask {
+    ZLEventTestPoster *poster;
+    size_t sequence;
+} ZLEventTestPostTask;
+
+static void ZLEventTestPostTaskRun(void *info) {
+    ZLEventTestPostTask *task = info;
+    ZLEventTestPoster *poster = task->poster;
+    ZLTestCheck(poster->next[poster->index] == task->sequence, "thread %zu task %zu ran before %zu", poster->index, task->sequence, poster->next[poster->index]);
+    poster->next[poster->index] = task->sequence + 1;
+    if (++*poster->executed == ZLEventTestPostThreads * ZLEventTestPostsPerThread) {
+        *poster->done = true;
+    }
+    free(task);
+}
+
+static void *ZLEventTestPostThread(void *info) {
+    ZLEventTestPoster *poster = info;
+    for (size_t i = 0; i < ZLEventTestPostsPerThread; i++) {
+        ZLEventTestPostTask *task = malloc(sizeof(ZLEventTestPostTask));
+        task->poster = poster;
+        task->sequence = i;
+        ZLTestCheck(ZLEventLoopPost(poster->loop, ZLEventTestPostTaskRun, task), "post failed");
+    }
+    return NULL;
+}
+
+static void ZLEventTestPost(void) {
+    ZLEventLoop *loop = ZLEventLoopCreate();
+    ZLTestCheck(loop != NULL, "create loop");
+
+    // 投递的任务让 backend 可读，外部的循环只监听它就能知道该处理了
+    ZLTestCheck(!ZLEventTestReadable(ZLEventLoopFileDescriptor(loop)), "idle backend readable");
+    bool flag = false;
+    size_t next[ZLEventTestPostThreads] = { 0 };
+    size_t executed = 0;
+    ZLEventTestPoster posters[ZLEventTestPostThreads];
+    pthread_t threads[ZLEventTestPostThreads];
+    for (size_t i = 0; i < ZLEventTestPostThreads; i++) {
+        posters[i] = (ZLEventTestPoster){ loop, i, next, &executed, &flag };
+        pthread_create(&threads[i], NULL, ZLEventTestPostThread, &posters[i]);
+    }
+    ZLTestCheck(ZLEventTestRunUntil(loop, &flag, 10000), "only %zu posted tasks ran", executed);
+    for (size_t i = 0; i < ZLEventTestPostThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    ZLEventLoopRunOnce(loop, 0);
+    ZLTestCheck(!ZLEventTestReadable(ZLEventLoopFileDescriptor(loop)), "backend readable after draining");
+    ZLEventLoopDestroy(loop);
+}
+
+/* timers */
+
+typedef struct ZLEventTestTimer {
+    uint64_t scheduledAt;
+    uint64_t delayMilliseconds;
+    uint64_t firedAt;
+    size_t *order;
+    size_t rank;
+} ZLEventTestTimer;
+
+static void ZLEventTestTimerFire(void *info) {
+    ZLEventTestTimer *timer = info;
+    timer->firedAt = ZLEventTestNow();
+    timer->rank = ++*timer->order;
+}
+
+static void ZLEventTestTimers(void) {
+    ZLEventLoop *loop = ZLEventLoopCreate();
+    size_t order = 0;
+    uint64_t delays[] = { 60, 0, 25, 40 };
+    ZLEventTestTimer timers[4];
+    uint64_t timerIDs[4];
+    for (size_t i = 0; i < 4; i++) {
+        timers[i] = (ZLEventTestTimer){ ZLEventTestNow(), delays[i], 0, &order, 0 };
+        timerIDs[i] = ZLEventLoopScheduleTimer(loop, delays[i], ZLEventTestTimerFire, &timers[i]);
+        ZLTestCheck(timerIDs[i] != 0, "schedule timer %zu", i);
+    }
+    ZLTestCheck(ZLEventLoopCancelTimer(loop, timerIDs[3]), "cancel a pending timer");
+    ZLTestCheck(!ZLEventLoopCancelTimer(loop, timerIDs[3]), "cancel twice");
+
+    // 只等 backend 可读再处理，和交给 CFRunLoop 监听时一样
+    uint64_t deadline = ZLEventTestNow() + 2000000000ULL;
+    while (order < 3 && ZLEventTestNow() < deadline) {
+        struct pollfd entry = { .fd = ZLEventLoopFileDescriptor(loop), .events = POLLIN };
+        if (poll(&entry, 1, 1000) == 1) {
+            ZLEventLoopRunOnce(loop, 0);
+        }
+    }
+    ZLTestCheck(order == 3, "%zu timers fired", order);
+    for (size_t i = 0; i < 3; i++) {
+        ZLTestCheck(timers[i].firedAt >= timers[i].scheduledAt + timers[i].delayMilliseconds * 1000000, "timer %zu fired early", i);
+    }
+    ZLTestCheck(timers[1].rank == 1 && timers[2].rank == 2 && timers[0].rank == 3, "timers fired out of order");
+    ZLTestCheck(timers[3].rank == 0, "cancelled timer fired");
+    ZLTestCheck(!ZLEventLoopCancelTimer(loop, timerIDs[0]), "cancel a fired timer");
+
+    // 销毁时未触发的定时器直接丢弃
+    ZLEventLoopScheduleTimer(loop, 100000, ZLEventTestTimerFire, &timers[3]);
+    ZLEventLoopDestroy(loop);
+}
+
+/* watch */
+
+typedef struct ZLEventTestWatch {
+    int readableCount;
+    int writableCount;
+    int unwatchFD;              // 回调里移除另一个 fd，同一轮取到的事件不能再回调给它
+} ZLEventTestWatch;
+
+static void ZLEventTestWatchCallback(ZLEventLoop *loop, int fd, int events, void *info) {
+    (void)fd;
+    ZLEventTestWatch *watch = info;
+    watch->readableCount += (events & ZLEventLoopReadable) != 0;
+    watch->writableCount += (events & ZLEventLoopWritable) != 0;
+    if (watch->unwatchFD >= 0) {
+        ZLEventLoopUnwatch(loop, watch->unwatchFD);
+        watch->unwatchFD = -1;
+    }
+}
+
+static void ZLEventTestWatchEdges(void) {
+    ZLEventLoop *loop = ZLEventLoopCreate();
+    int pair[2];
+    int other[2];
+    ZLTestCheck(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0 && socketpair(AF_UNIX, SOCK_STREAM, 0, other) == 0, "socketpair");
+    fcntl(pair[0], F_SETFL, O_NONBLOCK);
+    fcntl(other[0], F_SETFL, O_NONBLOCK);
+
+    ZLEventTestWatch watch = { 0, 0, -1 };
+    ZLEventTestWatch otherWatch = { 0, 0, -1 };
+    ZLTestCheck(ZLEventLoopWatch(loop, pair[0], ZLEventTestWatchCallback, &watch), "watch");
+    ZLEventLoopRunOnce(loop, 100);
+    ZLTestCheck(watch.writableCount == 1 && watch.readableCount == 0, "initial writable edge %d/%d", watch.readableCount, watch.writableCount);
+
+    // 边沿触发：不读的话同一批数据不会再报
+    ZLTestCheck(write(pair[1], "abc", 3) == 3, "write");
+    ZLEventLoopRunOnce(loop, 100);
+    ZLTestCheck(watch.readableCount == 1, "readable edge %d", watch.readableCount);
+    ZLEventLoopRunOnce(loop, 0);
+    ZLTestCheck(watch.readableCount == 1, "level-triggered readable %d", watch.readableCount);
+
+    char buffer[8];
+    ZLTestCheck(read(pair[0], buffer, sizeof(buffer)) == 3, "read");
+    ZLTestCheck(read(pair[0], buffer, sizeof(buffer)) < 0 && errno == EAGAIN, "drained");
+    ZLTestCheck(write(pair[1], "d", 1) == 1, "write again");
+    ZLEventLoopRunOnce(loop, 100);
+    ZLTestCheck(watch.readableCount == 2, "new data after draining is a new edge %d", watch.readableCount);
+
+    // 两个 fd 同一轮就绪，先回调的移除另一个
+    read(pair[0], buffer, sizeof(buffer));
+    ZLTestCheck(ZLEventLoopWatch(loop, other[0], ZLEventTestWatchCallback, &otherWatch), "watch other");
+    ZLEventLoopRunOnce(loop, 100);
+    otherWatch = (ZLEventTestWatch){ 0, 0, -1 };
+    watch = (ZLEventTestWatch){ 0, 0, -1 };
+    watch.unwatchFD = other[0];
+    otherWatch.unwatchFD = pair[0];
+    write(pair[1], "e", 1);
+    write(other[1], "f", 1);
+    ZLEventLoopRunOnce(loop, 100);
+    ZLTestCheck(watch.readableCount + otherWatch.readableCount == 1, "unwatched fd called back in the same round (%d, %d)", watch.readableCount, otherWatch.readableCount);
+
+    ZLEventLoopMetrics metrics;
+    ZLEventLoopGetMetrics(loop, &metrics);
+    ZLTestCheck(metrics.watchCount == 1, "watch count %zu", metrics.watchCount);
+    ZLTestCheck(metrics.wakeupCount > 0 && metrics.maxBusyNanoseconds <= metrics.busyNanoseconds, "metrics");
+    ZLEventLoopUnwatch(loop, pair[0]);
+    ZLEventLoopUnwatch(loop, other[0]);
+    ZLEventLoopGetMetrics(loop, &metrics);
+    ZLTestCheck(metrics.watchCount == 0, "watch count after unwatch %zu", metrics.watchCount);
+
+    close(pair[0]);
+    close(pair[1]);
+    close(other[0]);
+    close(other[1]);
+    ZLEventLoopDestroy(loop);
+}
+
+/* socket stream */
+
+static int ZLEventTestListen(struct sockaddr_in *address) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(address, 0, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(*address);
+    if (fd < 0 || bind(fd, (struct sockaddr *)address, length) != 0 || listen(fd, 8) != 0 ||
+        getsockname(fd, (struct sockaddr *)address, &length) != 0) {
+        abort();
+    }
+    return fd;
+}
+
+typedef struct ZLEventTestServer {
+    int listener;
+    const uint8_t *reply;       // 非空时发完 reply 就关闭，否则回显到对端关闭
+    size_t replyLength;
+} ZLEventTestServer;
+
+static void *ZLEventTestServerThread(void *info) {
+    ZLEventTestServer *server = info;
+    int fd = accept(server->listener, NULL, NULL);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (server->reply) {
+        for (size_t offset = 0; offset < server->replyLength;) {
+            ssize_t written = write(fd, server->reply + offset, server->replyLength - offset);
+            if (written <= 0) {
+                break;
+            }
+            offset += (size_t)written;
+        }
+    } else {
+        uint8_t buffer[16384];
+        ssize_t length;
+        while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+            for (ssize_t offset = 0; offset < length;) {
+                ssize_t written = write(fd, buffer + offset, (size_t)(length - offset));
+                if (written <= 0) {
+                    break;
+                }
+                offset += written;
+            }
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+typedef struct ZLEventTestClient {
+    ZLSocketStream *stream;
+    ZLTestRandom *random;
+    const uint8_t *payload;
+    size_t length;
+    size_t sent;
+    ZLTestBuffer received;
+    int events[32];             // 每种事件的次数，下标是事件值
+    int eventsAfterClose;
+    bool closed;
+    bool done;
+} ZLEventTestClient;
+
+/// 写和读都用随机长度，直到返回 0；全部收到后在回调里关闭
+static void ZLEventTestPump(ZLEventTestClient *client) {
+    while (client->sent < client->length && ZLSocketStreamHasSpaceAvailable(client->stream)) {
+        size_t chunk = 1 + ZLTestRandomBelow(client->random, 65536);
+        if (chunk > client->length - client->sent) {
+            chunk = client->length - client->sent;
+        }
+        long written = ZLSocketStreamWrite(client->stream, client->payload + client->sent, chunk);
+        ZLTestCheck(written >= 0, "write error %d", ZLSocketStreamGetError(client->stream));
+        if (written <= 0) {
+            break;
+        }
+        client->sent += (size_t)written;
+    }
+    while (ZLSocketStreamHasBytesAvailable(client->stream)) {
+        uint8_t buffer[32768];
+        size_t chunk = 1 + ZLTestRandomBelow(client->random, sizeof(buffer));
+        long length = ZLSocketStreamRead(client->stream, buffer, chunk);
+        ZLTestCheck(length >= 0, "read error %d", ZLSocketStreamGetError(client->stream));
+        if (length <= 0) {
+            break;
+        }
+        ZLTestBufferAppend(&client->received, buffer, (size_t)length);
+    }
+    if (client->length > 0 && client->received.length == client->length && !client->closed) {
+        client->closed = true;
+        ZLSocketStreamClose(client->stream);
+        client->done = true;
+    }
+}
+
+static void ZLEventTestClientCallback(ZLSocketStream *stream, ZLSocketStreamEvent event, void *info) {
+    (void)stream;
+    ZLEventTestClient *client = info;
+    if (client->closed) {
+        client->eventsAfterClose++;
+        return;
+    }
+    client->events[event]++;
+    if (event == ZLSocketStreamEventErrorOccurred || event == ZLSocketStreamEventEndEncountered) {
+        client->done = true;
+        return;
+    }
+    ZLEventTestPump(client);
+}
+
+static void ZLEventTestStreamEcho(ZLTestRandom *random, size_t length) {
+    ZLEventLoop *loop = ZLEventLoopCreate();
+    struct sockaddr_in address;
+    ZLEventTestServer server = { ZLEventTestListen(&address), NULL, 0 };
+    pthread_t thread;
+    pthread_create(&thread, NULL, ZLEventTestServerThread, &server);
+
+    uint8_t *payload = malloc(length);
+    for (size_t i = 0; i < length; i++) {
+        payload[i] = (uint8_t)ZLTestRandomNext(random);
+    }
+    ZLEventTestClient client = { .random = random, .payload = payload, .length = length };
+    client.stream = ZLSocketStreamCreate(loop, ZLEventTestClientCallback, &client);
+    ZLTestCheck(ZLSocketStreamGetStatus(client.stream) == ZLSocketStreamStatusNotOpen, "initial status");
+    ZLTestCheck(ZLSocketStreamConnect(client.stream, (struct sockaddr *)&address, sizeof(address)), "connect");
+    ZLTestCheck(!ZLSocketStreamConnect(client.stream, (struct sockaddr *)&address, sizeof(address)), "connect twice");
+
+    ZLTestCheck(ZLEventTestRunUntil(loop, &client.done, 20000), "echo of %zu bytes timed out after %zu sent, %zu received", length, client.sent, client.received.length);
+    ZLTestCheck(client.events[ZLSocketStreamEventOpenCompleted] == 1, "open completed %d times", client.events[ZLSocketStreamEventOpenCompleted]);
+    ZLTestCheck(client.events[ZLSocketStreamEventErrorOccurred] == 0, "error %d", ZLSocketStreamGetError(client.stream));
+    ZLTestCheck(client.received.length == length && memcmp(client.received.bytes, payload, length) == 0, "echo of %zu bytes differs", length);
+
+    // 关闭后才在循环线程上移除监听并关闭 fd，服务端读到末尾退出
+    ZLEventLoopRunOnce(loop, 0);
+    pthread_join(thread, NULL);
+    ZLEventLoopRunOnce(loop, 0);
+    ZLTestCheck(client.eventsAfterClose == 0, "%d events after close", client.eventsAfterClose);
+    ZLTestCheck(ZLSocketStreamGetStatus(client.stream) == ZLSocketStreamStatusClosed, "status after close");
+    ZLTestCheck(ZLSocketStreamRead(client.stream, payload, 1) == -1 && ZLSocketStreamWrite(client.stream, payload, 1) == -1, "io after close");
+    ZLEventLoopMetrics metrics;
+    ZLEventLoopGetMetrics(loop, &metrics);
+    ZLTestCheck(metrics.watchCount == 0, "stream still watched after close");
+
+    ZLSocketStreamRelease(client.stream);
+    ZLTestBufferFree(&client.received);
+    free(payload);
+    close(server.listener);
+    ZLEventLoopDestroy(loop);
+}
+
+static void ZLEventTestStreamEnd(void) {
+    ZLEventLoop *loop = ZLEventLoopCreate();
+    struct sockaddr_in address;
+    static const uint8_t reply[] = "HTTP/1.1 101 Switching Protocols\r\n\r\n";
+    ZLEventTestServer server = { ZLEventTestListen(&address), reply, sizeof(reply) - 1 };
+    pthread_t thread;
+    pthread_create(&thread, NULL, ZLEventTestServerThread, &server);
+
+    ZLTestRandom random = ZLTestRandomMake(1);
+    ZLEventTestClient client = { .random = &random };
+    client.stream = ZLSocketStreamCreate(loop, ZLEventTestClientCallback, &client);
+    ZLSocketStreamConnect(client.stream, (struct sockaddr *)&address, sizeof(address));
+    ZLTestCheck(ZLEventTestRunUntil(loop, &client.done, 5000), "end not reported");
+    ZLTestCheck(client.events[ZLSocketStreamEventEndEncountered] == 1, "end reported %d times", client.events[ZLSocketStreamEventEndEncountered]);
+    ZLTestCheck(client.received.length == sizeof(reply) - 1 && memcmp(client.received.bytes, reply, sizeof(reply) - 1) == 0, "bytes before end");
+    ZLTestCheck(ZLSocketStreamGetStatus(client.stream) == ZLSocketStreamStatusAtEnd, "status at end");
+    ZLTestCheck(!ZLSocketStreamHasBytesAvailable(client.stream), "bytes available at end");
+
+    pthread_join(thread, NULL);
+    ZLSocketStreamClose(client.stream);
+    ZLEventLoopRunOnce(loop, 0);
+    ZLSocketStreamRelease(client.stream);
+    ZLTestBufferFree(&client.received);
+    close(server.listener);
+    ZLEventLoopDestroy(loop);
+}
+
+static void ZLEventTestStreamRefused(void) {
+    ZLEventLoop *loop = ZLEventLoopCreate();
+    struct sockaddr_in address;
+    close(ZLEventTestListen(&address));
+
+    ZLTestRandom random = ZLTestRandomMake(2);
+    ZLEventTestClient client = { .random = &random };
+    client.stream = ZLSocketStreamCreate(loop, ZLEventTestClientCallback, &client);
+    // 本机地址可能立即被拒绝，也可能等到可写事件，两种都要在循环线程上回调
+    ZLSocketStreamConnect(client.stream, (struct sockaddr *)&address, sizeof(address));
+    ZLTestCheck(ZLEventTestRunUntil(loop, &client.done, 5000), "refused connection not reported");
+    ZLTestCheck(client.events[ZLSocketStreamEventErrorOccurred] == 1 && client.events[ZLSocketStreamEventOpenCompleted] == 0, "refused connection events");
+    ZLTestCheck(ZLSocketStreamGetStatus(client.stream) == ZLSocketStreamStatusError, "status after refusal");
+    ZLTestCheck(ZLSocketStreamGetError(client.stream) == ECONNREFUSED, "error %d", ZLSocketStreamGetError(client.stream));
+    ZLTestCheck(!ZLSocketStreamConnect(client.stream, (struct sockaddr *)&address, sizeof(address)), "connect after failure");
+    ZLSocketStreamClose(client.stream);
+    ZLEventLoopRunOnce(loop, 0);
+    ZLSocketStreamRelease(client.stream);
+    ZLEventLoopDestroy(loop);
+}
+
+/* cross thread */
+
+/// ZLWebSocket 的用法：循环独占一个线程，事件只用来唤醒，读写在另一个线程上做
+typedef struct ZLEventTestWaiter {
+    pthread_mutex_t lock;
+    pthread_cond_t condition;
+    uint64_t eventCount;
+    bool end;
+} ZLEventTestWaiter;
+
+static void ZLEventTestWaiterCallback(ZLSocketStream *stream, ZLSocketStreamEvent event, void *info) {
+    (void)stream;
+    ZLEventTestWaiter *waiter = info;
+    pthread_mutex_lock(&waiter->lock);
+    waiter->eventCount++;
+    waiter->end |= event == ZLSocketStreamEventErrorOccurred || event == ZLSocketStreamEventEndEncountered;
+    pthread_cond_signal(&waiter->condition);
+    pthread_mutex_unlock(&waiter->lock);
+}
+
+static void *ZLEventTestLoopThread(void *info) {
+    ZLEventLoopRun(info);
+    return NULL;
+}
+
+static void ZLEventTestStreamCrossThread(ZLTestRandom *random) {
+    ZLEventLoop *loop = ZLEventLoopCreate();
+    pthread_t loopThread;
+    pthread_create(&loopThread, NULL, ZLEventTestLoopThread, loop);
+
+    struct sockaddr_in address;
+    ZLEventTestServer server = { ZLEventTestListen(&address), NULL, 0 };
+    pthread_t serverThread;
+    pthread_create(&serverThread, NULL, ZLEventTestServerThread, &server);
+
+    size_t length = 4 * 1024 * 1024;
+    uint8_t *payload = malloc(length);
+    for (size_t i = 0; i < length; i++) {
+        payload[i] = (uint8_t)ZLTestRandomNext(random);
+    }
+    ZLEventTestWaiter waiter = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, false };
+    ZLEventTestClient client = { .random = random, .payload = payload, .length = length };
+    client.stream = ZLSocketStreamCreate(loop, ZLEventTestWaiterCallback, &waiter);
+    ZLSocketStreamConnect(client.stream, (struct sockaddr *)&address, sizeof(address));
+
+    // 事件计数在读写之后才比较，读写返回 0 之后到来的事件不会丢
+    uint64_t seen = 0;
+    uint64_t deadline = ZLEventTestNow() + 20000000000ULL;
+    while (!client.done && ZLEventTestNow() < deadline) {
+        pthread_mutex_lock(&waiter.lock);
+        while (waiter.eventCount == seen && !waiter.end) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += 1;
+            if (pthread_cond_timedwait(&waiter.condition, &waiter.lock, &until) != 0) {
+                break;
+            }
+        }
+        seen = waiter.eventCount;
+        bool end = waiter.end;
+        pthread_mutex_unlock(&waiter.lock);
+        if (end) {
+            break;
+        }
+        ZLEventTestPump(&client);
+    }
+    ZLTestCheck(client.done, "cross thread echo timed out after %zu sent, %zu received", client.sent, client.received.length);
+    ZLTestCheck(client.received.length == length && memcmp(client.received.bytes, payload, length) == 0, "cross thread echo differs");
+
+    pthread_join(serverThread, NULL);
+    ZLEventLoopStop(loop);
+    pthread_join(loopThread, NULL);
+    ZLSocketStreamRelease(client.stream);
+    ZLTestBufferFree(&client.received);
+    free(payload);
+    close(server.listener);
+    ZLEventLoopDestroy(loop);
+}
+
+int main(int argc, char **argv) {
+    ZLTestRandom random = ZLTestRandomMake(ZLTestSeed(argc, argv));
+
+    ZLEventTestPost();
+    ZLEventTestTimers();
+    ZLEventTestWatchEdges();
+    ZLEventTestStreamEnd();
+    ZLEventTestStreamRefused();
+
+    // 小到一次写完，大到发送和接收缓冲区都会写满
+    ZLEventTestStreamEcho(&random, 1);
+    size_t rounds = ZLTestIterations(8);
+    for (size_t i = 0; i < rounds; i++) {
+        ZLEventTestStreamEcho(&random, 1 + ZLTestRandomBelow(&random, 8 * 1024 * 1024));
+    }
+    ZLEventTestStreamCrossThread(&random);
+    fprintf(stderr, "%zu random echo rounds\n", rounds);
+
+    return ZLTestFinish("ZLEventLoopTests");
+}
@@ -0,0 +1,675 @@
+//
+//  ZLGIFDecoderTests.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLTestSupport.h"
+#include "ZLGIFDecoder.h"
+
+/// 随机生成动画（全局/局部色表、透明色、隔行、各种 disposal、超出画布的帧、不同的 LZW 码长和 clear 时机），
+/// 用测试里的编码器写成 GIF，再用一个逐像素的参考合成器算出每帧画面，与解码器整体追加、随机分片追加的结果逐帧比较
+#define ZLGIFTestMaxFrames 6
+#define ZLGIFTestHashSize 8192
+
+typedef struct ZLGIFTestFrame {
+    ZLGIFRect rect;
+    bool hasControl;
+    uint16_t delay;
+    uint8_t disposal;
+    int16_t transparentIndex;   // -1 表示没有透明色
+    bool interlaced;
+    uint32_t colorCount;        // 局部色表，0 表示使用全局色表
+    uint8_t colorTable[256 * 3];
+    uint32_t minCodeSize;
+    uint8_t *indices;           // rect.width * rect.height 个，按行排列
+} ZLGIFTestFrame;
+
+typedef struct ZLGIFTestImage {
+    uint32_t width;
+    uint32_t height;
+    uint32_t colorCount;        // 全局色表，0 表示没有
+    uint8_t colorTable[256 * 3];
+    bool hasLoop;
+    uint16_t repeat;
+    ZLGIFTestFrame frames[ZLGIFTestMaxFrames];
+    size_t frameCount;
+} ZLGIFTestImage;
+
+/* 编码器 */
+
+static void ZLGIFTestAppendByte(ZLTestBuffer *buffer, uint8_t value) {
+    ZLTestBufferAppend(buffer, &value, 1);
+}
+
+static void ZLGIFTestAppendUInt16(ZLTestBuffer *buffer, uint16_t value) {
+    uint8_t bytes[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+    ZLTestBufferAppend(buffer, bytes, 2);
+}
+
+/// 色表长度字段：2 << field 个颜色
+static uint8_t ZLGIFTestTableField(uint32_t colorCount) {
+    uint8_t field = 0;
+    while ((2u << field) < colorCount) {
+        field++;
+    }
+    return field;
+}
+
+/// LZW 码流写入器，同时模拟解码端的码长变化，保证两边的码长一致；子块长度可以随机
+typedef struct ZLGIFTestLZWWriter {
+    ZLTestRandom *random;
+    ZLTestBuffer *file;
+    uint8_t block[255];
+    size_t blockLength;
+    size_t blockLimit;
+    bool randomBlocks;
+    uint32_t bits;
+    uint32_t bitCount;
+
+    uint32_t minCodeSize;
+    uint32_t decoderCodeSize;
+    uint32_t decoderNext;
+    bool decoderFirst;
+} ZLGIFTestLZWWriter;
+
+static void ZLGIFTestFlushBlock(ZLGIFTestLZWWriter *writer) {
+    if (writer->blockLength == 0) {
+        return;
+    }
+    ZLGIFTestAppendByte(writer->file, (uint8_t)writer->blockLength);
+    ZLTestBufferAppend(writer->file, writer->block, writer->blockLength);
+    writer->blockLength = 0;
+    writer->blockLimit = writer->randomBlocks ? 1 + (size_t)ZLTestRandomBelow(writer->random, 255) : 255;
+}
+
+static void ZLGIFTestEmit(ZLGIFTestLZWWriter *writer, uint32_t code) {
+    writer->bits |= code << writer->bitCount;
+    writer->bitCount += writer->decoderCodeSize;
+    while (writer->bitCount >= 8) {
+        writer->block[writer->blockLength++] = (uint8_t)writer->bits;
+        if (writer->blockLength == writer->blockLimit) {
+            ZLGIFTestFlushBlock(writer);
+        }
+        writer->bits >>= 8;
+        writer->bitCount -= 8;
+    }
+
+    uint32_t clear = 1u << writer->minCodeSize;
+    if (code == clear) {
+        writer->decoderCodeSize = writer->minCodeSize + 1;
+        writer->decoderNext = clear + 2;
+        writer->decoderFirst = true;
+        return;
+    }
+    if (code == clear + 1) {
+        return;
+    }
+    if (!writer->decoderFirst && writer->decoderNext < 4096) {
+        writer->decoderNext++;
+        if (writer->decoderNext == (1u << writer->decoderCodeSize) && writer->decoderCodeSize < 12) {
+            writer->decoderCodeSize++;
+        }
+    }
+    writer->decoderFirst = false;
+}
+
+/// 字典满了随机选择发 clear 或者继续用满的字典，中途也可能多发几次 clear，结尾的 end 码可以省略
+static void ZLGIFTestEncodeIndices(ZLTestRandom *random, const uint8_t *indices, size_t count, uint32_t minCodeSize, ZLTestBuffer *file) {
+    static uint32_t keys[ZLGIFTestHashSize];
+    static uint16_t codes[ZLGIFTestHashSize];
+    const uint32_t clear = 1u << minCodeSize;
+    bool clearWhenFull = ZLTestRandomBelow(random, 2);
+    bool extraClears = ZLTestRandomBelow(random, 4) == 0;
+    bool endCode = ZLTestRandomBelow(random, 8) != 0;
+
+    ZLGIFTestAppendByte(file, (uint8_t)minCodeSize);
+    ZLGIFTestLZWWriter writer = {.random = random, .file = file, .minCodeSize = minCodeSize};
+    writer.randomBlocks = ZLTestRandomBelow(random, 2);
+    writer.blockLimit = writer.randomBlocks ? 1 + (size_t)ZLTestRandomBelow(random, 255) : 255;
+    writer.decoderCodeSize = minCodeSize + 1;
+
+    memset(keys, 0, sizeof(keys));
+    uint32_t next = clear + 2;
+    ZLGIFTestEmit(&writer, clear);
+    uint32_t prefix = indices[0];
+    for (size_t i = 1; i < count; i++) {
+        uint32_t key = (prefix << 8 | indices[i]) + 1;
+        size_t slot = (key * 2654435761u) & (ZLGIFTestHashSize - 1);
+        while (keys[slot] && keys[slot] != key) {
+            slot = (slot + 1) & (ZLGIFTestHashSize - 1);
+        }
+        if (keys[slot]) {
+            prefix = codes[slot];
+            continue;
+        }
+        ZLGIFTestEmit(&writer, prefix);
+        if (next < 4096) {
+            keys[slot] = key;
+            codes[slot] = (uint16_t)next++;
+        }
+        if ((next == 4096 && clearWhenFull) || (extraClears && ZLTestRandomBelow(random, 64) == 0)) {
+            ZLGIFTestEmit(&writer, clear);
+            memset(keys, 0, sizeof(keys));
+            next = clear + 2;
+        }
+        prefix = indices[i];
+    }
+    ZLGIFTestEmit(&writer, prefix);
+    if (endCode) {
+        ZLGIFTestEmit(&writer, clear + 1);
+    }
+    if (writer.bitCount > 0) {
+        writer.block[writer.blockLength++] = (uint8_t)writer.bits;
+    }
+    ZLGIFTestFlushBlock(&writer);
+    ZLGIFTestAppendByte(file, 0);
+}
+
+/// 隔行时按 0、4、2、1 开始，步长 8、8、4、2 的四遍依次排列
+static void ZLGIFTestScanOrder(const ZLGIFTestFrame *frame, uint8_t *output) {
+    static const uint32_t start[4] = {0, 4, 2, 1}, step[4] = {8, 8, 4, 2};
+    uint32_t width = frame->rect.width, height = frame->rect.height;
+    size_t offset = 0;
+    for (uint32_t pass = 0; pass < (frame->interlaced ? 4u : 1u); pass++) {
+        uint32_t first = frame->interlaced ? start[pass] : 0, stride = frame->interlaced ? step[pass] : 1;
+        for (uint32_t y = first; y < height; y += stride) {
+            memcpy(output + offset, frame->indices + (size_t)y * width, width);
+            offset += width;
+        }
+    }
+}
+
+static void ZLGIFTestAppendComment(ZLTestRandom *random, ZLTestBuffer *file) {
+    static const uint8_t labels[3] = {0xFE, 0x01, 0xFF};
+    uint8_t label = labels[ZLTestRandomBelow(random, 3)];
+    ZLGIFTestAppendByte(file, 0x21);
+    ZLGIFTestAppendByte(file, label);
+    if (label == 0xFF) {
+        // 不认识的应用扩展，解码器应该跳过
+        ZLGIFTestAppendByte(file, 11);
+        ZLTestBufferAppend(file, "XMP DataXMP", 11);
+    }
+    size_t blocks = (size_t)ZLTestRandomBelow(random, 3);
+    for (size_t i = 0; i < blocks; i++) {
+        uint8_t length = (uint8_t)(1 + ZLTestRandomBelow(random, 255));
+        ZLGIFTestAppendByte(file, length);
+        for (uint8_t j = 0; j < length; j++) {
+            ZLGIFTestAppendByte(file, (uint8_t)ZLTestRandomNext(random));
+        }
+    }
+    ZLGIFTestAppendByte(file, 0);
+}
+
+static void ZLGIFTestEncode(ZLTestRandom *random, const ZLGIFTestImage *image, ZLTestBuffer *file) {
+    ZLTestBufferAppend(file, ZLTestRandomBelow(random, 4) ? "GIF89a" : "GIF87a", 6);
+    ZLGIFTestAppendUInt16(file, (uint16_t)image->width);
+    ZLGIFTestAppendUInt16(file, (uint16_t)image->height);
+    uint8_t flags = 0x70;
+    if (image->colorCount) {
+        flags |= 0x80 | ZLGIFTestTableField(image->colorCount);
+    }
+    ZLGIFTestAppendByte(file, flags);
+    ZLGIFTestAppendByte(file, (uint8_t)ZLTestRandomNext(random));
+    ZLGIFTestAppendByte(file, 0);
+    ZLTestBufferAppend(file, image->colorTable, image->colorCount * 3);
+
+    if (image->hasLoop) {
+        ZLGIFTestAppendByte(file, 0x21);
+        ZLGIFTestAppendByte(file, 0xFF);
+        ZLGIFTestAppendByte(file, 11);
+        ZLTestBufferAppend(file, ZLTestRandomBelow(random, 4) ? "NETSCAPE2.0" : "ANIMEXTS1.0", 11);
+        ZLGIFTestAppendByte(file, 3);
+        ZLGIFTestAppendByte(file, 1);
+        ZLGIFTestAppendUInt16(file, image->repeat);
+        ZLGIFTestAppendByte(file, 0);
+    }
+
+    for (size_t i = 0; i < image->frameCount; i++) {
+        const ZLGIFTestFrame *frame = &image->frames[i];
+        if (ZLTestRandomBelow(random, 4) == 0) {
+            ZLGIFTestAppendComment(random, file);
+        }
+        if (frame->hasControl) {
+            ZLGIFTestAppendByte(file, 0x21);
+            ZLGIFTestAppendByte(file, 0xF9);
+            ZLGIFTestAppendByte(file, 4);
+            ZLGIFTestAppendByte(file, (uint8_t)(frame->disposal << 2 | (frame->transparentIndex >= 0 ? 1 : 0)));
+            ZLGIFTestAppendUInt16(file, frame->delay);
+            ZLGIFTestAppendByte(file, frame->transparentIndex >= 0 ? (uint8_t)frame->transparentIndex : (uint8_t)ZLTestRandomNext(random));
+            ZLGIFTestAppendByte(file, 0);
+        }
+        ZLGIFTestAppendByte(file, 0x2C);
+        ZLGIFTestAppendUInt16(file, (uint16_t)frame->rect.x);
+        ZLGIFTestAppendUInt16(file, (uint16_t)frame->rect.y);
+        ZLGIFTestAppendUInt16(file, (uint16_t)frame->rect.width);
+        ZLGIFTestAppendUInt16(file, (uint16_t)frame->rect.height);
+        flags = frame->interlaced ? 0x40 : 0;
+        if (frame->colorCount) {
+            flags |= 0x80 | ZLGIFTestTableField(frame->colorCount);
+        }
+        ZLGIFTestAppendByte(file, flags);
+        ZLTestBufferAppend(file, frame->colorTable, frame->colorCount * 3);
+
+        size_t count = (size_t)frame->rect.width * frame->rect.height;
+        uint8_t *ordered = malloc(count);
+        if (ordered == NULL) {
+            abort();
+        }
+        ZLGIFTestScanOrder(frame, ordered);
+        ZLGIFTestEncodeIndices(random, ordered, count, frame->minCodeSize, file);
+        free(ordered);
+    }
+    ZLGIFTestAppendByte(file, 0x3B);
+}
+
+/* 随机图像 */
+
+static uint32_t ZLGIFTestRandomTable(ZLTestRandom *random, uint8_t *table) {
+    uint32_t count = 2u << ZLTestRandomBelow(random, 8);
+    for (uint32_t i = 0; i < count * 3; i++) {
+        table[i] = (uint8_t)ZLTestRandomNext(random);
+    }
+    return count;
+}
+
+/// 索引取满 2^minCodeSize，色表只有 2 个颜色时会出现色表之外的索引
+static void ZLGIFTestRandomIndices(ZLTestRandom *random, ZLGIFTestFrame *frame) {
+    size_t count = (size_t)frame->rect.width * frame->rect.height;
+    uint32_t limit = 1u << frame->minCodeSize;
+    frame->indices = malloc(count);
+    if (frame->indices == NULL) {
+        abort();
+    }
+    // 0 均匀随机，1 长串重复（走到 KwKwK 和长前缀链），2 只用几种颜色
+    uint64_t mode = ZLTestRandomBelow(random, 3);
+    uint32_t colors = 1 + (uint32_t)ZLTestRandomBelow(random, limit < 4 ? limit : 4);
+    for (size_t i = 0; i < count; i++) {
+        if (frame->transparentIndex >= 0 && ZLTestRandomBelow(random, 5) == 0) {
+            frame->indices[i] = (uint8_t)frame->transparentIndex;
+        } else if (mode == 1 && i > 0 && ZLTestRandomBelow(random, 8)) {
+            frame->indices[i] = frame->indices[i - 1];
+        } else {
+            frame->indices[i] = (uint8_t)ZLTestRandomBelow(random, mode == 2 ? colors : limit);
+        }
+    }
+}
+
+static void ZLGIFTestRandomImage(ZLTestRandom *random, ZLGIFTestImage *image) {
+    memset(image, 0, sizeof(*image));
+    // 偶尔生成大一些的画布，让字典涨满 12 位
+    bool large = ZLTestRandomBelow(random, 8) == 0;
+    image->width = large ? 48 + (uint32_t)ZLTestRandomBelow(random, 80) : 1 + (uint32_t)ZLTestRandomBelow(random, 24);
+    image->height = large ? 48 + (uint32_t)ZLTestRandomBelow(random, 80) : 1 + (uint32_t)ZLTestRandomBelow(random, 24);
+    if (ZLTestRandomBelow(random, 6)) {
+        image->colorCount = ZLGIFTestRandomTable(random, image->colorTable);
+    }
+    image->hasLoop = ZLTestRandomBelow(random, 2);
+    image->repeat = (uint16_t)ZLTestRandomBelow(random, 3);
+
+    image->frameCount = 1 + (size_t)ZLTestRandomBelow(random, ZLGIFTestMaxFrames);
+    for (size_t i = 0; i < image->frameCount; i++) {
+        ZLGIFTestFrame *frame = &image->frames[i];
+        if (large || ZLTestRandomBelow(random, 4) == 0) {
+            frame->rect.width = image->width;
+            frame->rect.height = image->height;
+        } else {
+            // 帧的位置和大小可以超出画布
+            frame->rect.x = (uint32_t)ZLTestRandomBelow(random, image->width + 2);
+            frame->rect.y = (uint32_t)ZLTestRandomBelow(random, image->height + 2);
+            frame->rect.width = 1 + (uint32_t)ZLTestRandomBelow(random, image->width + 4);
+            frame->rect.height = 1 + (uint32_t)ZLTestRandomBelow(random, image->height + 4);
+        }
+        frame->interlaced = ZLTestRandomBelow(random, 3) == 0;
+        frame->hasControl = ZLTestRandomBelow(random, 5) != 0;
+        frame->transparentIndex = -1;
+        if (frame->hasControl) {
+            // 0 和 1 按 100ms 处理；disposal 4-7 是保留值
+            frame->delay = (uint16_t)ZLTestRandomBelow(random, ZLTestRandomBelow(random, 4) ? 300 : 2);
+            frame->disposal = (uint8_t)ZLTestRandomBelow(random, ZLTestRandomBelow(random, 5) ? 4 : 8);
+        }
+        if (ZLTestRandomBelow(random, 3) == 0 || image->colorCount == 0) {
+            if (ZLTestRandomBelow(random, 8)) {
+                frame->colorCount = ZLGIFTestRandomTable(random, frame->colorTable);
+            }
+        }
+        uint32_t colorCount = frame->colorCount ? frame->colorCount : image->colorCount;
+        if (colorCount) {
+            uint32_t field = ZLGIFTestTableField(colorCount);
+            frame->minCodeSize = field + 1 < 2 ? 2 : field + 1;
+        } else {
+            frame->minCodeSize = 2 + (uint32_t)ZLTestRandomBelow(random, 7);
+        }
+        if (frame->hasControl && ZLTestRandomBelow(random, 2)) {
+            frame->transparentIndex = (int16_t)ZLTestRandomBelow(random, 1u << frame->minCodeSize);
+        }
+        ZLGIFTestRandomIndices(random, frame);
+    }
+}
+
+static void ZLGIFTestFreeImage(ZLGIFTestImage *image) {
+    for (size_t i = 0; i < image->frameCount; i++) {
+        free(image->frames[i].indices);
+    }
+}
+
+/* 参考合成器 */
+
+static uint32_t ZLGIFTestColor(const ZLGIFTestImage *image, const ZLGIFTestFrame *frame, uint8_t index) {
+    uint32_t count = frame->colorCount ? frame->colorCount : image->colorCount;
+    const uint8_t *table = frame->colorCount ? frame->colorTable : image->colorTable;
+    if (index >= count) {
+        return 0xFF000000u;
+    }
+    return 0xFF000000u | ((uint32_t)table[index * 3] << 16) | ((uint32_t)table[index * 3 + 1] << 8) | table[index * 3 + 2];
+}
+
+/// 每帧合成后的完整画面，frameCount 块依次排列；第 0 帧之前画布全透明，disposal 4-7 按 0 处理
+static uint32_t *ZLGIFTestReference(const ZLGIFTestImage *image) {
+    size_t area = (size_t)image->width * image->height;
+    uint32_t *snapshots = calloc(area * image->frameCount, sizeof(uint32_t));
+    uint32_t *canvas = calloc(area, sizeof(uint32_t));
+    uint32_t *saved = malloc(area * sizeof(uint32_t));
+    if (snapshots == NULL || canvas == NULL || saved == NULL) {
+        abort();
+    }
+    for (size_t i = 0; i < image->frameCount; i++) {
+        const ZLGIFTestFrame *frame = &image->frames[i];
+        memcpy(saved, canvas, area * sizeof(uint32_t));
+        for (uint32_t y = 0; y < frame->rect.height; y++) {
+            for (uint32_t x = 0; x < frame->rect.width; x++) {
+                uint32_t canvasX = frame->rect.x + x, canvasY = frame->rect.y + y;
+                uint8_t index = frame->indices[(size_t)y * frame->rect.width + x];
+                if (canvasX < image->width && canvasY < image->height && index != frame->transparentIndex) {
+                    canvas[(size_t)canvasY * image->width + canvasX] = ZLGIFTestColor(image, frame, index);
+                }
+            }
+        }
+        memcpy(snapshots + area * i, canvas, area * sizeof(uint32_t));
+        for (uint32_t y = frame->rect.y; y < image->height && y - frame->rect.y < frame->rect.height; y++) {
+            for (uint32_t x = frame->rect.x; x < image->width && x - frame->rect.x < frame->rect.width; x++) {
+                size_t p = (size_t)y * image->width + x;
+                if (frame->disposal == 2) {
+                    canvas[p] = 0;
+                } else if (frame->disposal == 3) {
+                    canvas[p] = saved[p];
+                }
+            }
+        }
+    }
+    free(canvas);
+    free(saved);
+    return snapshots;
+}
+
+static uint32_t ZLGIFTestDuration(const ZLGIFTestFrame *frame) {
+    if (!frame->hasControl || frame->delay <= 1) {
+        return 100;
+    }
+    return frame->delay * 10u;
+}
+
+static uint32_t ZLGIFTestLoopCount(const ZLGIFTestImage *image) {
+    if (!image->hasLoop) {
+        return 1;
+    }
+    return image->repeat == 0 ? 0 : image->repeat + 1u;
+}
+
+/* 差分比较 */
+
+/// 合成所有已收全的帧，逐帧与参考画面比较，并检查 dirtyRect 之外的像素没有变化
+static void ZLGIFTestRenderAvailable(ZLGIFCanvas *canvas, const ZLGIFDecoder *decoder, const ZLGIFTestImage *image,
+                                     const uint32_t *reference, uint32_t *before, uint64_t seed) {
+    size_t area = (size_t)image->width * image->height;
+    while (ZLGIFCanvasNextFrameIndex(canvas) < ZLGIFDecoderFrameCount(decoder)) {
+        size_t index = ZLGIFCanvasNextFrameIndex(canvas);
+        memcpy(before, ZLGIFCanvasPixels(canvas), area * sizeof(uint32_t));
+        ZLGIFRect dirty;
+        ZLTestCheck(ZLGIFCanvasRenderNextFrame(canvas, decoder, &dirty), "seed %" PRIu64 " frame %zu", seed, index);
+        const uint32_t *pixels = ZLGIFCanvasPixels(canvas);
+        size_t mismatch = SIZE_MAX, outside = SIZE_MAX;
+        for (size_t p = 0; p < area; p++) {
+            uint32_t x = (uint32_t)(p % image->width), y = (uint32_t)(p / image->width);
+            if (mismatch == SIZE_MAX && pixels[p] != reference[area * index + p]) {
+                mismatch = p;
+            }
+            bool inside = x >= dirty.x && x - dirty.x < dirty.width && y >= dirty.y && y - dirty.y < dirty.height;
+            if (outside == SIZE_MAX && !inside && pixels[p] != before[p]) {
+                outside = p;
+            }
+        }
+        ZLTestCheck(mismatch == SIZE_MAX, "seed %" PRIu64 " frame %zu pixel %zu: %08x, expected %08x (interlaced %d disposal %u)",
+                    seed, index, mismatch, pixels[mismatch == SIZE_MAX ? 0 : mismatch], reference[area * index + (mismatch == SIZE_MAX ? 0 : mismatch)],
+                    image->frames[index].interlaced, image->frames[index].disposal);
+        ZLTestCheck(outside == SIZE_MAX, "seed %" PRIu64 " frame %zu changed pixel %zu outside the dirty rect", seed, index, outside);
+    }
+}
+
+static void ZLGIFTestDecode(ZLTestRandom *random, const ZLGIFTestImage *image, const ZLTestBuffer *file,
+                            const uint32_t *reference, bool chunked, uint64_t seed) {
+    ZLGIFDecoder *decoder = ZLGIFDecoderCreate();
+    ZLGIFCanvas *canvas = NULL;
+    uint32_t *before = malloc((size_t)image->width * image->height * sizeof(uint32_t));
+    if (decoder == NULL || before == NULL) {
+        abort();
+    }
+    size_t offset = 0;
+    size_t previousFrameCount = 0;
+    while (offset < file->length) {
+        size_t length = chunked ? 1 + (size_t)ZLTestRandomBelow(random, ZLTestRandomBelow(random, 2) ? 16 : 512) : file->length;
+        if (length > file->length - offset) {
+            length = file->length - offset;
+        }
+        uint8_t *bytes = ZLTestCopyBytes(file->bytes + offset, length);
+        ZLTestCheck(ZLGIFDecoderAppend(decoder, bytes, length), "seed %" PRIu64 " append at %zu", seed, offset);
+        free(bytes);
+        offset += length;
+
+        size_t frameCount = ZLGIFDecoderFrameCount(decoder);
+        ZLTestCheck(frameCount >= previousFrameCount && frameCount <= image->frameCount, "seed %" PRIu64 " frame count %zu", seed, frameCount);
+        previousFrameCount = frameCount;
+        ZLTestCheck(ZLGIFDecoderIsComplete(decoder) == (offset == file->length), "seed %" PRIu64 " complete at %zu", seed, offset);
+        if (canvas == NULL) {
+            canvas = ZLGIFCanvasCreate(decoder);
+        }
+        if (canvas) {
+            ZLGIFTestRenderAvailable(canvas, decoder, image, reference, before, seed);
+        }
+    }
+
+    ZLTestCheck(ZLGIFDecoderFrameCount(decoder) == image->frameCount, "seed %" PRIu64 " %zu frames, expected %zu", seed,
+                ZLGIFDecoderFrameCount(decoder), image->frameCount);
+    ZLTestCheck(ZLGIFDecoderWidth(decoder) == image->width && ZLGIFDecoderHeight(decoder) == image->height, "seed %" PRIu64 " size", seed);
+    ZLTestCheck(ZLGIFDecoderLoopCount(decoder) == ZLGIFTestLoopCount(image), "seed %" PRIu64 " loop count %u", seed, ZLGIFDecoderLoopCount(decoder));
+    ZLTestCheck(ZLGIFDecoderDataLength(decoder) == file->length, "seed %" PRIu64 " data length", seed);
+    for (size_t i = 0; i < image->frameCount; i++) {
+        ZLTestCheck(ZLGIFDecoderFrameDuration(decoder, i) == ZLGIFTestDuration(&image->frames[i]), "seed %" PRIu64 " frame %zu duration %u",
+                    seed, i, ZLGIFDecoderFrameDuration(decoder, i));
+    }
+    // 回到开头再播一遍，复用 backup 和 LZW 表
+    if (canvas) {
+        ZLGIFCanvasReset(canvas);
+        ZLGIFTestRenderAvailable(canvas, decoder, image, reference, before, seed);
+        ZLTestCheck(!ZLGIFCanvasRenderNextFrame(canvas, decoder, NULL), "seed %" PRIu64 " render past the end", seed);
+    }
+    ZLGIFCanvasDestroy(canvas);
+    ZLGIFDecoderDestroy(decoder);
+    free(before);
+}
+
+static void ZLGIFTestRandomImages(ZLTestRandom *random, size_t rounds) {
+    for (size_t round = 0; round < rounds; round++) {
+        uint64_t seed = ZLTestRandomNext(random);
+        ZLTestRandom imageRandom = ZLTestRandomMake(seed);
+        ZLGIFTestImage image;
+        ZLGIFTestRandomImage(&imageRandom, &image);
+        ZLTestBuffer file = {0};
+        ZLGIFTestEncode(&imageRandom, &image, &file);
+        uint32_t *reference = ZLGIFTestReference(&image);
+
+        ZLGIFTestDecode(&imageRandom, &image, &file, reference, false, seed);
+        ZLGIFTestDecode(&imageRandom, &image, &file, reference, true, seed);
+
+        free(reference);
+        ZLTestBufferFree(&file);
+        ZLGIFTestFreeImage(&image);
+    }
+}
+
+/* 变异 */
+
+/// 只要求不崩溃、不越界；数据损坏后已解析的帧仍能合成
+static void ZLGIFTestMutations(ZLTestRandom *random, size_t rounds) {
+    for (size_t round = 0; round < rounds; round++) {
+        ZLGIFTestImage image;
+        ZLGIFTestRandomImage(random, &image);
+        ZLTestBuffer file = {0};
+        ZLGIFTestEncode(random, &image, &file);
+        size_t length;
+        uint8_t *mutated = ZLTestMutate(random, (const uint8_t *)file.bytes, file.length, "!,;\x01\x0b\xf9\xfe\xff", &length);
+
+        ZLGIFDecoder *decoder = ZLGIFDecoderCreate();
+        ZLGIFCanvas *canvas = NULL;
+        size_t offset = 0;
+        while (offset < length) {
+            size_t chunk = 1 + (size_t)ZLTestRandomBelow(random, 256);
+            if (chunk > length - offset) {
+                chunk = length - offset;
+            }
+            uint8_t *bytes = ZLTestCopyBytes(mutated + offset, chunk);
+            bool valid = ZLGIFDecoderAppend(decoder, bytes, chunk);
+            free(bytes);
+            offset += chunk;
+            if (canvas == NULL) {
+                canvas = ZLGIFCanvasCreate(decoder);
+            }
+            while (canvas && ZLGIFCanvasRenderNextFrame(canvas, decoder, NULL)) {
+            }
+            if (!valid) {
+                ZLTestCheck(ZLGIFDecoderIsComplete(decoder), "round %zu corrupted but not complete", round);
+                ZLTestCheck(!ZLGIFDecoderAppend(decoder, mutated, 1), "round %zu append after corruption", round);
+                break;
+            }
+        }
+        ZLGIFCanvasDestroy(canvas);
+        ZLGIFDecoderDestroy(decoder);
+        free(mutated);
+        ZLTestBufferFree(&file);
+        ZLGIFTestFreeImage(&image);
+    }
+}
+
+/* 固定用例 */
+
+/// 2x2 的单帧 GIF，全局色表 {红, 绿}；pixelCount 小于 4 时 LZW 数据提前结束
+static void ZLGIFTestSimpleFile(ZLTestRandom *random, ZLTestBuffer *file, int repeat, uint16_t delay, size_t pixelCount) {
+    static const uint8_t header[13] = {'G', 'I', 'F', '8', '9', 'a', 2, 0, 2, 0, 0x80, 0, 0};
+    static const uint8_t table[6] = {255, 0, 0, 0, 255, 0};
+    ZLTestBufferAppend(file, header, sizeof(header));
+    ZLTestBufferAppend(file, table, sizeof(table));
+    if (repeat >= 0) {
+        ZLTestBufferAppend(file, "\x21\xFF\x0BNETSCAPE2.0\x03\x01", 16);
+        ZLGIFTestAppendUInt16(file, (uint16_t)repeat);
+        ZLGIFTestAppendByte(file, 0);
+    }
+    static const uint8_t control[4] = {0x21, 0xF9, 4, 0};
+    ZLTestBufferAppend(file, control, sizeof(control));
+    ZLGIFTestAppendUInt16(file, delay);
+    ZLTestBufferAppend(file, "\0\0", 2);
+    static const uint8_t descriptor[10] = {0x2C, 0, 0, 0, 0, 2, 0, 2, 0, 0};
+    ZLTestBufferAppend(file, descriptor, sizeof(descriptor));
+    static const uint8_t indices[4] = {0, 1, 1, 0};
+    ZLGIFTestEncodeIndices(random, indices, pixelCount, 2, file);
+    ZLGIFTestAppendByte(file, 0x3B);
+}
+
+static void ZLGIFTestFixedCases(ZLTestRandom *random) {
+    ZLTestBuffer file = {0};
+    ZLGIFTestSimpleFile(random, &file, 0, 5, 4);
+    ZLGIFDecoder *decoder = ZLGIFDecoderCreate();
+    ZLTestCheck(ZLGIFDecoderAppend(decoder, (const uint8_t *)file.bytes, file.length) && ZLGIFDecoderFrameCount(decoder) == 1, "simple GIF");
+    ZLTestCheck(ZLGIFDecoderIsComplete(decoder) && ZLGIFDecoderLoopCount(decoder) == 0, "infinite loop");
+    ZLTestCheck(ZLGIFDecoderFrameDuration(decoder, 0) == 50 && ZLGIFDecoderFrameDuration(decoder, 1) == 0, "duration");
+    ZLGIFCanvas *canvas = ZLGIFCanvasCreate(decoder);
+    ZLGIFRect dirty;
+    ZLTestCheck(canvas && ZLGIFCanvasRenderNextFrame(canvas, decoder, &dirty), "render simple GIF");
+    if (canvas) {
+        const uint32_t *pixels = ZLGIFCanvasPixels(canvas);
+        ZLTestCheck(pixels[0] == 0xFFFF0000u && pixels[1] == 0xFF00FF00u && pixels[2] == 0xFF00FF00u && pixels[3] == 0xFFFF0000u,
+                    "pixels %08x %08x %08x %08x", pixels[0], pixels[1], pixels[2], pixels[3]);
+        ZLTestCheck(dirty.x == 0 && dirty.y == 0 && dirty.width == 2 && dirty.height == 2, "dirty rect");
+    }
+    ZLGIFCanvasDestroy(canvas);
+    ZLGIFDecoderDestroy(decoder);
+
+    // NETSCAPE 记录的是重复次数；没有这个扩展时只播一次；不超过 10ms 的时长按 100ms
+    ZLTestBufferClear(&file);
+    ZLGIFTestSimpleFile(random, &file, 2, 1, 4);
+    decoder = ZLGIFDecoderCreate();
+    ZLGIFDecoderAppend(decoder, (const uint8_t *)file.bytes, file.length);
+    ZLTestCheck(ZLGIFDecoderLoopCount(decoder) == 3 && ZLGIFDecoderFrameDuration(decoder, 0) == 100, "repeat twice, tiny delay");
+    ZLGIFDecoderDestroy(decoder);
+    ZLTestBufferClear(&file);
+    ZLGIFTestSimpleFile(random, &file, -1, 5, 4);
+    decoder = ZLGIFDecoderCreate();
+    ZLGIFDecoderAppend(decoder, (const uint8_t *)file.bytes, file.length);
+    ZLTestCheck(ZLGIFDecoderLoopCount(decoder) == 1, "no loop extension");
+    ZLGIFDecoderDestroy(decoder);
+
+    // LZW 数据提前结束：已解出的像素照常显示，其余保持透明
+    ZLTestBufferClear(&file);
+    ZLGIFTestSimpleFile(random, &file, 0, 5, 2);
+    decoder = ZLGIFDecoderCreate();
+    ZLTestCheck(ZLGIFDecoderAppend(decoder, (const uint8_t *)file.bytes, file.length) && ZLGIFDecoderFrameCount(decoder) == 1, "short LZW data");
+    canvas = ZLGIFCanvasCreate(decoder);
+    ZLTestCheck(canvas && ZLGIFCanvasRenderNextFrame(canvas, decoder, NULL), "render short LZW data");
+    if (canvas) {
+        const uint32_t *pixels = ZLGIFCanvasPixels(canvas);
+        ZLTestCheck(pixels[0] == 0xFFFF0000u && pixels[1] == 0xFF00FF00u && pixels[2] == 0 && pixels[3] == 0,
+                    "missing pixels stay transparent: %08x %08x %08x %08x", pixels[0], pixels[1], pixels[2], pixels[3]);
+    }
+    ZLGIFCanvasDestroy(canvas);
+    ZLGIFDecoderDestroy(decoder);
+
+    // 帧之后出现不认识的块：已解析的帧仍可使用
+    ZLTestBufferClear(&file);
+    ZLGIFTestSimpleFile(random, &file, 0, 5, 4);
+    file.bytes[file.length - 1] = 0x42;
+    decoder = ZLGIFDecoderCreate();
+    ZLTestCheck(!ZLGIFDecoderAppend(decoder, (const uint8_t *)file.bytes, file.length) && ZLGIFDecoderIsComplete(decoder), "bad block introducer");
+    ZLTestCheck(ZLGIFDecoderFrameCount(decoder) == 1, "frame before the corruption");
+    ZLGIFDecoderDestroy(decoder);
+
+    decoder = ZLGIFDecoderCreate();
+    ZLTestCheck(!ZLGIFDecoderAppend(decoder, (const uint8_t *)"\x89PNG\r\n\x1a\n\0\0\0\rIHDR", 16) && ZLGIFDecoderIsComplete(decoder), "not a GIF");
+    ZLGIFDecoderDestroy(decoder);
+
+    // 超过像素上限的文件头当作损坏，交给 ImageIO；正好在上限上的仍然接受
+    static const uint8_t oversized[13] = {'G', 'I', 'F', '8', '9', 'a', 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0};
+    decoder = ZLGIFDecoderCreate();
+    ZLTestCheck(!ZLGIFDecoderAppend(decoder, oversized, sizeof(oversized)) && ZLGIFDecoderWidth(decoder) == 0, "oversized header");
+    ZLTestCheck(ZLGIFCanvasCreate(decoder) == NULL, "no canvas for an oversized header");
+    ZLGIFDecoderDestroy(decoder);
+    static const uint8_t limit[13] = {'G', 'I', 'F', '8', '9', 'a', 0x00, 0x20, 0x00, 0x20, 0, 0, 0};
+    decoder = ZLGIFDecoderCreate();
+    ZLTestCheck(ZLGIFDecoderAppend(decoder, limit, sizeof(limit)) && ZLGIFDecoderWidth(decoder) == 8192, "header at the limit");
+    ZLGIFDecoderDestroy(decoder);
+
+    ZLTestBufferFree(&file);
+}
+
+int main(int argc, char **argv) {
+    ZLTestRandom random = ZLTestRandomMake(ZLTestSeed(argc, argv));
+
+    ZLGIFTestFixedCases(&random);
+
+    size_t rounds = ZLTestIterations(400);
+    ZLGIFTestRandomImages(&random, rounds);
+    fprintf(stderr, "%zu random animations\n", rounds);
+
+    ZLGIFTestMutations(&random, ZLTestIterations(2000));
+
+    return ZLTestFinish("ZLGIFDecoderTests");
+}
@@ -0,0 +1,280 @@
+//
+//  ZLHTTPResponseParserTests.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLTestSupport.h"
+#include "ZLHTTPResponseParser.h"
+
+/// 解析结果记录成文本：C 为完成（版本、状态码、原因短语、头部长度），H 为字段，I 为还没收全，X 为错误
+static void ZLHTTPTestRecord(const ZLHTTPResponseHead *head, ZLHTTPParseResult result, const uint8_t *data, ZLTestBuffer *transcript) {
+    if (result == ZLHTTPParseError) {
+        ZLTestBufferAppend(transcript, "X\n", 2);
+        return;
+    }
+    if (result == ZLHTTPParseIncomplete) {
+        ZLTestBufferAppend(transcript, "I\n", 2);
+        return;
+    }
+    ZLTestBufferAppendFormat(transcript, "C 1.%d %d '", head->minorVersion, head->statusCode);
+    ZLTestBufferAppend(transcript, data + head->reason.offset, head->reason.length);
+    ZLTestBufferAppendFormat(transcript, "' %zu\n", head->headLength);
+    for (size_t i = 0; i < head->headerCount; i++) {
+        const ZLHTTPHeaderField *field = &head->headers[i];
+        ZLTestBufferAppend(transcript, "H ", 2);
+        ZLTestBufferAppend(transcript, data + field->name.offset, field->name.length);
+        ZLTestBufferAppend(transcript, ":", 1);
+        ZLTestBufferAppend(transcript, data + field->value.offset, field->value.length);
+        ZLTestBufferAppend(transcript, "\n", 1);
+    }
+}
+
+static void ZLHTTPTestParseWhole(const uint8_t *response, size_t length, ZLTestBuffer *transcript) {
+    ZLHTTPResponseHead head;
+    ZLHTTPResponseHeadReset(&head);
+    uint8_t *bytes = ZLTestCopyBytes(response, length);
+    ZLHTTPParseResult result = ZLHTTPResponseHeadParse(&head, bytes, length);
+    ZLHTTPTestRecord(&head, result, bytes, transcript);
+    if (result == ZLHTTPParseComplete) {
+        ZLTestCheck(head.headLength <= length, "head length %zu beyond %zu", head.headLength, length);
+    }
+    free(bytes);
+}
+
+/// 与 ZLWebSocket 读握手响应一样，每次传入从开头起收到的全部数据；每次都放在新的内存里，
+/// 解析器只能依赖偏移量而不能持有上次的指针
+static void ZLHTTPTestParseChunked(const uint8_t *response, size_t length, ZLTestRandom *random, ZLTestBuffer *transcript) {
+    ZLHTTPResponseHead head;
+    ZLHTTPResponseHeadReset(&head);
+    size_t maxChunk = 1 + (size_t)ZLTestRandomBelow(random, length / 3 + 2);
+    size_t received = 0;
+    ZLHTTPParseResult result = ZLHTTPParseIncomplete;
+    do {
+        size_t chunk = 1 + (size_t)ZLTestRandomBelow(random, maxChunk);
+        received = length - received < chunk ? length : received + chunk;
+        uint8_t *bytes = ZLTestCopyBytes(response, received);
+        ZLHTTPParseResult previous = result;
+        result = ZLHTTPResponseHeadParse(&head, bytes, received);
+        ZLTestCheck(previous == ZLHTTPParseIncomplete || result == previous, "result changed from %d to %d", previous, result);
+        if (result == ZLHTTPParseComplete) {
+            ZLTestCheck(head.headLength <= received, "head length %zu beyond %zu", head.headLength, received);
+        }
+        free(bytes);
+    } while (received < length);
+    ZLHTTPTestRecord(&head, result, response, transcript);
+}
+
+static void ZLHTTPTestCompareChunked(const uint8_t *response, size_t length, ZLTestRandom *random, size_t rounds, const ZLTestBuffer *whole) {
+    ZLTestBuffer chunked = {0};
+    for (size_t round = 0; round < rounds; round++) {
+        ZLTestBufferClear(&chunked);
+        uint64_t state = random->state;
+        ZLHTTPTestParseChunked(response, length, random, &chunked);
+        ZLTestCheck(ZLTestBufferEqual(whole, &chunked), "chunked transcript differs (random state %" PRIu64 ") for %.*s\nwhole:\n%s\nchunked:\n%s",
+                    state, (int)length, (const char *)response, whole->bytes, chunked.bytes);
+    }
+    ZLTestBufferFree(&chunked);
+}
+
+/* 固定用例 */
+
+typedef struct ZLHTTPTestCase {
+    const char *response;
+    const char *transcript;
+} ZLHTTPTestCase;
+
+static const ZLHTTPTestCase ZLHTTPTestCases[] = {
+    { "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n\r\n\x81\x05hello",
+      "C 1.1 101 'Switching Protocols' 129\nH Upgrade:websocket\nH Connection:Upgrade\nH Sec-WebSocket-Accept:s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\n" },
+    { "HTTP/1.0 200 Connection established\r\n\r\n", "C 1.0 200 'Connection established' 39\n" },
+    { "HTTP/1.1 407 Proxy Authentication Required\nProxy-Authenticate: Basic realm=\"corp\"\n\n",
+      "C 1.1 407 'Proxy Authentication Required' 83\nH Proxy-Authenticate:Basic realm=\"corp\"\n" },
+    { "\r\nHTTP/1.1 204\r\n\r\n", "C 1.1 204 '' 18\n" },
+    { "HTTP/1.1 200 \r\nX-Empty:\r\nX-Space: \t \r\nX-Trim:\t a b \t\r\n\r\n", "C 1.1 200 '' 56\nH X-Empty:\nH X-Space:\nH X-Trim:a b\n" },
+    { "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n", "I\n" },
+    { "HTTP/1.1 200 OK\r\n\r", "I\n" },
+    { "HTTP/1.1 2", "I\n" },
+    { "", "I\n" },
+    { "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nHTTP/1.1 200 OK\r\n\r\n", "C 1.1 200 'OK' 38\nH Content-Length:5\n" },
+    { "HTTP/2 200\r\n\r\n", "X\n" },
+    { "HTTP/1.1 20x OK\r\n\r\n", "X\n" },
+    { "HTTP/1.1 200OK\r\n\r\n", "X\n" },
+    { "HTTP/1.x 200 OK\r\n\r\n", "X\n" },
+    { "ICY 200 OK\r\n\r\n", "X\n" },
+    { "\r\n\r\nHTTP/1.1 200 OK\r\n\r\n", "X\n" },
+    { "HTTP/1.1 200 OK\r\nNo-Colon\r\n\r\n", "X\n" },
+    { "HTTP/1.1 200 OK\r\n: value\r\n\r\n", "X\n" },
+    { "HTTP/1.1 200 OK\r\nBad Name: value\r\n\r\n", "X\n" },
+    { "HTTP/1.1 200 OK\r\nFolded: a\r\n  b\r\n\r\n", "X\n" },
+};
+
+static void ZLHTTPTestFixedCases(ZLTestRandom *random) {
+    ZLTestBuffer whole = {0};
+    for (size_t i = 0; i < sizeof(ZLHTTPTestCases) / sizeof(ZLHTTPTestCases[0]); i++) {
+        const ZLHTTPTestCase *testCase = &ZLHTTPTestCases[i];
+        const uint8_t *response = (const uint8_t *)testCase->response;
+        size_t length = strlen(testCase->response);
+        ZLTestBufferClear(&whole);
+        ZLHTTPTestParseWhole(response, length, &whole);
+        ZLTestCheck(whole.bytes && strcmp(whole.bytes, testCase->transcript) == 0, "case %zu: %s\nexpected:\n%sgot:\n%s",
+                    i, testCase->response, testCase->transcript, whole.bytes);
+        ZLHTTPTestCompareChunked(response, length, random, 64, &whole);
+    }
+    ZLTestBufferFree(&whole);
+}
+
+/// 字段查找与 span 比较，ZLWebSocket 用它们直接在收到的数据上校验 Sec-WebSocket-Accept
+static void ZLHTTPTestFieldLookup(void) {
+    const char *response = "HTTP/1.1 101 Switching Protocols\r\nupgrade: WebSocket\r\nSec-WebSocket-Accept: abc=\r\nSEC-WEBSOCKET-ACCEPT: second\r\n\r\n";
+    const uint8_t *data = (const uint8_t *)response;
+    ZLHTTPResponseHead head;
+    ZLHTTPResponseHeadReset(&head);
+    ZLTestCheck(ZLHTTPResponseHeadParse(&head, data, strlen(response)) == ZLHTTPParseComplete, "lookup response did not parse");
+
+    const ZLHTTPHeaderField *accept = ZLHTTPResponseHeadFindField(&head, data, "sec-websocket-accept");
+    ZLTestCheck(accept == &head.headers[1], "first matching field expected");
+    ZLTestCheck(accept && ZLHTTPSpanEquals(data, accept->value, "abc=", 4), "accept value");
+    ZLTestCheck(accept && !ZLHTTPSpanEquals(data, accept->value, "abc", 3), "prefix must not match");
+    const ZLHTTPHeaderField *upgrade = ZLHTTPResponseHeadFindField(&head, data, "Upgrade");
+    ZLTestCheck(upgrade && ZLHTTPSpanEqualsIgnoringCase(data, upgrade->value, "websocket"), "upgrade value");
+    ZLTestCheck(upgrade && !ZLHTTPSpanEqualsIgnoringCase(data, upgrade->value, "websockets"), "longer string must not match");
+    ZLTestCheck(upgrade && !ZLHTTPSpanEqualsIgnoringCase(data, upgrade->value, "websocke"), "shorter string must not match");
+    ZLTestCheck(ZLHTTPResponseHeadFindField(&head, data, "Sec-WebSocket") == NULL, "name prefix must not match");
+    ZLTestCheck(ZLHTTPResponseHeadFindField(&head, data, "Connection") == NULL, "missing field");
+    ZLTestCheck(ZLHTTPSpanEqualsIgnoringCase(data, head.reason, "switching protocols"), "reason");
+}
+
+/// 字段数和头部长度的上限，整体和分片输入都要在同一个位置出错
+static void ZLHTTPTestLimits(ZLTestRandom *random) {
+    ZLTestBuffer response = {0}, whole = {0}, expected = {0};
+    for (size_t count = ZLHTTPResponseMaxHeaderCount; count <= ZLHTTPResponseMaxHeaderCount + 1; count++) {
+        ZLTestBufferClear(&response);
+        ZLTestBufferClear(&expected);
+        ZLTestBufferAppend(&response, "HTTP/1.1 200 OK\r\n", 17);
+        for (size_t i = 0; i < count; i++) {
+            ZLTestBufferAppendFormat(&response, "X-%zu: %zu\r\n", i, i);
+            ZLTestBufferAppendFormat(&expected, "H X-%zu:%zu\n", i, i);
+        }
+        ZLTestBufferAppend(&response, "\r\n", 2);
+        ZLTestBufferClear(&whole);
+        ZLHTTPTestParseWhole((const uint8_t *)response.bytes, response.length, &whole);
+        if (count > ZLHTTPResponseMaxHeaderCount) {
+            ZLTestCheck(strcmp(whole.bytes, "X\n") == 0, "%zu fields accepted", count);
+        } else {
+            ZLTestCheck(whole.length > expected.length && strstr(whole.bytes, expected.bytes) != NULL, "%zu fields: %s", count, whole.bytes);
+        }
+        ZLHTTPTestCompareChunked((const uint8_t *)response.bytes, response.length, random, 8, &whole);
+    }
+
+    // 空行结束在上限之内可以完成，越过上限出错
+    for (size_t extra = 0; extra <= 1; extra++) {
+        ZLTestBufferClear(&response);
+        ZLTestBufferAppend(&response, "HTTP/1.1 200 OK\r\nX-Padding: ", 28);
+        while (response.length < ZLHTTPResponseMaxHeadLength - 4 + extra) {
+            ZLTestBufferAppend(&response, "a", 1);
+        }
+        ZLTestBufferAppend(&response, "\r\n\r\nbody", 8);
+        ZLTestBufferClear(&whole);
+        ZLHTTPTestParseWhole((const uint8_t *)response.bytes, response.length, &whole);
+        ZLTestCheck((whole.bytes[0] == 'X') == (extra == 1), "head of %zu bytes: %.2s", response.length - 4, whole.bytes);
+        ZLHTTPTestCompareChunked((const uint8_t *)response.bytes, response.length, random, 4, &whole);
+    }
+    ZLTestBufferFree(&response);
+    ZLTestBufferFree(&whole);
+    ZLTestBufferFree(&expected);
+}
+
+/* 随机响应：同时生成数据和期望的解析结果 */
+
+static void ZLHTTPTestGenerateSpace(ZLTestRandom *random, ZLTestBuffer *out) {
+    static const char *spaces[] = { "", "", "", " ", "  ", "\t", " \t " };
+    const char *space = spaces[ZLTestRandomBelow(random, sizeof(spaces) / sizeof(spaces[0]))];
+    ZLTestBufferAppend(out, space, strlen(space));
+}
+
+static void ZLHTTPTestGenerateResponse(ZLTestRandom *random, ZLTestBuffer *response, ZLTestBuffer *transcript) {
+    static const char *reasons[] = { "", "OK", "Switching Protocols", "Connection established", "Not Modified", "Weird: reason\twith tab" };
+    static const char *names[] = { "Upgrade", "Connection", "Sec-WebSocket-Accept", "content-length", "X-Request-ID", "Proxy-Authenticate", "a", "!#$%&'*+-.^_`|~0" };
+    static const char *values[] = { "", "websocket", "Upgrade", "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=", "0", "Basic realm=\"x: y\"", "a  b", "\xE4\xB8\xAD\xE6\x96\x87", "v:w" };
+    const char *newline = ZLTestRandomBelow(random, 4) ? "\r\n" : "\n";
+    ZLTestBufferClear(response);
+    ZLTestBufferClear(transcript);
+    if (ZLTestRandomBelow(random, 8) == 0) {
+        ZLTestBufferAppend(response, newline, strlen(newline));
+    }
+
+    int minor = (int)ZLTestRandomBelow(random, 2);
+    int status = 100 + (int)ZLTestRandomBelow(random, 500);
+    const char *reason = reasons[ZLTestRandomBelow(random, sizeof(reasons) / sizeof(reasons[0]))];
+    ZLTestBufferAppendFormat(response, "HTTP/1.%d %03d", minor, status);
+    if (*reason || ZLTestRandomBelow(random, 2)) {
+        ZLTestBufferAppendFormat(response, " %s", reason);
+    }
+    ZLTestBufferAppend(response, newline, strlen(newline));
+
+    ZLTestBuffer fields = {0};
+    size_t count = (size_t)ZLTestRandomBelow(random, 12);
+    for (size_t i = 0; i < count; i++) {
+        const char *name = names[ZLTestRandomBelow(random, sizeof(names) / sizeof(names[0]))];
+        const char *value = values[ZLTestRandomBelow(random, sizeof(values) / sizeof(values[0]))];
+        ZLTestBufferAppendFormat(response, "%s:", name);
+        ZLHTTPTestGenerateSpace(random, response);
+        ZLTestBufferAppend(response, value, strlen(value));
+        if (*value) {
+            ZLHTTPTestGenerateSpace(random, response);
+        }
+        ZLTestBufferAppend(response, newline, strlen(newline));
+        ZLTestBufferAppendFormat(&fields, "H %s:%s\n", name, value);
+    }
+    ZLTestBufferAppend(response, newline, strlen(newline));
+    ZLTestBufferAppendFormat(transcript, "C 1.%d %d '%s' %zu\n", minor, status, reason, response->length);
+    ZLTestBufferAppend(transcript, fields.bytes, fields.length);
+    ZLTestBufferFree(&fields);
+
+    // 后面跟着的响应体或 WebSocket 帧不属于头部
+    size_t body = (size_t)ZLTestRandomBelow(random, 16);
+    for (size_t i = 0; i < body; i++) {
+        uint8_t byte = (uint8_t)ZLTestRandomNext(random);
+        ZLTestBufferAppend(response, &byte, 1);
+    }
+}
+
+int main(int argc, char **argv) {
+    ZLTestRandom random = ZLTestRandomMake(ZLTestSeed(argc, argv));
+
+    ZLHTTPTestFixedCases(&random);
+    ZLHTTPTestFieldLookup();
+    ZLHTTPTestLimits(&random);
+
+    ZLTestBuffer response = {0}, expected = {0}, whole = {0};
+    size_t responses = ZLTestIterations(3000);
+    size_t mutations = 0, failures = 0;
+    for (size_t i = 0; i < responses; i++) {
+        ZLHTTPTestGenerateResponse(&random, &response, &expected);
+        const uint8_t *bytes = (const uint8_t *)response.bytes;
+        ZLTestBufferClear(&whole);
+        ZLHTTPTestParseWhole(bytes, response.length, &whole);
+        ZLTestCheck(ZLTestBufferEqual(&whole, &expected), "response %zu: %s\nexpected:\n%s\ngot:\n%s",
+                    i, response.bytes, expected.bytes, whole.bytes);
+        ZLHTTPTestCompareChunked(bytes, response.length, &random, 4, &whole);
+
+        for (size_t j = 0; j < 8; j++) {
+            size_t mutatedLength = 0;
+            uint8_t *mutated = ZLTestMutate(&random, bytes, response.length, "\r\n: \t/1HTP", &mutatedLength);
+            ZLTestBufferClear(&whole);
+            ZLHTTPTestParseWhole(mutated, mutatedLength, &whole);
+            failures += whole.length == 2 && whole.bytes[0] == 'X';
+            mutations++;
+            ZLHTTPTestCompareChunked(mutated, mutatedLength, &random, 2, &whole);
+            free(mutated);
+        }
+    }
+    fprintf(stderr, "%zu responses, %zu mutations (%zu rejected)\n", responses, mutations, failures);
+
+    ZLTestBufferFree(&response);
+    ZLTestBufferFree(&expected);
+    ZLTestBufferFree(&whole);
+    return ZLTestFinish("ZLHTTPResponseParserTests");
+}
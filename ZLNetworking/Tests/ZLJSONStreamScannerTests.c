@@ -0,0 +1,319 @@
+//
+//  ZLJSONStreamScannerTests.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLTestSupport.h"
+#include "ZLJSONStreamScanner.h"
+
+/// 与 ZLIncrementalJSONParser 相同的用法：按收到的顺序扫描，把成员的字节攒起来，遇到逗号或结束括号时交出一个成员。
+/// 事件序列记录成文本：B 为开始（括号），M 为成员原始字节，E 为结束，S 为整体解析的标量，X 为错误
+typedef struct ZLJSONTestSplitter {
+    ZLJSONStreamScanner scanner;
+    ZLTestBuffer pending;
+    ZLTestBuffer *transcript;
+    bool scalar;
+    bool failed;
+} ZLJSONTestSplitter;
+
+static void ZLJSONTestRecordMember(ZLJSONTestSplitter *splitter) {
+    ZLTestBufferAppendFormat(splitter->transcript, "M %zu:", splitter->pending.length);
+    ZLTestBufferAppend(splitter->transcript, splitter->pending.bytes, splitter->pending.length);
+    ZLTestBufferAppend(splitter->transcript, "\n", 1);
+    ZLTestBufferClear(&splitter->pending);
+}
+
+static void ZLJSONTestScan(ZLJSONTestSplitter *splitter, const uint8_t *bytes, size_t length) {
+    while (length > 0 && !splitter->failed) {
+        if (splitter->scalar) {
+            ZLTestBufferAppend(&splitter->pending, bytes, length);
+            return;
+        }
+        size_t consumed = 0;
+        ZLJSONScanResult result = ZLJSONStreamScannerScan(&splitter->scanner, bytes, length, &consumed);
+        ZLTestCheck(consumed <= length, "consumed %zu of %zu", consumed, length);
+        switch (result) {
+            case ZLJSONScanNeedMoreData:
+                ZLTestCheck(consumed == length, "need more data after %zu of %zu", consumed, length);
+                if (splitter->scanner.container != 0 && !splitter->scanner.closed) {
+                    ZLTestBufferAppend(&splitter->pending, bytes, consumed);
+                }
+                return;
+            case ZLJSONScanBegin:
+                ZLTestCheck(consumed > 0 && (bytes[consumed - 1] == '[' || bytes[consumed - 1] == '{'), "begin without a bracket");
+                ZLTestBufferAppendFormat(splitter->transcript, "B %c\n", bytes[consumed - 1]);
+                break;
+            case ZLJSONScanSeparator:
+            case ZLJSONScanEnd:
+                ZLTestCheck(consumed > 0, "empty separator");
+                ZLTestBufferAppend(&splitter->pending, bytes, consumed - 1);
+                ZLJSONTestRecordMember(splitter);
+                ZLTestBufferAppendFormat(splitter->transcript, "%s %c\n", result == ZLJSONScanEnd ? "E" : ",", bytes[consumed - 1]);
+                break;
+            case ZLJSONScanScalar:
+                splitter->scalar = true;
+                break;
+            default:
+                ZLTestBufferAppend(splitter->transcript, "X\n", 2);
+                splitter->failed = true;
+                return;
+        }
+        bytes += consumed;
+        length -= consumed;
+    }
+}
+
+static void ZLJSONTestFinish(ZLJSONTestSplitter *splitter) {
+    if (splitter->failed) {
+        return;
+    }
+    if (splitter->scalar) {
+        ZLTestBufferAppendFormat(splitter->transcript, "S %zu:", splitter->pending.length);
+        ZLTestBufferAppend(splitter->transcript, splitter->pending.bytes, splitter->pending.length);
+        ZLTestBufferAppend(splitter->transcript, "\n", 1);
+    } else {
+        // 文档结束时的状态：是否已闭合、最外层之内还有没有未交出的字节
+        ZLTestBufferAppendFormat(splitter->transcript, "F %d %zu\n", splitter->scanner.closed, splitter->pending.length);
+    }
+}
+
+static void ZLJSONTestSplitWhole(const uint8_t *document, size_t length, ZLTestBuffer *transcript) {
+    ZLJSONTestSplitter splitter = { .transcript = transcript };
+    ZLJSONStreamScannerReset(&splitter.scanner);
+    uint8_t *bytes = ZLTestCopyBytes(document, length);
+    ZLJSONTestScan(&splitter, bytes, length);
+    ZLJSONTestFinish(&splitter);
+    free(bytes);
+    ZLTestBufferFree(&splitter.pending);
+}
+
+/// 分片可以落在字符串、转义、\u 序列和多字节字符的中间；每片放在单独的内存里
+static void ZLJSONTestSplitChunked(const uint8_t *document, size_t length, ZLTestRandom *random, ZLTestBuffer *transcript) {
+    ZLJSONTestSplitter splitter = { .transcript = transcript };
+    ZLJSONStreamScannerReset(&splitter.scanner);
+    size_t maxChunk = 1 + (size_t)ZLTestRandomBelow(random, length / 3 + 2);
+    size_t offset = 0;
+    while (offset < length) {
+        size_t chunk = 1 + (size_t)ZLTestRandomBelow(random, maxChunk);
+        chunk = length - offset < chunk ? length - offset : chunk;
+        uint8_t *bytes = ZLTestCopyBytes(document + offset, chunk);
+        ZLJSONTestScan(&splitter, bytes, chunk);
+        free(bytes);
+        offset += chunk;
+    }
+    ZLJSONTestFinish(&splitter);
+    ZLTestBufferFree(&splitter.pending);
+}
+
+static void ZLJSONTestCompareChunked(const uint8_t *document, size_t length, ZLTestRandom *random, size_t rounds, const ZLTestBuffer *whole) {
+    ZLTestBuffer chunked = {0};
+    for (size_t round = 0; round < rounds; round++) {
+        ZLTestBufferClear(&chunked);
+        uint64_t state = random->state;
+        ZLJSONTestSplitChunked(document, length, random, &chunked);
+        ZLTestCheck(ZLTestBufferEqual(whole, &chunked), "chunked transcript differs (random state %" PRIu64 ") for %.*s\nwhole:\n%s\nchunked:\n%s",
+                    state, (int)length, (const char *)document, whole->bytes, chunked.bytes);
+    }
+    ZLTestBufferFree(&chunked);
+}
+
+/* 固定用例 */
+
+typedef struct ZLJSONTestCase {
+    const char *document;
+    const char *transcript;
+} ZLJSONTestCase;
+
+static const ZLJSONTestCase ZLJSONTestCases[] = {
+    { "[1,2]", "B [\nM 1:1\n, ,\nM 1:2\nE ]\nF 1 0\n" },
+    { " \r\n[]\n", "B [\nM 0:\nE ]\nF 1 0\n" },
+    { "{\"a\": [1, {\"b\": \"],}\"}], \"c\":\"\\\"\\\\\"}", "B {\nM 22:\"a\": [1, {\"b\": \"],}\"}]\n, ,\nM 11: \"c\":\"\\\"\\\\\"\nE }\nF 1 0\n" },
+    { "[\"\\u005d\", \"\xE4\xB8\xAD,\"]", "B [\nM 8:\"\\u005d\"\n, ,\nM 7: \"\xE4\xB8\xAD,\"\nE ]\nF 1 0\n" },
+    { "[[[]],{}]", "B [\nM 4:[[]]\n, ,\nM 2:{}\nE ]\nF 1 0\n" },
+    { "  \"text\"", "S 6:\"text\"\n" },
+    { "42", "S 2:42\n" },
+    { "null ", "S 5:null \n" },
+    { "[1,", "B [\nM 1:1\n, ,\nF 0 0\n" },
+    { "[1, 2", "B [\nM 1:1\n, ,\nF 0 2\n" },
+    { "[\"open", "B [\nF 0 5\n" },
+    { "", "F 0 0\n" },
+    { "   ", "F 0 0\n" },
+    { "[}", "B [\nX\n" },
+    { "{1]", "B {\nX\n" },
+    { "[] x", "B [\nM 0:\nE ]\nX\n" },
+    { "[][]", "B [\nM 0:\nE ]\nX\n" },
+};
+
+static void ZLJSONTestFixedCases(ZLTestRandom *random) {
+    ZLTestBuffer whole = {0};
+    for (size_t i = 0; i < sizeof(ZLJSONTestCases) / sizeof(ZLJSONTestCases[0]); i++) {
+        const ZLJSONTestCase *testCase = &ZLJSONTestCases[i];
+        const uint8_t *document = (const uint8_t *)testCase->document;
+        size_t length = strlen(testCase->document);
+        ZLTestBufferClear(&whole);
+        ZLJSONTestSplitWhole(document, length, &whole);
+        ZLTestCheck(whole.bytes && strcmp(whole.bytes, testCase->transcript) == 0, "case %zu: %s\nexpected:\n%sgot:\n%s",
+                    i, testCase->document, testCase->transcript, whole.bytes);
+        ZLJSONTestCompareChunked(document, length, random, 64, &whole);
+    }
+    ZLTestBufferFree(&whole);
+}
+
+/* 随机文档：同时生成文档和期望的成员切分 */
+
+static void ZLJSONTestGenerateSpace(ZLTestRandom *random, ZLTestBuffer *out) {
+    static const char *spaces[] = { "", "", "", " ", "\n", "\r\n  ", "\t" };
+    const char *space = spaces[ZLTestRandomBelow(random, sizeof(spaces) / sizeof(spaces[0]))];
+    ZLTestBufferAppend(out, space, strlen(space));
+}
+
+static void ZLJSONTestGenerateString(ZLTestRandom *random, ZLTestBuffer *out) {
+    // 字符串里的括号、逗号和转义后的引号都不能影响切分
+    static const char *pieces[] = { "a", "key", "[", "]", "{", "}", ",", ":", " ", "\\\"", "\\\\", "\\/", "\\n", "\\u005B", "\\uD83D\\uDE00", "\xC3\xA9", "\xE4\xB8\xAD", "\\\\\\\"" };
+    ZLTestBufferAppend(out, "\"", 1);
+    size_t count = (size_t)ZLTestRandomBelow(random, 6);
+    for (size_t i = 0; i < count; i++) {
+        const char *piece = pieces[ZLTestRandomBelow(random, sizeof(pieces) / sizeof(pieces[0]))];
+        ZLTestBufferAppend(out, piece, strlen(piece));
+    }
+    ZLTestBufferAppend(out, "\"", 1);
+}
+
+static void ZLJSONTestGenerateValue(ZLTestRandom *random, ZLTestBuffer *out, unsigned depth) {
+    switch (ZLTestRandomBelow(random, depth < 6 ? 7 : 5)) {
+        case 0:
+            ZLJSONTestGenerateString(random, out);
+            break;
+        case 1: {
+            static const char *numbers[] = { "0", "-1", "3.25", "1e10", "-0.5E-3", "12345678901234567890" };
+            const char *number = numbers[ZLTestRandomBelow(random, sizeof(numbers) / sizeof(numbers[0]))];
+            ZLTestBufferAppend(out, number, strlen(number));
+            break;
+        }
+        case 2:
+            ZLTestBufferAppend(out, "true", 4);
+            break;
+        case 3:
+            ZLTestBufferAppend(out, "false", 5);
+            break;
+        case 4:
+            ZLTestBufferAppend(out, "null", 4);
+            break;
+        default: {
+            bool object = ZLTestRandomBelow(random, 2);
+            ZLTestBufferAppend(out, object ? "{" : "[", 1);
+            size_t count = (size_t)ZLTestRandomBelow(random, 4);
+            for (size_t i = 0; i < count; i++) {
+                if (i) {
+                    ZLTestBufferAppend(out, ",", 1);
+                }
+                ZLJSONTestGenerateSpace(random, out);
+                if (object) {
+                    ZLJSONTestGenerateString(random, out);
+                    ZLJSONTestGenerateSpace(random, out);
+                    ZLTestBufferAppend(out, ":", 1);
+                    ZLJSONTestGenerateSpace(random, out);
+                }
+                ZLJSONTestGenerateValue(random, out, depth + 1);
+                ZLJSONTestGenerateSpace(random, out);
+            }
+            if (count == 0) {
+                ZLJSONTestGenerateSpace(random, out);
+            }
+            ZLTestBufferAppend(out, object ? "}" : "]", 1);
+            break;
+        }
+    }
+}
+
+static void ZLJSONTestGenerateDocument(ZLTestRandom *random, ZLTestBuffer *document, ZLTestBuffer *transcript) {
+    ZLTestBufferClear(document);
+    ZLTestBufferClear(transcript);
+    ZLJSONTestGenerateSpace(random, document);
+
+    if (ZLTestRandomBelow(random, 10) == 0) {
+        size_t start = document->length;
+        ZLJSONTestGenerateValue(random, document, 5);
+        if (document->bytes[start] != '[' && document->bytes[start] != '{') {
+            ZLJSONTestGenerateSpace(random, document);
+            ZLTestBufferAppendFormat(transcript, "S %zu:", document->length - start);
+            ZLTestBufferAppend(transcript, document->bytes + start, document->length - start);
+            ZLTestBufferAppend(transcript, "\n", 1);
+            return;
+        }
+        // 生成的刚好是数组或对象，按下面的方式重新生成
+        ZLTestBufferClear(document);
+    }
+
+    bool object = ZLTestRandomBelow(random, 3) == 0;
+    ZLTestBufferAppend(document, object ? "{" : "[", 1);
+    ZLTestBufferAppendFormat(transcript, "B %c\n", object ? '{' : '[');
+    size_t count = (size_t)ZLTestRandomBelow(random, 12);
+    ZLTestBuffer member = {0};
+    // 空的 [] 或 {} 也会交出一个只有空白的成员
+    for (size_t i = 0; i < (count ? count : 1); i++) {
+        ZLTestBufferClear(&member);
+        ZLJSONTestGenerateSpace(random, &member);
+        if (count > 0) {
+            if (object) {
+                ZLJSONTestGenerateString(random, &member);
+                ZLJSONTestGenerateSpace(random, &member);
+                ZLTestBufferAppend(&member, ":", 1);
+                ZLJSONTestGenerateSpace(random, &member);
+            }
+            ZLJSONTestGenerateValue(random, &member, 1);
+            ZLJSONTestGenerateSpace(random, &member);
+        }
+        if (i > 0) {
+            ZLTestBufferAppend(document, ",", 1);
+            ZLTestBufferAppend(transcript, ", ,\n", 4);
+        }
+        ZLTestBufferAppend(document, member.bytes, member.length);
+        ZLTestBufferAppendFormat(transcript, "M %zu:", member.length);
+        ZLTestBufferAppend(transcript, member.bytes, member.length);
+        ZLTestBufferAppend(transcript, "\n", 1);
+    }
+    ZLTestBufferFree(&member);
+    ZLTestBufferAppend(document, object ? "}" : "]", 1);
+    ZLTestBufferAppendFormat(transcript, "E %c\n", object ? '}' : ']');
+    ZLJSONTestGenerateSpace(random, document);
+    ZLTestBufferAppend(transcript, "F 1 0\n", 6);
+}
+
+int main(int argc, char **argv) {
+    ZLTestRandom random = ZLTestRandomMake(ZLTestSeed(argc, argv));
+
+    ZLJSONTestFixedCases(&random);
+
+    ZLTestBuffer document = {0}, expected = {0}, whole = {0};
+    size_t documents = ZLTestIterations(3000);
+    size_t mutations = 0, failures = 0;
+    for (size_t i = 0; i < documents; i++) {
+        ZLJSONTestGenerateDocument(&random, &document, &expected);
+        const uint8_t *bytes = (const uint8_t *)document.bytes;
+        ZLTestBufferClear(&whole);
+        ZLJSONTestSplitWhole(bytes, document.length, &whole);
+        ZLTestCheck(ZLTestBufferEqual(&whole, &expected), "document %zu: %s\nexpected:\n%s\ngot:\n%s",
+                    i, document.bytes, expected.bytes, whole.bytes);
+        ZLJSONTestCompareChunked(bytes, document.length, &random, 4, &whole);
+
+        for (size_t j = 0; j < 8; j++) {
+            size_t mutatedLength = 0;
+            uint8_t *mutated = ZLTestMutate(&random, bytes, document.length, "[]{}\",:\\ \n", &mutatedLength);
+            ZLTestBufferClear(&whole);
+            ZLJSONTestSplitWhole(mutated, mutatedLength, &whole);
+            failures += whole.length >= 2 && memcmp(whole.bytes + whole.length - 2, "X\n", 2) == 0;
+            mutations++;
+            ZLJSONTestCompareChunked(mutated, mutatedLength, &random, 2, &whole);
+            free(mutated);
+        }
+    }
+    fprintf(stderr, "%zu documents, %zu mutations (%zu rejected)\n", documents, mutations, failures);
+
+    ZLTestBufferFree(&document);
+    ZLTestBufferFree(&expected);
+    ZLTestBufferFree(&whole);
+    return ZLTestFinish("ZLJSONStreamScannerTests");
+}
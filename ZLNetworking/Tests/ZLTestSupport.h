@@ -0,0 +1,225 @@
+//
+//  ZLTestSupport.h
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#ifndef ZLTestSupport_h
+#define ZLTestSupport_h
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// C 核心的单元测试共用的断言、随机数和字节缓冲，每个测试是一个单独的可执行文件，只包含一次本头文件
+
+static unsigned long ZLTestFailureCount;
+
+/// 失败时打印位置和说明，继续执行；超过一定数量直接退出，避免随机测试刷屏
+#define ZLTestCheck(condition, ...) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #condition); \
+        fprintf(stderr, __VA_ARGS__); \
+        fputc('\n', stderr); \
+        if (++ZLTestFailureCount >= 20) { \
+            exit(1); \
+        } \
+    } \
+} while (0)
+
+/// 测试入口的返回值，打印统计
+static inline int ZLTestFinish(const char *name) {
+    if (ZLTestFailureCount) {
+        fprintf(stderr, "%s: %lu check(s) failed\n", name, ZLTestFailureCount);
+        return 1;
+    }
+    fprintf(stderr, "%s: ok\n", name);
+    return 0;
+}
+
+/* 随机数 */
+
+/// xorshift64*，结果只由种子决定，失败时用打印出的种子重现
+typedef struct ZLTestRandom {
+    uint64_t state;
+} ZLTestRandom;
+
+/// 种子先经过 splitmix64 打散，相近的种子也得到互不相关的序列
+static inline ZLTestRandom ZLTestRandomMake(uint64_t seed) {
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    ZLTestRandom random = { z ? z : 0x9E3779B97F4A7C15ULL };
+    return random;
+}
+
+static inline uint64_t ZLTestRandomNext(ZLTestRandom *random) {
+    uint64_t x = random->state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    random->state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/// [0, bound)，bound 为 0 时返回 0
+static inline uint64_t ZLTestRandomBelow(ZLTestRandom *random, uint64_t bound) {
+    return bound ? ZLTestRandomNext(random) % bound : 0;
+}
+
+/// 种子依次取命令行第一个参数、环境变量 ZL_TEST_SEED，都没有时用固定值，保证 CI 结果稳定
+static inline uint64_t ZLTestSeed(int argc, char **argv) {
+    const char *string = argc > 1 ? argv[1] : getenv("ZL_TEST_SEED");
+    uint64_t seed = string ? strtoull(string, NULL, 0) : 20220402;
+    fprintf(stderr, "%s: seed %" PRIu64 "\n", argv[0], seed);
+    return seed;
+}
+
+/// 随机测试的轮数，环境变量 ZL_TEST_SCALE 可以按倍数放大，做长时间的 soak
+static inline size_t ZLTestIterations(size_t iterations) {
+    const char *string = getenv("ZL_TEST_SCALE");
+    unsigned long scale = string ? strtoul(string, NULL, 10) : 1;
+    return iterations * (scale ? scale : 1);
+}
+
+/* 字节缓冲 */
+
+/// 记录事件序列等输出，方便整体比较
+typedef struct ZLTestBuffer {
+    char *bytes;
+    size_t length;
+    size_t capacity;
+} ZLTestBuffer;
+
+static inline void ZLTestBufferAppend(ZLTestBuffer *buffer, const void *bytes, size_t length) {
+    if (buffer->capacity - buffer->length <= length) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 256;
+        while (capacity - buffer->length <= length) {
+            capacity *= 2;
+        }
+        buffer->bytes = realloc(buffer->bytes, capacity);
+        if (buffer->bytes == NULL) {
+            abort();
+        }
+        buffer->capacity = capacity;
+    }
+    if (length) {
+        memcpy(buffer->bytes + buffer->length, bytes, length);
+    }
+    buffer->length += length;
+    buffer->bytes[buffer->length] = '\0';
+}
+
+static inline void ZLTestBufferAppendFormat(ZLTestBuffer *buffer, const char *format, ...) {
+    char stack[256];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(stack, sizeof(stack), format, arguments);
+    va_end(arguments);
+    if (length < 0) {
+        return;
+    }
+    if ((size_t)length < sizeof(stack)) {
+        ZLTestBufferAppend(buffer, stack, (size_t)length);
+        return;
+    }
+    char *heap = malloc((size_t)length + 1);
+    if (heap == NULL) {
+        abort();
+    }
+    va_start(arguments, format);
+    vsnprintf(heap, (size_t)length + 1, format, arguments);
+    va_end(arguments);
+    ZLTestBufferAppend(buffer, heap, (size_t)length);
+    free(heap);
+}
+
+static inline void ZLTestBufferClear(ZLTestBuffer *buffer) {
+    buffer->length = 0;
+    if (buffer->bytes) {
+        buffer->bytes[0] = '\0';
+    }
+}
+
+static inline void ZLTestBufferFree(ZLTestBuffer *buffer) {
+    free(buffer->bytes);
+    buffer->bytes = NULL;
+    buffer->length = buffer->capacity = 0;
+}
+
+static inline bool ZLTestBufferEqual(const ZLTestBuffer *a, const ZLTestBuffer *b) {
+    return a->length == b->length && (a->length == 0 || memcmp(a->bytes, b->bytes, a->length) == 0);
+}
+
+/// 把 bytes 拷贝到一块恰好 length 大小的新内存，越界读会被 AddressSanitizer 发现；
+/// 分片测试每次都换新地址，也能验证解析器不会持有旧的指针
+static inline uint8_t *ZLTestCopyBytes(const void *bytes, size_t length) {
+    uint8_t *copy = malloc(length ? length : 1);
+    if (copy == NULL) {
+        abort();
+    }
+    if (length) {
+        memcpy(copy, bytes, length);
+    }
+    return copy;
+}
+
+/// 随机变异：翻转、替换、插入、删除或截断若干字节，结果由调用方 free
+static inline uint8_t *ZLTestMutate(ZLTestRandom *random, const uint8_t *bytes, size_t length, const char *dictionary, size_t *mutatedLength) {
+    size_t capacity = length + 64;
+    uint8_t *mutated = malloc(capacity);
+    if (mutated == NULL) {
+        abort();
+    }
+    memcpy(mutated, bytes, length);
+    size_t count = 1 + (size_t)ZLTestRandomBelow(random, 4);
+    size_t dictionaryLength = dictionary ? strlen(dictionary) : 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t position = (size_t)ZLTestRandomBelow(random, length + 1);
+        switch (ZLTestRandomBelow(random, 6)) {
+            case 0:
+                if (position < length) {
+                    mutated[position] ^= (uint8_t)(1u << ZLTestRandomBelow(random, 8));
+                }
+                break;
+            case 1:
+                if (position < length) {
+                    mutated[position] = (uint8_t)ZLTestRandomNext(random);
+                }
+                break;
+            case 2:
+                // 插入一个语法上有意义的字符，比直接随机字节更容易走到深层分支
+                if (length < capacity) {
+                    memmove(mutated + position + 1, mutated + position, length - position);
+                    mutated[position] = dictionaryLength ? (uint8_t)dictionary[ZLTestRandomBelow(random, dictionaryLength)] : (uint8_t)ZLTestRandomNext(random);
+                    length++;
+                }
+                break;
+            case 3:
+                if (position < length) {
+                    memmove(mutated + position, mutated + position + 1, length - position - 1);
+                    length--;
+                }
+                break;
+            case 4:
+                if (position < length && dictionaryLength) {
+                    mutated[position] = (uint8_t)dictionary[ZLTestRandomBelow(random, dictionaryLength)];
+                }
+                break;
+            default:
+                length = position;
+                break;
+        }
+    }
+    *mutatedLength = length;
+    return mutated;
+}
+
+#endif /* ZLTestSupport_h */
@@ -0,0 +1,280 @@
+//
+//  ZLTimerWheelTests.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLTestSupport.h"
+#include "ZLTimerWheel.h"
+
+/// 随机模型测试：同一串添加、取消、推进操作同时作用于时间轮和一个简单数组，数组记录每个定时器应该在哪个 tick 触发。
+/// 每次推进后比较触发的集合和顺序、剩余数量和 NextTick；回调里也会添加和取消定时器
+typedef struct ZLTimerModelTimer {
+    uint64_t timerID;
+    uint64_t due;               // 应该触发的 tick：max(deadline, 添加时的 tick + 1)
+    bool alive;
+} ZLTimerModelTimer;
+
+typedef struct ZLTimerModel {
+    ZLTimerModelTimer *timers;  // 下标就是 context - 1
+    size_t count;
+    size_t capacity;
+    size_t aliveCount;
+    uint64_t current;
+} ZLTimerModel;
+
+typedef struct ZLTimerTestRun {
+    ZLTimerWheel *wheel;
+    ZLTimerModel model;
+    ZLTestRandom *random;
+    uint64_t seed;
+    uint64_t lastFireTick;      // 本次推进中上一个触发的 tick，检查触发顺序
+    size_t firedCount;
+} ZLTimerTestRun;
+
+static size_t ZLTimerModelAdd(ZLTimerModel *model, uint64_t due) {
+    if (model->count == model->capacity) {
+        model->capacity = model->capacity ? model->capacity * 2 : 256;
+        model->timers = realloc(model->timers, model->capacity * sizeof(ZLTimerModelTimer));
+        if (model->timers == NULL) {
+            abort();
+        }
+    }
+    ZLTimerModelTimer *timer = &model->timers[model->count];
+    timer->timerID = 0;
+    timer->due = due;
+    timer->alive = true;
+    model->aliveCount++;
+    return model->count++;
+}
+
+/// 近的、刚好在层边界上的、远到超出时间轮范围的和已经过期的都要覆盖
+static uint64_t ZLTimerTestDeadline(ZLTestRandom *random, uint64_t current) {
+    switch (ZLTestRandomBelow(random, 8)) {
+        case 0:
+            return current > 10 ? current - ZLTestRandomBelow(random, 10) : 0;
+        case 1:
+            return current + ZLTestRandomBelow(random, 3);
+        case 2: {
+            uint64_t boundary = 1ULL << (6 * (1 + ZLTestRandomBelow(random, 4)));
+            return ((current + boundary) & ~(boundary - 1)) + ZLTestRandomBelow(random, 3) - 1;
+        }
+        case 3:
+            return current + ZLTestRandomBelow(random, 1ULL << 24);
+        case 4:
+            return current + (1ULL << 24) + ZLTestRandomBelow(random, 1ULL << 26);
+        default:
+            return current + ZLTestRandomBelow(random, 4096);
+    }
+}
+
+static void ZLTimerTestSchedule(ZLTimerTestRun *run, uint64_t current) {
+    uint64_t deadline = ZLTimerTestDeadline(run->random, current);
+    size_t index = ZLTimerModelAdd(&run->model, deadline > current ? deadline : current + 1);
+    uint64_t timerID = ZLTimerWheelSchedule(run->wheel, deadline, (void *)(uintptr_t)(index + 1));
+    ZLTestCheck(timerID != 0, "seed %" PRIu64 " schedule failed", run->seed);
+    run->model.timers[index].timerID = timerID;
+}
+
+static void ZLTimerTestCancel(ZLTimerTestRun *run) {
+    ZLTimerModel *model = &run->model;
+    if (model->count == 0) {
+        return;
+    }
+    size_t index = (size_t)ZLTestRandomBelow(run->random, model->count);
+    ZLTimerModelTimer *timer = &model->timers[index];
+    void *context = NULL;
+    bool cancelled = ZLTimerWheelCancel(run->wheel, timer->timerID, &context);
+    ZLTestCheck(cancelled == timer->alive, "seed %" PRIu64 " cancel timer %zu returned %d", run->seed, index, cancelled);
+    if (cancelled) {
+        ZLTestCheck(context == (void *)(uintptr_t)(index + 1), "seed %" PRIu64 " cancel timer %zu context", run->seed, index);
+        timer->alive = false;
+        model->aliveCount--;
+    }
+}
+
+static void ZLTimerTestCallback(void *context, void *info) {
+    ZLTimerTestRun *run = info;
+    size_t index = (size_t)(uintptr_t)context - 1;
+    ZLTestCheck(index < run->model.count, "seed %" PRIu64 " unknown context %zu", run->seed, index);
+    if (index >= run->model.count) {
+        return;
+    }
+    ZLTimerModelTimer *timer = &run->model.timers[index];
+    ZLTestCheck(timer->alive, "seed %" PRIu64 " timer %zu fired twice or after cancel", run->seed, index);
+    ZLTestCheck(timer->due <= run->model.current, "seed %" PRIu64 " timer %zu due at %" PRIu64 " fired advancing to %" PRIu64,
+                run->seed, index, timer->due, run->model.current);
+    ZLTestCheck(timer->due >= run->lastFireTick, "seed %" PRIu64 " timer %zu due at %" PRIu64 " fired after one due at %" PRIu64,
+                run->seed, index, timer->due, run->lastFireTick);
+    timer->alive = false;
+    run->model.aliveCount--;
+    run->firedCount++;
+    run->lastFireTick = timer->due;
+
+    // 回调里添加的定时器按正在触发的 tick 计算，最早在下一个 tick
+    switch (ZLTestRandomBelow(run->random, 8)) {
+        case 0:
+            ZLTimerTestSchedule(run, timer->due);
+            break;
+        case 1:
+            ZLTimerTestCancel(run);
+            break;
+        default:
+            break;
+    }
+}
+
+/// 推进之后，模型中所有到期的定时器都已经触发，其余的都还在
+static void ZLTimerTestCompare(ZLTimerTestRun *run, size_t step) {
+    ZLTimerModel *model = &run->model;
+    uint64_t earliest = UINT64_MAX;
+    size_t overdue = SIZE_MAX;
+    for (size_t i = 0; i < model->count; i++) {
+        if (!model->timers[i].alive) {
+            continue;
+        }
+        if (model->timers[i].due <= model->current && overdue == SIZE_MAX) {
+            overdue = i;
+        }
+        if (model->timers[i].due < earliest) {
+            earliest = model->timers[i].due;
+        }
+    }
+    ZLTestCheck(overdue == SIZE_MAX, "seed %" PRIu64 " step %zu: timer %zu due at %" PRIu64 " did not fire by %" PRIu64,
+                run->seed, step, overdue, overdue == SIZE_MAX ? 0 : model->timers[overdue].due, model->current);
+    ZLTestCheck(ZLTimerWheelCount(run->wheel) == model->aliveCount, "seed %" PRIu64 " step %zu: count %zu, expected %zu",
+                run->seed, step, ZLTimerWheelCount(run->wheel), model->aliveCount);
+    // NextTick 可以早于最早的到期时间（上层下移），但不能晚，也不能停在已经处理过的 tick
+    uint64_t next = ZLTimerWheelNextTick(run->wheel);
+    if (model->aliveCount == 0) {
+        ZLTestCheck(next == UINT64_MAX, "seed %" PRIu64 " step %zu: next tick %" PRIu64 " with no timers", run->seed, step, next);
+    } else {
+        ZLTestCheck(next > model->current && next <= earliest, "seed %" PRIu64 " step %zu: next tick %" PRIu64 ", current %" PRIu64 ", earliest %" PRIu64,
+                    run->seed, step, next, model->current, earliest);
+    }
+}
+
+static void ZLTimerTestAdvance(ZLTimerTestRun *run, uint64_t now, size_t step) {
+    if (now > run->model.current) {
+        run->model.current = now;
+    }
+    run->lastFireTick = 0;
+    run->firedCount = 0;
+    size_t fired = ZLTimerWheelAdvance(run->wheel, now, ZLTimerTestCallback, run);
+    ZLTestCheck(fired == run->firedCount, "seed %" PRIu64 " step %zu: advance returned %zu, callback ran %zu times", run->seed, step, fired, run->firedCount);
+    ZLTimerTestCompare(run, step);
+}
+
+static void ZLTimerTestRandomOperations(ZLTestRandom *random, size_t steps) {
+    uint64_t seed = ZLTestRandomNext(random);
+    ZLTestRandom runRandom = ZLTestRandomMake(seed);
+    // 起点也随机，覆盖各层槽位的不同相位
+    uint64_t start = ZLTestRandomBelow(&runRandom, 2) ? ZLTestRandomBelow(&runRandom, 1ULL << 30) : 0;
+    ZLTimerTestRun run = { ZLTimerWheelCreate(start), { NULL, 0, 0, 0, start }, &runRandom, seed, 0, 0 };
+    if (run.wheel == NULL) {
+        abort();
+    }
+
+    for (size_t step = 0; step < steps; step++) {
+        uint64_t current = run.model.current;
+        switch (ZLTestRandomBelow(&runRandom, 10)) {
+            case 0:
+            case 1:
+            case 2:
+            case 3:
+                ZLTimerTestSchedule(&run, current);
+                break;
+            case 4:
+            case 5:
+                ZLTimerTestCancel(&run);
+                break;
+            case 6:
+                ZLTimerTestAdvance(&run, current + ZLTestRandomBelow(&runRandom, 4), step);
+                break;
+            case 7: {
+                // 像 ZLRunLoopThread 一样只在 NextTick 醒来
+                uint64_t next = ZLTimerWheelNextTick(run.wheel);
+                ZLTimerTestAdvance(&run, next == UINT64_MAX ? current + 1 : next, step);
+                break;
+            }
+            case 8:
+                ZLTimerTestAdvance(&run, current + ZLTestRandomBelow(&runRandom, 1ULL << (6 * (1 + ZLTestRandomBelow(&runRandom, 3)))), step);
+                break;
+            default:
+                // 时钟不会倒退，但调用方可能拿旧的 tick 来推进
+                ZLTimerTestAdvance(&run, current > 5 ? current - 5 : 0, step);
+                break;
+        }
+    }
+    // 最后推进到所有定时器都触发
+    while (run.model.aliveCount > 0) {
+        uint64_t next = ZLTimerWheelNextTick(run.wheel);
+        if (next == UINT64_MAX) {
+            ZLTestCheck(false, "seed %" PRIu64 " %zu timers left but no next tick", seed, run.model.aliveCount);
+            break;
+        }
+        ZLTimerTestAdvance(&run, next, steps);
+    }
+
+    ZLTimerWheelDestroy(run.wheel);
+    free(run.model.timers);
+}
+
+static void ZLTimerTestIgnore(void *context, void *info) {
+    (void)context;
+    (*(size_t *)info)++;
+}
+
+static void ZLTimerTestFixedCases(void) {
+    size_t fired = 0;
+    ZLTimerWheel *wheel = ZLTimerWheelCreate(100);
+    ZLTestCheck(ZLTimerWheelNextTick(wheel) == UINT64_MAX, "empty wheel next tick");
+
+    // 已经过期的在下一个 tick 触发
+    uint64_t expired = ZLTimerWheelSchedule(wheel, 50, NULL);
+    ZLTestCheck(ZLTimerWheelNextTick(wheel) == 101, "expired timer next tick %" PRIu64, ZLTimerWheelNextTick(wheel));
+    ZLTestCheck(ZLTimerWheelAdvance(wheel, 100, ZLTimerTestIgnore, &fired) == 0, "advance to the current tick");
+    ZLTestCheck(ZLTimerWheelAdvance(wheel, 101, ZLTimerTestIgnore, &fired) == 1 && fired == 1, "expired timer fires next tick");
+    ZLTestCheck(!ZLTimerWheelCancel(wheel, expired, NULL), "cancel a fired timer");
+
+    // 节点复用后旧的标识失效
+    uint64_t first = ZLTimerWheelSchedule(wheel, 200, NULL);
+    ZLTestCheck(ZLTimerWheelCancel(wheel, first, NULL), "cancel");
+    uint64_t second = ZLTimerWheelSchedule(wheel, 200, NULL);
+    ZLTestCheck(second != first && !ZLTimerWheelCancel(wheel, first, NULL), "stale id after reuse");
+    ZLTestCheck(!ZLTimerWheelCancel(wheel, 0, NULL) && !ZLTimerWheelCancel(wheel, 12345, NULL), "bogus ids");
+
+    // 超出时间轮范围的定时器先停在最上层，准时触发
+    uint64_t far = 101 + (1ULL << 24) * 3 + 17;
+    ZLTimerWheelSchedule(wheel, far, NULL);
+    fired = 0;
+    ZLTestCheck(ZLTimerWheelAdvance(wheel, far - 1, ZLTimerTestIgnore, &fired) == 1 && fired == 1, "only the near timer before the far one");
+    ZLTestCheck(ZLTimerWheelAdvance(wheel, far, ZLTimerTestIgnore, &fired) == 1 && ZLTimerWheelCount(wheel) == 0, "far timer fires on time");
+
+    // 刚好在时间轮范围两侧的到期时间
+    for (uint64_t offset = (1ULL << 24) - 1; offset <= (1ULL << 24) + 1; offset++) {
+        ZLTimerWheelSchedule(wheel, far + offset, NULL);
+        fired = 0;
+        ZLTimerWheelAdvance(wheel, far + offset - 1, ZLTimerTestIgnore, &fired);
+        ZLTestCheck(fired == 0, "timer %" PRIu64 " ticks ahead fired early", offset);
+        ZLTimerWheelAdvance(wheel, far + offset, ZLTimerTestIgnore, &fired);
+        ZLTestCheck(fired == 1, "timer %" PRIu64 " ticks ahead did not fire on time", offset);
+        far += offset;
+    }
+    ZLTimerWheelDestroy(wheel);
+}
+
+int main(int argc, char **argv) {
+    ZLTestRandom random = ZLTestRandomMake(ZLTestSeed(argc, argv));
+
+    ZLTimerTestFixedCases();
+
+    size_t rounds = ZLTestIterations(200);
+    for (size_t i = 0; i < rounds; i++) {
+        ZLTimerTestRandomOperations(&random, 2000);
+    }
+    fprintf(stderr, "%zu random operation rounds\n", rounds);
+
+    return ZLTestFinish("ZLTimerWheelTests");
+}
@@ -0,0 +1,361 @@
+//
+//  ZLUTF8ValidatorTests.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLTestSupport.h"
+#include "ZLUTF8Validator.h"
+
+typedef enum ZLUTF8TestResult {
+    ZLUTF8TestInvalid = 0,
+    ZLUTF8TestIncomplete,       // 合法数据的前缀，末尾的字符还没收全
+    ZLUTF8TestComplete,
+} ZLUTF8TestResult;
+
+static const char *ZLUTF8TestResultName(ZLUTF8TestResult result) {
+    return result == ZLUTF8TestInvalid ? "invalid" : (result == ZLUTF8TestIncomplete ? "incomplete" : "complete");
+}
+
+/// 参照实现：逐个解出码点，再按长度下限、代理区和 U+10FFFF 判断。
+/// 末尾只有首字节时，C2..F4 都能补成合法字符；有了第二个字节后，过长、代理区、超出范围都已由前两个字节决定，
+/// 剩下的用 0x80 补齐再判断即可
+static ZLUTF8TestResult ZLUTF8TestReference(const uint8_t *bytes, size_t length) {
+    static const uint32_t minimum[4] = { 0, 0x80, 0x800, 0x10000 };
+    size_t i = 0;
+    while (i < length) {
+        uint8_t lead = bytes[i];
+        size_t count;
+        uint32_t codePoint;
+        if (lead < 0x80) {
+            i++;
+            continue;
+        } else if (lead >= 0xC0 && lead <= 0xDF) {
+            count = 1;
+            codePoint = lead & 0x1F;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+            count = 2;
+            codePoint = lead & 0x0F;
+        } else if (lead >= 0xF0 && lead <= 0xF7) {
+            count = 3;
+            codePoint = lead & 0x07;
+        } else {
+            return ZLUTF8TestInvalid;
+        }
+        if (i + 1 == length) {
+            return lead >= 0xC2 && lead <= 0xF4 ? ZLUTF8TestIncomplete : ZLUTF8TestInvalid;
+        }
+        bool truncated = false;
+        for (size_t k = 1; k <= count; k++) {
+            uint8_t byte = 0x80;
+            if (i + k < length) {
+                byte = bytes[i + k];
+            } else {
+                truncated = true;
+            }
+            if ((byte & 0xC0) != 0x80) {
+                return ZLUTF8TestInvalid;
+            }
+            codePoint = codePoint << 6 | (byte & 0x3F);
+        }
+        if (codePoint < minimum[count] || (codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF) {
+            return ZLUTF8TestInvalid;
+        }
+        if (truncated) {
+            return ZLUTF8TestIncomplete;
+        }
+        i += count + 1;
+    }
+    return ZLUTF8TestComplete;
+}
+
+static ZLUTF8TestResult ZLUTF8TestValidate(const uint8_t *bytes, size_t length) {
+    ZLUTF8ValidatorState state;
+    ZLUTF8ValidatorReset(&state);
+    uint8_t *exact = ZLTestCopyBytes(bytes, length);
+    bool valid = ZLUTF8ValidatorUpdate(&state, exact, length);
+    free(exact);
+    if (!valid) {
+        return ZLUTF8TestInvalid;
+    }
+    return ZLUTF8ValidatorIsComplete(&state) ? ZLUTF8TestComplete : ZLUTF8TestIncomplete;
+}
+
+/// 随机切成若干片依次校验，每片单独分配；每片之后的 IsComplete 都要与参照实现对这段前缀的判断一致
+static ZLUTF8TestResult ZLUTF8TestValidateChunked(ZLTestRandom *random, const uint8_t *bytes, size_t length, size_t maxChunk) {
+    ZLUTF8ValidatorState state;
+    ZLUTF8ValidatorReset(&state);
+    size_t offset = 0;
+    while (offset < length) {
+        size_t chunk = 1 + (size_t)ZLTestRandomBelow(random, maxChunk);
+        if (chunk > length - offset) {
+            chunk = length - offset;
+        }
+        uint8_t *exact = ZLTestCopyBytes(bytes + offset, chunk);
+        bool valid = ZLUTF8ValidatorUpdate(&state, exact, chunk);
+        free(exact);
+        offset += chunk;
+        if (!valid) {
+            return ZLUTF8TestInvalid;
+        }
+        ZLUTF8TestResult prefix = ZLUTF8TestReference(bytes, offset);
+        ZLTestCheck(prefix != ZLUTF8TestInvalid && (prefix == ZLUTF8TestComplete) == ZLUTF8ValidatorIsComplete(&state),
+                    "prefix of %zu bytes: reference %s, validator pending %u", offset, ZLUTF8TestResultName(prefix), state.pending);
+    }
+    return ZLUTF8ValidatorIsComplete(&state) ? ZLUTF8TestComplete : ZLUTF8TestIncomplete;
+}
+
+static void ZLUTF8TestCompare(ZLTestRandom *random, const uint8_t *bytes, size_t length, const char *label, size_t round) {
+    ZLUTF8TestResult expected = ZLUTF8TestReference(bytes, length);
+    ZLUTF8TestResult whole = ZLUTF8TestValidate(bytes, length);
+    ZLTestCheck(whole == expected, "%s %zu (%zu bytes): whole %s, reference %s", label, round, length,
+                ZLUTF8TestResultName(whole), ZLUTF8TestResultName(expected));
+    // 小片让状态跨片保存，大片让向量路径在片内走完整的块
+    size_t maxChunk = ZLTestRandomBelow(random, 2) ? 8 : 96;
+    ZLUTF8TestResult chunked = ZLUTF8TestValidateChunked(random, bytes, length, maxChunk);
+    ZLTestCheck(chunked == expected, "%s %zu (%zu bytes): chunked %s, reference %s", label, round, length,
+                ZLUTF8TestResultName(chunked), ZLUTF8TestResultName(expected));
+}
+
+/* 随机文本 */
+
+static size_t ZLUTF8TestEncode(uint32_t codePoint, uint8_t *out) {
+    if (codePoint < 0x80) {
+        out[0] = (uint8_t)codePoint;
+        return 1;
+    } else if (codePoint < 0x800) {
+        out[0] = (uint8_t)(0xC0 | codePoint >> 6);
+        out[1] = (uint8_t)(0x80 | (codePoint & 0x3F));
+        return 2;
+    } else if (codePoint < 0x10000) {
+        out[0] = (uint8_t)(0xE0 | codePoint >> 12);
+        out[1] = (uint8_t)(0x80 | (codePoint >> 6 & 0x3F));
+        out[2] = (uint8_t)(0x80 | (codePoint & 0x3F));
+        return 3;
+    }
+    out[0] = (uint8_t)(0xF0 | codePoint >> 18);
+    out[1] = (uint8_t)(0x80 | (codePoint >> 12 & 0x3F));
+    out[2] = (uint8_t)(0x80 | (codePoint >> 6 & 0x3F));
+    out[3] = (uint8_t)(0x80 | (codePoint & 0x3F));
+    return 4;
+}
+
+/// 各个长度的边界码点，以及代理区两侧
+static const uint32_t ZLUTF8TestEdges[] = {
+    0x00, 0x7F, 0x80, 0x7FF, 0x800, 0xFFF, 0x1000, 0xD7FF, 0xE000, 0xFFFD, 0xFFFF, 0x10000, 0x3FFFF, 0x40000, 0xFFFFF, 0x100000, 0x10FFFF,
+};
+
+/// 按文本类型挑码点：偏 ASCII（JSON）、偏中文、偏 emoji、各种长度均匀混合
+static uint32_t ZLUTF8TestCodePoint(ZLTestRandom *random, unsigned style) {
+    uint64_t roll = ZLTestRandomBelow(random, 100);
+    if (roll < 3) {
+        return ZLUTF8TestEdges[ZLTestRandomBelow(random, sizeof(ZLUTF8TestEdges) / sizeof(ZLUTF8TestEdges[0]))];
+    }
+    switch (style) {
+        case 0:
+            return roll < 90 ? 0x20 + (uint32_t)ZLTestRandomBelow(random, 0x5F) : 0x4E00 + (uint32_t)ZLTestRandomBelow(random, 0x5200);
+        case 1:
+            return roll < 20 ? 0x20 + (uint32_t)ZLTestRandomBelow(random, 0x5F) : 0x4E00 + (uint32_t)ZLTestRandomBelow(random, 0x5200);
+        case 2:
+            return roll < 50 ? 0x20 + (uint32_t)ZLTestRandomBelow(random, 0x5F) : 0x1F300 + (uint32_t)ZLTestRandomBelow(random, 0x300);
+        default: {
+            uint32_t codePoint;
+            do {
+                codePoint = (uint32_t)ZLTestRandomBelow(random, 0x110000);
+            } while (codePoint >= 0xD800 && codePoint <= 0xDFFF);
+            return codePoint;
+        }
+    }
+}
+
+static uint8_t *ZLUTF8TestRandomText(ZLTestRandom *random, size_t *length) {
+    size_t count = (size_t)ZLTestRandomBelow(random, 300);
+    unsigned style = (unsigned)ZLTestRandomBelow(random, 4);
+    uint8_t *text = malloc(count * 4 + 1);
+    if (text == NULL) {
+        abort();
+    }
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+        used += ZLUTF8TestEncode(ZLUTF8TestCodePoint(random, style), text + used);
+    }
+    *length = used;
+    return text;
+}
+
+/* 固定用例 */
+
+typedef struct ZLUTF8TestCase {
+    const char *bytes;
+    ZLUTF8TestResult expected;
+} ZLUTF8TestCase;
+
+static const ZLUTF8TestCase ZLUTF8TestCases[] = {
+    { "", ZLUTF8TestComplete },
+    { "plain ascii", ZLUTF8TestComplete },
+    { "\xc2\x80", ZLUTF8TestComplete },
+    { "\xdf\xbf", ZLUTF8TestComplete },
+    { "\xe0\xa0\x80", ZLUTF8TestComplete },
+    { "\xed\x9f\xbf", ZLUTF8TestComplete },
+    { "\xee\x80\x80", ZLUTF8TestComplete },
+    { "\xef\xbf\xbf", ZLUTF8TestComplete },
+    { "\xf0\x90\x80\x80", ZLUTF8TestComplete },
+    { "\xf4\x8f\xbf\xbf", ZLUTF8TestComplete },
+    { "\xe4\xbd\xa0\xe5\xa5\xbd", ZLUTF8TestComplete },
+    { "\xc2", ZLUTF8TestIncomplete },
+    { "\xe4\xbd", ZLUTF8TestIncomplete },
+    { "\xf0\x9f\x98", ZLUTF8TestIncomplete },
+    { "\xe0\xa0", ZLUTF8TestIncomplete },
+    { "\xf4\x8f", ZLUTF8TestIncomplete },
+    // 孤立的续字节、非法首字节
+    { "\x80", ZLUTF8TestInvalid },
+    { "\xbf", ZLUTF8TestInvalid },
+    { "\xc2\x80\x80", ZLUTF8TestInvalid },
+    { "\xf5\x80\x80\x80", ZLUTF8TestInvalid },
+    { "\xf8\x88\x80\x80\x80", ZLUTF8TestInvalid },
+    { "\xfe", ZLUTF8TestInvalid },
+    { "\xff", ZLUTF8TestInvalid },
+    // 过长编码
+    { "\xc0\x80", ZLUTF8TestInvalid },
+    { "\xc1\xbf", ZLUTF8TestInvalid },
+    { "\xe0\x9f\xbf", ZLUTF8TestInvalid },
+    { "\xe0\x80", ZLUTF8TestInvalid },
+    { "\xf0\x8f\xbf\xbf", ZLUTF8TestInvalid },
+    { "\xf0\x80", ZLUTF8TestInvalid },
+    // 代理区、超出 U+10FFFF
+    { "\xed\xa0\x80", ZLUTF8TestInvalid },
+    { "\xed\xbf\xbf", ZLUTF8TestInvalid },
+    { "\xed\xa0", ZLUTF8TestInvalid },
+    { "\xf4\x90\x80\x80", ZLUTF8TestInvalid },
+    { "\xf4\x90", ZLUTF8TestInvalid },
+    // 续字节不够就出现了下一个字符
+    { "\xc2" "a", ZLUTF8TestInvalid },
+    { "\xe4\xbd" "a", ZLUTF8TestInvalid },
+    { "\xf0\x9f\x98" "a", ZLUTF8TestInvalid },
+    { "\xe4\xbd\xe4\xbd\xa0", ZLUTF8TestInvalid },
+    { "\xf0\x9f\x98\x80\x80", ZLUTF8TestInvalid },
+};
+
+/// 每个固定用例放在 ASCII 和中文前缀之后的各个位置上，覆盖 16 字节块内、跨块和末尾不满一块的情况
+static void ZLUTF8TestFixedCases(ZLTestRandom *random) {
+    static const char cjk[] = "\xe4\xbd\xa0\xe5\xa5\xbd\xe4\xb8\x96\xe7\x95\x8c";
+    uint8_t buffer[256];
+    for (size_t c = 0; c < sizeof(ZLUTF8TestCases) / sizeof(ZLUTF8TestCases[0]); c++) {
+        const ZLUTF8TestCase *testCase = &ZLUTF8TestCases[c];
+        size_t caseLength = strlen(testCase->bytes);
+        ZLTestCheck(ZLUTF8TestReference((const uint8_t *)testCase->bytes, caseLength) == testCase->expected, "reference on case %zu", c);
+        ZLTestCheck(ZLUTF8TestValidate((const uint8_t *)testCase->bytes, caseLength) == testCase->expected, "case %zu", c);
+
+        for (int prefixStyle = 0; prefixStyle < 2; prefixStyle++) {
+            for (size_t prefixLength = 0; prefixLength < 40; prefixLength++) {
+                size_t length = 0;
+                // 中文前缀按整字截取，保证前缀本身合法
+                while (length < prefixLength) {
+                    if (prefixStyle == 0) {
+                        buffer[length] = (uint8_t)('a' + length % 26);
+                        length++;
+                    } else {
+                        memcpy(buffer + length, cjk + length % 12 / 3 * 3, 3);
+                        length += 3;
+                    }
+                }
+                memcpy(buffer + length, testCase->bytes, caseLength);
+                length += caseLength;
+                ZLTestCheck(ZLUTF8TestValidate(buffer, length) == testCase->expected, "case %zu after %zu prefix bytes (style %d)", c, length - caseLength, prefixStyle);
+
+                // 后面再跟一段 ASCII：不完整的字符也变成非法
+                size_t suffixLength = 1 + (size_t)ZLTestRandomBelow(random, 40);
+                memset(buffer + length, 'z', suffixLength);
+                ZLUTF8TestResult expected = testCase->expected == ZLUTF8TestComplete ? ZLUTF8TestComplete : ZLUTF8TestInvalid;
+                ZLTestCheck(ZLUTF8TestValidate(buffer, length + suffixLength) == expected, "case %zu after %zu prefix bytes with a suffix", c, length - caseLength);
+                ZLTestCheck(ZLUTF8TestValidateChunked(random, buffer, length + suffixLength, 20) == expected, "case %zu chunked", c);
+            }
+        }
+    }
+}
+
+/// 非 ASCII 首字节配上所有第二字节；三字节首字节再配上所有第三字节，其余位置取一组有代表性的值。
+/// 分别放在块的开头和跨块的位置，再在字符中间截断。量比较大，直接在栈上校验，不逐个分配
+static ZLUTF8TestResult ZLUTF8TestValidateInPlace(const uint8_t *bytes, size_t length) {
+    ZLUTF8ValidatorState state;
+    ZLUTF8ValidatorReset(&state);
+    if (!ZLUTF8ValidatorUpdate(&state, bytes, length)) {
+        return ZLUTF8TestInvalid;
+    }
+    return ZLUTF8ValidatorIsComplete(&state) ? ZLUTF8TestComplete : ZLUTF8TestIncomplete;
+}
+
+static void ZLUTF8TestExhaustive(void) {
+    static const size_t positions[] = { 0, 14 };
+    static const uint8_t samples[] = { 0x00, 0x41, 0x7f, 0x80, 0x8f, 0x90, 0x9f, 0xa0, 0xbf, 0xc0, 0xc2, 0xe0, 0xed, 0xf0, 0xf4, 0xff };
+    const size_t sampleCount = sizeof(samples) / sizeof(samples[0]);
+    uint8_t buffer[40];
+    size_t checked = 0;
+    for (size_t p = 0; p < sizeof(positions) / sizeof(positions[0]); p++) {
+        size_t position = positions[p];
+        memset(buffer, 'a', sizeof(buffer));
+        for (unsigned first = 0x80; first <= 0xFF; first++) {
+            bool threeByte = first >= 0xE0 && first <= 0xEF;
+            size_t thirdCount = threeByte ? 256 : sampleCount;
+            size_t fourthCount = first >= 0xF0 ? sampleCount : 1;
+            for (unsigned second = 0; second <= 0xFF; second++) {
+                for (size_t t = 0; t < thirdCount; t++) {
+                    for (size_t f = 0; f < fourthCount; f++) {
+                        buffer[position] = (uint8_t)first;
+                        buffer[position + 1] = (uint8_t)second;
+                        buffer[position + 2] = threeByte ? (uint8_t)t : samples[t];
+                        buffer[position + 3] = first >= 0xF0 ? samples[f] : 'a';
+                        size_t length = position + 20;
+                        if (ZLUTF8TestValidateInPlace(buffer, length) != ZLUTF8TestReference(buffer, length)) {
+                            ZLTestCheck(false, "%02x %02x %02x %02x at %zu", first, second, buffer[position + 2], buffer[position + 3], position);
+                        }
+                        size_t cut = position + 1 + (t + f) % 3;
+                        if (ZLUTF8TestValidateInPlace(buffer, cut) != ZLUTF8TestReference(buffer, cut)) {
+                            ZLTestCheck(false, "%02x %02x %02x %02x cut at %zu", first, second, buffer[position + 2], buffer[position + 3], cut);
+                        }
+                        checked++;
+                    }
+                }
+            }
+        }
+    }
+    fprintf(stderr, "%zu exhaustive sequences\n", checked);
+}
+
+int main(int argc, char **argv) {
+    ZLTestRandom random = ZLTestRandomMake(ZLTestSeed(argc, argv));
+
+    ZLUTF8TestFixedCases(&random);
+    ZLUTF8TestExhaustive();
+
+    size_t rounds = ZLTestIterations(2000);
+    for (size_t round = 0; round < rounds; round++) {
+        size_t length = 0;
+        uint8_t *text = ZLUTF8TestRandomText(&random, &length);
+        ZLTestCheck(ZLUTF8TestReference(text, length) == ZLUTF8TestComplete, "generated text %zu is not valid", round);
+        ZLUTF8TestCompare(&random, text, length, "text", round);
+        // 截断在任意位置
+        ZLUTF8TestCompare(&random, text, (size_t)ZLTestRandomBelow(&random, length + 1), "truncated text", round);
+        free(text);
+    }
+    fprintf(stderr, "%zu random texts\n", rounds);
+
+    size_t mutations = ZLTestIterations(8000);
+    size_t rejected = 0;
+    for (size_t round = 0; round < mutations; round++) {
+        size_t length = 0;
+        uint8_t *text = ZLUTF8TestRandomText(&random, &length);
+        size_t mutatedLength = 0;
+        uint8_t *mutated = ZLTestMutate(&random, text, length, "\x80\xbf\xc2\xe0\xed\xf0\xf4\xff", &mutatedLength);
+        if (ZLUTF8TestReference(mutated, mutatedLength) == ZLUTF8TestInvalid) {
+            rejected++;
+        }
+        ZLUTF8TestCompare(&random, mutated, mutatedLength, "mutation", round);
+        free(mutated);
+        free(text);
+    }
+    fprintf(stderr, "%zu mutations (%zu rejected)\n", mutations, rejected);
+
+    return ZLTestFinish("ZLUTF8ValidatorTests");
+}
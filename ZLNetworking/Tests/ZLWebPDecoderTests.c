@@ -0,0 +1,577 @@
+//
+//  ZLWebPDecoderTests.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLTestSupport.h"
+#include "ZLWebPDecoder.h"
+
+/// 随机生成动画（VP8L、带或不带 ALPH 的 VP8、blending、disposal、超出画布的帧、夹杂不认识的块），写成动画 WebP，
+/// 再用一个逐像素的参考合成器算出每帧画面，与解码器整体追加、随机分片追加的结果逐帧比较。
+/// 真正的 VP8/VP8L 码流在 iOS 上交给 ImageIO，这里的帧数据是未压缩的像素：VP8L 块放预乘 ARGB，VP8 块放预乘 RGB、
+/// ALPH 块放 alpha，测试的 frameDecoder 校验解码器重新包装出的单帧文件结构后把像素原样取出
+#define ZLWebPTestMaxFrames 6
+
+typedef enum ZLWebPTestKind {
+    ZLWebPTestKindLossless = 0,
+    ZLWebPTestKindLossyAlpha,
+    ZLWebPTestKindLossy,
+} ZLWebPTestKind;
+
+typedef struct ZLWebPTestFrame {
+    ZLWebPRect rect;
+    uint32_t duration;
+    bool blend;
+    bool disposeBackground;
+    ZLWebPTestKind kind;
+    bool broken;                // 帧数据长度不对，frameDecoder 返回 false
+    uint32_t *pixels;           // rect.width * rect.height 个预乘 ARGB
+} ZLWebPTestFrame;
+
+typedef struct ZLWebPTestImage {
+    uint32_t width;
+    uint32_t height;
+    uint16_t loopCount;
+    ZLWebPTestFrame frames[ZLWebPTestMaxFrames];
+    size_t frameCount;
+} ZLWebPTestImage;
+
+/* 编码器 */
+
+static void ZLWebPTestAppendUInt24(ZLTestBuffer *buffer, uint32_t value) {
+    uint8_t bytes[3] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16)};
+    ZLTestBufferAppend(buffer, bytes, 3);
+}
+
+static void ZLWebPTestAppendUInt32(ZLTestBuffer *buffer, uint32_t value) {
+    uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+    ZLTestBufferAppend(buffer, bytes, 4);
+}
+
+static void ZLWebPTestAppendChunk(ZLTestBuffer *file, const char *type, const void *data, size_t length) {
+    ZLTestBufferAppend(file, type, 4);
+    ZLWebPTestAppendUInt32(file, (uint32_t)length);
+    ZLTestBufferAppend(file, data, length);
+    if (length & 1) {
+        ZLTestBufferAppend(file, "", 1);
+    }
+}
+
+static void ZLWebPTestAppendUnknownChunk(ZLTestRandom *random, ZLTestBuffer *file) {
+    static const char *types[4] = {"ICCP", "EXIF", "XMP ", "ZLZL"};
+    uint8_t payload[7];
+    size_t length = (size_t)ZLTestRandomBelow(random, sizeof(payload) + 1);
+    for (size_t i = 0; i < length; i++) {
+        payload[i] = (uint8_t)ZLTestRandomNext(random);
+    }
+    ZLWebPTestAppendChunk(file, types[ZLTestRandomBelow(random, 4)], payload, length);
+}
+
+/// 一帧的 ANMF 负载：帧头、子块
+static void ZLWebPTestAppendFrame(ZLTestRandom *random, const ZLWebPTestFrame *frame, ZLTestBuffer *file) {
+    ZLTestBuffer chunk = {0};
+    ZLWebPTestAppendUInt24(&chunk, frame->rect.x / 2);
+    ZLWebPTestAppendUInt24(&chunk, frame->rect.y / 2);
+    ZLWebPTestAppendUInt24(&chunk, frame->rect.width - 1);
+    ZLWebPTestAppendUInt24(&chunk, frame->rect.height - 1);
+    ZLWebPTestAppendUInt24(&chunk, frame->duration);
+    uint8_t flags = (uint8_t)((frame->blend ? 0 : 0x02) | (frame->disposeBackground ? 0x01 : 0) | (ZLTestRandomBelow(random, 4) == 0 ? 0xFC : 0));
+    ZLTestBufferAppend(&chunk, &flags, 1);
+    if (ZLTestRandomBelow(random, 6) == 0) {
+        ZLWebPTestAppendUnknownChunk(random, &chunk);
+    }
+
+    size_t area = (size_t)frame->rect.width * frame->rect.height;
+    ZLTestBuffer alpha = {0}, image = {0};
+    for (size_t i = 0; i < area; i++) {
+        uint32_t pixel = frame->pixels[i];
+        uint8_t argb[4] = {(uint8_t)pixel, (uint8_t)(pixel >> 8), (uint8_t)(pixel >> 16), (uint8_t)(pixel >> 24)};
+        if (frame->kind == ZLWebPTestKindLossless) {
+            ZLTestBufferAppend(&image, argb, 4);
+        } else {
+            ZLTestBufferAppend(&image, argb, 3);
+            ZLTestBufferAppend(&alpha, argb + 3, 1);
+        }
+    }
+    if (frame->broken) {
+        ZLTestBufferAppend(&image, "", 1);
+    }
+    if (frame->kind == ZLWebPTestKindLossyAlpha) {
+        ZLWebPTestAppendChunk(&chunk, "ALPH", alpha.bytes, alpha.length);
+    } else if (frame->kind == ZLWebPTestKindLossless && ZLTestRandomBelow(random, 4) == 0) {
+        // VP8L 前面的 ALPH 应该被忽略
+        ZLWebPTestAppendChunk(&chunk, "ALPH", "\1\2\3", 3);
+    }
+    ZLWebPTestAppendChunk(&chunk, frame->kind == ZLWebPTestKindLossless ? "VP8L" : "VP8 ", image.bytes, image.length);
+    ZLWebPTestAppendChunk(file, "ANMF", chunk.bytes, chunk.length);
+    ZLTestBufferFree(&alpha);
+    ZLTestBufferFree(&image);
+    ZLTestBufferFree(&chunk);
+}
+
+static void ZLWebPTestEncode(ZLTestRandom *random, const ZLWebPTestImage *image, ZLTestBuffer *file) {
+    ZLTestBufferAppend(file, "RIFF\0\0\0\0WEBP", 12);
+    uint8_t header[10] = {0x02, 0, 0, 0};
+    if (ZLTestRandomBelow(random, 2)) {
+        header[0] |= 0x10;
+    }
+    header[4] = (uint8_t)(image->width - 1);
+    header[5] = (uint8_t)((image->width - 1) >> 8);
+    header[6] = (uint8_t)((image->width - 1) >> 16);
+    header[7] = (uint8_t)(image->height - 1);
+    header[8] = (uint8_t)((image->height - 1) >> 8);
+    header[9] = (uint8_t)((image->height - 1) >> 16);
+    ZLWebPTestAppendChunk(file, "VP8X", header, sizeof(header));
+    if (ZLTestRandomBelow(random, 4) == 0) {
+        ZLWebPTestAppendUnknownChunk(random, file);
+    }
+
+    uint8_t animation[6] = {0, 0, 0, 0, (uint8_t)image->loopCount, (uint8_t)(image->loopCount >> 8)};
+    ZLWebPTestAppendChunk(file, "ANIM", animation, sizeof(animation));
+    for (size_t i = 0; i < image->frameCount; i++) {
+        ZLWebPTestAppendFrame(random, &image->frames[i], file);
+    }
+    if (ZLTestRandomBelow(random, 4) == 0) {
+        ZLWebPTestAppendUnknownChunk(random, file);
+    }
+    uint32_t riffLength = (uint32_t)(file->length - 8);
+    uint8_t *p = (uint8_t *)file->bytes + 4;
+    p[0] = (uint8_t)riffLength;
+    p[1] = (uint8_t)(riffLength >> 8);
+    p[2] = (uint8_t)(riffLength >> 16);
+    p[3] = (uint8_t)(riffLength >> 24);
+}
+
+/* 测试用的 frameDecoder */
+
+typedef struct ZLWebPTestChunkReader {
+    const uint8_t *bytes;
+    size_t length;
+    size_t offset;
+} ZLWebPTestChunkReader;
+
+static bool ZLWebPTestNextChunk(ZLWebPTestChunkReader *reader, const char *type, const uint8_t **payload, uint32_t *length) {
+    if (reader->length - reader->offset < 8 || memcmp(reader->bytes + reader->offset, type, 4) != 0) {
+        return false;
+    }
+    const uint8_t *p = reader->bytes + reader->offset + 4;
+    *length = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    size_t padded = (size_t)*length + (*length & 1);
+    if (padded > reader->length - reader->offset - 8) {
+        return false;
+    }
+    *payload = reader->bytes + reader->offset + 8;
+    reader->offset += 8 + padded;
+    return true;
+}
+
+static bool ZLWebPTestDecodeFrame(const uint8_t *bytes, size_t length, uint32_t width, uint32_t height, uint32_t *pixels, void *info) {
+    size_t *calls = info;
+    (*calls)++;
+    if (length < 12 || memcmp(bytes, "RIFF", 4) != 0 || memcmp(bytes + 8, "WEBP", 4) != 0) {
+        return false;
+    }
+    uint32_t riffLength = (uint32_t)bytes[4] | ((uint32_t)bytes[5] << 8) | ((uint32_t)bytes[6] << 16) | ((uint32_t)bytes[7] << 24);
+    if (riffLength != length - 8) {
+        return false;
+    }
+    ZLWebPTestChunkReader reader = {bytes, length, 12};
+    size_t area = (size_t)width * height;
+    const uint8_t *payload, *alpha = NULL;
+    uint32_t payloadLength;
+    if (ZLWebPTestNextChunk(&reader, "VP8X", &payload, &payloadLength)) {
+        if (payloadLength != 10) {
+            return false;
+        }
+        uint32_t headerWidth = 1 + ((uint32_t)payload[4] | ((uint32_t)payload[5] << 8) | ((uint32_t)payload[6] << 16));
+        uint32_t headerHeight = 1 + ((uint32_t)payload[7] | ((uint32_t)payload[8] << 8) | ((uint32_t)payload[9] << 16));
+        if (payload[0] != 0x10 || headerWidth != width || headerHeight != height ||
+            !ZLWebPTestNextChunk(&reader, "ALPH", &alpha, &payloadLength) || payloadLength != area) {
+            return false;
+        }
+    }
+    if (ZLWebPTestNextChunk(&reader, "VP8L", &payload, &payloadLength)) {
+        if (alpha || payloadLength != area * 4) {
+            return false;
+        }
+        for (size_t i = 0; i < area; i++) {
+            const uint8_t *p = payload + i * 4;
+            pixels[i] = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        }
+    } else if (ZLWebPTestNextChunk(&reader, "VP8 ", &payload, &payloadLength)) {
+        if (payloadLength != area * 3) {
+            return false;
+        }
+        for (size_t i = 0; i < area; i++) {
+            const uint8_t *p = payload + i * 3;
+            uint32_t a = alpha ? alpha[i] : 255;
+            pixels[i] = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | (a << 24);
+        }
+    } else {
+        return false;
+    }
+    return reader.offset == length;
+}
+
+/* 随机图像 */
+
+/// alpha 偏向 0 和 255，颜色分量不超过 alpha
+static uint32_t ZLWebPTestRandomPixel(ZLTestRandom *random, bool opaque) {
+    uint32_t a = 255;
+    if (!opaque) {
+        uint64_t choice = ZLTestRandomBelow(random, 4);
+        a = choice == 0 ? 0 : (choice == 1 ? 255 : (uint32_t)ZLTestRandomBelow(random, 256));
+    }
+    uint32_t r = (uint32_t)ZLTestRandomBelow(random, a + 1);
+    uint32_t g = (uint32_t)ZLTestRandomBelow(random, a + 1);
+    uint32_t b = (uint32_t)ZLTestRandomBelow(random, a + 1);
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+static void ZLWebPTestRandomImage(ZLTestRandom *random, ZLWebPTestImage *image) {
+    memset(image, 0, sizeof(*image));
+    image->width = 1 + (uint32_t)ZLTestRandomBelow(random, 40);
+    image->height = 1 + (uint32_t)ZLTestRandomBelow(random, 40);
+    image->loopCount = (uint16_t)ZLTestRandomBelow(random, 4);
+    image->frameCount = 1 + (size_t)ZLTestRandomBelow(random, ZLWebPTestMaxFrames);
+    for (size_t i = 0; i < image->frameCount; i++) {
+        ZLWebPTestFrame *frame = &image->frames[i];
+        if (ZLTestRandomBelow(random, 4) == 0) {
+            frame->rect.width = image->width;
+            frame->rect.height = image->height;
+        } else {
+            // 偏移只能是偶数；偶尔超出画布，解码器只合成重叠的部分
+            frame->rect.x = (uint32_t)ZLTestRandomBelow(random, image->width) & ~1u;
+            frame->rect.y = (uint32_t)ZLTestRandomBelow(random, image->height) & ~1u;
+            uint32_t extra = ZLTestRandomBelow(random, 8) == 0 ? 4 : 0;
+            frame->rect.width = 1 + (uint32_t)ZLTestRandomBelow(random, image->width - frame->rect.x + extra);
+            frame->rect.height = 1 + (uint32_t)ZLTestRandomBelow(random, image->height - frame->rect.y + extra);
+        }
+        frame->duration = (uint32_t)ZLTestRandomBelow(random, ZLTestRandomBelow(random, 4) ? 1000 : 12);
+        frame->blend = ZLTestRandomBelow(random, 2);
+        frame->disposeBackground = ZLTestRandomBelow(random, 2);
+        frame->kind = (ZLWebPTestKind)ZLTestRandomBelow(random, 3);
+        frame->broken = ZLTestRandomBelow(random, 12) == 0;
+        size_t area = (size_t)frame->rect.width * frame->rect.height;
+        frame->pixels = malloc(area * sizeof(uint32_t));
+        if (frame->pixels == NULL) {
+            abort();
+        }
+        for (size_t p = 0; p < area; p++) {
+            frame->pixels[p] = ZLWebPTestRandomPixel(random, frame->kind == ZLWebPTestKindLossy);
+        }
+    }
+}
+
+static void ZLWebPTestFreeImage(ZLWebPTestImage *image) {
+    for (size_t i = 0; i < image->frameCount; i++) {
+        free(image->frames[i].pixels);
+    }
+}
+
+/* 参考合成器 */
+
+static uint32_t ZLWebPTestScale(uint32_t c, uint32_t a) {
+    return (c * a * 2 + 255) / 510;
+}
+
+static uint32_t ZLWebPTestOver(uint32_t src, uint32_t dst) {
+    uint32_t inverse = 255 - (src >> 24);
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        result |= (((src >> shift) & 0xFF) + ZLWebPTestScale((dst >> shift) & 0xFF, inverse)) << shift;
+    }
+    return result;
+}
+
+/// 每帧合成后的完整画面，frameCount 块依次排列；解码失败的帧不改动画布，disposal 照常处理
+static uint32_t *ZLWebPTestReference(const ZLWebPTestImage *image) {
+    size_t area = (size_t)image->width * image->height;
+    uint32_t *snapshots = calloc(area * image->frameCount, sizeof(uint32_t));
+    uint32_t *canvas = calloc(area, sizeof(uint32_t));
+    if (snapshots == NULL || canvas == NULL) {
+        abort();
+    }
+    for (size_t i = 0; i < image->frameCount; i++) {
+        const ZLWebPTestFrame *frame = &image->frames[i];
+        for (uint32_t y = 0; y < frame->rect.height && !frame->broken; y++) {
+            for (uint32_t x = 0; x < frame->rect.width; x++) {
+                uint32_t canvasX = frame->rect.x + x, canvasY = frame->rect.y + y;
+                if (canvasX >= image->width || canvasY >= image->height) {
+                    continue;
+                }
+                uint32_t pixel = frame->pixels[(size_t)y * frame->rect.width + x];
+                uint32_t *target = canvas + (size_t)canvasY * image->width + canvasX;
+                *target = frame->blend ? ZLWebPTestOver(pixel, *target) : pixel;
+            }
+        }
+        memcpy(snapshots + area * i, canvas, area * sizeof(uint32_t));
+        if (frame->disposeBackground) {
+            for (uint32_t y = frame->rect.y; y < image->height && y - frame->rect.y < frame->rect.height; y++) {
+                for (uint32_t x = frame->rect.x; x < image->width && x - frame->rect.x < frame->rect.width; x++) {
+                    canvas[(size_t)y * image->width + x] = 0;
+                }
+            }
+        }
+    }
+    free(canvas);
+    return snapshots;
+}
+
+/* 差分比较 */
+
+/// 合成所有已收全的帧，逐帧与参考画面比较，并检查 dirtyRect 之外的像素没有变化
+static void ZLWebPTestRenderAvailable(ZLWebPCanvas *canvas, const ZLWebPDecoder *decoder, const ZLWebPTestImage *image,
+                                      const uint32_t *reference, uint32_t *before, uint64_t seed) {
+    size_t area = (size_t)image->width * image->height;
+    while (ZLWebPCanvasNextFrameIndex(canvas) < ZLWebPDecoderFrameCount(decoder)) {
+        size_t index = ZLWebPCanvasNextFrameIndex(canvas);
+        memcpy(before, ZLWebPCanvasPixels(canvas), area * sizeof(uint32_t));
+        ZLWebPRect dirty;
+        ZLTestCheck(ZLWebPCanvasRenderNextFrame(canvas, decoder, &dirty), "seed %" PRIu64 " frame %zu", seed, index);
+        const uint32_t *pixels = ZLWebPCanvasPixels(canvas);
+        size_t mismatch = SIZE_MAX, outside = SIZE_MAX;
+        for (size_t p = 0; p < area; p++) {
+            uint32_t x = (uint32_t)(p % image->width), y = (uint32_t)(p / image->width);
+            if (mismatch == SIZE_MAX && pixels[p] != reference[area * index + p]) {
+                mismatch = p;
+            }
+            bool inside = x >= dirty.x && x - dirty.x < dirty.width && y >= dirty.y && y - dirty.y < dirty.height;
+            if (outside == SIZE_MAX && !inside && pixels[p] != before[p]) {
+                outside = p;
+            }
+        }
+        ZLTestCheck(mismatch == SIZE_MAX, "seed %" PRIu64 " frame %zu pixel %zu: %08x, expected %08x (kind %d blend %d)",
+                    seed, index, mismatch, pixels[mismatch == SIZE_MAX ? 0 : mismatch], reference[area * index + (mismatch == SIZE_MAX ? 0 : mismatch)],
+                    image->frames[index].kind, image->frames[index].blend);
+        ZLTestCheck(outside == SIZE_MAX, "seed %" PRIu64 " frame %zu changed pixel %zu outside the dirty rect", seed, index, outside);
+    }
+}
+
+static void ZLWebPTestDecode(ZLTestRandom *random, const ZLWebPTestImage *image, const ZLTestBuffer *file,
+                             const uint32_t *reference, bool chunked, uint64_t seed) {
+    size_t calls = 0;
+    ZLWebPDecoder *decoder = ZLWebPDecoderCreate(ZLWebPTestDecodeFrame, &calls);
+    ZLWebPCanvas *canvas = NULL;
+    uint32_t *before = malloc((size_t)image->width * image->height * sizeof(uint32_t));
+    if (decoder == NULL || before == NULL) {
+        abort();
+    }
+    size_t offset = 0;
+    size_t previousFrameCount = 0;
+    while (offset < file->length) {
+        size_t length = chunked ? 1 + (size_t)ZLTestRandomBelow(random, ZLTestRandomBelow(random, 2) ? 16 : 512) : file->length;
+        if (length > file->length - offset) {
+            length = file->length - offset;
+        }
+        uint8_t *bytes = ZLTestCopyBytes(file->bytes + offset, length);
+        ZLTestCheck(ZLWebPDecoderAppend(decoder, bytes, length), "seed %" PRIu64 " append at %zu", seed, offset);
+        free(bytes);
+        offset += length;
+
+        size_t frameCount = ZLWebPDecoderFrameCount(decoder);
+        ZLTestCheck(frameCount >= previousFrameCount && frameCount <= image->frameCount, "seed %" PRIu64 " frame count %zu", seed, frameCount);
+        previousFrameCount = frameCount;
+        ZLTestCheck(ZLWebPDecoderIsComplete(decoder) == (offset == file->length), "seed %" PRIu64 " complete at %zu", seed, offset);
+        if (canvas == NULL) {
+            canvas = ZLWebPCanvasCreate(decoder);
+        }
+        if (canvas) {
+            ZLWebPTestRenderAvailable(canvas, decoder, image, reference, before, seed);
+        }
+    }
+
+    ZLTestCheck(ZLWebPDecoderFrameCount(decoder) == image->frameCount, "seed %" PRIu64 " %zu frames, expected %zu", seed,
+                ZLWebPDecoderFrameCount(decoder), image->frameCount);
+    ZLTestCheck(ZLWebPDecoderWidth(decoder) == image->width && ZLWebPDecoderHeight(decoder) == image->height, "seed %" PRIu64 " size", seed);
+    ZLTestCheck(ZLWebPDecoderLoopCount(decoder) == image->loopCount, "seed %" PRIu64 " loop count", seed);
+    ZLTestCheck(ZLWebPDecoderDataLength(decoder) == file->length, "seed %" PRIu64 " data length", seed);
+    for (size_t i = 0; i < image->frameCount; i++) {
+        uint32_t expected = image->frames[i].duration <= 10 ? 100 : image->frames[i].duration;
+        ZLTestCheck(ZLWebPDecoderFrameDuration(decoder, i) == expected, "seed %" PRIu64 " frame %zu duration %u", seed, i, ZLWebPDecoderFrameDuration(decoder, i));
+    }
+    // 回到开头再播一遍，复用帧缓冲和单帧文件
+    if (canvas) {
+        ZLWebPCanvasReset(canvas);
+        ZLWebPTestRenderAvailable(canvas, decoder, image, reference, before, seed);
+        ZLTestCheck(!ZLWebPCanvasRenderNextFrame(canvas, decoder, NULL), "seed %" PRIu64 " render past the end", seed);
+    }
+    ZLWebPCanvasDestroy(canvas);
+    ZLWebPDecoderDestroy(decoder);
+    free(before);
+}
+
+static void ZLWebPTestRandomImages(ZLTestRandom *random, size_t rounds) {
+    for (size_t round = 0; round < rounds; round++) {
+        uint64_t seed = ZLTestRandomNext(random);
+        ZLTestRandom imageRandom = ZLTestRandomMake(seed);
+        ZLWebPTestImage image;
+        ZLWebPTestRandomImage(&imageRandom, &image);
+        ZLTestBuffer file = {0};
+        ZLWebPTestEncode(&imageRandom, &image, &file);
+        uint32_t *reference = ZLWebPTestReference(&image);
+
+        ZLTestCheck(ZLWebPSniff((const uint8_t *)file.bytes, file.length) == ZLWebPSniffAnimated, "seed %" PRIu64 " sniff", seed);
+        ZLWebPTestDecode(&imageRandom, &image, &file, reference, false, seed);
+        ZLWebPTestDecode(&imageRandom, &image, &file, reference, true, seed);
+
+        free(reference);
+        ZLTestBufferFree(&file);
+        ZLWebPTestFreeImage(&image);
+    }
+}
+
+/* 变异 */
+
+/// 只要求不崩溃、不越界；数据损坏后已解析的帧仍能合成
+static void ZLWebPTestMutations(ZLTestRandom *random, size_t rounds) {
+    for (size_t round = 0; round < rounds; round++) {
+        ZLWebPTestImage image;
+        ZLWebPTestRandomImage(random, &image);
+        ZLTestBuffer file = {0};
+        ZLWebPTestEncode(random, &image, &file);
+        size_t length;
+        uint8_t *mutated = ZLTestMutate(random, (const uint8_t *)file.bytes, file.length, "\1\2\x10 8AFHILMNPRXV", &length);
+        ZLWebPSniff(mutated, length);
+
+        size_t calls = 0;
+        ZLWebPDecoder *decoder = ZLWebPDecoderCreate(ZLWebPTestDecodeFrame, &calls);
+        ZLWebPCanvas *canvas = NULL;
+        size_t offset = 0;
+        while (offset < length) {
+            size_t chunk = 1 + (size_t)ZLTestRandomBelow(random, 256);
+            if (chunk > length - offset) {
+                chunk = length - offset;
+            }
+            uint8_t *bytes = ZLTestCopyBytes(mutated + offset, chunk);
+            bool valid = ZLWebPDecoderAppend(decoder, bytes, chunk);
+            free(bytes);
+            offset += chunk;
+            if (canvas == NULL) {
+                canvas = ZLWebPCanvasCreate(decoder);
+            }
+            while (canvas && ZLWebPCanvasRenderNextFrame(canvas, decoder, NULL)) {
+            }
+            if (!valid) {
+                ZLTestCheck(ZLWebPDecoderIsComplete(decoder), "round %zu corrupted but not complete", round);
+                ZLTestCheck(!ZLWebPDecoderAppend(decoder, mutated, 1), "round %zu append after corruption", round);
+                break;
+            }
+        }
+        ZLWebPCanvasDestroy(canvas);
+        ZLWebPDecoderDestroy(decoder);
+        free(mutated);
+        ZLTestBufferFree(&file);
+        ZLWebPTestFreeImage(&image);
+    }
+}
+
+/* 固定用例 */
+
+/// 2x1 画布上的一帧 VP8L：不透明红色和半透明蓝色
+static void ZLWebPTestSimpleFile(ZLTestBuffer *file, uint32_t duration, bool withFrame) {
+    ZLTestBufferAppend(file, "RIFF\0\0\0\0WEBP", 12);
+    static const uint8_t header[10] = {0x12, 0, 0, 0, 1, 0, 0, 0, 0, 0};
+    ZLWebPTestAppendChunk(file, "VP8X", header, sizeof(header));
+    static const uint8_t animation[6] = {0, 0, 0, 0, 2, 0};
+    ZLWebPTestAppendChunk(file, "ANIM", animation, sizeof(animation));
+    ZLTestBuffer chunk = {0};
+    ZLWebPTestAppendUInt24(&chunk, 0);
+    ZLWebPTestAppendUInt24(&chunk, 0);
+    ZLWebPTestAppendUInt24(&chunk, 1);
+    ZLWebPTestAppendUInt24(&chunk, 0);
+    ZLWebPTestAppendUInt24(&chunk, duration);
+    ZLTestBufferAppend(&chunk, "\2", 1);
+    if (withFrame) {
+        static const uint8_t pixels[8] = {0, 0, 255, 255, 128, 0, 0, 128};
+        ZLWebPTestAppendChunk(&chunk, "VP8L", pixels, sizeof(pixels));
+    }
+    ZLWebPTestAppendChunk(file, "ANMF", chunk.bytes, chunk.length);
+    ZLTestBufferFree(&chunk);
+    uint32_t riffLength = (uint32_t)(file->length - 8);
+    memcpy(file->bytes + 4, (uint8_t[4]){(uint8_t)riffLength, (uint8_t)(riffLength >> 8), 0, 0}, 4);
+}
+
+static void ZLWebPTestFixedCases(void) {
+    ZLTestBuffer file = {0};
+    ZLWebPTestSimpleFile(&file, 40, true);
+    const uint8_t *bytes = (const uint8_t *)file.bytes;
+    ZLTestCheck(ZLWebPSniff(bytes, 4) == ZLWebPSniffNeedMoreData, "RIFF prefix");
+    ZLTestCheck(ZLWebPSniff(bytes, 20) == ZLWebPSniffNeedMoreData, "VP8X header only");
+    ZLTestCheck(ZLWebPSniff(bytes, 21) == ZLWebPSniffAnimated, "VP8X flags");
+    ZLTestCheck(ZLWebPSniff((const uint8_t *)"RIFF\0\0\0\0WAVE", 12) == ZLWebPSniffNotAnimated, "WAVE");
+    ZLTestCheck(ZLWebPSniff((const uint8_t *)"RIFF\0\0\0\0WEBPVP8 \0\0\0\0\0", 21) == ZLWebPSniffNotAnimated, "still lossy WebP");
+    ZLTestCheck(ZLWebPSniff((const uint8_t *)"GIF89a", 6) == ZLWebPSniffNotAnimated, "GIF");
+
+    size_t calls = 0;
+    ZLWebPDecoder *decoder = ZLWebPDecoderCreate(ZLWebPTestDecodeFrame, &calls);
+    ZLTestCheck(ZLWebPDecoderAppend(decoder, bytes, file.length) && ZLWebPDecoderFrameCount(decoder) == 1 && ZLWebPDecoderIsComplete(decoder), "simple WebP");
+    ZLTestCheck(ZLWebPDecoderWidth(decoder) == 2 && ZLWebPDecoderHeight(decoder) == 1, "canvas size");
+    ZLTestCheck(ZLWebPDecoderLoopCount(decoder) == 2 && ZLWebPDecoderFrameDuration(decoder, 0) == 40 && ZLWebPDecoderFrameDuration(decoder, 1) == 0, "loop count and duration");
+    ZLWebPCanvas *canvas = ZLWebPCanvasCreate(decoder);
+    ZLWebPRect dirty;
+    ZLTestCheck(canvas && ZLWebPCanvasRenderNextFrame(canvas, decoder, &dirty), "render simple WebP");
+    if (canvas) {
+        const uint32_t *pixels = ZLWebPCanvasPixels(canvas);
+        ZLTestCheck(pixels[0] == 0xFFFF0000u && pixels[1] == 0x80000080u, "pixels %08x %08x", pixels[0], pixels[1]);
+        ZLTestCheck(dirty.x == 0 && dirty.y == 0 && dirty.width == 2 && dirty.height == 1, "dirty rect");
+        ZLTestCheck(calls == 1, "frame decoder called %zu times", calls);
+    }
+    ZLWebPCanvasDestroy(canvas);
+    ZLWebPDecoderDestroy(decoder);
+
+    // 没有 frameDecoder 时帧照常推进，画布保持透明
+    decoder = ZLWebPDecoderCreate(NULL, NULL);
+    ZLWebPDecoderAppend(decoder, bytes, file.length);
+    canvas = ZLWebPCanvasCreate(decoder);
+    ZLTestCheck(canvas && ZLWebPCanvasRenderNextFrame(canvas, decoder, NULL) && ZLWebPCanvasPixels(canvas)[0] == 0, "no frame decoder");
+    ZLWebPCanvasDestroy(canvas);
+    ZLWebPDecoderDestroy(decoder);
+
+    // 不超过 10ms 的时长按 100ms
+    ZLTestBufferClear(&file);
+    ZLWebPTestSimpleFile(&file, 10, true);
+    decoder = ZLWebPDecoderCreate(ZLWebPTestDecodeFrame, &calls);
+    ZLWebPDecoderAppend(decoder, (const uint8_t *)file.bytes, file.length);
+    ZLTestCheck(ZLWebPDecoderFrameDuration(decoder, 0) == 100, "tiny duration");
+    ZLWebPDecoderDestroy(decoder);
+
+    // ANMF 里没有码流
+    ZLTestBufferClear(&file);
+    ZLWebPTestSimpleFile(&file, 40, false);
+    decoder = ZLWebPDecoderCreate(ZLWebPTestDecodeFrame, &calls);
+    ZLTestCheck(!ZLWebPDecoderAppend(decoder, (const uint8_t *)file.bytes, file.length) && ZLWebPDecoderIsComplete(decoder), "frame without bitstream");
+    ZLTestCheck(ZLWebPDecoderFrameCount(decoder) == 0, "no frames");
+    ZLWebPDecoderDestroy(decoder);
+
+    // 静态 WebP 交给系统解码
+    decoder = ZLWebPDecoderCreate(ZLWebPTestDecodeFrame, &calls);
+    ZLTestCheck(!ZLWebPDecoderAppend(decoder, (const uint8_t *)"RIFF\x0e\0\0\0WEBPVP8L\x02\0\0\0\x2f\0", 22), "still WebP");
+    ZLWebPDecoderDestroy(decoder);
+
+    // 超过像素上限的画布
+    static const uint8_t oversized[30] = {'R', 'I', 'F', 'F', 22, 0, 0, 0, 'W', 'E', 'B', 'P', 'V', 'P', '8', 'X', 10, 0, 0, 0,
+                                          0x02, 0, 0, 0, 0xFF, 0x3F, 0, 0xFF, 0x3F, 0};
+    decoder = ZLWebPDecoderCreate(ZLWebPTestDecodeFrame, &calls);
+    ZLTestCheck(!ZLWebPDecoderAppend(decoder, oversized, sizeof(oversized)) && ZLWebPDecoderWidth(decoder) == 0, "oversized header");
+    ZLTestCheck(ZLWebPCanvasCreate(decoder) == NULL, "no canvas for an oversized header");
+    ZLWebPDecoderDestroy(decoder);
+
+    ZLTestBufferFree(&file);
+}
+
+int main(int argc, char **argv) {
+    ZLTestRandom random = ZLTestRandomMake(ZLTestSeed(argc, argv));
+
+    ZLWebPTestFixedCases();
+
+    size_t rounds = ZLTestIterations(400);
+    ZLWebPTestRandomImages(&random, rounds);
+    fprintf(stderr, "%zu random animations\n", rounds);
+
+    ZLWebPTestMutations(&random, ZLTestIterations(2000));
+
+    return ZLTestFinish("ZLWebPDecoderTests");
+}
@@ -0,0 +1,402 @@
+//
+//  ZLXMLPullParserTests.c
+//  ZLNetworking
+//
+//  Created by lylaut on 2022/4/2.
+//
+
+#include "ZLTestSupport.h"
+#include "ZLXMLPullParser.h"
+
+/// 把事件序列记录成文本：S/E 为开始/结束标签（名字、之前的文本、属性），C 为注释，D 为文档结束，X 为错误
+static void ZLXMLTestRecordBytes(ZLTestBuffer *transcript, const char *bytes, size_t length) {
+    ZLTestBufferAppendFormat(transcript, "%zu:", length);
+    ZLTestBufferAppend(transcript, bytes, length);
+}
+
+static bool ZLXMLTestRecordEvent(ZLXMLPullParser *parser, ZLXMLEvent event, ZLTestBuffer *transcript) {
+    size_t length = 0;
+    const char *bytes = NULL;
+    switch (event) {
+        case ZLXMLEventStartElement:
+        case ZLXMLEventEndElement: {
+            ZLTestBufferAppend(transcript, event == ZLXMLEventStartElement ? "S " : "E ", 2);
+            bytes = ZLXMLPullParserNameBytes(parser, ZLXMLPullParserElementName(parser), &length);
+            ZLXMLTestRecordBytes(transcript, bytes, length);
+            ZLTestBufferAppend(transcript, " T ", 3);
+            bytes = ZLXMLPullParserText(parser, &length);
+            ZLXMLTestRecordBytes(transcript, bytes, length);
+            size_t count = ZLXMLPullParserAttributeCount(parser);
+            for (size_t i = 0; i < count; i++) {
+                uint32_t name = 0;
+                const char *value = ZLXMLPullParserAttribute(parser, i, &name, &length);
+                size_t valueLength = length;
+                ZLTestBufferAppend(transcript, " A ", 3);
+                bytes = ZLXMLPullParserNameBytes(parser, name, &length);
+                ZLXMLTestRecordBytes(transcript, bytes, length);
+                ZLTestBufferAppend(transcript, "=", 1);
+                ZLXMLTestRecordBytes(transcript, value, valueLength);
+            }
+            ZLTestBufferAppend(transcript, "\n", 1);
+            return true;
+        }
+        case ZLXMLEventComment:
+            ZLTestBufferAppend(transcript, "C ", 2);
+            bytes = ZLXMLPullParserComment(parser, &length);
+            ZLXMLTestRecordBytes(transcript, bytes, length);
+            ZLTestBufferAppend(transcript, "\n", 1);
+            return true;
+        case ZLXMLEventEndDocument:
+            ZLTestBufferAppend(transcript, "D\n", 2);
+            return false;
+        default:
+            ZLTestBufferAppend(transcript, "X\n", 2);
+            return false;
+    }
+}
+
+/// 一次给出全部数据
+static void ZLXMLTestParseWhole(const uint8_t *document, size_t length, ZLTestBuffer *transcript) {
+    uint8_t *bytes = ZLTestCopyBytes(document, length);
+    ZLXMLPullParser *parser = ZLXMLPullParserCreate(bytes, length);
+    ZLTestCheck(parser != NULL, "create");
+    for (;;) {
+        ZLXMLEvent event = ZLXMLPullParserNext(parser);
+        ZLTestCheck(event != ZLXMLEventNeedMoreData, "final input asked for more data");
+        if (event == ZLXMLEventNeedMoreData || !ZLXMLTestRecordEvent(parser, event, transcript)) {
+            break;
+        }
+    }
+    ZLXMLPullParserDestroy(parser);
+    free(bytes);
+}
+
+/// 随机长度分片，每次都把已收到的数据放到新地址，模拟 NSMutableData 增长时的重新分配
+static void ZLXMLTestParseChunked(const uint8_t *document, size_t length, ZLTestRandom *random, ZLTestBuffer *transcript) {
+    size_t maxChunk = 1 + (size_t)ZLTestRandomBelow(random, length / 4 + 2);
+    size_t fed = 1 + (size_t)ZLTestRandomBelow(random, maxChunk);
+    fed = fed < length ? fed : length;
+    uint8_t *bytes = ZLTestCopyBytes(document, fed);
+    ZLXMLPullParser *parser = ZLXMLPullParserCreate(bytes, fed);
+    ZLTestCheck(parser != NULL, "create");
+    ZLXMLPullParserFeed(parser, bytes, fed, fed == length);
+    for (;;) {
+        ZLXMLEvent event = ZLXMLPullParserNext(parser);
+        if (event == ZLXMLEventNeedMoreData) {
+            ZLTestCheck(fed < length, "final input asked for more data");
+            if (fed == length) {
+                break;
+            }
+            size_t chunk = 1 + (size_t)ZLTestRandomBelow(random, maxChunk);
+            fed = length - fed > chunk ? fed + chunk : length;
+            uint8_t *grown = ZLTestCopyBytes(document, fed);
+            free(bytes);
+            bytes = grown;
+            ZLXMLPullParserFeed(parser, bytes, fed, fed == length);
+            continue;
+        }
+        if (!ZLXMLTestRecordEvent(parser, event, transcript)) {
+            break;
+        }
+    }
+    ZLXMLPullParserDestroy(parser);
+    free(bytes);
+}
+
+/// 分片解析的事件序列必须与一次解析完全相同，包括出错的位置
+static void ZLXMLTestCompareChunked(const uint8_t *document, size_t length, ZLTestRandom *random, size_t rounds, const ZLTestBuffer *whole) {
+    ZLTestBuffer chunked = {0};
+    for (size_t round = 0; round < rounds; round++) {
+        ZLTestBufferClear(&chunked);
+        uint64_t state = random->state;
+        ZLXMLTestParseChunked(document, length, random, &chunked);
+        ZLTestCheck(ZLTestBufferEqual(whole, &chunked), "chunked transcript differs (random state %" PRIu64 ") for %.*s\nwhole:\n%s\nchunked:\n%s",
+                    state, (int)length, (const char *)document, whole->bytes, chunked.bytes);
+    }
+    ZLTestBufferFree(&chunked);
+}
+
+/* 固定用例 */
+
+typedef struct ZLXMLTestCase {
+    const char *document;
+    /// NULL 表示期望解析出错
+    const char *transcript;
+} ZLXMLTestCase;
+
+static const ZLXMLTestCase ZLXMLTestCases[] = {
+    { "<a/>", "S 1:a T 0:\nE 1:a T 0:\nD\n" },
+    { "\xEF\xBB\xBF<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<!DOCTYPE a [<!ENTITY x \"y\">]>\n<a k='v&amp;1' j = \"x\ty\r\nz\">t&lt;&#x4E2D;&#65;<![CDATA[<&>]]><!--c--> u</a>\n",
+      "S 1:a T 0: A 1:k=3:v&1 A 1:j=5:x y z\nC 1:c\nE 1:a T 11:t<\xE4\xB8\xAD" "A<&> u\nD\n" },
+    { "<a><b>1</b><b>2</b>tail</a>", "S 1:a T 0:\nS 1:b T 0:\nE 1:b T 1:1\nS 1:b T 0:\nE 1:b T 1:2\nE 1:a T 4:tail\nD\n" },
+    { "<a>x\r\ny\rz</a>", "S 1:a T 0:\nE 1:a T 5:x\ny\nz\nD\n" },
+    { "<a b='1 > 0'>&quot;&apos;&gt;</a>", "S 1:a T 0: A 1:b=5:1 > 0\nE 1:a T 3:\"'>\nD\n" },
+    { "<a><?pi data?>x<!-- note -->y</a>", "S 1:a T 0:\nC 6: note \nE 1:a T 2:xy\nD\n" },
+    { "<中文 属性=\"值\">&#x1F600;</中文>", "S 6:中文 T 0: A 6:属性=3:值\nE 6:中文 T 4:\xF0\x9F\x98\x80\nD\n" },
+    { "", NULL },
+    { "   ", NULL },
+    { "<a>", NULL },
+    { "<a></b>", NULL },
+    { "<a></a><b/>", NULL },
+    { "<a></a>text", NULL },
+    { "text<a/>", NULL },
+    { "<a b='1' b='2'/>", NULL },
+    { "<a b=1/>", NULL },
+    { "<a b='<'/>", NULL },
+    { "<a>&unknown;</a>", NULL },
+    { "<a>&#0;</a>", NULL },
+    { "<a>&#xD800;</a>", NULL },
+    { "<a>&#x110000;</a>", NULL },
+    { "<a>& </a>", NULL },
+    { "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?><a/>", NULL },
+    { "\xFE\xFF<a/>", NULL },
+    { "<![CDATA[x]]><a/>", NULL },
+    { "<a/><!DOCTYPE a>", NULL },
+    { "<a><!ELEMENT b></a>", NULL },
+    { "<1a/>", NULL },
+    { "<a/ >", NULL },
+    { "<a><!-- unterminated </a>", NULL },
+};
+
+static void ZLXMLTestFixedCases(ZLTestRandom *random) {
+    ZLTestBuffer whole = {0};
+    for (size_t i = 0; i < sizeof(ZLXMLTestCases) / sizeof(ZLXMLTestCases[0]); i++) {
+        const ZLXMLTestCase *testCase = &ZLXMLTestCases[i];
+        const uint8_t *document = (const uint8_t *)testCase->document;
+        size_t length = strlen(testCase->document);
+        ZLTestBufferClear(&whole);
+        ZLXMLTestParseWhole(document, length, &whole);
+        if (testCase->transcript == NULL) {
+            ZLTestCheck(whole.length >= 2 && memcmp(whole.bytes + whole.length - 2, "X\n", 2) == 0,
+                        "case %zu should fail: %s\n%s", i, testCase->document, whole.bytes);
+        } else {
+            ZLTestCheck(strcmp(whole.bytes, testCase->transcript) == 0, "case %zu: %s\nexpected:\n%sgot:\n%s",
+                        i, testCase->document, testCase->transcript, whole.bytes);
+        }
+        ZLXMLTestCompareChunked(document, length, random, 64, &whole);
+    }
+    ZLTestBufferFree(&whole);
+}
+
+/* 随机文档：同时生成文档和期望的事件序列 */
+
+typedef struct ZLXMLTestGenerator {
+    ZLTestRandom *random;
+    ZLTestBuffer document;
+    ZLTestBuffer transcript;
+    /// 上一个标签事件之后累积的文本
+    ZLTestBuffer text;
+} ZLXMLTestGenerator;
+
+static const char *ZLXMLTestNames[] = { "a", "item", "soap:Body", "x-y.z", "_n1", "名字", "k" };
+
+#define ZLXMLTestNameCount (sizeof(ZLXMLTestNames) / sizeof(ZLXMLTestNames[0]))
+
+static const char *ZLXMLTestPick(ZLXMLTestGenerator *generator, const char **strings, size_t count) {
+    return strings[ZLTestRandomBelow(generator->random, count)];
+}
+
+/// 生成一段字符数据，raw 写入文档，decoded 为解码后的内容；attribute 为引号字符时按属性值规则生成
+static void ZLXMLTestGenerateCharacters(ZLXMLTestGenerator *generator, ZLTestBuffer *decoded, char attribute) {
+    static const struct { const char *raw; const char *text; const char *value; } pieces[] = {
+        { "abc", "abc", "abc" },
+        { " ", " ", " " },
+        { "0123", "0123", "0123" },
+        { "\xC3\xA9", "\xC3\xA9", "\xC3\xA9" },
+        { "\xE4\xB8\xAD\xE6\x96\x87", "\xE4\xB8\xAD\xE6\x96\x87", "\xE4\xB8\xAD\xE6\x96\x87" },
+        { "&lt;", "<", "<" },
+        { "&gt;", ">", ">" },
+        { "&amp;", "&", "&" },
+        { "&quot;", "\"", "\"" },
+        { "&apos;", "'", "'" },
+        { "&#65;", "A", "A" },
+        { "&#x4E2D;", "\xE4\xB8\xAD", "\xE4\xB8\xAD" },
+        { "&#x1F600;", "\xF0\x9F\x98\x80", "\xF0\x9F\x98\x80" },
+        { "\t", "\t", " " },
+        { "\n", "\n", " " },
+        { "\r\n", "\n", " " },
+        { ">", ">", ">" },
+        { "'", "'", NULL },
+        { "\"", "\"", NULL },
+    };
+    size_t count = (size_t)ZLTestRandomBelow(generator->random, 6);
+    for (size_t i = 0; i < count; i++) {
+        size_t index = (size_t)ZLTestRandomBelow(generator->random, sizeof(pieces) / sizeof(pieces[0]));
+        const char *raw = pieces[index].raw;
+        const char *value = attribute ? pieces[index].value : pieces[index].text;
+        if (value == NULL) {
+            // 与引号相同的字符只能用实体
+            if (raw[0] == attribute) {
+                continue;
+            }
+            value = raw;
+        }
+        ZLTestBufferAppend(&generator->document, raw, strlen(raw));
+        ZLTestBufferAppend(decoded, value, strlen(value));
+    }
+}
+
+static void ZLXMLTestEmitTag(ZLXMLTestGenerator *generator, char kind, const char *name, const ZLTestBuffer *attributes) {
+    ZLTestBufferAppendFormat(&generator->transcript, "%c ", kind);
+    ZLXMLTestRecordBytes(&generator->transcript, name, strlen(name));
+    ZLTestBufferAppend(&generator->transcript, " T ", 3);
+    ZLXMLTestRecordBytes(&generator->transcript, generator->text.bytes ? generator->text.bytes : "", generator->text.length);
+    if (attributes) {
+        ZLTestBufferAppend(&generator->transcript, attributes->bytes ? attributes->bytes : "", attributes->length);
+    }
+    ZLTestBufferAppend(&generator->transcript, "\n", 1);
+    ZLTestBufferClear(&generator->text);
+}
+
+static void ZLXMLTestGenerateComment(ZLXMLTestGenerator *generator) {
+    static const char *comments[] = { "", " note ", "a-b", "<tag> & stuff", "\xE6\xB3\xA8" };
+    const char *comment = ZLXMLTestPick(generator, comments, sizeof(comments) / sizeof(comments[0]));
+    ZLTestBufferAppendFormat(&generator->document, "<!--%s-->", comment);
+    ZLTestBufferAppend(&generator->transcript, "C ", 2);
+    ZLXMLTestRecordBytes(&generator->transcript, comment, strlen(comment));
+    ZLTestBufferAppend(&generator->transcript, "\n", 1);
+}
+
+static void ZLXMLTestGenerateElement(ZLXMLTestGenerator *generator, unsigned depth) {
+    ZLTestRandom *random = generator->random;
+    const char *name = ZLXMLTestPick(generator, ZLXMLTestNames, ZLXMLTestNameCount);
+    ZLTestBufferAppendFormat(&generator->document, "<%s", name);
+
+    ZLTestBuffer attributes = {0};
+    bool used[ZLXMLTestNameCount] = {false};
+    size_t attributeCount = (size_t)ZLTestRandomBelow(random, 4);
+    for (size_t i = 0; i < attributeCount; i++) {
+        size_t index = (size_t)ZLTestRandomBelow(random, ZLXMLTestNameCount);
+        if (used[index]) {
+            continue;
+        }
+        used[index] = true;
+        char quote = ZLTestRandomBelow(random, 2) ? '"' : '\'';
+        static const char *separators[] = { " ", "\n  ", "\t" };
+        static const char *equals[] = { "=", " = ", "=\n" };
+        ZLTestBufferAppendFormat(&generator->document, "%s%s%s%c", separators[ZLTestRandomBelow(random, 3)], ZLXMLTestNames[index], equals[ZLTestRandomBelow(random, 3)], quote);
+        ZLTestBuffer value = {0};
+        ZLXMLTestGenerateCharacters(generator, &value, quote);
+        ZLTestBufferAppend(&generator->document, &quote, 1);
+        ZLTestBufferAppend(&attributes, " A ", 3);
+        ZLXMLTestRecordBytes(&attributes, ZLXMLTestNames[index], strlen(ZLXMLTestNames[index]));
+        ZLTestBufferAppend(&attributes, "=", 1);
+        ZLXMLTestRecordBytes(&attributes, value.bytes ? value.bytes : "", value.length);
+        ZLTestBufferFree(&value);
+    }
+    if (ZLTestRandomBelow(random, 3) == 0) {
+        ZLTestBufferAppend(&generator->document, " ", 1);
+    }
+
+    if (ZLTestRandomBelow(random, 4) == 0) {
+        ZLTestBufferAppend(&generator->document, "/>", 2);
+        ZLXMLTestEmitTag(generator, 'S', name, &attributes);
+        ZLXMLTestEmitTag(generator, 'E', name, NULL);
+        ZLTestBufferFree(&attributes);
+        return;
+    }
+    ZLTestBufferAppend(&generator->document, ">", 1);
+    ZLXMLTestEmitTag(generator, 'S', name, &attributes);
+    ZLTestBufferFree(&attributes);
+
+    size_t items = (size_t)ZLTestRandomBelow(random, depth < 5 ? 6 : 3);
+    for (size_t i = 0; i < items; i++) {
+        switch (ZLTestRandomBelow(random, depth < 5 ? 6 : 4)) {
+            case 0:
+            case 1:
+                ZLXMLTestGenerateCharacters(generator, &generator->text, 0);
+                break;
+            case 2: {
+                static const char *sections[] = { "", "<raw & text>", "]]", "a]b", "\xE4\xB8\xAD" };
+                const char *section = ZLXMLTestPick(generator, sections, sizeof(sections) / sizeof(sections[0]));
+                ZLTestBufferAppendFormat(&generator->document, "<![CDATA[%s]]>", section);
+                ZLTestBufferAppend(&generator->text, section, strlen(section));
+                break;
+            }
+            case 3:
+                if (ZLTestRandomBelow(random, 2)) {
+                    ZLXMLTestGenerateComment(generator);
+                } else {
+                    ZLTestBufferAppend(&generator->document, "<?pi x=\"?\"?>", 12);
+                }
+                break;
+            default:
+                ZLXMLTestGenerateElement(generator, depth + 1);
+                break;
+        }
+    }
+    ZLTestBufferAppendFormat(&generator->document, "</%s%s>", name, ZLTestRandomBelow(random, 4) == 0 ? " " : "");
+    ZLXMLTestEmitTag(generator, 'E', name, NULL);
+}
+
+static void ZLXMLTestGenerateDocument(ZLXMLTestGenerator *generator) {
+    ZLTestRandom *random = generator->random;
+    ZLTestBufferClear(&generator->document);
+    ZLTestBufferClear(&generator->transcript);
+    ZLTestBufferClear(&generator->text);
+    if (ZLTestRandomBelow(random, 4) == 0) {
+        ZLTestBufferAppend(&generator->document, "\xEF\xBB\xBF", 3);
+    }
+    if (ZLTestRandomBelow(random, 2)) {
+        static const char *declarations[] = { "<?xml version=\"1.0\"?>", "<?xml version='1.0' encoding='utf-8'?>", "<?xml version=\"1.0\" encoding=\"US-ASCII\" standalone=\"yes\"?>" };
+        const char *declaration = ZLXMLTestPick(generator, declarations, 3);
+        ZLTestBufferAppend(&generator->document, declaration, strlen(declaration));
+    }
+    if (ZLTestRandomBelow(random, 3) == 0) {
+        ZLTestBufferAppend(&generator->document, "\n", 1);
+        ZLXMLTestGenerateComment(generator);
+    }
+    if (ZLTestRandomBelow(random, 3) == 0) {
+        static const char *doctype = "\n<!DOCTYPE r SYSTEM \"r>.dtd\" [<!ENTITY e 'a>b'>]>\n";
+        ZLTestBufferAppend(&generator->document, doctype, strlen(doctype));
+    }
+    ZLXMLTestGenerateElement(generator, 0);
+    if (ZLTestRandomBelow(random, 3) == 0) {
+        ZLTestBufferAppend(&generator->document, "\r\n", 2);
+        ZLXMLTestGenerateComment(generator);
+    }
+    if (ZLTestRandomBelow(random, 2)) {
+        ZLTestBufferAppend(&generator->document, "\n", 1);
+    }
+    ZLTestBufferAppend(&generator->transcript, "D\n", 2);
+}
+
+int main(int argc, char **argv) {
+    ZLTestRandom random = ZLTestRandomMake(ZLTestSeed(argc, argv));
+
+    ZLXMLTestFixedCases(&random);
+
+    ZLXMLTestGenerator generator = { .random = &random };
+    ZLTestBuffer whole = {0};
+    size_t documents = ZLTestIterations(2000);
+    size_t mutations = 0, failures = 0;
+    for (size_t i = 0; i < documents; i++) {
+        ZLXMLTestGenerateDocument(&generator);
+        const uint8_t *document = (const uint8_t *)generator.document.bytes;
+        size_t length = generator.document.length;
+        ZLTestBufferClear(&whole);
+        ZLXMLTestParseWhole(document, length, &whole);
+        ZLTestCheck(ZLTestBufferEqual(&whole, &generator.transcript), "document %zu: %s\nexpected:\n%s\ngot:\n%s",
+                    i, generator.document.bytes, generator.transcript.bytes, whole.bytes);
+        ZLXMLTestCompareChunked(document, length, &random, 4, &whole);
+
+        // 变异后的文档没有期望结果，只要求不崩溃、不越界，并且分片与一次解析一致
+        for (size_t j = 0; j < 8; j++) {
+            size_t mutatedLength = 0;
+            uint8_t *mutated = ZLTestMutate(&random, document, length, "<>/=\"'&;!?-[]# \r\n\xEF\xBB\xBF", &mutatedLength);
+            ZLTestBufferClear(&whole);
+            ZLXMLTestParseWhole(mutated, mutatedLength, &whole);
+            failures += whole.length >= 2 && memcmp(whole.bytes + whole.length - 2, "X\n", 2) == 0;
+            mutations++;
+            ZLXMLTestCompareChunked(mutated, mutatedLength, &random, 2, &whole);
+            free(mutated);
+        }
+    }
+    fprintf(stderr, "%zu documents, %zu mutations (%zu rejected)\n", documents, mutations, failures);
+
+    ZLTestBufferFree(&whole);
+    ZLTestBufferFree(&generator.document);
+    ZLTestBufferFree(&generator.transcript);
+    ZLTestBufferFree(&generator.text);
+    return ZLTestFinish("ZLXMLPullParserTests");
+}